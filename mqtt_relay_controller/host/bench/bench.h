@@ -0,0 +1,109 @@
+/*
+ bench.h - shared helpers for the host benchmark runner (env:native_bench).
+*/
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <Arduino.h>
+#include <HostHal.h>
+
+#include "mock_broker.h"
+
+// Firmware entry points (src/main.cpp)
+void setup();
+void loop();
+
+// Console that keeps printing while Serial is silenced
+class BenchOutput : public Print {
+public:
+   size_t write(uint8_t c) override;
+   size_t write(const uint8_t *buffer, size_t size) override;
+   using Print::write;
+};
+
+extern BenchOutput benchOut;
+
+// Cycle and allocation delta over a region
+struct BenchSample {
+   uint64_t cycles;
+   uint64_t allocations;
+   uint64_t bytes;
+};
+
+class BenchMeter {
+public:
+   void start();
+   BenchSample stop() const;
+
+private:
+   uint64_t startCycles;
+   host::HeapStats startHeap;
+};
+
+// Collects samples and prints mean / p50 / p99 / max
+class BenchSeries {
+public:
+   static const size_t MAX_SAMPLES = 4096;
+
+   BenchSeries() : count(0), allocations(0), bytes(0) {}
+   void add(const BenchSample &sample);
+   size_t size() const { return count; }
+   uint64_t percentile(double p);
+   double meanCycles() const;
+   double allocationsPerSample() const;
+   double bytesPerSample() const;
+
+private:
+   uint64_t cycles[MAX_SAMPLES];
+   size_t count;
+   uint64_t allocations;
+   uint64_t bytes;
+};
+
+void benchPrintHeader(const char *title);
+void benchPrintSeriesHeader(const char *label);
+void benchPrintSeries(const char *label, BenchSeries &series);
+// For series whose samples are not cycles (e.g. latency in microseconds)
+void benchPrintDistributionHeader(const char *label, const char *unit);
+void benchPrintDistribution(const char *label, BenchSeries &series);
+
+// The firmware is booted once (setup() plus loop() until it has subscribed)
+// against the shared mock broker; suites that need it call benchBootFirmware().
+MockBroker &benchBroker();
+bool benchBootFirmware();
+
+struct BenchSuite {
+   const char *name;
+   const char *description;
+   int (*run)();
+};
+
+int benchFirmware();
+int benchLatency();
+int benchReconnect();
+int benchWiFi();
+int benchSound();
+int benchParse();
+int benchDispatch();
+int benchRelays();
+int benchJournal();
+int benchMqttRead();
+int benchMqttWrite();
+int benchMqttQos();
+int benchOutbox();
+int benchMqtt5();
+int benchMqttBatch();
+int benchMqttVec();
+int benchMqttCork();
+int benchRouter();
+int benchCapture();
+int benchVad();
+int benchKws();
+int benchMfcc();
+int benchKwsNn();
+
+#endif
@@ -0,0 +1,251 @@
+/*
+ bench_capture.cpp - microphone samples lost while the loop is held up.
+
+ A second I2S port carries a ramp (each sample is its absolute index), so
+ the reader can tell exactly which samples it never saw. The loop consumes
+ audio every 50 ms, the old audioCheckInterval, and every 2 s it is held up
+ for 100 ms to 1.5 s, as a flash erase, a blocking connect or a tone
+ sequence could. Two readers are compared:
+
+ - polled: one 1024-sample i2s_read() per tick, no wait, as
+   processAudioInput() did, with the 4 x 1024 DMA ring as the only buffer
+ - capture task: an AudioCapture (src/audio_capture.h) fed by the driver's
+   event queue, the loop taking frames from its ring
+
+ Reported per stall: frames, samples lost, DMA and ring overruns, and for
+ the task the capture -> analysis latency. The task must lose nothing while
+ a stall fits the ring, every frame it hands out must carry the samples
+ its sequence number says, and none may wait longer than the stall (or
+ tick) plus one frame. Last, the booted firmware runs for 20 s and
+ reports its own capture stats and latency with the event-driven audio
+ task.
+*/
+
+#include "bench.h"
+#include "audio_capture.h"
+#include "scheduler.h"
+
+#include <freertos/queue.h>
+
+namespace {
+
+const i2s_port_t PORT = I2S_NUM_1;
+const uint32_t SAMPLE_RATE = 16000;
+const uint64_t TICK_MICROS = 50000;
+const uint64_t STALL_EVERY_MICROS = 2000000;
+const uint64_t SCENARIO_MICROS = 20000000;
+const uint64_t FRAME_MICROS = AudioFrame::SAMPLES * 1000000ULL / SAMPLE_RATE;
+const uint32_t STALLS_MS[] = {0, 100, 300, 500, 1500};
+
+AudioCapture capture;
+int16_t polledBuffer[AudioFrame::SAMPLES];
+
+void ramp(int16_t *dst, size_t count, uint64_t first, void *ctx) {
+   (void)ctx;
+   for (size_t i = 0; i < count; i++) {
+      dst[i] = (int16_t)(uint16_t)(first + i);
+   }
+}
+
+i2s_config_t config() {
+   i2s_config_t config = {};
+   config.mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_RX);
+   config.sample_rate = SAMPLE_RATE;
+   config.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT;
+   config.channel_format = I2S_CHANNEL_FMT_ONLY_LEFT;
+   config.communication_format = I2S_COMM_FORMAT_STAND_I2S;
+   config.dma_buf_count = 4;
+   config.dma_buf_len = AudioFrame::SAMPLES;
+   return config;
+}
+
+struct Result {
+   uint32_t frames;
+   uint64_t lost;
+   uint32_t dmaOverruns;
+   uint32_t ringOverruns;
+   uint32_t corrupt;  // Frames whose samples do not match their position
+};
+
+// Samples are consecutive and, for the task, start where `sequence` says
+bool intact(const int16_t *samples, size_t count, uint16_t first) {
+   for (size_t i = 0; i < count; i++) {
+      if ((uint16_t)samples[i] != (uint16_t)(first + i)) return false;
+   }
+   return true;
+}
+
+// Once every STALL_EVERY_MICROS the wait after consuming is a stall
+// instead of a tick
+template <typename Consume>
+void runScenario(uint32_t stallMs, Consume consume) {
+   uint64_t end = host::nowMicros() + SCENARIO_MICROS;
+   uint64_t nextStall = host::nowMicros() + STALL_EVERY_MICROS;
+   while (host::nowMicros() < end) {
+      consume();
+      if (stallMs > 0 && host::nowMicros() >= nextStall) {
+         host::advanceMicros((uint64_t)stallMs * 1000ULL);
+         nextStall += STALL_EVERY_MICROS;
+      } else {
+         host::advanceMicros(TICK_MICROS);
+      }
+   }
+}
+
+Result runPolled(uint32_t stallMs) {
+   Result result = {};
+   i2s_config_t cfg = config();
+   i2s_driver_install(PORT, &cfg, 0, NULL);
+   uint16_t next = 0;
+   runScenario(stallMs, [&]() {
+      size_t bytesRead = 0;
+      i2s_read(PORT, polledBuffer, sizeof(polledBuffer), &bytesRead, 0);
+      size_t count = bytesRead / sizeof(int16_t);
+      if (count == 0) return;
+      result.frames++;
+      result.lost += (uint16_t)((uint16_t)polledBuffer[0] - next);
+      if (!intact(polledBuffer, count, polledBuffer[0])) result.corrupt++;
+      next = (uint16_t)polledBuffer[count - 1] + 1;
+   });
+   i2s_driver_uninstall(PORT);
+   return result;
+}
+
+Result runTask(uint32_t stallMs, uint32_t &nextSequence, BenchSeries &latency) {
+   AudioCaptureStats before = capture.stats();
+   Result result = {};
+   runScenario(stallMs, [&]() {
+      for (const AudioFrame *frame = capture.peek(); frame != NULL; frame = capture.peek()) {
+         result.frames++;
+         result.lost += (uint64_t)(frame->sequence - nextSequence) * AudioFrame::SAMPLES;
+         if (!intact(frame->samples, AudioFrame::SAMPLES, (uint16_t)(frame->sequence * AudioFrame::SAMPLES))) {
+            result.corrupt++;
+         }
+         nextSequence = frame->sequence + 1;
+         // capturedAt is a 32-bit micros(); the difference wraps with it
+         BenchSample sample = {(uint32_t)((uint32_t)micros() - frame->capturedAt), 0, 0};
+         latency.add(sample);
+         capture.release();
+      }
+   });
+   result.dmaOverruns = capture.stats().dmaOverruns - before.dmaOverruns;
+   result.ringOverruns = capture.stats().ringOverruns - before.ringOverruns;
+   return result;
+}
+
+void printRow(const char *stall, const char *path, const Result &result, BenchSeries *latency) {
+   benchOut.printf("%-8s %-13s %7u %9llu %8u %9u", stall, path, (unsigned)result.frames,
+                   (unsigned long long)result.lost, (unsigned)result.dmaOverruns, (unsigned)result.ringOverruns);
+   if (latency != NULL) {
+      benchOut.printf(" %9llu %9llu %9llu\n", (unsigned long long)latency->percentile(0.50),
+                      (unsigned long long)latency->percentile(0.99), (unsigned long long)latency->percentile(1.0));
+   } else {
+      benchOut.printf(" %9s %9s %9s\n", "-", "-", "-");
+   }
+}
+
+int runStalls() {
+   Result polled[sizeof(STALLS_MS) / sizeof(STALLS_MS[0])];
+   for (size_t i = 0; i < sizeof(STALLS_MS) / sizeof(STALLS_MS[0]); i++) {
+      polled[i] = runPolled(STALLS_MS[i]);
+   }
+
+   i2s_config_t cfg = config();
+   QueueHandle_t events = NULL;
+   if (i2s_driver_install(PORT, &cfg, AudioCapture::EVENT_QUEUE_LENGTH, &events) != ESP_OK ||
+       !capture.begin(PORT, events)) {
+      benchOut.printf("FAIL: capture task did not start\n");
+      return 1;
+   }
+
+   int failures = 0;
+   uint32_t nextSequence = 0;
+   benchOut.printf("%-8s %-13s %7s %9s %8s %9s %9s %9s %9s\n", "stall", "path", "frames", "lost", "dma ovf",
+                   "ring ovf", "p50 us", "p99 us", "max us");
+   for (size_t i = 0; i < sizeof(STALLS_MS) / sizeof(STALLS_MS[0]); i++) {
+      char label[16];
+      snprintf(label, sizeof(label), "%u ms", (unsigned)STALLS_MS[i]);
+      BenchSeries latency;
+      Result task = runTask(STALLS_MS[i], nextSequence, latency);
+      printRow(label, "polled", polled[i], NULL);
+      printRow("", "capture task", task, &latency);
+
+      // Frames of a stall that fit the ring are all kept; a longer stall
+      // drops whole frames, and only as many as the ring overruns say
+      bool fits = STALLS_MS[i] * 1000ULL < AudioCapture::RING_FRAMES * FRAME_MICROS;
+      if (task.corrupt || polled[i].corrupt) {
+         benchOut.printf("FAIL: %s: %u frames with samples out of place\n", label,
+                         (unsigned)(task.corrupt + polled[i].corrupt));
+         failures++;
+      }
+      // A frame waits for the next consume: at most the stall (or tick)
+      // plus the frame the driver was filling
+      uint64_t limit = (STALLS_MS[i] * 1000ULL > TICK_MICROS ? STALLS_MS[i] * 1000ULL : TICK_MICROS) + FRAME_MICROS;
+      if (latency.percentile(1.0) > limit) {
+         benchOut.printf("FAIL: %s: capture -> analysis up to %llu us, limit %llu us\n", label,
+                         (unsigned long long)latency.percentile(1.0), (unsigned long long)limit);
+         failures++;
+      }
+      if ((fits && task.lost) ||
+          task.lost != (uint64_t)(task.ringOverruns + task.dmaOverruns) * AudioFrame::SAMPLES) {
+         benchOut.printf("FAIL: %s: capture task lost %llu samples, %u frames overrun\n", label,
+                         (unsigned long long)task.lost, (unsigned)(task.ringOverruns + task.dmaOverruns));
+         failures++;
+      }
+   }
+   benchOut.printf("ring %u x %u samples (%llu ms), DMA %u x %u samples\n", (unsigned)AudioCapture::RING_FRAMES,
+                   (unsigned)AudioFrame::SAMPLES, (unsigned long long)(AudioCapture::RING_FRAMES * FRAME_MICROS / 1000),
+                   (unsigned)cfg.dma_buf_count, (unsigned)cfg.dma_buf_len);
+   return failures;
+}
+
+// The firmware's own capture task and event-driven audio task
+int runFirmware() {
+   host::setI2sSource(NULL, NULL);
+   if (!benchBootFirmware()) return 1;
+   // Frames captured while other suites held the loop are taken first
+   loop();
+   AudioCaptureStats before = audioCapture.stats();
+   BenchSeries latency;
+   uint64_t end = host::nowMicros() + SCENARIO_MICROS;
+   while (host::nowMicros() < end) {
+      uint32_t analysed = audioCapture.stats().analysed;
+      loop();
+      if (audioCapture.stats().analysed != analysed) {
+         BenchSample sample = {audioCapture.stats().lastLatencyMicros, 0, 0};
+         latency.add(sample);
+      }
+   }
+   const AudioCaptureStats &after = audioCapture.stats();
+   uint32_t frames = after.frames - before.frames;
+   uint32_t overruns = after.dmaOverruns - before.dmaOverruns + after.ringOverruns - before.ringOverruns;
+   benchOut.printf("firmware, 20 s: %u frames (%llu expected), %u analysed, %u overruns\n", (unsigned)frames,
+                   (unsigned long long)(SCENARIO_MICROS / FRAME_MICROS), (unsigned)(after.analysed - before.analysed),
+                   (unsigned)overruns);
+   benchPrintDistributionHeader("firmware", "us");
+   benchPrintDistribution("capture -> analysis", latency);
+   int failures = 0;
+   if (overruns || frames + 1 < SCENARIO_MICROS / FRAME_MICROS) {
+      benchOut.printf("FAIL: firmware capture lost frames\n");
+      failures++;
+   }
+   // The audio task wakes on each frame, so none waits a frame period
+   if (latency.percentile(1.0) > FRAME_MICROS) {
+      benchOut.printf("FAIL: firmware capture -> analysis up to %llu us, limit %llu us\n",
+                      (unsigned long long)latency.percentile(1.0), (unsigned long long)FRAME_MICROS);
+      failures++;
+   }
+   return failures;
+}
+
+} // namespace
+
+int benchCapture() {
+   benchPrintHeader("capture: microphone samples lost while the loop is held up");
+   host::setSerialEcho(false);
+   int failures = runFirmware();
+   host::setI2sSource(ramp, NULL);
+   failures += runStalls();
+   host::setI2sSource(NULL, NULL);
+   return failures;
+}
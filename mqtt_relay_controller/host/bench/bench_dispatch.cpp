@@ -0,0 +1,164 @@
+/*
+ bench_dispatch.cpp - command lookup cost as the command set grows.
+
+ The registry from src/command_registry.h is instantiated at compile time
+ for the first 5, 16 and 64 names of a realistic command list and compared
+ with the if/else chain of string compares it replaced. Lookups cycle
+ through every registered name plus one unknown name; cycles are per
+ lookup, averaged over a batch of 1024.
+*/
+
+#include "bench.h"
+#include "command_registry.h"
+
+namespace {
+
+const int BATCHES = 400;
+const int LOOKUPS_PER_BATCH = 1024;
+
+uint32_t handled = 0;
+
+void countCall(const CommandRequest &request) {
+   (void)request;
+   handled++;
+}
+
+// Prefixes of this table are registered below
+constexpr CommandSpec all[] = {
+   {"turn_on", countCall},
+   {"turn_off", countCall},
+   {"get_status", countCall},
+   {"enable_voice", countCall},
+   {"disable_voice", countCall},
+   {"toggle", countCall},
+   {"set_level", countCall},
+   {"dim_up", countCall},
+   {"dim_down", countCall},
+   {"set_color", countCall},
+   {"set_color_temp", countCall},
+   {"set_scene", countCall},
+   {"save_scene", countCall},
+   {"delete_scene", countCall},
+   {"list_scenes", countCall},
+   {"set_schedule", countCall},
+   {"clear_schedule", countCall},
+   {"get_schedule", countCall},
+   {"set_timer", countCall},
+   {"cancel_timer", countCall},
+   {"set_config", countCall},
+   {"get_config", countCall},
+   {"reset_config", countCall},
+   {"factory_reset", countCall},
+   {"reboot", countCall},
+   {"get_diagnostics", countCall},
+   {"get_heap", countCall},
+   {"get_tasks", countCall},
+   {"get_wifi", countCall},
+   {"get_mqtt", countCall},
+   {"set_volume", countCall},
+   {"mute", countCall},
+   {"unmute", countCall},
+   {"play_sound", countCall},
+   {"stop_sound", countCall},
+   {"set_threshold", countCall},
+   {"calibrate_mic", countCall},
+   {"enable_ota", countCall},
+   {"disable_ota", countCall},
+   {"get_version", countCall},
+   {"set_channel", countCall},
+   {"set_channels", countCall},
+   {"get_channels", countCall},
+   {"lock", countCall},
+   {"unlock", countCall},
+   {"set_name", countCall},
+   {"set_room", countCall},
+   {"identify", countCall},
+   {"blink", countCall},
+   {"set_fade", countCall},
+   {"set_power_on_state", countCall},
+   {"get_energy", countCall},
+   {"reset_energy", countCall},
+   {"set_limit", countCall},
+   {"get_limit", countCall},
+   {"subscribe_events", countCall},
+   {"unsubscribe_events", countCall},
+   {"ping", countCall},
+   {"set_log_level", countCall},
+   {"get_log", countCall},
+   {"get_uptime", countCall},
+   {"set_button_mode", countCall},
+   {"get_button_mode", countCall},
+   {"restore_state", countCall},
+};
+
+template <size_t N>
+struct Prefix {
+   CommandSpec specs[N];
+   constexpr Prefix() : specs() {
+      for (size_t i = 0; i < N; i++) specs[i] = all[i];
+   }
+};
+
+constexpr Prefix<5> prefix5;
+constexpr Prefix<16> prefix16;
+constexpr Prefix<64> prefix64;
+constexpr CommandRegistry<5> registry5(prefix5.specs);
+constexpr CommandRegistry<16> registry16(prefix16.specs);
+constexpr CommandRegistry<64> registry64(prefix64.specs);
+static_assert(registry5.valid() && registry16.valid() && registry64.valid(), "no perfect hash seed");
+
+// What callback() did before: compare against each name in turn
+template <size_t N>
+bool chainDispatch(const CommandRequest &request) {
+   for (size_t i = 0; i < N; i++) {
+      if (strcmp(request.command, all[i].name) == 0) {
+         all[i].handler(request);
+         return true;
+      }
+   }
+   return false;
+}
+
+template <size_t N>
+void measure(const char *label, const CommandRegistry<N> *registry) {
+   BenchSeries series;
+   CommandRequest request = {"", "bench", "mqtt", -1, 0, 0, false};
+   uint32_t before = handled;
+   int misses = 0;
+   for (int batch = 0; batch < BATCHES; batch++) {
+      BenchMeter meter;
+      meter.start();
+      for (int i = 0; i < LOOKUPS_PER_BATCH; i++) {
+         // Every registered name, then one that is not registered
+         size_t index = i % (N + 1);
+         request.command = index < N ? all[index].name : "not_a_command";
+         bool found = registry != NULL ? registry->dispatch(request) : chainDispatch<N>(request);
+         misses += !found;
+      }
+      BenchSample sample = meter.stop();
+      sample.cycles /= LOOKUPS_PER_BATCH;
+      series.add(sample);
+   }
+   benchPrintSeries(label, series);
+   if (handled - before + misses != (uint32_t)BATCHES * LOOKUPS_PER_BATCH) {
+      benchOut.printf("FAIL: %s lost lookups\n", label);
+   }
+}
+
+} // namespace
+
+int benchDispatch() {
+   benchPrintHeader("dispatch: command name -> handler");
+   benchPrintSeriesHeader("lookup");
+   measure<5>("if/else chain, 5", NULL);
+   measure<5>("perfect hash, 5", &registry5);
+   measure<16>("if/else chain, 16", NULL);
+   measure<16>("perfect hash, 16", &registry16);
+   measure<64>("if/else chain, 64", NULL);
+   measure<64>("perfect hash, 64", &registry64);
+   benchOut.printf("hash seeds: %u / %u / %u, table slots %u / %u / %u\n",
+                   (unsigned)registry5.hashSeed(), (unsigned)registry16.hashSeed(), (unsigned)registry64.hashSeed(),
+                   (unsigned)CommandRegistry<5>::TABLE_SIZE, (unsigned)CommandRegistry<16>::TABLE_SIZE,
+                   (unsigned)CommandRegistry<64>::TABLE_SIZE);
+   return 0;
+}
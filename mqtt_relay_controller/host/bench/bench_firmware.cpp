@@ -0,0 +1,164 @@
+/*
+ bench_firmware.cpp - drives setup()/loop() with scripted MQTT commands,
+ heartbeats and microphone input, and reports cycles and heap allocations
+ per command plus the per-function profile collected by PROFILE_SCOPE.
+*/
+
+#include "bench.h"
+#include "profiling.h"
+#include "state_journal.h"
+
+#include <math.h>
+#include <stdio.h>
+
+extern const char *command_topic;
+extern const char *response_topic;
+extern const char *heartbeat_topic;
+extern unsigned long lastHeartbeat;
+
+namespace {
+
+const uint8_t LIGHT_RELAY_PIN = 4;  // Matches LIGHT_RELAY_PIN in main.cpp
+const int COMMAND_RUNS = 500;
+const int WARMUP_RUNS = 10;
+
+struct ScriptedCommand {
+   const char *command;
+   int expectedRelay;  // -1: relay must not change
+};
+
+const ScriptedCommand script[] = {
+   {"turn_on", HIGH},
+   {"turn_off", LOW},
+   {"get_status", -1},
+   {"disable_voice", -1},
+   {"enable_voice", -1},
+   {"bogus_command", -1},
+};
+
+bool loudMicrophone = false;
+
+// Low background noise, or a 440 Hz tone at ~8000 RMS when "speaking"
+void microphone(int16_t *dst, size_t count, uint64_t first, void *ctx) {
+   (void)ctx;
+   for (size_t i = 0; i < count; i++) {
+      uint64_t n = first + i;
+      if (loudMicrophone) {
+         dst[i] = (int16_t)(11000.0 * sin(2.0 * M_PI * 440.0 * n / 16000.0));
+      } else {
+         dst[i] = (int16_t)(((uint32_t)(n * 2654435761u) >> 24) & 0xFF) - 128;
+      }
+   }
+}
+
+int runCommand(const ScriptedCommand &cmd) {
+   MockBroker &broker = benchBroker();
+   char payload[96];
+   BenchSeries series;
+   int failures = 0;
+   uint32_t publishesBefore = broker.stats().publishesIn;
+   uint64_t bytesBefore = broker.stats().bytesIn;
+   uint64_t writesBefore = broker.stats().writeCalls;
+
+   for (int run = 0; run < WARMUP_RUNS + COMMAND_RUNS; run++) {
+      snprintf(payload, sizeof(payload), "{\"command\":\"%s\",\"requestId\":\"bench-%d\"}", cmd.command, run);
+      broker.injectPublish(command_topic, payload);
+      if (run == WARMUP_RUNS) {
+         publishesBefore = broker.stats().publishesIn;
+         bytesBefore = broker.stats().bytesIn;
+         writesBefore = broker.stats().writeCalls;
+      }
+      BenchMeter meter;
+      meter.start();
+      loop();
+      BenchSample sample = meter.stop();
+      if (run >= WARMUP_RUNS) {
+         series.add(sample);
+      }
+      if (cmd.expectedRelay >= 0 && host::pinLevel(LIGHT_RELAY_PIN) != cmd.expectedRelay) {
+         failures++;
+      }
+   }
+
+   benchPrintSeries(cmd.command, series);
+   benchOut.printf("%-24s %8s publishes/cmd %.2f, socket writes/cmd %.1f, bytes on wire/cmd %.1f\n", "", "",
+                   (double)(broker.stats().publishesIn - publishesBefore) / COMMAND_RUNS,
+                   (double)(broker.stats().writeCalls - writesBefore) / COMMAND_RUNS,
+                   (double)(broker.stats().bytesIn - bytesBefore) / COMMAND_RUNS);
+   if (failures) {
+      benchOut.printf("FAIL: relay pin did not follow %s in %d runs\n", cmd.command, failures);
+   }
+   return failures;
+}
+
+// Step the clock a second at a time (keeping the MQTT keepalive happy) and
+// sample only the loop() iterations that ran sendHeartbeat()
+int runHeartbeats() {
+   MockBroker &broker = benchBroker();
+   BenchSeries series;
+   uint32_t deliveredBefore = broker.publishedTo(heartbeat_topic);
+   uint64_t writesBefore = broker.stats().writeCalls;
+   for (int step = 0; step < 3000 && series.size() < 100; step++) {
+      unsigned long before = lastHeartbeat;
+      host::advanceMicros(1000ULL * 1000ULL);
+      BenchMeter meter;
+      meter.start();
+      loop();
+      BenchSample sample = meter.stop();
+      if (lastHeartbeat != before) {
+         series.add(sample);
+      }
+   }
+   benchPrintSeries("heartbeat tick", series);
+   uint32_t delivered = broker.publishedTo(heartbeat_topic) - deliveredBefore;
+   benchOut.printf("%-24s %8s heartbeats delivered %u of %u, socket writes/heartbeat %.1f\n", "", "",
+                   (unsigned)delivered, (unsigned)series.size(),
+                   delivered ? (double)(broker.stats().writeCalls - writesBefore) / delivered : 0.0);
+   return 0;
+}
+
+int runAudio() {
+   BenchSeries quiet;
+   BenchSeries speaking;
+   for (int run = 0; run < 400; run++) {
+      loudMicrophone = (run / 50) % 2 == 1;
+      host::advanceMicros(51ULL * 1000ULL);
+      BenchMeter meter;
+      meter.start();
+      loop();
+      (loudMicrophone ? speaking : quiet).add(meter.stop());
+   }
+   loudMicrophone = false;
+   benchPrintSeries("audio tick (quiet)", quiet);
+   benchPrintSeries("audio tick (voice)", speaking);
+   return 0;
+}
+
+} // namespace
+
+int benchFirmware() {
+   benchPrintHeader("firmware: per-command loop() cost");
+   host::setI2sSource(microphone, NULL);
+   if (!benchBootFirmware()) return 1;
+
+#ifdef ENABLE_PROFILING
+   profilingReset();
+#endif
+
+   int failures = 0;
+   benchPrintSeriesHeader("command");
+   for (size_t i = 0; i < sizeof(script) / sizeof(script[0]); i++) {
+      failures += runCommand(script[i]);
+   }
+   failures += runHeartbeats();
+   failures += runAudio();
+
+#ifdef ENABLE_PROFILING
+   benchPrintHeader("firmware: per-function profile");
+   profilingReport(benchOut);
+#endif
+   benchOut.printf("State journal commits: %u (of %u changes), flash erases: %u, I2S overrun samples: %llu\n",
+                   stateJournal.stats().commits, stateJournal.stats().records, host::flashStats().erases,
+                   (unsigned long long)host::i2sOverrunSamples());
+   return failures;
+}
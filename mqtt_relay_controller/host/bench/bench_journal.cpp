@@ -0,0 +1,213 @@
+/*
+ bench_journal.cpp - relay state persistence cost and boot replay.
+
+ Toggle storm: turn_on/turn_off commands arrive 20..400 ms apart, in bursts
+ separated by idle gaps, against the booted firmware. Reported: flash time
+ spent inside the loop() iteration that handled each command (the command
+ path), journal commits and sector erases per toggle, the latency of each
+ deferred commit, and the projected number of toggles before a sector
+ reaches 100k erase cycles. The old scheme, one EEPROM commit (sector erase
+ plus program) per toggle, is replayed on a scratch partition for
+ comparison. Flash timings come from the host esp_partition model.
+
+ Replay: a separate journal on a scratch partition is filled to several
+ levels (including a full ring wrap, a torn last record and a sector whose
+ first record was lost to a power cut) and reopened; the replayed state
+ must be the last intact one.
+*/
+
+#include "bench.h"
+#include "relay_bank.h"
+#include "state_journal.h"
+
+#include <esp_partition.h>
+#include <stdio.h>
+#include <string.h>
+
+extern const char *command_topic;
+
+namespace {
+
+const uint8_t LIGHT_RELAY_PIN = 4;  // Matches LIGHT_RELAY_PIN in main.cpp
+const int TOGGLES = 1000;
+const int BURST = 25;                   // Toggles per burst
+const uint64_t BURST_GAP_US = 5000000;  // Idle gap between bursts
+const int MAX_LOOPS_PER_COMMAND = 5000;
+const uint32_t ERASE_ENDURANCE = 100000;
+
+const uint32_t RECORDS_PER_SECTOR = (SPI_FLASH_SEC_SIZE - 16) / 8;  // Matches StateJournal
+const char *SCRATCH = "bench";
+const uint32_t SCRATCH_SIZE = 4 * SPI_FLASH_SEC_SIZE;
+
+uint64_t flashMicros(const host::FlashStats &before, const host::FlashStats &after, uint64_t elapsed) {
+   return after.erases != before.erases || after.writes != before.writes ? elapsed : 0;
+}
+
+int runStorm() {
+   MockBroker &broker = benchBroker();
+   BenchSeries commandPath;
+   BenchSeries commitLatency;
+   StateJournalStats before = stateJournal.stats();
+   host::FlashStats flashBefore = host::flashStats();
+   uint64_t commandFlashUs = 0;
+   int failures = 0;
+   char payload[96];
+
+   for (int toggle = 0; toggle < TOGGLES; toggle++) {
+      int expected = host::pinLevel(LIGHT_RELAY_PIN) == HIGH ? LOW : HIGH;
+      snprintf(payload, sizeof(payload), "{\"command\":\"%s\",\"requestId\":\"wear-%d\"}",
+               expected == HIGH ? "turn_on" : "turn_off", toggle);
+      uint64_t spacing = toggle % BURST == 0 ? BURST_GAP_US : 20000 + (uint64_t)(toggle * 7919) % 380000;
+      broker.injectPublishAt(host::nowMicros() + spacing, command_topic, payload);
+
+      for (int i = 0; i < MAX_LOOPS_PER_COMMAND && host::pinLevel(LIGHT_RELAY_PIN) != expected; i++) {
+         uint32_t commits = stateJournal.stats().commits;
+         host::FlashStats flash = host::flashStats();
+         uint64_t start = host::nowMicros();
+         loop();
+         uint64_t elapsed = host::nowMicros() - start;
+         if (host::pinLevel(LIGHT_RELAY_PIN) == expected) {
+            uint64_t flashUs = flashMicros(flash, host::flashStats(), elapsed);
+            BenchSample sample = {flashUs, 0, 0};
+            commandPath.add(sample);
+            commandFlashUs += flashUs;
+         }
+         if (stateJournal.stats().commits != commits) {
+            BenchSample sample = {stateJournal.stats().lastCommitUs, 0, 0};
+            commitLatency.add(sample);
+         }
+      }
+      if (host::pinLevel(LIGHT_RELAY_PIN) != expected) failures++;
+   }
+
+   // Let the last burst settle; the deferred commit must follow
+   for (int i = 0; i < 100 && stateJournal.pending(); i++) {
+      uint32_t commits = stateJournal.stats().commits;
+      loop();
+      if (stateJournal.stats().commits != commits) {
+         BenchSample sample = {stateJournal.stats().lastCommitUs, 0, 0};
+         commitLatency.add(sample);
+      }
+   }
+
+   const StateJournalStats &after = stateJournal.stats();
+   host::FlashStats flashAfter = host::flashStats();
+   uint32_t commits = after.commits - before.commits;
+   uint32_t erases = flashAfter.erases - flashBefore.erases;
+
+   benchPrintDistributionHeader("journal", "us");
+   benchPrintDistribution("flash on command path", commandPath);
+   benchPrintDistribution("deferred commit", commitLatency);
+   benchOut.printf("%u toggles: %u commits (%.3f per toggle), %u sector erases, %u flash writes, %.1f us flash per toggle on the command path\n",
+                   TOGGLES, commits, (double)commits / TOGGLES, erases, flashAfter.writes - flashBefore.writes,
+                   (double)commandFlashUs / TOGGLES);
+   double toggles = commits ? (double)ERASE_ENDURANCE * stateJournal.sectorCount() * RECORDS_PER_SECTOR * TOGGLES / commits : 0;
+   benchOut.printf("projected toggles before a sector reaches %u erases: %.3g (journal) vs %u (erase per toggle)\n",
+                   ERASE_ENDURANCE, toggles, ERASE_ENDURANCE);
+
+   if (failures) {
+      benchOut.printf("FAIL: relay did not follow %d toggles\n", failures);
+   }
+   if (stateJournal.pending() || stateJournal.state() != relays.state()) {
+      benchOut.printf("FAIL: journal holds 0x%lx, relays are 0x%lx\n",
+                      (unsigned long)stateJournal.state(), (unsigned long)relays.state());
+      failures++;
+   }
+   // What the next boot would see
+   StateJournal reopened;
+   if (!reopened.begin("relaylog") || !reopened.hasState() || reopened.state() != relays.state()) {
+      benchOut.printf("FAIL: replay after the storm did not return the relay state\n");
+      failures++;
+   }
+   return failures;
+}
+
+// The old scheme: every toggle erases and reprograms the EEPROM sector
+void runEraseEveryToggle() {
+   const esp_partition_t *scratch = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, SCRATCH);
+   BenchSeries series;
+   for (int toggle = 0; toggle < 200; toggle++) {
+      uint8_t value = toggle & 1;
+      uint64_t start = host::nowMicros();
+      esp_partition_erase_range(scratch, 0, SPI_FLASH_SEC_SIZE);
+      esp_partition_write(scratch, 0, &value, 1);
+      BenchSample sample = {host::nowMicros() - start, 0, 0};
+      series.add(sample);
+   }
+   benchPrintDistribution("erase per toggle (old)", series);
+}
+
+// Fill a scratch journal with `commits` states and check what it replays
+int runReplay(const char *label, uint32_t commits, int tear) {
+   const esp_partition_t *scratch = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, SCRATCH);
+   esp_partition_erase_range(scratch, 0, SCRATCH_SIZE);
+
+   StateJournal writer;
+   writer.begin(SCRATCH);
+   uint32_t expected = 0;
+   bool expectState = false;
+   for (uint32_t i = 1; i <= commits; i++) {
+      uint32_t state = i * 2654435761u;
+      writer.record(state);
+      writer.flush();
+      // A torn last write leaves the state before it
+      if (i < commits || tear == 0) {
+         expected = state;
+         expectState = true;
+      }
+   }
+
+   uint8_t *raw = host::partitionData(SCRATCH);
+   if (commits > 0 && tear != 0) {
+      // Locate the last record: highest-generation sector, last used slot
+      size_t index = commits - 1;
+      size_t sector = (index / RECORDS_PER_SECTOR) % (SCRATCH_SIZE / SPI_FLASH_SEC_SIZE);
+      uint8_t *record = raw + sector * SPI_FLASH_SEC_SIZE + 16 + (index % RECORDS_PER_SECTOR) * 8;
+      if (tear == 1) {
+         record[6] = 0xFF;  // The check word was only partly programmed
+         record[7] = 0xFF;
+      } else {
+         memset(record, 0xFF, 8);  // Lost entirely, right after the sector header
+      }
+   }
+
+   host::FlashStats flashBefore = host::flashStats();
+   StateJournal reader;
+   reader.begin(SCRATCH);
+   uint32_t reads = host::flashStats().reads - flashBefore.reads;
+   bool ok = reader.hasState() == expectState && (!expectState || reader.state() == expected);
+   benchOut.printf("%-28s %8u %8u %10u   %s\n", label, (unsigned)commits, (unsigned)reads,
+                   (unsigned)reader.stats().replayUs, ok ? "ok" : "WRONG STATE");
+   if (!ok) {
+      benchOut.printf("FAIL: replay of %s returned %s0x%lx, expected 0x%lx\n", label,
+                      reader.hasState() ? "" : "nothing, ", (unsigned long)reader.state(), (unsigned long)expected);
+      return 1;
+   }
+   return 0;
+}
+
+} // namespace
+
+int benchJournal() {
+   benchPrintHeader("journal: relay state persistence");
+   if (!benchBootFirmware()) return 1;
+   static bool scratchAdded = false;
+   if (!scratchAdded) {
+      scratchAdded = host::addPartition(SCRATCH, 0x40, SCRATCH_SIZE);
+   }
+
+   int failures = runStorm();
+   runEraseEveryToggle();
+
+   const uint32_t perSector = RECORDS_PER_SECTOR;
+   const uint32_t ring = perSector * (SCRATCH_SIZE / SPI_FLASH_SEC_SIZE);
+   benchOut.printf("\n%-28s %8s %8s %10s\n", "replay", "records", "reads", "virtual us");
+   failures += runReplay("empty partition", 0, 0);
+   failures += runReplay("one record", 1, 0);
+   failures += runReplay("half sector", perSector / 2, 0);
+   failures += runReplay("full sector", perSector, 0);
+   failures += runReplay("ring wrapped 3x", 3 * ring + 7, 0);
+   failures += runReplay("torn last record", perSector / 2, 1);
+   failures += runReplay("lost first record in sector", perSector + 1, 2);
+   return failures;
+}
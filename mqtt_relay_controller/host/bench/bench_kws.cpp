@@ -0,0 +1,462 @@
+/*
+ bench_kws.cpp - keyword spotting accuracy and cost per utterance.
+
+ The evaluator runs a corpus of 16 kHz mono 16-bit WAV files, with one
+ directory of .wav files per voice command action under <corpus> (turn_on,
+ turn_off, get_status), plus <corpus>/unknown/ for words and noises that
+ must be rejected. KWS_CORPUS names the corpus; without it a synthetic one
+ is written to a temporary directory first: formant-synthesised "turn on",
+ "turn off" and "status" by 40 speakers each (pitch, vocal tract length,
+ tempo, loudness and background noise varied), plus other words and door
+ slams.
+
+ Each file takes the firmware's path: a VoiceActivityDetector on
+ 1024-sample frames and, once it fires, the KeywordSpotter with the same
+ preroll over a 1.5 s window. The first 16 files of each action are the
+ enrollment pool and the rest are tests. With 3, 8 and 16 templates per
+ action enrolled into a template store on a flash partition, reported are
+ accuracy, false rejects, confusions and false accepts of unknown files,
+ and per utterance the cycles and DTW cells of matching with and without
+ LB_Keogh / early-abandon pruning. The pruned search must return exactly
+ what the full one does.
+
+ Last, the booted firmware is enrolled over MQTT and must switch the relay
+ when new speakers say "turn on" and "turn off" to its microphone.
+*/
+
+#include "bench.h"
+#include "keyword_model.h"
+#include "keyword_spotter.h"
+#include "keyword_templates.h"
+#include "mfcc_frontend.h"
+#include "voice_activity.h"
+#include "audio_capture.h"
+#include "synthetic_speech.h"
+
+#include <dirent.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+extern const char *audio_topic;
+
+namespace {
+
+const uint32_t RATE = 16000;
+const uint16_t THRESHOLD = 2000;     // DETECTION_THRESHOLD in main.cpp
+const uint8_t PREROLL = 3 * AudioFrame::SAMPLES / MfccFrontEnd::HOP;  // keywordPreroll
+const int WINDOW_FRAMES = 24;        // Capture frames in voiceCommandWindow
+const size_t MAX_SAMPLES = 4 * RATE;
+const size_t UTTERANCE_SAMPLES = 40 * AudioFrame::SAMPLES;
+const int POOL = 16;                 // Enrollment files per action
+const int PER_ACTION = 40;
+const int PER_UNKNOWN = 8;
+const int ENROLLED[] = {3, 8, 16};
+const char *ACTIONS[] = {"turn_on", "turn_off", "get_status"};
+const int NUM_ACTIONS = SPEECH_KEYWORDS;
+const uint8_t LIGHT_RELAY_PIN = 4;   // Matches LIGHT_RELAY_PIN in main.cpp
+
+// --- WAV files -------------------------------------------------------------
+
+void put32(uint8_t *p, uint32_t v) {
+   p[0] = v;
+   p[1] = v >> 8;
+   p[2] = v >> 16;
+   p[3] = v >> 24;
+}
+
+uint32_t get32(const uint8_t *p) {
+   return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+bool writeWav(const char *path, const int16_t *samples, size_t count) {
+   uint8_t header[44] = {'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E', 'f', 'm', 't', ' ', 16, 0, 0, 0,
+                         1, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0, 16, 0, 'd', 'a', 't', 'a'};
+   put32(header + 4, 36 + count * 2);
+   put32(header + 24, RATE);
+   put32(header + 28, RATE * 2);
+   put32(header + 40, count * 2);
+   FILE *file = fopen(path, "wb");
+   if (file == NULL) return false;
+   bool ok = fwrite(header, 1, sizeof(header), file) == sizeof(header) &&
+             fwrite(samples, sizeof(int16_t), count, file) == count;
+   return fclose(file) == 0 && ok;
+}
+
+// 16 kHz mono 16-bit PCM only; returns the samples read
+size_t readWav(const char *path, int16_t *samples, size_t capacity) {
+   FILE *file = fopen(path, "rb");
+   if (file == NULL) return 0;
+   uint8_t riff[12];
+   size_t count = 0;
+   bool format = false;
+   if (fread(riff, 1, 12, file) == 12 && memcmp(riff, "RIFF", 4) == 0 && memcmp(riff + 8, "WAVE", 4) == 0) {
+      uint8_t chunk[8];
+      while (fread(chunk, 1, 8, file) == 8) {
+         uint32_t size = get32(chunk + 4);
+         if (memcmp(chunk, "fmt ", 4) == 0 && size >= 16) {
+            uint8_t fmt[16];
+            if (fread(fmt, 1, 16, file) != 16) break;
+            format = fmt[0] == 1 && fmt[2] == 1 && get32(fmt + 4) == RATE && fmt[14] == 16;
+            fseek(file, size - 16 + (size & 1), SEEK_CUR);
+         } else if (memcmp(chunk, "data", 4) == 0 && format) {
+            size_t wanted = size / 2 < capacity ? size / 2 : capacity;
+            count = fread(samples, sizeof(int16_t), wanted, file);
+            break;
+         } else {
+            fseek(file, size + (size & 1), SEEK_CUR);
+         }
+      }
+   }
+   fclose(file);
+   return count;
+}
+
+int16_t audio[MAX_SAMPLES];
+
+bool generateCorpus(const char *root) {
+   char path[256];
+   for (int a = 0; a <= NUM_ACTIONS; a++) {
+      snprintf(path, sizeof(path), "%s/%s", root, a < NUM_ACTIONS ? ACTIONS[a] : "unknown");
+      if (mkdir(path, 0755) != 0) return false;
+   }
+   for (int a = 0; a < NUM_ACTIONS; a++) {
+      for (int i = 0; i < PER_ACTION; i++) {
+         size_t count = synthesize(speechKeywords[a], speakerFor(100 * a + i), audio, UTTERANCE_SAMPLES);
+         snprintf(path, sizeof(path), "%s/%s/speaker%02d.wav", root, ACTIONS[a], i);
+         if (!writeWav(path, audio, count)) return false;
+      }
+   }
+   for (size_t u = 0; u < SPEECH_UNKNOWNS; u++) {
+      for (int i = 0; i < PER_UNKNOWN; i++) {
+         size_t count = synthesize(speechUnknowns[u], speakerFor(1000 + 100 * u + i), audio, UTTERANCE_SAMPLES);
+         snprintf(path, sizeof(path), "%s/unknown/%s%02d.wav", root, speechUnknowns[u].name, i);
+         if (!writeWav(path, audio, count)) return false;
+      }
+   }
+   return true;
+}
+
+void removeCorpus(const char *root) {
+   char path[512];
+   for (int a = 0; a <= NUM_ACTIONS; a++) {
+      snprintf(path, sizeof(path), "%s/%s", root, a < NUM_ACTIONS ? ACTIONS[a] : "unknown");
+      DIR *dir = opendir(path);
+      if (dir == NULL) continue;
+      for (struct dirent *entry = readdir(dir); entry != NULL; entry = readdir(dir)) {
+         if (entry->d_name[0] == '.') continue;
+         char file[768];
+         snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+         unlink(file);
+      }
+      closedir(dir);
+      rmdir(path);
+   }
+   rmdir(root);
+}
+
+// --- evaluation ------------------------------------------------------------
+
+struct Utterance {
+   int8_t action;  // -1: unknown
+   bool detected;  // The voice detector fired and the spotter kept it
+   KeywordTemplate features;
+};
+
+const size_t MAX_UTTERANCES = 512;
+Utterance utterances[MAX_UTTERANCES];
+size_t utteranceCount = 0;
+MfccFrontEnd frontEnd;
+KeywordSpotter spotter(frontEnd);
+
+int compareNames(const void *a, const void *b) {
+   return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// The firmware's path: VAD per capture frame, the front-end fed every frame
+// and the spotter marked where the detector fires, the window closed 1.5 s
+// later
+bool extract(const int16_t *samples, size_t count, KeywordTemplate &out, BenchSeries &cycles) {
+   VoiceActivityDetector detector(THRESHOLD);
+   frontEnd.reset();
+   int triggered = -1;
+   for (size_t f = 0; (f + 1) * AudioFrame::SAMPLES <= count; f++) {
+      const int16_t *frame = samples + f * AudioFrame::SAMPLES;
+      BenchMeter meter;
+      meter.start();
+      frontEnd.addAudio(frame, AudioFrame::SAMPLES);
+      cycles.add(meter.stop());
+      if (triggered < 0 && detector.process(frame, AudioFrame::SAMPLES)) {
+         triggered = f;
+         spotter.markStart(PREROLL);
+      }
+      if (triggered >= 0 && (int)f - triggered + 1 >= WINDOW_FRAMES) break;
+   }
+   return triggered >= 0 && spotter.utterance(out);
+}
+
+int loadCorpus(const char *root, BenchSeries &featureCycles) {
+   utteranceCount = 0;
+   int files = 0;
+   for (int a = 0; a <= NUM_ACTIONS; a++) {
+      char path[256];
+      snprintf(path, sizeof(path), "%s/%s", root, a < NUM_ACTIONS ? ACTIONS[a] : "unknown");
+      DIR *dir = opendir(path);
+      if (dir == NULL) continue;
+      static char names[MAX_UTTERANCES][64];
+      char *sorted[MAX_UTTERANCES];
+      size_t count = 0;
+      for (struct dirent *entry = readdir(dir); entry != NULL && count < MAX_UTTERANCES; entry = readdir(dir)) {
+         size_t length = strlen(entry->d_name);
+         if (length < 5 || length >= sizeof(names[0]) || strcmp(entry->d_name + length - 4, ".wav") != 0) continue;
+         strcpy(names[count], entry->d_name);
+         sorted[count] = names[count];
+         count++;
+      }
+      closedir(dir);
+      qsort(sorted, count, sizeof(sorted[0]), compareNames);
+      for (size_t i = 0; i < count && utteranceCount < MAX_UTTERANCES; i++) {
+         char file[512];
+         snprintf(file, sizeof(file), "%s/%s", path, sorted[i]);
+         size_t samples = readWav(file, audio, MAX_SAMPLES);
+         if (samples == 0) {
+            benchOut.printf("skipped %s: not 16 kHz mono 16-bit PCM\n", file);
+            continue;
+         }
+         Utterance &u = utterances[utteranceCount++];
+         u.action = a < NUM_ACTIONS ? a : -1;
+         u.detected = extract(audio, samples, u.features, featureCycles);
+         files++;
+      }
+   }
+   return files;
+}
+
+struct Score {
+   int tests;
+   int correct;
+   int rejected;   // Keyword files not recognised
+   int confused;   // Recognised as another keyword
+   int missed;     // The voice detector never fired
+   int unknowns;
+   int accepted;   // Unknown files recognised as a keyword
+   uint64_t cells;
+   uint64_t fullCells;
+   uint32_t compared;
+   uint32_t pruned;
+};
+
+const char *SCRATCH = "kwsbench";
+KeywordTemplateStore store;
+
+int evaluate(int perAction, Score &score, BenchSeries &pruned, BenchSeries &full) {
+   int failures = 0;
+   store.clear();
+   int enrolled[NUM_ACTIONS] = {};
+   for (size_t i = 0; i < utteranceCount; i++) {
+      Utterance &u = utterances[i];
+      if (u.action < 0 || !u.detected || enrolled[u.action] >= perAction) continue;
+      u.features.keyword = u.action;
+      if (store.add(u.features)) enrolled[u.action]++;
+   }
+
+   memset(&score, 0, sizeof(score));
+   int seen[NUM_ACTIONS] = {};
+   for (size_t i = 0; i < utteranceCount; i++) {
+      const Utterance &u = utterances[i];
+      if (u.action >= 0 && seen[u.action]++ < POOL) continue;
+      if (u.action >= 0) {
+         score.tests++;
+      } else {
+         score.unknowns++;
+      }
+      if (!u.detected) {
+         score.missed += u.action >= 0;
+         score.rejected += u.action >= 0;
+         continue;
+      }
+
+      KeywordSpotterStats before = spotter.stats();
+      BenchMeter meter;
+      meter.start();
+      KeywordMatch match = spotter.match(u.features, store.templates(), store.count(), true);
+      pruned.add(meter.stop());
+      KeywordSpotterStats middle = spotter.stats();
+      meter.start();
+      KeywordMatch reference = spotter.match(u.features, store.templates(), store.count(), false);
+      full.add(meter.stop());
+      score.cells += middle.cells - before.cells;
+      score.fullCells += spotter.stats().cells - middle.cells;
+      score.compared += middle.compared - before.compared;
+      score.pruned += middle.pruned - before.pruned;
+
+      if (match.index != reference.index || match.distance != reference.distance) {
+         benchOut.printf("FAIL: pruned search found template %d at %ld, full search %d at %ld\n", match.index,
+                         (long)match.distance, reference.index, (long)reference.distance);
+         failures++;
+      }
+      if (u.action < 0) {
+         score.accepted += match.keyword >= 0;
+      } else if (match.keyword == u.action) {
+         score.correct++;
+      } else if (match.keyword < 0) {
+         score.rejected++;
+      } else {
+         score.confused++;
+      }
+   }
+   return failures;
+}
+
+int runCorpus() {
+   const char *corpus = getenv("KWS_CORPUS");
+   char generated[64] = "";
+   if (corpus == NULL || corpus[0] == '\0') {
+      strcpy(generated, "/tmp/kws_corpusXXXXXX");
+      if (mkdtemp(generated) == NULL || !generateCorpus(generated)) {
+         benchOut.printf("FAIL: could not write the synthetic corpus\n");
+         if (generated[0] != '\0') removeCorpus(generated);
+         return 1;
+      }
+      corpus = generated;
+   }
+
+   BenchSeries featureCycles;
+   int files = loadCorpus(corpus, featureCycles);
+   bool synthetic = generated[0] != '\0';
+   if (synthetic) removeCorpus(generated);
+   benchOut.printf("corpus: %s, %d files\n", synthetic ? "synthetic" : corpus, files);
+   if (files == 0) {
+      benchOut.printf("FAIL: no WAV files\n");
+      return 1;
+   }
+
+   static bool scratchAdded = false;
+   if (!scratchAdded) scratchAdded = host::addPartition(SCRATCH, 0x42, 8 * SPI_FLASH_SEC_SIZE);
+   if (!store.begin(SCRATCH)) {
+      benchOut.printf("FAIL: no template partition\n");
+      return 1;
+   }
+
+   int failures = 0;
+   BenchSeries pruned[3];
+   BenchSeries full[3];
+   Score scores[3];
+   benchOut.printf("%-9s %6s %8s %7s %8s %7s %9s %10s %9s %8s\n", "templates", "tests", "correct", "reject",
+                   "confused", "missed", "false acc", "cells", "full cells", "compared");
+   for (int s = 0; s < 3; s++) {
+      failures += evaluate(ENROLLED[s], scores[s], pruned[s], full[s]);
+      const Score &score = scores[s];
+      int matched = score.tests - score.missed + score.unknowns;
+      benchOut.printf("%-9u %6d %7.1f%% %7d %8d %7d %5d/%-3d %10llu %10llu %8.1f\n", (unsigned)store.count(),
+                      score.tests, score.tests ? 100.0 * score.correct / score.tests : 0.0, score.rejected,
+                      score.confused, score.missed, score.accepted, score.unknowns,
+                      (unsigned long long)(matched ? score.cells / matched : 0),
+                      (unsigned long long)(matched ? score.fullCells / matched : 0),
+                      matched ? (double)score.compared / matched : 0.0);
+   }
+   benchPrintSeriesHeader("per utterance");
+   for (int s = 0; s < 3; s++) {
+      char label[40];
+      snprintf(label, sizeof(label), "match, %u templates", (unsigned)(ENROLLED[s] * NUM_ACTIONS));
+      benchPrintSeries(label, pruned[s]);
+      snprintf(label, sizeof(label), "full DTW, %u templates", (unsigned)(ENROLLED[s] * NUM_ACTIONS));
+      benchPrintSeries(label, full[s]);
+   }
+   benchPrintSeries("features, 1024 samples", featureCycles);
+   benchOut.printf("accept distance %ld, warping band %u frames, %u frames per template\n",
+                   (long)spotter.getAcceptDistance(), (unsigned)KeywordSpotter::WARP,
+                   (unsigned)KeywordTemplate::FRAMES);
+
+   // The synthetic corpus must be recognised; a real one is only reported
+   const Score &eight = scores[1];
+   if (synthetic && (eight.correct * 10 < eight.tests * 9 || eight.accepted * 10 > eight.unknowns || eight.missed)) {
+      benchOut.printf("FAIL: %d of %d keywords recognised, %d of %d unknowns accepted, %d missed\n", eight.correct,
+                      eight.tests, eight.accepted, eight.unknowns, eight.missed);
+      failures++;
+   }
+   return failures;
+}
+
+// A template whose magic word never made it to flash is skipped, and its
+// slot is not reused
+int checkTornWrite() {
+   uint16_t before = store.count();
+   const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, SCRATCH);
+   esp_partition_write(partition, before * KeywordTemplateStore::SLOT_SIZE + 4, &utterances[0].features,
+                       sizeof(KeywordTemplate));
+   store.begin(SCRATCH);
+   bool skipped = store.count() == before;
+   bool added = store.add(utterances[0].features) && store.count() == before + 1;
+   store.begin(SCRATCH);
+   if (!skipped || !added || store.count() != before + 1 ||
+       store.templates()[before] != (const KeywordTemplate *)(host::partitionData(SCRATCH) +
+                                                               (before + 1) * KeywordTemplateStore::SLOT_SIZE + 4)) {
+      benchOut.printf("FAIL: torn template slot: skipped %d, added %d, %u templates\n", skipped, added,
+                      (unsigned)store.count());
+      return 1;
+   }
+   benchOut.printf("torn slot skipped, next template stored after it\n");
+   return 0;
+}
+
+// --- firmware --------------------------------------------------------------
+
+int runFirmware() {
+   if (!benchBootFirmware()) return 1;
+   speechMicrophoneOn();
+   int failures = 0;
+   speechCommand("clear_voice_templates", 0);
+   uint32_t events = benchBroker().publishedTo(audio_topic);
+   for (int a = 0; a < 2; a++) {
+      for (int i = 0; i < 3; i++) {
+         char name[32];
+         snprintf(name, sizeof(name), "enroll_%s", ACTIONS[a]);
+         speechCommand(name, i);
+         speechSay(speechKeywords[a], 100 * a + i);
+      }
+   }
+   uint16_t enrolled = keywordTemplates.count();
+   uint32_t enrollEvents = benchBroker().publishedTo(audio_topic) - events;
+
+   // The keyword model goes first in processVoiceCommand(); with it
+   // accepting nothing, only the templates can switch the relay
+   uint16_t modelAccept = keywordModel.getAcceptProbability();
+   keywordModel.setAcceptProbability(257);
+   uint32_t matched = keywordSpotter.stats().accepted;
+   int switched = 0;
+   const int TRIES = 4;
+   for (int i = 0; i < TRIES; i++) {
+      speechCommand("turn_off", 10 + i);
+      speechSay(speechKeywords[0], 5000 + i);
+      switched += host::pinLevel(LIGHT_RELAY_PIN) == HIGH;
+      speechSay(speechKeywords[1], 6000 + i);
+      switched += host::pinLevel(LIGHT_RELAY_PIN) == LOW;
+   }
+   matched = keywordSpotter.stats().accepted - matched;
+   keywordModel.setAcceptProbability(modelAccept);
+   benchOut.printf("firmware: %u templates enrolled (%u events), relay switched by voice %d of %d times, "
+                   "%u template matches (keyword model off)\n",
+                   (unsigned)enrolled, (unsigned)enrollEvents, switched, 2 * TRIES, (unsigned)matched);
+   if (enrolled != 6 || enrollEvents < 6 || switched < 2 * TRIES - 1 || (int)matched < switched) {
+      benchOut.printf("FAIL: firmware voice commands\n");
+      failures++;
+   }
+   speechCommand("clear_voice_templates", 1);
+   speechMicrophoneOff();
+   return failures;
+}
+
+} // namespace
+
+int benchKws() {
+   benchPrintHeader("kws: keyword spotting against enrolled templates");
+   host::setSerialEcho(false);
+   int failures = runCorpus();
+   if (store.ready()) failures += checkTornWrite();
+   failures += runFirmware();
+   return failures;
+}
@@ -0,0 +1,705 @@
+/*
+ bench_kwsnn.cpp - the int8 keyword model (src/keyword_model.h): kernel
+ exactness, golden outputs, accuracy, latency and memory.
+
+ Every optimized kernel - nnConv2d(), nnDepthwiseConv2d(),
+ nnFullyConnected() and each nnDot16() variant this CPU has - must match
+ its reference bit for bit on random tensors over a spread of shapes,
+ strides, paddings and zero points, extremes included; nnRequantize() must
+ be within one of the exact product. The whole model must give the same
+ probabilities with either set of kernels.
+
+ Golden outputs: the same network in double precision on the dequantized
+ weights of src/keyword_model_data.cpp, with no activation rounding, is
+ the reference. Over the kws suite's synthetic corpus (the same speakers
+ and unknown words, none of them in the training set) the int8
+ probabilities must stay within MAX_ERROR of it and the top class must
+ agree on at least AGREEMENT of the utterances. Accuracy, false rejects,
+ confusions and false accepts of unknown words are reported at a sweep of
+ accept probabilities and must meet MIN_ACCURACY / MAX_FALSE_ACCEPTS at the
+ default one.
+
+ Cost: host cycles per inference and per layer with the reference and the
+ optimized kernels, and an ESP32 cycle model of both that must keep an
+ inference under LATENCY_BUDGET at 240 MHz. Memory: the planned arena
+ against every tensor and scratch buffer in its own memory, the weights in
+ flash, and no heap allocation while inferring.
+
+ Last, the booted firmware with no templates enrolled must switch the relay
+ when new speakers say "turn on" and "turn off".
+*/
+
+#include "bench.h"
+#include "keyword_model.h"
+#include "keyword_spotter.h"
+#include "keyword_templates.h"
+#include "mfcc_frontend.h"
+#include "audio_capture.h"
+#include "synthetic_speech.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+typedef KeywordModelLayout Layout;
+
+const uint8_t CLASSES = KeywordModel::CLASSES;
+const int PER_ACTION = 40;            // Speakers per keyword, as in the kws suite
+const int PER_UNKNOWN = 8;
+const size_t UTTERANCE_SAMPLES = 40 * AudioFrame::SAMPLES;
+const double MAX_ERROR = 0.10;        // Largest probability difference to the double model
+const double MAX_MEAN_ERROR = 0.01;
+const double AGREEMENT = 0.97;        // Top class the same as the double model's
+const double MIN_ACCURACY = 0.95;     // Keywords recognised at the default accept probability
+const double MAX_FALSE_ACCEPTS = 0.10;
+const double CPU_HZ = 240e6;
+const double LATENCY_BUDGET = 0.020;  // Seconds per inference
+const uint8_t LIGHT_RELAY_PIN = 4;    // Matches LIGHT_RELAY_PIN in main.cpp
+
+uint32_t seed = 1;
+
+uint32_t next() {
+   seed = seed * 1664525u + 1013904223u;
+   return seed >> 8;
+}
+
+int32_t uniform(int32_t low, int32_t high) {
+   return low + (int32_t)(next() % (uint32_t)(high - low + 1));
+}
+
+// --- kernels ---------------------------------------------------------------
+
+const size_t MAX_TENSOR = 8192;
+const size_t MAX_WEIGHTS = 8192;
+const size_t MAX_CHANNELS = 64;
+const size_t MAX_SCRATCH = 16384;
+
+int8_t input[MAX_TENSOR];
+int8_t filter[MAX_WEIGHTS];
+int32_t bias[MAX_CHANNELS];
+NnRequant requant[MAX_CHANNELS];
+int8_t expected[MAX_TENSOR];
+int8_t actual[MAX_TENSOR];
+alignas(4) int16_t scratch[MAX_SCRATCH];
+
+enum Fill { RANDOM, HIGHEST, LOWEST };
+
+// Operands for one run; the extremes put every input and weight at the end
+// of its range the zero point is furthest from
+void fillOperands(Fill fill, size_t inputs, size_t weights, size_t channels, NnConvParams &params) {
+   params.inputZero = fill == RANDOM ? (int8_t)uniform(-128, 127) : fill == HIGHEST ? -128 : 127;
+   params.outputZero = (int8_t)uniform(-128, 127);
+   if (next() % 2) {
+      params.activationMin = -128;
+      params.activationMax = 127;
+   } else {
+      params.activationMin = params.outputZero;  // ReLU
+      params.activationMax = 127;
+   }
+   for (size_t i = 0; i < inputs; i++) {
+      input[i] = fill == RANDOM ? (int8_t)uniform(-128, 127) : fill == HIGHEST ? 127 : -128;
+   }
+   for (size_t i = 0; i < weights; i++) {
+      filter[i] = fill == RANDOM ? (int8_t)uniform(-127, 127) : (next() % 2 ? 127 : -127);
+   }
+   for (size_t c = 0; c < channels; c++) {
+      bias[c] = uniform(-20000, 20000);
+      requant[c].multiplier = (int32_t)(((uint32_t)1 << 30) + next() % ((uint32_t)1 << 30));
+      requant[c].shift = (int8_t)uniform(-14, 0);
+   }
+}
+
+// "Same" padding for a stride
+NnShape outputFor(const NnShape &in, NnConvParams &params, uint16_t channels) {
+   NnShape out = {(uint8_t)((in.height + params.strideHeight - 1) / params.strideHeight),
+                  (uint8_t)((in.width + params.strideWidth - 1) / params.strideWidth), channels};
+   int padHeight = (out.height - 1) * params.strideHeight + params.kernelHeight - in.height;
+   int padWidth = (out.width - 1) * params.strideWidth + params.kernelWidth - in.width;
+   params.padTop = padHeight > 0 ? padHeight / 2 : 0;
+   params.padLeft = padWidth > 0 ? padWidth / 2 : 0;
+   return out;
+}
+
+struct ConvCase {
+   NnShape input;
+   uint8_t kernelHeight, kernelWidth, strideHeight, strideWidth;
+   uint16_t outputChannels;  // Ignored for depthwise
+};
+
+const ConvCase CONV_CASES[] = {
+   {{32, 12, 1}, 3, 3, 2, 1, 16},  // The model's first layer
+   {{16, 12, 16}, 1, 1, 1, 1, 24},
+   {{9, 7, 3}, 3, 3, 1, 1, 5},
+   {{10, 10, 8}, 5, 5, 2, 2, 12},
+   {{5, 9, 7}, 2, 4, 1, 3, 3},
+   {{1, 1, 32}, 1, 1, 1, 1, 4},
+};
+
+const ConvCase DEPTHWISE_CASES[] = {
+   {{16, 12, 16}, 3, 3, 1, 1, 0},
+   {{16, 12, 24}, 3, 3, 2, 2, 0},
+   {{9, 9, 5}, 5, 5, 1, 1, 0},
+   {{7, 8, 3}, 3, 2, 2, 1, 0},
+   {{6, 6, 4}, 7, 7, 1, 1, 0},  // More taps than the optimized kernel keeps: the reference path
+};
+
+const uint16_t FC_CASES[][2] = {{32, 4}, {37, 5}, {1, 3}, {300, 10}};
+
+const int RUNS = 8;  // Per case: RUNS - 2 random, then both extremes
+
+Fill fillFor(int run) {
+   return run == RUNS - 2 ? HIGHEST : run == RUNS - 1 ? LOWEST : RANDOM;
+}
+
+int checkConv() {
+   int mismatches = 0, runs = 0;
+   for (const ConvCase &c : CONV_CASES) {
+      NnConvParams params = {c.kernelHeight, c.kernelWidth, c.strideHeight, c.strideWidth, 0, 0, 0, 0, 0, 0};
+      NnShape out = outputFor(c.input, params, c.outputChannels);
+      size_t weights = (size_t)c.outputChannels * c.kernelHeight * c.kernelWidth * c.input.channels;
+      if (c.input.size() > MAX_TENSOR || out.size() > MAX_TENSOR || weights > MAX_WEIGHTS ||
+          nnConv2dScratch(params, c.input, out) > MAX_SCRATCH) {
+         benchOut.printf("FAIL: conv case too large for the buffers\n");
+         return 1;
+      }
+      for (int run = 0; run < RUNS; run++, runs++) {
+         fillOperands(fillFor(run), c.input.size(), weights, c.outputChannels, params);
+         nnConv2dReference(params, c.input, input, filter, bias, requant, out, expected);
+         nnConv2d(params, c.input, input, filter, bias, requant, out, actual, scratch);
+         mismatches += memcmp(expected, actual, out.size()) != 0;
+      }
+   }
+   benchOut.printf("nnConv2d():          %2d runs over %d shapes, %d differ from the reference\n", runs,
+                   (int)(sizeof(CONV_CASES) / sizeof(CONV_CASES[0])), mismatches);
+   return mismatches;
+}
+
+int checkDepthwise() {
+   int mismatches = 0, runs = 0;
+   for (const ConvCase &c : DEPTHWISE_CASES) {
+      NnConvParams params = {c.kernelHeight, c.kernelWidth, c.strideHeight, c.strideWidth, 0, 0, 0, 0, 0, 0};
+      NnShape out = outputFor(c.input, params, c.input.channels);
+      size_t weights = (size_t)c.kernelHeight * c.kernelWidth * c.input.channels;
+      for (int run = 0; run < RUNS; run++, runs++) {
+         fillOperands(fillFor(run), c.input.size(), weights, c.input.channels, params);
+         nnDepthwiseConv2dReference(params, c.input, input, filter, bias, requant, out, expected);
+         nnDepthwiseConv2d(params, c.input, input, filter, bias, requant, out, actual, scratch);
+         mismatches += memcmp(expected, actual, out.size()) != 0;
+      }
+   }
+   benchOut.printf("nnDepthwiseConv2d(): %2d runs over %d shapes, %d differ from the reference\n", runs,
+                   (int)(sizeof(DEPTHWISE_CASES) / sizeof(DEPTHWISE_CASES[0])), mismatches);
+   return mismatches;
+}
+
+int checkFullyConnected() {
+   int mismatches = 0, runs = 0;
+   for (const uint16_t *c : FC_CASES) {
+      for (int run = 0; run < RUNS; run++, runs++) {
+         NnConvParams conv = {};
+         fillOperands(fillFor(run), c[0], (size_t)c[0] * c[1], c[1], conv);
+         NnFullyConnectedParams params = {conv.inputZero, conv.outputZero, conv.activationMin, conv.activationMax};
+         nnFullyConnectedReference(params, c[0], input, filter, bias, requant, c[1], expected);
+         nnFullyConnected(params, c[0], input, filter, bias, requant, c[1], actual, scratch);
+         mismatches += memcmp(expected, actual, c[1]) != 0;
+      }
+   }
+   benchOut.printf("nnFullyConnected():  %2d runs over %d shapes, %d differ from the reference\n", runs,
+                   (int)(sizeof(FC_CASES) / sizeof(FC_CASES[0])), mismatches);
+   return mismatches;
+}
+
+struct DotKernel {
+   const char *name;
+   int32_t (*dot)(const int16_t *, const int16_t *, size_t);
+};
+
+const DotKernel DOT_KERNELS[] = {
+   {"unrolled", nnDot16Unrolled},
+#if defined(__x86_64__)
+   {"sse2", nnDot16Sse2},
+#endif
+   {"nnDot16", nnDot16},
+};
+
+int checkDot() {
+   alignas(4) int16_t a[1024], b[1024];
+   int failures = 0;
+   for (const DotKernel &kernel : DOT_KERNELS) {
+      int mismatches = 0, runs = 0;
+      for (size_t count = 4; count <= 1024; count = count < 64 ? count + 4 : count * 2, runs++) {
+         // Operand ranges of the kernels: inputs less a zero point, weights
+         bool extreme = runs % 3 == 2;
+         for (size_t i = 0; i < count; i++) {
+            a[i] = extreme ? (next() % 2 ? 255 : -255) : (int16_t)uniform(-255, 255);
+            b[i] = extreme ? (next() % 2 ? 127 : -127) : (int16_t)uniform(-127, 127);
+         }
+         mismatches += kernel.dot(a, b, count) != nnDot16Reference(a, b, count);
+      }
+      benchOut.printf("nnDot16 %-12s %2d lengths from 4 to 1024, %d differ from the reference\n", kernel.name, runs,
+                      mismatches);
+      failures += mismatches;
+   }
+   return failures;
+}
+
+int checkRequantize() {
+   int worst = 0;
+   for (int i = 0; i < 100000; i++) {
+      NnRequant r = {(int32_t)(((uint32_t)1 << 30) + next() % ((uint32_t)1 << 30)), (int8_t)uniform(-20, 2)};
+      int32_t acc = i % 10 == 0 ? (next() % 2 ? INT32_MAX / 8 : INT32_MIN / 8) : uniform(-4000000, 4000000);
+      double exact = (double)acc * r.multiplier * ldexp(1.0, r.shift - 31);
+      int error = (int)fabs(nnRequantize(acc, r) - round(exact));
+      if (error > worst) worst = error;
+   }
+   benchOut.printf("nnRequantize():      100000 products, worst error %d (limit 1)\n", worst);
+   return worst > 1;
+}
+
+int checkKernels() {
+   benchOut.printf("kernels (nnDot16: %s)\n", nnDotKernel());
+   int failures = checkConv() + checkDepthwise() + checkFullyConnected() + checkDot() + checkRequantize();
+   if (failures) {
+      benchOut.printf("FAIL: %d optimized kernel runs differ from the reference\n", failures);
+      return 1;
+   }
+   return 0;
+}
+
+// --- corpus ----------------------------------------------------------------
+
+const int MAX_UTTERANCES = SPEECH_KEYWORDS * PER_ACTION + SPEECH_UNKNOWNS * PER_UNKNOWN;
+
+struct Utterance {
+   KeywordTemplate features;
+   int8_t label;  // Keyword, or UNKNOWN
+};
+
+Utterance utterances[MAX_UTTERANCES];
+int utteranceCount = 0;
+int refused = 0;
+int16_t audio[SPEECH_MAX_SAMPLES];
+MfccFrontEnd frontEnd;
+KeywordSpotter spotter(frontEnd);
+
+void addUtterance(const Word &word, uint32_t speaker, int8_t label) {
+   size_t count = synthesize(word, speakerFor(speaker), audio, UTTERANCE_SAMPLES);
+   Utterance &u = utterances[utteranceCount];
+   if (!extractUtterance(audio, count, frontEnd, spotter, u.features)) {
+      refused++;
+      return;
+   }
+   u.label = label;
+   utteranceCount++;
+}
+
+void buildCorpus() {
+   for (int a = 0; a < SPEECH_KEYWORDS; a++) {
+      for (int i = 0; i < PER_ACTION; i++) addUtterance(speechKeywords[a], 100 * a + i, a);
+   }
+   for (int u = 0; u < SPEECH_UNKNOWNS; u++) {
+      for (int i = 0; i < PER_UNKNOWN; i++) addUtterance(speechUnknowns[u], 1000 + 100 * u + i, KeywordModel::UNKNOWN);
+   }
+}
+
+// --- golden outputs --------------------------------------------------------
+
+// One layer's weights and the scale of each output channel's
+struct Dequantized {
+   const int8_t *filter;
+   const int32_t *bias;
+   const float *scale;
+};
+
+template <size_t WEIGHTS, uint16_t CHANNELS>
+Dequantized dequantized(const KeywordModelLayer<WEIGHTS, CHANNELS> &layer) {
+   return {layer.filter, layer.bias, layer.scale};
+}
+
+const size_t MAX_ACTIVATIONS =
+   Layout::regionSize(0) > Layout::regionSize(1) ? Layout::regionSize(0) : Layout::regionSize(1);
+
+double tensors[Layout::TENSORS][MAX_ACTIVATIONS];
+
+// The network in double precision: weights and biases dequantized, the
+// activations not rounded or clamped beyond the ReLU
+void referenceModel(const KeywordTemplate &features, double *probabilities) {
+   const KeywordModelWeights &w = keywordModelWeights;
+   const Dequantized layers[Layout::TENSORS] = {
+      {}, dequantized(w.conv), dequantized(w.depthwise1), dequantized(w.pointwise1), dequantized(w.depthwise2),
+      dequantized(w.pointwise2), dequantized(w.depthwise3), dequantized(w.pointwise3), {}, dequantized(w.dense),
+   };
+   for (size_t i = 0; i < Layout::SHAPES[Layout::FEATURES].size(); i++) {
+      tensors[Layout::FEATURES][i] = w.scale[Layout::FEATURES] * ((&features.features[0][0])[i] - w.zero[0]);
+   }
+   for (uint8_t t = Layout::CONV; t <= Layout::POINTWISE3; t++) {
+      const NnShape &in = Layout::SHAPES[t - 1];
+      const NnShape &out = Layout::SHAPES[t];
+      const NnConvParams &g = Layout::GEOMETRY[t];
+      const Dequantized &layer = layers[t];
+      double inputScale = w.scale[t - 1];
+      bool depthwise = Layout::isDepthwise(t);
+      for (int oy = 0; oy < out.height; oy++) {
+         for (int ox = 0; ox < out.width; ox++) {
+            for (int oc = 0; oc < out.channels; oc++) {
+               double sum = layer.bias[oc] * inputScale * layer.scale[oc];
+               for (int ky = 0; ky < g.kernelHeight; ky++) {
+                  for (int kx = 0; kx < g.kernelWidth; kx++) {
+                     int iy = oy * g.strideHeight - g.padTop + ky;
+                     int ix = ox * g.strideWidth - g.padLeft + kx;
+                     if (iy < 0 || iy >= in.height || ix < 0 || ix >= in.width) continue;
+                     const double *x = tensors[t - 1] + (iy * in.width + ix) * in.channels;
+                     if (depthwise) {
+                        sum += x[oc] * layer.filter[(ky * g.kernelWidth + kx) * in.channels + oc] * layer.scale[oc];
+                        continue;
+                     }
+                     const int8_t *f = layer.filter + ((oc * g.kernelHeight + ky) * g.kernelWidth + kx) * in.channels;
+                     for (int ic = 0; ic < in.channels; ic++) sum += x[ic] * f[ic] * layer.scale[oc];
+                  }
+               }
+               tensors[t][(oy * out.width + ox) * out.channels + oc] = sum > 0 ? sum : 0;
+            }
+         }
+      }
+   }
+   const NnShape &last = Layout::SHAPES[Layout::POINTWISE3];
+   for (int c = 0; c < last.channels; c++) {
+      double sum = 0;
+      for (int i = 0; i < last.height * last.width; i++) sum += tensors[Layout::POINTWISE3][i * last.channels + c];
+      tensors[Layout::POOL][c] = sum / (last.height * last.width);
+   }
+   const Dequantized &dense = layers[Layout::LOGITS];
+   double largest = -1e300;
+   for (int k = 0; k < CLASSES; k++) {
+      double sum = dense.bias[k] * w.scale[Layout::POOL] * dense.scale[k];
+      for (int i = 0; i < last.channels; i++) {
+         sum += tensors[Layout::POOL][i] * dense.filter[k * last.channels + i] * dense.scale[k];
+      }
+      tensors[Layout::LOGITS][k] = sum;
+      if (sum > largest) largest = sum;
+   }
+   double total = 0;
+   for (int k = 0; k < CLASSES; k++) total += probabilities[k] = exp(tensors[Layout::LOGITS][k] - largest);
+   for (int k = 0; k < CLASSES; k++) probabilities[k] /= total;
+}
+
+int argmax(const double *p) {
+   int best = 0;
+   for (int k = 1; k < CLASSES; k++) {
+      if (p[k] > p[best]) best = k;
+   }
+   return best;
+}
+
+int checkGolden() {
+   int differ = 0, agree = 0;
+   double worst = 0, total = 0;
+   for (int u = 0; u < utteranceCount; u++) {
+      int8_t optimized[CLASSES], reference[CLASSES];
+      keywordModel.infer(utterances[u].features, optimized);
+      keywordModel.infer(utterances[u].features, reference, true);
+      differ += memcmp(optimized, reference, sizeof(optimized)) != 0;
+      double golden[CLASSES], quantized[CLASSES];
+      referenceModel(utterances[u].features, golden);
+      for (int k = 0; k < CLASSES; k++) {
+         quantized[k] = (optimized[k] + 128) / 256.0;
+         double error = fabs(quantized[k] - golden[k]);
+         total += error;
+         if (error > worst) worst = error;
+      }
+      agree += argmax(quantized) == argmax(golden);
+   }
+   double mean = total / (utteranceCount * CLASSES);
+   double agreement = (double)agree / utteranceCount;
+   benchOut.printf("golden: %d utterances (%d refused by the detector or spotter) against the double model:\n",
+                   utteranceCount, refused);
+   benchOut.printf("  probability error mean %.4f, max %.4f (limits %.2f, %.2f); top class agrees %.1f%% "
+                   "(limit %.0f%%); reference and optimized kernels differ on %d\n",
+                   mean, worst, MAX_MEAN_ERROR, MAX_ERROR, 100 * agreement, 100 * AGREEMENT, differ);
+   if (differ || worst > MAX_ERROR || mean > MAX_MEAN_ERROR || agreement < AGREEMENT) {
+      benchOut.printf("FAIL: int8 model against the double one\n");
+      return 1;
+   }
+   return 0;
+}
+
+// --- accuracy --------------------------------------------------------------
+
+int checkAccuracy() {
+   const uint16_t ACCEPTS[] = {128, 160, 192, 224, 240};
+   int failures = 0;
+   uint16_t accept = keywordModel.getAcceptProbability();
+   benchOut.printf("%-8s %9s %9s %9s %14s\n", "accept", "correct", "rejected", "confused", "false accepts");
+   for (uint16_t probability : ACCEPTS) {
+      keywordModel.setAcceptProbability(probability);
+      int correct = 0, rejected = 0, confused = 0, keywords = 0, accepted = 0, unknowns = 0;
+      for (int u = 0; u < utteranceCount; u++) {
+         int8_t keyword = keywordModel.classify(utterances[u].features);
+         if (utterances[u].label == KeywordModel::UNKNOWN) {
+            unknowns++;
+            accepted += keyword >= 0;
+            continue;
+         }
+         keywords++;
+         if (keyword == utterances[u].label) {
+            correct++;
+         } else if (keyword < 0) {
+            rejected++;
+         } else {
+            confused++;
+         }
+      }
+      double accuracy = keywords ? (double)correct / keywords : 0;
+      double falseAccepts = unknowns ? (double)accepted / unknowns : 0;
+      benchOut.printf("%3u/256%s %8.1f%% %8.1f%% %8.1f%% %13.1f%%\n", (unsigned)probability,
+                      probability == accept ? "*" : " ", 100 * accuracy, keywords ? 100.0 * rejected / keywords : 0,
+                      keywords ? 100.0 * confused / keywords : 0, 100 * falseAccepts);
+      if (probability == accept && (accuracy < MIN_ACCURACY || falseAccepts > MAX_FALSE_ACCEPTS)) {
+         benchOut.printf("FAIL: %.1f%% correct, %.1f%% false accepts at the default accept probability "
+                         "(limits %.0f%%, %.0f%%)\n",
+                         100 * accuracy, 100 * falseAccepts, 100 * MIN_ACCURACY, 100 * MAX_FALSE_ACCEPTS);
+         failures++;
+      }
+   }
+   keywordModel.setAcceptProbability(accept);
+   benchOut.printf("(* KeywordModel::DEFAULT_ACCEPT)\n");
+   return failures;
+}
+
+// --- cost ------------------------------------------------------------------
+
+// Operations of one layer's loops, counted from src/nn_kernels.cpp
+struct LayerModel {
+   uint32_t loads;
+   uint32_t stores;
+   uint32_t alu;
+   uint32_t mul;       // MULL / MUL16S, result used next
+   uint32_t mac;       // MULA.DD.LDINC: one per cycle, loads included
+   uint32_t mul64;     // nnRequantize(): MULL + MULSH
+   uint32_t branches;  // Taken, outside zero-overhead LOOPs
+};
+
+// Xtensa LX6 as in the mfcc suite; a MAC16 multiply-accumulate with its
+// load issues every cycle
+const double LOAD = 1, STORE = 1, ALU = 1, MUL = 2, MAC = 1, MUL64 = 4, BRANCH = 3, STALL = 1.3;
+
+double modelCycles(const LayerModel &m) {
+   return STALL * (LOAD * m.loads + STORE * m.stores + ALU * m.alu + MUL * m.mul + MAC * m.mac + MUL64 * m.mul64 +
+                   BRANCH * m.branches);
+}
+
+// Taps of a layer's kernel inside the input, summed over its output positions
+uint32_t insideTaps(uint8_t t) {
+   const NnShape &in = Layout::SHAPES[t - 1];
+   const NnShape &out = Layout::SHAPES[t];
+   const NnConvParams &g = Layout::GEOMETRY[t];
+   uint32_t taps = 0;
+   for (int oy = 0; oy < out.height; oy++) {
+      for (int ox = 0; ox < out.width; ox++) {
+         for (int ky = 0; ky < g.kernelHeight; ky++) {
+            for (int kx = 0; kx < g.kernelWidth; kx++) {
+               int iy = oy * g.strideHeight - g.padTop + ky;
+               int ix = ox * g.strideWidth - g.padLeft + kx;
+               taps += iy >= 0 && iy < in.height && ix >= 0 && ix < in.width;
+            }
+         }
+      }
+   }
+   return taps;
+}
+
+// Multiplies a layer does, padding taps left out
+uint32_t layerMacs(uint8_t t) {
+   const NnShape &in = Layout::SHAPES[t - 1];
+   const NnShape &out = Layout::SHAPES[t];
+   if (t == Layout::LOGITS) return (uint32_t)in.size() * out.channels;
+   if (t == Layout::POOL) return 0;
+   return insideTaps(t) * (Layout::isDepthwise(t) ? in.channels : (uint32_t)in.channels * out.channels);
+}
+
+// nnOutput(): bias load, nnRequantize()'s two 64-bit products, rounding,
+// zero point, clamp and store
+const LayerModel REQUANTIZE = {1, 1, 16, 0, 0, 2, 2};
+
+LayerModel &operator+=(LayerModel &a, const LayerModel &b) {
+   a.loads += b.loads;
+   a.stores += b.stores;
+   a.alu += b.alu;
+   a.mul += b.mul;
+   a.mac += b.mac;
+   a.mul64 += b.mul64;
+   a.branches += b.branches;
+   return a;
+}
+
+LayerModel times(const LayerModel &m, uint32_t n) {
+   return {m.loads * n, m.stores * n, m.alu * n, m.mul * n, m.mac * n, m.mul64 * n, m.branches * n};
+}
+
+LayerModel buildModel(uint8_t t, bool reference) {
+   const NnShape &in = Layout::SHAPES[t - 1];
+   const NnShape &out = Layout::SHAPES[t];
+   const NnConvParams &g = Layout::GEOMETRY[t];
+   LayerModel m = {};
+   if (t == Layout::POOL) {
+      // A load and add per input, a division per channel
+      m += {(uint32_t)in.size(), out.channels, (uint32_t)in.size() + 40u * out.channels, 0, 0, 0, out.channels};
+      return m;
+   }
+   uint32_t macs = layerMacs(t);
+   uint32_t outputs = (uint32_t)out.size();
+   uint32_t positions = (uint32_t)out.height * out.width;
+   uint32_t taps = t == Layout::LOGITS ? 1 : (uint32_t)g.kernelHeight * g.kernelWidth;
+   m += times(REQUANTIZE, outputs);
+   if (reference) {
+      // Input and weight loads, zero point, index arithmetic and the sum per
+      // multiply; every tap's indices and bounds checked for every output
+      m += times({2, 0, 5, 1, 0, 0, 0}, macs);
+      if (t != Layout::LOGITS) m += times({0, 0, 12, 0, 0, 0, 1}, outputs * taps);
+      return m;
+   }
+   if (Layout::isDepthwise(t)) {
+      // Weights widened once, tap pointers per position, then per channel
+      // and inside tap two pointer and two operand loads, a MUL16S and a sum
+      m += times({1, 1, 1, 0, 0, 0, 0}, taps * in.channels);
+      m += times({0, 2, 10, 0, 0, 0, 1}, positions * taps);
+      m += times({4, 0, 3, 1, 0, 0, 0}, macs);
+      return m;
+   }
+   // Weights widened once, im2col of every position (padding as zeros),
+   // then per output a dot product: four MULA.DD.LDINC, ADDI and BNEZ per
+   // iteration
+   uint32_t patch = taps * in.channels;
+   uint32_t length = nnDotLength(patch);
+   m += times({1, 1, 2, 0, 0, 0, 0}, length * out.channels);
+   m += times({1, 1, 2, 0, 0, 0, 0}, patch * positions);
+   m += times({0, 0, 8, 0, 0, 0, 1}, taps * positions);
+   m += times({0, 0, 8 + length / 4, 0, length, 0, 1 + length / 4}, outputs);
+   return m;
+}
+
+const char *LAYER_NAMES[Layout::LAYERS] = {"conv",        "depthwise 1", "pointwise 1", "depthwise 2", "pointwise 2",
+                                           "depthwise 3", "pointwise 3", "pool",        "dense",       "softmax"};
+
+int measureCost() {
+   BenchSeries optimized, reference;
+   double layerOptimized[Layout::LAYERS] = {}, layerReference[Layout::LAYERS] = {};
+   int8_t probabilities[CLASSES];
+   uint64_t allocations = 0;
+   int runs = 0;
+   for (int round = 0; optimized.size() < 200; round++) {
+      for (int u = 0; u < utteranceCount && optimized.size() < 200; u += 3, runs++) {
+         BenchMeter meter;
+         meter.start();
+         keywordModel.infer(utterances[u].features, probabilities);
+         BenchSample sample = meter.stop();
+         optimized.add(sample);
+         allocations += sample.allocations;
+         for (int l = 0; l < Layout::LAYERS; l++) layerOptimized[l] += keywordModel.stats().layerCycles[l];
+         meter.start();
+         keywordModel.infer(utterances[u].features, probabilities, true);
+         sample = meter.stop();
+         reference.add(sample);
+         allocations += sample.allocations;
+         for (int l = 0; l < Layout::LAYERS; l++) layerReference[l] += keywordModel.stats().layerCycles[l];
+      }
+   }
+   benchPrintSeriesHeader("host, per inference");
+   benchPrintSeries("reference kernels", reference);
+   benchPrintSeries("optimized kernels", optimized);
+
+   benchOut.printf("%-12s %8s %11s %11s %7s %12s %12s %7s\n", "layer", "MACs", "host ref", "host opt", "speedup",
+                   "ESP32 ref", "ESP32 opt", "speedup");
+   double totalReference = 0, totalOptimized = 0;
+   uint32_t totalMacs = 0;
+   for (uint8_t t = Layout::CONV; t <= Layout::LAYERS; t++) {
+      uint8_t l = t - 1;
+      double modelReference, modelOptimized;
+      uint32_t macs = 0;
+      if (t == Layout::LAYERS) {
+         // Softmax: largest, table lookups, a division per class
+         modelReference = modelOptimized = modelCycles({3u * CLASSES, CLASSES, 50u * CLASSES, 0, 0, 0, CLASSES});
+      } else {
+         macs = layerMacs(t);
+         modelReference = modelCycles(buildModel(t, true));
+         modelOptimized = modelCycles(buildModel(t, false));
+      }
+      totalMacs += macs;
+      totalReference += modelReference;
+      totalOptimized += modelOptimized;
+      double hostReference = layerReference[l] / runs, hostOptimized = layerOptimized[l] / runs;
+      benchOut.printf("%-12s %8u %11.0f %11.0f %6.1fx %12.0f %12.0f %6.1fx\n", LAYER_NAMES[l], (unsigned)macs,
+                      hostReference, hostOptimized, hostOptimized > 0 ? hostReference / hostOptimized : 0,
+                      modelReference, modelOptimized, modelReference / modelOptimized);
+   }
+   benchOut.printf("%-12s %8u %11.0f %11.0f %6.1fx %12.0f %12.0f %6.1fx\n", "total", (unsigned)totalMacs,
+                   reference.meanCycles(), optimized.meanCycles(), reference.meanCycles() / optimized.meanCycles(),
+                   totalReference, totalOptimized, totalReference / totalOptimized);
+   double latency = totalOptimized / CPU_HZ;
+   benchOut.printf("modelled ESP32 latency at 240 MHz: %.2f ms optimized, %.2f ms reference (budget %.0f ms); "
+                   "stats(): max %u cycles\n",
+                   1000 * latency, 1000 * totalReference / CPU_HZ, 1000 * LATENCY_BUDGET,
+                   (unsigned)keywordModel.stats().maxCycles);
+
+   int failures = 0;
+   if (latency > LATENCY_BUDGET) {
+      benchOut.printf("FAIL: an inference would take %.1f ms\n", 1000 * latency);
+      failures++;
+   }
+
+   size_t even = Layout::regionSize(0), odd = Layout::regionSize(1), scratchBytes = Layout::scratchSize();
+   benchOut.printf("arena: %u bytes static (odd tensors %u + even tensors %u + int16 scratch %u), %u if every "
+                   "tensor and scratch buffer had its own; weights %u bytes in flash\n",
+                   (unsigned)KeywordModel::ARENA_SIZE, (unsigned)odd, (unsigned)even, (unsigned)scratchBytes,
+                   (unsigned)Layout::unplannedSize(), (unsigned)sizeof(KeywordModelWeights));
+   benchOut.printf("heap: %llu allocations over %d inferences\n", (unsigned long long)allocations, 2 * runs);
+   if (allocations != 0) {
+      benchOut.printf("FAIL: inference allocates\n");
+      failures++;
+   }
+   return failures;
+}
+
+// --- firmware --------------------------------------------------------------
+
+int runFirmware() {
+   if (!benchBootFirmware()) return 1;
+   speechMicrophoneOn();
+   speechCommand("clear_voice_templates", 0);
+   uint32_t accepted = keywordModel.stats().accepted;
+   int switched = 0;
+   const int TRIES = 4;
+   for (int i = 0; i < TRIES; i++) {
+      speechCommand("turn_off", 10 + i);
+      speechSay(speechKeywords[0], 7000 + i);
+      switched += host::pinLevel(LIGHT_RELAY_PIN) == HIGH;
+      speechSay(speechKeywords[1], 8000 + i);
+      switched += host::pinLevel(LIGHT_RELAY_PIN) == LOW;
+   }
+   accepted = keywordModel.stats().accepted - accepted;
+   speechMicrophoneOff();
+   benchOut.printf("firmware: no templates enrolled, relay switched by voice %d of %d times, %u keywords accepted "
+                   "by the model in %u cycles at most\n",
+                   switched, 2 * TRIES, (unsigned)accepted, (unsigned)keywordModel.stats().maxCycles);
+   if (keywordTemplates.count() != 0 || switched < 2 * TRIES - 1) {
+      benchOut.printf("FAIL: firmware voice commands without enrollment\n");
+      return 1;
+   }
+   return 0;
+}
+
+} // namespace
+
+int benchKwsNn() {
+   benchPrintHeader("kwsnn: int8 DS-CNN keyword model");
+   host::setSerialEcho(false);
+   int failures = checkKernels();
+   buildCorpus();
+   failures += checkGolden();
+   failures += checkAccuracy();
+   failures += measureCost();
+   failures += runFirmware();
+   return failures;
+}
@@ -0,0 +1,63 @@
+/*
+ bench_latency.cpp - command-to-relay latency.
+
+ turn_on/turn_off commands are scripted to arrive at staggered points in
+ firmware time, so they land at every phase of the loop's timers and waits.
+ Latency is measured on the virtual clock from the moment the PUBLISH
+ becomes readable to the moment the relay pin changes level; it therefore
+ captures scheduling delay and blocking waits, not host CPU speed.
+*/
+
+#include "bench.h"
+
+#include <stdio.h>
+
+extern const char *command_topic;
+
+namespace {
+
+const uint8_t LIGHT_RELAY_PIN = 4;  // Matches LIGHT_RELAY_PIN in main.cpp
+const int LATENCY_RUNS = 400;
+const int WARMUP_RUNS = 10;
+const int MAX_LOOPS_PER_COMMAND = 5000;
+
+} // namespace
+
+int benchLatency() {
+   benchPrintHeader("latency: command arrival -> relay pin change");
+   if (!benchBootFirmware()) return 1;
+
+   MockBroker &broker = benchBroker();
+   BenchSeries series;
+   int failures = 0;
+   char payload[96];
+
+   for (int run = 0; run < WARMUP_RUNS + LATENCY_RUNS; run++) {
+      int expected = host::pinLevel(LIGHT_RELAY_PIN) == HIGH ? LOW : HIGH;
+      snprintf(payload, sizeof(payload), "{\"command\":\"%s\",\"requestId\":\"lat-%d\"}",
+               expected == HIGH ? "turn_on" : "turn_off", run);
+
+      // Spread arrivals over 1..250 ms so they hit every phase of the loop
+      uint64_t arrival = host::nowMicros() + 1000 + (uint64_t)(run * 7919) % 250000;
+      broker.injectPublishAt(arrival, command_topic, payload);
+
+      for (int i = 0; i < MAX_LOOPS_PER_COMMAND && host::pinLevel(LIGHT_RELAY_PIN) != expected; i++) {
+         loop();
+      }
+      if (host::pinLevel(LIGHT_RELAY_PIN) != expected) {
+         failures++;
+         continue;
+      }
+      if (run >= WARMUP_RUNS) {
+         BenchSample sample = {host::pinChangedAtMicros(LIGHT_RELAY_PIN) - arrival, 0, 0};
+         series.add(sample);
+      }
+   }
+
+   benchPrintDistributionHeader("command", "us");
+   benchPrintDistribution("command -> relay", series);
+   if (failures) {
+      benchOut.printf("FAIL: relay did not follow %d commands\n", failures);
+   }
+   return failures;
+}
@@ -0,0 +1,199 @@
+/*
+ bench_main.cpp - host benchmark runner.
+
+ Usage: program [suite ...]   (no argument runs every suite)
+*/
+
+#include "bench.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+extern const char *command_topic;
+
+static const BenchSuite suites[] = {
+   {"firmware", "setup()/loop() driven by scripted MQTT commands", benchFirmware},
+   {"latency", "command-to-relay latency for commands arriving between loop() runs", benchLatency},
+   {"reconnect", "MQTT backoff during a broker outage and reconnect time after restarts", benchReconnect},
+   {"wifi", "WiFi outage recovery via cached BSSID/channel, associate/IP histograms", benchWiFi},
+   {"sound", "error/confirmation sounds: task run time, relay latency, tone timing", benchSound},
+   {"parse", "MQTT command parsing: String copy vs in-place zero-copy with a filter", benchParse},
+   {"dispatch", "command lookup: if/else chain vs compile-time perfect hash, 5..64 commands", benchDispatch},
+   {"relays", "switching all relay channels: per-channel commands vs set_channels", benchRelays},
+   {"journal", "relay state persistence: flash commits, erases and wear per toggle, boot replay", benchJournal},
+   {"mqttread", "inbound MQTT parsing over fragmented links: read calls, cycles, worst loop() time", benchMqttRead},
+   {"mqttwrite", "streamed JSON publishes: client write calls and segments, byte writes vs coalesced", benchMqttWrite},
+   {"mqttqos", "QoS 1 publishes: throughput per in-flight window, retransmission after drops", benchMqttQos},
+   {"outbox", "messages queued while MQTT is down: flash cost, drain time and order, reboot replay", benchOutbox},
+   {"mqtt5", "bytes per command round trip, MQTT 3.1.1 vs 5; aliased QoS 1 resends after reconnects", benchMqtt5},
+   {"mqttbatch", "32 KB command batch through a 512 B buffer: chunked delivery, worst loop(), cut-off", benchMqttBatch},
+   {"mqttvec", "vectored publish: copies, client writes and cycles vs copying into the packet buffer", benchMqttVec},
+   {"mqttcork", "one scheduler tick's packets: client writes and segments, packet by packet vs corked", benchMqttCork},
+   {"router", "inbound topic -> handler: cycles per topic, filter by filter vs topic trie at 4, 16 and 32 filters", benchRouter},
+   {"capture", "microphone samples lost while the loop is held up: polled reads vs the capture task and its ring", benchCapture},
+   {"vad", "voice activity per frame: float/sqrt detector vs integer energy kernels, bit-exact checks", benchVad},
+   {"kws", "keyword spotting: WAV corpus accuracy, DTW cycles with and without LB_Keogh pruning", benchKws},
+   {"mfcc", "MFCC front-end: accuracy against double precision, cycles per stage, ESP32 cycle model", benchMfcc},
+   {"kwsnn", "int8 keyword model: kernel exactness, golden outputs, accuracy, latency, arena size", benchKwsNn},
+};
+
+static const size_t NUM_SUITES = sizeof(suites) / sizeof(suites[0]);
+
+BenchOutput benchOut;
+
+size_t BenchOutput::write(uint8_t c) {
+   fputc(c, stdout);
+   return 1;
+}
+
+size_t BenchOutput::write(const uint8_t *buffer, size_t size) {
+   fwrite(buffer, 1, size, stdout);
+   return size;
+}
+
+void BenchMeter::start() {
+   startHeap = host::heapStats();
+   startCycles = host::cycleCounter();
+}
+
+BenchSample BenchMeter::stop() const {
+   uint64_t endCycles = host::cycleCounter();
+   host::HeapStats endHeap = host::heapStats();
+   BenchSample sample;
+   sample.cycles = endCycles - startCycles;
+   sample.allocations = (endHeap.allocations - startHeap.allocations) +
+                        (endHeap.reallocations - startHeap.reallocations);
+   sample.bytes = endHeap.bytesAllocated - startHeap.bytesAllocated;
+   return sample;
+}
+
+void BenchSeries::add(const BenchSample &sample) {
+   if (count < MAX_SAMPLES) {
+      cycles[count++] = sample.cycles;
+      allocations += sample.allocations;
+      bytes += sample.bytes;
+   }
+}
+
+uint64_t BenchSeries::percentile(double p) {
+   if (count == 0) return 0;
+   std::sort(cycles, cycles + count);
+   size_t index = (size_t)(p * (count - 1) + 0.5);
+   return cycles[index];
+}
+
+double BenchSeries::meanCycles() const {
+   if (count == 0) return 0;
+   double sum = 0;
+   for (size_t i = 0; i < count; i++) sum += cycles[i];
+   return sum / count;
+}
+
+double BenchSeries::allocationsPerSample() const {
+   return count ? (double)allocations / count : 0;
+}
+
+double BenchSeries::bytesPerSample() const {
+   return count ? (double)bytes / count : 0;
+}
+
+void benchPrintHeader(const char *title) {
+   benchOut.printf("\n=== %s ===\n", title);
+}
+
+void benchPrintSeriesHeader(const char *label) {
+   benchOut.printf("%-24s %8s %12s %12s %12s %12s %10s %12s\n",
+                   label, "runs", "mean cyc", "p50 cyc", "p99 cyc", "max cyc", "allocs", "heap bytes");
+}
+
+void benchPrintSeries(const char *label, BenchSeries &series) {
+   double mean = series.meanCycles();
+   benchOut.printf("%-24s %8u %12.0f %12llu %12llu %12llu %10.2f %12.1f\n",
+                   label,
+                   (unsigned)series.size(),
+                   mean,
+                   (unsigned long long)series.percentile(0.50),
+                   (unsigned long long)series.percentile(0.99),
+                   (unsigned long long)series.percentile(1.0),
+                   series.allocationsPerSample(),
+                   series.bytesPerSample());
+}
+
+void benchPrintDistributionHeader(const char *label, const char *unit) {
+   char columns[4][16];
+   const char *names[4] = {"mean", "p50", "p99", "max"};
+   for (int i = 0; i < 4; i++) {
+      snprintf(columns[i], sizeof(columns[i]), "%s %s", names[i], unit);
+   }
+   benchOut.printf("%-24s %8s %12s %12s %12s %12s\n",
+                   label, "runs", columns[0], columns[1], columns[2], columns[3]);
+}
+
+void benchPrintDistribution(const char *label, BenchSeries &series) {
+   benchOut.printf("%-24s %8u %12.0f %12llu %12llu %12llu\n",
+                   label,
+                   (unsigned)series.size(),
+                   series.meanCycles(),
+                   (unsigned long long)series.percentile(0.50),
+                   (unsigned long long)series.percentile(0.99),
+                   (unsigned long long)series.percentile(1.0));
+}
+
+MockBroker &benchBroker() {
+   static MockBroker broker;
+   return broker;
+}
+
+bool benchBootFirmware() {
+   static bool booted = false;
+   if (booted) return true;
+
+   host::setVirtualClock(true);
+   host::setSerialEcho(false);
+   host::setTransport(&benchBroker());
+
+   setup();
+   for (int i = 0; i < 2000 && !benchBroker().subscribed(command_topic); i++) {
+      loop();
+   }
+   // Drain the SUBACK so the first scripted command is processed by the
+   // very next loop()
+   for (int i = 0; i < 100 && benchBroker().available() > 0; i++) {
+      loop();
+   }
+   booted = benchBroker().subscribed(command_topic);
+   if (!booted) {
+      benchOut.printf("firmware never subscribed to %s\n", command_topic);
+   }
+   return booted;
+}
+
+static void usage(const char *argv0) {
+   printf("usage: %s [suite ...]\n\nsuites:\n", argv0);
+   for (size_t i = 0; i < NUM_SUITES; i++) {
+      printf("  %-16s %s\n", suites[i].name, suites[i].description);
+   }
+}
+
+int main(int argc, char **argv) {
+   int failures = 0;
+   if (argc < 2) {
+      for (size_t i = 0; i < NUM_SUITES; i++) {
+         failures += suites[i].run() != 0;
+      }
+      return failures ? 1 : 0;
+   }
+   for (int arg = 1; arg < argc; arg++) {
+      const BenchSuite *suite = NULL;
+      for (size_t i = 0; i < NUM_SUITES; i++) {
+         if (strcmp(argv[arg], suites[i].name) == 0) suite = &suites[i];
+      }
+      if (suite == NULL) {
+         usage(argv[0]);
+         return 2;
+      }
+      failures += suite->run() != 0;
+   }
+   return failures ? 1 : 0;
+}
@@ -0,0 +1,471 @@
+/*
+ bench_mfcc.cpp - the streaming MFCC front-end: accuracy and cost per frame.
+
+ MfccFrontEnd (src/mfcc_frontend.h) turns the microphone stream into
+ 13 cepstral coefficients every 10 ms in int16/int64 arithmetic. Checked
+ here:
+
+ - accuracy: every frame of tones, a chirp, white noise and speech-like
+   buzz at -6 to -60 dBFS against the same pipeline in double precision
+   (direct 512-point DFT, continuous mel triangles, exact log2, the same
+   48 dB floor). Errors are in log2 units (1 = 3 dB) for the log-mel bands,
+   for c0..c12 and for the frame energy
+ - streaming: the same audio fed 1, 37, 160 and 1024 samples at a time
+   gives the same frames
+ - cost: host cycles per stage and per 1024-sample capture frame, and an
+   ESP32 cycle model of the same loops - loads, stores, ALU operations,
+   16 and 32-bit multiplies, 64-bit adds per frame, at LX6 costs - that
+   must keep the front-end under 15% of one 240 MHz core at 100 frames/s
+ - the firmware runs it on every captured frame and reports its on-target
+   load (cycles from CCOUNT) in the heartbeat
+*/
+
+#include "bench.h"
+#include "mfcc_frontend.h"
+#include "voice_activity.h"
+#include "audio_capture.h"
+
+#include <math.h>
+#include <string.h>
+
+extern const char *heartbeat_topic;
+
+namespace {
+
+const uint16_t RATE = MfccFrontEnd::SAMPLE_RATE;
+const uint16_t WINDOW = MfccFrontEnd::WINDOW;
+const uint16_t HOP = MfccFrontEnd::HOP;
+const uint16_t FFT_SIZE = MfccFrontEnd::FFT_SIZE;
+const uint16_t BINS = MfccFrontEnd::BINS;
+const uint8_t BANDS = MfccFrontEnd::MEL_BANDS;
+const uint8_t COEFFS = MfccFrontEnd::COEFFS;
+const size_t SIGNAL = RATE;                 // 1 s per test signal, 98 frames
+const size_t FRAMES = (SIGNAL - WINDOW) / HOP + 1;
+const double FLOOR = MfccFrontEnd::FLOOR_Q8 / 256.0;
+const double CPU_HZ = 240e6;
+const double BUDGET = 0.15;
+
+uint32_t seed = 7;
+
+double uniform() {
+   seed = seed * 1664525u + 1013904223u;
+   return (seed >> 8) / 16777216.0 * 2 - 1;
+}
+
+int16_t clip(double value) {
+   return (int16_t)(value > 32767 ? 32767 : (value < -32768 ? -32768 : lrint(value)));
+}
+
+enum Kind { TONE, CHIRP, NOISE, BUZZ };
+
+struct Signal {
+   const char *name;
+   Kind kind;
+   double dbfs;  // Peak
+};
+
+const Signal SIGNALS[] = {
+   {"tone 1 kHz -6 dBFS", TONE, -6},     {"tone 1 kHz -60 dBFS", TONE, -60}, {"chirp -12 dBFS", CHIRP, -12},
+   {"noise -20 dBFS", NOISE, -20},       {"buzz -6 dBFS", BUZZ, -6},         {"buzz -30 dBFS", BUZZ, -30},
+   {"buzz -50 dBFS", BUZZ, -50},
+};
+const int SIGNAL_COUNT = sizeof(SIGNALS) / sizeof(SIGNALS[0]);
+
+int16_t audio[SIGNAL];
+
+// Buzz: 120-180 Hz pitch, harmonics through two resonances that move, plus
+// some breath noise
+void generate(const Signal &s, int16_t *out) {
+   double amplitude = 32768 * pow(10, s.dbfs / 20);
+   double phase = 0;
+   double low = 0, band = 0;
+   for (size_t n = 0; n < SIGNAL; n++) {
+      double t = (double)n / RATE;
+      double value = 0;
+      switch (s.kind) {
+      case TONE: value = sin(2 * M_PI * 1000 * t); break;
+      case CHIRP:
+         phase += 2 * M_PI * (100 + 7800 * t) / RATE;
+         value = sin(phase);
+         break;
+      case NOISE: value = uniform(); break;
+      case BUZZ: {
+         double pitch = 150 + 30 * sin(2 * M_PI * 2 * t);
+         phase += 2 * M_PI * pitch / RATE;
+         double pulse = fmod(phase, 2 * M_PI) < 2 * M_PI * pitch / RATE ? 1.0 : 0.0;
+         double f = 500 + 1500 * (0.5 + 0.5 * sin(2 * M_PI * 3 * t));
+         double g = 2 * sin(M_PI * f / RATE);
+         double excitation = pulse * 20 + 0.05 * uniform();
+         low += g * band;
+         band += g * (excitation - low - 0.1 * band);
+         value = 0.25 * band;
+         break;
+      }
+      }
+      out[n] = clip(amplitude * (value > 1 ? 1 : (value < -1 ? -1 : value)));
+   }
+}
+
+// --- double-precision reference --------------------------------------------
+
+double melOf(double hz) { return 1127.0 * log(1.0 + hz / 700.0); }
+
+struct Reference {
+   double cosine[FFT_SIZE];
+   double window[WINDOW];
+   double filters[BANDS][BINS];
+   double dct[COEFFS][BANDS];
+
+   void init() {
+      for (int k = 0; k < FFT_SIZE; k++) cosine[k] = cos(2 * M_PI * k / FFT_SIZE);
+      for (int n = 0; n < WINDOW; n++) window[n] = 0.54 - 0.46 * cos(2 * M_PI * n / (WINDOW - 1));
+      double lowMel = melOf(20), highMel = melOf(RATE / 2);
+      double edges[BANDS + 2];
+      for (int i = 0; i < BANDS + 2; i++) edges[i] = lowMel + (highMel - lowMel) * i / (BANDS + 1);
+      for (int b = 0; b < BANDS; b++) {
+         for (int k = 0; k < BINS; k++) {
+            double mel = melOf((double)k * RATE / FFT_SIZE);
+            double w = 0;
+            if (mel > edges[b] && mel < edges[b + 1]) w = (mel - edges[b]) / (edges[b + 1] - edges[b]);
+            if (mel >= edges[b + 1] && mel < edges[b + 2]) w = (edges[b + 2] - mel) / (edges[b + 2] - edges[b + 1]);
+            filters[b][k] = w;
+         }
+      }
+      for (int i = 0; i < COEFFS; i++) {
+         for (int b = 0; b < BANDS; b++) {
+            dct[i][b] = i == 0 ? 1.0 / BANDS : sqrt(2.0 / BANDS) * cos(M_PI * i * (b + 0.5) / BANDS);
+         }
+      }
+   }
+
+   // log2 units throughout
+   void frame(const int16_t *x, double *logMel, double *coeffs, double &energy) const {
+      double v[WINDOW];
+      double sumSquares = 0;
+      for (int n = 0; n < WINDOW; n++) {
+         double previous = n > 0 ? x[n - 1] : x[0];
+         v[n] = (x[n] - 0.97 * previous) / 2 * window[n];
+         sumSquares += (double)x[n] * x[n];
+      }
+      energy = sumSquares > 0 ? log2(sumSquares) : 0;
+      double power[BINS];
+      for (int k = 0; k < BINS; k++) {
+         double re = 0, im = 0;
+         for (int n = 0; n < WINDOW; n++) {
+            int at = (k * n) & (FFT_SIZE - 1);
+            re += v[n] * cosine[at];
+            im -= v[n] * cosine[(at + FFT_SIZE * 3 / 4) & (FFT_SIZE - 1)];
+         }
+         power[k] = re * re + im * im;
+      }
+      double loudest = 0;
+      for (int b = 0; b < BANDS; b++) {
+         double mel = 0;
+         for (int k = 0; k < BINS; k++) mel += filters[b][k] * power[k];
+         logMel[b] = mel > 1 ? log2(mel) : 0;
+         loudest = logMel[b] > loudest ? logMel[b] : loudest;
+      }
+      for (int b = 0; b < BANDS; b++) {
+         if (logMel[b] < loudest - FLOOR) logMel[b] = loudest - FLOOR;
+      }
+      for (int i = 0; i < COEFFS; i++) {
+         coeffs[i] = 0;
+         for (int b = 0; b < BANDS; b++) coeffs[i] += dct[i][b] * logMel[b];
+      }
+   }
+};
+
+Reference reference;
+
+struct Error {
+   double sum;
+   double max;
+   uint32_t count;
+
+   void add(double e) {
+      e = fabs(e);
+      sum += e;
+      if (e > max) max = e;
+      count++;
+   }
+   double mean() const { return count ? sum / count : 0; }
+};
+
+// The fixed-point stages of one frame, as MfccFrontEnd::compute() runs them
+void fixedFrame(const int16_t *x, int16_t *logMel, int16_t *coeffs) {
+   int16_t real[FFT_SIZE / 2], imag[FFT_SIZE / 2];
+   uint32_t power[BINS];
+   uint64_t mel[BANDS];
+   int8_t shift = mfccWindow(x, real, imag);
+   shift += mfccFft(real, imag);
+   mfccPowerSpectrum(real, imag, power);
+   mfccMelEnergies(power, mel);
+   mfccLogMel(mel, shift, logMel);
+   mfccDct(logMel, coeffs);
+}
+
+MfccFrontEnd frontEnd;
+
+int checkAccuracy() {
+   int failures = 0;
+   benchOut.printf("%-22s %10s %10s %10s %10s %10s %10s\n", "signal (log2 units)", "mel mean", "mel max",
+                   "c0 max", "c1-12 mean", "c1-12 max", "energy max");
+   Error allMel = {}, allCeps = {};
+   for (int s = 0; s < SIGNAL_COUNT; s++) {
+      generate(SIGNALS[s], audio);
+      frontEnd.reset();
+      frontEnd.addAudio(audio, SIGNAL);
+      Error mel = {}, c0 = {}, ceps = {}, energy = {};
+      for (size_t f = 0; f < FRAMES; f++) {
+         double refMel[BANDS], refCoeffs[COEFFS], refEnergy;
+         reference.frame(audio + f * HOP, refMel, refCoeffs, refEnergy);
+         int16_t logMel[BANDS], coeffs[COEFFS];
+         fixedFrame(audio + f * HOP, logMel, coeffs);
+         if (memcmp(coeffs, frontEnd.frame(f), sizeof(coeffs)) != 0) {
+            benchOut.printf("FAIL: %s frame %u: front-end and stages differ\n", SIGNALS[s].name, (unsigned)f);
+            failures++;
+         }
+         for (int b = 0; b < BANDS; b++) {
+            mel.add(logMel[b] / 256.0 - refMel[b]);
+            allMel.add(logMel[b] / 256.0 - refMel[b]);
+         }
+         c0.add(coeffs[0] / 256.0 - refCoeffs[0]);
+         for (int i = 1; i < COEFFS; i++) {
+            ceps.add(coeffs[i] / 256.0 - refCoeffs[i]);
+            allCeps.add(coeffs[i] / 256.0 - refCoeffs[i]);
+         }
+         energy.add(frontEnd.energy(f) / 256.0 - refEnergy);
+      }
+      benchOut.printf("%-22s %10.4f %10.4f %10.4f %10.4f %10.4f %10.4f\n", SIGNALS[s].name, mel.mean(), mel.max,
+                      c0.max, ceps.mean(), ceps.max, energy.max);
+      if (energy.max > 1.5 / 256) {
+         benchOut.printf("FAIL: %s: frame energy off by %.4f\n", SIGNALS[s].name, energy.max);
+         failures++;
+      }
+   }
+   benchOut.printf("all: log-mel mean %.4f max %.4f, c1-c12 mean %.4f max %.4f (%u bands, %u coefficients)\n",
+                   allMel.mean(), allMel.max, allCeps.mean(), allCeps.max, (unsigned)allMel.count,
+                   (unsigned)allCeps.count);
+   // 0.05 log2 units is 0.15 dB
+   if (allMel.mean() > 0.05 || allCeps.mean() > 0.05 || allMel.max > 1 || allCeps.max > 0.5) {
+      benchOut.printf("FAIL: fixed-point front-end strays from the double-precision one\n");
+      failures++;
+   }
+   return failures;
+}
+
+int checkStreaming() {
+   generate(SIGNALS[4], audio);
+   static int16_t expected[MfccFrontEnd::RING_FRAMES][COEFFS];
+   frontEnd.reset();
+   frontEnd.addAudio(audio, SIGNAL);
+   for (size_t f = 0; f < FRAMES; f++) memcpy(expected[f], frontEnd.frame(f), sizeof(expected[f]));
+   const size_t CHUNKS[] = {1, 37, HOP, AudioFrame::SAMPLES};
+   int failures = 0;
+   for (size_t c = 0; c < sizeof(CHUNKS) / sizeof(CHUNKS[0]); c++) {
+      frontEnd.reset();
+      for (size_t at = 0; at < SIGNAL; at += CHUNKS[c]) {
+         frontEnd.addAudio(audio + at, at + CHUNKS[c] <= SIGNAL ? CHUNKS[c] : SIGNAL - at);
+      }
+      bool same = frontEnd.written() == FRAMES;
+      for (size_t f = 0; same && f < FRAMES; f++) same = memcmp(expected[f], frontEnd.frame(f), sizeof(expected[f])) == 0;
+      if (!same) {
+         benchOut.printf("FAIL: fed %u samples at a time: %u frames, different coefficients\n", (unsigned)CHUNKS[c],
+                         (unsigned)frontEnd.written());
+         failures++;
+      }
+   }
+   if (failures == 0) {
+      benchOut.printf("streaming: %u frames per second of audio, the same fed 1, 37, 160 or 1024 samples at a time\n",
+                      (unsigned)FRAMES);
+   }
+   return failures;
+}
+
+// --- cost ------------------------------------------------------------------
+
+// Operations per frame of each stage's loops, counted from src/mfcc_frontend.cpp
+struct StageModel {
+   const char *name;
+   uint32_t loads;
+   uint32_t stores;
+   uint32_t alu;      // add, sub, shift, logic, compare, NSAU
+   uint32_t mul;      // MUL16S / MULL / MULA
+   uint32_t mul64;    // 32x32 -> 64: MULL + MULUH
+   uint32_t add64;
+   uint32_t branches; // Taken, outside zero-overhead LOOPs
+};
+
+// Xtensa LX6: one load, store or ALU op per cycle; multiplies stall the
+// next use by a cycle; a 64-bit add is add, add, compare, add; taken
+// branches cost 3. STALL covers load-use interlocks the counts leave out.
+const double LOAD = 1, STORE = 1, ALU = 1, MUL = 2, MUL64 = 4, ADD64 = 4, BRANCH = 3, STALL = 1.3;
+
+double modelCycles(const StageModel &m) {
+   return STALL * (LOAD * m.loads + STORE * m.stores + ALU * m.alu + MUL * m.mul + MUL64 * m.mul64 +
+                   ADD64 * m.add64 + BRANCH * m.branches);
+}
+
+void buildModel(StageModel *stages, int &count) {
+   const uint32_t N = FFT_SIZE / 2;
+   const uint32_t LOG2N = 8;
+   const uint32_t TWIDDLE_GROUPS = N - 2;  // j values over stages 2..8: 2 + 4 + ... + 128
+   count = 0;
+   // addAudio(): copy HOP samples in, slide WINDOW - HOP out (memmove by words)
+   stages[count++] = {"buffer", HOP + (WINDOW - HOP) / 2, HOP + (WINDOW - HOP) / 2, 2 * HOP, 0, 0, 0, HOP};
+   // frameEnergyMac16(): one word load and two MULAs per sample pair
+   stages[count++] = {"energy", WINDOW / 2, 0, 8, WINDOW, 0, 4, 4};
+   // mfccWindow(): OR of the raw magnitudes; scaling, pre-emphasis, window,
+   // OR of magnitudes; bit-reversed scatter with the shift; zero padding
+   stages[count++] = {"window", 3 * WINDOW + 3 * WINDOW / 2 + (N - WINDOW / 2), WINDOW + WINDOW + 2 * (N - WINDOW / 2),
+                      2 * WINDOW + 8 * WINDOW + WINDOW, 2 * WINDOW, 0, 0, 0};
+   // mfccFft(): 4 loads, 4 stores per butterfly; stage 1 adds and halves,
+   // the others multiply by the twiddle, round, add and shift; every output
+   // goes into the OR of magnitudes
+   stages[count++] = {"fft", 4 * N * LOG2N / 2 + 2 * TWIDDLE_GROUPS, 4 * N * LOG2N / 2,
+                      16 * N / 2 + 24 * (N / 2) * (LOG2N - 1) + 4 * TWIDDLE_GROUPS, 4 * (N / 2) * (LOG2N - 1), 0, 0,
+                      TWIDDLE_GROUPS + LOG2N};
+   // mfccPowerSpectrum(): per bin 4 data and 2 twiddle loads, 4 + 2 multiplies
+   stages[count++] = {"split + power", 6 * N, N + 1, 20 * N, 6 * N, 0, 0, 0};
+   // mfccMelEnergies(): per bin segment, weight, power; two 64-bit
+   // accumulators read, multiplied into and written back
+   stages[count++] = {"mel", 3 * BINS + 4 * BINS, 4 * BINS, 4 * BINS, 0, 2 * BINS, 2 * BINS, 4};
+   // mfccLog2() of each band, mfccLogMel()'s offset, peak and floor
+   stages[count++] = {"log", 4 * (BANDS + 1), 2 * BANDS + 1, 24 * (BANDS + 1), BANDS + 1, 0, 0, BANDS + 1};
+   // mfccDct(): the mean for c0, a MAC per band and coefficient, rounding
+   // and saturation
+   stages[count++] = {"dct", BANDS + 2 * (COEFFS - 1) * BANDS, COEFFS, BANDS + (COEFFS - 1) * (BANDS + 6) + 10,
+                      (COEFFS - 1) * BANDS, 0, 0, COEFFS};
+   // Ring slot, energy store, counters and CCOUNT reads
+   stages[count++] = {"bookkeeping", 10, 10, 30, 0, 0, 2, 6};
+}
+
+BenchSeries stageSeries[7];
+
+int measureCost() {
+   const char *names[] = {"window", "fft", "split + power", "mel", "log", "dct", "energy"};
+   generate(SIGNALS[4], audio);
+   alignas(4) int16_t frame[WINDOW];
+   for (size_t f = 0; f < FRAMES * 20 && stageSeries[0].size() < BenchSeries::MAX_SAMPLES; f++) {
+      memcpy(frame, audio + (f % FRAMES) * HOP, sizeof(frame));
+      int16_t real[FFT_SIZE / 2], imag[FFT_SIZE / 2], logMel[BANDS], coeffs[COEFFS];
+      uint32_t power[BINS];
+      uint64_t mel[BANDS];
+      BenchMeter meter;
+      meter.start();
+      int8_t shift = mfccWindow(frame, real, imag);
+      stageSeries[0].add(meter.stop());
+      meter.start();
+      shift += mfccFft(real, imag);
+      stageSeries[1].add(meter.stop());
+      meter.start();
+      mfccPowerSpectrum(real, imag, power);
+      stageSeries[2].add(meter.stop());
+      meter.start();
+      mfccMelEnergies(power, mel);
+      stageSeries[3].add(meter.stop());
+      meter.start();
+      mfccLogMel(mel, shift, logMel);
+      stageSeries[4].add(meter.stop());
+      meter.start();
+      mfccDct(logMel, coeffs);
+      stageSeries[5].add(meter.stop());
+      meter.start();
+      volatile int32_t energy = mfccLog2(frameEnergy(frame, WINDOW));
+      (void)energy;
+      stageSeries[6].add(meter.stop());
+   }
+   BenchSeries capture;
+   frontEnd.reset();
+   for (int round = 0; capture.size() < 600; round++) {
+      for (size_t at = 0; at + AudioFrame::SAMPLES <= SIGNAL; at += AudioFrame::SAMPLES) {
+         BenchMeter meter;
+         meter.start();
+         frontEnd.addAudio(audio + at, AudioFrame::SAMPLES);
+         capture.add(meter.stop());
+      }
+   }
+   benchPrintSeriesHeader("host, per frame");
+   for (int s = 0; s < 7; s++) benchPrintSeries(names[s], stageSeries[s]);
+   benchPrintSeries("addAudio(), 1024 samples", capture);
+   const MfccFrontEndStats &stats = frontEnd.stats();
+   benchOut.printf("stats(): %u frames, %.0f cycles per frame, max %u\n", (unsigned)stats.frames,
+                   stats.frames ? (double)stats.cycles / stats.frames : 0.0, (unsigned)stats.maxCycles);
+
+   StageModel stages[12];
+   int count = 0;
+   buildModel(stages, count);
+   benchOut.printf("%-16s %7s %7s %7s %7s %7s %7s %7s %10s\n", "ESP32 model", "loads", "stores", "alu", "mul",
+                   "mul64", "add64", "branch", "cycles");
+   double total = 0;
+   for (int s = 0; s < count; s++) {
+      const StageModel &m = stages[s];
+      double cycles = modelCycles(m);
+      total += cycles;
+      benchOut.printf("%-16s %7u %7u %7u %7u %7u %7u %7u %10.0f\n", m.name, (unsigned)m.loads, (unsigned)m.stores,
+                      (unsigned)m.alu, (unsigned)m.mul, (unsigned)m.mul64, (unsigned)m.add64, (unsigned)m.branches,
+                      cycles);
+   }
+   double load = total * MfccFrontEnd::FRAMES_PER_SECOND / CPU_HZ;
+   benchOut.printf("modelled: %.0f cycles per frame, %.2f%% of a 240 MHz core at %u frames/s (budget %.0f%%)\n",
+                   total, 100 * load, (unsigned)MfccFrontEnd::FRAMES_PER_SECOND, 100 * BUDGET);
+   if (load > BUDGET) {
+      benchOut.printf("FAIL: the front-end would take %.1f%% of a core\n", 100 * load);
+      return 1;
+   }
+   return 0;
+}
+
+// --- firmware --------------------------------------------------------------
+
+bool sawFeatures = false;
+
+void heartbeatHook(const MockBroker::Message &message, const uint8_t *payload) {
+   if (strcmp(message.topic, heartbeat_topic) != 0) return;
+   sawFeatures = memmem(payload, message.length, "\"features\":{\"frames\":", 21) != NULL;
+}
+
+void microphone(int16_t *dst, size_t count, uint64_t first, void *ctx) {
+   (void)ctx;
+   for (size_t i = 0; i < count; i++) {
+      dst[i] = (int16_t)(300 * sin(2 * M_PI * 440.0 * (double)(first + i) / RATE));
+   }
+}
+
+int runFirmware() {
+   if (!benchBootFirmware()) return 1;
+   host::setI2sSource(microphone, NULL);
+   benchBroker().setPublishHook(heartbeatHook);
+   uint32_t framesBefore = mfccFrontEnd.stats().frames;
+   uint64_t samplesBefore = host::i2sSamplesDelivered();
+   for (int step = 0; step < 2000; step++) {
+      host::advanceMicros(10000);
+      loop();
+   }
+   uint32_t frames = mfccFrontEnd.stats().frames - framesBefore;
+   uint64_t samples = host::i2sSamplesDelivered() - samplesBefore;
+   benchBroker().setPublishHook(NULL);
+   host::setI2sSource(NULL, NULL);
+   benchOut.printf("firmware: %u frames from %llu samples over 20 s, heartbeat features %s, load %u.%02u%%\n",
+                   (unsigned)frames, (unsigned long long)samples, sawFeatures ? "reported" : "missing",
+                   (unsigned)(mfccFrontEnd.load(ESP.getCpuFreqMHz()) / 100),
+                   (unsigned)(mfccFrontEnd.load(ESP.getCpuFreqMHz()) % 100));
+   if (frames + 3 < samples / HOP || !sawFeatures) {
+      benchOut.printf("FAIL: firmware front-end\n");
+      return 1;
+   }
+   return 0;
+}
+
+} // namespace
+
+int benchMfcc() {
+   benchPrintHeader("mfcc: streaming fixed-point MFCC front-end");
+   host::setSerialEcho(false);
+   reference.init();
+   int failures = checkAccuracy();
+   failures += checkStreaming();
+   failures += measureCost();
+   failures += runFirmware();
+   return failures;
+}
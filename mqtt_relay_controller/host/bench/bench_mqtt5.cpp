@@ -0,0 +1,277 @@
+/*
+ bench_mqtt5.cpp - bytes on the wire per command round trip, MQTT 3.1.1 vs 5.
+
+ The booted firmware is reconnected with each protocol version and handles
+ the same stream of turn_on / turn_off / get_status commands. A round trip
+ is everything on the socket for one command: the command PUBLISH, the
+ device's QoS 1 response and its PUBACK, and the status broadcast after a
+ relay change. Round trips that shared the socket with a heartbeat or a
+ keepalive are left out.
+
+ Variants: 3.1.1 with the requestId in the command and response JSON; MQTT
+ 5 with the same id as Correlation Data (the response omits it, its topic
+ and the status topic go by alias); and MQTT 5 where the requester also
+ names its reply topic. Every response must carry the command's id, under
+ MQTT 5 as correlation data with a message expiry and on the requested
+ topic.
+
+ Finally responses are left unacknowledged while the connection drops, and
+ the broker comes back allowing 10 and then no topic aliases: every one
+ must be resent with DUP set and a topic the broker can resolve. Then the
+ broker comes back refusing MQTT 5 and accepts the 3.1.1 retry: a response
+ is either resent as a 3.1.1 publish or counted as dropped, never sent in
+ its MQTT 5 form.
+*/
+
+#include "bench.h"
+#include "mqtt_connection.h"
+
+#include <PubSubClient.h>
+#include <stdio.h>
+#include <string.h>
+
+extern PubSubClient client;
+extern MqttConnection mqttConnection;
+extern const char *command_topic;
+extern const char *response_topic;
+extern const char *heartbeat_topic;
+
+namespace {
+
+const int MAX_LOOPS = 20000;
+const int ROUND_TRIPS = 90;
+const char *const COMMANDS[] = {"turn_on", "turn_off", "get_status"};
+const char *const REPLY_TOPIC = "apps/dashboard-7/replies";
+
+struct Variant {
+   const char *label;
+   uint8_t version;
+   bool responseTopic;
+};
+
+bool reconnect(uint8_t version) {
+   // A publish still awaiting its PUBACK could only be resent in the old format
+   for (int i = 0; i < MAX_LOOPS && version != client.protocolVersion() && client.inflight() > 0; i++) {
+      loop();
+   }
+   client.setProtocolVersion(version);
+   uint32_t sessions = mqttConnection.stats().sessions;
+   benchBroker().dropConnection();
+   for (int i = 0; i < MAX_LOOPS; i++) {
+      loop();
+      if (mqttConnection.stats().sessions != sessions) return true;
+   }
+   return false;
+}
+
+// The response to the command with this id, as the variant must send it
+bool checkResponse(const Variant &variant, const MockBroker::Message *response, const char *id) {
+   if (response == NULL) return false;
+   char field[48];
+   snprintf(field, sizeof(field), "\"requestId\":\"%s\"", id);
+   if (variant.version != MQTT_VERSION_5) return payloadContains(response, field);
+   return !payloadContains(response, "requestId") && response->correlationLength == strlen(id) &&
+          memcmp(response->correlation, id, response->correlationLength) == 0 && response->messageExpiry > 0;
+}
+
+// Inject one command and run the firmware until its response arrives
+bool roundTrip(const Variant &variant, int index, const char *replyTopic) {
+   MockBroker &broker = benchBroker();
+   char id[16], payload[96];
+   snprintf(id, sizeof(id), "app-7-%05d", index);
+   const char *command = COMMANDS[index % 3];
+   MockBroker::Properties properties = {NULL, (const uint8_t *)id, strlen(id)};
+   if (variant.version == MQTT_VERSION_5) {
+      snprintf(payload, sizeof(payload), "{\"command\":\"%s\"}", command);
+      properties.responseTopic = variant.responseTopic ? REPLY_TOPIC : NULL;
+   } else {
+      snprintf(payload, sizeof(payload), "{\"command\":\"%s\",\"requestId\":\"%s\"}", command, id);
+   }
+   uint32_t responses = broker.publishedTo(replyTopic);
+   broker.injectPublish(command_topic, (const uint8_t *)payload, strlen(payload), 0, 0,
+                        variant.version == MQTT_VERSION_5 ? &properties : NULL);
+   for (int i = 0; i < MAX_LOOPS && broker.publishedTo(replyTopic) == responses; i++) {
+      loop();
+   }
+   return checkResponse(variant, broker.lastPublished(replyTopic), id);
+}
+
+int runVariant(const Variant &variant, double &baseline) {
+   MockBroker &broker = benchBroker();
+   if (!reconnect(variant.version)) {
+      benchOut.printf("FAIL: %s: no session\n", variant.label);
+      return 1;
+   }
+   const char *replyTopic = variant.responseTopic ? REPLY_TOPIC : response_topic;
+   uint64_t toBroker = 0, toDevice = 0;
+   uint32_t counted = 0, wrong = 0;
+   uint32_t aliased = client.getStats().aliasedPublishes;
+   for (int i = 0; i < ROUND_TRIPS; i++) {
+      MockBroker::Stats before = broker.stats();
+      uint32_t heartbeats = broker.publishedTo(heartbeat_topic);
+      if (!roundTrip(variant, i, replyTopic)) wrong++;
+      const MockBroker::Stats &after = broker.stats();
+      if (after.pings != before.pings || broker.publishedTo(heartbeat_topic) != heartbeats) continue;
+      toBroker += after.bytesIn - before.bytesIn;
+      toDevice += after.bytesOut - before.bytesOut;
+      counted++;
+   }
+   double out = counted ? (double)toBroker / counted : 0.0;
+   double in = counted ? (double)toDevice / counted : 0.0;
+   if (variant.version != MQTT_VERSION_5) baseline = out + in;
+   char saving[16] = "-";
+   if (variant.version == MQTT_VERSION_5 && baseline > 0) {
+      snprintf(saving, sizeof(saving), "%.1f%%", 100.0 * (out + in - baseline) / baseline);
+   }
+   benchOut.printf("%-36s %6u %9.1f %9.1f %7.1f %8s %8u\n", variant.label, (unsigned)counted, out, in, out + in,
+                   saving, (unsigned)(client.getStats().aliasedPublishes - aliased));
+
+   int failures = 0;
+   if (wrong) {
+      benchOut.printf("FAIL: %s: %u responses without the command's id, expiry or reply topic\n", variant.label,
+                      (unsigned)wrong);
+      failures++;
+   }
+   if (counted < ROUND_TRIPS / 2) {
+      benchOut.printf("FAIL: %s: only %u round trips measured\n", variant.label, (unsigned)counted);
+      failures++;
+   }
+   return failures;
+}
+
+uint32_t dupResponses;
+
+void countDuplicate(const MockBroker::Message &message, const uint8_t *payload) {
+   (void)payload;
+   if (message.dup && strcmp(message.topic, response_topic) == 0 && message.correlationLength > 0) dupResponses++;
+}
+
+// Responses left without PUBACK across a reconnect
+int runResend(uint16_t aliasMaximum) {
+   MockBroker &broker = benchBroker();
+   const Variant variant = {"resend", MQTT_VERSION_5, false};
+   uint32_t malformed = broker.stats().malformed;
+   uint32_t retransmits = client.getStats().retransmits;
+   broker.setAutoPuback(false);
+   int sent = 0;
+   for (int i = 0; i < 4; i++) {
+      sent += roundTrip(variant, 1000 + i, response_topic) ? 1 : 0;
+   }
+   uint8_t pending = client.inflight();
+
+   dupResponses = 0;
+   broker.setTopicAliasMaximum(aliasMaximum);
+   broker.setAutoPuback(true);
+   broker.setPublishHook(countDuplicate);
+   bool up = reconnect(MQTT_VERSION_5);
+   for (int i = 0; i < MAX_LOOPS && client.inflight() > 0; i++) {
+      loop();
+   }
+   broker.setPublishHook(NULL);
+   uint32_t resent = client.getStats().retransmits - retransmits;
+   uint32_t badPackets = broker.stats().malformed - malformed;
+   benchOut.printf("alias maximum %-3u after reconnect: %u unacknowledged, %u resent, %u arrived with DUP, "
+                   "%u malformed\n",
+                   aliasMaximum, pending, (unsigned)resent, (unsigned)dupResponses, (unsigned)badPackets);
+   if (!up || sent != 4 || pending != 4 || resent != pending || dupResponses != pending || badPackets ||
+       client.inflight() != 0) {
+      benchOut.printf("FAIL: resend with alias maximum %u\n", aliasMaximum);
+      return 1;
+   }
+   return 0;
+}
+
+uint32_t emptyTopics;
+
+void countFallback(const MockBroker::Message &message, const uint8_t *payload) {
+   (void)payload;
+   if (message.dup && message.topic[0] == '\0') emptyTopics++;
+   if (message.dup && strcmp(message.topic, response_topic) == 0) dupResponses++;
+}
+
+// Responses left without PUBACK, some named by alias only, when the broker
+// refuses MQTT 5 on the reconnect
+int runFallback() {
+   MockBroker &broker = benchBroker();
+   const Variant variant = {"fallback", MQTT_VERSION_5, false};
+   uint32_t malformed = broker.stats().malformed;
+   uint32_t retransmits = client.getStats().retransmits;
+   uint32_t dropped = client.getStats().inflightDropped;
+   broker.setAutoPuback(false);
+   int sent = 0;
+   for (int i = 0; i < 4; i++) {
+      sent += roundTrip(variant, 2000 + i, response_topic) ? 1 : 0;
+   }
+   uint8_t pending = client.inflight();
+
+   dupResponses = 0;
+   emptyTopics = 0;
+   broker.setPublishHook(countFallback);
+   broker.setAutoConnack(false);
+   uint32_t connects = broker.stats().connects;
+   uint32_t sessions = mqttConnection.stats().sessions;
+   broker.dropConnection();
+   for (int i = 0; i < MAX_LOOPS && broker.stats().connects == connects; i++) {
+      loop();
+   }
+   bool refused = broker.stats().connects != connects && broker.protocolVersion() == MQTT_VERSION_5;
+   broker.sendConnack(0x01); // Unacceptable protocol version, as a 3.1.1 broker answers
+   broker.setAutoConnack(true);
+   broker.setAutoPuback(true);
+   for (int i = 0; i < MAX_LOOPS * 10 && mqttConnection.stats().sessions == sessions; i++) {
+      loop();
+   }
+   for (int i = 0; i < MAX_LOOPS && client.inflight() > 0; i++) {
+      loop();
+   }
+   broker.setPublishHook(NULL);
+   uint32_t resent = client.getStats().retransmits - retransmits;
+   uint32_t lost = client.getStats().inflightDropped - dropped;
+   uint32_t badPackets = broker.stats().malformed - malformed;
+   bool up = mqttConnection.stats().sessions != sessions && broker.protocolVersion() == MQTT_VERSION_3_1_1;
+   benchOut.printf("MQTT 5 refused, back as 3.1.1: %u unacknowledged, %u resent, %u dropped, %u arrived with DUP, "
+                   "%u without topic, %u malformed\n",
+                   pending, (unsigned)resent, (unsigned)lost, (unsigned)dupResponses, (unsigned)emptyTopics,
+                   (unsigned)badPackets);
+   if (!refused || !up || sent != 4 || pending != 4 || resent + lost != pending || resent == 0 ||
+       dupResponses != resent || emptyTopics || badPackets || client.inflight() != 0) {
+      benchOut.printf("FAIL: in-flight responses across the fall back to 3.1.1\n");
+      return 1;
+   }
+   return 0;
+}
+
+} // namespace
+
+int benchMqtt5() {
+   benchPrintHeader("mqtt5: bytes per command round trip, MQTT 3.1.1 vs 5");
+   if (!benchBootFirmware()) return 1;
+   uint8_t version = client.protocolVersion();
+
+   static const Variant variants[] = {
+      {"MQTT 3.1.1, requestId in JSON", MQTT_VERSION_3_1_1, false},
+      {"MQTT 5, correlation data", MQTT_VERSION_5, false},
+      {"MQTT 5, response topic + correlation", MQTT_VERSION_5, true},
+   };
+   benchOut.printf("%-36s %6s %9s %9s %7s %8s %8s\n", "protocol", "trips", "dev->brk", "brk->dev", "bytes",
+                   "vs 3.1.1", "aliased");
+   int failures = 0;
+   double baseline = 0;
+   for (const Variant &variant : variants) {
+      failures += runVariant(variant, baseline);
+   }
+
+   failures += runResend(10);
+   failures += runResend(0);
+   benchBroker().setTopicAliasMaximum(10);
+   if (!reconnect(MQTT_VERSION_5)) {
+      benchOut.printf("FAIL: no MQTT 5 session for the fall back\n");
+      failures++;
+   }
+   failures += runFallback();
+   if (!reconnect(version)) {
+      benchOut.printf("FAIL: no session after restoring MQTT %u\n", version);
+      failures++;
+   }
+   return failures;
+}
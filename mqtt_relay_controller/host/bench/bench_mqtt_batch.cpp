@@ -0,0 +1,349 @@
+/*
+ bench_mqtt_batch.cpp - a 32 KB command batch through a 512 byte MQTT buffer.
+
+ The booted firmware (PubSubClient buffer 512 B) receives one 32 KB message
+ on its batch topic, {"requestId": .., "commands": [..]} with some 600
+ turn_on / turn_off commands over the relay channels. The PUBLISH reaches
+ the socket S bytes at a time, each segment released once the previous one
+ has been read, as a TCP receive window would let it in. PubSubClient
+ passes the payload to the firmware's chunk handler as it arrives, the JSON
+ splitter cuts out one command at a time and each is parsed and dispatched
+ on its own. Before the chunk handler such a message was discarded.
+
+ Reported per run: commands run, loop() calls, the longest single loop(),
+ cycles and allocations per command, responses and status broadcasts. The
+ same commands sent as one message each are the baseline. A batch must
+ leave the relays as its commands do and be answered once, with its
+ requestId, followed by at most one status broadcast (none when the relays
+ end where they started).
+
+ Then: the batch at QoS 1 must be acknowledged; a batch cut off by a
+ dropped connection must be answered "Interrupted" once the session is
+ back; so must one whose connection is found dropped while a heartbeat is
+ being published, without the answer taking the heartbeat's place; and a
+ message larger than the buffer on another topic must be dropped without
+ breaking the framing of the next one.
+*/
+
+#include "bench.h"
+#include "json_stream.h"
+#include "mqtt_connection.h"
+#include "relay_bank.h"
+
+#include <PubSubClient.h>
+#include <stdio.h>
+#include <string.h>
+
+extern PubSubClient client;
+extern MqttConnection mqttConnection;
+extern const char *command_topic;
+extern const char *response_topic;
+extern const char *status_topic;
+extern const char *batch_topic;
+extern const char *heartbeat_topic;
+
+void sendHeartbeat();
+
+namespace {
+
+const size_t BATCH_BYTES = 32 * 1024;
+const size_t PACKET_CAPACITY = BATCH_BYTES + 256;
+const int MAX_LOOPS = 20000;
+const size_t TCP_SEGMENT = 1460;
+const size_t TCP_WINDOW = 5744;  // lwIP's default receive window on the ESP32
+
+char payload[BATCH_BYTES];
+uint8_t packet[PACKET_CAPACITY];
+
+struct RunStats {
+   BenchSeries series;
+   uint32_t loops;
+   uint64_t maxCycles;
+   uint64_t cycles;
+   uint64_t allocations;
+   uint32_t responses;
+   uint32_t statuses;
+};
+
+// Command `index` of every batch; `state` follows what it does to the relays
+int formatCommand(char *out, size_t size, int index, uint32_t &state) {
+   uint8_t channel = (index * 3) % relays.count();
+   bool on = (index / relays.count()) % 2 == 0;
+   state = on ? state | (1UL << channel) : state & ~(1UL << channel);
+   return snprintf(out, size, "{\"command\":\"%s\",\"channel\":%u,\"requestId\":\"c-%05d\"}",
+                   on ? "turn_on" : "turn_off", channel, index);
+}
+
+// {"requestId": id, "commands": [...]} of just under BATCH_BYTES
+size_t buildBatch(const char *requestId, int &count, uint32_t &state) {
+   size_t length = snprintf(payload, sizeof(payload), "{\"requestId\":\"%s\",\"commands\":[", requestId);
+   char command[96];
+   count = 0;
+   for (;;) {
+      uint32_t next = state;
+      int n = formatCommand(command, sizeof(command), count, next);
+      if (length + n + 3 > sizeof(payload)) break;
+      if (count > 0) payload[length++] = ',';
+      memcpy(payload + length, command, n);
+      length += n;
+      state = next;
+      count++;
+   }
+   payload[length++] = ']';
+   payload[length++] = '}';
+   return length;
+}
+
+size_t encodeLength(uint8_t *out, size_t length) {
+   size_t n = 0;
+   do {
+      uint8_t digit = length % 128;
+      length /= 128;
+      out[n++] = length > 0 ? digit | 0x80 : digit;
+   } while (length > 0);
+   return n;
+}
+
+// The whole PUBLISH packet, for releasing to the firmware a segment at a time
+size_t buildPublish(const char *topic, const char *body, size_t length, uint8_t qos, uint16_t packetId) {
+   size_t topicLength = strlen(topic);
+   bool v5 = benchBroker().protocolVersion() == 5;
+   size_t remaining = 2 + topicLength + (qos > 0 ? 2 : 0) + (v5 ? 1 : 0) + length;
+   size_t pos = 0;
+   packet[pos++] = 0x30 | (qos << 1);
+   pos += encodeLength(packet + pos, remaining);
+   packet[pos++] = (uint8_t)(topicLength >> 8);
+   packet[pos++] = (uint8_t)(topicLength & 0xFF);
+   memcpy(packet + pos, topic, topicLength);
+   pos += topicLength;
+   if (qos > 0) {
+      packet[pos++] = (uint8_t)(packetId >> 8);
+      packet[pos++] = (uint8_t)(packetId & 0xFF);
+   }
+   if (v5) packet[pos++] = 0;  // No properties
+   memcpy(packet + pos, body, length);
+   return pos + length;
+}
+
+// Run loop() until the firmware has read everything queued for it
+void drain(RunStats &stats) {
+   MockBroker &broker = benchBroker();
+   for (int i = 0; i < MAX_LOOPS && broker.available() > 0; i++) {
+      BenchMeter meter;
+      meter.start();
+      loop();
+      BenchSample sample = meter.stop();
+      stats.series.add(sample);
+      stats.loops++;
+      stats.cycles += sample.cycles;
+      stats.allocations += sample.allocations;
+      if (sample.cycles > stats.maxCycles) stats.maxCycles = sample.cycles;
+   }
+}
+
+// Release `length` bytes of packet `segment` bytes at a time
+void deliver(size_t length, size_t segment, RunStats &stats) {
+   for (size_t offset = 0; offset < length; offset += segment) {
+      size_t n = length - offset < segment ? length - offset : segment;
+      benchBroker().injectRaw(packet + offset, n);
+      drain(stats);
+   }
+}
+
+void printRun(const char *label, int commands, RunStats &stats) {
+   benchOut.printf("%-30s %8d %6u %10llu %10llu %9.0f %7.2f %9u %7u\n", label, commands, (unsigned)stats.loops,
+                   (unsigned long long)stats.series.percentile(0.50), (unsigned long long)stats.maxCycles, commands ? (double)stats.cycles / commands : 0.0,
+                   commands ? (double)stats.allocations / commands : 0.0, (unsigned)stats.responses,
+                   (unsigned)stats.statuses);
+}
+
+int runBatch(const char *label, size_t segment, uint8_t qos, int index) {
+   MockBroker &broker = benchBroker();
+   char requestId[16];
+   snprintf(requestId, sizeof(requestId), "bulk-%d", index);
+   int count;
+   uint32_t expected = relays.state();
+   size_t length = buildBatch(requestId, count, expected);
+   size_t packetLength = buildPublish(batch_topic, payload, length, qos, (uint16_t)(100 + index));
+
+   uint32_t responses = broker.publishedTo(response_topic);
+   uint32_t statuses = broker.publishedTo(status_topic);
+   uint32_t pubacks = broker.stats().pubacksIn;
+   uint32_t chunked = client.getStats().chunkedMessages;
+   static RunStats stats;
+   stats = RunStats();
+   deliver(packetLength, segment, stats);
+   stats.responses = broker.publishedTo(response_topic) - responses;
+   stats.statuses = broker.publishedTo(status_topic) - statuses;
+   printRun(label, count, stats);
+
+   char field[32];
+   snprintf(field, sizeof(field), "\"requestId\":\"%s\"", requestId);
+   const MockBroker::Message *response = broker.lastPublished(response_topic);
+   int failures = 0;
+   if (client.getStats().chunkedMessages != chunked + 1 || relays.state() != expected) {
+      benchOut.printf("FAIL: %s: relays 0x%02lx, expected 0x%02lx\n", label, (unsigned long)relays.state(),
+                      (unsigned long)expected);
+      failures++;
+   }
+   if (stats.responses != 1 || !payloadContains(response, field) || !payloadContains(response, "\"success\":true")) {
+      benchOut.printf("FAIL: %s: %u responses, last without success or the batch's id\n", label,
+                      (unsigned)stats.responses);
+      failures++;
+   }
+   if (stats.statuses > 1) {
+      benchOut.printf("FAIL: %s: %u status broadcasts for one batch\n", label, (unsigned)stats.statuses);
+      failures++;
+   }
+   if (qos > 0 && broker.stats().pubacksIn != pubacks + 1) {
+      benchOut.printf("FAIL: %s: QoS 1 batch not acknowledged\n", label);
+      failures++;
+   }
+   return failures;
+}
+
+// The batch's commands as one message each on the command topic
+int runSeparate(int count) {
+   MockBroker &broker = benchBroker();
+   uint32_t responses = broker.publishedTo(response_topic);
+   uint32_t statuses = broker.publishedTo(status_topic);
+   uint32_t expected = relays.state();
+   static RunStats stats;
+   stats = RunStats();
+   char command[96];
+   for (int i = 0; i < count; i++) {
+      int n = formatCommand(command, sizeof(command), i, expected);
+      broker.injectPublish(command_topic, (const uint8_t *)command, n);
+      drain(stats);
+   }
+   stats.responses = broker.publishedTo(response_topic) - responses;
+   stats.statuses = broker.publishedTo(status_topic) - statuses;
+   printRun("one message per command", count, stats);
+   if (relays.state() != expected || stats.responses != (uint32_t)count) {
+      benchOut.printf("FAIL: separate commands: relays 0x%02lx, expected 0x%02lx, %u responses\n",
+                      (unsigned long)relays.state(), (unsigned long)expected, (unsigned)stats.responses);
+      return 1;
+   }
+   return 0;
+}
+
+// The connection drops with half the batch read
+int runInterrupted() {
+   MockBroker &broker = benchBroker();
+   int count;
+   uint32_t expected = relays.state();
+   size_t length = buildBatch("bulk-cut", count, expected);
+   size_t packetLength = buildPublish(batch_topic, payload, length, 0, 0);
+   uint32_t responses = broker.publishedTo(response_topic);
+   uint32_t sessions = mqttConnection.stats().sessions;
+   static RunStats stats;
+   stats = RunStats();
+   deliver(packetLength / 2, TCP_SEGMENT, stats);
+   broker.dropConnection();
+   for (int i = 0; i < MAX_LOOPS * 10 && broker.publishedTo(response_topic) == responses; i++) {
+      loop();
+   }
+   const MockBroker::Message *response = broker.lastPublished(response_topic);
+   bool answered = broker.publishedTo(response_topic) == responses + 1 && payloadContains(response, "Interrupted after") &&
+                   payloadContains(response, "\"success\":false");
+   benchOut.printf("connection lost half-way: %s, session %s\n", answered ? "answered \"Interrupted\"" : "no answer",
+                   mqttConnection.stats().sessions != sessions ? "back" : "down");
+   if (!answered) {
+      benchOut.printf("FAIL: interrupted batch not reported after the reconnect\n");
+      return 1;
+   }
+   return 0;
+}
+
+uint32_t heartbeats;
+uint32_t misplaced;
+
+// Heartbeat topic: the heartbeat itself, or something published over it
+void countHeartbeat(const MockBroker::Message &message, const uint8_t *body) {
+   (void)body;
+   if (strcmp(message.topic, heartbeat_topic) != 0) return;
+   if (payloadContains(&message, "\"type\":\"heartbeat\"")) heartbeats++;
+   if (payloadContains(&message, "\"command\":\"batch\"")) misplaced++;
+}
+
+// The heartbeat finds the connection gone with half a batch read: the
+// batch is cut off inside its connected() check
+int runInterruptedHeartbeat() {
+   MockBroker &broker = benchBroker();
+   int count;
+   uint32_t expected = relays.state();
+   size_t length = buildBatch("bulk-cut-heartbeat", count, expected);
+   size_t packetLength = buildPublish(batch_topic, payload, length, 0, 0);
+   uint32_t responses = broker.publishedTo(response_topic);
+   static RunStats stats;
+   stats = RunStats();
+   heartbeats = 0;
+   misplaced = 0;
+   broker.setPublishHook(countHeartbeat);
+   deliver(packetLength / 2, TCP_SEGMENT, stats);
+   broker.dropConnection();
+   sendHeartbeat();
+   for (int i = 0; i < MAX_LOOPS * 10 && (broker.publishedTo(response_topic) == responses || heartbeats == 0); i++) {
+      loop();
+   }
+   broker.setPublishHook(NULL);
+   const MockBroker::Message *response = broker.lastPublished(response_topic);
+   bool answered = broker.publishedTo(response_topic) == responses + 1 && payloadContains(response, "Interrupted after");
+   benchOut.printf("connection lost under a heartbeat: %s, %u heartbeats, %u batch answers on the heartbeat topic\n",
+                   answered ? "answered \"Interrupted\"" : "no answer", (unsigned)heartbeats, (unsigned)misplaced);
+   if (!answered || heartbeats == 0 || misplaced != 0) {
+      benchOut.printf("FAIL: interrupted batch answered in place of the heartbeat\n");
+      return 1;
+   }
+   return 0;
+}
+
+// Too large for the buffer on a topic without chunked handling
+int runDeclined() {
+   MockBroker &broker = benchBroker();
+   int count;
+   uint32_t state = relays.state();
+   size_t length = buildBatch("bulk-wrong-topic", count, state);
+   size_t packetLength = buildPublish(command_topic, payload, length, 0, 0);
+   uint32_t dropped = client.getStats().packetsDropped;
+   uint32_t responses = broker.publishedTo(response_topic);
+   static RunStats stats;
+   stats = RunStats();
+   deliver(packetLength, TCP_WINDOW, stats);
+   uint32_t afterBig = broker.publishedTo(response_topic);
+   broker.injectPublish(command_topic, "{\"command\":\"get_status\",\"requestId\":\"after-drop\"}");
+   drain(stats);
+   bool next = broker.publishedTo(response_topic) == afterBig + 1 &&
+               payloadContains(broker.lastPublished(response_topic), "after-drop");
+   benchOut.printf("32 KB on the command topic: %u dropped, next command %s\n",
+                   (unsigned)(client.getStats().packetsDropped - dropped), next ? "answered" : "lost");
+   if (client.getStats().packetsDropped != dropped + 1 || afterBig != responses || !next) {
+      benchOut.printf("FAIL: oversized command not dropped cleanly\n");
+      return 1;
+   }
+   return 0;
+}
+
+} // namespace
+
+int benchMqttBatch() {
+   benchPrintHeader("mqttbatch: 32 KB command batch through a 512 B MQTT buffer");
+   if (!benchBootFirmware()) return 1;
+   benchOut.printf("MQTT buffer %u B, splitter %u B (element %u + skeleton %u)\n", client.getBufferSize(),
+                   (unsigned)sizeof(JsonStreamSplitter), JsonStreamSplitter::ELEMENT_SIZE,
+                   JsonStreamSplitter::SKELETON_SIZE);
+   benchOut.printf("%-30s %8s %6s %10s %10s %9s %7s %9s %7s\n", "delivery", "commands", "loops", "p50 loop",
+                   "max loop", "cyc/cmd", "alloc/c", "responses", "status");
+   int failures = 0;
+   int count;
+   uint32_t state = relays.state();
+   buildBatch("", count, state);
+   failures += runBatch("batch, 1460 B segments", TCP_SEGMENT, 0, 1);
+   failures += runBatch("batch, 5744 B segments", TCP_WINDOW, 0, 2);
+   failures += runBatch("batch, QoS 1, 5744 B segments", TCP_WINDOW, 1, 3);
+   failures += runSeparate(count);
+   failures += runInterrupted();
+   failures += runInterruptedHeartbeat();
+   failures += runDeclined();
+   return failures;
+}
@@ -0,0 +1,204 @@
+/*
+ bench_mqtt_cork.cpp - packets of one scheduler tick in one socket write.
+
+ A standalone PubSubClient writes to a counting Client. Three ticks of the
+ firmware are replayed, once packet by packet and once between cork() and
+ uncork() as loop() in main.cpp does: a relay command (QoS 1 response and
+ status broadcast), a session start (two SUBSCRIBEs and the registration)
+ and a busy tick (six status broadcasts, more than one MSS in all).
+
+ Reported per tick and path: client write calls, the TCP segments those
+ writes become with Nagle off (one per write, split at the MSS) and bytes.
+ Both paths must put the same packets on the wire, and the corked one may
+ only use as many writes as MSS-sized pieces of the tick. Packets corked
+ when the connection drops must not reach the next one, which has to start
+ with its CONNECT.
+*/
+
+#include "bench.h"
+
+#include <PubSubClient.h>
+
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+const int RUNS = 200;
+const size_t WIRE_CAPACITY = 8192;
+const char *RESPONSE_TOPIC = "devices/esp32-light-controller/responses";
+const char *STATUS_TOPIC = "devices/esp32-light-controller/status";
+const char *REGISTER_TOPIC = "devices/esp32-light-controller/register";
+const char *COMMAND_TOPIC = "devices/esp32-light-controller/commands";
+const char *DEVICE_TOPIC = "devices/esp32-light-controller/config";
+
+CountingClient network;
+char response[200];
+char status[160];
+char registration[360];
+uint8_t reference[WIRE_CAPACITY];
+
+void fill(char *text, size_t size, const char *prefix) {
+   size_t n = snprintf(text, size, "{\"deviceId\":\"esp32-light-controller\",\"%s\":\"", prefix);
+   for (; n < size - 3; n++) {
+      text[n] = 'a' + n % 26;
+   }
+   strcpy(text + n, "\"}");
+}
+
+bool publishText(PubSubClient &client, const char *topic, const char *text, uint8_t qos) {
+   return client.publish(topic, (const uint8_t *)text, strlen(text), false, qos);
+}
+
+// handleTurnOn(): the response to the command, then the status broadcast
+bool tickCommand(PubSubClient &client) {
+   return publishText(client, RESPONSE_TOPIC, response, 1) && publishText(client, STATUS_TOPIC, status, 0);
+}
+
+// MqttConnection after the CONNACK: subscriptions, then the registration
+bool tickSession(PubSubClient &client) {
+   return client.subscribe(COMMAND_TOPIC) && client.subscribe(DEVICE_TOPIC) &&
+          publishText(client, REGISTER_TOPIC, registration, 0);
+}
+
+// A heartbeat round: status broadcasts past one MSS in all
+bool tickBusy(PubSubClient &client) {
+   bool ok = true;
+   for (int i = 0; i < 6; i++) {
+      ok = publishText(client, STATUS_TOPIC, registration, 0) && ok;
+   }
+   return ok;
+}
+
+struct TickResult {
+   uint64_t writes;
+   uint64_t segments;
+   size_t bytes;
+};
+
+// Drain acknowledgements so QoS 1 publishes never fill the window
+void settle(PubSubClient &client) {
+   for (int i = 0; i < 8 && network.available() > 0; i++) {
+      client.loop();
+   }
+}
+
+TickResult runTick(PubSubClient &client, bool (*tick)(PubSubClient &), bool corked, int &failures) {
+   size_t bytes = 0;
+   for (int run = 0; run < RUNS; run++) {
+      settle(client);
+      network.resetCounts();
+      network.clear();
+      if (corked) client.cork();
+      bool ok = tick(client);
+      if (corked) ok = client.uncork() && ok;
+      if (!ok) failures++;
+      bytes = network.size();
+   }
+   TickResult result = {network.writeCalls(), network.segmentCount(), bytes};
+   return result;
+}
+
+// The packet types on the wire, in order (packet ids differ between runs)
+size_t packetTypes(const uint8_t *data, size_t size, uint8_t *types, size_t capacity) {
+   size_t count = 0;
+   size_t pos = 0;
+   while (pos < size && count < capacity) {
+      types[count++] = data[pos] & 0xF0;
+      size_t remaining = 0;
+      size_t multiplier = 1;
+      size_t at = pos + 1;
+      while (at < size) {
+         uint8_t digit = data[at++];
+         remaining += (digit & 0x7F) * multiplier;
+         multiplier <<= 7;
+         if ((digit & 0x80) == 0) break;
+      }
+      pos = at + remaining;
+   }
+   return count;
+}
+
+void printTick(const char *label, const TickResult &result) {
+   benchOut.printf("  %-20s %7llu %9llu %9u\n", label, (unsigned long long)result.writes,
+                   (unsigned long long)result.segments, (unsigned)result.bytes);
+}
+
+int runScenario(PubSubClient &client, const char *label, bool (*tick)(PubSubClient &)) {
+   benchOut.printf("%s\n", label);
+   int failures = 0;
+   TickResult plain = runTick(client, tick, false, failures);
+   memcpy(reference, network.data(), network.size() < WIRE_CAPACITY ? network.size() : WIRE_CAPACITY);
+   printTick("packet by packet", plain);
+   TickResult corked = runTick(client, tick, true, failures);
+   printTick("corked", corked);
+   if (failures) {
+      benchOut.printf("FAIL: %s: %d ticks not sent\n", label, failures);
+   }
+   uint8_t plainTypes[16], corkedTypes[16];
+   size_t plainCount = packetTypes(reference, plain.bytes, plainTypes, 16);
+   size_t corkedCount = packetTypes(network.data(), corked.bytes, corkedTypes, 16);
+   if (corked.bytes != plain.bytes || corkedCount != plainCount || memcmp(plainTypes, corkedTypes, plainCount) != 0) {
+      benchOut.printf("FAIL: %s: corked packets differ from packet-by-packet\n", label);
+      failures++;
+   }
+   size_t expectedWrites = (corked.bytes + MQTT_WRITE_BUFFER_SIZE - 1) / MQTT_WRITE_BUFFER_SIZE;
+   if (corked.writes > expectedWrites) {
+      benchOut.printf("FAIL: %s: %llu writes for %u corked bytes\n", label, (unsigned long long)corked.writes,
+                      (unsigned)corked.bytes);
+      failures++;
+   }
+   return failures;
+}
+
+// Packets corked when the connection drops stay with it
+int runDrop(PubSubClient &client) {
+   int failures = 0;
+   settle(client);
+   client.cork();
+   publishText(client, STATUS_TOPIC, status, 0);
+   network.drop();
+   client.connected();
+   network.connect("broker", 1883);
+   bool dropped = !client.uncork();
+   network.clear();
+   if (!client.connectAsync("bench-cork") || network.size() == 0 || (network.data()[0] & 0xF0) != MQTTCONNECT) {
+      benchOut.printf("FAIL: reconnect after a drop did not start with CONNECT\n");
+      failures++;
+   }
+   while (client.poll() == MQTT_CONNECTING) {
+   }
+   benchOut.printf("connection lost while corked: %s, %s\n", dropped ? "packets dropped" : "packets kept",
+                   client.connected() ? "next session starts with CONNECT" : "no session");
+   if (!dropped || !client.connected()) failures++;
+   return failures;
+}
+
+} // namespace
+
+int benchMqttCork() {
+   benchPrintHeader("mqttcork: packets of one scheduler tick in one socket write");
+   host::setSerialEcho(false);
+
+   fill(response, sizeof(response), "response");
+   fill(status, sizeof(status), "status");
+   fill(registration, sizeof(registration), "name");
+
+   PubSubClient client(network);
+   client.setBufferSize(512);
+   if (!client.connect("bench-cork")) {
+      benchOut.printf("FAIL: CONNECT was not acknowledged\n");
+      return 1;
+   }
+   benchOut.printf("write buffer %u B, segments counted at an MSS of %u B\n", (unsigned)MQTT_WRITE_BUFFER_SIZE,
+                   (unsigned)CountingClient::MSS);
+   benchOut.printf("  %-20s %7s %9s %9s\n", "path", "writes", "segments", "bytes");
+
+   int failures = 0;
+   failures += runScenario(client, "command: QoS 1 response + status", tickCommand);
+   failures += runScenario(client, "session start: 2 SUBSCRIBEs + registration", tickSession);
+   failures += runScenario(client, "busy tick: 6 status broadcasts", tickBusy);
+   failures += runDrop(client);
+   client.disconnect();
+   return failures;
+}
@@ -0,0 +1,350 @@
+/*
+ bench_mqtt_qos.cpp - QoS 1 publishing through the in-flight window.
+
+ A standalone PubSubClient publishes 400 QoS 1 messages (60..400 byte
+ payloads, each carrying its sequence number) to a link that answers every
+ PUBLISH with a PUBACK one round trip (20 ms of virtual time) later. The
+ publisher sends whenever the client accepts a packet and otherwise runs
+ loop() at the next PUBACK. Reported per in-flight window (1 is the old
+ stop-and-wait): virtual time until the last PUBACK, messages per second,
+ the most publishes awaiting a PUBACK at once, and how often the packet
+ store rather than the window held a publish back.
+
+ Drop test: with a window of 8 the connection is dropped twice while
+ publishes are unacknowledged, and their PUBACKs are lost with it. After
+ each reconnect every unacknowledged publish must be sent again, with DUP
+ set and its original packet id; in the end every sequence number must
+ have reached the broker and been acknowledged, in order of first arrival.
+*/
+
+#include "bench.h"
+
+#include <PubSubClient.h>
+
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+const int MESSAGES = 400;
+const uint64_t RTT_US = 20000;
+const uint64_t RUN_LIMIT_US = 120000000;
+const char *TOPIC = "devices/esp32-light-controller/responses";
+const size_t MAX_PENDING = 64;
+
+// Answers CONNECT, PINGREQ and QoS 1 PUBLISH packets after a round trip
+class AckingLink : public Client {
+public:
+   AckingLink() : open(false), parsed(0), pendingCount(0), toClientLength(0), toClientPos(0) { reset(); }
+
+   void reset() {
+      open = false;
+      parsed = 0;
+      pendingCount = 0;
+      toClientLength = toClientPos = 0;
+      memset(firstArrival, 0, sizeof(firstArrival));
+      arrivals = duplicates = dupFlagged = reorders = mismatchedIds = 0;
+      highest = -1;
+   }
+
+   // The connection goes; PUBACKs not yet delivered go with it
+   void drop() {
+      open = false;
+      pendingCount = 0;
+      toClientLength = toClientPos = 0;
+      parsed = 0;
+   }
+
+   uint64_t nextArrivalMicros() const {
+      uint64_t next = UINT64_MAX;
+      for (size_t i = 0; i < pendingCount; i++) {
+         if (pending[i].at < next) next = pending[i].at;
+      }
+      return next;
+   }
+
+   bool received(int sequence) const { return firstArrival[sequence] != 0; }
+   int arrivals;
+   int duplicates;     // Sequence numbers seen again
+   int dupFlagged;     // Of those, with DUP set and the original packet id
+   int reorders;       // First arrivals out of sequence order
+   int mismatchedIds;
+
+   int connect(IPAddress, uint16_t) override { return open = true; }
+   int connect(const char *, uint16_t) override { return open = true; }
+   size_t write(uint8_t c) override { return write(&c, 1); }
+   size_t write(const uint8_t *buf, size_t size) override {
+      host::advanceMicros(1);
+      if (!open || parsed + size > sizeof(fromClient)) return 0;
+      memcpy(fromClient + parsed, buf, size);
+      parsed += size;
+      parse();
+      return size;
+   }
+   int available() override {
+      host::advanceMicros(1);
+      deliver();
+      return (int)(toClientLength - toClientPos);
+   }
+   int read() override {
+      uint8_t c;
+      return read(&c, 1) == 1 ? c : -1;
+   }
+   int read(uint8_t *buf, size_t size) override {
+      host::advanceMicros(1);
+      deliver();
+      size_t n = toClientLength - toClientPos;
+      if (n > size) n = size;
+      memcpy(buf, toClient + toClientPos, n);
+      toClientPos += n;
+      return (int)n;
+   }
+   int peek() override { return toClientPos < toClientLength ? toClient[toClientPos] : -1; }
+   void flush() override {}
+   void stop() override { drop(); }
+   uint8_t connected() override { return open; }
+   operator bool() override { return open; }
+
+private:
+   struct Pending {
+      uint64_t at;
+      uint8_t packet[4];
+      uint8_t length;
+   };
+
+   bool open;
+   uint8_t fromClient[4096];
+   size_t parsed;
+   Pending pending[MAX_PENDING];
+   size_t pendingCount;
+   uint8_t toClient[256];
+   size_t toClientLength;
+   size_t toClientPos;
+   uint16_t firstArrival[MESSAGES];  // Packet id of the first copy
+   int highest;
+
+   void respond(uint64_t at, uint8_t type, uint8_t length, uint16_t id) {
+      if (pendingCount == MAX_PENDING) return;
+      Pending &p = pending[pendingCount++];
+      p.at = at;
+      p.packet[0] = type;
+      p.packet[1] = length;
+      p.packet[2] = id >> 8;
+      p.packet[3] = id & 0xFF;
+      p.length = 2 + length;
+   }
+
+   // Move the responses that are due to the client's receive queue
+   void deliver() {
+      uint64_t now = host::nowMicros();
+      if (toClientPos == toClientLength) toClientPos = toClientLength = 0;
+      size_t kept = 0;
+      for (size_t i = 0; i < pendingCount; i++) {
+         if (pending[i].at <= now && toClientLength + pending[i].length <= sizeof(toClient)) {
+            memcpy(toClient + toClientLength, pending[i].packet, pending[i].length);
+            toClientLength += pending[i].length;
+         } else {
+            pending[kept++] = pending[i];
+         }
+      }
+      pendingCount = kept;
+   }
+
+   // Consume every complete packet the client has written
+   void parse() {
+      for (;;) {
+         size_t length = 0, multiplier = 1, pos = 1;
+         uint8_t digit;
+         do {
+            if (pos >= parsed) return;
+            digit = fromClient[pos++];
+            length += (digit & 127) * multiplier;
+            multiplier *= 128;
+         } while (digit & 128);
+         if (pos + length > parsed) return;
+         handle(fromClient[0], fromClient + pos, length);
+         memmove(fromClient, fromClient + pos + length, parsed - pos - length);
+         parsed -= pos + length;
+      }
+   }
+
+   void handle(uint8_t header, const uint8_t *body, size_t length) {
+      uint64_t now = host::nowMicros();
+      switch (header & 0xF0) {
+      case 0x10:  // CONNECT
+         respond(now, 0x20, 2, 0);
+         break;
+      case 0xC0:  // PINGREQ
+         respond(now, 0xD0, 0, 0);
+         break;
+      case 0x30: {
+         if ((header & 0x06) != 0x02 || length < 4) break;
+         size_t topicLength = (body[0] << 8) | body[1];
+         if (4 + topicLength > length) break;
+         uint16_t id = (body[2 + topicLength] << 8) | body[3 + topicLength];
+         int sequence = -1;
+         sscanf((const char *)body + 4 + topicLength, "%d", &sequence);
+         if (sequence < 0 || sequence >= MESSAGES) break;
+         arrivals++;
+         if (firstArrival[sequence]) {
+            duplicates++;
+            if ((header & 0x08) && firstArrival[sequence] == id) dupFlagged++;
+            else if (firstArrival[sequence] != id) mismatchedIds++;
+         } else {
+            firstArrival[sequence] = id;
+            if (sequence != highest + 1) reorders++;
+            highest = sequence;
+         }
+         respond(now + RTT_US, 0x40, 2, id);
+         break;
+      }
+      }
+   }
+};
+
+AckingLink link;
+uint8_t payload[420];
+
+size_t buildPayload(int sequence) {
+   size_t length = 60 + (size_t)(sequence * 7919) % 341;
+   int n = snprintf((char *)payload, sizeof(payload), "%d ", sequence);
+   memset(payload + n, 'a' + sequence % 26, length - n);
+   return length;
+}
+
+// Run loop() at the next PUBACK, or give up the rest of the time limit
+bool waitForAck(PubSubClient &client, uint64_t deadline) {
+   uint64_t next = link.nextArrivalMicros();
+   if (next == UINT64_MAX || next > deadline) return false;
+   if (next > host::nowMicros()) host::advanceMicros(next - host::nowMicros());
+   return client.loop();
+}
+
+struct WindowResult {
+   uint64_t virtualUs;
+   uint8_t maxInflight;
+   int storeFull;
+   bool complete;
+};
+
+// Publish sequence numbers [from, to); `dropAt` drops the connection once that one is sent
+WindowResult publishRange(PubSubClient &client, uint8_t window, int from, int to, int dropAt) {
+   WindowResult result = {0, 0, 0, false};
+   uint64_t start = host::nowMicros();
+   uint64_t deadline = start + RUN_LIMIT_US;
+   int sequence = from;
+   while ((sequence < to || client.inflight() > 0) && host::nowMicros() < deadline) {
+      if (!client.connected()) {
+         if (!client.connect("bench-qos")) return result;
+         continue;
+      }
+      if (sequence < to) {
+         size_t length = buildPayload(sequence);
+         uint8_t before = client.inflight();
+         if (client.publish(TOPIC, payload, length, false, 1)) {
+            if (client.inflight() > result.maxInflight) result.maxInflight = client.inflight();
+            if (sequence++ == dropAt) link.drop();
+            continue;
+         }
+         if (before < window && client.connected()) result.storeFull++;
+      }
+      if (!waitForAck(client, deadline)) {
+         client.loop();
+         if (client.connected()) return result;
+      }
+   }
+   result.virtualUs = host::nowMicros() - start;
+   result.complete = sequence == to && client.inflight() == 0;
+   return result;
+}
+
+int runWindow(uint8_t window) {
+   link.reset();
+   PubSubClient client(link);
+   client.setInflightWindow(window);
+   if (!client.connect("bench-qos")) {
+      benchOut.printf("FAIL: window %u: CONNECT was not acknowledged\n", window);
+      return 1;
+   }
+   int failures = 0;
+   WindowResult result = publishRange(client, window, 0, MESSAGES, -1);
+   benchOut.printf("%6u %12.1f %10.0f %12u %12d\n", window, result.virtualUs / 1000.0,
+                   result.virtualUs ? MESSAGES * 1e6 / result.virtualUs : 0.0, result.maxInflight,
+                   result.storeFull);
+   const PubSubClientStats &stats = client.getStats();
+   if (!result.complete || stats.pubacks != MESSAGES || link.arrivals != MESSAGES) {
+      benchOut.printf("FAIL: window %u: %u PUBACKs, %d arrivals for %d publishes\n", window,
+                      (unsigned)stats.pubacks, link.arrivals, MESSAGES);
+      failures++;
+   }
+   if (result.maxInflight > window) {
+      benchOut.printf("FAIL: window %u: %u publishes in flight\n", window, result.maxInflight);
+      failures++;
+   }
+   client.disconnect();
+   return failures;
+}
+
+int runDrops() {
+   link.reset();
+   PubSubClient client(link);
+   client.setInflightWindow(MQTT_MAX_INFLIGHT);
+   if (!client.connect("bench-qos")) {
+      benchOut.printf("FAIL: drop test: CONNECT was not acknowledged\n");
+      return 1;
+   }
+   const PubSubClientStats &stats = client.getStats();
+   WindowResult first = publishRange(client, MQTT_MAX_INFLIGHT, 0, MESSAGES / 2, MESSAGES / 4);
+   uint32_t afterFirst = stats.retransmits;
+   WindowResult second = publishRange(client, MQTT_MAX_INFLIGHT, MESSAGES / 2, MESSAGES, 3 * MESSAGES / 4);
+   bool complete = first.complete && second.complete;
+
+   int missing = 0;
+   for (int sequence = 0; sequence < MESSAGES; sequence++) {
+      if (!link.received(sequence)) missing++;
+   }
+   benchOut.printf("drops: 2, retransmitted %u + %u, duplicates at the broker %d (%d with DUP and the same id), "
+                   "missing %d, out of order %d, PUBACKs %u\n",
+                   (unsigned)afterFirst, (unsigned)(stats.retransmits - afterFirst), link.duplicates,
+                   link.dupFlagged, missing, link.reorders, (unsigned)stats.pubacks);
+
+   int failures = 0;
+   if (!complete || missing || client.inflight() != 0) {
+      benchOut.printf("FAIL: drop test: %d messages lost, %u still in flight\n", missing, client.inflight());
+      failures++;
+   }
+   if (afterFirst == 0 || stats.retransmits == afterFirst) {
+      benchOut.printf("FAIL: drop test: nothing was in flight at a drop\n");
+      failures++;
+   }
+   if (link.duplicates != (int)stats.retransmits || link.dupFlagged != link.duplicates || link.mismatchedIds) {
+      benchOut.printf("FAIL: drop test: %d resent copies, %d with DUP and the original id, %u retransmits\n",
+                      link.duplicates, link.dupFlagged, (unsigned)stats.retransmits);
+      failures++;
+   }
+   if (link.reorders) {
+      benchOut.printf("FAIL: drop test: %d publishes first arrived out of order\n", link.reorders);
+      failures++;
+   }
+   client.disconnect();
+   return failures;
+}
+
+} // namespace
+
+int benchMqttQos() {
+   benchPrintHeader("mqttqos: QoS 1 publishing with an in-flight window");
+   host::setVirtualClock(true);
+   host::setSerialEcho(false);
+
+   benchOut.printf("%d publishes of 60..400 B, PUBACK after %llu ms, %u B packet store\n", MESSAGES,
+                   (unsigned long long)(RTT_US / 1000), (unsigned)MQTT_INFLIGHT_STORE_SIZE);
+   benchOut.printf("%6s %12s %10s %12s %12s\n", "window", "virtual ms", "msgs/s", "max inflight", "store full");
+   int failures = 0;
+   static const uint8_t windows[] = {1, 2, 4, 8};
+   for (uint8_t window : windows) {
+      failures += runWindow(window);
+   }
+   failures += runDrops();
+   return failures;
+}
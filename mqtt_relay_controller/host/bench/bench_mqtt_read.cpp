@@ -0,0 +1,303 @@
+/*
+ bench_mqtt_read.cpp - inbound MQTT packet parsing under fragmented delivery.
+
+ A standalone PubSubClient reads from a scripted link that serves a CONNACK
+ and then a run of QoS 0 PUBLISH packets (20..400 byte payloads, plus one
+ packet larger than the client buffer that must be dropped without losing
+ framing). The link releases the stream in fragments of F bytes every G us
+ of virtual time, as a slow or congested TCP connection would; every
+ available()/read() call on it costs 1 us of virtual time. Scenarios: one
+ whole packet per gap, a queued backlog, 64 B every 2 ms, 7 B every 1 ms,
+ 1 B every 200 us, and a packet that stalls half-way for 5 s.
+
+ Reported per scenario: packets per second of host CPU time spent in
+ loop(), cycles and client read calls per packet, and the worst single
+ loop() in virtual us and cycles. Every payload must reach the callback
+ intact, and loop() must never wait for bytes that have not arrived.
+*/
+
+#include "bench.h"
+
+#include <PubSubClient.h>
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+const int PACKETS = 200;
+const int OVERSIZED_INDEX = 57;
+const size_t OVERSIZED_PAYLOAD = 700;
+const uint16_t BUFFER_SIZE = 512;
+const uint64_t MAX_LOOP_VIRTUAL_US = 1000;  // loop() must not wait on the network
+const uint64_t STALL_US = 5000000;
+const uint64_t RUN_LIMIT_US = 60000000;
+const char *TOPIC = "bench/read";
+const size_t SCRIPT_CAPACITY = 128 * 1024;
+
+// Byte stream released to the reader fragment by fragment on the virtual clock
+class FragmentedLink : public Client {
+public:
+   FragmentedLink() : length(0), released(0), position(0), fragment(0), gapMicros(0), nextAt(0),
+                      stallOffset(0), stallMicros(0), open(false), reads(0), polls(0) {}
+
+   void reset(size_t fragmentBytes, uint64_t gap) {
+      length = released = position = 0;
+      packets = 0;
+      fragment = fragmentBytes;
+      gapMicros = gap;
+      stallOffset = 0;
+      stallMicros = 0;
+      reads = polls = 0;
+   }
+
+   // Hold back the rest of the stream for `micros` half-way through packet `index`
+   void stallInside(size_t index, uint64_t micros) {
+      stallOffset = (packetEnds[index] + packetEnds[index + 1]) / 2;
+      stallMicros = micros;
+   }
+
+   void append(const uint8_t *data, size_t size) {
+      memcpy(script + length, data, size);
+      length += size;
+      packetEnds[packets++] = length;
+   }
+
+   // The CONNACK is readable at once; the rest starts one gap later
+   void start() {
+      released = packetEnds[0];
+      nextAt = host::nowMicros() + gapMicros;
+   }
+
+   bool drained() const { return position == length; }
+   uint64_t nextArrivalMicros() const { return released < length ? nextAt : UINT64_MAX; }
+   uint64_t readCalls() const { return reads; }
+   uint64_t pollCalls() const { return polls; }
+
+   int connect(IPAddress, uint16_t) override { open = true; return 1; }
+   int connect(const char *, uint16_t) override { open = true; return 1; }
+   size_t write(uint8_t) override { return 1; }
+   size_t write(const uint8_t *, size_t size) override { return size; }
+   int available() override {
+      host::advanceMicros(1);
+      polls++;
+      release();
+      return (int)(released - position);
+   }
+   int read() override {
+      uint8_t c;
+      return read(&c, 1) == 1 ? c : -1;
+   }
+   int read(uint8_t *buf, size_t size) override {
+      host::advanceMicros(1);
+      reads++;
+      release();
+      size_t n = released - position;
+      if (n > size) n = size;
+      memcpy(buf, script + position, n);
+      position += n;
+      return (int)n;
+   }
+   int peek() override { return position < released ? script[position] : -1; }
+   void flush() override {}
+   void stop() override { open = false; }
+   uint8_t connected() override { return open; }
+   operator bool() override { return open; }
+
+private:
+   uint8_t script[SCRIPT_CAPACITY];
+   size_t packetEnds[PACKETS + 2];
+   size_t packets;
+   size_t length;
+   size_t released;
+   size_t position;
+   size_t fragment;       // 0: one whole packet per gap
+   uint64_t gapMicros;
+   uint64_t nextAt;
+   size_t stallOffset;    // The stall starts once this many bytes are out
+   uint64_t stallMicros;
+   bool open;
+   uint64_t reads;
+   uint64_t polls;
+
+   void release() {
+      uint64_t now = host::nowMicros();
+      while (released < length && now >= nextAt) {
+         size_t next = released + fragment;
+         if (fragment == 0) {
+            size_t p = 0;
+            while (packetEnds[p] <= released) p++;
+            next = packetEnds[p];
+         }
+         if (next > length) next = length;
+         if (stallMicros && released < stallOffset && next >= stallOffset) {
+            next = stallOffset;
+            nextAt += stallMicros;
+            stallMicros = 0;
+         }
+         released = next;
+         nextAt += gapMicros;
+      }
+   }
+};
+
+FragmentedLink link;
+int received;
+int corrupted;
+
+size_t payloadLength(int index) {
+   return index == OVERSIZED_INDEX ? OVERSIZED_PAYLOAD : 20 + (size_t)(index * 7919) % 381;
+}
+
+uint8_t payloadByte(int index, size_t offset) {
+   return (uint8_t)(index * 31 + offset);
+}
+
+void onMessage(char *topic, uint8_t *payload, unsigned int length) {
+   // Packets arrive in order and the oversized one never does
+   int index = received + (received >= OVERSIZED_INDEX ? 1 : 0);
+   bool ok = strcmp(topic, TOPIC) == 0 && length == payloadLength(index);
+   for (unsigned int i = 0; ok && i < length; i++) {
+      ok = payload[i] == payloadByte(index, i);
+   }
+   if (!ok) corrupted++;
+   received++;
+}
+
+size_t encodeRemainingLength(uint8_t *out, size_t length) {
+   size_t n = 0;
+   do {
+      uint8_t digit = length % 128;
+      length /= 128;
+      out[n++] = digit | (length > 0 ? 0x80 : 0);
+   } while (length > 0);
+   return n;
+}
+
+void buildScript() {
+   const uint8_t connack[] = {0x20, 0x02, 0x00, 0x00};
+   link.append(connack, sizeof(connack));
+   static uint8_t packet[1024];
+   size_t topicLength = strlen(TOPIC);
+   for (int index = 0; index < PACKETS; index++) {
+      size_t payload = payloadLength(index);
+      size_t n = 0;
+      packet[n++] = 0x30;  // PUBLISH, QoS 0
+      n += encodeRemainingLength(packet + n, 2 + topicLength + payload);
+      packet[n++] = topicLength >> 8;
+      packet[n++] = topicLength & 0xFF;
+      memcpy(packet + n, TOPIC, topicLength);
+      n += topicLength;
+      for (size_t i = 0; i < payload; i++) packet[n++] = payloadByte(index, i);
+      link.append(packet, n);
+   }
+}
+
+struct Scenario {
+   const char *label;
+   size_t fragment;
+   uint64_t gapMicros;
+   bool stall;
+};
+
+int runScenario(const Scenario &scenario) {
+   link.reset(scenario.fragment, scenario.gapMicros);
+   buildScript();
+   if (scenario.stall) {
+      link.stallInside(PACKETS / 2, STALL_US);
+   }
+   received = 0;
+   corrupted = 0;
+
+   PubSubClient client(link);
+   client.setBufferSize(BUFFER_SIZE);
+   client.setCallback(onMessage);
+   link.start();
+   if (!client.connect("bench-read")) {
+      benchOut.printf("FAIL: %s: CONNECT was not acknowledged\n", scenario.label);
+      return 1;
+   }
+
+   uint64_t worstVirtual = 0;
+   uint64_t worstCycles = 0;
+   uint64_t cycles = 0;
+   uint64_t readsBefore = link.readCalls();
+   uint64_t pollsBefore = link.pollCalls();
+   std::chrono::nanoseconds cpu(0);
+   uint64_t deadline = host::nowMicros() + RUN_LIMIT_US;
+   bool dropped = false;
+
+   while (!link.drained() && host::nowMicros() < deadline) {
+      uint64_t virtualStart = host::nowMicros();
+      std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now();
+      uint64_t cycleStart = host::cycleCounter();
+      bool alive = client.loop();
+      uint64_t spent = host::cycleCounter() - cycleStart;
+      cpu += std::chrono::steady_clock::now() - wallStart;
+      uint64_t virtualSpent = host::nowMicros() - virtualStart;
+      cycles += spent;
+      if (virtualSpent > worstVirtual) worstVirtual = virtualSpent;
+      if (spent > worstCycles) worstCycles = spent;
+      if (!alive) {
+         dropped = true;
+         break;
+      }
+      uint64_t next = link.nextArrivalMicros();
+      if (next != UINT64_MAX && next > host::nowMicros()) {
+         host::advanceMicros(next - host::nowMicros());
+      }
+   }
+
+   double packets = PACKETS;
+   double seconds = std::chrono::duration<double>(cpu).count();
+   benchOut.printf("%-24s %10.0f %12.0f %10.1f %10.1f %12llu %12llu\n", scenario.label,
+                   seconds > 0 ? packets / seconds : 0, cycles / packets,
+                   (link.readCalls() - readsBefore) / packets, (link.pollCalls() - pollsBefore) / packets,
+                   (unsigned long long)worstVirtual, (unsigned long long)worstCycles);
+
+   int failures = 0;
+   if (dropped) {
+      benchOut.printf("FAIL: %s: connection dropped after %d packets\n", scenario.label, received);
+      failures++;
+   }
+   if (received != PACKETS - 1 || corrupted) {
+      benchOut.printf("FAIL: %s: %d of %d publishes delivered, %d corrupted\n", scenario.label, received,
+                      PACKETS - 1, corrupted);
+      failures++;
+   }
+   if (worstVirtual > MAX_LOOP_VIRTUAL_US) {
+      benchOut.printf("FAIL: %s: loop() blocked for %llu us waiting for the network\n", scenario.label,
+                      (unsigned long long)worstVirtual);
+      failures++;
+   }
+   client.disconnect();
+   return failures;
+}
+
+} // namespace
+
+int benchMqttRead() {
+   benchPrintHeader("mqttread: inbound packet parsing over a fragmented link");
+   host::setVirtualClock(true);
+   host::setSerialEcho(false);
+
+   static const Scenario scenarios[] = {
+      {"whole packets, 1 ms", 0, 1000, false},
+      {"backlog of 200", SCRIPT_CAPACITY, 1000, false},
+      {"64 B every 2 ms", 64, 2000, false},
+      {"7 B every 1 ms", 7, 1000, false},
+      {"1 B every 200 us", 1, 200, false},
+      {"64 B, 5 s stall", 64, 2000, true},
+   };
+
+   benchOut.printf("%u publishes of 20..400 B, one of %u B (over the %u B buffer) dropped\n",
+                   PACKETS, (unsigned)OVERSIZED_PAYLOAD, BUFFER_SIZE);
+   benchOut.printf("%-24s %10s %12s %10s %10s %12s %12s\n", "delivery", "pkts/cpu-s", "cyc/pkt",
+                   "reads/pkt", "polls/pkt", "max loop us", "max loop cyc");
+   int failures = 0;
+   for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+      failures += runScenario(scenarios[i]);
+   }
+   return failures;
+}
@@ -0,0 +1,197 @@
+/*
+ bench_mqtt_vec.cpp - publishing without copying topic and payload into the
+ packet buffer.
+
+ A standalone PubSubClient writes to a counting Client. Payloads of 48 B to
+ 16 KB go out three ways: as publish() did before, copying the topic and
+ then the payload byte by byte into a packet buffer large enough for the
+ whole message and passing it on in one client write; through today's
+ publish(), which sends the header pieces and the payload through the MSS
+ write buffer and writes whole MSS-sized runs of the payload from where they
+ lie; and through publishv() with the payload in three segments (an
+ envelope prefix, the body and a suffix).
+
+ Reported per payload and path: client write calls, the TCP segments those
+ writes become with Nagle off (one per write, split at the MSS), bytes the
+ library copied, the packet buffer the path needs, and median cycles per
+ publish. Every path must put identical bytes on the wire, and the new
+ ones must never need a buffer beyond the write buffer or more write calls
+ than MSS-sized pieces of the packet. The summary gives publishv()'s fixed
+ cost over the bare copy at the smallest payload (payloads up to
+ MQTT_SMALL_PUBLISH_SIZE take the one-pass copy) and the break-even size:
+ the first payload for which it copies fewer bytes than the copying path.
+*/
+
+#include "bench.h"
+
+#include <PubSubClient.h>
+
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+const int RUNS = 200;
+const size_t MAX_PAYLOAD = 16384;
+const size_t WIRE_CAPACITY = MAX_PAYLOAD + 256;
+const char *TOPIC = "home/devices/esp32_relay_bench/audio";
+const size_t PREFIX = 24;
+const size_t SUFFIX = 8;
+
+CountingClient network;
+uint8_t payload[MAX_PAYLOAD];
+uint8_t reference[WIRE_CAPACITY];
+
+struct PathResult {
+   uint64_t writes;
+   uint64_t segments;
+   uint64_t copied;
+   size_t buffer;
+   size_t bytes;
+   uint64_t cycles;
+};
+
+// publish() before: header built at the end of the first 5 bytes of a
+// packet buffer, topic and payload copied in after it, one client write
+size_t publishCopy(uint8_t *buffer, size_t length) {
+   size_t topicLength = strlen(TOPIC);
+   size_t pos = MQTT_MAX_HEADER_SIZE;
+   buffer[pos++] = topicLength >> 8;
+   buffer[pos++] = topicLength & 0xFF;
+   memcpy(buffer + pos, TOPIC, topicLength);
+   pos += topicLength;
+   for (size_t i = 0; i < length; i++) {
+      buffer[pos++] = payload[i];
+   }
+   uint8_t lengthBytes[4];
+   size_t llen = 0;
+   size_t remaining = pos - MQTT_MAX_HEADER_SIZE;
+   do {
+      uint8_t digit = remaining % 128;
+      remaining /= 128;
+      lengthBytes[llen++] = digit | (remaining > 0 ? 0x80 : 0);
+   } while (remaining > 0);
+   uint8_t *start = buffer + MQTT_MAX_HEADER_SIZE - llen - 1;
+   start[0] = MQTTPUBLISH;
+   memcpy(start + 1, lengthBytes, llen);
+   size_t total = pos - MQTT_MAX_HEADER_SIZE + llen + 1;
+   network.write(start, total);
+   return total;
+}
+
+PathResult runCopy(size_t length) {
+   static uint8_t buffer[WIRE_CAPACITY];
+   network.resetCounts();
+   BenchSeries series;
+   size_t total = 0;
+   for (int run = 0; run < RUNS; run++) {
+      network.clear();
+      BenchMeter meter;
+      meter.start();
+      total = publishCopy(buffer, length);
+      series.add(meter.stop());
+   }
+   memcpy(reference, network.data(), network.size());
+   PathResult result = {network.writeCalls() / RUNS, network.segmentCount() / RUNS, total,
+                        MQTT_MAX_HEADER_SIZE + 2 + strlen(TOPIC) + length, network.size(), series.percentile(0.50)};
+   return result;
+}
+
+PathResult runClient(PubSubClient &client, size_t length, bool vectored, int &failures) {
+   MqttSegment segments[3] = {
+      {payload, PREFIX},
+      {payload + PREFIX, length - PREFIX - SUFFIX},
+      {payload + length - SUFFIX, SUFFIX},
+   };
+   network.resetCounts();
+   uint32_t gathered = client.getStats().bytesGathered;
+   BenchSeries series;
+   for (int run = 0; run < RUNS; run++) {
+      network.clear();
+      BenchMeter meter;
+      meter.start();
+      bool ok = vectored ? client.publishv(TOPIC, segments, 3, false) : client.publish(TOPIC, payload, length);
+      series.add(meter.stop());
+      if (!ok) failures++;
+   }
+   PathResult result = {network.writeCalls() / RUNS, network.segmentCount() / RUNS,
+                        (client.getStats().bytesGathered - gathered) / RUNS, 0, network.size(),
+                        series.percentile(0.50)};
+   return result;
+}
+
+void printPath(const char *label, const PathResult &result) {
+   char buffer[16] = "-";
+   if (result.buffer > 0) snprintf(buffer, sizeof(buffer), "%u", (unsigned)result.buffer);
+   benchOut.printf("  %-20s %7llu %9llu %9llu %9s %10llu\n", label, (unsigned long long)result.writes,
+                   (unsigned long long)result.segments, (unsigned long long)result.copied, buffer,
+                   (unsigned long long)result.cycles);
+}
+
+int check(const char *label, size_t length, const PathResult &copy, const PathResult &result) {
+   int failures = 0;
+   if (result.bytes != copy.bytes || memcmp(reference, network.data(), result.bytes) != 0) {
+      benchOut.printf("FAIL: %s, %u B payload: bytes on the wire differ from the copying publish\n", label,
+                      (unsigned)length);
+      failures++;
+   }
+   size_t expectedWrites = (result.bytes + MQTT_WRITE_BUFFER_SIZE - 1) / MQTT_WRITE_BUFFER_SIZE + 1;
+   if (result.writes > expectedWrites) {
+      benchOut.printf("FAIL: %s, %u B payload: %llu writes for %u bytes\n", label, (unsigned)length,
+                      (unsigned long long)result.writes, (unsigned)result.bytes);
+      failures++;
+   }
+   return failures;
+}
+
+int runPayload(PubSubClient &client, size_t length, PathResult &copy, PathResult &vectored) {
+   for (size_t i = 0; i < length; i++) {
+      payload[i] = (uint8_t)(i * 31 + 7);
+   }
+   benchOut.printf("%u B payload\n", (unsigned)length);
+   int failures = 0;
+   copy = runCopy(length);
+   printPath("copy into buffer", copy);
+   PathResult single = runClient(client, length, false, failures);
+   printPath("publish()", single);
+   failures += check("publish()", length, copy, single);
+   vectored = runClient(client, length, true, failures);
+   printPath("publishv(), 3 segs", vectored);
+   failures += check("publishv()", length, copy, vectored);
+   return failures;
+}
+
+} // namespace
+
+int benchMqttVec() {
+   benchPrintHeader("mqttvec: publishing without copying into the packet buffer");
+   host::setSerialEcho(false);
+
+   PubSubClient client(network);
+   client.setBufferSize(512);
+   if (!client.connect("bench-vec")) {
+      benchOut.printf("FAIL: CONNECT was not acknowledged\n");
+      return 1;
+   }
+   benchOut.printf("client buffer %u B, write buffer %u B, segments counted at an MSS of %u B\n",
+                   client.getBufferSize(), (unsigned)MQTT_WRITE_BUFFER_SIZE, (unsigned)CountingClient::MSS);
+   benchOut.printf("  %-20s %7s %9s %9s %9s %10s\n", "path", "writes", "segments", "copied B", "buffer B",
+                   "cycles p50");
+
+   static const size_t lengths[] = {48, 400, 1400, 4096, MAX_PAYLOAD};
+   const size_t count = sizeof(lengths) / sizeof(lengths[0]);
+   PathResult copies[count];
+   PathResult vectored[count];
+   int failures = 0;
+   size_t breakEven = 0;
+   for (size_t i = 0; i < count; i++) {
+      failures += runPayload(client, lengths[i], copies[i], vectored[i]);
+      if (breakEven == 0 && vectored[i].copied < copies[i].copied) breakEven = lengths[i];
+   }
+   benchOut.printf("publishv() at %u B: %lld cycles over the bare copy (one-pass copy up to %u B); "
+                   "copies less from %u B\n",
+                   (unsigned)lengths[0], (long long)vectored[0].cycles - (long long)copies[0].cycles,
+                   (unsigned)MQTT_SMALL_PUBLISH_SIZE, (unsigned)breakEven);
+   client.disconnect();
+   return failures;
+}
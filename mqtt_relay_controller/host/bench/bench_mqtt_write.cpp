@@ -0,0 +1,216 @@
+/*
+ bench_mqtt_write.cpp - streaming a JSON publish through beginPublish().
+
+ A standalone PubSubClient writes to a counting Client. Three documents the
+ size of the firmware's command response, registration and heartbeat are
+ published with beginPublish() / serializeJson() / endPublish() and, for
+ comparison, the way the unbuffered library did it: the header, then
+ serializeJson() through a Print that stamps millis() and forwards each
+ byte to the network client. Reported per document:
+ client write calls, bytes per write, the TCP segments those writes become
+ with Nagle off (one per write, split at the MSS), and cycles per publish.
+ Both paths must put identical bytes on the wire, and the library's
+ writeCalls / bytesOut counters must match what the client saw.
+*/
+
+#include "bench.h"
+
+#include <ArduinoJson.h>
+#include <PubSubClient.h>
+
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+const int RUNS = 200;
+const size_t WIRE_CAPACITY = 8192;
+const char *TOPIC = "home/devices/esp32_relay_bench/heartbeat";
+
+CountingClient network;
+StaticJsonDocument<4096> doc;
+
+// What PubSubClient::write() did before the write buffer
+class ForwardingPrint : public Print {
+public:
+   unsigned long lastOutActivity;
+   size_t write(uint8_t data) override {
+      lastOutActivity = millis();
+      return network.write(data);
+   }
+   size_t write(const uint8_t *buffer, size_t size) override {
+      lastOutActivity = millis();
+      return network.write(buffer, size);
+   }
+};
+
+ForwardingPrint forwarding;
+
+void buildResponse() {
+   doc.clear();
+   doc["deviceId"] = "esp32_relay_bench";
+   doc["command"] = "turn_on";
+   doc["requestId"] = "bench-1234";
+   doc["success"] = true;
+   doc["status"] = "on";
+   doc["state"] = 1;
+   doc["channels"] = 8;
+   doc["timestamp"] = 123456789;
+}
+
+void buildRegistration() {
+   buildResponse();
+   doc["name"] = "ESP32 Voice Relay";
+   doc["ip"] = "192.168.100.123";
+   doc["type"] = "registration";
+   JsonArray capabilities = doc.createNestedArray("capabilities");
+   capabilities.add("relay_control");
+   capabilities.add("multi_channel");
+   capabilities.add("voice_commands");
+   capabilities.add("audio_feedback");
+}
+
+// The firmware heartbeat is ~3 KB, mostly nested diagnostics
+void buildHeartbeat() {
+   buildRegistration();
+   doc["type"] = "heartbeat";
+   JsonArray pins = doc.createNestedArray("relay_pins");
+   const uint8_t relayPins[] = {4, 5, 13, 14, 16, 17, 21, 23};
+   for (uint8_t pin : relayPins) pins.add(pin);
+   char key[24];
+   for (int section = 0; section < 10; section++) {
+      snprintf(key, sizeof(key), "diagnostics_%d", section);
+      JsonObject object = doc.createNestedObject(key);
+      for (int field = 0; field < 10; field++) {
+         snprintf(key, sizeof(key), "counter_%d", field);
+         object[key] = 1000000UL * section + 7919UL * field;
+      }
+   }
+}
+
+struct PathResult {
+   uint64_t writes;
+   uint64_t segments;
+   size_t bytes;
+   double cycles;
+};
+
+// The unbuffered library: header in one write, then every byte the
+// serializer produces passed on by PubSubClient::write()
+PathResult runDirect(uint8_t *wireCopy) {
+   size_t length = measureJson(doc);
+   size_t topicLength = strlen(TOPIC);
+   uint8_t header[8];
+   size_t remaining = 2 + topicLength + length;
+   size_t n = 0;
+   header[n++] = 0x30;
+   do {
+      uint8_t digit = remaining % 128;
+      remaining /= 128;
+      header[n++] = digit | (remaining > 0 ? 0x80 : 0);
+   } while (remaining > 0);
+   header[n++] = topicLength >> 8;
+   header[n++] = topicLength & 0xFF;
+
+   network.resetCounts();
+   BenchSeries series;
+   for (int run = 0; run < RUNS; run++) {
+      network.clear();
+      BenchMeter meter;
+      meter.start();
+      uint8_t packet[64];
+      memcpy(packet, header, n);
+      memcpy(packet + n, TOPIC, topicLength);
+      network.write(packet, n + topicLength);
+      serializeJson(doc, forwarding);
+      series.add(meter.stop());
+   }
+   memcpy(wireCopy, network.data(), network.size());
+   PathResult result = {network.writeCalls() / RUNS, network.segmentCount() / RUNS, network.size(),
+                        series.meanCycles()};
+   return result;
+}
+
+PathResult runBuffered(PubSubClient &client, int &failures) {
+   size_t length = measureJson(doc);
+   network.resetCounts();
+   PubSubClientStats before = client.getStats();
+   BenchSeries series;
+   for (int run = 0; run < RUNS; run++) {
+      network.clear();
+      BenchMeter meter;
+      meter.start();
+      bool ok = client.beginPublish(TOPIC, length, false);
+      size_t written = serializeJson(doc, client);
+      ok = client.endPublish() && ok && written == length;
+      series.add(meter.stop());
+      if (!ok) failures++;
+   }
+   const PubSubClientStats &after = client.getStats();
+   if (after.writeCalls - before.writeCalls != network.writeCalls()) {
+      benchOut.printf("FAIL: stats count %u writes, the client saw %llu\n",
+                      (unsigned)(after.writeCalls - before.writeCalls), (unsigned long long)network.writeCalls());
+      failures++;
+   }
+   if (after.bytesOut - before.bytesOut != network.size() * RUNS) {
+      benchOut.printf("FAIL: stats count %u bytes out, the client saw %llu\n",
+                      (unsigned)(after.bytesOut - before.bytesOut), (unsigned long long)network.size() * RUNS);
+      failures++;
+   }
+   PathResult result = {network.writeCalls() / RUNS, network.segmentCount() / RUNS, network.size(),
+                        series.meanCycles()};
+   return result;
+}
+
+void printPath(const char *label, const PathResult &result) {
+   benchOut.printf("  %-22s %8llu %10.1f %10llu %12.0f\n", label, (unsigned long long)result.writes,
+                   result.writes ? (double)result.bytes / result.writes : 0.0,
+                   (unsigned long long)result.segments, result.cycles);
+}
+
+int runDocument(PubSubClient &client, const char *label, void (*build)()) {
+   static uint8_t direct[WIRE_CAPACITY];
+   build();
+   benchOut.printf("%s (%u byte publish)\n", label, (unsigned)(measureJson(doc) + strlen(TOPIC) + 5));
+   benchOut.printf("  %-22s %8s %10s %10s %12s\n", "path", "writes", "bytes/wr", "segments", "cycles");
+
+   int failures = 0;
+   PathResult unbuffered = runDirect(direct);
+   PathResult buffered = runBuffered(client, failures);
+   printPath("byte writes (old)", unbuffered);
+   printPath("coalesced", buffered);
+
+   if (buffered.bytes != unbuffered.bytes || memcmp(direct, network.data(), buffered.bytes) != 0) {
+      benchOut.printf("FAIL: %s: buffered publish differs from the unbuffered bytes\n", label);
+      failures++;
+   }
+   size_t expectedWrites = (buffered.bytes + MQTT_WRITE_BUFFER_SIZE - 1) / MQTT_WRITE_BUFFER_SIZE;
+   if (buffered.writes > expectedWrites) {
+      benchOut.printf("FAIL: %s: %llu writes for %u bytes, expected %u\n", label,
+                      (unsigned long long)buffered.writes, (unsigned)buffered.bytes, (unsigned)expectedWrites);
+      failures++;
+   }
+   return failures;
+}
+
+} // namespace
+
+int benchMqttWrite() {
+   benchPrintHeader("mqttwrite: streaming JSON publishes into the socket");
+   host::setSerialEcho(false);
+
+   PubSubClient client(network);
+   if (!client.connect("bench-write")) {
+      benchOut.printf("FAIL: CONNECT was not acknowledged\n");
+      return 1;
+   }
+   benchOut.printf("write buffer %u B, segments counted at an MSS of %u B\n",
+                   (unsigned)MQTT_WRITE_BUFFER_SIZE, (unsigned)CountingClient::MSS);
+
+   int failures = 0;
+   failures += runDocument(client, "command response", buildResponse);
+   failures += runDocument(client, "registration", buildRegistration);
+   failures += runDocument(client, "heartbeat", buildHeartbeat);
+   client.disconnect();
+   return failures;
+}
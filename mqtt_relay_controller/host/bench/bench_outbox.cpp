@@ -0,0 +1,227 @@
+/*
+ bench_outbox.cpp - store-and-forward of messages produced while offline.
+
+ The broker refuses connections while the booted firmware keeps producing
+ messages: a command response and a status broadcast every 15 s (what a
+ voice command publishes) and its heartbeat, which is queued once a minute
+ while offline. Then the broker comes back. Reported per outage: records
+ queued, flash writes and sector erases, the queue depth when the outage ends,
+ time from the new session to an empty queue, records per second and
+ records lost. Every queued record must arrive exactly once with no gap in
+ "seq", all events before any telemetry and oldest first within each.
+
+ Scenarios: an 8 minute outage drained at the configured 20 records/s, the
+ same drained at 200/s, and a 5 s outage, which must not write to flash at
+ all because the RAM cache is only flushed after 10 s. Finally the queue of
+ a 2 minute outage is reopened as after a reboot and must index the same
+ records.
+*/
+
+#include "bench.h"
+#include "mqtt_connection.h"
+#include "outbox.h"
+
+#include <stdio.h>
+#include <string.h>
+
+extern MqttConnection mqttConnection;
+extern const char *heartbeat_topic;
+void sendCommandResponse(const char *command, const char *requestId, bool success, const char *error, const char *source);
+void sendStatus(const char *requestId, bool reply);
+
+namespace {
+
+const int MAX_LOOPS = 400000;
+const size_t MAX_ARRIVALS = 512;
+
+struct Arrival {
+   uint32_t seq;
+   bool telemetry;
+};
+
+Arrival arrivals[MAX_ARRIVALS];
+size_t arrivalCount;
+
+// "seq" is the last field serialized, so search from the end
+bool findSeq(const uint8_t *payload, size_t length, uint32_t &seq) {
+   static const char key[] = "\"seq\":";
+   const size_t keyLength = sizeof(key) - 1;
+   for (size_t i = length >= keyLength ? length - keyLength + 1 : 0; i-- > 0;) {
+      if (memcmp(payload + i, key, keyLength) == 0) {
+         seq = 0;
+         for (size_t j = i + keyLength; j < length && payload[j] >= '0' && payload[j] <= '9'; j++) {
+            seq = seq * 10 + (payload[j] - '0');
+         }
+         return true;
+      }
+   }
+   return false;
+}
+
+void onPublish(const MockBroker::Message &message, const uint8_t *payload) {
+   uint32_t seq;
+   if (arrivalCount < MAX_ARRIVALS && findSeq(payload, message.length, seq)) {
+      arrivals[arrivalCount].seq = seq;
+      arrivals[arrivalCount].telemetry = strcmp(message.topic, heartbeat_topic) == 0;
+      arrivalCount++;
+   }
+}
+
+// Run the firmware until `micros` of virtual time has passed, producing
+// a response and a status every `eventEvery` us meanwhile
+void runOffline(uint64_t micros, uint64_t eventEvery) {
+   uint64_t end = host::nowMicros() + micros;
+   uint64_t nextEvent = host::nowMicros() + eventEvery;
+   char requestId[24];
+   for (int i = 0; i < MAX_LOOPS && host::nowMicros() < end; i++) {
+      loop();
+      if (host::nowMicros() >= nextEvent) {
+         snprintf(requestId, sizeof(requestId), "voice_%lu", millis());
+         sendCommandResponse("turn_on", requestId, true, "", "voice");
+         sendStatus("", false);
+         nextEvent += eventEvery;
+      }
+   }
+}
+
+bool runUntilDrained() {
+   uint32_t sessions = mqttConnection.stats().sessions;
+   for (int i = 0; i < MAX_LOOPS; i++) {
+      loop();
+      if (mqttConnection.stats().sessions != sessions && outbox.depth() == 0) {
+         return true;
+      }
+   }
+   return false;
+}
+
+// Every seq in [first, first + count) once; events first, each in order
+int checkArrivals(const char *label, uint32_t first, uint32_t count) {
+   int failures = 0;
+   static bool seen[MAX_ARRIVALS];
+   memset(seen, 0, sizeof(seen));
+   size_t duplicates = 0, outOfRange = 0, misordered = 0;
+   bool telemetryStarted = false;
+   uint32_t lastEvent = 0, lastTelemetry = 0;
+   for (size_t i = 0; i < arrivalCount; i++) {
+      const Arrival &arrival = arrivals[i];
+      if (arrival.seq < first || arrival.seq - first >= count || arrival.seq - first >= MAX_ARRIVALS) {
+         outOfRange++;
+         continue;
+      }
+      if (seen[arrival.seq - first]) duplicates++;
+      seen[arrival.seq - first] = true;
+      uint32_t &last = arrival.telemetry ? lastTelemetry : lastEvent;
+      if ((!arrival.telemetry && telemetryStarted) || arrival.seq < last) misordered++;
+      last = arrival.seq;
+      telemetryStarted = telemetryStarted || arrival.telemetry;
+   }
+   size_t missing = 0;
+   for (uint32_t i = 0; i < count && i < MAX_ARRIVALS; i++) {
+      if (!seen[i]) missing++;
+   }
+   if (missing || duplicates || outOfRange || misordered) {
+      benchOut.printf("FAIL: %s: %u missing, %u duplicated, %u unexpected, %u out of order\n", label,
+                      (unsigned)missing, (unsigned)duplicates, (unsigned)outOfRange, (unsigned)misordered);
+      failures++;
+   }
+   return failures;
+}
+
+int runOutage(const char *label, uint64_t outageMicros, uint64_t eventEvery, uint16_t drainRate, bool expectFlash) {
+   MockBroker &broker = benchBroker();
+   OutboxStats before = outbox.stats();
+   host::FlashStats flashBefore = host::flashStats();
+   outbox.setDrainRate(drainRate);
+
+   broker.setAcceptConnections(false);
+   broker.dropConnection();
+   runOffline(outageMicros, eventEvery);
+   host::FlashStats flashOffline = host::flashStats();
+   uint8_t depth = outbox.depth();
+
+   arrivalCount = 0;
+   broker.setPublishHook(onPublish);
+   broker.setAcceptConnections(true);
+   bool drained = runUntilDrained();
+   broker.setPublishHook(NULL);
+
+   // Until the session is up, the firmware may queue a few more
+   const OutboxStats &after = outbox.stats();
+   uint32_t queued = after.queued - before.queued;
+   uint32_t lost = after.dropped - before.dropped;
+   uint32_t drainMs = after.lastDrainMs;
+   benchOut.printf("%-20s %5u %6u %9u %7u %9u %10.1f %5u\n", label, (unsigned)queued, (unsigned)depth,
+                   (unsigned)(flashOffline.writes - flashBefore.writes),
+                   (unsigned)(flashOffline.erases - flashBefore.erases), (unsigned)drainMs,
+                   drainMs ? (after.lastDrainRecords - 1) * 1000.0 / drainMs : 0.0, (unsigned)lost);
+
+   int failures = 0;
+   if (!drained) {
+      benchOut.printf("FAIL: %s: %u records still queued after the reconnect\n", label, outbox.depth());
+      return 1;
+   }
+   if (lost || after.sent - before.sent != queued) {
+      benchOut.printf("FAIL: %s: %u queued, %u sent, %u lost\n", label, (unsigned)queued,
+                      (unsigned)(after.sent - before.sent), (unsigned)lost);
+      failures++;
+   }
+   // The records of this outage are the last `queued` sequence numbers
+   uint32_t last = 0;
+   for (size_t i = 0; i < arrivalCount; i++) {
+      if (arrivals[i].seq > last) last = arrivals[i].seq;
+   }
+   failures += checkArrivals(label, last + 1 - queued, queued);
+   if (!expectFlash && flashOffline.writes != flashBefore.writes) {
+      benchOut.printf("FAIL: %s: %u flash writes for an outage shorter than the cache flush delay\n", label,
+                      (unsigned)(flashOffline.writes - flashBefore.writes));
+      failures++;
+   }
+   return failures;
+}
+
+// Queue during an outage, flush as before a reboot, and index it again
+int runReplay() {
+   MockBroker &broker = benchBroker();
+   broker.setAcceptConnections(false);
+   broker.dropConnection();
+   runOffline(120000000ULL, 15000000ULL);
+   outbox.flush();
+
+   Outbox reopened;
+   bool opened = reopened.begin("outbox");
+   benchOut.printf("reboot with %u queued: reopened with %u in %u us\n", outbox.depth(), reopened.depth(),
+                   (unsigned)reopened.stats().replayUs);
+   int failures = 0;
+   if (!opened || reopened.depth() != outbox.depth()) {
+      benchOut.printf("FAIL: replay indexed %u of %u queued records\n", reopened.depth(), outbox.depth());
+      failures++;
+   }
+   broker.setAcceptConnections(true);
+   if (!runUntilDrained()) {
+      benchOut.printf("FAIL: replay: queue not drained after the reconnect\n");
+      failures++;
+   }
+   return failures;
+}
+
+} // namespace
+
+int benchOutbox() {
+   benchPrintHeader("outbox: messages queued while MQTT is down");
+   if (!benchBootFirmware()) return 1;
+   // Outages in earlier suites may have left records to send
+   for (int i = 0; i < MAX_LOOPS && outbox.depth() > 0; i++) {
+      loop();
+   }
+
+   benchOut.printf("%-20s %5s %6s %9s %7s %9s %10s %5s\n", "outage", "queued", "depth", "flash wr", "erases",
+                   "drain ms", "records/s", "lost");
+   int failures = 0;
+   failures += runOutage("8 min, drain 20/s", 480000000ULL, 15000000ULL, 20, true);
+   failures += runOutage("8 min, drain 200/s", 480000000ULL, 15000000ULL, 200, true);
+   failures += runOutage("5 s, drain 20/s", 5000000ULL, 2000000ULL, 20, false);
+   outbox.setDrainRate(Outbox::DEFAULT_DRAIN_RATE);
+   failures += runReplay();
+   return failures;
+}
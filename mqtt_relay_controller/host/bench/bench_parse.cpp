@@ -0,0 +1,115 @@
+/*
+ bench_parse.cpp - MQTT command parsing, before and after in-place parsing.
+
+ "String copy" is the previous callback() path, kept here as the reference:
+ rebuild the payload one char at a time into a String, deserializeJson()
+ it into a DynamicJsonDocument(512) and copy the fields out as Strings.
+ "in place" is parseCommand() from src/command_parser.cpp: zero-copy mode
+ on the packet buffer with a filter for command/requestId. Each payload is
+ copied into a scratch buffer before every run (as PubSubClient would have
+ filled it), outside the measured region. Only the in-place path has to
+ recover both fields from every payload; the old path's 512-byte pool is
+ too small for the larger one on a 64-bit host.
+*/
+
+#include "bench.h"
+#include "command_parser.h"
+
+#include <ArduinoJson.h>
+#include <time.h>
+
+namespace {
+
+const int PARSE_RUNS = 2000;
+const int WARMUP_RUNS = 20;
+
+struct Payload {
+   const char *label;
+   const char *json;
+};
+
+const Payload payloads[] = {
+   {"bridge command",
+    "{\"command\":\"turn_on\",\"requestId\":\"7f9c2ba4-e88f-11ee-a951-0242ac120002\"}"},
+   {"dashboard command",
+    "{\"command\":\"turn_off\",\"requestId\":\"7f9c2ba4-e88f-11ee-a951-0242ac120002\","
+    "\"source\":\"dashboard\",\"timestamp\":1718000000123,"
+    "\"user\":{\"id\":42,\"name\":\"living-room-panel\",\"roles\":[\"admin\",\"scenes\"]},"
+    "\"trace\":{\"span\":\"00f067aa0ba902b7\",\"parent\":\"b7ad6b7169203331\"}}"},
+};
+
+bool legacyParse(const byte *payload, unsigned int length) {
+   String message;
+   for (unsigned int i = 0; i < length; i++) {
+      message += (char)payload[i];
+   }
+   DynamicJsonDocument doc(512);
+   DeserializationError error = deserializeJson(doc, message);
+   if (error) return false;
+   String command = doc["command"];
+   String requestId = doc["requestId"];
+   return command.length() > 0 && requestId.length() > 0;
+}
+
+bool inPlaceParse(byte *payload, unsigned int length) {
+   ParsedCommand parsed;
+   if (parseCommand(payload, length, parsed)) return false;
+   return parsed.command[0] != '\0' && parsed.requestId[0] != '\0';
+}
+
+uint64_t monotonicNanos() {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Returns the number of runs that did not yield both fields
+int measure(const char *label, bool inPlace, const Payload &payload) {
+   static byte scratch[1024];
+   unsigned int length = strlen(payload.json);
+   BenchSeries series;
+   uint64_t nanos = 0;
+   int failures = 0;
+
+   for (int run = 0; run < WARMUP_RUNS + PARSE_RUNS; run++) {
+      memcpy(scratch, payload.json, length);
+      BenchMeter meter;
+      uint64_t start = monotonicNanos();
+      meter.start();
+      bool ok = inPlace ? inPlaceParse(scratch, length) : legacyParse(scratch, length);
+      BenchSample sample = meter.stop();
+      uint64_t elapsed = monotonicNanos() - start;
+      if (run >= WARMUP_RUNS) {
+         series.add(sample);
+         nanos += elapsed;
+      }
+      failures += !ok;
+   }
+
+   benchPrintSeries(label, series);
+   benchOut.printf("%-24s %8s mean %.2f us per parse", "", "", nanos / 1000.0 / PARSE_RUNS);
+   if (failures) {
+      benchOut.printf(", fields lost in %d runs", failures);
+   }
+   benchOut.printf("\n");
+   return failures;
+}
+
+} // namespace
+
+int benchParse() {
+   benchPrintHeader("parse: MQTT command payload -> command/requestId");
+
+   int failures = 0;
+   for (size_t i = 0; i < sizeof(payloads) / sizeof(payloads[0]); i++) {
+      benchOut.printf("%s (%u bytes)\n", payloads[i].label, (unsigned)strlen(payloads[i].json));
+      benchPrintSeriesHeader("  path");
+      // The 512-byte pool of the old path may not hold larger payloads
+      measure("  String copy (before)", false, payloads[i]);
+      failures += measure("  in place (after)", true, payloads[i]);
+   }
+   if (failures) {
+      benchOut.printf("FAIL: %d parses lost command or requestId\n", failures);
+   }
+   return failures;
+}
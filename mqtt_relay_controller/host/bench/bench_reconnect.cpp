@@ -0,0 +1,205 @@
+/*
+ bench_reconnect.cpp - MQTT reconnect behaviour.
+
+ Outage: the broker refuses connections for two minutes of firmware time.
+ Reports the retry schedule (capped exponential backoff with jitter), the
+ longest single run of the mqtt task (how long the rest of the firmware was
+ held up) and how often the audio task still ran.
+
+ Broker restart: the session is dropped while the broker stays up; the
+ distribution of drop -> re-registered times shows the first-retry jitter
+ that keeps a fleet from reconnecting in lockstep.
+
+ Slow broker: name lookup takes 40 ms, the TCP handshake 60 ms and the
+ CONNACK arrives 1.5 s after CONNECT. Reports the DNS / TCP / CONNACK phase
+ times the firmware measured, the longest mqtt task run (only the blocking
+ lookup and TCP connect may hold the firmware; the CONNACK wait must not)
+ and how often the audio task ran meanwhile. A broker that never sends the
+ CONNACK must time out the same way.
+*/
+
+#include "bench.h"
+#include "mqtt_connection.h"
+#include "scheduler.h"
+
+extern MqttConnection mqttConnection;
+
+namespace {
+
+const uint64_t OUTAGE_MICROS = 120ULL * 1000000ULL;
+const int RESTART_RUNS = 200;
+const int SLOW_RUNS = 20;
+const uint32_t DNS_DELAY_MS = 40;
+const uint32_t TCP_DELAY_MS = 60;
+const uint64_t CONNACK_DELAY_US = 1500000;
+const int SILENT_ATTEMPTS = 3;
+const int MAX_LOOPS = 200000;
+
+// Run until a new session has been registered
+bool runUntilNewSession() {
+   uint32_t sessions = mqttConnection.stats().sessions;
+   for (int i = 0; i < MAX_LOOPS && mqttConnection.stats().sessions == sessions; i++) {
+      loop();
+   }
+   return mqttConnection.stats().sessions != sessions;
+}
+
+int runOutage() {
+   MockBroker &broker = benchBroker();
+   int8_t mqttTask = scheduler.findTask("mqtt");
+   int8_t audioTask = scheduler.findTask("audio");
+
+   scheduler.resetStats();
+   uint32_t attemptsBefore = mqttConnection.stats().attempts;
+   broker.setAcceptConnections(false);
+   broker.dropConnection();
+
+   uint64_t start = host::nowMicros();
+   uint64_t lastAttemptAt = start;
+   uint32_t lastAttempts = attemptsBefore;
+   benchOut.printf("retry schedule (ms since previous attempt):");
+   for (int i = 0; i < MAX_LOOPS && host::nowMicros() - start < OUTAGE_MICROS; i++) {
+      loop();
+      if (mqttConnection.stats().attempts != lastAttempts) {
+         lastAttempts = mqttConnection.stats().attempts;
+         benchOut.printf(" %llu", (unsigned long long)((host::nowMicros() - lastAttemptAt) / 1000));
+         lastAttemptAt = host::nowMicros();
+      }
+   }
+   benchOut.printf("\n");
+
+   const TaskStats &mqtt = scheduler.taskStats(mqttTask);
+   const TaskStats &audio = scheduler.taskStats(audioTask);
+   benchOut.printf("outage %llu s: %u attempts, mqtt task max run %u us (firmware time), audio task ran %u times (at least %llu)\n",
+                   (unsigned long long)(OUTAGE_MICROS / 1000000ULL),
+                   (unsigned)(mqttConnection.stats().attempts - attemptsBefore),
+                   (unsigned)mqtt.maxMicros,
+                   (unsigned)audio.runs,
+                   (unsigned long long)(OUTAGE_MICROS / 50000ULL));
+
+   broker.setAcceptConnections(true);
+   uint64_t acceptedAt = host::nowMicros();
+   if (!runUntilNewSession()) {
+      benchOut.printf("FAIL: no session after the broker came back\n");
+      return 1;
+   }
+   benchOut.printf("broker back -> session up: %llu ms (reported reconnect_ms %u)\n",
+                   (unsigned long long)((host::nowMicros() - acceptedAt) / 1000),
+                   (unsigned)mqttConnection.stats().lastReconnectMs);
+   return 0;
+}
+
+int runRestarts() {
+   MockBroker &broker = benchBroker();
+   BenchSeries series;
+   for (int run = 0; run < RESTART_RUNS; run++) {
+      broker.dropConnection();
+      if (!runUntilNewSession()) {
+         benchOut.printf("FAIL: no session after restart %d\n", run);
+         return 1;
+      }
+      BenchSample sample = {mqttConnection.stats().lastReconnectMs, 0, 0};
+      series.add(sample);
+   }
+   benchPrintDistributionHeader("broker restart", "ms");
+   benchPrintDistribution("drop -> registered", series);
+   return 0;
+}
+
+int runSlowBroker() {
+   MockBroker &broker = benchBroker();
+   int8_t mqttTask = scheduler.findTask("mqtt");
+   int8_t audioTask = scheduler.findTask("audio");
+   BenchSeries dns;
+   BenchSeries tcp;
+   BenchSeries connack;
+   BenchSeries session;
+   uint32_t maxRun = 0;
+   uint64_t audioRuns = 0;
+   uint64_t handshakeMicros = 0;
+
+   host::setDnsDelay(DNS_DELAY_MS);
+   host::setTcpConnectDelay(TCP_DELAY_MS);
+   broker.setConnackDelay(CONNACK_DELAY_US);
+   for (int run = 0; run < SLOW_RUNS; run++) {
+      broker.dropConnection();
+      for (int i = 0; i < MAX_LOOPS && mqttConnection.state() == MQTT_STATE_CONNECTED; i++) {
+         loop();
+      }
+      // Start over from name resolution
+      mqttConnection.begin("broker.hivemq.com", 1883, "ESP32Client-");
+      scheduler.runNow(mqttTask);
+      scheduler.resetStats();
+      uint64_t start = host::nowMicros();
+      if (!runUntilNewSession()) {
+         benchOut.printf("FAIL: no session with the slow broker (run %d)\n", run);
+         return 1;
+      }
+      const MqttConnectionStats &stats = mqttConnection.stats();
+      BenchSample dnsSample = {stats.resolveUs / 1000, 0, 0};
+      BenchSample tcpSample = {stats.tcpConnectUs / 1000, 0, 0};
+      BenchSample connackSample = {stats.connackUs / 1000, 0, 0};
+      BenchSample sessionSample = {(host::nowMicros() - start) / 1000, 0, 0};
+      dns.add(dnsSample);
+      tcp.add(tcpSample);
+      connack.add(connackSample);
+      session.add(sessionSample);
+      if (scheduler.taskStats(mqttTask).maxMicros > maxRun) maxRun = scheduler.taskStats(mqttTask).maxMicros;
+      audioRuns += scheduler.taskStats(audioTask).runs;
+      handshakeMicros += host::nowMicros() - start;
+   }
+   broker.setConnackDelay(0);
+
+   benchPrintDistributionHeader("slow broker", "ms");
+   benchPrintDistribution("resolve", dns);
+   benchPrintDistribution("TCP connect", tcp);
+   benchPrintDistribution("CONNECT -> CONNACK", connack);
+   benchPrintDistribution("start -> registered", session);
+   benchOut.printf("mqtt task max run %u us, audio task ran %llu times (at least %llu)\n", (unsigned)maxRun,
+                   (unsigned long long)audioRuns, (unsigned long long)(handshakeMicros / 50000ULL));
+   int failures = 0;
+   if (maxRun > (DNS_DELAY_MS > TCP_DELAY_MS ? DNS_DELAY_MS : TCP_DELAY_MS) * 1000 + 10000) {
+      benchOut.printf("FAIL: the mqtt task blocked for %u us while connecting\n", (unsigned)maxRun);
+      failures++;
+   }
+
+   // A broker that accepts TCP but never answers CONNECT
+   broker.setAutoConnack(false);
+   broker.dropConnection();
+   scheduler.resetStats();
+   uint32_t failuresBefore = mqttConnection.stats().failures;
+   for (int i = 0; i < MAX_LOOPS && mqttConnection.stats().failures - failuresBefore < SILENT_ATTEMPTS; i++) {
+      loop();
+   }
+   uint32_t timeouts = mqttConnection.stats().failures - failuresBefore;
+   uint32_t silentMaxRun = scheduler.taskStats(mqttTask).maxMicros;
+   benchOut.printf("silent broker: %u CONNACK timeouts (last error %d), mqtt task max run %u us\n",
+                   (unsigned)timeouts, mqttConnection.stats().lastError, (unsigned)silentMaxRun);
+   broker.setAutoConnack(true);
+   host::setDnsDelay(0);
+   host::setTcpConnectDelay(0);
+   if (timeouts < SILENT_ATTEMPTS || mqttConnection.stats().lastError != MQTT_CONNECTION_TIMEOUT) {
+      benchOut.printf("FAIL: a silent broker did not time out the handshake\n");
+      failures++;
+   }
+   if (silentMaxRun > TCP_DELAY_MS * 1000 + 10000) {
+      benchOut.printf("FAIL: the mqtt task blocked for %u us waiting for a CONNACK\n", (unsigned)silentMaxRun);
+      failures++;
+   }
+   if (!runUntilNewSession()) {
+      benchOut.printf("FAIL: no session after the broker answered again\n");
+      failures++;
+   }
+   return failures;
+}
+
+} // namespace
+
+int benchReconnect() {
+   benchPrintHeader("reconnect: broker outage and restarts");
+   if (!benchBootFirmware()) return 1;
+   int failures = runOutage();
+   failures += runRestarts();
+   failures += runSlowBroker();
+   return failures;
+}
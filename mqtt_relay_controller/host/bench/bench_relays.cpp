@@ -0,0 +1,206 @@
+/*
+ bench_relays.cpp - switching every relay channel at once.
+
+ A scene change that flips all channels is sent two ways: as one
+ turn_on/turn_off command per channel (the only option before
+ set_channels), with the messages arriving 2 ms apart as a controller
+ publishing back-to-back would produce, and as a single set_channels
+ command. Reported per scene: loop() cycles and allocations, GPIO register
+ writes, publishes and bytes on the wire, EEPROM commits, and the skew
+ between the first and last relay changing level on the virtual clock.
+ The batched path must switch every channel at the same instant with at
+ most two register writes; invalid and overlapping channel lists must be
+ rejected without touching the pins.
+*/
+
+#include "bench.h"
+#include "relay_bank.h"
+
+#include <stdio.h>
+#include <string.h>
+
+extern const char *command_topic;
+extern const char *response_topic;
+
+namespace {
+
+const int SCENE_RUNS = 200;
+const int WARMUP_RUNS = 5;
+const uint64_t MESSAGE_SPACING_US = 2000;
+const int MAX_LOOPS_PER_SCENE = 5000;
+
+struct SceneTotals {
+   BenchSeries series;
+   uint64_t registerWrites;
+   uint64_t publishes;
+   uint64_t bytes;
+   uint64_t commits;
+   uint64_t skewMicros;
+   uint64_t maxSkewMicros;
+   int runs;
+   int failures;
+};
+
+// Every channel in `target` is at the expected level
+bool pinsMatch(uint32_t target) {
+   for (uint8_t i = 0; i < relays.count(); i++) {
+      int expected = (target >> i) & 1 ? HIGH : LOW;
+      if (host::pinLevel(relays.pin(i)) != expected) return false;
+   }
+   return true;
+}
+
+// First to last level change among the relays that changed since `since`
+uint64_t changeSkew(uint64_t since) {
+   uint64_t first = UINT64_MAX;
+   uint64_t last = 0;
+   for (uint8_t i = 0; i < relays.count(); i++) {
+      uint64_t at = host::pinChangedAtMicros(relays.pin(i));
+      if (at < since) continue;
+      if (at < first) first = at;
+      if (at > last) last = at;
+   }
+   return first == UINT64_MAX ? 0 : last - first;
+}
+
+// Channels 0, 2, 4... on and the rest off, or the reverse
+uint32_t sceneMask(int run) {
+   return (run % 2 == 0 ? 0x55555555UL : 0xAAAAAAAAUL) & relays.allMask();
+}
+
+void runScene(SceneTotals &totals, int run, bool batched) {
+   MockBroker &broker = benchBroker();
+   uint32_t target = sceneMask(run);
+   uint32_t publishesBefore = broker.stats().publishesIn;
+   uint64_t bytesBefore = broker.stats().bytesIn;
+   uint32_t writesBefore = host::gpioRegisterWrites();
+   uint32_t commitsBefore = host::eepromCommits();
+   uint32_t responsesBefore = broker.publishedTo(response_topic);
+   uint64_t startMicros = host::nowMicros();
+   char payload[160];
+
+   BenchMeter meter;
+   BenchSample sample = {0, 0, 0};
+   if (batched) {
+      char on[64] = "";
+      char off[64] = "";
+      for (uint8_t i = 0; i < relays.count(); i++) {
+         char *list = (target >> i) & 1 ? on : off;
+         snprintf(list + strlen(list), 64 - strlen(list), "%s%u", list[0] ? "," : "", i);
+      }
+      snprintf(payload, sizeof(payload), "{\"command\":\"set_channels\",\"requestId\":\"scene-%d\",\"on\":[%s],\"off\":[%s]}",
+               run, on, off);
+      broker.injectPublish(command_topic, payload);
+      meter.start();
+      loop();
+      sample = meter.stop();
+   } else {
+      uint64_t arrival = host::nowMicros() + 1000;
+      for (uint8_t i = 0; i < relays.count(); i++) {
+         snprintf(payload, sizeof(payload), "{\"command\":\"%s\",\"requestId\":\"scene-%d-%u\",\"channel\":%u}",
+                  (target >> i) & 1 ? "turn_on" : "turn_off", run, i, i);
+         broker.injectPublishAt(arrival + i * MESSAGE_SPACING_US, command_topic, payload);
+      }
+      // Until every command has been answered
+      for (int i = 0; i < MAX_LOOPS_PER_SCENE && broker.publishedTo(response_topic) - responsesBefore < relays.count(); i++) {
+         meter.start();
+         loop();
+         BenchSample step = meter.stop();
+         sample.cycles += step.cycles;
+         sample.allocations += step.allocations;
+         sample.bytes += step.bytes;
+      }
+   }
+
+   if (!pinsMatch(target) || relays.state() != target) {
+      totals.failures++;
+      return;
+   }
+   if (run < WARMUP_RUNS) return;
+
+   uint64_t skew = changeSkew(startMicros);
+   totals.series.add(sample);
+   totals.registerWrites += host::gpioRegisterWrites() - writesBefore;
+   totals.publishes += broker.stats().publishesIn - publishesBefore;
+   totals.bytes += broker.stats().bytesIn - bytesBefore;
+   totals.commits += host::eepromCommits() - commitsBefore;
+   totals.skewMicros += skew;
+   if (skew > totals.maxSkewMicros) totals.maxSkewMicros = skew;
+   totals.runs++;
+}
+
+void printTotals(const char *label, SceneTotals &totals) {
+   benchPrintSeries(label, totals.series);
+   double runs = totals.runs ? totals.runs : 1;
+   benchOut.printf("%-24s %8s GPIO writes/scene %.1f, publishes/scene %.1f, bytes/scene %.0f, EEPROM commits/scene %.1f\n",
+                   "", "", totals.registerWrites / runs, totals.publishes / runs, totals.bytes / runs,
+                   totals.commits / runs);
+   benchOut.printf("%-24s %8s relay skew mean %.0f us, max %llu us\n", "", "",
+                   totals.skewMicros / runs, (unsigned long long)totals.maxSkewMicros);
+}
+
+// A rejected set_channels must answer with an error and leave the pins alone
+int runRejected(const char *label, const char *arguments) {
+   MockBroker &broker = benchBroker();
+   uint32_t before = relays.state();
+   uint32_t writesBefore = host::gpioRegisterWrites();
+   char payload[160];
+   snprintf(payload, sizeof(payload), "{\"command\":\"set_channels\",\"requestId\":\"reject\",%s}", arguments);
+   broker.injectPublish(command_topic, payload);
+   loop();
+
+   const MockBroker::Message *reply = broker.lastPublished(response_topic);
+   bool rejected = reply != NULL && memmem(reply->payload, reply->length, "\"success\":false", 15) != NULL;
+   bool untouched = relays.state() == before && host::gpioRegisterWrites() == writesBefore && pinsMatch(before);
+   benchOut.printf("%-24s %s\n", label, rejected && untouched ? "rejected, pins untouched" : "");
+   if (!rejected || !untouched) {
+      benchOut.printf("FAIL: set_channels with %s was %s\n", arguments, rejected ? "applied" : "not rejected");
+      return 1;
+   }
+   return 0;
+}
+
+} // namespace
+
+int benchRelays() {
+   benchPrintHeader("relays: switching all channels per scene");
+   if (!benchBootFirmware()) return 1;
+   if (relays.count() < 2) {
+      benchOut.printf("FAIL: firmware built with %u relay channel(s); set RELAY_PINS\n", relays.count());
+      return 1;
+   }
+   benchOut.printf("%u channels, state bitmask 0x%04lx\n", relays.count(), (unsigned long)relays.state());
+
+   static SceneTotals sequential;
+   static SceneTotals batched;
+   for (int run = 0; run < WARMUP_RUNS + SCENE_RUNS; run++) {
+      runScene(sequential, run, false);
+   }
+   for (int run = 0; run < WARMUP_RUNS + SCENE_RUNS; run++) {
+      runScene(batched, run, true);
+   }
+
+   benchPrintSeriesHeader("scene");
+   printTotals("per-channel commands", sequential);
+   printTotals("set_channels", batched);
+
+   int failures = sequential.failures + batched.failures;
+   if (failures) {
+      benchOut.printf("FAIL: relays did not reach the scene in %d runs\n", failures);
+   }
+   if (batched.maxSkewMicros != 0) {
+      benchOut.printf("FAIL: set_channels switched relays %llu us apart\n", (unsigned long long)batched.maxSkewMicros);
+      failures++;
+   }
+   if (batched.runs && batched.registerWrites > 2ULL * batched.runs) {
+      benchOut.printf("FAIL: set_channels used more than 2 GPIO register writes per scene\n");
+      failures++;
+   }
+
+   char outOfRange[32];
+   snprintf(outOfRange, sizeof(outOfRange), "\"on\":[0,%u]", relays.count());
+   failures += runRejected("out-of-range channel", outOfRange);
+   failures += runRejected("channel in on and off", "\"on\":[0,1],\"off\":[1]");
+   failures += runRejected("non-integer channel", "\"on\":[\"x\"]");
+   return failures;
+}
@@ -0,0 +1,270 @@
+/*
+ bench_router.cpp - inbound topic -> handler as subscriptions grow.
+
+ The TopicRouter from src/topic_router.h is loaded with the first 4, 16 and
+ 32 filters of a realistic subscription list (device topics, `+` group
+ topics, `#` channels) and compared with matching the topic against each
+ filter in turn, which is what one callback() comparing topics does once
+ wildcards are involved. Topics cycle through one per filter plus two that
+ no filter takes; cycles are per topic, averaged over a batch of 1024.
+
+ Both matchers must agree on every topic, and a table of MQTT cases checks
+ the wildcard rules (`#` matching its parent level, `+` taking exactly one
+ level, wildcards not matching '$' topics) and that malformed filters are
+ refused. Per-route dispatch counts are printed for the 16-filter router.
+*/
+
+#include "bench.h"
+#include "topic_router.h"
+
+#include <string.h>
+
+namespace {
+
+const int BATCHES = 400;
+const int TOPICS_PER_BATCH = 1024;
+
+uint32_t handled = 0;
+
+void countCall(char *topic, byte *payload, unsigned int length) {
+   (void)topic;
+   (void)payload;
+   (void)length;
+   handled++;
+}
+
+struct Subscription {
+   const char *filter;
+   const char *topic;  // A topic only this filter (and the `#` ones) take
+};
+
+// Prefixes of this table are registered below
+const Subscription all[] = {
+   {"devices/esp32-light-controller/commands", "devices/esp32-light-controller/commands"},
+   {"devices/esp32-light-controller/batch", "devices/esp32-light-controller/batch"},
+   {"devices/all/commands", "devices/all/commands"},
+   {"rooms/living-room/+/commands", "rooms/living-room/lights/commands"},
+   {"devices/esp32-light-controller/config", "devices/esp32-light-controller/config"},
+   {"devices/esp32-light-controller/ota/#", "devices/esp32-light-controller/ota/chunk/17"},
+   {"rooms/+/lights", "rooms/kitchen/lights"},
+   {"rooms/+/scenes/+", "rooms/hallway/scenes/evening"},
+   {"groups/downstairs/commands", "groups/downstairs/commands"},
+   {"groups/lights/commands", "groups/lights/commands"},
+   {"groups/night/commands", "groups/night/commands"},
+   {"schedules/+/esp32-light-controller", "schedules/weekday/esp32-light-controller"},
+   {"firmware/esp32dev/latest", "firmware/esp32dev/latest"},
+   {"homeassistant/status", "homeassistant/status"},
+   {"sensors/+/motion", "sensors/porch/motion"},
+   {"sensors/+/lux", "sensors/garden/lux"},
+   {"alarms/#", "alarms/smoke/kitchen"},
+   {"presence/+/home", "presence/alex/home"},
+   {"weather/outdoor/temperature", "weather/outdoor/temperature"},
+   {"weather/outdoor/humidity", "weather/outdoor/humidity"},
+   {"energy/tariff/current", "energy/tariff/current"},
+   {"rooms/+/occupancy", "rooms/office/occupancy"},
+   {"rooms/bedroom/+/commands", "rooms/bedroom/blinds/commands"},
+   {"rooms/kitchen/+/commands", "rooms/kitchen/fan/commands"},
+   {"buttons/+/pressed", "buttons/wall-3/pressed"},
+   {"buttons/+/held", "buttons/wall-3/held"},
+   {"devices/esp32-light-controller/debug/+", "devices/esp32-light-controller/debug/level"},
+   {"calendar/holiday", "calendar/holiday"},
+   {"security/armed", "security/armed"},
+   {"doors/front/state", "doors/front/state"},
+   {"doors/garage/state", "doors/garage/state"},
+   {"irrigation/+/running", "irrigation/lawn/running"},
+};
+const size_t ALL_COUNT = sizeof(all) / sizeof(all[0]);
+
+const char *unmatched[] = {"devices/esp32-other/commands", "rooms/kitchen/lights/brightness"};
+
+// MQTT filter matching, one filter at a time
+bool filterMatches(const char *filter, const char *topic) {
+   if (topic[0] == '$' && (filter[0] == '+' || filter[0] == '#')) return false;
+   for (;;) {
+      if (filter[0] == '#' && filter[1] == '\0') return true;
+      if (filter[0] == '+' && (filter[1] == '/' || filter[1] == '\0')) {
+         while (*topic != '\0' && *topic != '/') topic++;
+         filter++;
+      } else {
+         while (*filter != '\0' && *filter != '/' && *filter == *topic) {
+            filter++;
+            topic++;
+         }
+         if ((*filter != '\0' && *filter != '/') || (*topic != '\0' && *topic != '/')) return false;
+      }
+      if (*filter == '\0' || *topic == '\0') {
+         // "a/#" also matches "a"
+         return *filter == *topic || (*topic == '\0' && strcmp(filter, "/#") == 0);
+      }
+      filter++;
+      topic++;
+   }
+}
+
+uint32_t linearMatch(size_t count, const char *topic) {
+   uint32_t matched = 0;
+   for (size_t i = 0; i < count; i++) {
+      if (filterMatches(all[i].filter, topic)) matched |= 1UL << i;
+   }
+   return matched;
+}
+
+const char *topicAt(size_t count, int i) {
+   size_t index = i % (count + 2);
+   return index < count ? all[index].topic : unmatched[index - count];
+}
+
+int measure(const char *label, size_t count, TopicRouter *router) {
+   BenchSeries series;
+   uint32_t routed = 0;
+   for (int batch = 0; batch < BATCHES; batch++) {
+      BenchMeter meter;
+      meter.start();
+      for (int i = 0; i < TOPICS_PER_BATCH; i++) {
+         uint32_t matched = router != NULL ? router->match(topicAt(count, i)) : linearMatch(count, topicAt(count, i));
+         routed += matched != 0;
+      }
+      BenchSample sample = meter.stop();
+      sample.cycles /= TOPICS_PER_BATCH;
+      series.add(sample);
+   }
+   benchPrintSeries(label, series);
+   // Every topic but the two unmatched ones has a route
+   uint32_t expected = 0;
+   for (int i = 0; i < TOPICS_PER_BATCH; i++) {
+      expected += i % (count + 2) < count;
+   }
+   if (routed != expected * BATCHES) {
+      benchOut.printf("FAIL: %s routed %u of %u topics\n", label, (unsigned)routed, (unsigned)(expected * BATCHES));
+      return 1;
+   }
+   return 0;
+}
+
+bool load(TopicRouter &router, size_t count) {
+   for (size_t i = 0; i < count; i++) {
+      if (router.add(all[i].filter, countCall, all[i].filter) != (int8_t)i) return false;
+   }
+   return true;
+}
+
+// Both matchers give the same routes for every topic of the table
+int compare(TopicRouter &router, size_t count) {
+   int failures = 0;
+   for (size_t i = 0; i < count + 2; i++) {
+      const char *topic = topicAt(count, i);
+      uint32_t expected = linearMatch(count, topic);
+      uint32_t matched = router.match(topic);
+      if (matched != expected) {
+         benchOut.printf("FAIL: %s: router 0x%08x, filter by filter 0x%08x\n", topic, (unsigned)matched,
+                         (unsigned)expected);
+         failures++;
+      }
+   }
+   return failures;
+}
+
+struct Case {
+   const char *filter;
+   const char *topic;
+   bool matches;
+};
+
+const Case cases[] = {
+   {"a/b/c", "a/b/c", true},
+   {"a/b/c", "a/b", false},
+   {"a/b", "a/b/c", false},
+   {"a/+/c", "a/x/c", true},
+   {"a/+/c", "a/x/y/c", false},
+   {"a/+", "a/", true},
+   {"+/+", "/x", true},
+   {"+", "a/b", false},
+   {"a/#", "a", true},
+   {"a/#", "a/b/c/d", true},
+   {"a/#", "ab", false},
+   {"#", "a/b", true},
+   {"#", "$SYS/uptime", false},
+   {"+/uptime", "$SYS/uptime", false},
+   {"$SYS/#", "$SYS/uptime", true},
+   {"$SYS/+", "$SYS/uptime", true},
+   {"a//c", "a//c", true},
+   {"a/+/c", "a//c", true},
+};
+
+// One router per case, so no other filter can hide a wrong answer
+int checkRules() {
+   int failures = 0;
+   for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+      const Case &c = cases[i];
+      TopicRouter router;
+      bool added = router.add(c.filter, countCall, NULL) == 0;
+      bool matches = added && router.match(c.topic) != 0;
+      if (matches != c.matches || filterMatches(c.filter, c.topic) != c.matches) {
+         benchOut.printf("FAIL: \"%s\" %s \"%s\"\n", c.filter, c.matches ? "must match" : "must not match", c.topic);
+         failures++;
+      }
+   }
+   const char *malformed[] = {"", "a/#/b", "a/b#", "a+/b", "a/+b", "##"};
+   for (size_t i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++) {
+      TopicRouter router;
+      if (router.add(malformed[i], countCall, NULL) >= 0) {
+         benchOut.printf("FAIL: malformed filter \"%s\" accepted\n", malformed[i]);
+         failures++;
+      }
+   }
+   benchOut.printf("wildcard rules: %u cases, %u malformed filters refused\n",
+                   (unsigned)(sizeof(cases) / sizeof(cases[0])), (unsigned)(sizeof(malformed) / sizeof(malformed[0])));
+   return failures;
+}
+
+TopicRouter router4;
+TopicRouter router16;
+TopicRouter router32;
+
+} // namespace
+
+int benchRouter() {
+   benchPrintHeader("router: inbound topic -> per-filter handler");
+   int failures = checkRules();
+   if (!load(router4, 4) || !load(router16, 16) || !load(router32, ALL_COUNT)) {
+      benchOut.printf("FAIL: filters did not fit the router\n");
+      return failures + 1;
+   }
+   failures += compare(router4, 4) + compare(router16, 16) + compare(router32, ALL_COUNT);
+
+   benchPrintSeriesHeader("match");
+   failures += measure("filter by filter, 4", 4, NULL);
+   failures += measure("topic trie, 4", 4, &router4);
+   failures += measure("filter by filter, 16", 16, NULL);
+   failures += measure("topic trie, 16", 16, &router16);
+   failures += measure("filter by filter, 32", ALL_COUNT, NULL);
+   failures += measure("topic trie, 32", ALL_COUNT, &router32);
+   benchOut.printf("trie nodes visited per topic: %.1f / %.1f / %.1f (most %u / %u / %u)\n",
+                   (double)router4.stats().visits / (BATCHES * TOPICS_PER_BATCH),
+                   (double)router16.stats().visits / (BATCHES * TOPICS_PER_BATCH),
+                   (double)router32.stats().visits / (BATCHES * TOPICS_PER_BATCH),
+                   (unsigned)router4.stats().maxVisits, (unsigned)router16.stats().maxVisits,
+                   (unsigned)router32.stats().maxVisits);
+
+   // dispatch() with a payload, then the per-route counts
+   char topic[64];
+   byte payload[] = "{\"command\":\"turn_on\"}";
+   uint32_t before = handled;
+   uint32_t taken = 0;
+   for (int i = 0; i < 18 * 10; i++) {
+      strncpy(topic, topicAt(16, i), sizeof(topic) - 1);
+      topic[sizeof(topic) - 1] = '\0';
+      taken += router16.dispatch(topic, payload, sizeof(payload) - 1);
+   }
+   if (handled - before != taken || router16.stats().unmatched != 20) {
+      benchOut.printf("FAIL: %u handler calls for %u dispatches, %u unmatched\n", (unsigned)(handled - before),
+                      (unsigned)taken, (unsigned)router16.stats().unmatched);
+      failures++;
+   }
+   benchOut.printf("dispatches per route (16 filters, 180 messages, %u unmatched):\n",
+                   (unsigned)router16.stats().unmatched);
+   for (uint8_t route = 0; route < router16.count(); route++) {
+      benchOut.printf("  %-42s %4u\n", router16.name(route), (unsigned)router16.dispatches(route));
+   }
+   return failures;
+}
@@ -0,0 +1,135 @@
+/*
+ bench_sound.cpp - audio feedback without stalling the loop.
+
+ An unknown command (error sound) arrives, followed 20 ms later by a relay
+ command. The suite reports how long the MQTT task ran for the sound
+ command, how late the relay followed the second command, how many
+ microphone samples were lost to DMA overruns and how late the audio task
+ ran. It then replays the confirmation sound and compares the tone
+ changes seen on the amplifier pin with the requested sequence.
+*/
+
+#include "bench.h"
+#include "scheduler.h"
+
+#include <stdio.h>
+
+extern const char *command_topic;
+
+namespace {
+
+const uint8_t LIGHT_RELAY_PIN = 4;    // Matches LIGHT_RELAY_PIN in main.cpp
+const uint8_t AUDIO_OUTPUT_PIN = 19;  // Matches AUDIO_OUTPUT_PIN in main.cpp
+const int SOUND_RUNS = 50;
+const int MAX_LOOPS = 20000;
+const uint32_t SETTLE_MS = 1000;
+
+// playConfirmationSound(): frequency / duration pairs, 0 Hz = pause
+const uint32_t CONFIRMATION[][2] = {{800, 150}, {0, 50}, {1200, 150}};
+const int CONFIRMATION_STEPS = sizeof(CONFIRMATION) / sizeof(CONFIRMATION[0]);
+const uint32_t TOLERANCE_MS = 2;
+
+void runFor(uint32_t ms) {
+   uint64_t until = host::nowMicros() + (uint64_t)ms * 1000ULL;
+   for (int i = 0; i < MAX_LOOPS && host::nowMicros() < until; i++) {
+      loop();
+   }
+}
+
+// Compare the tone changes on the amplifier pin with CONFIRMATION
+int checkConfirmationTones() {
+   host::ToneEvent events[16];
+   host::ToneEvent tones[16];
+   size_t count = 0;
+   size_t total = host::toneEvents(events, 16);
+   for (size_t i = 0; i < total; i++) {
+      if (events[i].pin == AUDIO_OUTPUT_PIN) tones[count++] = events[i];
+   }
+   if (count != (size_t)CONFIRMATION_STEPS + 1) {
+      benchOut.printf("FAIL: %u tone changes on the amplifier pin, %d expected\n",
+                      (unsigned)count, CONFIRMATION_STEPS + 1);
+      return 1;
+   }
+
+   int failures = 0;
+   benchOut.printf("%-24s %10s %12s %12s\n", "confirmation sound", "Hz", "wanted ms", "played ms");
+   for (int i = 0; i < CONFIRMATION_STEPS; i++) {
+      uint32_t playedMs = (uint32_t)((tones[i + 1].atMicros - tones[i].atMicros + 500) / 1000);
+      uint32_t wantedMs = CONFIRMATION[i][1];
+      bool ok = tones[i].frequency == CONFIRMATION[i][0] &&
+                playedMs + TOLERANCE_MS >= wantedMs && playedMs <= wantedMs + TOLERANCE_MS;
+      benchOut.printf("%-24s %10u %12u %12u%s\n", "", (unsigned)tones[i].frequency,
+                      (unsigned)wantedMs, (unsigned)playedMs, ok ? "" : "  <- wrong");
+      failures += !ok;
+   }
+   if (tones[CONFIRMATION_STEPS].frequency != 0) {
+      benchOut.printf("FAIL: amplifier left playing %u Hz\n", (unsigned)tones[CONFIRMATION_STEPS].frequency);
+      failures++;
+   }
+   return failures;
+}
+
+} // namespace
+
+int benchSound() {
+   benchPrintHeader("sound: audio feedback while commands and audio keep running");
+   if (!benchBootFirmware()) return 1;
+
+   MockBroker &broker = benchBroker();
+   int8_t mqttTask = scheduler.findTask("mqtt");
+   int8_t audioTask = scheduler.findTask("audio");
+   runFor(SETTLE_MS);
+
+   BenchSeries soundTask;
+   BenchSeries relayLatency;
+   BenchSeries audioLate;
+   uint64_t overrunBefore = host::i2sOverrunSamples();
+   uint32_t callbacksBefore = host::timerCallbacks();
+   int failures = 0;
+   char payload[96];
+
+   for (int run = 0; run < SOUND_RUNS; run++) {
+      int expected = host::pinLevel(LIGHT_RELAY_PIN) == HIGH ? LOW : HIGH;
+      uint64_t arrival = host::nowMicros() + 1000;
+      snprintf(payload, sizeof(payload), "{\"command\":\"beep\",\"requestId\":\"snd-%d\"}", run);
+      broker.injectPublishAt(arrival, command_topic, payload);
+      snprintf(payload, sizeof(payload), "{\"command\":\"%s\",\"requestId\":\"rel-%d\"}",
+               expected == HIGH ? "turn_on" : "turn_off", run);
+      broker.injectPublishAt(arrival + 20000, command_topic, payload);
+
+      scheduler.resetStats();
+      for (int i = 0; i < MAX_LOOPS && host::pinLevel(LIGHT_RELAY_PIN) != expected; i++) {
+         loop();
+      }
+      if (host::pinLevel(LIGHT_RELAY_PIN) != expected) {
+         failures++;
+         continue;
+      }
+      BenchSample relay = {host::pinChangedAtMicros(LIGHT_RELAY_PIN) - (arrival + 20000), 0, 0};
+      relayLatency.add(relay);
+      // Let the sound finish before the next run
+      runFor(SETTLE_MS);
+      BenchSample task = {scheduler.taskStats(mqttTask).maxMicros, 0, 0};
+      BenchSample late = {scheduler.taskStats(audioTask).maxLatenessMicros, 0, 0};
+      soundTask.add(task);
+      audioLate.add(late);
+   }
+
+   benchPrintDistributionHeader("error sound + command", "us");
+   benchPrintDistribution("mqtt task run", soundTask);
+   benchPrintDistribution("relay, cmd 20 ms later", relayLatency);
+   benchPrintDistribution("audio task lateness", audioLate);
+   benchOut.printf("microphone samples lost %llu, timer callbacks per sound %.1f\n",
+                   (unsigned long long)(host::i2sOverrunSamples() - overrunBefore),
+                   (double)(host::timerCallbacks() - callbacksBefore) / SOUND_RUNS);
+   if (failures) {
+      benchOut.printf("FAIL: relay did not follow %d commands\n", failures);
+   }
+
+   // Sequence accuracy: replay the confirmation sound and read back the pin
+   host::clearToneEvents();
+   broker.injectPublish(command_topic, "{\"command\":\"enable_voice\",\"requestId\":\"snd-ok\"}");
+   runFor(SETTLE_MS);
+   failures += checkConfirmationTones();
+   return failures;
+}
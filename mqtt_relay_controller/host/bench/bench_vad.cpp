@@ -0,0 +1,233 @@
+/*
+ bench_vad.cpp - voice activity detection per captured frame.
+
+ detectVoiceActivity() used to sum squares one sample at a time, take a
+ float sqrt() per frame and re-average its 10 RMS values on every call. The
+ VoiceActivityDetector (src/voice_activity.h) compares energies squared in
+ integers and keeps a running sum of its history; its energy kernels are
+ checked here:
+
+ - bit-exact: every kernel built for this host against
+   frameEnergyReference() on silence, full scale of both signs, alternating
+   extremes, noise and speech-like frames, at odd lengths and offsets
+ - the detector gives the same decisions with every kernel over a 60 s
+   synthetic stream of background noise and speech bursts; how often the
+   old float detector agrees is reported, as it averaged RMS, not energy
+ - cycles per 1024-sample frame for the old detector, each kernel and the
+   new detector, averaged over batches of 16 frames
+*/
+
+#include "bench.h"
+#include "voice_activity.h"
+#include "audio_capture.h"
+
+#include <math.h>
+
+namespace {
+
+const uint16_t THRESHOLD = 2000;  // DETECTION_THRESHOLD in main.cpp
+const size_t FRAME = AudioFrame::SAMPLES;
+const int STREAM_FRAMES = 940;    // 60 s at 16 kHz
+const int BATCHES = 400;
+const int FRAMES_PER_BATCH = 16;
+
+struct Kernel {
+   const char *name;
+   uint64_t (*energy)(const int16_t *samples, size_t count);
+};
+
+Kernel kernels[5];
+size_t kernelCount = 0;
+
+void addKernels() {
+   kernelCount = 0;
+   kernels[kernelCount++] = {"unrolled", frameEnergyUnrolled};
+#if defined(__x86_64__)
+   kernels[kernelCount++] = {"sse2", frameEnergySse2};
+   if (frameEnergyAvx2Supported()) kernels[kernelCount++] = {"avx2", frameEnergyAvx2};
+#endif
+   kernels[kernelCount++] = {"frameEnergy()", frameEnergy};
+}
+
+uint32_t seed = 1;
+
+int16_t noise(int amplitude) {
+   seed = seed * 1664525u + 1013904223u;
+   return (int16_t)((int32_t)(seed >> 16) % (amplitude + 1) - amplitude / 2);
+}
+
+// Background noise, with a burst of voiced sound for about a second every
+// 4 s: harmonics of a 140 Hz pitch under a rising and falling envelope
+void fillStream(int16_t *frame, int index) {
+   int inBurst = index % 62;
+   for (size_t i = 0; i < FRAME; i++) {
+      double sample = noise(600);
+      if (inBurst < 16) {
+         double t = (double)(index * FRAME + i) / 16000.0;
+         double envelope = sin(M_PI * (inBurst * FRAME + i) / (16.0 * FRAME)) * (3000 + 1000 * (index / 62 % 5));
+         sample += envelope * (sin(2 * M_PI * 140 * t) + 0.5 * sin(2 * M_PI * 280 * t) + 0.3 * sin(2 * M_PI * 420 * t));
+      }
+      if (sample > 32767) sample = 32767;
+      if (sample < -32768) sample = -32768;
+      frame[i] = (int16_t)sample;
+   }
+}
+
+// What detectVoiceActivity() did before
+struct FloatDetector {
+   float history[VoiceActivityDetector::HISTORY];
+   int index;
+
+   FloatDetector() : history(), index(0) {}
+
+   bool process(const int16_t *audio, int samples) {
+      long sum = 0;
+      for (int i = 0; i < samples; i++) {
+         sum += (long)audio[i] * audio[i];
+      }
+      float rms = sqrt((float)sum / samples);
+      history[index] = rms;
+      index = (index + 1) % VoiceActivityDetector::HISTORY;
+      float average = 0;
+      for (int i = 0; i < VoiceActivityDetector::HISTORY; i++) {
+         average += history[i];
+      }
+      average /= VoiceActivityDetector::HISTORY;
+      return (rms > THRESHOLD) && (rms > average * 1.5);
+   }
+};
+
+alignas(32) int16_t pattern[FRAME + 16];
+
+int checkExact() {
+   const char *names[] = {"silence", "+32767", "-32768", "alternating", "noise", "speech"};
+   const size_t lengths[] = {0, 1, 7, 15, 17, 255, 256, 257, 1023, FRAME};
+   int failures = 0;
+   int checks = 0;
+   for (int kind = 0; kind < 6; kind++) {
+      for (size_t i = 0; i < FRAME + 16; i++) {
+         switch (kind) {
+         case 0: pattern[i] = 0; break;
+         case 1: pattern[i] = 32767; break;
+         case 2: pattern[i] = -32768; break;
+         case 3: pattern[i] = i & 1 ? 32767 : -32768; break;
+         case 4: pattern[i] = noise(65535); break;
+         }
+      }
+      if (kind == 5) {
+         fillStream(pattern, 0);
+         fillStream(pattern + 8, 3);
+      }
+      for (size_t offset = 0; offset < 4; offset++) {
+         for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+            uint64_t expected = frameEnergyReference(pattern + offset, lengths[l]);
+            for (size_t k = 0; k < kernelCount; k++) {
+               uint64_t energy = kernels[k].energy(pattern + offset, lengths[l]);
+               checks++;
+               if (energy != expected) {
+                  benchOut.printf("FAIL: %s, %s, %u samples at +%u: %llu, expected %llu\n", kernels[k].name,
+                                  names[kind], (unsigned)lengths[l], (unsigned)offset, (unsigned long long)energy,
+                                  (unsigned long long)expected);
+                  failures++;
+               }
+            }
+         }
+      }
+   }
+   // The largest frame: 1024 x (-32768)^2 = 2^40
+   for (size_t i = 0; i < FRAME; i++) pattern[i] = -32768;
+   if (frameEnergy(pattern, FRAME) != (1ULL << 40)) {
+      benchOut.printf("FAIL: full-scale frame energy %llu\n", (unsigned long long)frameEnergy(pattern, FRAME));
+      failures++;
+   }
+   benchOut.printf("bit-exact: %d of %d kernel results match the reference\n", checks - failures, checks);
+   return failures;
+}
+
+int16_t stream[STREAM_FRAMES][FRAME];
+
+int checkDecisions() {
+   seed = 7;
+   for (int i = 0; i < STREAM_FRAMES; i++) fillStream(stream[i], i);
+
+   static bool reference[STREAM_FRAMES];
+   VoiceActivityDetector detector(THRESHOLD);
+   int voiced = 0;
+   for (int i = 0; i < STREAM_FRAMES; i++) {
+      reference[i] = detector.update(frameEnergyReference(stream[i], FRAME), FRAME);
+      voiced += reference[i];
+   }
+
+   int failures = 0;
+   for (size_t k = 0; k < kernelCount; k++) {
+      VoiceActivityDetector other(THRESHOLD);
+      int differ = 0;
+      for (int i = 0; i < STREAM_FRAMES; i++) {
+         differ += other.update(kernels[k].energy(stream[i], FRAME), FRAME) != reference[i];
+      }
+      if (differ) {
+         benchOut.printf("FAIL: %s: %d decisions differ from the reference kernel\n", kernels[k].name, differ);
+         failures++;
+      }
+   }
+
+   FloatDetector old;
+   int agree = 0;
+   int oldVoiced = 0;
+   for (int i = 0; i < STREAM_FRAMES; i++) {
+      bool decision = old.process(stream[i], FRAME);
+      oldVoiced += decision;
+      agree += decision == reference[i];
+   }
+   benchOut.printf("decisions over %d frames: %d voice (float detector %d), same as the float detector on %d\n",
+                   STREAM_FRAMES, voiced, oldVoiced, agree);
+   if (voiced == 0) {
+      benchOut.printf("FAIL: no voice detected in the speech bursts\n");
+      failures++;
+   }
+   return failures;
+}
+
+volatile uint64_t sink;
+
+template <typename Run>
+void measure(const char *label, Run run) {
+   BenchSeries series;
+   for (int batch = 0; batch < BATCHES; batch++) {
+      BenchMeter meter;
+      meter.start();
+      for (int i = 0; i < FRAMES_PER_BATCH; i++) {
+         sink = sink + run(stream[(batch * FRAMES_PER_BATCH + i) % STREAM_FRAMES]);
+      }
+      BenchSample sample = meter.stop();
+      sample.cycles /= FRAMES_PER_BATCH;
+      series.add(sample);
+   }
+   benchPrintSeries(label, series);
+}
+
+void measureAll() {
+   benchPrintSeriesHeader("1024-sample frame");
+   FloatDetector old;
+   measure("float detector (old)", [&](const int16_t *frame) { return (uint64_t)old.process(frame, FRAME); });
+   measure("reference energy", [](const int16_t *frame) { return frameEnergyReference(frame, FRAME); });
+   for (size_t k = 0; k < kernelCount; k++) {
+      char label[32];
+      snprintf(label, sizeof(label), "%s energy", kernels[k].name);
+      measure(label, [&](const int16_t *frame) { return kernels[k].energy(frame, FRAME); });
+   }
+   VoiceActivityDetector detector(THRESHOLD);
+   measure("detector (new)", [&](const int16_t *frame) { return (uint64_t)detector.process(frame, FRAME); });
+   benchOut.printf("frameEnergy() uses %s\n", frameEnergyKernel());
+}
+
+} // namespace
+
+int benchVad() {
+   benchPrintHeader("vad: voice activity detection per frame");
+   addKernels();
+   int failures = checkExact();
+   failures += checkDecisions();
+   measureAll();
+   return failures;
+}
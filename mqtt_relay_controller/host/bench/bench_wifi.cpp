@@ -0,0 +1,149 @@
+/*
+ bench_wifi.cpp - WiFi supervision.
+
+ The access point disappears for 1-5 s of firmware time and comes back; the
+ suite measures AP back -> IP address and AP back -> MQTT session, checks
+ that the loop kept running during the outage, and prints the
+ time-to-associate / time-to-IP histograms the firmware reports in its
+ heartbeat. Outages this short must be ridden out on the cached
+ BSSID/channel: the suite fails if AP back -> IP reaches a second at p99 or
+ if more than MAX_SCANS full scans were started. A final run moves the AP to
+ another channel so the cached BSSID/channel goes stale and the supervisor
+ has to fall back to a scan after PROBES_BEFORE_SCAN directed probes.
+*/
+
+#include "bench.h"
+#include "mqtt_connection.h"
+#include "scheduler.h"
+#include "wifi_supervisor.h"
+
+extern MqttConnection mqttConnection;
+
+namespace {
+
+// Representative ESP32 timings: all-channel scan + association, directed
+// association to a known BSSID/channel, DHCP lease
+const uint32_t SCAN_MS = 2500;
+const uint32_t FAST_MS = 120;
+const uint32_t DHCP_MS = 400;
+const int OUTAGE_RUNS = 100;
+const uint64_t MAX_IP_P99_MS = 1000;
+const uint32_t MAX_SCANS = 2;
+const int MAX_LOOPS = 200000;
+
+bool runUntil(bool (*done)()) {
+   for (int i = 0; i < MAX_LOOPS && !done(); i++) {
+      loop();
+   }
+   return done();
+}
+
+bool wifiUp() {
+   return wifiSupervisor.connected();
+}
+
+bool mqttUp() {
+   return mqttConnection.state() == MQTT_STATE_CONNECTED;
+}
+
+void printHistogram(const char *label, const DurationHistogram &histogram) {
+   static const char *buckets[DurationHistogram::BUCKETS] = {
+      "<100", "<250", "<500", "<1k", "<2k", "<5k", "<10k", ">=10k"};
+   benchOut.printf("%-24s", label);
+   for (uint8_t i = 0; i < DurationHistogram::BUCKETS; i++) {
+      benchOut.printf(" %s:%u", buckets[i], histogram.counts[i]);
+   }
+   benchOut.printf("  max %u ms\n", (unsigned)histogram.maxMs);
+}
+
+// Drop the AP for `outageMs`, then measure recovery; returns false on timeout
+bool runOutage(uint32_t outageMs, BenchSeries &toIp, BenchSeries &toMqtt) {
+   host::setWiFiAvailable(false);
+   uint64_t until = host::nowMicros() + (uint64_t)outageMs * 1000ULL;
+   for (int i = 0; i < MAX_LOOPS && host::nowMicros() < until; i++) {
+      loop();
+   }
+   host::setWiFiAvailable(true);
+   uint64_t back = host::nowMicros();
+   if (!runUntil(wifiUp)) return false;
+   BenchSample ip = {(host::nowMicros() - back) / 1000, 0, 0};
+   if (!runUntil(mqttUp)) return false;
+   BenchSample session = {(host::nowMicros() - back) / 1000, 0, 0};
+   toIp.add(ip);
+   toMqtt.add(session);
+   return true;
+}
+
+} // namespace
+
+int benchWiFi() {
+   benchPrintHeader("wifi: outage recovery with cached BSSID/channel");
+   if (!benchBootFirmware()) return 1;
+
+   host::setWiFiConnectDelay(SCAN_MS);
+   host::setWiFiFastConnectDelay(FAST_MS);
+   host::setWiFiDhcpDelay(DHCP_MS);
+
+   int8_t audioTask = scheduler.findTask("audio");
+   scheduler.resetStats();
+   uint64_t start = host::nowMicros();
+   uint32_t scansBefore = host::wifiBeginCount() - host::wifiFastBeginCount();
+   uint32_t nvsBefore = host::nvsWrites();
+
+   BenchSeries toIp;
+   BenchSeries toMqtt;
+   int failures = 0;
+   for (int run = 0; run < OUTAGE_RUNS; run++) {
+      uint32_t outageMs = 1000 + (uint32_t)(run * 7919) % 4000;
+      if (!runOutage(outageMs, toIp, toMqtt)) {
+         benchOut.printf("FAIL: no recovery after outage %d\n", run);
+         failures++;
+         break;
+      }
+   }
+   uint64_t elapsedMs = (host::nowMicros() - start) / 1000;
+   uint32_t scans = host::wifiBeginCount() - host::wifiFastBeginCount() - scansBefore;
+
+   benchPrintDistributionHeader("AP back ->", "ms");
+   benchPrintDistribution("IP address", toIp);
+   benchPrintDistribution("MQTT session", toMqtt);
+   benchOut.printf("audio task ran %u times in %llu ms (at least %llu), full scans %u, NVS writes %u\n",
+                   (unsigned)scheduler.taskStats(audioTask).runs,
+                   (unsigned long long)elapsedMs,
+                   (unsigned long long)(elapsedMs / 50),
+                   (unsigned)scans,
+                   (unsigned)(host::nvsWrites() - nvsBefore));
+   if (toIp.percentile(0.99) >= MAX_IP_P99_MS) {
+      benchOut.printf("FAIL: AP back -> IP p99 %llu ms (limit %llu)\n",
+                      (unsigned long long)toIp.percentile(0.99), (unsigned long long)MAX_IP_P99_MS);
+      failures++;
+   }
+   if (scans > MAX_SCANS) {
+      benchOut.printf("FAIL: %u full scans for %d brief outages (limit %u)\n",
+                      (unsigned)scans, OUTAGE_RUNS, (unsigned)MAX_SCANS);
+      failures++;
+   }
+
+   // AP moved: the cached channel is stale, the directed probes find nothing,
+   // then a scan
+   host::setWiFiChannel(11);
+   BenchSeries movedIp;
+   BenchSeries movedMqtt;
+   if (!runOutage(1000, movedIp, movedMqtt)) {
+      benchOut.printf("FAIL: no recovery after the AP changed channel\n");
+      failures++;
+   } else {
+      benchPrintDistribution("IP (AP moved)", movedIp);
+   }
+   host::setWiFiChannel(6);
+   runOutage(1000, movedIp, movedMqtt);
+
+   const WiFiSupervisorStats &stats = wifiSupervisor.stats();
+   printHistogram("associate (firmware)", stats.associate);
+   printHistogram("IP (firmware)", stats.gotIp);
+
+   host::setWiFiConnectDelay(300);
+   host::setWiFiFastConnectDelay(60);
+   host::setWiFiDhcpDelay(0);
+   return failures;
+}
@@ -0,0 +1,641 @@
+/*
+ mock_broker.cpp - in-process MQTT 3.1.1 / 5 broker stand-in for host benchmarks.
+*/
+
+#include "mock_broker.h"
+
+#include <string.h>
+
+namespace {
+
+size_t encodeLength(uint8_t *dst, size_t length) {
+   size_t pos = 0;
+   do {
+      uint8_t digit = length & 0x7F;
+      length >>= 7;
+      if (length > 0) digit |= 0x80;
+      dst[pos++] = digit;
+   } while (length > 0);
+   return pos;
+}
+
+size_t decodeLength(const uint8_t *src, size_t available, size_t &length) {
+   length = 0;
+   size_t multiplier = 1;
+   for (size_t pos = 0; pos < available && pos < 4; pos++) {
+      length += (src[pos] & 0x7F) * multiplier;
+      multiplier <<= 7;
+      if ((src[pos] & 0x80) == 0) return pos + 1;
+   }
+   return 0;
+}
+
+void copyString(char *dst, size_t size, const uint8_t *src, size_t length) {
+   size_t n = length < size - 1 ? length : size - 1;
+   memcpy(dst, src, n);
+   dst[n] = 0;
+}
+
+} // namespace
+
+MockBroker::MockBroker()
+    : connected(false), acceptConnections(true), autoConnack(true), connackDelay(0), connackAt(0),
+      autoPuback(true), publishHook(NULL), protocolLevel(4), topicAliasMaximum(10), receiveMaximum(0), sessionAliasMaximum(0), readChunk(0), toClientHead(0), toClientTail(0), fromClientLength(0), subscriptionCount(0), logCount(0),
+      delayedHead(0), delayedCount(0) {
+   memset(counterTopics, 0, sizeof(counterTopics));
+   memset(counterValues, 0, sizeof(counterValues));
+   memset(aliases, 0, sizeof(aliases));
+   resetStats();
+}
+
+bool MockBroker::open(const char *host, uint16_t port) {
+   (void)host;
+   (void)port;
+   if (!acceptConnections) return false;
+   connected = true;
+   toClientHead = toClientTail = 0;
+   fromClientLength = 0;
+   subscriptionCount = 0;
+   delayedHead = delayedCount = 0;
+   connackAt = 0;
+   protocolLevel = 4;
+   sessionAliasMaximum = 0;
+   memset(aliases, 0, sizeof(aliases));
+   return true;
+}
+
+void MockBroker::close() {
+   connected = false;
+   toClientHead = toClientTail = 0;
+   fromClientLength = 0;
+   delayedHead = delayedCount = 0;
+   connackAt = 0;
+}
+
+bool MockBroker::isOpen() {
+   return connected;
+}
+
+void MockBroker::dropConnection() {
+   close();
+}
+
+int MockBroker::available() {
+   if (!connected) return 0;
+   releaseDelayed();
+   size_t pending = toClientTail - toClientHead;
+   if (readChunk > 0 && pending > readChunk) return (int)readChunk;
+   return (int)pending;
+}
+
+int MockBroker::read(uint8_t *buf, size_t size) {
+   releaseDelayed();
+   size_t pending = toClientTail - toClientHead;
+   if (!connected || pending == 0) return -1;
+   if (readChunk > 0 && pending > readChunk) pending = readChunk;
+   size_t n = size < pending ? size : pending;
+   memcpy(buf, toClient + toClientHead, n);
+   toClientHead += n;
+   if (toClientHead == toClientTail) {
+      toClientHead = toClientTail = 0;
+   }
+   return (int)n;
+}
+
+size_t MockBroker::write(const uint8_t *buf, size_t size) {
+   if (!connected) return 0;
+   counters.writeCalls++;
+   counters.bytesIn += size;
+   if (fromClientLength + size > BUFFER_SIZE) {
+      counters.malformed++;
+      fromClientLength = 0;
+      return size;
+   }
+   memcpy(fromClient + fromClientLength, buf, size);
+   fromClientLength += size;
+   parse();
+   return size;
+}
+
+bool MockBroker::queue(const uint8_t *data, size_t length) {
+   if (toClientTail + length > BUFFER_SIZE) {
+      if (toClientHead > 0) {
+         memmove(toClient, toClient + toClientHead, toClientTail - toClientHead);
+         toClientTail -= toClientHead;
+         toClientHead = 0;
+      }
+      if (toClientTail + length > BUFFER_SIZE) return false;
+   }
+   memcpy(toClient + toClientTail, data, length);
+   toClientTail += length;
+   counters.bytesOut += length;
+   return true;
+}
+
+uint64_t MockBroker::nextArrivalMicros() {
+   releaseDelayed();
+   uint64_t next = delayedCount > 0 ? delayed[delayedHead].atMicros : UINT64_MAX;
+   return connackAt != 0 && connackAt < next ? connackAt : next;
+}
+
+// Move scripted packets whose arrival time has come into the receive stream
+void MockBroker::releaseDelayed() {
+   uint64_t now = host::nowMicros();
+   if (connackAt != 0 && connackAt <= now) {
+      connackAt = 0;
+      sendConnack(0);
+   }
+   while (delayedCount > 0 && delayed[delayedHead].atMicros <= now) {
+      DelayedPacket &packet = delayed[delayedHead];
+      if (!queue(packet.data, packet.length)) break;
+      counters.publishesOut++;
+      delayedHead = (delayedHead + 1) % DELAYED_PACKETS;
+      delayedCount--;
+   }
+}
+
+bool MockBroker::injectPublishAt(uint64_t atMicros, const char *topic, const char *payload) {
+   if (!connected || delayedCount == DELAYED_PACKETS) return false;
+   size_t topicLength = strlen(topic);
+   size_t payloadLength = strlen(payload);
+   size_t propertiesLength = protocolLevel == 5 ? 1 : 0;
+   size_t remaining = 2 + topicLength + propertiesLength + payloadLength;
+   DelayedPacket &packet = delayed[(delayedHead + delayedCount) % DELAYED_PACKETS];
+   uint8_t header[8];
+   header[0] = 0x30;
+   size_t headerLength = 1 + encodeLength(header + 1, remaining);
+   if (headerLength + remaining > DELAYED_SIZE) return false;
+   uint8_t *dst = packet.data;
+   memcpy(dst, header, headerLength);
+   dst += headerLength;
+   *dst++ = (uint8_t)(topicLength >> 8);
+   *dst++ = (uint8_t)(topicLength & 0xFF);
+   memcpy(dst, topic, topicLength);
+   dst += topicLength;
+   if (propertiesLength) *dst++ = 0;
+   memcpy(dst, payload, payloadLength);
+   packet.length = headerLength + remaining;
+   packet.atMicros = atMicros;
+   delayedCount++;
+   return true;
+}
+
+bool MockBroker::injectRaw(const uint8_t *data, size_t length) {
+   if (!connected) return false;
+   return queue(data, length);
+}
+
+void MockBroker::sendConnack(uint8_t returnCode) {
+   if (protocolLevel != 5) {
+      uint8_t connack[4] = {0x20, 0x02, 0x00, returnCode};
+      queue(connack, sizeof(connack));
+      return;
+   }
+   uint8_t connack[11] = {0x20, 0x03, 0x00, returnCode, 0x00};
+   size_t length = 5;
+   sessionAliasMaximum = topicAliasMaximum;
+   if (topicAliasMaximum > 0) {
+      connack[length++] = 0x22;
+      connack[length++] = (uint8_t)(topicAliasMaximum >> 8);
+      connack[length++] = (uint8_t)(topicAliasMaximum & 0xFF);
+   }
+   if (receiveMaximum > 0) {
+      connack[length++] = 0x21;
+      connack[length++] = (uint8_t)(receiveMaximum >> 8);
+      connack[length++] = (uint8_t)(receiveMaximum & 0xFF);
+   }
+   connack[1] = (uint8_t)(length - 2);
+   connack[4] = (uint8_t)(length - 5);
+   queue(connack, length);
+}
+
+bool MockBroker::injectPublish(const char *topic, const char *payload) {
+   return injectPublish(topic, (const uint8_t *)payload, strlen(payload));
+}
+
+bool MockBroker::injectPublish(const char *topic, const uint8_t *payload, size_t length, uint8_t qos, uint16_t packetId,
+                               const Properties *properties) {
+   if (!connected) return false;
+   size_t topicLength = strlen(topic);
+   uint8_t props[4 + 3 + TOPIC_SIZE + 3 + CORRELATION_SIZE];
+   size_t propsLength = 0;
+   if (protocolLevel == 5 && properties) {
+      uint8_t *dst = props + 4;
+      if (properties->responseTopic) {
+         size_t n = strlen(properties->responseTopic);
+         if (n > TOPIC_SIZE) return false;
+         *dst++ = 0x08;
+         *dst++ = (uint8_t)(n >> 8);
+         *dst++ = (uint8_t)(n & 0xFF);
+         memcpy(dst, properties->responseTopic, n);
+         dst += n;
+      }
+      if (properties->correlationData) {
+         if (properties->correlationLength > CORRELATION_SIZE) return false;
+         *dst++ = 0x09;
+         *dst++ = (uint8_t)(properties->correlationLength >> 8);
+         *dst++ = (uint8_t)(properties->correlationLength & 0xFF);
+         memcpy(dst, properties->correlationData, properties->correlationLength);
+         dst += properties->correlationLength;
+      }
+      propsLength = dst - (props + 4);
+   }
+   uint8_t propsHeader[4];
+   size_t propsHeaderLength = protocolLevel == 5 ? encodeLength(propsHeader, propsLength) : 0;
+   size_t remaining = 2 + topicLength + (qos > 0 ? 2 : 0) + propsHeaderLength + propsLength + length;
+   uint8_t header[8];
+   header[0] = 0x30 | (qos << 1);
+   size_t headerLength = 1 + encodeLength(header + 1, remaining);
+   if (toClientTail - toClientHead + headerLength + remaining > BUFFER_SIZE) return false;
+   queue(header, headerLength);
+   uint8_t topicHeader[2] = {(uint8_t)(topicLength >> 8), (uint8_t)(topicLength & 0xFF)};
+   queue(topicHeader, 2);
+   queue((const uint8_t *)topic, topicLength);
+   if (qos > 0) {
+      uint8_t id[2] = {(uint8_t)(packetId >> 8), (uint8_t)(packetId & 0xFF)};
+      queue(id, 2);
+   }
+   queue(propsHeader, propsHeaderLength);
+   queue(props + 4, propsLength);
+   queue(payload, length);
+   counters.publishesOut++;
+   return true;
+}
+
+void MockBroker::parse() {
+   size_t offset = 0;
+   while (fromClientLength - offset >= 2) {
+      const uint8_t *packet = fromClient + offset;
+      size_t available = fromClientLength - offset;
+      size_t remaining = 0;
+      size_t multiplier = 1;
+      size_t pos = 1;
+      bool complete = false;
+      while (pos < available && pos <= 4) {
+         uint8_t digit = packet[pos++];
+         remaining += (digit & 0x7F) * multiplier;
+         multiplier <<= 7;
+         if ((digit & 0x80) == 0) {
+            complete = true;
+            break;
+         }
+      }
+      if (!complete) {
+         if (pos > 4) {
+            counters.malformed++;
+            fromClientLength = 0;
+            return;
+         }
+         break;
+      }
+      if (available < pos + remaining) break;
+      handlePacket(packet, pos, remaining);
+      offset += pos + remaining;
+   }
+   if (offset > 0) {
+      memmove(fromClient, fromClient + offset, fromClientLength - offset);
+      fromClientLength -= offset;
+   }
+}
+
+void MockBroker::handlePacket(const uint8_t *packet, size_t headerLength, size_t remaining) {
+   uint8_t type = packet[0] & 0xF0;
+   const uint8_t *body = packet + headerLength;
+   switch (type) {
+      case 0x10:  // CONNECT
+         handleConnect(body, remaining);
+         break;
+      case 0x30:  // PUBLISH
+         handlePublish(packet[0] & 0x0F, body, remaining);
+         break;
+      case 0x40:  // PUBACK
+         counters.pubacksIn++;
+         break;
+      case 0x80:  // SUBSCRIBE
+         handleSubscribe(body, remaining);
+         break;
+      case 0xC0: {  // PINGREQ
+         counters.pings++;
+         uint8_t pingresp[2] = {0xD0, 0x00};
+         queue(pingresp, sizeof(pingresp));
+         break;
+      }
+      case 0xE0:  // DISCONNECT
+         connected = false;
+         break;
+      default:
+         break;
+   }
+}
+
+void MockBroker::handleConnect(const uint8_t *body, size_t length) {
+   // Protocol name "MQTT" (or "MQIsdp"), then the level
+   if (length >= 7 && body[1] == 4) protocolLevel = body[6];
+   memset(aliases, 0, sizeof(aliases));
+   counters.connects++;
+   if (autoConnack && connackDelay > 0) {
+      connackAt = host::nowMicros() + connackDelay;
+   } else if (autoConnack) {
+      sendConnack(0);
+   }
+}
+
+void MockBroker::handleSubscribe(const uint8_t *body, size_t length) {
+   if (length < 5) {
+      counters.malformed++;
+      return;
+   }
+   uint16_t packetId = (body[0] << 8) | body[1];
+   size_t pos = 2;
+   if (protocolLevel == 5) {
+      size_t propertiesLength;
+      size_t n = decodeLength(body + pos, length - pos, propertiesLength);
+      if (n == 0 || pos + n + propertiesLength > length) {
+         counters.malformed++;
+         return;
+      }
+      pos += n + propertiesLength;
+   }
+   uint8_t granted[8];
+   size_t grantedCount = 0;
+   while (pos + 2 <= length && grantedCount < sizeof(granted)) {
+      size_t topicLength = (body[pos] << 8) | body[pos + 1];
+      pos += 2;
+      if (pos + topicLength + 1 > length) break;
+      if (subscriptionCount < 8) {
+         copyString(subscriptions[subscriptionCount++], TOPIC_SIZE, body + pos, topicLength);
+      }
+      pos += topicLength;
+      uint8_t qos = body[pos++] & 0x03;
+      granted[grantedCount++] = qos > 1 ? 1 : qos;
+   }
+   counters.subscribes++;
+   uint8_t suback[5 + sizeof(granted)];
+   size_t header = protocolLevel == 5 ? 5 : 4;
+   suback[0] = 0x90;
+   suback[1] = header - 2 + grantedCount;
+   suback[2] = packetId >> 8;
+   suback[3] = packetId & 0xFF;
+   suback[4] = 0;  // MQTT 5: no properties
+   memcpy(suback + header, granted, grantedCount);
+   queue(suback, header + grantedCount);
+}
+
+void MockBroker::handlePublish(uint8_t flags, const uint8_t *body, size_t length) {
+   if (length < 2) {
+      counters.malformed++;
+      return;
+   }
+   size_t topicLength = (body[0] << 8) | body[1];
+   uint8_t qos = (flags >> 1) & 0x03;
+   size_t pos = 2 + topicLength;
+   uint16_t packetId = 0;
+   if (qos > 0) {
+      if (pos + 2 > length) {
+         counters.malformed++;
+         return;
+      }
+      packetId = (body[pos] << 8) | body[pos + 1];
+      pos += 2;
+   }
+   if (pos > length) {
+      counters.malformed++;
+      return;
+   }
+
+   Message &msg = log[logCount % LOG_SIZE];
+   msg.aliased = false;
+   msg.messageExpiry = 0;
+   msg.correlationLength = 0;
+   copyString(msg.topic, TOPIC_SIZE, body + 2, topicLength);
+   uint16_t alias = 0;
+   if (protocolLevel == 5 && !readProperties(body, pos, length, msg, alias)) {
+      counters.malformed++;
+      return;
+   }
+   if (alias > 0 && topicLength > 0) {
+      strcpy(aliases[alias - 1], msg.topic);
+   } else if (alias > 0) {
+      if (aliases[alias - 1][0] == 0) {
+         counters.malformed++;
+         return;
+      }
+      strcpy(msg.topic, aliases[alias - 1]);
+      msg.aliased = true;
+   } else if (topicLength == 0) {
+      counters.malformed++;
+      return;
+   }
+   logCount++;
+   msg.length = length - pos;
+   memcpy(msg.payload, body + pos, msg.length < PAYLOAD_SIZE ? msg.length : PAYLOAD_SIZE);
+   msg.qos = qos;
+   msg.packetId = packetId;
+   msg.dup = (flags & 0x08) != 0;
+   msg.atMicros = host::nowMicros();
+   counters.publishesIn++;
+   countTopic(msg.topic);
+   if (publishHook) publishHook(msg, body + pos);
+
+   if (qos == 1 && autoPuback) {
+      uint8_t puback[4] = {0x40, 0x02, (uint8_t)(packetId >> 8), (uint8_t)(packetId & 0xFF)};
+      queue(puback, sizeof(puback));
+   }
+}
+
+// MQTT 5 PUBLISH properties at body[pos]; pos moves past them. False if
+// they are malformed or use an alias beyond the Topic Alias Maximum
+bool MockBroker::readProperties(const uint8_t *body, size_t &pos, size_t length, Message &msg, uint16_t &alias) {
+   size_t propertiesLength;
+   size_t n = decodeLength(body + pos, length - pos, propertiesLength);
+   if (n == 0 || pos + n + propertiesLength > length) return false;
+   const uint8_t *p = body + pos + n;
+   const uint8_t *end = p + propertiesLength;
+   pos += n + propertiesLength;
+   while (p < end) {
+      uint8_t id = *p++;
+      switch (id) {
+         case 0x02:  // Message Expiry Interval
+            if (end - p < 4) return false;
+            msg.messageExpiry = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | (p[2] << 8) | p[3];
+            p += 4;
+            break;
+         case 0x08:    // Response Topic
+         case 0x09: {  // Correlation Data
+            if (end - p < 2) return false;
+            size_t size = (p[0] << 8) | p[1];
+            p += 2;
+            if ((size_t)(end - p) < size) return false;
+            if (id == 0x09) {
+               msg.correlationLength = size < CORRELATION_SIZE ? size : CORRELATION_SIZE;
+               memcpy(msg.correlation, p, msg.correlationLength);
+            }
+            p += size;
+            break;
+         }
+         case 0x23:  // Topic Alias
+            if (end - p < 2) return false;
+            alias = (p[0] << 8) | p[1];
+            p += 2;
+            if (alias == 0 || alias > sessionAliasMaximum || alias > TOPIC_ALIASES) return false;
+            break;
+         default:
+            return false;
+      }
+   }
+   return true;
+}
+
+void MockBroker::countTopic(const char *topic) {
+   for (size_t i = 0; i < TOPIC_COUNTERS; i++) {
+      if (counterTopics[i][0] == 0) {
+         strncpy(counterTopics[i], topic, TOPIC_SIZE - 1);
+         counterValues[i] = 1;
+         return;
+      }
+      if (strcmp(counterTopics[i], topic) == 0) {
+         counterValues[i]++;
+         return;
+      }
+   }
+}
+
+void MockBroker::resetStats() {
+   memset(&counters, 0, sizeof(counters));
+   memset(counterTopics, 0, sizeof(counterTopics));
+   memset(counterValues, 0, sizeof(counterValues));
+   logCount = 0;
+}
+
+bool MockBroker::subscribed(const char *filter) const {
+   for (size_t i = 0; i < subscriptionCount; i++) {
+      if (strcmp(subscriptions[i], filter) == 0) return true;
+   }
+   return false;
+}
+
+const MockBroker::Message *MockBroker::lastPublished(const char *topic) const {
+   size_t available = logCount < LOG_SIZE ? logCount : LOG_SIZE;
+   for (size_t i = 0; i < available; i++) {
+      const Message &msg = log[(logCount - 1 - i) % LOG_SIZE];
+      if (topic == NULL || strcmp(msg.topic, topic) == 0) return &msg;
+   }
+   return NULL;
+}
+
+uint32_t MockBroker::publishedTo(const char *topic) const {
+   for (size_t i = 0; i < TOPIC_COUNTERS; i++) {
+      if (strcmp(counterTopics[i], topic) == 0) return counterValues[i];
+   }
+   return 0;
+}
+
+bool payloadContains(const MockBroker::Message *message, const char *text) {
+   if (message == NULL) return false;
+   size_t length = message->length < MockBroker::PAYLOAD_SIZE ? message->length : MockBroker::PAYLOAD_SIZE;
+   size_t n = strlen(text);
+   for (size_t i = 0; i + n <= length; i++) {
+      if (memcmp(message->payload + i, text, n) == 0) return true;
+   }
+   return false;
+}
+
+CountingClient::CountingClient()
+   : length(0), writes(0), segments(0), open(false), replyLength(0), replyPos(0), expectHeader(true), header(0),
+     remaining(0), multiplier(1), lengthDone(false), bodyPos(0) {}
+
+int CountingClient::reopen() {
+   open = true;
+   replyLength = replyPos = 0;
+   expectHeader = true;
+   return 1;
+}
+
+size_t CountingClient::write(const uint8_t *buf, size_t size) {
+   if (!open) return 0;
+   writes++;
+   segments += (size + MSS - 1) / MSS;
+   if (length + size <= WIRE_CAPACITY) {
+      memcpy(wire + length, buf, size);
+   }
+   length += size;
+   scan(buf, size);
+   return size;
+}
+
+int CountingClient::read() {
+   uint8_t c;
+   return read(&c, 1) == 1 ? c : -1;
+}
+
+int CountingClient::read(uint8_t *buf, size_t size) {
+   size_t n = replyLength - replyPos < size ? replyLength - replyPos : size;
+   memcpy(buf, reply + replyPos, n);
+   replyPos += n;
+   if (replyPos == replyLength) replyPos = replyLength = 0;
+   return (int)n;
+}
+
+// Follow the packet boundaries through the writes; payload bytes past the
+// start of the body are skipped in one step
+void CountingClient::scan(const uint8_t *buf, size_t size) {
+   size_t i = 0;
+   while (i < size) {
+      if (expectHeader) {
+         header = buf[i++];
+         remaining = 0;
+         multiplier = 1;
+         lengthDone = false;
+         bodyPos = 0;
+         expectHeader = false;
+         continue;
+      }
+      if (!lengthDone) {
+         uint8_t c = buf[i++];
+         remaining += (c & 0x7F) * multiplier;
+         multiplier <<= 7;
+         lengthDone = (c & 0x80) == 0;
+      } else {
+         size_t n = remaining - bodyPos < size - i ? remaining - bodyPos : size - i;
+         if (bodyPos < sizeof(body)) {
+            memcpy(body + bodyPos, buf + i, n < sizeof(body) - bodyPos ? n : sizeof(body) - bodyPos);
+         }
+         bodyPos += n;
+         i += n;
+      }
+      if (lengthDone && bodyPos == remaining) {
+         answer();
+         expectHeader = true;
+      }
+   }
+}
+
+void CountingClient::answer() {
+   switch (header & 0xF0) {
+      case 0x10: {  // CONNECT
+         const uint8_t connack[] = {0x20, 2, 0, 0};
+         queue(connack, sizeof(connack));
+         break;
+      }
+      case 0x30: {  // PUBLISH
+         if ((header & 0x06) != 0x02 || bodyPos < 2) break;
+         size_t at = 2 + ((body[0] << 8) | body[1]);
+         if (at + 2 > sizeof(body)) break;
+         const uint8_t puback[] = {0x40, 2, body[at], body[at + 1]};
+         queue(puback, sizeof(puback));
+         break;
+      }
+      case 0x80: {  // SUBSCRIBE
+         if (bodyPos < 2) break;
+         const uint8_t suback[] = {0x90, 3, body[0], body[1], 0};
+         queue(suback, sizeof(suback));
+         break;
+      }
+   }
+}
+
+void CountingClient::queue(const uint8_t *packet, size_t size) {
+   if (replyLength + size > sizeof(reply)) return;
+   memcpy(reply + replyLength, packet, size);
+   replyLength += size;
+}
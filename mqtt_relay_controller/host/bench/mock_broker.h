@@ -0,0 +1,235 @@
+/*
+ mock_broker.h - in-process MQTT 3.1.1 / 5 broker stand-in for host benchmarks.
+
+ Installed as the host::Transport behind WiFiClient. It answers CONNECT,
+ SUBSCRIBE and PINGREQ, records what the firmware publishes and lets the
+ benchmark inject PUBLISH packets towards the device. All storage is fixed
+ size so the broker itself never shows up in the heap counters.
+
+ A CONNECT with protocol level 5 makes the connection MQTT 5: the CONNACK
+ carries the scripted Topic Alias Maximum and Receive Maximum, topic
+ aliases in the firmware's publishes are resolved (an unknown one counts
+ as malformed) and injected publishes can carry a Response Topic and
+ Correlation Data.
+
+ CountingClient is the Client for benchmarks of a standalone PubSubClient:
+ it records the bytes and write calls that would have gone to the socket,
+ counts the TCP segments those writes become with Nagle off, and answers
+ CONNECT, SUBSCRIBE and QoS 1 PUBLISH as a broker would.
+*/
+
+#ifndef MOCK_BROKER_H
+#define MOCK_BROKER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <Client.h>
+
+#include "HostHal.h"
+
+class MockBroker : public host::Transport {
+public:
+   static const size_t BUFFER_SIZE = 64 * 1024;
+   static const size_t TOPIC_SIZE = 128;
+   static const size_t PAYLOAD_SIZE = 2048;
+   static const size_t LOG_SIZE = 32;
+   static const size_t DELAYED_PACKETS = 8;
+   static const size_t DELAYED_SIZE = 512;
+   static const size_t CORRELATION_SIZE = 64;
+   static const size_t TOPIC_ALIASES = 16;
+
+   struct Message {
+      char topic[TOPIC_SIZE];
+      uint8_t payload[PAYLOAD_SIZE];
+      size_t length;       // Full payload length (may exceed PAYLOAD_SIZE)
+      uint8_t qos;
+      uint16_t packetId;
+      bool dup;
+      uint64_t atMicros;
+      bool aliased;         // MQTT 5: topic given by alias only
+      uint32_t messageExpiry;
+      uint8_t correlation[CORRELATION_SIZE];
+      size_t correlationLength;
+   };
+
+   // MQTT 5 properties of an injected PUBLISH; NULL members are left out
+   struct Properties {
+      const char *responseTopic;
+      const uint8_t *correlationData;
+      size_t correlationLength;
+   };
+
+   struct Stats {
+      uint32_t connects;
+      uint32_t subscribes;
+      uint32_t publishesIn;     // Firmware -> broker
+      uint32_t publishesOut;    // Broker -> firmware
+      uint32_t pings;
+      uint32_t pubacksIn;       // Firmware -> broker, for QoS 1 injected publishes
+      uint64_t writeCalls;
+      uint64_t bytesIn;
+      uint64_t bytesOut;
+      uint32_t malformed;
+   };
+
+   // Called for every PUBLISH from the firmware with the whole payload
+   // (Message::payload keeps only the first PAYLOAD_SIZE bytes)
+   typedef void (*PublishHook)(const Message &message, const uint8_t *payload);
+
+   MockBroker();
+
+   // host::Transport
+   bool open(const char *host, uint16_t port) override;
+   void close() override;
+   bool isOpen() override;
+   int available() override;
+   int read(uint8_t *buf, size_t size) override;
+   size_t write(const uint8_t *buf, size_t size) override;
+   uint64_t nextArrivalMicros() override;
+
+   // Scripting
+   void setAcceptConnections(bool accept) { acceptConnections = accept; }
+   void setAutoConnack(bool enabled) { autoConnack = enabled; }
+   // The automatic CONNACK becomes readable this long after the CONNECT
+   void setConnackDelay(uint64_t micros) { connackDelay = micros; }
+   void setAutoPuback(bool enabled) { autoPuback = enabled; }
+   void setPublishHook(PublishHook hook) { publishHook = hook; }
+   // MQTT 5 CONNACK limits for the next connection (0 = not sent)
+   void setTopicAliasMaximum(uint16_t maximum) { topicAliasMaximum = maximum; }
+   void setReceiveMaximum(uint16_t maximum) { receiveMaximum = maximum; }
+   void dropConnection();
+   bool injectPublish(const char *topic, const uint8_t *payload, size_t length, uint8_t qos = 0, uint16_t packetId = 0,
+                      const Properties *properties = NULL);
+   bool injectPublish(const char *topic, const char *payload);
+   // Queue a PUBLISH that becomes readable once host::nowMicros() reaches
+   // `atMicros`; arrivals must be scripted in time order
+   bool injectPublishAt(uint64_t atMicros, const char *topic, const char *payload);
+   bool injectRaw(const uint8_t *data, size_t length);
+   // Deliver at most `bytes` of queued data per read() call (0 = unlimited)
+   void setReadChunk(size_t bytes) { readChunk = bytes; }
+   void sendConnack(uint8_t returnCode);
+
+   // Inspection
+   uint8_t protocolVersion() const { return protocolLevel; }
+   const Stats &stats() const { return counters; }
+   void resetStats();
+   bool subscribed(const char *filter) const;
+   size_t publishedCount() const { return logCount; }
+   const Message *lastPublished(const char *topic = NULL) const;
+   uint32_t publishedTo(const char *topic) const;
+
+private:
+   bool connected;
+   bool acceptConnections;
+   bool autoConnack;
+   uint64_t connackDelay;
+   uint64_t connackAt;         // Pending delayed CONNACK, 0 = none
+   bool autoPuback;
+   PublishHook publishHook;
+   uint8_t protocolLevel;      // Of the current connection
+   uint16_t topicAliasMaximum;
+   uint16_t receiveMaximum;
+   uint16_t sessionAliasMaximum;  // Sent in this connection's CONNACK
+   char aliases[TOPIC_ALIASES][TOPIC_SIZE];
+   size_t readChunk;
+
+   uint8_t toClient[BUFFER_SIZE];
+   size_t toClientHead;
+   size_t toClientTail;
+
+   uint8_t fromClient[BUFFER_SIZE];
+   size_t fromClientLength;
+
+   char subscriptions[8][TOPIC_SIZE];
+   size_t subscriptionCount;
+
+   Message log[LOG_SIZE];
+   size_t logCount;
+
+   static const size_t TOPIC_COUNTERS = 16;
+   char counterTopics[TOPIC_COUNTERS][TOPIC_SIZE];
+   uint32_t counterValues[TOPIC_COUNTERS];
+
+   struct DelayedPacket {
+      uint64_t atMicros;
+      size_t length;
+      uint8_t data[DELAYED_SIZE];
+   };
+   DelayedPacket delayed[DELAYED_PACKETS];
+   size_t delayedHead;
+   size_t delayedCount;
+
+   Stats counters;
+
+   bool queue(const uint8_t *data, size_t length);
+   void releaseDelayed();
+   void parse();
+   void handlePacket(const uint8_t *packet, size_t headerLength, size_t remaining);
+   void handleConnect(const uint8_t *body, size_t length);
+   void handleSubscribe(const uint8_t *body, size_t length);
+   void handlePublish(uint8_t flags, const uint8_t *body, size_t length);
+   bool readProperties(const uint8_t *body, size_t &pos, size_t length, Message &msg, uint16_t &alias);
+   void countTopic(const char *topic);
+};
+
+// True if `text` occurs in the stored part of the payload (false for NULL)
+bool payloadContains(const MockBroker::Message *message, const char *text);
+
+// Records what would have gone to the socket, one entry per write call
+class CountingClient : public Client {
+public:
+   static const size_t MSS = 1436;  // ESP32 lwIP TCP_MSS
+   static const size_t WIRE_CAPACITY = 32 * 1024;
+
+   CountingClient();
+
+   void clear() { length = 0; }
+   void resetCounts() { writes = segments = 0; }
+   const uint8_t *data() const { return wire; }
+   // Bytes written since clear(); only the first WIRE_CAPACITY are kept
+   size_t size() const { return length; }
+   uint64_t writeCalls() const { return writes; }
+   // Each write is one segment, split at the MSS
+   uint64_t segmentCount() const { return segments; }
+   // The connection breaks: writes fail until the next connect()
+   void drop() { open = false; }
+
+   int connect(IPAddress, uint16_t) override { return reopen(); }
+   int connect(const char *, uint16_t) override { return reopen(); }
+   size_t write(uint8_t c) override { return write(&c, 1); }
+   size_t write(const uint8_t *buf, size_t size) override;
+   int available() override { return (int)(replyLength - replyPos); }
+   int read() override;
+   int read(uint8_t *buf, size_t size) override;
+   int peek() override { return replyPos < replyLength ? reply[replyPos] : -1; }
+   void flush() override {}
+   void stop() override { open = false; }
+   uint8_t connected() override { return open; }
+   operator bool() override { return open; }
+
+private:
+   uint8_t wire[WIRE_CAPACITY];
+   size_t length;
+   uint64_t writes;
+   uint64_t segments;
+   bool open;
+   uint8_t reply[256];
+   size_t replyLength;
+   size_t replyPos;
+   // Packet being written: fixed header, then the first bytes of the body
+   bool expectHeader;
+   uint8_t header;
+   size_t remaining;
+   size_t multiplier;
+   bool lengthDone;
+   uint8_t body[128];
+   size_t bodyPos;
+
+   int reopen();
+   void scan(const uint8_t *buf, size_t size);
+   void answer();
+   void queue(const uint8_t *packet, size_t size);
+};
+
+#endif
@@ -0,0 +1,66 @@
+/*
+ speech_firmware.cpp - plays synthetic speech to the booted firmware's
+ microphone (the speechMicrophone*() / speechSay() / speechCommand() fixture
+ of synthetic_speech.h). Apart from synthetic_speech.cpp because it drives
+ the firmware and the mock broker, which the keyword model trainer does not
+ link.
+*/
+
+#include "bench.h"
+#include "synthetic_speech.h"
+#include "audio_capture.h"
+
+#include <stdio.h>
+
+extern const char *command_topic;
+
+namespace {
+
+const size_t UTTERANCE_SAMPLES = 40 * AudioFrame::SAMPLES;
+
+struct Player {
+   int16_t samples[UTTERANCE_SAMPLES];
+   uint64_t at;  // Absolute sample index of samples[0]
+   uint32_t seed;
+};
+
+Player player;
+
+void microphone(int16_t *dst, size_t count, uint64_t first, void *ctx) {
+   Player *p = (Player *)ctx;
+   for (size_t i = 0; i < count; i++) {
+      uint64_t n = first + i;
+      if (n >= p->at && n < p->at + UTTERANCE_SAMPLES) {
+         dst[i] = p->samples[n - p->at];
+      } else {
+         p->seed = p->seed * 1664525u + 1013904223u;
+         dst[i] = (int16_t)((int32_t)(p->seed >> 24) - 128);
+      }
+   }
+}
+
+} // namespace
+
+void speechMicrophoneOn() {
+   host::setI2sSource(microphone, &player);
+}
+
+void speechMicrophoneOff() {
+   host::setI2sSource(NULL, NULL);
+}
+
+void speechSay(const Word &word, uint32_t speaker) {
+   synthesize(word, speakerFor(speaker), player.samples, UTTERANCE_SAMPLES);
+   player.at = host::i2sSamplesDelivered() + AudioFrame::SAMPLES;
+   uint64_t end = host::nowMicros() + (UTTERANCE_SAMPLES + 2 * AudioFrame::SAMPLES) * 1000000ULL / SPEECH_RATE;
+   while (host::nowMicros() < end) {
+      loop();
+   }
+}
+
+void speechCommand(const char *name, int run) {
+   char payload[96];
+   snprintf(payload, sizeof(payload), "{\"command\":\"%s\",\"requestId\":\"speech-%d\"}", name, run);
+   benchBroker().injectPublish(command_topic, payload);
+   for (int i = 0; i < 5; i++) loop();
+}
@@ -0,0 +1,201 @@
+/*
+ synthetic_speech.cpp - formant synthesis of the benchmark words.
+*/
+
+#include "synthetic_speech.h"
+#include "audio_capture.h"
+#include "keyword_spotter.h"
+#include "mfcc_frontend.h"
+#include "voice_activity.h"
+
+#include <math.h>
+#include <string.h>
+
+namespace {
+
+const Segment turnOn[] = {
+   {GAP, 20, {0, 0, 0}, {0, 0, 0}, 0},
+   BURST_T(15, 0.4f),
+   {VOWEL, 170, {480, 1350, 1700}, {500, 1300, 1650}, 1.0f},
+   NASAL(70, 0.3f),
+   {VOWEL, 210, {600, 900, 2450}, {620, 1000, 2500}, 1.0f},
+   NASAL(110, 0.3f),
+};
+const Segment turnOff[] = {
+   {GAP, 20, {0, 0, 0}, {0, 0, 0}, 0},
+   BURST_T(15, 0.4f),
+   {VOWEL, 170, {480, 1350, 1700}, {500, 1300, 1650}, 1.0f},
+   NASAL(60, 0.3f),
+   {VOWEL, 170, {600, 900, 2450}, {600, 1000, 2500}, 1.0f},
+   {FRICATIVE, 170, {3500, 6000, 0}, {0, 0, 0}, 0.15f},
+};
+const Segment status[] = {
+   SIBILANT(130),
+   {GAP, 40, {0, 0, 0}, {0, 0, 0}, 0},
+   BURST_T(12, 0.35f),
+   {VOWEL, 170, {480, 1900, 2600}, {360, 2300, 2900}, 1.0f},
+   {GAP, 40, {0, 0, 0}, {0, 0, 0}, 0},
+   BURST_T(10, 0.25f),
+   {VOWEL, 80, {500, 1500, 2500}, {500, 1500, 2500}, 0.7f},
+   SIBILANT(150),
+};
+const Segment hello[] = {
+   {ASPIRATE, 60, {550, 1800, 2500}, {550, 1800, 2500}, 0.15f},
+   {VOWEL, 110, {550, 1800, 2500}, {550, 1800, 2500}, 1.0f},
+   {VOWEL, 60, {350, 1000, 2600}, {350, 1000, 2600}, 0.6f},
+   {VOWEL, 230, {500, 900, 2400}, {380, 800, 2300}, 1.0f},
+};
+const Segment lights[] = {
+   {VOWEL, 60, {350, 1000, 2600}, {350, 1000, 2600}, 0.6f},
+   {VOWEL, 210, {750, 1200, 2500}, {400, 2200, 2900}, 1.0f},
+   {GAP, 40, {0, 0, 0}, {0, 0, 0}, 0},
+   BURST_T(12, 0.35f),
+   SIBILANT(130),
+};
+const Segment music[] = {
+   {VOWEL, 80, {250, 1100, 2400}, {250, 1100, 2400}, 0.35f},
+   {VOWEL, 60, {300, 2200, 2900}, {300, 2200, 2900}, 0.7f},
+   {VOWEL, 140, {320, 900, 2300}, {320, 900, 2300}, 1.0f},
+   {FRICATIVE, 90, {5000, 3000, 0}, {0, 0, 0}, 0.2f},
+   {VOWEL, 70, {400, 2000, 2600}, {400, 2000, 2600}, 0.8f},
+   {GAP, 40, {0, 0, 0}, {0, 0, 0}, 0},
+   BURST_T(15, 0.4f),
+};
+const Segment slam[] = {
+   {BURST, 300, {1500, 6000, 60}, {0, 0, 0}, 1.0f},
+};
+
+
+struct Resonator {
+   double a, b, c, y1, y2;
+
+   void set(double frequency, double bandwidth) {
+      if (frequency > 7200) frequency = 7200;
+      c = -exp(-2 * M_PI * bandwidth / SPEECH_RATE);
+      b = 2 * exp(-M_PI * bandwidth / SPEECH_RATE) * cos(2 * M_PI * frequency / SPEECH_RATE);
+      a = 1 - b - c;
+   }
+   double step(double x) {
+      double y = a * x + b * y1 + c * y2;
+      y2 = y1;
+      y1 = y;
+      return y;
+   }
+};
+
+double work[SPEECH_MAX_SAMPLES];
+
+} // namespace
+
+const Word speechKeywords[SPEECH_KEYWORDS] = {WORD("turn on", turnOn), WORD("turn off", turnOff),
+                                               WORD("status", status)};
+const Word speechUnknowns[SPEECH_UNKNOWNS] = {WORD("hello", hello), WORD("lights", lights), WORD("music", music),
+                                              WORD("slam", slam)};
+
+Speaker speakerFor(uint32_t seed) {
+   Random random = {seed * 2654435761u + 17};
+   Speaker speaker;
+   speaker.f0 = 95 + 135 * random.uniform();
+   speaker.tract = 0.88 + 0.27 * random.uniform();
+   speaker.tempo = 0.8 + 0.45 * random.uniform();
+   speaker.rms = 4000 + 6000 * random.uniform();
+   speaker.noise = 50 + 150 * random.uniform();
+   speaker.seed = seed;
+   return speaker;
+}
+
+size_t synthesize(const Word &word, const Speaker &speaker, int16_t *out, size_t count) {
+   Random random = {speaker.seed};
+   memset(work, 0, sizeof(double) * count);
+   size_t at = (size_t)((0.4 + 0.3 * random.uniform()) * SPEECH_RATE);
+   Resonator formants[4] = {};
+   Resonator frication = {};
+   double phase = 0;
+   double glottis[2] = {0, 0};
+   const double bandwidths[4] = {60, 90, 150, 250};
+
+   for (size_t s = 0; s < word.count; s++) {
+      const Segment &segment = word.segments[s];
+      size_t n = (size_t)(segment.ms * speaker.tempo * (0.9 + 0.2 * random.uniform()) * SPEECH_RATE / 1000);
+      if (at + n > count) n = count - at;
+      size_t ramp = n / 4 < 240 ? n / 4 : 240;
+      if (segment.kind == FRICATIVE || segment.kind == BURST) {
+         frication.set(segment.f[0] * speaker.tract, segment.f[1]);
+      }
+      double energy = 0;
+      for (size_t i = 0; i < n; i++) {
+         double progress = (double)i / n;
+         double y = 0;
+         if (segment.kind == VOWEL || segment.kind == ASPIRATE) {
+            if (i % 32 == 0) {
+               for (int k = 0; k < 3; k++) {
+                  double f = segment.f[k] + (segment.fEnd[k] - segment.f[k]) * progress;
+                  formants[k].set(f * speaker.tract, bandwidths[k]);
+               }
+               formants[3].set(3500 * speaker.tract, bandwidths[3]);
+            }
+            double source;
+            if (segment.kind == VOWEL) {
+               phase += speaker.f0 * (1.05 - 0.1 * progress) / SPEECH_RATE;
+               source = phase >= 1 ? 1.0 : 0.0;
+               if (phase >= 1) phase -= 1;
+               glottis[0] = 0.9 * glottis[0] + source;
+               glottis[1] = 0.9 * glottis[1] + glottis[0];
+               source = glottis[1];
+            } else {
+               source = random.noise();
+            }
+            y = source;
+            for (int k = 0; k < 4; k++) y = formants[k].step(y);
+         } else if (segment.kind == FRICATIVE) {
+            y = frication.step(random.noise());
+         } else if (segment.kind == BURST) {
+            y = frication.step(random.noise()) * exp(-(double)i / (segment.f[2] * SPEECH_RATE / 1000));
+         }
+         double envelope = 1;
+         if (ramp > 0 && i < ramp) envelope = (double)i / ramp;
+         if (ramp > 0 && n - i < ramp) envelope = (double)(n - i) / ramp;
+         work[at + i] = y * envelope;
+         energy += y * y;
+      }
+      // Each segment at its level relative to a vowel
+      double rms = n > 0 ? sqrt(energy / n) : 0;
+      if (rms > 0) {
+         for (size_t i = 0; i < n; i++) work[at + i] *= segment.level / rms;
+      }
+      at += n;
+   }
+
+   double peak = 0;
+   for (size_t i = 0; i + 256 <= count; i += 256) {
+      double energy = 0;
+      for (size_t j = 0; j < 256; j++) energy += work[i + j] * work[i + j];
+      peak = fmax(peak, sqrt(energy / 256));
+   }
+   double gain = peak > 0 ? speaker.rms / peak : 0;
+   for (size_t i = 0; i < count; i++) {
+      double sample = work[i] * gain + speaker.noise * 1.7 * random.noise();
+      out[i] = (int16_t)fmax(-32768, fmin(32767, sample));
+   }
+   return count;
+}
+
+bool extractUtterance(const int16_t *samples, size_t count, MfccFrontEnd &frontEnd, KeywordSpotter &spotter,
+                      KeywordTemplate &out) {
+   const uint16_t THRESHOLD = 2000;                                         // DETECTION_THRESHOLD
+   const uint8_t PREROLL = 3 * AudioFrame::SAMPLES / MfccFrontEnd::HOP;   // keywordPreroll
+   const int WINDOW_FRAMES = 24;                                            // voiceCommandWindow
+   VoiceActivityDetector detector(THRESHOLD);
+   frontEnd.reset();
+   int triggered = -1;
+   for (size_t f = 0; (f + 1) * AudioFrame::SAMPLES <= count; f++) {
+      const int16_t *frame = samples + f * AudioFrame::SAMPLES;
+      frontEnd.addAudio(frame, AudioFrame::SAMPLES);
+      if (triggered < 0 && detector.process(frame, AudioFrame::SAMPLES)) {
+         triggered = f;
+         spotter.markStart(PREROLL);
+      }
+      if (triggered >= 0 && (int)f - triggered + 1 >= WINDOW_FRAMES) break;
+   }
+   return triggered >= 0 && spotter.utterance(out);
+}
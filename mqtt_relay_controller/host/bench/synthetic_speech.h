@@ -0,0 +1,98 @@
+/*
+ synthetic_speech.h - formant-synthesised words for the keyword benchmarks.
+
+ A word is a list of segments - vowels with formant glides, aspiration,
+ fricatives, bursts and gaps - spoken by a Speaker: pitch, vocal tract
+ length, tempo, loudness and background noise drawn from a seed, so every
+ seed is another voice. Used by the kws and kwsnn suites and by the keyword
+ model trainer (host/tools/train_keyword_model.cpp), which takes its
+ speakers from seeds the suites do not use.
+*/
+
+#ifndef SYNTHETIC_SPEECH_H
+#define SYNTHETIC_SPEECH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+class MfccFrontEnd;
+class KeywordSpotter;
+struct KeywordTemplate;
+
+const uint32_t SPEECH_RATE = 16000;
+const size_t SPEECH_MAX_SAMPLES = 4 * SPEECH_RATE;
+
+struct Random {
+   uint32_t state;
+   double uniform() {
+      state = state * 1664525u + 1013904223u;
+      return (state >> 8) / 16777216.0;
+   }
+   double noise() { return uniform() * 2 - 1; }
+};
+
+enum SegmentKind { GAP, VOWEL, ASPIRATE, FRICATIVE, BURST };
+
+// Vowels: formants from f[] to fEnd[]. Fricatives and bursts: f[0] centre,
+// f[1] bandwidth, f[2] decay (ms, bursts). `level` is the RMS relative to
+// a vowel.
+struct Segment {
+   SegmentKind kind;
+   uint16_t ms;
+   float f[3];
+   float fEnd[3];
+   float level;
+};
+
+struct Word {
+   const char *name;
+   const Segment *segments;
+   size_t count;
+};
+
+#define NASAL(ms, level) {VOWEL, ms, {250, 1700, 2600}, {250, 1700, 2600}, level}
+#define BURST_T(ms, level) {BURST, ms, {4000, 4000, 4}, {0, 0, 0}, level}
+#define SIBILANT(ms) {FRICATIVE, ms, {5500, 2500, 0}, {0, 0, 0}, 0.35f}
+#define WORD(name, segments) {name, segments, sizeof(segments) / sizeof(segments[0])}
+
+// "turn on", "turn off", "status": the voice command actions in main.cpp's order
+const int SPEECH_KEYWORDS = 3;
+extern const Word speechKeywords[SPEECH_KEYWORDS];
+// Words and noises that must be rejected
+const int SPEECH_UNKNOWNS = 4;
+extern const Word speechUnknowns[SPEECH_UNKNOWNS];
+
+struct Speaker {
+   double f0;       // Hz
+   double tract;    // Formant scale: shorter tracts, higher formants
+   double tempo;    // Duration scale
+   double rms;      // Of the loudest 16 ms
+   double noise;    // Background RMS
+   uint32_t seed;
+};
+
+Speaker speakerFor(uint32_t seed);
+
+// `count` (at most SPEECH_MAX_SAMPLES) samples with the word starting
+// 0.4-0.7 s in
+size_t synthesize(const Word &word, const Speaker &speaker, int16_t *out, size_t count);
+
+// The firmware's path from the microphone to an utterance: a voice detector
+// with DETECTION_THRESHOLD on 1024-sample capture frames, the front-end fed
+// every frame, the spotter marked keywordPreroll frames before the one the
+// detector fires on and the 1.5 s window closed after 24 capture frames.
+// False if the detector never fires or the spotter refuses the utterance.
+bool extractUtterance(const int16_t *samples, size_t count, MfccFrontEnd &frontEnd, KeywordSpotter &spotter,
+                      KeywordTemplate &out);
+
+// The booted firmware's microphone (speech_firmware.cpp, benchmarks only):
+// low noise, with a word in it while speechSay() plays one
+void speechMicrophoneOn();
+void speechMicrophoneOff();
+// Play `word` by `speaker` and run loop() until the voice command window
+// has closed
+void speechSay(const Word &word, uint32_t speaker);
+// A command on the command topic, then a few loop() calls
+void speechCommand(const char *name, int run);
+
+#endif
@@ -0,0 +1,88 @@
+/*
+ Arduino.h - host (Linux) stand-in for the arduino-esp32 core.
+
+ Only the subset of the Arduino API used by the firmware and its libraries
+ (ArduinoJson, PubSubClient) is provided. Behaviour that the firmware can
+ observe - timing, GPIO levels, WiFi link, I2S samples, network traffic - is
+ controlled from the host side through HostHal.h.
+*/
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+typedef bool boolean;
+typedef uint8_t byte;
+typedef uint16_t word;
+
+using std::min;
+using std::max;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT        0x01
+#define OUTPUT       0x03
+#define PULLUP       0x04
+#define INPUT_PULLUP 0x05
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+// PROGMEM is plain RAM on the ESP32, so the accessors are simple loads
+#define PROGMEM
+#define PGM_P const char *
+#define pgm_read_byte(addr)       (*(const unsigned char *)(addr))
+#define pgm_read_byte_near(addr)  pgm_read_byte(addr)
+#define pgm_read_word(addr)       (*(const unsigned short *)(addr))
+#define pgm_read_dword(addr)      (*(const unsigned long *)(addr))
+#define pgm_read_float(addr)      (*(const float *)(addr))
+#define pgm_read_ptr(addr)        (*(void * const *)(addr))
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define memcpy_P memcpy
+
+// Placement attributes (IRAM, DRAM) have no meaning on the host
+#define IRAM_ATTR
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+// LEDC PWM: levels are not synthesised, tone changes are recorded (HostHal.h)
+double ledcSetup(uint8_t channel, double freq, uint8_t resolution_bits);
+void ledcWrite(uint8_t channel, uint32_t duty);
+double ledcWriteTone(uint8_t channel, double freq);
+void ledcAttachPin(uint8_t pin, uint8_t channel);
+void ledcDetachPin(uint8_t pin);
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+#include "freertos/FreeRTOS.h"
+#include "WString.h"
+#include "Printable.h"
+#include "Print.h"
+#include "Stream.h"
+#include "HardwareSerial.h"
+#include "Esp.h"
+
+#endif
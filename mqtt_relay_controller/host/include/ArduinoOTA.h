@@ -0,0 +1,58 @@
+/*
+ ArduinoOTA.h - host stand-in for the arduino-esp32 OTA service.
+
+ Callbacks are stored so the host can trigger them, but no update server is
+ started.
+*/
+
+#ifndef HOST_ARDUINO_OTA_H
+#define HOST_ARDUINO_OTA_H
+
+#include <functional>
+
+#include "Arduino.h"
+
+#define U_FLASH   0
+#define U_SPIFFS  100
+
+typedef enum {
+   OTA_AUTH_ERROR,
+   OTA_BEGIN_ERROR,
+   OTA_CONNECT_ERROR,
+   OTA_RECEIVE_ERROR,
+   OTA_END_ERROR
+} ota_error_t;
+
+class ArduinoOTAClass {
+public:
+   typedef std::function<void(void)> THandlerFunction;
+   typedef std::function<void(ota_error_t)> THandlerFunction_Error;
+   typedef std::function<void(unsigned int, unsigned int)> THandlerFunction_Progress;
+
+   ArduinoOTAClass &setPort(uint16_t port);
+   ArduinoOTAClass &setHostname(const char *hostname);
+   ArduinoOTAClass &setPassword(const char *password);
+   ArduinoOTAClass &onStart(THandlerFunction fn);
+   ArduinoOTAClass &onEnd(THandlerFunction fn);
+   ArduinoOTAClass &onError(THandlerFunction_Error fn);
+   ArduinoOTAClass &onProgress(THandlerFunction_Progress fn);
+
+   void begin();
+   void end();
+   void handle();
+   int getCommand();
+
+   // Host only: run the registered callbacks as if an update had happened
+   void simulateUpdate(bool fail);
+
+private:
+   THandlerFunction _start_callback;
+   THandlerFunction _end_callback;
+   THandlerFunction_Error _error_callback;
+   THandlerFunction_Progress _progress_callback;
+   int _cmd = U_FLASH;
+};
+
+extern ArduinoOTAClass ArduinoOTA;
+
+#endif
@@ -0,0 +1,51 @@
+/*
+ EEPROM.h - host stand-in for the arduino-esp32 EEPROM emulation.
+
+ The contents live in RAM for the lifetime of the process; commits are
+ counted so host runs can see how often the firmware hits flash.
+*/
+
+#ifndef HOST_EEPROM_H
+#define HOST_EEPROM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+class EEPROMClass {
+public:
+   EEPROMClass();
+   ~EEPROMClass();
+
+   bool begin(size_t size);
+   uint8_t read(int address);
+   void write(int address, uint8_t val);
+   bool commit();
+   void end();
+   uint16_t length() { return _size; }
+   uint8_t *getDataPtr() { return _data; }
+
+   template <typename T>
+   T &get(int address, T &t) {
+      if (address < 0 || address + sizeof(T) > _size) return t;
+      memcpy((uint8_t *)&t, _data + address, sizeof(T));
+      return t;
+   }
+
+   template <typename T>
+   const T &put(int address, const T &t) {
+      if (address < 0 || address + sizeof(T) > _size) return t;
+      memcpy(_data + address, (const uint8_t *)&t, sizeof(T));
+      _dirty = true;
+      return t;
+   }
+
+private:
+   uint8_t *_data;
+   size_t _size;
+   bool _dirty;
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
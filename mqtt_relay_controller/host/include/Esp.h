@@ -0,0 +1,25 @@
+/*
+ Esp.h - host stand-in for the arduino-esp32 EspClass.
+*/
+
+#ifndef HOST_ESP_H
+#define HOST_ESP_H
+
+#include <stdint.h>
+
+class EspClass {
+public:
+   uint32_t getHeapSize();
+   uint32_t getFreeHeap();
+   uint32_t getMinFreeHeap();
+   uint32_t getCpuFreqMHz();
+   // Raw cycle counter (rdtsc / cntvct on host, CCOUNT on the Xtensa core)
+   uint32_t getCycleCount();
+   // Factory MAC (matches WiFi.macAddress() on the host)
+   uint64_t getEfuseMac();
+   void restart();
+};
+
+extern EspClass ESP;
+
+#endif
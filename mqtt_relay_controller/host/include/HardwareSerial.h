@@ -0,0 +1,32 @@
+/*
+ HardwareSerial.h - host stand-in for the ESP32 UART console.
+
+ Output goes to stdout unless silenced with host::setSerialEcho(false), which
+ the benchmark runner does so that terminal I/O does not dominate the numbers.
+*/
+
+#ifndef HOST_HARDWARE_SERIAL_H
+#define HOST_HARDWARE_SERIAL_H
+
+#include "Stream.h"
+
+class HardwareSerial : public Stream {
+public:
+   void begin(unsigned long baud);
+   void end();
+
+   int available() override { return 0; }
+   int read() override { return -1; }
+   int peek() override { return -1; }
+   void flush() override;
+
+   size_t write(uint8_t c) override;
+   size_t write(const uint8_t *buffer, size_t size) override;
+   using Print::write;
+
+   operator bool() const { return true; }
+};
+
+extern HardwareSerial Serial;
+
+#endif
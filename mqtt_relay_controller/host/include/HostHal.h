@@ -0,0 +1,180 @@
+/*
+ HostHal.h - control surface for the host (Linux) HAL shims.
+
+ Firmware code never includes this header. It is used by host entry points
+ (native_main.cpp, the benchmark runner) to script what the firmware sees:
+ time, WiFi link, microphone samples and the broker on the other end of the
+ TCP connection.
+*/
+
+#ifndef HOST_HAL_H
+#define HOST_HAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace host {
+
+// --- Clock -----------------------------------------------------------------
+
+// With the virtual clock enabled, delay()/delayMicroseconds() and blocking
+// I2S reads advance simulated time instead of sleeping, so a benchmark can
+// run hours of firmware time in milliseconds. esp_timer callbacks that fall
+// due while time advances are run at their deadline.
+void setVirtualClock(bool enabled);
+bool virtualClock();
+void advanceMicros(uint64_t us);
+uint64_t nowMicros();
+
+// Free-running CPU cycle counter (rdtsc / cntvct, monotonic ns as fallback)
+uint64_t cycleCounter();
+
+// --- Heap ------------------------------------------------------------------
+
+struct HeapStats {
+   uint64_t allocations;   // malloc/calloc/realloc(NULL, n)/operator new
+   uint64_t reallocations; // realloc of an existing block
+   uint64_t frees;
+   uint64_t bytesAllocated;
+   int64_t bytesLive;
+   int64_t peakBytesLive;
+};
+
+HeapStats heapStats();
+
+// --- Serial ----------------------------------------------------------------
+
+void setSerialEcho(bool enabled);
+
+// --- GPIO ------------------------------------------------------------------
+
+int pinLevel(uint8_t pin);
+int pinMode(uint8_t pin);
+uint32_t pinWrites(uint8_t pin);
+// nowMicros() at the last write that changed the pin level
+uint64_t pinChangedAtMicros(uint8_t pin);
+// Writes to the GPIO.out*_w1ts / _w1tc registers (soc/gpio_struct.h)
+uint32_t gpioRegisterWrites();
+
+// --- LEDC (PWM) ------------------------------------------------------------
+
+// A change of the square wave on an LEDC-attached pin; frequency 0 = silent
+struct ToneEvent {
+   uint64_t atMicros;
+   uint8_t pin;
+   uint32_t frequency;
+};
+
+// Copies the recorded tone changes, oldest first (the last 64 are kept)
+size_t toneEvents(ToneEvent *out, size_t max);
+void clearToneEvents();
+uint32_t pinToneFrequency(uint8_t pin);
+
+// --- esp_timer -------------------------------------------------------------
+
+// Callbacks fire from delay()/advanceMicros() and the scheduler's idle wait
+uint64_t nextTimerMicros();
+void runDueTimers();
+uint32_t timerCallbacks();
+
+// --- WiFi ------------------------------------------------------------------
+
+// Events (STA_CONNECTED, STA_GOT_IP, STA_DISCONNECTED) are delivered from
+// WiFi.status() and from waitForActivity(), at the simulated time they occur.
+void setWiFiAvailable(bool available);
+// Scan + association time for WiFi.begin(ssid, pass)
+void setWiFiConnectDelay(uint32_t ms);
+// Association time when begin() is given the access point's BSSID and channel
+void setWiFiFastConnectDelay(uint32_t ms);
+// DHCP lease time after association (skipped after WiFi.config() with an address)
+void setWiFiDhcpDelay(uint32_t ms);
+// Move the access point; a cached channel then no longer finds it
+void setWiFiChannel(uint8_t channel);
+uint32_t wifiBeginCount();
+uint32_t wifiFastBeginCount();
+
+// --- I2S microphone --------------------------------------------------------
+
+// Fills `count` samples starting at absolute sample index `first`
+typedef void (*SampleSource)(int16_t *dst, size_t count, uint64_t first, void *ctx);
+
+void setI2sSource(SampleSource source, void *ctx);
+uint64_t i2sSamplesDelivered();
+uint64_t i2sOverrunSamples();
+// Event queue (i2s_driver_install() with a queue): one RX_DONE per DMA
+// buffer, sent from delay()/advanceMicros() and the scheduler's idle wait
+uint64_t nextI2sEventMicros();
+void sendDueI2sEvents();
+
+// --- FreeRTOS tasks --------------------------------------------------------
+
+// Coroutine switches between the loop and tasks (freertos/task.h)
+uint32_t taskSwitches();
+
+// --- EEPROM ----------------------------------------------------------------
+
+uint32_t eepromCommits();
+
+// --- Flash partitions (esp_partition) --------------------------------------
+
+struct FlashStats {
+   uint32_t reads;
+   uint32_t writes;
+   uint32_t erases;       // 4 KB sectors
+   uint64_t bytesRead;
+   uint64_t bytesWritten;
+};
+
+FlashStats flashStats();
+// Extra erased data partition for benchmarks (size a multiple of 4 KB)
+bool addPartition(const char *label, uint8_t subtype, uint32_t size);
+// Raw contents, e.g. to simulate a write torn by power loss
+uint8_t *partitionData(const char *label);
+uint32_t partitionSectorErases(const char *label, uint32_t sector);
+
+// --- NVS (Preferences) -----------------------------------------------------
+
+uint32_t nvsWrites();
+// Wipe every namespace, as after a flash erase
+void nvsErase();
+
+// --- Network ---------------------------------------------------------------
+
+// Byte stream behind a WiFiClient. Implementations must not block.
+class Transport {
+public:
+   virtual ~Transport() {}
+   virtual bool open(const char *host, uint16_t port) = 0;
+   virtual void close() = 0;
+   virtual bool isOpen() = 0;
+   virtual int available() = 0;
+   virtual int read(uint8_t *buf, size_t size) = 0;
+   virtual size_t write(const uint8_t *buf, size_t size) = 0;
+   virtual void setNoDelay(bool nodelay) { (void)nodelay; }
+   // Descriptor to poll for readability, or -1 for in-process transports
+   virtual int fd() { return -1; }
+   // nowMicros() at which data scheduled for later delivery becomes readable
+   virtual uint64_t nextArrivalMicros() { return UINT64_MAX; }
+};
+
+// Route every subsequent WiFiClient::connect() through `transport`
+// (nullptr restores real sockets). The transport is not owned.
+void setTransport(Transport *transport);
+Transport *transport();
+// With a scripted transport, the time a blocking WiFi.hostByName() and
+// WiFiClient::connect() (TCP handshake) take
+void setDnsDelay(uint32_t ms);
+void setTcpConnectDelay(uint32_t ms);
+
+// Non-blocking TCP socket transport used when no override is installed
+Transport *createSocketTransport();
+
+// Idle wait used by the firmware scheduler in place of select(): blocks until
+// one of `fds` is readable or `timeoutMicros` passes, and returns a bitmask of
+// the ready entries. With the virtual clock it never sleeps; time jumps to the
+// installed transport's next scheduled arrival or to the timeout.
+uint32_t waitForActivity(const int *fds, size_t count, uint64_t timeoutMicros);
+
+} // namespace host
+
+#endif
@@ -0,0 +1,44 @@
+/*
+ IPAddress.h - host stand-in for the Arduino IPAddress class.
+*/
+
+#ifndef HOST_IPADDRESS_H
+#define HOST_IPADDRESS_H
+
+#include <stdint.h>
+
+#include "Printable.h"
+#include "WString.h"
+
+class IPAddress : public Printable {
+public:
+   IPAddress() : _address(0) {}
+   IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+      _bytes[0] = a;
+      _bytes[1] = b;
+      _bytes[2] = c;
+      _bytes[3] = d;
+   }
+   IPAddress(uint32_t address) : _address(address) {}
+   IPAddress(const uint8_t *address) {
+      for (int i = 0; i < 4; i++) _bytes[i] = address[i];
+   }
+
+   operator uint32_t() const { return _address; }
+   bool operator==(const IPAddress &addr) const { return _address == addr._address; }
+   bool operator!=(const IPAddress &addr) const { return _address != addr._address; }
+   uint8_t operator[](int index) const { return _bytes[index]; }
+   uint8_t &operator[](int index) { return _bytes[index]; }
+
+   bool fromString(const char *address);
+   String toString() const;
+   size_t printTo(Print &p) const override;
+
+private:
+   union {
+      uint8_t _bytes[4];
+      uint32_t _address;
+   };
+};
+
+#endif
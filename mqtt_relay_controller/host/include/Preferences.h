@@ -0,0 +1,37 @@
+/*
+ Preferences.h - host stand-in for the arduino-esp32 NVS key/value store.
+
+ Entries live in a fixed table in RAM for the lifetime of the process;
+ writes are counted so host runs can see how often the firmware hits flash.
+*/
+
+#ifndef HOST_PREFERENCES_H
+#define HOST_PREFERENCES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+class Preferences {
+public:
+   Preferences();
+   ~Preferences();
+
+   bool begin(const char *name, bool readOnly = false, const char *partition_label = NULL);
+   void end();
+
+   bool clear();
+   bool remove(const char *key);
+   bool isKey(const char *key);
+
+   size_t putUInt(const char *key, uint32_t value);
+   uint32_t getUInt(const char *key, uint32_t defaultValue = 0);
+   size_t putBytes(const char *key, const void *value, size_t len);
+   size_t getBytesLength(const char *key);
+   size_t getBytes(const char *key, void *buf, size_t maxLen);
+
+private:
+   int _namespace;
+   bool _readOnly;
+};
+
+#endif
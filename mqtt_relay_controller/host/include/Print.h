@@ -0,0 +1,65 @@
+/*
+ Print.h - host stand-in for the Arduino Print class.
+*/
+
+#ifndef HOST_PRINT_H
+#define HOST_PRINT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "WString.h"
+#include "Printable.h"
+
+class Print {
+public:
+   virtual ~Print() {}
+
+   virtual size_t write(uint8_t) = 0;
+   virtual size_t write(const uint8_t *buffer, size_t size);
+   size_t write(const char *str) {
+      if (str == NULL) return 0;
+      return write((const uint8_t *)str, strlen(str));
+   }
+   size_t write(const char *buffer, size_t size) {
+      return write((const uint8_t *)buffer, size);
+   }
+   virtual void flush() {}
+
+   size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+   size_t print(const __FlashStringHelper *);
+   size_t print(const String &);
+   size_t print(const char[]);
+   size_t print(char);
+   size_t print(unsigned char, int = DEC_BASE);
+   size_t print(int, int = DEC_BASE);
+   size_t print(unsigned int, int = DEC_BASE);
+   size_t print(long, int = DEC_BASE);
+   size_t print(unsigned long, int = DEC_BASE);
+   size_t print(long long, int = DEC_BASE);
+   size_t print(unsigned long long, int = DEC_BASE);
+   size_t print(double, int = 2);
+   size_t print(const Printable &);
+
+   size_t println(const __FlashStringHelper *);
+   size_t println(const String &s);
+   size_t println(const char[]);
+   size_t println(char);
+   size_t println(unsigned char, int = DEC_BASE);
+   size_t println(int, int = DEC_BASE);
+   size_t println(unsigned int, int = DEC_BASE);
+   size_t println(long, int = DEC_BASE);
+   size_t println(unsigned long, int = DEC_BASE);
+   size_t println(long long, int = DEC_BASE);
+   size_t println(unsigned long long, int = DEC_BASE);
+   size_t println(double, int = 2);
+   size_t println(const Printable &);
+   size_t println(void);
+
+private:
+   static const int DEC_BASE = 10;
+};
+
+#endif
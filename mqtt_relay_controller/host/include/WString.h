@@ -0,0 +1,105 @@
+/*
+ WString.h - host stand-in for the Arduino String class.
+
+ Storage is managed with malloc/realloc/free exactly like the arduino-esp32
+ implementation, so the host allocation counters see the same traffic the
+ firmware generates on target.
+*/
+
+#ifndef HOST_WSTRING_H
+#define HOST_WSTRING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+class __FlashStringHelper;
+
+class String {
+public:
+   String(const char *cstr = "");
+   String(const char *cstr, unsigned int length);
+   String(const String &str);
+   String(String &&rval);
+   String(const __FlashStringHelper *str);
+   explicit String(char c);
+   explicit String(unsigned char value, unsigned char base = 10);
+   explicit String(int value, unsigned char base = 10);
+   explicit String(unsigned int value, unsigned char base = 10);
+   explicit String(long value, unsigned char base = 10);
+   explicit String(unsigned long value, unsigned char base = 10);
+   explicit String(long long value, unsigned char base = 10);
+   explicit String(unsigned long long value, unsigned char base = 10);
+   explicit String(float value, unsigned char decimalPlaces = 2);
+   explicit String(double value, unsigned char decimalPlaces = 2);
+   ~String();
+
+   bool reserve(unsigned int size);
+   // size_t (not unsigned int) so ArduinoJson detects it on 64-bit hosts, as
+   // it does on the ESP32 where the two are the same type
+   size_t length() const { return len; }
+   const char *c_str() const { return buffer ? buffer : ""; }
+   char *begin() { return buffer; }
+   char *end() { return buffer + len; }
+
+   String &operator=(const String &rhs);
+   String &operator=(const char *cstr);
+   String &operator=(String &&rval);
+
+   bool concat(const String &str);
+   bool concat(const char *cstr);
+   bool concat(const char *cstr, unsigned int length);
+   bool concat(char c);
+   bool concat(int num);
+   bool concat(unsigned int num);
+   bool concat(long num);
+   bool concat(unsigned long num);
+   bool concat(double num);
+
+   template <typename T>
+   String &operator+=(const T &rhs) {
+      concat(rhs);
+      return *this;
+   }
+
+   bool equals(const String &s) const;
+   bool equals(const char *cstr) const;
+   bool operator==(const String &rhs) const { return equals(rhs); }
+   bool operator==(const char *cstr) const { return equals(cstr); }
+   bool operator!=(const String &rhs) const { return !equals(rhs); }
+   bool operator!=(const char *cstr) const { return !equals(cstr); }
+   bool equalsIgnoreCase(const String &s) const;
+   bool startsWith(const String &prefix) const;
+   bool endsWith(const String &suffix) const;
+
+   char charAt(unsigned int index) const;
+   char operator[](unsigned int index) const { return charAt(index); }
+   int indexOf(char ch, unsigned int fromIndex = 0) const;
+   int indexOf(const String &str, unsigned int fromIndex = 0) const;
+   int indexOf(const char *str, unsigned int fromIndex = 0) const;
+   String substring(unsigned int beginIndex) const;
+   String substring(unsigned int beginIndex, unsigned int endIndex) const;
+
+   void toLowerCase();
+   void toUpperCase();
+   void trim();
+   long toInt() const;
+   float toFloat() const;
+
+private:
+   char *buffer;
+   unsigned int capacity;
+   unsigned int len;
+
+   void init();
+   void invalidate();
+   bool changeBuffer(unsigned int maxStrLen);
+   String &copy(const char *cstr, unsigned int length);
+   void move(String &rhs);
+};
+
+String operator+(const String &lhs, const String &rhs);
+String operator+(const String &lhs, const char *rhs);
+String operator+(const char *lhs, const String &rhs);
+String operator+(const String &lhs, char rhs);
+
+#endif
@@ -0,0 +1,109 @@
+/*
+ WiFi.h - host stand-in for the arduino-esp32 WiFi station API.
+
+ The host is always "on the network"; link loss and association time are
+ simulated through host::setWiFiAvailable() / host::setWiFiConnectDelay().
+*/
+
+#ifndef HOST_WIFI_H
+#define HOST_WIFI_H
+
+#include <stdint.h>
+
+#include "Arduino.h"
+#include "IPAddress.h"
+#include "WiFiClient.h"
+
+typedef enum {
+   WL_NO_SHIELD = 255,
+   WL_IDLE_STATUS = 0,
+   WL_NO_SSID_AVAIL = 1,
+   WL_SCAN_COMPLETED = 2,
+   WL_CONNECTED = 3,
+   WL_CONNECT_FAILED = 4,
+   WL_CONNECTION_LOST = 5,
+   WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum {
+   WIFI_OFF = 0,
+   WIFI_STA = 1,
+   WIFI_AP = 2,
+   WIFI_AP_STA = 3
+} wifi_mode_t;
+
+// Subset of the arduino-esp32 event ids, in the same order
+typedef enum {
+   ARDUINO_EVENT_WIFI_READY = 0,
+   ARDUINO_EVENT_WIFI_SCAN_DONE,
+   ARDUINO_EVENT_WIFI_STA_START,
+   ARDUINO_EVENT_WIFI_STA_STOP,
+   ARDUINO_EVENT_WIFI_STA_CONNECTED,
+   ARDUINO_EVENT_WIFI_STA_DISCONNECTED,
+   ARDUINO_EVENT_WIFI_STA_AUTHMODE_CHANGE,
+   ARDUINO_EVENT_WIFI_STA_GOT_IP,
+   ARDUINO_EVENT_WIFI_STA_GOT_IP6,
+   ARDUINO_EVENT_WIFI_STA_LOST_IP,
+   ARDUINO_EVENT_MAX
+} arduino_event_id_t;
+
+// wifi_err_reason_t values reported by the host link model
+#define WIFI_REASON_ASSOC_LEAVE      8
+#define WIFI_REASON_BEACON_TIMEOUT   200
+#define WIFI_REASON_NO_AP_FOUND      201
+#define WIFI_REASON_AUTH_FAIL        202
+
+typedef struct {
+   uint8_t ssid[32];
+   uint8_t ssid_len;
+   uint8_t bssid[6];
+   uint8_t channel;
+} wifi_event_sta_connected_t;
+
+typedef struct {
+   uint8_t ssid[32];
+   uint8_t ssid_len;
+   uint8_t bssid[6];
+   uint8_t reason;
+} wifi_event_sta_disconnected_t;
+
+typedef union {
+   wifi_event_sta_connected_t wifi_sta_connected;
+   wifi_event_sta_disconnected_t wifi_sta_disconnected;
+} arduino_event_info_t;
+
+typedef struct {
+   arduino_event_id_t event_id;
+   arduino_event_info_t event_info;
+} arduino_event_t;
+
+typedef void (*WiFiEventSysCb)(arduino_event_t *event);
+typedef size_t wifi_event_id_t;
+
+class WiFiClass {
+public:
+   wl_status_t begin(const char *ssid, const char *passphrase = NULL, int32_t channel = 0,
+                     const uint8_t *bssid = NULL, bool connect = true);
+   bool config(IPAddress local_ip, IPAddress gateway, IPAddress subnet, IPAddress dns1 = IPAddress());
+   wifi_event_id_t onEvent(WiFiEventSysCb callback, arduino_event_id_t event = ARDUINO_EVENT_MAX);
+   bool disconnect(bool wifioff = false);
+   bool reconnect();
+   wl_status_t status();
+   bool isConnected() { return status() == WL_CONNECTED; }
+   bool mode(wifi_mode_t mode);
+   bool setAutoReconnect(bool autoReconnect);
+   IPAddress localIP();
+   IPAddress gatewayIP();
+   IPAddress subnetMask();
+   IPAddress dnsIP(uint8_t dns_no = 0);
+   uint8_t *BSSID();
+   int32_t channel();
+   int hostByName(const char *hostname, IPAddress &result);
+   String macAddress();
+   int8_t RSSI();
+   String SSID();
+};
+
+extern WiFiClass WiFi;
+
+#endif
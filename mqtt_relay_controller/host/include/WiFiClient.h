@@ -0,0 +1,47 @@
+/*
+ WiFiClient.h - host stand-in for the arduino-esp32 TCP client.
+
+ By default the connection is a real POSIX socket, so env:native can talk to
+ an actual broker. A host::Transport installed with host::setTransport()
+ replaces the socket, which is how the benchmark runner scripts the broker.
+*/
+
+#ifndef HOST_WIFI_CLIENT_H
+#define HOST_WIFI_CLIENT_H
+
+#include "Arduino.h"
+#include "Client.h"
+
+namespace host {
+class Transport;
+}
+
+class WiFiClient : public Client {
+public:
+   WiFiClient();
+   ~WiFiClient();
+
+   int connect(IPAddress ip, uint16_t port) override;
+   int connect(const char *host, uint16_t port) override;
+   int connect(IPAddress ip, uint16_t port, int32_t timeoutMs);
+   size_t write(uint8_t data) override;
+   size_t write(const uint8_t *buf, size_t size) override;
+   int available() override;
+   int read() override;
+   int read(uint8_t *buf, size_t size) override;
+   int peek() override;
+   void flush() override;
+   void stop() override;
+   uint8_t connected() override;
+   operator bool() override { return connected(); }
+
+   int setNoDelay(bool nodelay);
+   int fd() const;
+
+private:
+   host::Transport *_transport;
+   bool _ownsTransport;
+   int _peeked;
+};
+
+#endif
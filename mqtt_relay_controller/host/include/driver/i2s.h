@@ -0,0 +1,95 @@
+/*
+ driver/i2s.h - host stand-in for the legacy ESP-IDF I2S driver.
+
+ The microphone is modelled as a DMA ring that fills at the configured
+ sample rate against the host clock. Sample values come from the source
+ installed with host::setI2sSource() (silence by default); samples that are
+ not read before the ring wraps are dropped and counted as an overrun.
+*/
+
+#ifndef HOST_DRIVER_I2S_H
+#define HOST_DRIVER_I2S_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+typedef enum {
+   I2S_NUM_0 = 0,
+   I2S_NUM_1 = 1,
+   I2S_NUM_MAX
+} i2s_port_t;
+
+typedef enum {
+   I2S_MODE_MASTER = (1 << 0),
+   I2S_MODE_SLAVE = (1 << 1),
+   I2S_MODE_TX = (1 << 2),
+   I2S_MODE_RX = (1 << 3)
+} i2s_mode_t;
+
+typedef enum {
+   I2S_BITS_PER_SAMPLE_8BIT = 8,
+   I2S_BITS_PER_SAMPLE_16BIT = 16,
+   I2S_BITS_PER_SAMPLE_24BIT = 24,
+   I2S_BITS_PER_SAMPLE_32BIT = 32
+} i2s_bits_per_sample_t;
+
+typedef enum {
+   I2S_CHANNEL_FMT_RIGHT_LEFT,
+   I2S_CHANNEL_FMT_ALL_RIGHT,
+   I2S_CHANNEL_FMT_ALL_LEFT,
+   I2S_CHANNEL_FMT_ONLY_RIGHT,
+   I2S_CHANNEL_FMT_ONLY_LEFT
+} i2s_channel_fmt_t;
+
+typedef enum {
+   I2S_COMM_FORMAT_STAND_I2S = 0x01,
+   I2S_COMM_FORMAT_STAND_MSB = 0x03,
+   I2S_COMM_FORMAT_STAND_PCM_SHORT = 0x04
+} i2s_comm_format_t;
+
+typedef enum {
+   I2S_EVENT_DMA_ERROR,
+   I2S_EVENT_TX_DONE,
+   I2S_EVENT_RX_DONE,
+   I2S_EVENT_TX_Q_OVF,
+   I2S_EVENT_RX_Q_OVF
+} i2s_event_type_t;
+
+typedef struct {
+   i2s_event_type_t type;
+   size_t size;
+} i2s_event_t;
+
+#define I2S_PIN_NO_CHANGE (-1)
+
+typedef struct {
+   i2s_mode_t mode;
+   uint32_t sample_rate;
+   i2s_bits_per_sample_t bits_per_sample;
+   i2s_channel_fmt_t channel_format;
+   i2s_comm_format_t communication_format;
+   int intr_alloc_flags;
+   int dma_buf_count;
+   int dma_buf_len;
+   bool use_apll;
+   bool tx_desc_auto_clear;
+   int fixed_mclk;
+} i2s_config_t;
+
+typedef struct {
+   int bck_io_num;
+   int ws_io_num;
+   int data_out_num;
+   int data_in_num;
+} i2s_pin_config_t;
+
+esp_err_t i2s_driver_install(i2s_port_t i2s_num, const i2s_config_t *i2s_config, int queue_size, void *i2s_queue);
+esp_err_t i2s_driver_uninstall(i2s_port_t i2s_num);
+esp_err_t i2s_set_pin(i2s_port_t i2s_num, const i2s_pin_config_t *pin);
+esp_err_t i2s_read(i2s_port_t i2s_num, void *dest, size_t size, size_t *bytes_read, TickType_t ticks_to_wait);
+esp_err_t i2s_zero_dma_buffer(i2s_port_t i2s_num);
+
+#endif
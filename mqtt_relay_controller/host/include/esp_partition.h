@@ -0,0 +1,58 @@
+/*
+ esp_partition.h - host stand-in for the ESP-IDF partition API.
+
+ The data partitions from partitions.csv are backed by RAM with NOR flash
+ semantics: erase sets a 4 KB sector to 0xFF, and a write can only clear
+ bits (the new data is ANDed in). Reads, writes and erases advance host time
+ by typical SPI flash timings and are counted (host::flashStats()); reads
+ through a mapping are free.
+*/
+
+#ifndef HOST_ESP_PARTITION_H
+#define HOST_ESP_PARTITION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#define SPI_FLASH_SEC_SIZE 4096
+
+typedef enum {
+   ESP_PARTITION_TYPE_APP = 0x00,
+   ESP_PARTITION_TYPE_DATA = 0x01,
+   ESP_PARTITION_TYPE_ANY = 0xff
+} esp_partition_type_t;
+
+typedef enum {
+   ESP_PARTITION_SUBTYPE_DATA_NVS = 0x02,
+   ESP_PARTITION_SUBTYPE_ANY = 0xff
+} esp_partition_subtype_t;
+
+typedef enum {
+   SPI_FLASH_MMAP_DATA,
+   SPI_FLASH_MMAP_INST
+} spi_flash_mmap_memory_t;
+
+typedef uint32_t spi_flash_mmap_handle_t;
+
+typedef struct {
+   esp_partition_type_t type;
+   esp_partition_subtype_t subtype;
+   uint32_t address;
+   uint32_t size;
+   char label[17];
+   bool encrypted;
+} esp_partition_t;
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label);
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size);
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size);
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size);
+// The partition's backing RAM: writes and erases show through at once, as
+// they do through the flash cache on the chip
+esp_err_t esp_partition_mmap(const esp_partition_t *partition, size_t offset, size_t size,
+                             spi_flash_mmap_memory_t memory, const void **out_ptr, spi_flash_mmap_handle_t *out_handle);
+void spi_flash_munmap(spi_flash_mmap_handle_t handle);
+
+#endif
@@ -0,0 +1,40 @@
+/*
+ esp_timer.h - host stand-in for the ESP-IDF high resolution timer.
+
+ Callbacks run on the caller's thread whenever host time passes their
+ deadline: inside delay()/delayMicroseconds(), host::advanceMicros() and the
+ scheduler's idle wait. This matches ESP_TIMER_TASK dispatch closely enough
+ for code that only needs callbacks to fire at the right firmware time.
+*/
+
+#ifndef HOST_ESP_TIMER_H
+#define HOST_ESP_TIMER_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef struct esp_timer *esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void *arg);
+
+typedef enum {
+   ESP_TIMER_TASK,
+   ESP_TIMER_ISR
+} esp_timer_dispatch_t;
+
+typedef struct {
+   esp_timer_cb_t callback;
+   void *arg;
+   esp_timer_dispatch_t dispatch_method;
+   const char *name;
+   bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle);
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us);
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+esp_err_t esp_timer_delete(esp_timer_handle_t timer);
+int64_t esp_timer_get_time();
+
+#endif
@@ -0,0 +1,30 @@
+/*
+ esp_vfs_eventfd.h - host stand-in for the ESP-IDF eventfd VFS driver.
+
+ Linux has eventfd natively, so registration is a no-op and eventfd() is the
+ libc call.
+*/
+
+#ifndef HOST_ESP_VFS_EVENTFD_H
+#define HOST_ESP_VFS_EVENTFD_H
+
+#include <stddef.h>
+#include <sys/eventfd.h>
+
+#include "esp_err.h"
+
+// Linux eventfd writes are always async-signal-safe
+#define EFD_SUPPORT_ISR 0
+
+typedef struct {
+   size_t max_fds;
+} esp_vfs_eventfd_config_t;
+
+#define ESP_VFS_EVENTD_CONFIG_DEFAULT() {5}
+
+inline esp_err_t esp_vfs_eventfd_register(const esp_vfs_eventfd_config_t *config) {
+   (void)config;
+   return ESP_OK;
+}
+
+#endif
@@ -0,0 +1,35 @@
+/*
+ FreeRTOS.h - host stand-in for the FreeRTOS tick types and critical
+ section macros used by ESP-IDF APIs.
+*/
+
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define portMAX_DELAY        ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS   ((TickType_t)1)
+#define pdMS_TO_TICKS(ms)    ((TickType_t)(ms))
+#define pdTRUE               1
+#define pdFALSE              0
+#define pdPASS               pdTRUE
+#define pdFAIL               pdFALSE
+
+// The host runs the firmware on one thread, so critical sections are empty
+typedef struct {
+   uint32_t owner;
+   uint32_t count;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED  {0, 0}
+#define portENTER_CRITICAL(mux)       ((void)(mux))
+#define portEXIT_CRITICAL(mux)        ((void)(mux))
+#define portENTER_CRITICAL_ISR(mux)   ((void)(mux))
+#define portEXIT_CRITICAL_ISR(mux)    ((void)(mux))
+
+#endif
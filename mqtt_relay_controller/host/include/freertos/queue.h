@@ -0,0 +1,32 @@
+/*
+ freertos/queue.h - host stand-in for FreeRTOS queues.
+
+ Fixed-size item queues from a static pool. Sending never blocks. A receive
+ from a task (freertos/task.h) with portMAX_DELAY suspends the task until an
+ item is sent; any other wait in a task returns at once. A receive with a
+ timeout outside a task advances host time until an item arrives or the
+ timeout passes, so items sent by the host drivers as time passes (e.g. I2S
+ events) are seen at the right moment.
+*/
+
+#ifndef HOST_FREERTOS_QUEUE_H
+#define HOST_FREERTOS_QUEUE_H
+
+#include "FreeRTOS.h"
+
+typedef struct HostQueue *QueueHandle_t;
+
+#define errQUEUE_FULL   ((BaseType_t)0)
+#define errQUEUE_EMPTY  ((BaseType_t)0)
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize);
+void vQueueDelete(QueueHandle_t queue);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticksToWait);
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *higherPriorityTaskWoken);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticksToWait);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+BaseType_t xQueueReset(QueueHandle_t queue);
+
+#define xQueueSendToBack(queue, item, ticks) xQueueSend(queue, item, ticks)
+
+#endif
@@ -0,0 +1,33 @@
+/*
+ freertos/task.h - host stand-in for FreeRTOS task creation.
+
+ A task runs as a coroutine on its own stack, on the caller's thread. It
+ starts as soon as it is created and runs until it blocks in xQueueReceive();
+ a send to that queue resumes it before the sender continues. That is how a
+ higher-priority task on the other core behaves as seen from the loop task:
+ it reacts to its events at the moment they happen, and takes no host time.
+ Core and priority are recorded, the requested stack depth is not used.
+*/
+
+#ifndef HOST_FREERTOS_TASK_H
+#define HOST_FREERTOS_TASK_H
+
+#include "FreeRTOS.h"
+
+typedef void (*TaskFunction_t)(void *arg);
+typedef struct HostTask *TaskHandle_t;
+
+#define tskNO_AFFINITY        ((BaseType_t)0x7FFFFFFF)
+#define tskIDLE_PRIORITY      ((UBaseType_t)0)
+#define configMAX_PRIORITIES  25
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stackDepth, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core);
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stackDepth, void *arg,
+                       UBaseType_t priority, TaskHandle_t *handle);
+// NULL deletes the calling task
+void vTaskDelete(TaskHandle_t task);
+TickType_t xTaskGetTickCount();
+BaseType_t xPortGetCoreID();
+
+#endif
@@ -0,0 +1,47 @@
+/*
+ soc/gpio_struct.h - host stand-in for the ESP32 GPIO register block.
+
+ Only the output registers are modelled. Writing a mask to out_w1ts /
+ out_w1tc (GPIO0-31) or out1_w1ts.val / out1_w1tc.val (GPIO32-39) sets or
+ clears every pin in the mask at the same host time, and counts as one
+ register write (host::gpioRegisterWrites()).
+*/
+
+#ifndef HOST_SOC_GPIO_STRUCT_H
+#define HOST_SOC_GPIO_STRUCT_H
+
+#include <stdint.h>
+
+namespace host {
+void gpioStrobe(int bank, bool set, uint32_t mask);
+uint32_t gpioOut(int bank);
+}
+
+template <int BANK, bool SET>
+struct HostGpioStrobe {
+   void operator=(uint32_t mask) { host::gpioStrobe(BANK, SET, mask); }
+};
+
+template <int BANK>
+struct HostGpioOut {
+   operator uint32_t() const { return host::gpioOut(BANK); }
+};
+
+typedef struct {
+   HostGpioOut<0> out;
+   HostGpioStrobe<0, true> out_w1ts;
+   HostGpioStrobe<0, false> out_w1tc;
+   struct {
+      HostGpioOut<1> val;
+   } out1;
+   struct {
+      HostGpioStrobe<1, true> val;
+   } out1_w1ts;
+   struct {
+      HostGpioStrobe<1, false> val;
+   } out1_w1tc;
+} gpio_dev_t;
+
+extern gpio_dev_t GPIO;
+
+#endif
@@ -0,0 +1,16 @@
+/*
+ native_main.cpp - entry point for env:native.
+
+ Runs the unmodified firmware on Linux against a real MQTT broker, with the
+ HAL shims standing in for the ESP32 peripherals.
+*/
+
+void setup();
+void loop();
+
+int main() {
+   setup();
+   for (;;) {
+      loop();
+   }
+}
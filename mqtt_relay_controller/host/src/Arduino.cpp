@@ -0,0 +1,375 @@
+/*
+ Arduino.cpp - host implementation of the core Arduino runtime: clock,
+ GPIO, random numbers, console and EspClass.
+*/
+
+#include "Arduino.h"
+#include "HostHal.h"
+#include "soc/gpio_struct.h"
+
+#include <time.h>
+#include <sched.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace {
+
+const int NUM_PINS = 40;
+
+bool virtualClockEnabled = false;
+uint64_t virtualNowUs = 0;
+bool serialEcho = true;
+
+uint8_t pinLevels[NUM_PINS];
+uint8_t pinModes[NUM_PINS];
+uint32_t pinWriteCounts[NUM_PINS];
+uint64_t pinChangedAt[NUM_PINS];
+uint32_t gpioRegisterWriteCount = 0;
+
+uint32_t randomState = 0x9E3779B9;
+
+const int NUM_LEDC_CHANNELS = 16;
+const int TONE_LOG_SIZE = 64;
+
+struct LedcChannel {
+   double frequency;
+   uint32_t duty;
+   int pin;  // -1 when detached
+};
+
+LedcChannel ledcChannels[NUM_LEDC_CHANNELS];
+bool ledcInitialised = false;
+uint32_t pinTone[NUM_PINS];
+host::ToneEvent toneLog[TONE_LOG_SIZE];
+size_t toneLogCount = 0;  // Total recorded; the ring holds the last TONE_LOG_SIZE
+
+uint64_t monotonicMicros() {
+   static struct timespec start = {0, 0};
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   if (start.tv_sec == 0 && start.tv_nsec == 0) {
+      start = ts;
+   }
+   return (uint64_t)(ts.tv_sec - start.tv_sec) * 1000000ULL + (ts.tv_nsec - start.tv_nsec) / 1000;
+}
+
+void sleepMicros(uint64_t us) {
+   struct timespec ts;
+   ts.tv_sec = us / 1000000ULL;
+   ts.tv_nsec = (us % 1000000ULL) * 1000;
+   nanosleep(&ts, NULL);
+}
+
+void ledcInit() {
+   if (ledcInitialised) return;
+   for (int i = 0; i < NUM_LEDC_CHANNELS; i++) ledcChannels[i].pin = -1;
+   ledcInitialised = true;
+}
+
+// Record the audible output of a channel's pin when it changes
+void ledcUpdatePin(const LedcChannel &channel) {
+   if (channel.pin < 0 || channel.pin >= NUM_PINS) return;
+   uint32_t frequency = channel.duty != 0 ? (uint32_t)(channel.frequency + 0.5) : 0;
+   if (frequency == pinTone[channel.pin]) return;
+   pinTone[channel.pin] = frequency;
+   host::ToneEvent &event = toneLog[toneLogCount % TONE_LOG_SIZE];
+   event.atMicros = host::nowMicros();
+   event.pin = (uint8_t)channel.pin;
+   event.frequency = frequency;
+   toneLogCount++;
+}
+
+uint32_t nextRandom() {
+   // xorshift32: deterministic across runs unless randomSeed() is called
+   uint32_t x = randomState;
+   x ^= x << 13;
+   x ^= x >> 17;
+   x ^= x << 5;
+   randomState = x;
+   return x;
+}
+
+} // namespace
+
+namespace host {
+
+void setVirtualClock(bool enabled) {
+   if (enabled && !virtualClockEnabled) {
+      virtualNowUs = monotonicMicros();
+   }
+   virtualClockEnabled = enabled;
+}
+
+bool virtualClock() {
+   return virtualClockEnabled;
+}
+
+void advanceMicros(uint64_t us) {
+   uint64_t target = nowMicros() + us;
+   for (;;) {
+      uint64_t next = nextTimerMicros();
+      uint64_t i2s = nextI2sEventMicros();
+      if (i2s < next) next = i2s;
+      uint64_t until = next < target ? next : target;
+      uint64_t now = nowMicros();
+      if (until > now) {
+         if (virtualClockEnabled) {
+            virtualNowUs = until;
+         } else {
+            sleepMicros(until - now);
+         }
+      }
+      if (next > target) return;
+      runDueTimers();
+      sendDueI2sEvents();
+   }
+}
+
+uint64_t nowMicros() {
+   return virtualClockEnabled ? virtualNowUs : monotonicMicros();
+}
+
+uint64_t cycleCounter() {
+#if defined(__x86_64__) || defined(__i386__)
+   return __rdtsc();
+#elif defined(__aarch64__)
+   uint64_t value;
+   asm volatile("mrs %0, cntvct_el0" : "=r"(value));
+   return value;
+#else
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+void setSerialEcho(bool enabled) {
+   serialEcho = enabled;
+}
+
+int pinLevel(uint8_t pin) {
+   return pin < NUM_PINS ? pinLevels[pin] : LOW;
+}
+
+int pinMode(uint8_t pin) {
+   return pin < NUM_PINS ? pinModes[pin] : 0;
+}
+
+uint32_t pinWrites(uint8_t pin) {
+   return pin < NUM_PINS ? pinWriteCounts[pin] : 0;
+}
+
+uint64_t pinChangedAtMicros(uint8_t pin) {
+   return pin < NUM_PINS ? pinChangedAt[pin] : 0;
+}
+
+size_t toneEvents(ToneEvent *out, size_t max) {
+   size_t available = toneLogCount < (size_t)TONE_LOG_SIZE ? toneLogCount : TONE_LOG_SIZE;
+   size_t n = available < max ? available : max;
+   size_t first = toneLogCount - available;
+   for (size_t i = 0; i < n; i++) out[i] = toneLog[(first + i) % TONE_LOG_SIZE];
+   return n;
+}
+
+void clearToneEvents() {
+   toneLogCount = 0;
+}
+
+uint32_t pinToneFrequency(uint8_t pin) {
+   return pin < NUM_PINS ? pinTone[pin] : 0;
+}
+
+} // namespace host
+
+unsigned long millis() {
+   return (unsigned long)(host::nowMicros() / 1000ULL);
+}
+
+unsigned long micros() {
+   return (unsigned long)host::nowMicros();
+}
+
+void delay(uint32_t ms) {
+   host::advanceMicros((uint64_t)ms * 1000ULL);
+}
+
+void delayMicroseconds(uint32_t us) {
+   host::advanceMicros(us);
+}
+
+void yield() {
+   if (!host::virtualClock()) {
+      sched_yield();
+   }
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+   if (pin < NUM_PINS) pinModes[pin] = mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+   if (pin < NUM_PINS) {
+      uint8_t level = val ? HIGH : LOW;
+      if (level != pinLevels[pin]) pinChangedAt[pin] = host::nowMicros();
+      pinLevels[pin] = level;
+      pinWriteCounts[pin]++;
+   }
+}
+
+gpio_dev_t GPIO;
+
+namespace host {
+
+void gpioStrobe(int bank, bool set, uint32_t mask) {
+   uint64_t now = nowMicros();
+   uint8_t level = set ? HIGH : LOW;
+   for (int bit = 0; bit < 32; bit++) {
+      int pin = bank * 32 + bit;
+      if ((mask & (1UL << bit)) == 0 || pin >= NUM_PINS) continue;
+      if (level != pinLevels[pin]) pinChangedAt[pin] = now;
+      pinLevels[pin] = level;
+      pinWriteCounts[pin]++;
+   }
+   gpioRegisterWriteCount++;
+}
+
+uint32_t gpioOut(int bank) {
+   uint32_t value = 0;
+   for (int bit = 0; bit < 32 && bank * 32 + bit < NUM_PINS; bit++) {
+      if (pinLevels[bank * 32 + bit]) value |= 1UL << bit;
+   }
+   return value;
+}
+
+uint32_t gpioRegisterWrites() {
+   return gpioRegisterWriteCount;
+}
+
+} // namespace host
+
+int digitalRead(uint8_t pin) {
+   return host::pinLevel(pin);
+}
+
+double ledcSetup(uint8_t channel, double freq, uint8_t resolution_bits) {
+   ledcInit();
+   if (channel >= NUM_LEDC_CHANNELS || resolution_bits == 0 || resolution_bits > 20) return 0;
+   ledcChannels[channel].frequency = freq;
+   ledcUpdatePin(ledcChannels[channel]);
+   return freq;
+}
+
+void ledcWrite(uint8_t channel, uint32_t duty) {
+   ledcInit();
+   if (channel >= NUM_LEDC_CHANNELS) return;
+   ledcChannels[channel].duty = duty;
+   ledcUpdatePin(ledcChannels[channel]);
+}
+
+double ledcWriteTone(uint8_t channel, double freq) {
+   // Same as the core: 0 Hz silences the channel, otherwise 50% duty at 10 bits
+   if (freq <= 0) {
+      ledcWrite(channel, 0);
+      return 0;
+   }
+   double actual = ledcSetup(channel, freq, 10);
+   ledcWrite(channel, 0x1FF);
+   return actual;
+}
+
+void ledcAttachPin(uint8_t pin, uint8_t channel) {
+   ledcInit();
+   if (pin >= NUM_PINS || channel >= NUM_LEDC_CHANNELS) return;
+   ledcChannels[channel].pin = pin;
+   ledcUpdatePin(ledcChannels[channel]);
+}
+
+void ledcDetachPin(uint8_t pin) {
+   ledcInit();
+   for (int i = 0; i < NUM_LEDC_CHANNELS; i++) {
+      if (ledcChannels[i].pin == pin) {
+         LedcChannel silent = ledcChannels[i];
+         silent.duty = 0;
+         ledcUpdatePin(silent);
+         ledcChannels[i].pin = -1;
+      }
+   }
+}
+
+long random(long howbig) {
+   if (howbig <= 0) return 0;
+   return nextRandom() % howbig;
+}
+
+long random(long howsmall, long howbig) {
+   if (howsmall >= howbig) return howsmall;
+   return random(howbig - howsmall) + howsmall;
+}
+
+void randomSeed(unsigned long seed) {
+   if (seed != 0) randomState = (uint32_t)seed;
+}
+
+// --- Serial ----------------------------------------------------------------
+
+HardwareSerial Serial;
+
+void HardwareSerial::begin(unsigned long baud) {
+   (void)baud;
+}
+
+void HardwareSerial::end() {
+}
+
+void HardwareSerial::flush() {
+   if (serialEcho) fflush(stdout);
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+   if (serialEcho) fputc(c, stdout);
+   return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+   if (serialEcho) fwrite(buffer, 1, size, stdout);
+   return size;
+}
+
+// --- ESP -------------------------------------------------------------------
+
+EspClass ESP;
+
+static const uint32_t HOST_HEAP_SIZE = 320 * 1024;  // Typical ESP32 DRAM heap
+
+uint32_t EspClass::getHeapSize() {
+   return HOST_HEAP_SIZE;
+}
+
+uint32_t EspClass::getFreeHeap() {
+   int64_t live = host::heapStats().bytesLive;
+   return live >= (int64_t)HOST_HEAP_SIZE ? 0 : HOST_HEAP_SIZE - (uint32_t)live;
+}
+
+uint32_t EspClass::getMinFreeHeap() {
+   int64_t peak = host::heapStats().peakBytesLive;
+   return peak >= (int64_t)HOST_HEAP_SIZE ? 0 : HOST_HEAP_SIZE - (uint32_t)peak;
+}
+
+uint32_t EspClass::getCpuFreqMHz() {
+   return 240;
+}
+
+uint32_t EspClass::getCycleCount() {
+   return (uint32_t)host::cycleCounter();
+}
+
+uint64_t EspClass::getEfuseMac() {
+   return 0x010000286F24ULL;  // 24:6F:28:00:00:01, little-endian like the eFuse
+}
+
+void EspClass::restart() {
+   fflush(stdout);
+   exit(0);
+}
@@ -0,0 +1,68 @@
+/*
+ ArduinoOTA.cpp - host stand-in for the arduino-esp32 OTA service.
+*/
+
+#include "ArduinoOTA.h"
+
+ArduinoOTAClass ArduinoOTA;
+
+ArduinoOTAClass &ArduinoOTAClass::setPort(uint16_t port) {
+   (void)port;
+   return *this;
+}
+
+ArduinoOTAClass &ArduinoOTAClass::setHostname(const char *hostname) {
+   (void)hostname;
+   return *this;
+}
+
+ArduinoOTAClass &ArduinoOTAClass::setPassword(const char *password) {
+   (void)password;
+   return *this;
+}
+
+ArduinoOTAClass &ArduinoOTAClass::onStart(THandlerFunction fn) {
+   _start_callback = fn;
+   return *this;
+}
+
+ArduinoOTAClass &ArduinoOTAClass::onEnd(THandlerFunction fn) {
+   _end_callback = fn;
+   return *this;
+}
+
+ArduinoOTAClass &ArduinoOTAClass::onError(THandlerFunction_Error fn) {
+   _error_callback = fn;
+   return *this;
+}
+
+ArduinoOTAClass &ArduinoOTAClass::onProgress(THandlerFunction_Progress fn) {
+   _progress_callback = fn;
+   return *this;
+}
+
+void ArduinoOTAClass::begin() {
+}
+
+void ArduinoOTAClass::end() {
+}
+
+void ArduinoOTAClass::handle() {
+}
+
+int ArduinoOTAClass::getCommand() {
+   return _cmd;
+}
+
+void ArduinoOTAClass::simulateUpdate(bool fail) {
+   if (_start_callback) _start_callback();
+   if (_progress_callback) {
+      _progress_callback(50, 100);
+      _progress_callback(100, 100);
+   }
+   if (fail) {
+      if (_error_callback) _error_callback(OTA_RECEIVE_ERROR);
+   } else {
+      if (_end_callback) _end_callback();
+   }
+}
@@ -0,0 +1,69 @@
+/*
+ EEPROM.cpp - host stand-in for the arduino-esp32 EEPROM emulation.
+*/
+
+#include "EEPROM.h"
+#include "HostHal.h"
+
+#include <stdlib.h>
+
+namespace {
+uint32_t commits = 0;
+}
+
+namespace host {
+
+uint32_t eepromCommits() {
+   return commits;
+}
+
+} // namespace host
+
+EEPROMClass EEPROM;
+
+EEPROMClass::EEPROMClass() : _data(NULL), _size(0), _dirty(false) {
+}
+
+EEPROMClass::~EEPROMClass() {
+   end();
+}
+
+bool EEPROMClass::begin(size_t size) {
+   if (size == 0) return false;
+   if (_data != NULL && _size == size) return true;
+   uint8_t *data = (uint8_t *)realloc(_data, size);
+   if (data == NULL) return false;
+   // Erased flash reads back as 0xFF on target
+   if (size > _size) memset(data + _size, 0xFF, size - _size);
+   _data = data;
+   _size = size;
+   return true;
+}
+
+uint8_t EEPROMClass::read(int address) {
+   if (address < 0 || (size_t)address >= _size) return 0;
+   return _data[address];
+}
+
+void EEPROMClass::write(int address, uint8_t val) {
+   if (address < 0 || (size_t)address >= _size) return;
+   if (_data[address] != val) {
+      _data[address] = val;
+      _dirty = true;
+   }
+}
+
+bool EEPROMClass::commit() {
+   if (_data == NULL) return false;
+   if (!_dirty) return true;
+   commits++;
+   _dirty = false;
+   return true;
+}
+
+void EEPROMClass::end() {
+   free(_data);
+   _data = NULL;
+   _size = 0;
+   _dirty = false;
+}
@@ -0,0 +1,90 @@
+/*
+ HeapCounter.cpp - counts every heap operation made by the host build.
+
+ malloc & co. are interposed and forwarded to glibc's __libc_* entry points.
+ operator new/delete end up here too since libstdc++ implements them on top
+ of malloc/free. Linux/glibc only, like the rest of the host shims.
+*/
+
+#include "HostHal.h"
+
+#include <malloc.h>
+#include <stddef.h>
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t nmemb, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+}
+
+namespace {
+
+host::HeapStats stats;
+
+void recordAlloc(void *ptr) {
+   if (ptr == NULL) return;
+   size_t usable = malloc_usable_size(ptr);
+   stats.bytesAllocated += usable;
+   stats.bytesLive += usable;
+   if (stats.bytesLive > stats.peakBytesLive) {
+      stats.peakBytesLive = stats.bytesLive;
+   }
+}
+
+void recordFree(void *ptr) {
+   if (ptr == NULL) return;
+   stats.frees++;
+   stats.bytesLive -= malloc_usable_size(ptr);
+}
+
+} // namespace
+
+namespace host {
+
+HeapStats heapStats() {
+   return stats;
+}
+
+} // namespace host
+
+extern "C" {
+
+void *malloc(size_t size) {
+   void *ptr = __libc_malloc(size);
+   stats.allocations++;
+   recordAlloc(ptr);
+   return ptr;
+}
+
+void *calloc(size_t nmemb, size_t size) {
+   void *ptr = __libc_calloc(nmemb, size);
+   stats.allocations++;
+   recordAlloc(ptr);
+   return ptr;
+}
+
+void *realloc(void *ptr, size_t size) {
+   if (ptr == NULL) {
+      return malloc(size);
+   }
+   size_t before = malloc_usable_size(ptr);
+   void *result = __libc_realloc(ptr, size);
+   stats.reallocations++;
+   if (result != NULL) {
+      size_t after = malloc_usable_size(result);
+      stats.bytesLive += (int64_t)after - (int64_t)before;
+      if (after > before) stats.bytesAllocated += after - before;
+      if (stats.bytesLive > stats.peakBytesLive) {
+         stats.peakBytesLive = stats.bytesLive;
+      }
+   }
+   return result;
+}
+
+void free(void *ptr) {
+   recordFree(ptr);
+   __libc_free(ptr);
+}
+
+}
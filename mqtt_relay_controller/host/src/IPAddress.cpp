@@ -0,0 +1,43 @@
+/*
+ IPAddress.cpp - host stand-in for the Arduino IPAddress class.
+*/
+
+#include "Arduino.h"
+#include "IPAddress.h"
+
+bool IPAddress::fromString(const char *address) {
+   uint16_t acc = 0;
+   uint8_t dots = 0;
+   while (*address) {
+      char c = *address++;
+      if (c >= '0' && c <= '9') {
+         acc = acc * 10 + (c - '0');
+         if (acc > 255) return false;
+      } else if (c == '.') {
+         if (dots == 3) return false;
+         _bytes[dots++] = acc;
+         acc = 0;
+      } else {
+         return false;
+      }
+   }
+   if (dots != 3) return false;
+   _bytes[3] = acc;
+   return true;
+}
+
+String IPAddress::toString() const {
+   char szRet[16];
+   snprintf(szRet, sizeof(szRet), "%u.%u.%u.%u", _bytes[0], _bytes[1], _bytes[2], _bytes[3]);
+   return String(szRet);
+}
+
+size_t IPAddress::printTo(Print &p) const {
+   size_t n = 0;
+   for (int i = 0; i < 3; i++) {
+      n += p.print(_bytes[i], DEC);
+      n += p.print('.');
+   }
+   n += p.print(_bytes[3], DEC);
+   return n;
+}
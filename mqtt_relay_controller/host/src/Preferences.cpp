@@ -0,0 +1,147 @@
+/*
+ Preferences.cpp - host stand-in for the arduino-esp32 NVS key/value store.
+*/
+
+#include "Preferences.h"
+#include "HostHal.h"
+
+#include <string.h>
+
+namespace {
+
+const int MAX_NAMESPACES = 8;
+const int MAX_ENTRIES = 32;
+const size_t MAX_NAME = 16;   // NVS key and namespace limit (15 chars + NUL)
+const size_t MAX_VALUE = 128;
+
+struct Entry {
+   int ns;
+   char key[MAX_NAME];
+   uint8_t value[MAX_VALUE];
+   size_t length;
+   bool used;
+};
+
+char namespaces[MAX_NAMESPACES][MAX_NAME];
+Entry entries[MAX_ENTRIES];
+uint32_t writes = 0;
+
+Entry *findEntry(int ns, const char *key) {
+   for (int i = 0; i < MAX_ENTRIES; i++) {
+      if (entries[i].used && entries[i].ns == ns && strcmp(entries[i].key, key) == 0) {
+         return &entries[i];
+      }
+   }
+   return NULL;
+}
+
+} // namespace
+
+namespace host {
+
+uint32_t nvsWrites() {
+   return writes;
+}
+
+void nvsErase() {
+   memset(namespaces, 0, sizeof(namespaces));
+   memset(entries, 0, sizeof(entries));
+}
+
+} // namespace host
+
+Preferences::Preferences() : _namespace(-1), _readOnly(false) {
+}
+
+Preferences::~Preferences() {
+   end();
+}
+
+bool Preferences::begin(const char *name, bool readOnly, const char *partition_label) {
+   (void)partition_label;
+   if (name == NULL || strlen(name) >= MAX_NAME) return false;
+   _readOnly = readOnly;
+   for (int i = 0; i < MAX_NAMESPACES; i++) {
+      if (strcmp(namespaces[i], name) == 0) {
+         _namespace = i;
+         return true;
+      }
+   }
+   if (readOnly) return false;  // NVS refuses to create a namespace read-only
+   for (int i = 0; i < MAX_NAMESPACES; i++) {
+      if (namespaces[i][0] == 0) {
+         strcpy(namespaces[i], name);
+         _namespace = i;
+         return true;
+      }
+   }
+   return false;
+}
+
+void Preferences::end() {
+   _namespace = -1;
+}
+
+bool Preferences::clear() {
+   if (_namespace < 0 || _readOnly) return false;
+   for (int i = 0; i < MAX_ENTRIES; i++) {
+      if (entries[i].ns == _namespace) entries[i].used = false;
+   }
+   writes++;
+   return true;
+}
+
+bool Preferences::remove(const char *key) {
+   if (_namespace < 0 || _readOnly) return false;
+   Entry *entry = findEntry(_namespace, key);
+   if (entry == NULL) return false;
+   entry->used = false;
+   writes++;
+   return true;
+}
+
+bool Preferences::isKey(const char *key) {
+   return _namespace >= 0 && findEntry(_namespace, key) != NULL;
+}
+
+size_t Preferences::putUInt(const char *key, uint32_t value) {
+   return putBytes(key, &value, sizeof(value));
+}
+
+uint32_t Preferences::getUInt(const char *key, uint32_t defaultValue) {
+   uint32_t value = defaultValue;
+   if (getBytesLength(key) == sizeof(value)) getBytes(key, &value, sizeof(value));
+   return value;
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t len) {
+   if (_namespace < 0 || _readOnly || key == NULL || strlen(key) >= MAX_NAME || len > MAX_VALUE) return 0;
+   Entry *entry = findEntry(_namespace, key);
+   for (int i = 0; entry == NULL && i < MAX_ENTRIES; i++) {
+      if (!entries[i].used) {
+         entry = &entries[i];
+         entry->used = true;
+         entry->ns = _namespace;
+         strcpy(entry->key, key);
+      }
+   }
+   if (entry == NULL) return 0;
+   memcpy(entry->value, value, len);
+   entry->length = len;
+   writes++;
+   return len;
+}
+
+size_t Preferences::getBytesLength(const char *key) {
+   if (_namespace < 0) return 0;
+   Entry *entry = findEntry(_namespace, key);
+   return entry != NULL ? entry->length : 0;
+}
+
+size_t Preferences::getBytes(const char *key, void *buf, size_t maxLen) {
+   if (_namespace < 0) return 0;
+   Entry *entry = findEntry(_namespace, key);
+   if (entry == NULL || entry->length > maxLen) return 0;
+   memcpy(buf, entry->value, entry->length);
+   return entry->length;
+}
@@ -0,0 +1,192 @@
+/*
+ Print.cpp - host stand-in for the Arduino Print class.
+*/
+
+#include "Print.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+   size_t n = 0;
+   while (size--) {
+      n += write(*buffer++);
+   }
+   return n;
+}
+
+// Same strategy as arduino-esp32: format into a stack buffer and only fall
+// back to the heap for long lines
+size_t Print::printf(const char *format, ...) {
+   char loc_buf[64];
+   char *temp = loc_buf;
+   va_list arg;
+   va_list copy;
+   va_start(arg, format);
+   va_copy(copy, arg);
+   int len = vsnprintf(temp, sizeof(loc_buf), format, copy);
+   va_end(copy);
+   if (len < 0) {
+      va_end(arg);
+      return 0;
+   }
+   if (len >= (int)sizeof(loc_buf)) {
+      temp = (char *)malloc(len + 1);
+      if (temp == NULL) {
+         va_end(arg);
+         return 0;
+      }
+      len = vsnprintf(temp, len + 1, format, arg);
+   }
+   va_end(arg);
+   len = write((uint8_t *)temp, len);
+   if (temp != loc_buf) {
+      free(temp);
+   }
+   return len;
+}
+
+static size_t printNumber(Print &p, unsigned long long n, bool negative, int base) {
+   char buf[66];
+   char *str = &buf[sizeof(buf) - 1];
+   *str = '\0';
+   if (base < 2) base = 10;
+   do {
+      char c = n % base;
+      n /= base;
+      *--str = c < 10 ? c + '0' : c + 'A' - 10;
+   } while (n);
+   if (negative) *--str = '-';
+   return p.write(str);
+}
+
+static size_t printSigned(Print &p, long long n, int base) {
+   if (base == 10 && n < 0) {
+      return printNumber(p, 0ULL - (unsigned long long)n, true, base);
+   }
+   return printNumber(p, (unsigned long long)n, false, base);
+}
+
+size_t Print::print(const __FlashStringHelper *ifsh) {
+   return print(reinterpret_cast<const char *>(ifsh));
+}
+
+size_t Print::print(const String &s) {
+   return write(s.c_str(), s.length());
+}
+
+size_t Print::print(const char str[]) {
+   return write(str);
+}
+
+size_t Print::print(char c) {
+   return write((uint8_t)c);
+}
+
+size_t Print::print(unsigned char b, int base) {
+   return printNumber(*this, b, false, base);
+}
+
+size_t Print::print(int n, int base) {
+   return printSigned(*this, n, base);
+}
+
+size_t Print::print(unsigned int n, int base) {
+   return printNumber(*this, n, false, base);
+}
+
+size_t Print::print(long n, int base) {
+   return printSigned(*this, n, base);
+}
+
+size_t Print::print(unsigned long n, int base) {
+   return printNumber(*this, n, false, base);
+}
+
+size_t Print::print(long long n, int base) {
+   return printSigned(*this, n, base);
+}
+
+size_t Print::print(unsigned long long n, int base) {
+   return printNumber(*this, n, false, base);
+}
+
+size_t Print::print(double n, int digits) {
+   char buf[48];
+   snprintf(buf, sizeof(buf), "%.*f", digits, n);
+   return write(buf);
+}
+
+size_t Print::print(const Printable &x) {
+   return x.printTo(*this);
+}
+
+size_t Print::println(void) {
+   return write("\r\n");
+}
+
+size_t Print::println(const __FlashStringHelper *ifsh) {
+   size_t n = print(ifsh);
+   return n + println();
+}
+
+size_t Print::println(const String &s) {
+   size_t n = print(s);
+   return n + println();
+}
+
+size_t Print::println(const char c[]) {
+   size_t n = print(c);
+   return n + println();
+}
+
+size_t Print::println(char c) {
+   size_t n = print(c);
+   return n + println();
+}
+
+size_t Print::println(unsigned char b, int base) {
+   size_t n = print(b, base);
+   return n + println();
+}
+
+size_t Print::println(int num, int base) {
+   size_t n = print(num, base);
+   return n + println();
+}
+
+size_t Print::println(unsigned int num, int base) {
+   size_t n = print(num, base);
+   return n + println();
+}
+
+size_t Print::println(long num, int base) {
+   size_t n = print(num, base);
+   return n + println();
+}
+
+size_t Print::println(unsigned long num, int base) {
+   size_t n = print(num, base);
+   return n + println();
+}
+
+size_t Print::println(long long num, int base) {
+   size_t n = print(num, base);
+   return n + println();
+}
+
+size_t Print::println(unsigned long long num, int base) {
+   size_t n = print(num, base);
+   return n + println();
+}
+
+size_t Print::println(double num, int digits) {
+   size_t n = print(num, digits);
+   return n + println();
+}
+
+size_t Print::println(const Printable &x) {
+   size_t n = print(x);
+   return n + println();
+}
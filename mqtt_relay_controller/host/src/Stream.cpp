@@ -0,0 +1,27 @@
+/*
+ Stream.cpp - host stand-in for the Arduino Stream class.
+*/
+
+#include "Arduino.h"
+#include "Stream.h"
+
+int Stream::timedRead() {
+   unsigned long start = millis();
+   do {
+      int c = read();
+      if (c >= 0) return c;
+      yield();
+   } while (millis() - start < _timeout);
+   return -1;
+}
+
+size_t Stream::readBytes(char *buffer, size_t length) {
+   size_t count = 0;
+   while (count < length) {
+      int c = timedRead();
+      if (c < 0) break;
+      *buffer++ = (char)c;
+      count++;
+   }
+   return count;
+}
@@ -0,0 +1,372 @@
+/*
+ WString.cpp - host stand-in for the Arduino String class.
+*/
+
+#include "WString.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+static void formatInteger(char *buf, size_t size, unsigned long long value, bool negative, unsigned char base) {
+   char tmp[66];
+   int pos = 0;
+   if (base < 2) base = 10;
+   do {
+      unsigned digit = value % base;
+      tmp[pos++] = digit < 10 ? '0' + digit : 'a' + digit - 10;
+      value /= base;
+   } while (value > 0);
+   size_t out = 0;
+   if (negative && out + 1 < size) buf[out++] = '-';
+   while (pos > 0 && out + 1 < size) {
+      buf[out++] = tmp[--pos];
+   }
+   buf[out] = 0;
+}
+
+static void formatSigned(char *buf, size_t size, long long value, unsigned char base) {
+   if (value < 0 && base == 10) {
+      formatInteger(buf, size, 0ULL - (unsigned long long)value, true, base);
+   } else {
+      formatInteger(buf, size, (unsigned long long)value, false, base);
+   }
+}
+
+String::String(const char *cstr) {
+   init();
+   if (cstr) copy(cstr, strlen(cstr));
+}
+
+String::String(const char *cstr, unsigned int length) {
+   init();
+   if (cstr) copy(cstr, length);
+}
+
+String::String(const String &value) {
+   init();
+   *this = value;
+}
+
+String::String(String &&rval) {
+   init();
+   move(rval);
+}
+
+String::String(const __FlashStringHelper *str) {
+   init();
+   if (str) copy(reinterpret_cast<const char *>(str), strlen(reinterpret_cast<const char *>(str)));
+}
+
+String::String(char c) {
+   init();
+   char buf[2] = {c, 0};
+   *this = buf;
+}
+
+String::String(unsigned char value, unsigned char base) {
+   init();
+   char buf[9];
+   formatInteger(buf, sizeof(buf), value, false, base);
+   *this = buf;
+}
+
+String::String(int value, unsigned char base) {
+   init();
+   char buf[34];
+   formatSigned(buf, sizeof(buf), value, base);
+   *this = buf;
+}
+
+String::String(unsigned int value, unsigned char base) {
+   init();
+   char buf[33];
+   formatInteger(buf, sizeof(buf), value, false, base);
+   *this = buf;
+}
+
+String::String(long value, unsigned char base) {
+   init();
+   char buf[66];
+   formatSigned(buf, sizeof(buf), value, base);
+   *this = buf;
+}
+
+String::String(unsigned long value, unsigned char base) {
+   init();
+   char buf[66];
+   formatInteger(buf, sizeof(buf), value, false, base);
+   *this = buf;
+}
+
+String::String(long long value, unsigned char base) {
+   init();
+   char buf[66];
+   formatSigned(buf, sizeof(buf), value, base);
+   *this = buf;
+}
+
+String::String(unsigned long long value, unsigned char base) {
+   init();
+   char buf[66];
+   formatInteger(buf, sizeof(buf), value, false, base);
+   *this = buf;
+}
+
+String::String(float value, unsigned char decimalPlaces) {
+   init();
+   char buf[48];
+   snprintf(buf, sizeof(buf), "%.*f", decimalPlaces, (double)value);
+   *this = buf;
+}
+
+String::String(double value, unsigned char decimalPlaces) {
+   init();
+   char buf[48];
+   snprintf(buf, sizeof(buf), "%.*f", decimalPlaces, value);
+   *this = buf;
+}
+
+String::~String() {
+   free(buffer);
+}
+
+void String::init() {
+   buffer = NULL;
+   capacity = 0;
+   len = 0;
+}
+
+void String::invalidate() {
+   free(buffer);
+   init();
+}
+
+bool String::reserve(unsigned int size) {
+   if (buffer && capacity >= size) return true;
+   if (changeBuffer(size)) {
+      if (len == 0) buffer[0] = 0;
+      return true;
+   }
+   return false;
+}
+
+bool String::changeBuffer(unsigned int maxStrLen) {
+   char *newbuffer = (char *)realloc(buffer, maxStrLen + 1);
+   if (newbuffer) {
+      buffer = newbuffer;
+      capacity = maxStrLen;
+      return true;
+   }
+   return false;
+}
+
+String &String::copy(const char *cstr, unsigned int length) {
+   if (!reserve(length)) {
+      invalidate();
+      return *this;
+   }
+   len = length;
+   memmove(buffer, cstr, length);
+   buffer[len] = 0;
+   return *this;
+}
+
+void String::move(String &rhs) {
+   if (this != &rhs) {
+      free(buffer);
+      buffer = rhs.buffer;
+      capacity = rhs.capacity;
+      len = rhs.len;
+      rhs.init();
+   }
+}
+
+String &String::operator=(const String &rhs) {
+   if (this == &rhs) return *this;
+   if (rhs.buffer) {
+      copy(rhs.buffer, rhs.len);
+   } else {
+      invalidate();
+   }
+   return *this;
+}
+
+String &String::operator=(String &&rval) {
+   move(rval);
+   return *this;
+}
+
+String &String::operator=(const char *cstr) {
+   if (cstr) {
+      copy(cstr, strlen(cstr));
+   } else {
+      invalidate();
+   }
+   return *this;
+}
+
+bool String::concat(const char *cstr, unsigned int length) {
+   unsigned int newlen = len + length;
+   if (!cstr) return false;
+   if (length == 0) return true;
+   if (!reserve(newlen)) return false;
+   memmove(buffer + len, cstr, length);
+   len = newlen;
+   buffer[len] = 0;
+   return true;
+}
+
+bool String::concat(const String &s) {
+   return concat(s.c_str(), s.len);
+}
+
+bool String::concat(const char *cstr) {
+   if (!cstr) return false;
+   return concat(cstr, strlen(cstr));
+}
+
+bool String::concat(char c) {
+   return concat(&c, 1);
+}
+
+bool String::concat(int num) {
+   return concat(String(num));
+}
+
+bool String::concat(unsigned int num) {
+   return concat(String(num));
+}
+
+bool String::concat(long num) {
+   return concat(String(num));
+}
+
+bool String::concat(unsigned long num) {
+   return concat(String(num));
+}
+
+bool String::concat(double num) {
+   return concat(String(num));
+}
+
+bool String::equals(const String &s2) const {
+   return len == s2.len && strcmp(c_str(), s2.c_str()) == 0;
+}
+
+bool String::equals(const char *cstr) const {
+   if (len == 0) return (cstr == NULL || *cstr == 0);
+   if (cstr == NULL) return buffer[0] == 0;
+   return strcmp(buffer, cstr) == 0;
+}
+
+bool String::equalsIgnoreCase(const String &s2) const {
+   if (len != s2.len) return false;
+   return strcasecmp(c_str(), s2.c_str()) == 0;
+}
+
+bool String::startsWith(const String &prefix) const {
+   if (len < prefix.len) return false;
+   return strncmp(c_str(), prefix.c_str(), prefix.len) == 0;
+}
+
+bool String::endsWith(const String &suffix) const {
+   if (len < suffix.len) return false;
+   return strcmp(c_str() + len - suffix.len, suffix.c_str()) == 0;
+}
+
+char String::charAt(unsigned int index) const {
+   if (index >= len || !buffer) return 0;
+   return buffer[index];
+}
+
+int String::indexOf(char ch, unsigned int fromIndex) const {
+   if (fromIndex >= len) return -1;
+   const char *temp = strchr(buffer + fromIndex, ch);
+   if (temp == NULL) return -1;
+   return temp - buffer;
+}
+
+int String::indexOf(const String &s2, unsigned int fromIndex) const {
+   return indexOf(s2.c_str(), fromIndex);
+}
+
+int String::indexOf(const char *s2, unsigned int fromIndex) const {
+   if (fromIndex >= len) return -1;
+   const char *found = strstr(buffer + fromIndex, s2);
+   if (found == NULL) return -1;
+   return found - buffer;
+}
+
+String String::substring(unsigned int left) const {
+   return substring(left, len);
+}
+
+String String::substring(unsigned int left, unsigned int right) const {
+   if (left > right) {
+      unsigned int temp = right;
+      right = left;
+      left = temp;
+   }
+   if (left >= len) return String();
+   if (right > len) right = len;
+   return String(buffer + left, right - left);
+}
+
+void String::toLowerCase() {
+   if (!buffer) return;
+   for (char *p = buffer; *p; p++) {
+      *p = tolower((unsigned char)*p);
+   }
+}
+
+void String::toUpperCase() {
+   if (!buffer) return;
+   for (char *p = buffer; *p; p++) {
+      *p = toupper((unsigned char)*p);
+   }
+}
+
+void String::trim() {
+   if (!buffer || len == 0) return;
+   char *begin = buffer;
+   while (isspace((unsigned char)*begin)) begin++;
+   char *end = buffer + len - 1;
+   while (isspace((unsigned char)*end) && end >= begin) end--;
+   len = end + 1 - begin;
+   if (begin > buffer) memmove(buffer, begin, len);
+   buffer[len] = 0;
+}
+
+long String::toInt() const {
+   return buffer ? atol(buffer) : 0;
+}
+
+float String::toFloat() const {
+   return buffer ? (float)atof(buffer) : 0;
+}
+
+String operator+(const String &lhs, const String &rhs) {
+   String result(lhs);
+   result.concat(rhs);
+   return result;
+}
+
+String operator+(const String &lhs, const char *rhs) {
+   String result(lhs);
+   result.concat(rhs);
+   return result;
+}
+
+String operator+(const char *lhs, const String &rhs) {
+   String result(lhs);
+   result.concat(rhs);
+   return result;
+}
+
+String operator+(const String &lhs, char rhs) {
+   String result(lhs);
+   result.concat(rhs);
+   return result;
+}
@@ -0,0 +1,576 @@
+/*
+ WiFi.cpp - host implementation of the WiFi station, WiFiClient and the
+ POSIX socket transport behind it.
+*/
+
+#include "WiFi.h"
+#include "WiFiClient.h"
+#include "HostHal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+// CONNECTING: scanning/associating, DHCP: associated and waiting for a lease
+enum LinkState { LINK_IDLE, LINK_CONNECTING, LINK_DHCP, LINK_CONNECTED, LINK_LOST };
+
+const uint8_t AP_BSSID[6] = {0x24, 0x0A, 0xC4, 0x12, 0x34, 0x56};
+
+bool wifiAvailable = true;
+uint32_t wifiConnectDelayMs = 300;
+uint32_t wifiFastConnectDelayMs = 60;
+uint32_t wifiDhcpDelayMs = 0;
+uint8_t apChannel = 6;
+uint32_t wifiBegins = 0;
+uint32_t wifiFastBegins = 0;
+bool wifiAutoReconnect = true;
+LinkState linkState = LINK_IDLE;
+uint64_t linkStartUs = 0;
+bool linkFast = false;        // begin() was given a BSSID and channel
+bool linkFastValid = false;   // ...and they match the access point
+uint32_t staticIp = 0;        // WiFi.config() address, 0 = DHCP
+
+const int MAX_EVENT_HANDLERS = 4;
+WiFiEventSysCb eventHandlers[MAX_EVENT_HANDLERS];
+arduino_event_id_t eventFilters[MAX_EVENT_HANDLERS];
+
+host::Transport *transportOverride = NULL;
+uint32_t dnsDelayMs = 0;
+uint32_t tcpConnectDelayMs = 0;
+
+const int SOCKET_CONNECT_TIMEOUT_MS = 3000;
+const int SOCKET_WRITE_TIMEOUT_MS = 10000;
+
+class SocketTransport : public host::Transport {
+public:
+   SocketTransport() : sock(-1) {}
+   ~SocketTransport() { close(); }
+
+   bool open(const char *hostname, uint16_t port) override {
+      close();
+      char service[8];
+      snprintf(service, sizeof(service), "%u", port);
+      struct addrinfo hints;
+      memset(&hints, 0, sizeof(hints));
+      hints.ai_family = AF_INET;
+      hints.ai_socktype = SOCK_STREAM;
+      struct addrinfo *res = NULL;
+      if (getaddrinfo(hostname, service, &hints, &res) != 0 || res == NULL) {
+         return false;
+      }
+      sock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+      if (sock < 0) {
+         freeaddrinfo(res);
+         return false;
+      }
+      fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+      int rc = ::connect(sock, res->ai_addr, res->ai_addrlen);
+      freeaddrinfo(res);
+      if (rc < 0 && errno != EINPROGRESS) {
+         close();
+         return false;
+      }
+      if (rc < 0) {
+         // Same contract as the ESP32 WiFiClient: connect() blocks up to a timeout
+         struct pollfd pfd = {sock, POLLOUT, 0};
+         if (poll(&pfd, 1, SOCKET_CONNECT_TIMEOUT_MS) <= 0) {
+            close();
+            return false;
+         }
+         int err = 0;
+         socklen_t len = sizeof(err);
+         getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &len);
+         if (err != 0) {
+            close();
+            return false;
+         }
+      }
+      return true;
+   }
+
+   void close() override {
+      if (sock >= 0) {
+         ::close(sock);
+         sock = -1;
+      }
+   }
+
+   bool isOpen() override {
+      if (sock < 0) return false;
+      uint8_t dummy;
+      ssize_t res = recv(sock, &dummy, 1, MSG_DONTWAIT | MSG_PEEK);
+      if (res == 0) {
+         close();
+         return false;
+      }
+      if (res < 0 && errno != EWOULDBLOCK && errno != EAGAIN) {
+         close();
+         return false;
+      }
+      return true;
+   }
+
+   int available() override {
+      if (sock < 0) return 0;
+      int count = 0;
+      if (ioctl(sock, FIONREAD, &count) < 0) return 0;
+      return count;
+   }
+
+   int read(uint8_t *buf, size_t size) override {
+      if (sock < 0) return -1;
+      ssize_t res = recv(sock, buf, size, MSG_DONTWAIT);
+      if (res > 0) return (int)res;
+      if (res == 0) close();
+      return -1;
+   }
+
+   size_t write(const uint8_t *buf, size_t size) override {
+      size_t sent = 0;
+      while (sock >= 0 && sent < size) {
+         ssize_t res = send(sock, buf + sent, size - sent, MSG_NOSIGNAL);
+         if (res > 0) {
+            sent += res;
+         } else if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd pfd = {sock, POLLOUT, 0};
+            if (poll(&pfd, 1, SOCKET_WRITE_TIMEOUT_MS) <= 0) break;
+         } else {
+            close();
+         }
+      }
+      return sent;
+   }
+
+   int fd() override {
+      return sock;
+   }
+
+   void setNoDelay(bool nodelay) override {
+      if (sock < 0) return;
+      int flag = nodelay ? 1 : 0;
+      setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+   }
+
+private:
+   int sock;
+};
+
+void fireEvent(arduino_event_id_t id, uint8_t reason = 0) {
+   arduino_event_t event;
+   memset(&event, 0, sizeof(event));
+   event.event_id = id;
+   if (id == ARDUINO_EVENT_WIFI_STA_CONNECTED) {
+      memcpy(event.event_info.wifi_sta_connected.bssid, AP_BSSID, 6);
+      event.event_info.wifi_sta_connected.channel = apChannel;
+   } else if (id == ARDUINO_EVENT_WIFI_STA_DISCONNECTED) {
+      event.event_info.wifi_sta_disconnected.reason = reason;
+   }
+   for (int i = 0; i < MAX_EVENT_HANDLERS; i++) {
+      if (eventHandlers[i] != NULL && (eventFilters[i] == ARDUINO_EVENT_MAX || eventFilters[i] == id)) {
+         eventHandlers[i](&event);
+      }
+   }
+}
+
+void startConnecting() {
+   linkState = LINK_CONNECTING;
+   linkStartUs = host::nowMicros();
+}
+
+uint64_t associateMicros() {
+   return (uint64_t)(linkFast ? wifiFastConnectDelayMs : wifiConnectDelayMs) * 1000ULL;
+}
+
+// Time of the next state change the model will make on its own
+uint64_t nextLinkEventMicros() {
+   if (linkState == LINK_CONNECTING) return linkStartUs + associateMicros();
+   if (linkState == LINK_DHCP) return linkStartUs + (uint64_t)wifiDhcpDelayMs * 1000ULL;
+   return UINT64_MAX;
+}
+
+// Advance the link model to the current time, firing events on each transition
+void updateLink() {
+   for (;;) {
+      uint64_t now = host::nowMicros();
+      if (!wifiAvailable && (linkState == LINK_DHCP || linkState == LINK_CONNECTED)) {
+         linkState = LINK_LOST;
+         fireEvent(ARDUINO_EVENT_WIFI_STA_DISCONNECTED, WIFI_REASON_BEACON_TIMEOUT);
+         continue;
+      }
+      if (linkState == LINK_LOST && wifiAutoReconnect && wifiAvailable) {
+         linkFast = false;
+         startConnecting();
+         continue;
+      }
+      if (linkState == LINK_CONNECTING && now - linkStartUs >= associateMicros()) {
+         if (!wifiAvailable || (linkFast && !linkFastValid)) {
+            // Scan (or the directed probe) found nothing
+            linkState = LINK_LOST;
+            fireEvent(ARDUINO_EVENT_WIFI_STA_DISCONNECTED, WIFI_REASON_NO_AP_FOUND);
+            if (!wifiAutoReconnect) linkState = LINK_IDLE;
+            return;
+         }
+         linkStartUs += associateMicros();
+         linkState = LINK_DHCP;
+         fireEvent(ARDUINO_EVENT_WIFI_STA_CONNECTED);
+         continue;
+      }
+      if (linkState == LINK_DHCP && (staticIp != 0 || now - linkStartUs >= (uint64_t)wifiDhcpDelayMs * 1000ULL)) {
+         linkState = LINK_CONNECTED;
+         fireEvent(ARDUINO_EVENT_WIFI_STA_GOT_IP);
+         continue;
+      }
+      return;
+   }
+}
+
+} // namespace
+
+namespace host {
+
+void setWiFiAvailable(bool available) {
+   updateLink();
+   wifiAvailable = available;
+   updateLink();
+}
+
+void setWiFiConnectDelay(uint32_t ms) {
+   wifiConnectDelayMs = ms;
+}
+
+void setWiFiFastConnectDelay(uint32_t ms) {
+   wifiFastConnectDelayMs = ms;
+}
+
+void setWiFiDhcpDelay(uint32_t ms) {
+   wifiDhcpDelayMs = ms;
+}
+
+void setWiFiChannel(uint8_t channel) {
+   apChannel = channel;
+}
+
+uint32_t wifiBeginCount() {
+   return wifiBegins;
+}
+
+uint32_t wifiFastBeginCount() {
+   return wifiFastBegins;
+}
+
+void setTransport(Transport *t) {
+   transportOverride = t;
+}
+
+Transport *transport() {
+   return transportOverride;
+}
+
+void setDnsDelay(uint32_t ms) {
+   dnsDelayMs = ms;
+}
+
+void setTcpConnectDelay(uint32_t ms) {
+   tcpConnectDelayMs = ms;
+}
+
+Transport *createSocketTransport() {
+   return new SocketTransport();
+}
+
+uint32_t waitForActivity(const int *fds, size_t count, uint64_t timeoutMicros) {
+   struct pollfd pfds[8];
+   size_t n = 0;
+   for (size_t i = 0; i < count && n < 8; i++) {
+      pfds[n].fd = fds[i];  // poll() ignores negative descriptors
+      pfds[n].events = POLLIN;
+      pfds[n].revents = 0;
+      n++;
+   }
+
+   if (!virtualClock()) {
+      // Wake for esp_timer deadlines; the callbacks run here, not on a timer task
+      uint64_t timer = nextTimerMicros();
+      uint64_t i2s = nextI2sEventMicros();
+      if (i2s < timer) timer = i2s;
+      uint64_t now = nowMicros();
+      if (timer <= now) {
+         timeoutMicros = 0;
+      } else if (timer - now < timeoutMicros) {
+         timeoutMicros = timer - now;
+      }
+      int timeoutMs = (int)((timeoutMicros + 999) / 1000);
+      poll(pfds, n, timeoutMs);
+      runDueTimers();
+      sendDueI2sEvents();
+   } else if (poll(pfds, n, 0) <= 0) {
+      // Nothing ready: jump to the next scripted arrival, or wait out the timeout
+      uint64_t now = nowMicros();
+      uint64_t deadline = now + timeoutMicros;
+      uint64_t arrival = transportOverride != NULL ? transportOverride->nextArrivalMicros() : UINT64_MAX;
+      uint64_t linkEvent = nextLinkEventMicros();
+      if (linkEvent < arrival) arrival = linkEvent;
+      // A task woken by an I2S event may notify the loop
+      uint64_t i2s = nextI2sEventMicros();
+      if (i2s < arrival) arrival = i2s;
+      advanceMicros((arrival < deadline ? (arrival > now ? arrival : now) : deadline) - now);
+      // Deliver WiFi events that became due while "sleeping"
+      updateLink();
+      if (n > 0) poll(pfds, n, 0);
+   }
+
+   uint32_t ready = 0;
+   for (size_t i = 0; i < n; i++) {
+      if (pfds[i].revents & (POLLIN | POLLHUP | POLLERR)) ready |= 1UL << i;
+   }
+   return ready;
+}
+
+} // namespace host
+
+// --- WiFiClass -------------------------------------------------------------
+
+WiFiClass WiFi;
+
+wl_status_t WiFiClass::begin(const char *ssid, const char *passphrase, int32_t channel, const uint8_t *bssid, bool connect) {
+   (void)ssid;
+   (void)passphrase;
+   wifiBegins++;
+   linkFast = bssid != NULL && channel > 0;
+   linkFastValid = linkFast && channel == apChannel && memcmp(bssid, AP_BSSID, 6) == 0;
+   if (linkFast) wifiFastBegins++;
+   if (connect) startConnecting();
+   return status();
+}
+
+bool WiFiClass::disconnect(bool wifioff) {
+   (void)wifioff;
+   bool associated = linkState == LINK_DHCP || linkState == LINK_CONNECTED;
+   linkState = LINK_IDLE;
+   if (associated) fireEvent(ARDUINO_EVENT_WIFI_STA_DISCONNECTED, WIFI_REASON_ASSOC_LEAVE);
+   return true;
+}
+
+bool WiFiClass::reconnect() {
+   startConnecting();
+   return true;
+}
+
+bool WiFiClass::config(IPAddress local_ip, IPAddress gateway, IPAddress subnet, IPAddress dns1) {
+   (void)gateway;
+   (void)subnet;
+   (void)dns1;
+   staticIp = (uint32_t)local_ip;
+   return true;
+}
+
+wifi_event_id_t WiFiClass::onEvent(WiFiEventSysCb callback, arduino_event_id_t event) {
+   for (int i = 0; i < MAX_EVENT_HANDLERS; i++) {
+      if (eventHandlers[i] == NULL) {
+         eventHandlers[i] = callback;
+         eventFilters[i] = event;
+         return i + 1;
+      }
+   }
+   return 0;
+}
+
+uint8_t *WiFiClass::BSSID() {
+   static uint8_t bssid[6];
+   if (status() != WL_CONNECTED) return NULL;
+   memcpy(bssid, AP_BSSID, 6);
+   return bssid;
+}
+
+int32_t WiFiClass::channel() {
+   return apChannel;
+}
+
+IPAddress WiFiClass::gatewayIP() {
+   return status() == WL_CONNECTED ? IPAddress(192, 168, 1, 1) : IPAddress();
+}
+
+IPAddress WiFiClass::subnetMask() {
+   return status() == WL_CONNECTED ? IPAddress(255, 255, 255, 0) : IPAddress();
+}
+
+IPAddress WiFiClass::dnsIP(uint8_t dns_no) {
+   (void)dns_no;
+   return status() == WL_CONNECTED ? IPAddress(192, 168, 1, 1) : IPAddress();
+}
+
+wl_status_t WiFiClass::status() {
+   updateLink();
+   switch (linkState) {
+      case LINK_CONNECTED:
+         return WL_CONNECTED;
+      case LINK_LOST:
+         return WL_CONNECTION_LOST;
+      case LINK_CONNECTING:
+      case LINK_DHCP:
+         return WL_DISCONNECTED;
+      default:
+         return WL_IDLE_STATUS;
+   }
+}
+
+bool WiFiClass::mode(wifi_mode_t mode) {
+   (void)mode;
+   return true;
+}
+
+bool WiFiClass::setAutoReconnect(bool autoReconnect) {
+   wifiAutoReconnect = autoReconnect;
+   return true;
+}
+
+IPAddress WiFiClass::localIP() {
+   if (status() != WL_CONNECTED) return IPAddress();
+   return staticIp != 0 ? IPAddress(staticIp) : IPAddress(192, 168, 1, 50);
+}
+
+int WiFiClass::hostByName(const char *hostname, IPAddress &result) {
+   if (status() != WL_CONNECTED) return 0;
+   // A scripted transport ignores the address; don't depend on the host's DNS
+   if (transportOverride != NULL) {
+      host::advanceMicros((uint64_t)dnsDelayMs * 1000ULL);
+      result = IPAddress(127, 0, 0, 1);
+      return 1;
+   }
+   struct addrinfo hints;
+   memset(&hints, 0, sizeof(hints));
+   hints.ai_family = AF_INET;
+   struct addrinfo *res = NULL;
+   if (getaddrinfo(hostname, NULL, &hints, &res) != 0 || res == NULL) {
+      return 0;
+   }
+   const uint8_t *addr = (const uint8_t *)&((struct sockaddr_in *)res->ai_addr)->sin_addr;
+   result = IPAddress(addr[0], addr[1], addr[2], addr[3]);
+   freeaddrinfo(res);
+   return 1;
+}
+
+String WiFiClass::macAddress() {
+   return String("24:6F:28:00:00:01");
+}
+
+int8_t WiFiClass::RSSI() {
+   return status() == WL_CONNECTED ? -55 : 0;
+}
+
+String WiFiClass::SSID() {
+   return String("host");
+}
+
+// --- WiFiClient ------------------------------------------------------------
+
+WiFiClient::WiFiClient() : _transport(NULL), _ownsTransport(false), _peeked(-1) {
+}
+
+WiFiClient::~WiFiClient() {
+   stop();
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port) {
+   return connect(ip.toString().c_str(), port);
+}
+
+// The socket transport bounds the connect with its own timeout
+int WiFiClient::connect(IPAddress ip, uint16_t port, int32_t timeoutMs) {
+   (void)timeoutMs;
+   return connect(ip, port);
+}
+
+int WiFiClient::connect(const char *hostname, uint16_t port) {
+   stop();
+   if (host::transport() != NULL) {
+      _transport = host::transport();
+      _ownsTransport = false;
+      host::advanceMicros((uint64_t)tcpConnectDelayMs * 1000ULL);
+   } else {
+      _transport = host::createSocketTransport();
+      _ownsTransport = true;
+   }
+   if (!_transport->open(hostname, port)) {
+      stop();
+      return 0;
+   }
+   return 1;
+}
+
+size_t WiFiClient::write(uint8_t data) {
+   return write(&data, 1);
+}
+
+size_t WiFiClient::write(const uint8_t *buf, size_t size) {
+   if (_transport == NULL || !_transport->isOpen()) return 0;
+   return _transport->write(buf, size);
+}
+
+int WiFiClient::available() {
+   if (_transport == NULL) return 0;
+   return _transport->available() + (_peeked >= 0 ? 1 : 0);
+}
+
+int WiFiClient::read() {
+   uint8_t data;
+   if (read(&data, 1) == 1) return data;
+   return -1;
+}
+
+int WiFiClient::read(uint8_t *buf, size_t size) {
+   if (_transport == NULL || size == 0) return -1;
+   size_t offset = 0;
+   if (_peeked >= 0) {
+      buf[offset++] = (uint8_t)_peeked;
+      _peeked = -1;
+      if (offset == size) return 1;
+   }
+   int res = _transport->read(buf + offset, size - offset);
+   if (res < 0) return offset > 0 ? (int)offset : -1;
+   return res + offset;
+}
+
+int WiFiClient::peek() {
+   if (_peeked < 0 && _transport != NULL) {
+      uint8_t data;
+      if (_transport->read(&data, 1) == 1) _peeked = data;
+   }
+   return _peeked;
+}
+
+void WiFiClient::flush() {
+}
+
+void WiFiClient::stop() {
+   if (_transport != NULL) {
+      _transport->close();
+      if (_ownsTransport) delete _transport;
+   }
+   _transport = NULL;
+   _ownsTransport = false;
+   _peeked = -1;
+}
+
+uint8_t WiFiClient::connected() {
+   if (_transport == NULL) return 0;
+   if (_peeked >= 0) return 1;
+   return _transport->isOpen() ? 1 : 0;
+}
+
+int WiFiClient::fd() const {
+   return _transport != NULL ? _transport->fd() : -1;
+}
+
+int WiFiClient::setNoDelay(bool nodelay) {
+   if (_transport != NULL) _transport->setNoDelay(nodelay);
+   return 0;
+}
@@ -0,0 +1,178 @@
+/*
+ esp_partition.cpp - RAM-backed data partitions with NOR flash semantics
+ and timing (see esp_partition.h).
+*/
+
+#include "esp_partition.h"
+#include "HostHal.h"
+
+#include <string.h>
+
+namespace {
+
+// Typical 4 MB SPI NOR part (W25Q32 class) on the 40 MHz bus
+const uint32_t READ_SETUP_US = 2;
+const uint32_t WRITE_SETUP_US = 20;
+const uint32_t WRITE_NS_PER_BYTE = 1500;      // ~0.4 ms per 256-byte page
+const uint32_t SECTOR_ERASE_US = 45000;
+
+const int MAX_PARTITIONS = 8;
+const size_t POOL_SIZE = 256 * 1024;
+
+struct Partition {
+   esp_partition_t info;
+   uint8_t *data;
+   uint32_t sectorErases[POOL_SIZE / SPI_FLASH_SEC_SIZE];
+};
+
+// Data partitions of partitions.csv that the firmware opens by label
+const struct {
+   const char *label;
+   uint8_t subtype;
+   uint32_t address;
+   uint32_t size;
+} layout[] = {
+   {"keywords", 0x42, 0x3D8000, 0x8000},
+   {"relaylog", 0x40, 0x3E0000, 0x4000},
+   {"outbox", 0x41, 0x3E4000, 0xC000},
+};
+
+uint8_t pool[POOL_SIZE];
+size_t poolUsed = 0;
+Partition partitions[MAX_PARTITIONS];
+int partitionCount = 0;
+bool layoutLoaded = false;
+host::FlashStats counters;
+
+void ensureLayout() {
+   if (layoutLoaded) return;
+   layoutLoaded = true;
+   for (size_t i = 0; i < sizeof(layout) / sizeof(layout[0]); i++) {
+      host::addPartition(layout[i].label, layout[i].subtype, layout[i].size);
+      partitions[partitionCount - 1].info.address = layout[i].address;
+   }
+}
+
+Partition *lookup(const esp_partition_t *partition) {
+   for (int i = 0; i < partitionCount; i++) {
+      if (&partitions[i].info == partition) return &partitions[i];
+   }
+   return NULL;
+}
+
+bool inRange(const esp_partition_t *partition, size_t offset, size_t size) {
+   return offset <= partition->size && size <= partition->size - offset;
+}
+
+} // namespace
+
+namespace host {
+
+bool addPartition(const char *label, uint8_t subtype, uint32_t size) {
+   ensureLayout();
+   if (partitionCount >= MAX_PARTITIONS || size % SPI_FLASH_SEC_SIZE != 0 || size > POOL_SIZE - poolUsed) {
+      return false;
+   }
+   Partition &p = partitions[partitionCount++];
+   memset(&p, 0, sizeof(p));
+   p.info.type = ESP_PARTITION_TYPE_DATA;
+   p.info.subtype = (esp_partition_subtype_t)subtype;
+   p.info.address = 0x400000 + poolUsed;  // Past the 4 MB chip: bench-only
+   p.info.size = size;
+   strncpy(p.info.label, label, sizeof(p.info.label) - 1);
+   p.data = pool + poolUsed;
+   memset(p.data, 0xFF, size);
+   poolUsed += size;
+   return true;
+}
+
+uint8_t *partitionData(const char *label) {
+   ensureLayout();
+   for (int i = 0; i < partitionCount; i++) {
+      if (strcmp(partitions[i].info.label, label) == 0) return partitions[i].data;
+   }
+   return NULL;
+}
+
+uint32_t partitionSectorErases(const char *label, uint32_t sector) {
+   ensureLayout();
+   for (int i = 0; i < partitionCount; i++) {
+      if (strcmp(partitions[i].info.label, label) == 0 && sector < partitions[i].info.size / SPI_FLASH_SEC_SIZE) {
+         return partitions[i].sectorErases[sector];
+      }
+   }
+   return 0;
+}
+
+FlashStats flashStats() {
+   return counters;
+}
+
+} // namespace host
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label) {
+   ensureLayout();
+   for (int i = 0; i < partitionCount; i++) {
+      const esp_partition_t &info = partitions[i].info;
+      if ((type == ESP_PARTITION_TYPE_ANY || type == info.type) &&
+          (subtype == ESP_PARTITION_SUBTYPE_ANY || subtype == info.subtype) &&
+          (label == NULL || strcmp(label, info.label) == 0)) {
+         return &info;
+      }
+   }
+   return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size) {
+   Partition *p = lookup(partition);
+   if (p == NULL || dst == NULL) return ESP_ERR_INVALID_ARG;
+   if (!inRange(partition, src_offset, size)) return ESP_ERR_INVALID_SIZE;
+   memcpy(dst, p->data + src_offset, size);
+   counters.reads++;
+   counters.bytesRead += size;
+   host::advanceMicros(READ_SETUP_US + size / 20);
+   return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size) {
+   Partition *p = lookup(partition);
+   if (p == NULL || src == NULL) return ESP_ERR_INVALID_ARG;
+   if (!inRange(partition, dst_offset, size)) return ESP_ERR_INVALID_SIZE;
+   const uint8_t *bytes = (const uint8_t *)src;
+   for (size_t i = 0; i < size; i++) {
+      p->data[dst_offset + i] &= bytes[i];  // Programming only clears bits
+   }
+   counters.writes++;
+   counters.bytesWritten += size;
+   host::advanceMicros(WRITE_SETUP_US + (uint64_t)size * WRITE_NS_PER_BYTE / 1000);
+   return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size) {
+   Partition *p = lookup(partition);
+   if (p == NULL) return ESP_ERR_INVALID_ARG;
+   if (offset % SPI_FLASH_SEC_SIZE != 0 || size % SPI_FLASH_SEC_SIZE != 0) return ESP_ERR_INVALID_SIZE;
+   if (!inRange(partition, offset, size)) return ESP_ERR_INVALID_SIZE;
+   memset(p->data + offset, 0xFF, size);
+   for (size_t sector = offset / SPI_FLASH_SEC_SIZE; sector < (offset + size) / SPI_FLASH_SEC_SIZE; sector++) {
+      p->sectorErases[sector]++;
+      counters.erases++;
+   }
+   host::advanceMicros((uint64_t)SECTOR_ERASE_US * (size / SPI_FLASH_SEC_SIZE));
+   return ESP_OK;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t *partition, size_t offset, size_t size,
+                             spi_flash_mmap_memory_t memory, const void **out_ptr, spi_flash_mmap_handle_t *out_handle) {
+   (void)memory;
+   Partition *p = lookup(partition);
+   if (p == NULL || out_ptr == NULL || out_handle == NULL) return ESP_ERR_INVALID_ARG;
+   if (!inRange(partition, offset, size)) return ESP_ERR_INVALID_SIZE;
+   *out_ptr = p->data + offset;
+   *out_handle = (spi_flash_mmap_handle_t)(p - partitions) + 1;
+   return ESP_OK;
+}
+
+void spi_flash_munmap(spi_flash_mmap_handle_t handle) {
+   (void)handle;
+}
@@ -0,0 +1,113 @@
+/*
+ esp_timer.cpp - host model of esp_timer: a fixed table of one-shot and
+ periodic timers dispatched as host time passes their deadlines.
+*/
+
+#include "esp_timer.h"
+#include "HostHal.h"
+
+struct esp_timer {
+   bool used;
+   bool armed;
+   esp_timer_cb_t callback;
+   void *arg;
+   uint64_t deadline;
+   uint64_t period;  // 0 for one-shot
+};
+
+namespace {
+
+const int MAX_TIMERS = 8;
+
+esp_timer timers[MAX_TIMERS];
+uint32_t dispatched = 0;
+
+} // namespace
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle) {
+   if (create_args == NULL || create_args->callback == NULL || out_handle == NULL) return ESP_ERR_INVALID_ARG;
+   for (int i = 0; i < MAX_TIMERS; i++) {
+      if (!timers[i].used) {
+         timers[i] = esp_timer();
+         timers[i].used = true;
+         timers[i].callback = create_args->callback;
+         timers[i].arg = create_args->arg;
+         *out_handle = &timers[i];
+         return ESP_OK;
+      }
+   }
+   return ESP_ERR_NO_MEM;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+   if (timer == NULL || !timer->used) return ESP_ERR_INVALID_ARG;
+   if (timer->armed) return ESP_ERR_INVALID_STATE;
+   timer->armed = true;
+   timer->period = 0;
+   timer->deadline = host::nowMicros() + timeout_us;
+   return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) {
+   if (timer == NULL || !timer->used || period == 0) return ESP_ERR_INVALID_ARG;
+   if (timer->armed) return ESP_ERR_INVALID_STATE;
+   timer->armed = true;
+   timer->period = period;
+   timer->deadline = host::nowMicros() + period;
+   return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+   if (timer == NULL || !timer->used) return ESP_ERR_INVALID_ARG;
+   if (!timer->armed) return ESP_ERR_INVALID_STATE;
+   timer->armed = false;
+   return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+   if (timer == NULL || !timer->used) return ESP_ERR_INVALID_ARG;
+   if (timer->armed) return ESP_ERR_INVALID_STATE;
+   timer->used = false;
+   return ESP_OK;
+}
+
+int64_t esp_timer_get_time() {
+   return (int64_t)host::nowMicros();
+}
+
+namespace host {
+
+uint64_t nextTimerMicros() {
+   uint64_t next = UINT64_MAX;
+   for (int i = 0; i < MAX_TIMERS; i++) {
+      if (timers[i].armed && timers[i].deadline < next) next = timers[i].deadline;
+   }
+   return next;
+}
+
+void runDueTimers() {
+   // Earliest first; a callback may re-arm its own or another timer
+   for (;;) {
+      esp_timer *due = NULL;
+      uint64_t now = nowMicros();
+      for (int i = 0; i < MAX_TIMERS; i++) {
+         if (timers[i].armed && timers[i].deadline <= now && (due == NULL || timers[i].deadline < due->deadline)) {
+            due = &timers[i];
+         }
+      }
+      if (due == NULL) return;
+      if (due->period != 0) {
+         due->deadline += due->period;
+      } else {
+         due->armed = false;
+      }
+      dispatched++;
+      due->callback(due->arg);
+   }
+}
+
+uint32_t timerCallbacks() {
+   return dispatched;
+}
+
+} // namespace host
@@ -0,0 +1,238 @@
+/*
+ freertos.cpp - host model of FreeRTOS tasks and queues.
+
+ Tasks are ucontext coroutines on static stacks. Only one runs at a time:
+ the loop (the host thread's own context) resumes a task when something is
+ sent to the queue it waits on, and the task swaps back when it blocks
+ again. Queues and stacks come from fixed pools, so creating them does not
+ show up in the heap counters.
+*/
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "HostHal.h"
+
+#include <string.h>
+#include <ucontext.h>
+
+struct HostQueue {
+   bool used;
+   UBaseType_t length;
+   UBaseType_t itemSize;
+   UBaseType_t head;
+   UBaseType_t count;
+   uint8_t storage[1024];
+};
+
+struct HostTask {
+   bool used;
+   bool finished;
+   const char *name;
+   TaskFunction_t function;
+   void *arg;
+   UBaseType_t priority;
+   BaseType_t core;
+   HostQueue *waitingOn;  // Blocked in xQueueReceive, NULL when runnable
+   ucontext_t context;
+};
+
+namespace {
+
+const int MAX_QUEUES = 8;
+const int MAX_TASKS = 4;
+const size_t STACK_BYTES = 256 * 1024;  // Host code (printf, sanitizers) needs far more than Xtensa
+
+HostQueue queues[MAX_QUEUES];
+HostTask tasks[MAX_TASKS];
+alignas(16) uint8_t stacks[MAX_TASKS][STACK_BYTES];
+ucontext_t loopContext;
+HostTask *current = NULL;  // NULL while the loop runs
+uint32_t switches = 0;
+
+void taskEntry(unsigned int index) {
+   HostTask &task = tasks[index];
+   task.function(task.arg);
+   // FreeRTOS tasks must not return; treat it as vTaskDelete(NULL)
+   task.finished = true;
+}
+
+// Run `task` until it blocks or ends
+void resume(HostTask &task) {
+   current = &task;
+   switches++;
+   swapcontext(&loopContext, &task.context);
+   current = NULL;
+   if (task.finished) {
+      task.used = false;
+   }
+}
+
+// From the loop: run every task whose queue has items, until all block
+void runReadyTasks() {
+   if (current != NULL) return;
+   for (bool ran = true; ran;) {
+      ran = false;
+      for (int i = 0; i < MAX_TASKS; i++) {
+         HostTask &task = tasks[i];
+         if (task.used && !task.finished && (task.waitingOn == NULL || task.waitingOn->count > 0)) {
+            task.waitingOn = NULL;
+            resume(task);
+            ran = true;
+         }
+      }
+   }
+}
+
+// From a task: give the loop back until `queue` has an item
+void block(HostQueue *queue) {
+   HostTask *task = current;
+   task->waitingOn = queue;
+   switches++;
+   swapcontext(&task->context, &loopContext);
+}
+
+bool push(HostQueue *queue, const void *item) {
+   if (queue == NULL || !queue->used || queue->count >= queue->length) return false;
+   UBaseType_t slot = (queue->head + queue->count) % queue->length;
+   memcpy(queue->storage + slot * queue->itemSize, item, queue->itemSize);
+   queue->count++;
+   return true;
+}
+
+bool pop(HostQueue *queue, void *item) {
+   if (queue->count == 0) return false;
+   memcpy(item, queue->storage + queue->head * queue->itemSize, queue->itemSize);
+   queue->head = (queue->head + 1) % queue->length;
+   queue->count--;
+   return true;
+}
+
+BaseType_t createTask(TaskFunction_t function, const char *name, void *arg, UBaseType_t priority,
+                      TaskHandle_t *handle, BaseType_t core) {
+   if (function == NULL) return pdFAIL;
+   for (int i = 0; i < MAX_TASKS; i++) {
+      HostTask &task = tasks[i];
+      if (task.used) continue;
+      task.used = true;
+      task.finished = false;
+      task.name = name;
+      task.function = function;
+      task.arg = arg;
+      task.priority = priority;
+      task.core = core;
+      task.waitingOn = NULL;
+      getcontext(&task.context);
+      task.context.uc_stack.ss_sp = stacks[i];
+      task.context.uc_stack.ss_size = STACK_BYTES;
+      task.context.uc_link = &loopContext;
+      makecontext(&task.context, (void (*)())taskEntry, 1, (unsigned int)i);
+      if (handle != NULL) *handle = &task;
+      runReadyTasks();
+      return pdPASS;
+   }
+   return pdFAIL;
+}
+
+} // namespace
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+   if (length == 0 || itemSize == 0 || length * itemSize > sizeof(HostQueue::storage)) return NULL;
+   for (int i = 0; i < MAX_QUEUES; i++) {
+      if (!queues[i].used) {
+         queues[i].used = true;
+         queues[i].length = length;
+         queues[i].itemSize = itemSize;
+         queues[i].head = 0;
+         queues[i].count = 0;
+         return &queues[i];
+      }
+   }
+   return NULL;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+   if (queue != NULL) queue->used = false;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticksToWait) {
+   (void)ticksToWait;
+   if (!push(queue, item)) return errQUEUE_FULL;
+   runReadyTasks();
+   return pdPASS;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *higherPriorityTaskWoken) {
+   if (higherPriorityTaskWoken != NULL) *higherPriorityTaskWoken = pdFALSE;
+   return xQueueSend(queue, item, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticksToWait) {
+   if (queue == NULL || !queue->used) return pdFAIL;
+   if (current != NULL) {
+      while (queue->count == 0 && ticksToWait == portMAX_DELAY) {
+         block(queue);
+      }
+      return pop(queue, item) ? pdPASS : errQUEUE_EMPTY;
+   }
+   if (queue->count == 0 && ticksToWait > 0) {
+      // Let host time pass in 1 ms steps until a driver sends something
+      uint64_t deadline = ticksToWait == portMAX_DELAY ? UINT64_MAX
+                                                       : host::nowMicros() + (uint64_t)ticksToWait * portTICK_PERIOD_MS * 1000ULL;
+      while (queue->count == 0 && host::nowMicros() < deadline) {
+         host::advanceMicros(1000);
+      }
+   }
+   return pop(queue, item) ? pdPASS : errQUEUE_EMPTY;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+   return queue != NULL ? queue->count : 0;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue) {
+   if (queue == NULL) return pdFAIL;
+   queue->head = 0;
+   queue->count = 0;
+   return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stackDepth, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core) {
+   (void)stackDepth;
+   return createTask(function, name, arg, priority, handle, core);
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stackDepth, void *arg,
+                       UBaseType_t priority, TaskHandle_t *handle) {
+   (void)stackDepth;
+   return createTask(function, name, arg, priority, handle, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+   if (task == NULL || task == current) {
+      if (current == NULL) return;
+      // Never resumed: the loop frees the slot when the swap returns
+      current->finished = true;
+      swapcontext(&current->context, &loopContext);
+      return;
+   }
+   task->used = false;
+}
+
+TickType_t xTaskGetTickCount() {
+   return (TickType_t)(host::nowMicros() / (portTICK_PERIOD_MS * 1000ULL));
+}
+
+BaseType_t xPortGetCoreID() {
+   // The Arduino loop task runs on core 1
+   return current != NULL && current->core != tskNO_AFFINITY ? current->core : 1;
+}
+
+namespace host {
+
+uint32_t taskSwitches() {
+   return switches;
+}
+
+} // namespace host
@@ -0,0 +1,184 @@
+/*
+ i2s.cpp - host model of the I2S microphone DMA ring.
+
+ With an event queue installed, an I2S_EVENT_RX_DONE is sent each time a
+ DMA buffer's worth of samples has been produced, preceded by
+ I2S_EVENT_RX_Q_OVF when unread buffers had to be dropped. As in the
+ ESP-IDF driver, a full event queue loses its oldest event.
+*/
+
+#include "driver/i2s.h"
+#include "freertos/queue.h"
+#include "HostHal.h"
+
+#include <string.h>
+
+namespace {
+
+struct I2sPort {
+   bool installed;
+   uint32_t sampleRate;
+   uint64_t capacity;     // DMA ring size in samples
+   uint64_t bufferSamples;  // One DMA buffer
+   uint64_t installUs;
+   uint64_t readIndex;    // Absolute index of the next sample to hand out
+   uint64_t delivered;
+   uint64_t overrun;
+   QueueHandle_t events;  // NULL without an event queue
+   uint64_t nextEvent;    // Sample index at which the next DMA buffer completes
+};
+
+I2sPort ports[I2S_NUM_MAX];
+host::SampleSource sampleSource = NULL;
+void *sampleSourceCtx = NULL;
+
+uint64_t producedSamples(const I2sPort &port) {
+   uint64_t elapsed = host::nowMicros() - port.installUs;
+   return elapsed * port.sampleRate / 1000000ULL;
+}
+
+// Drop whatever the DMA ring could not hold since the last read
+void accountOverrun(I2sPort &port) {
+   uint64_t produced = producedSamples(port);
+   if (produced - port.readIndex > port.capacity) {
+      uint64_t lost = produced - port.readIndex - port.capacity;
+      port.overrun += lost;
+      port.readIndex += lost;
+   }
+}
+
+uint64_t sampleMicros(const I2sPort &port, uint64_t index) {
+   return port.installUs + (index * 1000000ULL + port.sampleRate - 1) / port.sampleRate;
+}
+
+void sendEvent(I2sPort &port, i2s_event_type_t type) {
+   i2s_event_t event = {type, (size_t)(port.bufferSamples * sizeof(int16_t))};
+   if (xQueueSend(port.events, &event, 0) != pdPASS) {
+      i2s_event_t oldest;
+      xQueueReceive(port.events, &oldest, 0);
+      xQueueSend(port.events, &event, 0);
+   }
+}
+
+} // namespace
+
+namespace host {
+
+void setI2sSource(SampleSource source, void *ctx) {
+   sampleSource = source;
+   sampleSourceCtx = ctx;
+}
+
+uint64_t i2sSamplesDelivered() {
+   return ports[I2S_NUM_0].delivered;
+}
+
+uint64_t i2sOverrunSamples() {
+   return ports[I2S_NUM_0].overrun;
+}
+
+uint64_t nextI2sEventMicros() {
+   uint64_t next = UINT64_MAX;
+   for (int i = 0; i < I2S_NUM_MAX; i++) {
+      const I2sPort &port = ports[i];
+      if (port.installed && port.events != NULL) {
+         uint64_t at = sampleMicros(port, port.nextEvent);
+         if (at < next) next = at;
+      }
+   }
+   return next;
+}
+
+void sendDueI2sEvents() {
+   for (int i = 0; i < I2S_NUM_MAX; i++) {
+      I2sPort &port = ports[i];
+      while (port.installed && port.events != NULL && producedSamples(port) >= port.nextEvent) {
+         uint64_t completed = port.nextEvent;
+         port.nextEvent += port.bufferSamples;
+         // The driver drops the oldest unread buffer to make room
+         if (completed - port.readIndex > port.capacity) {
+            sendEvent(port, I2S_EVENT_RX_Q_OVF);
+         }
+         sendEvent(port, I2S_EVENT_RX_DONE);
+      }
+   }
+}
+
+} // namespace host
+
+esp_err_t i2s_driver_install(i2s_port_t i2s_num, const i2s_config_t *i2s_config, int queue_size, void *i2s_queue) {
+   if (i2s_num >= I2S_NUM_MAX || i2s_config == NULL || i2s_config->sample_rate == 0 ||
+       i2s_config->dma_buf_len <= 0 || (queue_size > 0 && i2s_queue == NULL)) {
+      return ESP_ERR_INVALID_ARG;
+   }
+   I2sPort &port = ports[i2s_num];
+   port.installed = true;
+   port.sampleRate = i2s_config->sample_rate;
+   port.bufferSamples = i2s_config->dma_buf_len;
+   port.capacity = (uint64_t)i2s_config->dma_buf_count * i2s_config->dma_buf_len;
+   port.installUs = host::nowMicros();
+   port.readIndex = 0;
+   port.nextEvent = port.bufferSamples;
+   port.events = NULL;
+   if (queue_size > 0) {
+      port.events = xQueueCreate(queue_size, sizeof(i2s_event_t));
+      if (port.events == NULL) {
+         port.installed = false;
+         return ESP_ERR_NO_MEM;
+      }
+      *(QueueHandle_t *)i2s_queue = port.events;
+   }
+   return ESP_OK;
+}
+
+esp_err_t i2s_driver_uninstall(i2s_port_t i2s_num) {
+   if (i2s_num >= I2S_NUM_MAX) return ESP_ERR_INVALID_ARG;
+   ports[i2s_num].installed = false;
+   if (ports[i2s_num].events != NULL) {
+      vQueueDelete(ports[i2s_num].events);
+      ports[i2s_num].events = NULL;
+   }
+   return ESP_OK;
+}
+
+esp_err_t i2s_set_pin(i2s_port_t i2s_num, const i2s_pin_config_t *pin) {
+   if (i2s_num >= I2S_NUM_MAX || pin == NULL) return ESP_ERR_INVALID_ARG;
+   return ports[i2s_num].installed ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t i2s_zero_dma_buffer(i2s_port_t i2s_num) {
+   if (i2s_num >= I2S_NUM_MAX) return ESP_ERR_INVALID_ARG;
+   return ESP_OK;
+}
+
+esp_err_t i2s_read(i2s_port_t i2s_num, void *dest, size_t size, size_t *bytes_read, TickType_t ticks_to_wait) {
+   *bytes_read = 0;
+   if (i2s_num >= I2S_NUM_MAX || dest == NULL) return ESP_ERR_INVALID_ARG;
+   I2sPort &port = ports[i2s_num];
+   if (!port.installed) return ESP_ERR_INVALID_STATE;
+
+   uint64_t wanted = size / sizeof(int16_t);
+   accountOverrun(port);
+   uint64_t pending = producedSamples(port) - port.readIndex;
+
+   // Block until the request can be satisfied or the timeout expires
+   if (pending < wanted && ticks_to_wait > 0) {
+      uint64_t missingUs = (wanted - pending) * 1000000ULL / port.sampleRate + 1;
+      uint64_t timeoutUs = (uint64_t)ticks_to_wait * portTICK_PERIOD_MS * 1000ULL;
+      host::advanceMicros(missingUs < timeoutUs ? missingUs : timeoutUs);
+      accountOverrun(port);
+      pending = producedSamples(port) - port.readIndex;
+   }
+
+   uint64_t count = pending < wanted ? pending : wanted;
+   if (count == 0) return ESP_OK;
+   if (sampleSource != NULL) {
+      sampleSource((int16_t *)dest, count, port.readIndex, sampleSourceCtx);
+   } else {
+      memset(dest, 0, count * sizeof(int16_t));
+   }
+   port.readIndex += count;
+   port.delivered += count;
+   *bytes_read = count * sizeof(int16_t);
+   return ESP_OK;
+}
@@ -0,0 +1,670 @@
+/*
+ train_keyword_model.cpp - trains the keyword DS-CNN and writes its int8
+ weights to src/keyword_model_data.cpp (env:native_train).
+
+ Usage: program [output]   (default src/keyword_model_data.cpp)
+
+ The training set is synthetic speech (host/bench/synthetic_speech.h) from
+ speakers the benchmarks never use: "turn on", "turn off" and "status" by
+ SPEAKERS voices each, and as many unknown utterances - fragments of the
+ keywords ("turn", "on", "off"), other words and random syllables. The
+ kws/kwsnn suites' own unknown words are left out, so their false accepts
+ measure how the model does on words it has not seen. Every file takes the
+ firmware's path to an utterance (extractUtterance()).
+
+ The network of keyword_model.h is trained in float with Adam on softmax
+ cross-entropy, then quantized after training as TensorFlow Lite does it:
+ symmetric int8 weights with a scale per output channel, int32 biases,
+ activation ranges from the training set (ReLU outputs use all 256 levels
+ above zero), requantization multipliers in Q31. The quantized model is run
+ with the firmware's KeywordModel on the held-out part of the training
+ speakers, and its accuracy is written into the generated file's header.
+
+ Everything is seeded, so a run reproduces the committed weights.
+*/
+
+#include "keyword_model.h"
+#include "keyword_spotter.h"
+#include "mfcc_frontend.h"
+#include "synthetic_speech.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace {
+
+typedef KeywordModelLayout Layout;
+
+const int SPEAKERS = 500;           // Per class
+const int VALIDATION = 50;          // Of them, held out
+const int EPOCHS = 40;
+const int BATCH = 32;
+const double LEARNING_RATE = 0.003;
+const double WEIGHT_DECAY = 1e-4;
+const uint32_t SEED_BASE = 200000;  // The suites use seeds below 10000
+const uint8_t CLASSES = Layout::CLASSES;
+const uint8_t UNKNOWN = KeywordModel::UNKNOWN;
+
+// --- training words ---------------------------------------------------------
+
+const Segment turn[] = {
+   {GAP, 20, {0, 0, 0}, {0, 0, 0}, 0},
+   BURST_T(15, 0.4f),
+   {VOWEL, 170, {480, 1350, 1700}, {500, 1300, 1650}, 1.0f},
+   NASAL(70, 0.3f),
+};
+const Segment on[] = {
+   {VOWEL, 210, {600, 900, 2450}, {620, 1000, 2500}, 1.0f},
+   NASAL(110, 0.3f),
+};
+const Segment off[] = {
+   {VOWEL, 170, {600, 900, 2450}, {600, 1000, 2500}, 1.0f},
+   {FRICATIVE, 170, {3500, 6000, 0}, {0, 0, 0}, 0.15f},
+};
+const Segment stop[] = {
+   SIBILANT(120),
+   {GAP, 40, {0, 0, 0}, {0, 0, 0}, 0},
+   BURST_T(12, 0.35f),
+   {VOWEL, 180, {650, 1050, 2450}, {600, 1000, 2400}, 1.0f},
+   {GAP, 60, {0, 0, 0}, {0, 0, 0}, 0},
+   {BURST, 15, {1200, 2000, 6}, {0, 0, 0}, 0.3f},
+};
+const Segment yes[] = {
+   {VOWEL, 60, {300, 2200, 2900}, {300, 2200, 2900}, 0.6f},
+   {VOWEL, 180, {550, 1800, 2500}, {600, 1700, 2450}, 1.0f},
+   SIBILANT(160),
+};
+const Segment seven[] = {
+   SIBILANT(110),
+   {VOWEL, 140, {550, 1800, 2500}, {550, 1750, 2500}, 1.0f},
+   {FRICATIVE, 60, {3000, 4000, 0}, {0, 0, 0}, 0.1f},
+   {VOWEL, 90, {500, 1500, 2500}, {500, 1500, 2500}, 0.7f},
+   NASAL(90, 0.3f),
+};
+const Segment door[] = {
+   {BURST, 12, {3000, 3000, 4}, {0, 0, 0}, 0.35f},
+   {VOWEL, 260, {450, 900, 2400}, {500, 1300, 1700}, 1.0f},
+};
+const Segment fan[] = {
+   {FRICATIVE, 110, {4000, 5000, 0}, {0, 0, 0}, 0.15f},
+   {VOWEL, 200, {700, 1700, 2500}, {700, 1750, 2550}, 1.0f},
+   NASAL(100, 0.3f),
+};
+const Segment window[] = {
+   {VOWEL, 60, {300, 700, 2300}, {300, 700, 2300}, 0.6f},
+   {VOWEL, 150, {550, 1800, 2500}, {550, 1800, 2500}, 1.0f},
+   NASAL(60, 0.3f),
+   {BURST, 12, {3000, 3000, 4}, {0, 0, 0}, 0.3f},
+   {VOWEL, 180, {500, 1000, 2400}, {380, 800, 2300}, 1.0f},
+};
+const Segment clap[] = {
+   {BURST, 80, {2500, 5000, 15}, {0, 0, 0}, 1.0f},
+};
+
+const Word trainingUnknowns[] = {WORD("turn", turn), WORD("on", on), WORD("off", off), WORD("stop", stop),
+                                 WORD("yes", yes), WORD("seven", seven), WORD("door", door), WORD("fan", fan),
+                                 WORD("window", window), WORD("clap", clap)};
+const int TRAINING_UNKNOWNS = sizeof(trainingUnknowns) / sizeof(trainingUnknowns[0]);
+
+// 2 to 5 syllable-like segments with random formants, frication and bursts
+Segment randomSegments[8];
+
+Word randomWord(std::mt19937 &random) {
+   std::uniform_real_distribution<float> unit(0, 1);
+   int count = 2 + random() % 4;
+   for (int i = 0; i < count; i++) {
+      Segment &s = randomSegments[i];
+      memset(&s, 0, sizeof(s));
+      int kind = random() % 6;
+      if (kind <= 2) {
+         s.kind = VOWEL;
+         s.ms = 80 + 160 * unit(random);
+         for (int k = 0; k < 3; k++) {
+            float low[3] = {250, 700, 2000};
+            float span[3] = {600, 1700, 1000};
+            s.f[k] = low[k] + span[k] * unit(random);
+            s.fEnd[k] = low[k] + span[k] * unit(random);
+         }
+         s.level = 0.6f + 0.4f * unit(random);
+      } else if (kind == 3) {
+         Segment nasal = NASAL(60, 0.3f);
+         s = nasal;
+         s.ms = 50 + 80 * unit(random);
+      } else if (kind == 4) {
+         s.kind = FRICATIVE;
+         s.ms = 60 + 120 * unit(random);
+         s.f[0] = 2500 + 4000 * unit(random);
+         s.f[1] = 1500 + 4500 * unit(random);
+         s.level = 0.1f + 0.3f * unit(random);
+      } else {
+         s.kind = BURST;
+         s.ms = 10 + 60 * unit(random);
+         s.f[0] = 1500 + 3000 * unit(random);
+         s.f[1] = 2000 + 4000 * unit(random);
+         s.f[2] = 3 + 20 * unit(random);
+         s.level = 0.3f + 0.7f * unit(random);
+      }
+   }
+   Word word = {"random", randomSegments, (size_t)count};
+   return word;
+}
+
+// --- data ------------------------------------------------------------------
+
+const size_t INPUT_SIZE = Layout::SHAPES[Layout::FEATURES].size();
+
+struct Example {
+   uint8_t label;
+   KeywordTemplate features;
+};
+
+std::vector<Example> trainingSet;
+std::vector<Example> validationSet;
+int16_t audio[SPEECH_MAX_SAMPLES];
+MfccFrontEnd frontEnd;
+KeywordSpotter spotter(frontEnd);
+
+void collect(std::mt19937 &random) {
+   const size_t samples = 40 * 1024;
+   int refused = 0;
+   for (int i = 0; i < SPEAKERS; i++) {
+      for (int c = 0; c < CLASSES; c++) {
+         Word word;
+         if (c != UNKNOWN) {
+            word = speechKeywords[c];
+         } else if (i % 2 == 0) {
+            word = trainingUnknowns[(i / 2) % TRAINING_UNKNOWNS];
+         } else {
+            word = randomWord(random);
+         }
+         synthesize(word, speakerFor(SEED_BASE + 1000 * c + i), audio, samples);
+         Example example;
+         example.label = c;
+         if (!extractUtterance(audio, samples, frontEnd, spotter, example.features)) {
+            refused++;
+            continue;
+         }
+         (i < SPEAKERS - VALIDATION ? trainingSet : validationSet).push_back(example);
+      }
+   }
+   printf("%u training and %u validation utterances, %d refused by the voice detector or spotter\n",
+          (unsigned)trainingSet.size(), (unsigned)validationSet.size(), refused);
+}
+
+// --- float model -------------------------------------------------------------
+
+// Parameters of the layer producing tensor t, laid out as the int8 ones
+struct Parameters {
+   std::vector<double> weights, bias;
+   std::vector<double> weightGrad, biasGrad;
+   std::vector<double> weightMoment, weightVariance, biasMoment, biasVariance;
+
+   void resize(size_t w, size_t b) {
+      weights.assign(w, 0);
+      bias.assign(b, 0);
+      weightGrad.assign(w, 0);
+      biasGrad.assign(b, 0);
+      weightMoment.assign(w, 0);
+      weightVariance.assign(w, 0);
+      biasMoment.assign(b, 0);
+      biasVariance.assign(b, 0);
+   }
+};
+
+Parameters parameters[Layout::TENSORS];
+
+bool hasWeights(uint8_t t) {
+   return t >= Layout::CONV && t != Layout::POOL;
+}
+
+size_t weightCount(uint8_t t) {
+   const NnShape &in = Layout::SHAPES[t - 1];
+   const NnShape &out = Layout::SHAPES[t];
+   if (t == Layout::LOGITS) return in.size() * out.channels;
+   const NnConvParams &g = Layout::GEOMETRY[t];
+   size_t taps = (size_t)g.kernelHeight * g.kernelWidth;
+   return Layout::isDepthwise(t) ? taps * in.channels : taps * in.channels * out.channels;
+}
+
+// Inputs each output of the layer sums, for He initialisation
+size_t fanIn(uint8_t t) {
+   const NnShape &in = Layout::SHAPES[t - 1];
+   if (t == Layout::LOGITS) return in.size();
+   const NnConvParams &g = Layout::GEOMETRY[t];
+   return (size_t)g.kernelHeight * g.kernelWidth * (Layout::isDepthwise(t) ? 1 : in.channels);
+}
+
+void initialise(std::mt19937 &random) {
+   for (uint8_t t = Layout::CONV; t < Layout::TENSORS; t++) {
+      if (!hasWeights(t)) continue;
+      Parameters &p = parameters[t];
+      p.resize(weightCount(t), Layout::SHAPES[t].channels);
+      std::normal_distribution<double> normal(0, sqrt(2.0 / fanIn(t)));
+      for (double &w : p.weights) w = normal(random);
+   }
+}
+
+// Activations of one example: tensors after their ReLU
+struct Activations {
+   std::vector<double> tensors[Layout::TENSORS];
+   double probabilities[CLASSES];
+
+   Activations() {
+      for (uint8_t t = 0; t < Layout::TENSORS; t++) tensors[t].assign(Layout::SHAPES[t].size(), 0);
+   }
+};
+
+// Calls visit(outIndex, inIndex, weightIndex) for every product of a
+// convolution layer
+template <typename Visit>
+void convolve(uint8_t t, Visit visit) {
+   const NnShape &in = Layout::SHAPES[t - 1];
+   const NnShape &out = Layout::SHAPES[t];
+   const NnConvParams &g = Layout::GEOMETRY[t];
+   bool depthwise = Layout::isDepthwise(t);
+   for (int oy = 0; oy < out.height; oy++) {
+      for (int ox = 0; ox < out.width; ox++) {
+         for (int ky = 0; ky < g.kernelHeight; ky++) {
+            int iy = oy * g.strideHeight - g.padTop + ky;
+            if (iy < 0 || iy >= in.height) continue;
+            for (int kx = 0; kx < g.kernelWidth; kx++) {
+               int ix = ox * g.strideWidth - g.padLeft + kx;
+               if (ix < 0 || ix >= in.width) continue;
+               size_t inBase = ((size_t)iy * in.width + ix) * in.channels;
+               size_t outBase = ((size_t)oy * out.width + ox) * out.channels;
+               if (depthwise) {
+                  for (int c = 0; c < out.channels; c++) {
+                     visit(outBase + c, inBase + c, ((size_t)ky * g.kernelWidth + kx) * in.channels + c);
+                  }
+               } else {
+                  for (int oc = 0; oc < out.channels; oc++) {
+                     size_t w = (((size_t)oc * g.kernelHeight + ky) * g.kernelWidth + kx) * in.channels;
+                     for (int ic = 0; ic < in.channels; ic++) {
+                        visit(outBase + oc, inBase + ic, w + ic);
+                     }
+                  }
+               }
+            }
+         }
+      }
+   }
+}
+
+void forward(const KeywordTemplate &features, Activations &a) {
+   for (size_t i = 0; i < INPUT_SIZE; i++) {
+      a.tensors[Layout::FEATURES][i] = (&features.features[0][0])[i] / 8.0;
+   }
+   for (uint8_t t = Layout::CONV; t <= Layout::POINTWISE3; t++) {
+      const std::vector<double> &in = a.tensors[t - 1];
+      std::vector<double> &out = a.tensors[t];
+      const Parameters &p = parameters[t];
+      uint16_t channels = Layout::SHAPES[t].channels;
+      for (size_t i = 0; i < out.size(); i++) out[i] = p.bias[i % channels];
+      convolve(t, [&](size_t o, size_t i, size_t w) { out[o] += in[i] * p.weights[w]; });
+      for (double &v : out) v = v > 0 ? v : 0;
+   }
+
+   const NnShape &last = Layout::SHAPES[Layout::POINTWISE3];
+   std::vector<double> &pool = a.tensors[Layout::POOL];
+   for (int c = 0; c < last.channels; c++) {
+      double sum = 0;
+      for (int i = 0; i < last.height * last.width; i++) sum += a.tensors[Layout::POINTWISE3][i * last.channels + c];
+      pool[c] = sum / (last.height * last.width);
+   }
+
+   const Parameters &dense = parameters[Layout::LOGITS];
+   std::vector<double> &logits = a.tensors[Layout::LOGITS];
+   double largest = -1e300;
+   for (int k = 0; k < CLASSES; k++) {
+      double v = dense.bias[k];
+      for (size_t i = 0; i < pool.size(); i++) v += dense.weights[k * pool.size() + i] * pool[i];
+      logits[k] = v;
+      largest = std::max(largest, v);
+   }
+   double sum = 0;
+   for (int k = 0; k < CLASSES; k++) sum += a.probabilities[k] = exp(logits[k] - largest);
+   for (int k = 0; k < CLASSES; k++) a.probabilities[k] /= sum;
+}
+
+// Adds the gradients of one example's cross-entropy; returns its loss
+double backward(const Activations &a, uint8_t label) {
+   std::vector<double> grad[Layout::TENSORS];
+   for (uint8_t t = 0; t < Layout::TENSORS; t++) grad[t].assign(Layout::SHAPES[t].size(), 0);
+
+   Parameters &dense = parameters[Layout::LOGITS];
+   const std::vector<double> &pool = a.tensors[Layout::POOL];
+   for (int k = 0; k < CLASSES; k++) {
+      double g = a.probabilities[k] - (k == label ? 1 : 0);
+      dense.biasGrad[k] += g;
+      for (size_t i = 0; i < pool.size(); i++) {
+         dense.weightGrad[k * pool.size() + i] += g * pool[i];
+         grad[Layout::POOL][i] += g * dense.weights[k * pool.size() + i];
+      }
+   }
+
+   const NnShape &last = Layout::SHAPES[Layout::POINTWISE3];
+   for (int i = 0; i < last.height * last.width; i++) {
+      for (int c = 0; c < last.channels; c++) {
+         grad[Layout::POINTWISE3][i * last.channels + c] = grad[Layout::POOL][c] / (last.height * last.width);
+      }
+   }
+
+   for (uint8_t t = Layout::POINTWISE3; t >= Layout::CONV; t--) {
+      std::vector<double> &g = grad[t];
+      const std::vector<double> &out = a.tensors[t];
+      const std::vector<double> &in = a.tensors[t - 1];
+      std::vector<double> &gIn = grad[t - 1];
+      Parameters &p = parameters[t];
+      uint16_t channels = Layout::SHAPES[t].channels;
+      for (size_t i = 0; i < g.size(); i++) {
+         if (out[i] <= 0) g[i] = 0;  // ReLU
+         p.biasGrad[i % channels] += g[i];
+      }
+      bool first = t == Layout::CONV;
+      convolve(t, [&](size_t o, size_t i, size_t w) {
+         p.weightGrad[w] += g[o] * in[i];
+         if (!first) gIn[i] += g[o] * p.weights[w];
+      });
+   }
+   return -log(std::max(a.probabilities[label], 1e-12));
+}
+
+void adamStep(std::vector<double> &value, std::vector<double> &grad, std::vector<double> &moment,
+              std::vector<double> &variance, double rate, int step, double decay) {
+   const double beta1 = 0.9, beta2 = 0.999;
+   double correction1 = 1 - pow(beta1, step);
+   double correction2 = 1 - pow(beta2, step);
+   for (size_t i = 0; i < value.size(); i++) {
+      double g = grad[i] + decay * value[i];
+      moment[i] = beta1 * moment[i] + (1 - beta1) * g;
+      variance[i] = beta2 * variance[i] + (1 - beta2) * g * g;
+      value[i] -= rate * (moment[i] / correction1) / (sqrt(variance[i] / correction2) + 1e-8);
+      grad[i] = 0;
+   }
+}
+
+int predict(const KeywordTemplate &features) {
+   Activations a;
+   forward(features, a);
+   return std::max_element(a.probabilities, a.probabilities + CLASSES) - a.probabilities;
+}
+
+double accuracy(const std::vector<Example> &set) {
+   int correct = 0;
+   for (const Example &e : set) correct += predict(e.features) == e.label;
+   return set.empty() ? 0 : (double)correct / set.size();
+}
+
+void train(std::mt19937 &random) {
+   std::vector<size_t> order(trainingSet.size());
+   for (size_t i = 0; i < order.size(); i++) order[i] = i;
+   int step = 0;
+   Activations a;
+   for (int epoch = 0; epoch < EPOCHS; epoch++) {
+      std::shuffle(order.begin(), order.end(), random);
+      // Cosine decay to a tenth
+      double rate = LEARNING_RATE * (0.55 + 0.45 * cos(M_PI * epoch / EPOCHS));
+      double loss = 0;
+      for (size_t start = 0; start < order.size(); start += BATCH) {
+         size_t end = std::min(order.size(), start + BATCH);
+         for (size_t i = start; i < end; i++) {
+            const Example &e = trainingSet[order[i]];
+            forward(e.features, a);
+            loss += backward(a, e.label);
+         }
+         step++;
+         for (uint8_t t = Layout::CONV; t < Layout::TENSORS; t++) {
+            if (!hasWeights(t)) continue;
+            Parameters &p = parameters[t];
+            for (double &g : p.weightGrad) g /= (end - start);
+            for (double &g : p.biasGrad) g /= (end - start);
+            adamStep(p.weights, p.weightGrad, p.weightMoment, p.weightVariance, rate, step, WEIGHT_DECAY);
+            adamStep(p.bias, p.biasGrad, p.biasMoment, p.biasVariance, rate, step, 0);
+         }
+      }
+      if (epoch % 5 == 4 || epoch == EPOCHS - 1) {
+         printf("epoch %2d: loss %.4f, training %.1f%%, validation %.1f%%\n", epoch + 1, loss / order.size(),
+                100 * accuracy(trainingSet), 100 * accuracy(validationSet));
+         fflush(stdout);
+      }
+   }
+}
+
+// --- quantization ------------------------------------------------------------
+
+KeywordModelWeights quantized;
+
+NnRequant quantizeMultiplier(double real) {
+   NnRequant requant = {0, 0};
+   if (real <= 0) return requant;
+   int exponent;
+   double fraction = frexp(real, &exponent);
+   int64_t multiplier = llround(fraction * (1LL << 31));
+   if (multiplier == (1LL << 31)) {
+      multiplier /= 2;
+      exponent++;
+   }
+   requant.multiplier = (int32_t)multiplier;
+   requant.shift = (int8_t)exponent;
+   return requant;
+}
+
+template <size_t WEIGHTS, uint16_t CHANNELS>
+void quantizeLayer(uint8_t t, KeywordModelLayer<WEIGHTS, CHANNELS> &layer) {
+   const Parameters &p = parameters[t];
+   size_t perChannel = WEIGHTS / CHANNELS;
+   bool depthwise = Layout::isDepthwise(t);
+   // Weight w belongs to output channel w % CHANNELS in a depthwise filter,
+   // w / perChannel in the others
+   double scales[CHANNELS];
+   for (int c = 0; c < CHANNELS; c++) {
+      double largest = 0;
+      for (size_t k = 0; k < perChannel; k++) {
+         size_t w = depthwise ? k * CHANNELS + c : c * perChannel + k;
+         largest = std::max(largest, fabs(p.weights[w]));
+      }
+      scales[c] = largest > 0 ? largest / 127 : 1;
+      layer.scale[c] = (float)scales[c];
+   }
+   double inputScale = quantized.scale[t - 1];
+   double outputScale = quantized.scale[t];
+   for (size_t w = 0; w < WEIGHTS; w++) {
+      int c = depthwise ? w % CHANNELS : w / perChannel;
+      layer.filter[w] = (int8_t)std::max(-127L, std::min(127L, lround(p.weights[w] / layer.scale[c])));
+   }
+   for (int c = 0; c < CHANNELS; c++) {
+      double product = inputScale * layer.scale[c];
+      layer.bias[c] = (int32_t)llround(p.bias[c] / product);
+      layer.requant[c] = quantizeMultiplier(product / outputScale);
+   }
+}
+
+void quantize() {
+   // Activation ranges over the training set
+   double largest[Layout::TENSORS] = {};
+   double smallest[Layout::TENSORS] = {};
+   Activations a;
+   for (const Example &e : trainingSet) {
+      forward(e.features, a);
+      for (uint8_t t = Layout::CONV; t < Layout::TENSORS; t++) {
+         for (double v : a.tensors[t]) {
+            largest[t] = std::max(largest[t], v);
+            smallest[t] = std::min(smallest[t], v);
+         }
+      }
+   }
+
+   quantized.scale[Layout::FEATURES] = 1.0f / 8;
+   quantized.zero[Layout::FEATURES] = 0;
+   for (uint8_t t = Layout::CONV; t <= Layout::POINTWISE3; t++) {
+      quantized.scale[t] = (float)(largest[t] > 0 ? largest[t] / 255 : 1);
+      quantized.zero[t] = -128;
+   }
+   // Averages stay within their inputs' range
+   quantized.scale[Layout::POOL] = quantized.scale[Layout::POINTWISE3];
+   quantized.zero[Layout::POOL] = quantized.zero[Layout::POINTWISE3];
+   double range = std::max(largest[Layout::LOGITS], 0.0) - std::min(smallest[Layout::LOGITS], 0.0);
+   quantized.scale[Layout::LOGITS] = (float)(range > 0 ? range / 255 : 1);
+   long zero = lround(-128 - std::min(smallest[Layout::LOGITS], 0.0) / quantized.scale[Layout::LOGITS]);
+   quantized.zero[Layout::LOGITS] = (int8_t)std::max(-128L, std::min(127L, zero));
+
+   quantizeLayer(Layout::CONV, quantized.conv);
+   quantizeLayer(Layout::DEPTHWISE1, quantized.depthwise1);
+   quantizeLayer(Layout::POINTWISE1, quantized.pointwise1);
+   quantizeLayer(Layout::DEPTHWISE2, quantized.depthwise2);
+   quantizeLayer(Layout::POINTWISE2, quantized.pointwise2);
+   quantizeLayer(Layout::DEPTHWISE3, quantized.depthwise3);
+   quantizeLayer(Layout::POINTWISE3, quantized.pointwise3);
+   quantizeLayer(Layout::LOGITS, quantized.dense);
+
+   for (int d = 0; d < 256; d++) {
+      quantized.softmax[d] = (uint16_t)lround(65535 * exp(-d * (double)quantized.scale[Layout::LOGITS]));
+   }
+}
+
+double quantizedAccuracy(KeywordModel &model, const std::vector<Example> &set) {
+   int correct = 0;
+   for (const Example &e : set) {
+      int8_t probabilities[CLASSES];
+      model.infer(e.features, probabilities);
+      correct += std::max_element(probabilities, probabilities + CLASSES) - probabilities == e.label;
+   }
+   return set.empty() ? 0 : (double)correct / set.size();
+}
+
+// --- output ------------------------------------------------------------------
+
+// Brace-enclosed lists wrapped at 112 columns
+struct Writer {
+   FILE *file;
+   int indent;
+   int column;
+   bool first;
+
+   void begin(int at) {
+      indent = at;
+      fprintf(file, "%*s{", indent, "");
+      column = indent + 1;
+      first = true;
+   }
+   void item(const char *text) {
+      int length = strlen(text);
+      if (first) {
+         first = false;
+      } else if (column + length + 4 > 112) {
+         fprintf(file, ",\n%*s", indent + 1, "");
+         column = indent + 1;
+      } else {
+         fprintf(file, ", ");
+         column += 2;
+      }
+      fprintf(file, "%s", text);
+      column += length;
+   }
+   void end() { fprintf(file, "},\n"); }
+};
+
+template <size_t WEIGHTS, uint16_t CHANNELS>
+void writeLayer(Writer &out, const char *name, const KeywordModelLayer<WEIGHTS, CHANNELS> &layer) {
+   char text[48];
+   fprintf(out.file, "  {  // %s\n", name);
+   out.begin(4);
+   for (size_t i = 0; i < WEIGHTS; i++) {
+      snprintf(text, sizeof(text), "%d", layer.filter[i]);
+      out.item(text);
+   }
+   out.end();
+   out.begin(4);
+   for (int c = 0; c < CHANNELS; c++) {
+      snprintf(text, sizeof(text), "%ld", (long)layer.bias[c]);
+      out.item(text);
+   }
+   out.end();
+   out.begin(4);
+   for (int c = 0; c < CHANNELS; c++) {
+      snprintf(text, sizeof(text), "%.9gf", layer.scale[c]);
+      out.item(text);
+   }
+   out.end();
+   out.begin(4);
+   for (int c = 0; c < CHANNELS; c++) {
+      snprintf(text, sizeof(text), "{%ld, %d}", (long)layer.requant[c].multiplier, layer.requant[c].shift);
+      out.item(text);
+   }
+   out.end();
+   fprintf(out.file, "  },\n");
+}
+
+bool write(const char *path, double floatAccuracy, double int8Accuracy) {
+   FILE *file = fopen(path, "w");
+   if (file == NULL) return false;
+   fprintf(file, "// Keyword model weights, written by host/tools/train_keyword_model.cpp - do not edit.\n");
+   fprintf(file, "//\n");
+   fprintf(file, "// %d synthetic speakers per class, %u training utterances, %d epochs. Validation\n", SPEAKERS,
+           (unsigned)trainingSet.size(), EPOCHS);
+   fprintf(file, "// accuracy on %u held-out utterances: %.1f%% in float, %.1f%% in int8.\n",
+           (unsigned)validationSet.size(), 100 * floatAccuracy, 100 * int8Accuracy);
+   fprintf(file, "\n#include \"keyword_model.h\"\n\n");
+   fprintf(file, "const KeywordModelWeights keywordModelWeights = {\n");
+   Writer out = {file, 0, 0, true};
+   writeLayer(out, "conv", quantized.conv);
+   writeLayer(out, "depthwise 1", quantized.depthwise1);
+   writeLayer(out, "pointwise 1", quantized.pointwise1);
+   writeLayer(out, "depthwise 2", quantized.depthwise2);
+   writeLayer(out, "pointwise 2", quantized.pointwise2);
+   writeLayer(out, "depthwise 3", quantized.depthwise3);
+   writeLayer(out, "pointwise 3", quantized.pointwise3);
+   writeLayer(out, "dense", quantized.dense);
+
+   char text[48];
+   fprintf(file, "  // Activation scales and zero points, input first\n");
+   out.begin(2);
+   for (int t = 0; t < Layout::TENSORS; t++) {
+      snprintf(text, sizeof(text), "%.9gf", quantized.scale[t]);
+      out.item(text);
+   }
+   out.end();
+   out.begin(2);
+   for (int t = 0; t < Layout::TENSORS; t++) {
+      snprintf(text, sizeof(text), "%d", quantized.zero[t]);
+      out.item(text);
+   }
+   out.end();
+   fprintf(file, "  // Softmax: exp(-d * logit scale), Q16\n");
+   out.begin(2);
+   for (int d = 0; d < 256; d++) {
+      snprintf(text, sizeof(text), "%u", (unsigned)quantized.softmax[d]);
+      out.item(text);
+   }
+   out.end();
+   fprintf(file, "};\n");
+   return fclose(file) == 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+   const char *output = argc > 1 ? argv[1] : "src/keyword_model_data.cpp";
+   std::mt19937 random(25);
+   collect(random);
+   initialise(random);
+   train(random);
+   double floatAccuracy = accuracy(validationSet);
+
+   quantize();
+   static KeywordModel model(quantized);
+   double int8Accuracy = quantizedAccuracy(model, validationSet);
+   printf("validation accuracy: float %.1f%%, int8 %.1f%%\n", 100 * floatAccuracy, 100 * int8Accuracy);
+
+   if (!write(output, floatAccuracy, int8Accuracy)) {
+      printf("could not write %s\n", output);
+      return 1;
+   }
+   printf("wrote %s\n", output);
+   return 0;
+}
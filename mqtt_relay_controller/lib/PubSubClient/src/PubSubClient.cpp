@@ -0,0 +1,1737 @@
+/*
+
+  PubSubClient.cpp - A simple client for MQTT.
+  Nick O'Leary
+  http://knolleary.net
+*/
+
+#include "PubSubClient.h"
+#include "Arduino.h"
+
+// MQTT variable byte integer at buf[pos], not reading past buf[end-1].
+// Returns the bytes it takes, 0 if it is malformed or not all there
+static uint8_t readVarInt(const uint8_t* buf, uint32_t pos, uint32_t end, uint32_t* value) {
+    uint32_t multiplier = 1;
+    *value = 0;
+    for (uint8_t i = 0; i < 4 && pos + i < end; i++) {
+        *value += (buf[pos+i] & 127) * multiplier;
+        if ((buf[pos+i] & 128) == 0) {
+            return i + 1;
+        }
+        multiplier <<= 7;
+    }
+    return 0;
+}
+
+static uint8_t writeVarInt(uint8_t* buf, uint32_t value) {
+    uint8_t pos = 0;
+    do {
+        uint8_t digit = value & 127;
+        value >>= 7;
+        if (value > 0) {
+            digit |= 0x80;
+        }
+        buf[pos++] = digit;
+    } while (value > 0);
+    return pos;
+}
+
+static uint8_t varIntSize(uint32_t value) {
+    uint8_t size = 1;
+    while (value >= 128) {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+// Bytes taken by the MQTT 5 property at buf[pos], identifier included;
+// 0 for an unknown identifier or one running past buf[end-1]
+static uint32_t propertyLength(const uint8_t* buf, uint32_t pos, uint32_t end) {
+    uint32_t size;
+    switch (buf[pos]) {
+        case 0x01: case 0x17: case 0x19: case 0x24: case 0x25: case 0x28: case 0x29: case 0x2A:
+            size = 2;
+            break;
+        case 0x13: case 0x21: case 0x22: case 0x23:
+            size = 3;
+            break;
+        case 0x02: case 0x11: case 0x18: case 0x27:
+            size = 5;
+            break;
+        case 0x0B: {
+            uint32_t value;
+            uint8_t n = readVarInt(buf, pos+1, end, &value);
+            if (n == 0) {
+                return 0;
+            }
+            size = 1 + n;
+            break;
+        }
+        case 0x03: case 0x08: case 0x09: case 0x12: case 0x15: case 0x16: case 0x1A: case 0x1C: case 0x1F:
+            if (pos + 3 > end) {
+                return 0;
+            }
+            size = 3 + ((buf[pos+1]<<8)|buf[pos+2]);
+            break;
+        case 0x26: {
+            // User property: a pair of strings
+            if (pos + 3 > end) {
+                return 0;
+            }
+            uint32_t first = 3 + ((buf[pos+1]<<8)|buf[pos+2]);
+            if (pos + first + 2 > end) {
+                return 0;
+            }
+            size = first + 2 + ((buf[pos+first]<<8)|buf[pos+first+1]);
+            break;
+        }
+        default:
+            return 0;
+    }
+    return pos + size <= end ? size : 0;
+}
+
+// State shared by every constructor; they then set server, callback,
+// client and stream as given
+void PubSubClient::init() {
+    this->_state = MQTT_DISCONNECTED;
+    this->_client = NULL;
+    this->stream = NULL;
+    setCallback(NULL);
+    this->bufferSize = 0;
+    this->chunkHandler = NULL;
+    this->chunking = CHUNK_NONE;
+    resetReader();
+    memset(&this->stats, 0, sizeof(this->stats));
+    this->writePos = 0;
+    this->publishing = false;
+    this->writeFailed = false;
+    this->corked = false;
+    this->connectSentUs = 0;
+    this->inflightHead = 0;
+    this->inflightUsed = 0;
+    this->inflightUnacked = 0;
+    this->inflightWindow = MQTT_MAX_INFLIGHT;
+    this->inflightStoreHead = 0;
+    this->recording = false;
+    this->recorded = 0;
+    this->protocol = MQTT_VERSION;
+    this->serverReceiveMaximum = 0xFFFF;
+    this->topicAliasMaximum = 0;
+    this->aliasCount = 0;
+    this->aliasesSent = 0;
+    memset(&this->received, 0, sizeof(this->received));
+    setBufferSize(MQTT_MAX_PACKET_SIZE);
+    setKeepAlive(MQTT_KEEPALIVE);
+    setSocketTimeout(MQTT_SOCKET_TIMEOUT);
+}
+
+PubSubClient::PubSubClient() {
+    init();
+}
+
+PubSubClient::PubSubClient(Client& client) {
+    init();
+    setClient(client);
+}
+
+PubSubClient::PubSubClient(IPAddress addr, uint16_t port, Client& client) {
+    init();
+    setServer(addr, port);
+    setClient(client);
+}
+
+PubSubClient::PubSubClient(IPAddress addr, uint16_t port, Client& client, Stream& stream) {
+    init();
+    setServer(addr,port);
+    setClient(client);
+    setStream(stream);
+}
+
+PubSubClient::PubSubClient(IPAddress addr, uint16_t port, MQTT_CALLBACK_SIGNATURE, Client& client) {
+    init();
+    setServer(addr, port);
+    setCallback(callback);
+    setClient(client);
+}
+
+PubSubClient::PubSubClient(IPAddress addr, uint16_t port, MQTT_CALLBACK_SIGNATURE, Client& client, Stream& stream) {
+    init();
+    setServer(addr,port);
+    setCallback(callback);
+    setClient(client);
+    setStream(stream);
+}
+
+PubSubClient::PubSubClient(uint8_t *ip, uint16_t port, Client& client) {
+    init();
+    setServer(ip, port);
+    setClient(client);
+}
+
+PubSubClient::PubSubClient(uint8_t *ip, uint16_t port, Client& client, Stream& stream) {
+    init();
+    setServer(ip,port);
+    setClient(client);
+    setStream(stream);
+}
+
+PubSubClient::PubSubClient(uint8_t *ip, uint16_t port, MQTT_CALLBACK_SIGNATURE, Client& client) {
+    init();
+    setServer(ip, port);
+    setCallback(callback);
+    setClient(client);
+}
+
+PubSubClient::PubSubClient(uint8_t *ip, uint16_t port, MQTT_CALLBACK_SIGNATURE, Client& client, Stream& stream) {
+    init();
+    setServer(ip,port);
+    setCallback(callback);
+    setClient(client);
+    setStream(stream);
+}
+
+PubSubClient::PubSubClient(const char* domain, uint16_t port, Client& client) {
+    init();
+    setServer(domain,port);
+    setClient(client);
+}
+
+PubSubClient::PubSubClient(const char* domain, uint16_t port, Client& client, Stream& stream) {
+    init();
+    setServer(domain,port);
+    setClient(client);
+    setStream(stream);
+}
+
+PubSubClient::PubSubClient(const char* domain, uint16_t port, MQTT_CALLBACK_SIGNATURE, Client& client) {
+    init();
+    setServer(domain,port);
+    setCallback(callback);
+    setClient(client);
+}
+
+PubSubClient::PubSubClient(const char* domain, uint16_t port, MQTT_CALLBACK_SIGNATURE, Client& client, Stream& stream) {
+    init();
+    setServer(domain,port);
+    setCallback(callback);
+    setClient(client);
+    setStream(stream);
+}
+
+PubSubClient::~PubSubClient() {
+  free(this->buffer);
+}
+
+boolean PubSubClient::connect(const char *id) {
+    return connect(id,NULL,NULL,0,0,0,0,1);
+}
+
+boolean PubSubClient::connect(const char *id, const char *user, const char *pass) {
+    return connect(id,user,pass,0,0,0,0,1);
+}
+
+boolean PubSubClient::connect(const char *id, const char* willTopic, uint8_t willQos, boolean willRetain, const char* willMessage) {
+    return connect(id,NULL,NULL,willTopic,willQos,willRetain,willMessage,1);
+}
+
+boolean PubSubClient::connect(const char *id, const char *user, const char *pass, const char* willTopic, uint8_t willQos, boolean willRetain, const char* willMessage) {
+    return connect(id,user,pass,willTopic,willQos,willRetain,willMessage,1);
+}
+
+boolean PubSubClient::connect(const char *id, const char *user, const char *pass, const char* willTopic, uint8_t willQos, boolean willRetain, const char* willMessage, boolean cleanSession) {
+    if (connected()) {
+        return true;
+    }
+    if (!connectAsync(id,user,pass,willTopic,willQos,willRetain,willMessage,cleanSession)) {
+        return false;
+    }
+    int rc;
+    while ((rc = poll()) == MQTT_CONNECTING) {
+        yield();
+    }
+    return rc == MQTT_CONNECTED;
+}
+
+// Opens the network connection if needed and sends CONNECT; poll() (or
+// loop()) then completes the handshake when the CONNACK arrives
+boolean PubSubClient::connectAsync(const char *id, const char *user, const char *pass, const char* willTopic, uint8_t willQos, boolean willRetain, const char* willMessage, boolean cleanSession) {
+    if (!connected()) {
+        int result = 0;
+
+        this->stats.connectTcpUs = 0;
+        this->stats.connectMqttUs = 0;
+        if(_client->connected()) {
+            result = 1;
+        } else {
+            unsigned long started = micros();
+            if (domain != NULL) {
+                result = _client->connect(this->domain, this->port);
+            } else {
+                result = _client->connect(this->ip, this->port);
+            }
+            this->stats.connectTcpUs = micros() - started;
+        }
+
+        if (result == 1) {
+            nextMsgId = 1;
+            // Leave room in the buffer for header and variable length field
+            uint16_t length = MQTT_MAX_HEADER_SIZE;
+            unsigned int j;
+
+            if (this->protocol == MQTT_VERSION_3_1) {
+                uint8_t d[9] = {0x00,0x06,'M','Q','I','s','d','p', MQTT_VERSION_3_1};
+                for (j = 0;j<sizeof(d);j++) {
+                    this->buffer[length++] = d[j];
+                }
+            } else {
+                uint8_t d[7] = {0x00,0x04,'M','Q','T','T',this->protocol};
+                for (j = 0;j<sizeof(d);j++) {
+                    this->buffer[length++] = d[j];
+                }
+            }
+
+            uint8_t v;
+            if (willTopic) {
+                v = 0x04|(willQos<<3)|(willRetain<<5);
+            } else {
+                v = 0x00;
+            }
+            if (cleanSession) {
+                v = v|0x02;
+            }
+
+            if(user != NULL) {
+                v = v|0x80;
+
+                if(pass != NULL) {
+                    v = v|(0x80>>1);
+                }
+            }
+            this->buffer[length++] = v;
+
+            this->buffer[length++] = ((this->keepAlive) >> 8);
+            this->buffer[length++] = ((this->keepAlive) & 0xFF);
+
+            if (this->protocol == MQTT_VERSION_5) {
+                // No Topic Alias Maximum: the broker names every topic in full
+                this->buffer[length++] = 3;
+                this->buffer[length++] = MQTT_PROP_RECEIVE_MAXIMUM;
+                this->buffer[length++] = (MQTT_RECEIVE_MAXIMUM >> 8);
+                this->buffer[length++] = (MQTT_RECEIVE_MAXIMUM & 0xFF);
+            }
+
+            CHECK_STRING_LENGTH(length,id)
+            length = writeString(id,this->buffer,length);
+            if (willTopic) {
+                if (this->protocol == MQTT_VERSION_5) {
+                    // Will properties: none
+                    this->buffer[length++] = 0;
+                }
+                CHECK_STRING_LENGTH(length,willTopic)
+                length = writeString(willTopic,this->buffer,length);
+                CHECK_STRING_LENGTH(length,willMessage)
+                length = writeString(willMessage,this->buffer,length);
+            }
+
+            if(user != NULL) {
+                CHECK_STRING_LENGTH(length,user)
+                length = writeString(user,this->buffer,length);
+                if(pass != NULL) {
+                    CHECK_STRING_LENGTH(length,pass)
+                    length = writeString(pass,this->buffer,length);
+                }
+            }
+
+            // Nothing corked for an earlier connection goes to this one,
+            // and CONNECT itself is not held back
+            this->writePos = 0;
+            write(MQTTCONNECT,this->buffer,length-MQTT_MAX_HEADER_SIZE);
+
+            lastInActivity = lastOutActivity = millis();
+            this->connectSentUs = micros();
+            resetReader();
+            _state = MQTT_CONNECTING;
+            return true;
+        }
+        _state = MQTT_CONNECT_FAILED;
+        return false;
+    }
+    return true;
+}
+
+// Checks for the CONNACK without waiting for it. Returns MQTT_CONNECTING
+// while it is outstanding, then MQTT_CONNECTED or the reason it failed.
+int PubSubClient::poll() {
+    if (_state != MQTT_CONNECTING) {
+        return _state;
+    }
+    uint8_t llen;
+    uint32_t len = readPacket(&llen);
+    if (len == 0) {
+        if (_state != MQTT_CONNECTING) {
+            // readPacket found a malformed packet and closed the connection
+            return _state;
+        }
+        unsigned long t = millis();
+        if (!_client->connected() || t-lastInActivity >= ((int32_t) this->socketTimeout*1000UL)) {
+            _state = MQTT_CONNECTION_TIMEOUT;
+            _client->stop();
+        }
+        return _state;
+    }
+
+    this->stats.connectMqttUs = micros() - this->connectSentUs;
+    if (len >= (uint32_t)llen + 3 && (this->buffer[0]&0xF0) == MQTTCONNACK) {
+        uint8_t rc = this->buffer[llen+2];
+        this->serverReceiveMaximum = 0xFFFF;
+        this->topicAliasMaximum = 0;
+        this->aliasesSent = 0;
+        if (rc == 0 && (this->protocol != MQTT_VERSION_5 || readConnackProperties(this->buffer+llen+3, len-llen-3))) {
+            lastInActivity = millis();
+            pingOutstanding = false;
+            _state = MQTT_CONNECTED;
+            resendInflight();
+            return _state;
+        }
+        switch (rc) {
+            // MQTT 5 reason codes; a broker without MQTT 5 answers in 3.1.1 form
+            case 0x00: _state = MQTT_CONNECT_FAILED; break;
+            case 0x84: _state = MQTT_CONNECT_BAD_PROTOCOL; break;
+            case 0x85: _state = MQTT_CONNECT_BAD_CLIENT_ID; break;
+            case 0x86: _state = MQTT_CONNECT_BAD_CREDENTIALS; break;
+            case 0x87: _state = MQTT_CONNECT_UNAUTHORIZED; break;
+            case 0x88: case 0x89: _state = MQTT_CONNECT_UNAVAILABLE; break;
+            default: _state = rc < 0x80 ? rc : MQTT_CONNECT_FAILED; break;
+        }
+    } else {
+        _state = MQTT_CONNECT_FAILED;
+    }
+    _client->stop();
+    return _state;
+}
+
+void PubSubClient::resetReader() {
+    this->readState = READ_FIXED_HEADER;
+    this->readPos = 0;
+    this->readHeaderLength = 0;
+    this->readLength = 0;
+    this->readMultiplier = 1;
+    this->readBodyReceived = 0;
+    this->readOverflow = false;
+    if (this->chunking == CHUNK_PAYLOAD) {
+        // The rest of the message will not come
+        this->chunking = CHUNK_NONE;
+        this->chunkHandler->end(false);
+    }
+    this->chunking = CHUNK_NONE;
+}
+
+// One bulk read of at most maxLength bytes; 0 when nothing is buffered
+int PubSubClient::readAvailable(uint8_t* dst, size_t maxLength) {
+    int available = _client->available();
+    if (available <= 0) {
+        return 0;
+    }
+    if ((size_t)available < maxLength) {
+        maxLength = available;
+    }
+    int rc = _client->read(dst, maxLength);
+    this->stats.readCalls++;
+    if (rc <= 0) {
+        return 0;
+    }
+    this->stats.bytesIn += rc;
+    this->readProgressAt = millis();
+    return rc;
+}
+
+// Pass the PUBLISH payload bytes in data (body offset `offset`) to the stream
+void PubSubClient::streamPayload(const uint8_t* data, uint32_t offset, size_t length) {
+    uint8_t llen = this->readHeaderLength - 1;
+    uint32_t skip = 2 + ((this->buffer[llen+1]<<8)+this->buffer[llen+2]);
+    if (this->buffer[0]&MQTTQOS1) {
+        // skip message id
+        skip += 2;
+    }
+    if (this->protocol == MQTT_VERSION_5) {
+        // and the properties; until their length has arrived nothing is payload
+        uint32_t propertiesLength;
+        uint8_t n = readVarInt(this->buffer+llen+1, skip, offset+length, &propertiesLength);
+        if (n == 0) {
+            return;
+        }
+        skip += n + propertiesLength;
+    }
+    for (size_t i = 0; i < length; i++) {
+        if (offset + i >= skip) {
+            this->stream->write(data[i]);
+        }
+    }
+}
+
+// Once the topic, message id and properties of an oversized PUBLISH are in
+// the buffer, offer the message to the chunk handler and pass it the
+// payload bytes read with them. If they do not fit, or the handler declines,
+// the packet is discarded as usual.
+void PubSubClient::startChunked() {
+    uint32_t end = this->readPos;
+    uint32_t pos = this->readHeaderLength;
+    uint32_t propertiesLength = 0;
+    uint8_t n = 0;
+    boolean complete = pos + 2 <= end;
+    if (complete) {
+        pos += 2 + ((this->buffer[pos]<<8)+this->buffer[pos+1]);
+        if ((this->buffer[0]&0x06) == MQTTQOS1) {
+            pos += 2;
+        }
+        if (this->protocol == MQTT_VERSION_5) {
+            n = readVarInt(this->buffer, pos, end, &propertiesLength);
+            complete = n > 0;
+            pos += n + propertiesLength;
+        }
+        complete = complete && pos <= end;
+    }
+    if (!complete) {
+        if (end >= this->bufferSize) {
+            this->chunking = CHUNK_OFF;
+        }
+        return;
+    }
+    this->chunking = CHUNK_OFF;
+    if (pos >= this->bufferSize || pos > this->readHeaderLength + this->readLength) {
+        return;
+    }
+    if (this->protocol == MQTT_VERSION_5 &&
+        !readPublishProperties(this->buffer+pos-propertiesLength, propertiesLength)) {
+        return;
+    }
+    uint8_t llen = this->readHeaderLength - 1;
+    uint16_t tl = (this->buffer[llen+1]<<8)+this->buffer[llen+2];
+    this->chunkMsgId = 0;
+    if ((this->buffer[0]&0x06) == MQTTQOS1) {
+        this->chunkMsgId = (this->buffer[llen+3+tl]<<8)+this->buffer[llen+4+tl];
+    }
+    memmove(this->buffer+llen+2,this->buffer+llen+3,tl);
+    this->buffer[llen+2+tl] = 0;
+    if (!this->chunkHandler->begin((char*) this->buffer+llen+2, this->readHeaderLength + this->readLength - pos)) {
+        return;
+    }
+    this->chunking = CHUNK_PAYLOAD;
+    this->chunkAt = pos;
+    if (end > pos) {
+        this->chunkHandler->chunk(this->buffer+pos, end-pos);
+    }
+}
+
+// Reads whatever part of the current packet the client has buffered and
+// returns at once when it runs out; the next call carries on from there.
+// Only the bytes of this packet are requested (the fixed header one or two
+// at a time, then the body in bulk), so nothing past it is consumed.
+// Returns the number of bytes in the buffer once the packet is complete,
+// 0 while it is incomplete, on error, or when an oversized packet was
+// discarded.
+uint32_t PubSubClient::readPacket(uint8_t* lengthLength) {
+    while (this->readState == READ_FIXED_HEADER) {
+        // Type byte plus the first length byte, then one length byte at a time
+        uint16_t start = this->readPos;
+        int rc = readAvailable(this->buffer + start, start == 0 ? 2 : 1);
+        if (rc == 0) {
+            return 0;
+        }
+        this->readPos += rc;
+        for (uint16_t i = (start == 0 ? 1 : start); i < this->readPos; i++) {
+            uint8_t digit = this->buffer[i];
+            this->readLength += (digit & 127) * this->readMultiplier;
+            this->readMultiplier <<= 7; //multiplier *= 128
+            if ((digit & 128) == 0) {
+                this->readHeaderLength = this->readPos;
+                this->readState = READ_BODY;
+            } else if (i == 4) {
+                // Invalid remaining length encoding - kill the connection
+                _state = MQTT_DISCONNECTED;
+                _client->stop();
+                resetReader();
+                return 0;
+            }
+        }
+    }
+
+    bool isPublish = (this->buffer[0]&0xF0) == MQTTPUBLISH;
+    if (this->chunking == CHUNK_NONE && isPublish && this->chunkHandler &&
+        this->readHeaderLength + this->readLength > this->bufferSize) {
+        this->chunking = CHUNK_HEADER;
+    }
+    while (this->readBodyReceived < this->readLength) {
+        uint32_t remaining = this->readLength - this->readBodyReceived;
+        if (this->chunking == CHUNK_PAYLOAD) {
+            // Straight through the buffer space past the variable header
+            size_t room = this->bufferSize - this->chunkAt;
+            int rc = readAvailable(this->buffer + this->chunkAt, remaining < room ? remaining : room);
+            if (rc == 0) {
+                return 0;
+            }
+            this->readBodyReceived += rc;
+            this->lastInActivity = this->readProgressAt;
+            this->chunkHandler->chunk(this->buffer + this->chunkAt, rc);
+            continue;
+        }
+        uint8_t discard[64];
+        uint8_t* dst = discard;
+        size_t room = sizeof(discard);
+        if (this->readPos < this->bufferSize) {
+            dst = this->buffer + this->readPos;
+            room = this->bufferSize - this->readPos;
+        }
+        int rc = readAvailable(dst, remaining < room ? remaining : room);
+        if (rc == 0) {
+            return 0;
+        }
+        // The topic length must be in the buffer before payload bytes are streamed
+        if (this->stream && isPublish && this->chunking == CHUNK_NONE && this->readBodyReceived + rc > 2) {
+            streamPayload(dst, this->readBodyReceived, rc);
+        }
+        if (dst == discard) {
+            this->readOverflow = true;
+        } else {
+            this->readPos += rc;
+        }
+        this->readBodyReceived += rc;
+        if (this->chunking == CHUNK_HEADER) {
+            startChunked();
+        }
+    }
+
+    *lengthLength = this->readHeaderLength - 1;
+    if (this->chunking == CHUNK_PAYLOAD) {
+        uint16_t msgId = this->chunkMsgId;
+        this->chunking = CHUNK_NONE;
+        resetReader();
+        this->stats.packetsIn++;
+        this->stats.chunkedMessages++;
+        this->chunkHandler->end(true);
+        if (msgId) {
+            uint8_t ack[4] = {MQTTPUBACK, 2, (uint8_t)(msgId >> 8), (uint8_t)(msgId & 0xFF)};
+            sendPacket(ack,4);
+            lastOutActivity = millis();
+        }
+        // Nothing left for loop() to handle
+        return 0;
+    }
+    uint32_t len = this->readPos;
+    bool dropped = this->readOverflow && (!this->stream || this->chunking == CHUNK_OFF);
+    resetReader();
+    this->stats.packetsIn++;
+    if (dropped) {
+        // This will cause the packet to be ignored.
+        this->stats.packetsDropped++;
+        return 0;
+    }
+    return len;
+}
+
+boolean PubSubClient::loop() {
+    if (_state == MQTT_CONNECTING) {
+        return poll() == MQTT_CONNECTED;
+    }
+    if (connected()) {
+        unsigned long t = millis();
+        if ((t - lastInActivity > this->keepAlive*1000UL) || (t - lastOutActivity > this->keepAlive*1000UL)) {
+            if (pingOutstanding) {
+                this->_state = MQTT_CONNECTION_TIMEOUT;
+                _client->stop();
+                return false;
+            } else {
+                this->buffer[0] = MQTTPINGREQ;
+                this->buffer[1] = 0;
+                sendPacket(this->buffer,2);
+                lastOutActivity = t;
+                lastInActivity = t;
+                pingOutstanding = true;
+            }
+        }
+        if (this->readPos > 0 && t - this->readProgressAt >= this->socketTimeout*1000UL) {
+            // The rest of a partly received packet never came
+            this->_state = MQTT_CONNECTION_TIMEOUT;
+            _client->stop();
+            resetReader();
+            return false;
+        }
+        for (uint8_t packets = 0; packets < MQTT_MAX_PACKETS_PER_LOOP; packets++) {
+            uint8_t llen;
+            uint32_t len = readPacket(&llen);
+            uint16_t msgId = 0;
+            uint8_t *payload;
+            if (len == 0) {
+                if (!connected()) {
+                    // readPacket has closed the connection
+                    return false;
+                }
+                break;
+            }
+            lastInActivity = t;
+            uint8_t type = this->buffer[0]&0xF0;
+            if (type == MQTTPUBLISH) {
+                if (callback) {
+                    uint16_t tl = (this->buffer[llen+1]<<8)+this->buffer[llen+2]; /* topic length in bytes */
+                    memmove(this->buffer+llen+2,this->buffer+llen+3,tl); /* move topic inside buffer 1 byte to front */
+                    this->buffer[llen+2+tl] = 0; /* end the topic as a 'C' string with \x00 */
+                    char *topic = (char*) this->buffer+llen+2;
+                    uint32_t pos = llen+3+tl;
+                    boolean qos1 = (this->buffer[0]&0x06) == MQTTQOS1;
+                    // msgId only present for QOS>0
+                    if (qos1) {
+                        msgId = (this->buffer[pos]<<8)+this->buffer[pos+1];
+                        pos += 2;
+                    }
+                    if (this->protocol == MQTT_VERSION_5) {
+                        uint32_t propertiesLength;
+                        uint8_t n = readVarInt(this->buffer, pos, len, &propertiesLength);
+                        if (n == 0 || pos + n + propertiesLength > len ||
+                            !readPublishProperties(this->buffer+pos+n, propertiesLength)) {
+                            // Malformed properties: the message is ignored
+                            continue;
+                        }
+                        pos += n + propertiesLength;
+                    }
+                    payload = this->buffer+pos;
+                    callback(topic,payload,len-pos);
+
+                    if (qos1) {
+                        this->buffer[0] = MQTTPUBACK;
+                        this->buffer[1] = 2;
+                        this->buffer[2] = (msgId >> 8);
+                        this->buffer[3] = (msgId & 0xFF);
+                        sendPacket(this->buffer,4);
+                        lastOutActivity = t;
+                    }
+                }
+            } else if (type == MQTTPINGREQ) {
+                this->buffer[0] = MQTTPINGRESP;
+                this->buffer[1] = 0;
+                sendPacket(this->buffer,2);
+            } else if (type == MQTTPINGRESP) {
+                pingOutstanding = false;
+            } else if (type == MQTTPUBACK) {
+                if (len >= (uint32_t)llen + 3) {
+                    // An MQTT 5 reason code after the id is not needed: either way the publish is done
+                    ackInflight((this->buffer[llen+1]<<8)+this->buffer[llen+2]);
+                }
+            } else if (type == MQTTDISCONNECT) {
+                // MQTT 5 brokers say why they close the connection
+                this->_state = MQTT_CONNECTION_LOST;
+                _client->stop();
+                return false;
+            }
+            if (!connected()) {
+                // The callback dropped the connection
+                return false;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+boolean PubSubClient::publish(const char* topic, const char* payload) {
+    return publish(topic,(const uint8_t*)payload, payload ? strlen(payload) : 0,false);
+}
+
+boolean PubSubClient::publish(const char* topic, const char* payload, boolean retained) {
+    return publish(topic,(const uint8_t*)payload, payload ? strlen(payload) : 0,retained);
+}
+
+boolean PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int plength) {
+    return publish(topic, payload, plength, false);
+}
+
+boolean PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int plength, boolean retained) {
+    return publish(topic, payload, plength, retained, 0);
+}
+
+boolean PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int plength, boolean retained, uint8_t qos) {
+    MqttSegment segment = {payload, plength};
+    return publishv(topic, &segment, 1, retained, qos, NULL);
+}
+
+boolean PubSubClient::publishv(const char* topic, const MqttSegment* segments, uint8_t count, boolean retained, uint8_t qos, const MqttPublishProperties* properties) {
+    uint32_t plength = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        plength += segments[i].length;
+    }
+    if (qos == 0 && plength <= MQTT_SMALL_PUBLISH_SIZE) {
+        return publishSmall(topic, segments, count, plength, retained, properties);
+    }
+    if (!beginPublish(topic, plength, retained, qos, properties)) {
+        return false;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        write(segments[i].data, segments[i].length);
+    }
+    return endPublish();
+}
+
+// A small QoS 0 publish, header and payload copied straight into the write
+// buffer after whatever is corked there and written in one go. The general
+// path costs a few hundred cycles per publish more in per-write overhead,
+// which only pays off once the payload is large enough to be written from
+// where it lies
+boolean PubSubClient::publishSmall(const char* topic, const MqttSegment* segments, uint8_t count, uint32_t plength, boolean retained, const MqttPublishProperties* properties) {
+    if (!connected()) {
+        return false;
+    }
+    uint8_t scratch[MQTT_PUBLISH_HEADER_SCRATCH];
+    MqttSegment header[MQTT_PUBLISH_HEADER_SEGMENTS];
+    uint16_t alias;
+    uint8_t headerCount = buildPublishHeader(retained ? MQTTPUBLISH | 1 : MQTTPUBLISH,topic,plength,0,properties,&alias,scratch,header);
+    if (headerCount == 0) {
+        return false;
+    }
+    size_t length = plength;
+    for (uint8_t i = 0; i < headerCount; i++) {
+        length += header[i].length;
+    }
+    this->recording = false;
+    startPacket();
+    if (length > (size_t)(MQTT_WRITE_BUFFER_SIZE - this->writePos)) {
+        // Does not fit after the corked packets: let write() split it
+        for (uint8_t i = 0; i < headerCount; i++) {
+            write(header[i].data,header[i].length);
+        }
+        for (uint8_t i = 0; i < count; i++) {
+            write(segments[i].data,segments[i].length);
+        }
+    } else {
+        uint8_t* pos = this->writeBuffer + this->writePos;
+        for (uint8_t i = 0; i < headerCount; i++) {
+            memcpy(pos,header[i].data,header[i].length);
+            pos += header[i].length;
+        }
+        for (uint8_t i = 0; i < count; i++) {
+            memcpy(pos,segments[i].data,segments[i].length);
+            pos += segments[i].length;
+        }
+        this->writePos += length;
+        this->stats.bytesGathered += length;
+    }
+    sentAlias(alias);
+    return finishPacket();
+}
+
+boolean PubSubClient::publish_P(const char* topic, const char* payload, boolean retained) {
+    return publish_P(topic, (const uint8_t*)payload, payload ? strnlen(payload, this->bufferSize) : 0, retained);
+}
+
+boolean PubSubClient::publish_P(const char* topic, const uint8_t* payload, unsigned int plength, boolean retained) {
+    uint8_t llen = 0;
+    uint8_t digit;
+    unsigned int rc = 0;
+    uint16_t tlen;
+    unsigned int pos = 0;
+    unsigned int i;
+    uint8_t header;
+    unsigned int len;
+    int expectedLength;
+
+    if (!connected()) {
+        return false;
+    }
+
+    tlen = strnlen(topic, this->bufferSize);
+
+    header = MQTTPUBLISH;
+    if (retained) {
+        header |= 1;
+    }
+    this->buffer[pos++] = header;
+    // MQTT 5: no properties (and no topic alias)
+    uint8_t plen = this->protocol == MQTT_VERSION_5 ? 1 : 0;
+    len = plength + 2 + tlen + plen;
+    do {
+        digit = len  & 127; //digit = len %128
+        len >>= 7; //len = len / 128
+        if (len > 0) {
+            digit |= 0x80;
+        }
+        this->buffer[pos++] = digit;
+        llen++;
+    } while(len>0);
+
+    pos = writeString(topic,this->buffer,pos);
+    if (plen) {
+        this->buffer[pos++] = 0;
+    }
+
+    // Collected like a beginPublish() payload rather than one write per byte
+    startPacket();
+    rc += write(this->buffer,pos);
+
+    for (i=0;i<plength;i++) {
+        rc += write((uint8_t)pgm_read_byte_near(payload + i));
+    }
+    if (!finishPacket()) {
+        rc = 0;
+    }
+
+    lastOutActivity = millis();
+
+    expectedLength = 1 + llen + 2 + tlen + plen + plength;
+
+    return (rc == (unsigned int)expectedLength);
+}
+
+boolean PubSubClient::beginPublish(const char* topic, unsigned int plength, boolean retained) {
+    return beginPublish(topic, plength, retained, 0);
+}
+
+boolean PubSubClient::beginPublish(const char* topic, unsigned int plength, boolean retained, uint8_t qos) {
+    return beginPublish(topic, plength, retained, qos, NULL);
+}
+
+boolean PubSubClient::beginPublish(const char* topic, unsigned int plength, boolean retained, uint8_t qos, const MqttPublishProperties* properties) {
+    if (connected()) {
+        uint8_t header = MQTTPUBLISH;
+        if (retained) {
+            header |= 1;
+        }
+        uint16_t msgId = 0;
+        if (qos > 0) {
+            uint16_t window = this->inflightWindow < this->serverReceiveMaximum ? this->inflightWindow : this->serverReceiveMaximum;
+            if (this->inflightUnacked >= window || this->inflightUsed >= MQTT_MAX_INFLIGHT) {
+                return false;
+            }
+            header |= MQTTQOS1;
+            msgId = nextPacketId();
+        }
+        // The header goes out in pieces from where they lie, not via the buffer
+        uint8_t scratch[MQTT_PUBLISH_HEADER_SCRATCH];
+        MqttSegment segments[MQTT_PUBLISH_HEADER_SEGMENTS];
+        uint16_t alias;
+        uint8_t count = buildPublishHeader(header,topic,plength,msgId,properties,&alias,scratch,segments);
+        if (count == 0) {
+            return false;
+        }
+        size_t headerLength = 0;
+        for (uint8_t i = 0; i < count; i++) {
+            headerLength += segments[i].length;
+        }
+        this->recording = false;
+        if (qos > 0) {
+            if (headerLength+plength > MQTT_INFLIGHT_STORE_SIZE) {
+                return false;
+            }
+            int32_t offset = allocateInflight(headerLength+plength);
+            if (offset < 0) {
+                return false;
+            }
+            InflightEntry& entry = this->inflightEntries[(this->inflightHead+this->inflightUsed)%MQTT_MAX_INFLIGHT];
+            entry.msgId = msgId;
+            entry.offset = offset;
+            entry.length = headerLength+plength;
+            entry.acked = false;
+            this->recording = true;
+            this->recorded = 0;
+        }
+        startPacket();
+        size_t rc = 0;
+        for (uint8_t i = 0; i < count; i++) {
+            rc += write(segments[i].data,segments[i].length);
+        }
+        sentAlias(alias);
+        return (rc == headerLength);
+    }
+    return false;
+}
+
+int PubSubClient::endPublish() {
+    boolean result = finishPacket();
+    if (this->recording) {
+        this->recording = false;
+        InflightEntry& entry = this->inflightEntries[(this->inflightHead+this->inflightUsed)%MQTT_MAX_INFLIGHT];
+        // Kept until the PUBACK even if the write failed: it is resent after reconnecting
+        result = (this->recorded == entry.length);
+        if (result) {
+            this->inflightStoreHead = entry.offset + entry.length;
+            this->inflightUsed++;
+            this->inflightUnacked++;
+            this->stats.qos1Published++;
+        }
+    }
+    return result ? 1 : 0;
+}
+
+size_t PubSubClient::write(uint8_t data) {
+    if (this->publishing && !this->recording && this->writePos < MQTT_WRITE_BUFFER_SIZE - 1) {
+        // The serializer's per-character path
+        this->writeBuffer[this->writePos++] = data;
+        this->stats.bytesGathered++;
+        return 1;
+    }
+    return write(&data, 1);
+}
+
+// Between beginPublish() and endPublish() the bytes are collected in
+// writeBuffer and go out a full buffer at a time; whole buffers' worth of
+// the caller's data are written from where they lie, so only the pieces
+// before and after them are copied. A QoS 1 packet is copied to the
+// in-flight store as it comes, whether or not the connection takes it
+size_t PubSubClient::write(const uint8_t *buffer, size_t size) {
+    if (!this->publishing) {
+        size_t rc = clientWrite(buffer,size);
+        lastOutActivity = millis();
+        return rc;
+    }
+    if (this->recording) {
+        recordInflight(buffer,size);
+    }
+    size_t written = 0;
+    while (written < size) {
+        if (this->writeFailed) {
+            return this->recording ? size : written;
+        }
+        if (this->writePos == 0 && size - written >= MQTT_WRITE_BUFFER_SIZE) {
+            // Whole chunks need no copy
+            size_t chunk = size - written - (size - written) % MQTT_WRITE_BUFFER_SIZE;
+            sendChunk(buffer+written,chunk);
+            written += chunk;
+            continue;
+        }
+        size_t chunk = MQTT_WRITE_BUFFER_SIZE - this->writePos;
+        if (chunk > size - written) {
+            chunk = size - written;
+        }
+        memcpy(this->writeBuffer+this->writePos,buffer+written,chunk);
+        this->stats.bytesGathered += chunk;
+        this->writePos += chunk;
+        written += chunk;
+        if (this->writePos == MQTT_WRITE_BUFFER_SIZE) {
+            flushWrite();
+        }
+    }
+    return written;
+}
+
+boolean PubSubClient::flushWrite() {
+    if (this->writePos > 0) {
+        size_t length = this->writePos;
+        this->writePos = 0;
+        sendChunk(this->writeBuffer,length);
+    }
+    return !this->writeFailed;
+}
+
+void PubSubClient::sendChunk(const uint8_t* buf, size_t size) {
+    if (this->writeFailed) {
+        return;
+    }
+    if (clientWrite(buf,size) != size) {
+        this->writeFailed = true;
+        return;
+    }
+    lastOutActivity = millis();
+}
+
+PubSubClient& PubSubClient::setInflightWindow(uint8_t window) {
+    if (window < 1) {
+        window = 1;
+    } else if (window > MQTT_MAX_INFLIGHT) {
+        window = MQTT_MAX_INFLIGHT;
+    }
+    this->inflightWindow = window;
+    return *this;
+}
+
+// Packet identifier not used by a publish awaiting its PUBACK
+uint16_t PubSubClient::nextPacketId() {
+    for (;;) {
+        nextMsgId++;
+        if (nextMsgId == 0) {
+            nextMsgId = 1;
+        }
+        boolean used = false;
+        for (uint8_t i = 0; i < this->inflightUsed && !used; i++) {
+            const InflightEntry& entry = this->inflightEntries[(this->inflightHead+i)%MQTT_MAX_INFLIGHT];
+            used = !entry.acked && entry.msgId == nextMsgId;
+        }
+        if (!used) {
+            return nextMsgId;
+        }
+    }
+}
+
+// Collect a packet in writeBuffer. Corked, it goes in after the packets
+// before it, and the buffer is only written once it is full
+void PubSubClient::startPacket() {
+    if (!this->corked) {
+        this->writePos = 0;
+    }
+    this->writeFailed = false;
+    this->publishing = true;
+}
+
+boolean PubSubClient::finishPacket() {
+    boolean result = this->corked ? !this->writeFailed : flushWrite();
+    this->publishing = false;
+    lastOutActivity = millis();
+    return result;
+}
+
+// A packet built elsewhere, written at once or joined to the corked ones
+boolean PubSubClient::sendPacket(const uint8_t* buf, size_t size) {
+    if (!this->corked) {
+        return clientWrite(buf,size) == size;
+    }
+    startPacket();
+    write(buf,size);
+    return finishPacket();
+}
+
+void PubSubClient::cork() {
+    this->corked = true;
+}
+
+boolean PubSubClient::uncork() {
+    this->corked = false;
+    if (this->publishing) {
+        // endPublish() sends the rest
+        return !this->writeFailed;
+    }
+    if (_state != MQTT_CONNECTED && _state != MQTT_CONNECTING) {
+        // The connection they were packed for is gone, and the network
+        // client may already be connected again for the next session
+        boolean dropped = this->writePos > 0;
+        this->writePos = 0;
+        this->writeFailed = false;
+        return !dropped;
+    }
+    boolean result = flushWrite();
+    this->writeFailed = false;
+    return result;
+}
+
+// Offset for a packet of `length` bytes after the newest one, wrapping to
+// the start of the store when the end is too short; -1 when it is full
+int32_t PubSubClient::allocateInflight(uint16_t length) {
+    if (this->inflightUsed == 0) {
+        this->inflightStoreHead = 0;
+        return length <= MQTT_INFLIGHT_STORE_SIZE ? 0 : -1;
+    }
+    uint16_t tail = this->inflightEntries[this->inflightHead].offset;
+    if (this->inflightStoreHead >= tail) {
+        if ((uint32_t)this->inflightStoreHead + length <= MQTT_INFLIGHT_STORE_SIZE) {
+            return this->inflightStoreHead;
+        }
+        return length < tail ? 0 : -1;
+    }
+    return (uint32_t)this->inflightStoreHead + length < tail ? this->inflightStoreHead : -1;
+}
+
+void PubSubClient::recordInflight(const uint8_t* buf, size_t size) {
+    const InflightEntry& entry = this->inflightEntries[(this->inflightHead+this->inflightUsed)%MQTT_MAX_INFLIGHT];
+    if ((size_t)this->recorded + size > entry.length) {
+        // More than beginPublish() announced; endPublish() will refuse it
+        this->recorded = entry.length + 1;
+        return;
+    }
+    memcpy(this->inflightStore+entry.offset+this->recorded,buf,size);
+    this->recorded += size;
+}
+
+// Release the publish with this identifier, and with it every entry at
+// the front of the ring that has been acknowledged
+void PubSubClient::ackInflight(uint16_t msgId) {
+    for (uint8_t i = 0; i < this->inflightUsed; i++) {
+        InflightEntry& entry = this->inflightEntries[(this->inflightHead+i)%MQTT_MAX_INFLIGHT];
+        if (!entry.acked && entry.msgId == msgId) {
+            entry.acked = true;
+            this->inflightUnacked--;
+            this->stats.pubacks++;
+            break;
+        }
+    }
+    releaseAcked();
+}
+
+// Free the acknowledged entries at the front of the ring
+void PubSubClient::releaseAcked() {
+    while (this->inflightUsed > 0 && this->inflightEntries[this->inflightHead].acked) {
+        this->inflightHead = (this->inflightHead + 1) % MQTT_MAX_INFLIGHT;
+        this->inflightUsed--;
+    }
+}
+
+// After a CONNACK: send every unacknowledged publish again, in order, with
+// DUP set. Under a clean session the broker takes them as new publishes.
+void PubSubClient::resendInflight() {
+    for (uint8_t i = 0; i < this->inflightUsed; i++) {
+        InflightEntry& entry = this->inflightEntries[(this->inflightHead+i)%MQTT_MAX_INFLIGHT];
+        if (entry.acked) {
+            continue;
+        }
+        this->inflightStore[entry.offset] |= 0x08;
+        if (this->protocol == MQTT_VERSION_5) {
+            if (!resendAliased(this->inflightStore+entry.offset,entry.length)) {
+                return;
+            }
+        } else if (!sendPacket(this->inflightStore+entry.offset,entry.length)) {
+            return;
+        }
+        this->stats.retransmits++;
+        lastOutActivity = millis();
+    }
+}
+
+// MQTT 5 resend of a stored publish. Its topic alias belonged to the old
+// connection, so a publish that named the topic by alias only is sent with
+// the topic in full. The alias property (always the last one, see
+// buildPublishHeader()) is kept when the new connection allows the alias,
+// which tells the broker about it again, and dropped otherwise.
+boolean PubSubClient::resendAliased(const uint8_t* packet, uint16_t length) {
+    uint32_t remaining;
+    uint8_t n = readVarInt(packet, 1, length, &remaining);
+    uint16_t topicAt = 1 + n;
+    uint16_t topicLength = (packet[topicAt]<<8) | packet[topicAt+1];
+    uint16_t idAt = topicAt + 2 + topicLength;
+    uint32_t propertiesLength;
+    n = readVarInt(packet, idAt+2, length, &propertiesLength);
+    uint16_t propertiesAt = idAt + 2 + n;
+    uint16_t payloadAt = propertiesAt + propertiesLength;
+    uint16_t alias = 0;
+    for (uint32_t pos = propertiesAt; pos < payloadAt;) {
+        uint32_t size = propertyLength(packet, pos, payloadAt);
+        if (size == 0) {
+            break;
+        }
+        if (packet[pos] == MQTT_PROP_TOPIC_ALIAS && pos + size == payloadAt) {
+            alias = (packet[pos+1]<<8) | packet[pos+2];
+        }
+        pos += size;
+    }
+    boolean keep = alias != 0 && alias <= this->topicAliasMaximum;
+    if (alias == 0 || (topicLength > 0 && keep)) {
+        if (keep) {
+            this->aliasesSent |= 1UL << (alias-1);
+        }
+        return sendPacket(packet,length);
+    }
+
+    const uint8_t* topic = packet + topicAt + 2;
+    if (topicLength == 0) {
+        topic = (const uint8_t*)this->aliasTopics[alias-1];
+        topicLength = strlen(this->aliasTopics[alias-1]);
+    }
+    uint32_t newProperties = propertiesLength - (keep ? 0 : 3);
+    uint16_t payloadLength = length - payloadAt;
+    uint8_t header[MQTT_MAX_HEADER_SIZE];
+    header[0] = packet[0];
+    uint8_t headerLength = 1 + writeVarInt(header+1, 2 + topicLength + 2 + varIntSize(newProperties) + newProperties + payloadLength);
+    uint8_t topicHeader[2] = {(uint8_t)(topicLength >> 8), (uint8_t)(topicLength & 0xFF)};
+    uint8_t propertiesHeader[4];
+    uint8_t propertiesHeaderLength = writeVarInt(propertiesHeader, newProperties);
+
+    // Collected like a beginPublish() packet
+    startPacket();
+    write(header,headerLength);
+    write(topicHeader,2);
+    write(topic,topicLength);
+    write(packet+idAt,2);
+    write(propertiesHeader,propertiesHeaderLength);
+    write(packet+propertiesAt,newProperties);
+    write(packet+payloadAt,payloadLength);
+    boolean result = finishPacket();
+    if (keep) {
+        this->aliasesSent |= 1UL << (alias-1);
+    }
+    return result;
+}
+
+PubSubClient& PubSubClient::setProtocolVersion(uint8_t version) {
+    if (version != this->protocol) {
+        convertInflight(version);
+        this->aliasCount = 0;
+        this->aliasesSent = 0;
+    }
+    this->protocol = version;
+    return *this;
+}
+
+// The stored publishes are in the old version's form. Falling back from
+// MQTT 5, each is rewritten without its properties where that fits in its
+// place in the store; the others, and all of them on a move to MQTT 5, are
+// dropped as if acknowledged. 3.1 and 3.1.1 publishes are the same.
+void PubSubClient::convertInflight(uint8_t version) {
+    if ((this->protocol == MQTT_VERSION_5) == (version == MQTT_VERSION_5)) {
+        return;
+    }
+    for (uint8_t i = 0; i < this->inflightUsed; i++) {
+        InflightEntry& entry = this->inflightEntries[(this->inflightHead+i)%MQTT_MAX_INFLIGHT];
+        if (entry.acked || (version != MQTT_VERSION_5 && stripProperties(entry))) {
+            continue;
+        }
+        entry.acked = true;
+        this->inflightUnacked--;
+        this->stats.inflightDropped++;
+    }
+    releaseAcked();
+}
+
+// A stored MQTT 5 publish rewritten in place in 3.1.1 form. One that named
+// its topic by alias only gets the topic in full, which must fit where the
+// properties were; false when it does not.
+boolean PubSubClient::stripProperties(InflightEntry& entry) {
+    uint8_t* packet = this->inflightStore + entry.offset;
+    uint32_t remaining;
+    uint8_t n = readVarInt(packet, 1, entry.length, &remaining);
+    uint16_t topicAt = 1 + n;
+    uint16_t topicLength = (packet[topicAt]<<8) | packet[topicAt+1];
+    uint16_t idAt = topicAt + 2 + topicLength;
+    uint32_t propertiesLength;
+    n = readVarInt(packet, idAt+2, entry.length, &propertiesLength);
+    uint16_t payloadAt = idAt + 2 + n + propertiesLength;
+    uint16_t payloadLength = entry.length - payloadAt;
+    const char* alias = NULL;
+    if (topicLength == 0) {
+        // The alias is always the last property, see buildPublishHeader()
+        uint16_t id = propertiesLength >= 3 ? (packet[payloadAt-2]<<8) | packet[payloadAt-1] : 0;
+        if (id == 0 || id > this->aliasCount || packet[payloadAt-3] != MQTT_PROP_TOPIC_ALIAS) {
+            return false;
+        }
+        alias = this->aliasTopics[id-1];
+        topicLength = strlen(alias);
+    }
+    uint32_t newRemaining = 2 + topicLength + 2 + payloadLength;
+    uint8_t headerLength = 1 + varIntSize(newRemaining);
+    if (headerLength + newRemaining > entry.length) {
+        return false;
+    }
+
+    // Every part moves towards the start, and the payload is not reached
+    // before it has been moved
+    uint8_t packetId[2] = {packet[idAt], packet[idAt+1]};
+    writeVarInt(packet+1, newRemaining);
+    uint16_t pos = headerLength;
+    if (alias) {
+        packet[pos++] = (uint8_t)(topicLength >> 8);
+        packet[pos++] = (uint8_t)(topicLength & 0xFF);
+        memcpy(packet+pos, alias, topicLength);
+        pos += topicLength;
+    } else {
+        memmove(packet+pos, packet+topicAt, 2 + topicLength);
+        pos += 2 + topicLength;
+    }
+    packet[pos++] = packetId[0];
+    packet[pos++] = packetId[1];
+    memmove(packet+pos, packet+payloadAt, payloadLength);
+    entry.length = pos + payloadLength;
+    return true;
+}
+
+// MQTT 5 alias for `topic`, assigning the next free one if the table and
+// the broker's Topic Alias Maximum allow; 0 when it is sent in full
+uint16_t PubSubClient::topicAlias(const char* topic) {
+    uint16_t usable = this->topicAliasMaximum < MQTT_MAX_TOPIC_ALIASES ? this->topicAliasMaximum : MQTT_MAX_TOPIC_ALIASES;
+    for (uint8_t i = 0; i < this->aliasCount; i++) {
+        if (strcmp(this->aliasTopics[i], topic) == 0) {
+            return i < usable ? i + 1 : 0;
+        }
+    }
+    size_t length = strnlen(topic, MQTT_TOPIC_ALIAS_LENGTH);
+    if (this->aliasCount >= usable || length == 0 || length >= MQTT_TOPIC_ALIAS_LENGTH) {
+        return 0;
+    }
+    memcpy(this->aliasTopics[this->aliasCount], topic, length + 1);
+    return ++this->aliasCount;
+}
+
+// A publish built by buildPublishHeader() with this alias is going out:
+// from now on the broker knows the alias
+void PubSubClient::sentAlias(uint16_t alias) {
+    if (alias == 0) {
+        return;
+    }
+    uint32_t bit = 1UL << (alias-1);
+    if (this->aliasesSent & bit) {
+        this->stats.aliasedPublishes++;
+    }
+    this->aliasesSent |= bit;
+}
+
+// The PUBLISH fixed header, topic, packet id and MQTT 5 properties as
+// segments: lengths and ids are built in scratch (MQTT_PUBLISH_HEADER_SCRATCH
+// bytes), the topic, Response Topic and Correlation Data are referenced where
+// they lie. Under MQTT 5 *alias is the topic alias used (0 for none); when
+// the broker already knows it the topic is left out, and the caller passes
+// it to sentAlias() once the packet goes out. Returns the number of
+// segments, 0 if the packet is too long
+uint8_t PubSubClient::buildPublishHeader(uint8_t header, const char* topic, uint32_t plength, uint16_t msgId, const MqttPublishProperties* properties, uint16_t* alias, uint8_t* scratch, MqttSegment* segments) {
+    size_t topicLength = strnlen(topic, 0xFFFF);
+    uint32_t propertiesLength = 0;
+    *alias = 0;
+    if (this->protocol == MQTT_VERSION_5) {
+        *alias = topicAlias(topic);
+        if (*alias != 0) {
+            propertiesLength += 3;
+            if (this->aliasesSent & (1UL << (*alias-1))) {
+                topicLength = 0;
+            }
+        }
+        if (properties != NULL) {
+            if (properties->messageExpiry) {
+                propertiesLength += 5;
+            }
+            if (properties->responseTopic) {
+                propertiesLength += 3 + properties->responseTopicLength;
+            }
+            if (properties->correlationData) {
+                propertiesLength += 3 + properties->correlationDataLength;
+            }
+        }
+    }
+    uint32_t remaining = 2 + topicLength + (msgId ? 2 : 0) + plength;
+    if (this->protocol == MQTT_VERSION_5) {
+        remaining += varIntSize(propertiesLength) + propertiesLength;
+    }
+    if (remaining > MQTT_MAX_REMAINING_LENGTH || remaining < plength) {
+        *alias = 0;
+        return 0;
+    }
+
+    uint8_t count = 0;
+    uint8_t* start = scratch;
+    uint8_t* p = scratch;
+    *p++ = header;
+    p += writeVarInt(p,remaining);
+    *p++ = (topicLength >> 8);
+    *p++ = (topicLength & 0xFF);
+    segments[count++] = {start, (size_t)(p-start)};
+    if (topicLength > 0) {
+        segments[count++] = {(const uint8_t*)topic, topicLength};
+    }
+    start = p;
+    if (msgId) {
+        *p++ = (msgId >> 8);
+        *p++ = (msgId & 0xFF);
+    }
+    if (this->protocol == MQTT_VERSION_5) {
+        p += writeVarInt(p,propertiesLength);
+        if (properties != NULL && properties->messageExpiry) {
+            *p++ = MQTT_PROP_MESSAGE_EXPIRY;
+            *p++ = (properties->messageExpiry >> 24);
+            *p++ = (properties->messageExpiry >> 16) & 0xFF;
+            *p++ = (properties->messageExpiry >> 8) & 0xFF;
+            *p++ = (properties->messageExpiry & 0xFF);
+        }
+        if (properties != NULL && properties->responseTopic) {
+            *p++ = MQTT_PROP_RESPONSE_TOPIC;
+            *p++ = (properties->responseTopicLength >> 8);
+            *p++ = (properties->responseTopicLength & 0xFF);
+            segments[count++] = {start, (size_t)(p-start)};
+            segments[count++] = {(const uint8_t*)properties->responseTopic, properties->responseTopicLength};
+            start = p;
+        }
+        if (properties != NULL && properties->correlationData) {
+            *p++ = MQTT_PROP_CORRELATION_DATA;
+            *p++ = (properties->correlationDataLength >> 8);
+            *p++ = (properties->correlationDataLength & 0xFF);
+            segments[count++] = {start, (size_t)(p-start)};
+            segments[count++] = {properties->correlationData, properties->correlationDataLength};
+            start = p;
+        }
+        if (*alias != 0) {
+            // Last, so resendAliased() can drop it
+            *p++ = MQTT_PROP_TOPIC_ALIAS;
+            *p++ = (*alias >> 8);
+            *p++ = (*alias & 0xFF);
+        }
+    }
+    if (p > start) {
+        segments[count++] = {start, (size_t)(p-start)};
+    }
+    return count;
+}
+
+// CONNACK properties after the reason code: the broker's Receive Maximum
+// and Topic Alias Maximum. False if they are malformed
+boolean PubSubClient::readConnackProperties(const uint8_t* buf, uint32_t length) {
+    uint32_t propertiesLength;
+    uint8_t n = readVarInt(buf, 0, length, &propertiesLength);
+    if (n == 0 || n + propertiesLength > length) {
+        return false;
+    }
+    uint32_t end = n + propertiesLength;
+    for (uint32_t pos = n; pos < end;) {
+        uint32_t size = propertyLength(buf, pos, end);
+        if (size == 0) {
+            return false;
+        }
+        if (buf[pos] == MQTT_PROP_RECEIVE_MAXIMUM) {
+            this->serverReceiveMaximum = (buf[pos+1]<<8) | buf[pos+2];
+        } else if (buf[pos] == MQTT_PROP_TOPIC_ALIAS_MAXIMUM) {
+            this->topicAliasMaximum = (buf[pos+1]<<8) | buf[pos+2];
+        }
+        pos += size;
+    }
+    return this->serverReceiveMaximum != 0;
+}
+
+// Properties of a received PUBLISH: Message Expiry, Response Topic and
+// Correlation Data go to publishProperties(), the rest is skipped. False
+// if they are malformed
+boolean PubSubClient::readPublishProperties(const uint8_t* buf, uint32_t length) {
+    memset(&this->received, 0, sizeof(this->received));
+    for (uint32_t pos = 0; pos < length;) {
+        uint32_t size = propertyLength(buf, pos, length);
+        if (size == 0) {
+            return false;
+        }
+        if (buf[pos] == MQTT_PROP_MESSAGE_EXPIRY) {
+            this->received.messageExpiry = ((uint32_t)buf[pos+1]<<24) | ((uint32_t)buf[pos+2]<<16) | (buf[pos+3]<<8) | buf[pos+4];
+        } else if (buf[pos] == MQTT_PROP_RESPONSE_TOPIC) {
+            this->received.responseTopic = (const char*)buf+pos+3;
+            this->received.responseTopicLength = size - 3;
+        } else if (buf[pos] == MQTT_PROP_CORRELATION_DATA) {
+            this->received.correlationData = buf+pos+3;
+            this->received.correlationDataLength = size - 3;
+        }
+        pos += size;
+    }
+    return true;
+}
+
+// Every write to the network client goes through here to be counted
+size_t PubSubClient::clientWrite(const uint8_t* buf, size_t size) {
+    this->stats.writeCalls++;
+    size_t rc = _client->write(buf,size);
+    this->stats.bytesOut += rc;
+    return rc;
+}
+
+size_t PubSubClient::buildHeader(uint8_t header, uint8_t* buf, uint16_t length) {
+    uint8_t lenBuf[4];
+    uint8_t llen = 0;
+    uint8_t digit;
+    uint8_t pos = 0;
+    uint16_t len = length;
+    do {
+
+        digit = len  & 127; //digit = len %128
+        len >>= 7; //len = len / 128
+        if (len > 0) {
+            digit |= 0x80;
+        }
+        lenBuf[pos++] = digit;
+        llen++;
+    } while(len>0);
+
+    buf[4-llen] = header;
+    for (int i=0;i<llen;i++) {
+        buf[MQTT_MAX_HEADER_SIZE-llen+i] = lenBuf[i];
+    }
+    return llen+1; // Full header size is variable length bit plus the 1-byte fixed header
+}
+
+boolean PubSubClient::write(uint8_t header, uint8_t* buf, uint16_t length) {
+    uint16_t rc;
+    uint8_t hlen = buildHeader(header, buf, length);
+    if (this->corked && header != MQTTCONNECT) {
+        return sendPacket(buf+(MQTT_MAX_HEADER_SIZE-hlen),length+hlen);
+    }
+
+#ifdef MQTT_MAX_TRANSFER_SIZE
+    uint8_t* writeBuf = buf+(MQTT_MAX_HEADER_SIZE-hlen);
+    uint16_t bytesRemaining = length+hlen;  //Match the length type
+    uint8_t bytesToWrite;
+    boolean result = true;
+    while((bytesRemaining > 0) && result) {
+        bytesToWrite = (bytesRemaining > MQTT_MAX_TRANSFER_SIZE)?MQTT_MAX_TRANSFER_SIZE:bytesRemaining;
+        rc = clientWrite(writeBuf,bytesToWrite);
+        result = (rc == bytesToWrite);
+        bytesRemaining -= rc;
+        writeBuf += rc;
+    }
+    return result;
+#else
+    rc = clientWrite(buf+(MQTT_MAX_HEADER_SIZE-hlen),length+hlen);
+    lastOutActivity = millis();
+    return (rc == hlen+length);
+#endif
+}
+
+boolean PubSubClient::subscribe(const char* topic) {
+    return subscribe(topic, 0);
+}
+
+boolean PubSubClient::subscribe(const char* topic, uint8_t qos) {
+    size_t topicLength = strnlen(topic, this->bufferSize);
+    if (topic == 0) {
+        return false;
+    }
+    if (qos > 1) {
+        return false;
+    }
+    if (this->bufferSize < 10 + topicLength) {
+        // Too long
+        return false;
+    }
+    if (connected()) {
+        // Leave room in the buffer for header and variable length field
+        uint16_t length = MQTT_MAX_HEADER_SIZE;
+        uint16_t msgId = nextPacketId();
+        this->buffer[length++] = (msgId >> 8);
+        this->buffer[length++] = (msgId & 0xFF);
+        if (this->protocol == MQTT_VERSION_5) {
+            // No properties
+            this->buffer[length++] = 0;
+        }
+        length = writeString((char*)topic, this->buffer,length);
+        this->buffer[length++] = qos;
+        return write(MQTTSUBSCRIBE|MQTTQOS1,this->buffer,length-MQTT_MAX_HEADER_SIZE);
+    }
+    return false;
+}
+
+boolean PubSubClient::unsubscribe(const char* topic) {
+	size_t topicLength = strnlen(topic, this->bufferSize);
+    if (topic == 0) {
+        return false;
+    }
+    if (this->bufferSize < 10 + topicLength) {
+        // Too long
+        return false;
+    }
+    if (connected()) {
+        uint16_t length = MQTT_MAX_HEADER_SIZE;
+        uint16_t msgId = nextPacketId();
+        this->buffer[length++] = (msgId >> 8);
+        this->buffer[length++] = (msgId & 0xFF);
+        if (this->protocol == MQTT_VERSION_5) {
+            this->buffer[length++] = 0;
+        }
+        length = writeString(topic, this->buffer,length);
+        return write(MQTTUNSUBSCRIBE|MQTTQOS1,this->buffer,length-MQTT_MAX_HEADER_SIZE);
+    }
+    return false;
+}
+
+void PubSubClient::disconnect() {
+    if (!this->publishing) {
+        // What is corked goes before the DISCONNECT
+        flushWrite();
+    }
+    this->buffer[0] = MQTTDISCONNECT;
+    this->buffer[1] = 0;
+    clientWrite(this->buffer,2);
+    _state = MQTT_DISCONNECTED;
+    _client->flush();
+    _client->stop();
+    resetReader();
+    lastInActivity = lastOutActivity = millis();
+}
+
+uint16_t PubSubClient::writeString(const char* string, uint8_t* buf, uint16_t pos) {
+    const char* idp = string;
+    uint16_t i = 0;
+    pos += 2;
+    while (*idp) {
+        buf[pos++] = *idp++;
+        i++;
+    }
+    buf[pos-i-2] = (i >> 8);
+    buf[pos-i-1] = (i & 0xFF);
+    return pos;
+}
+
+
+boolean PubSubClient::connected() {
+    boolean rc;
+    if (_client == NULL ) {
+        rc = false;
+    } else {
+        rc = (int)_client->connected();
+        if (!rc) {
+            if (this->_state == MQTT_CONNECTED) {
+                this->_state = MQTT_CONNECTION_LOST;
+                _client->flush();
+                _client->stop();
+                resetReader();
+            }
+        } else {
+            return this->_state == MQTT_CONNECTED;
+        }
+    }
+    return rc;
+}
+
+PubSubClient& PubSubClient::setServer(uint8_t * ip, uint16_t port) {
+    IPAddress addr(ip[0],ip[1],ip[2],ip[3]);
+    return setServer(addr,port);
+}
+
+PubSubClient& PubSubClient::setServer(IPAddress ip, uint16_t port) {
+    this->ip = ip;
+    this->port = port;
+    this->domain = NULL;
+    return *this;
+}
+
+PubSubClient& PubSubClient::setServer(const char * domain, uint16_t port) {
+    this->domain = domain;
+    this->port = port;
+    return *this;
+}
+
+PubSubClient& PubSubClient::setCallback(MQTT_CALLBACK_SIGNATURE) {
+    this->callback = callback;
+    return *this;
+}
+
+PubSubClient& PubSubClient::setClient(Client& client){
+    this->_client = &client;
+    return *this;
+}
+
+PubSubClient& PubSubClient::setStream(Stream& stream){
+    this->stream = &stream;
+    return *this;
+}
+
+PubSubClient& PubSubClient::setChunkHandler(MqttChunkHandler* handler) {
+    this->chunkHandler = handler;
+    return *this;
+}
+
+int PubSubClient::state() {
+    return this->_state;
+}
+
+boolean PubSubClient::setBufferSize(uint16_t size) {
+    if (size == 0) {
+        // Cannot set it back to 0
+        return false;
+    }
+    if (this->bufferSize == 0) {
+        this->buffer = (uint8_t*)malloc(size);
+    } else {
+        uint8_t* newBuffer = (uint8_t*)realloc(this->buffer, size);
+        if (newBuffer != NULL) {
+            this->buffer = newBuffer;
+        } else {
+            return false;
+        }
+    }
+    this->bufferSize = size;
+    return (this->buffer != NULL);
+}
+
+uint16_t PubSubClient::getBufferSize() {
+    return this->bufferSize;
+}
+PubSubClient& PubSubClient::setKeepAlive(uint16_t keepAlive) {
+    this->keepAlive = keepAlive;
+    return *this;
+}
+PubSubClient& PubSubClient::setSocketTimeout(uint16_t timeout) {
+    this->socketTimeout = timeout;
+    return *this;
+}
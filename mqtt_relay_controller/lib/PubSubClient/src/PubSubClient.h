@@ -0,0 +1,442 @@
+/*
+ PubSubClient.h - A simple client for MQTT.
+  Nick O'Leary
+  http://knolleary.net
+*/
+
+#ifndef PubSubClient_h
+#define PubSubClient_h
+
+#include <Arduino.h>
+#include "IPAddress.h"
+#include "Client.h"
+#include "Stream.h"
+
+#define MQTT_VERSION_3_1      3
+#define MQTT_VERSION_3_1_1    4
+#define MQTT_VERSION_5        5
+
+// MQTT_VERSION : Pick the version. setProtocolVersion() changes it at run time
+//#define MQTT_VERSION MQTT_VERSION_3_1
+#ifndef MQTT_VERSION
+#define MQTT_VERSION MQTT_VERSION_3_1_1
+#endif
+
+// MQTT_MAX_PACKET_SIZE : Maximum packet size. Override with setBufferSize().
+#ifndef MQTT_MAX_PACKET_SIZE
+#define MQTT_MAX_PACKET_SIZE 256
+#endif
+
+// MQTT_KEEPALIVE : keepAlive interval in Seconds. Override with setKeepAlive()
+#ifndef MQTT_KEEPALIVE
+#define MQTT_KEEPALIVE 15
+#endif
+
+// MQTT_SOCKET_TIMEOUT: socket timeout interval in Seconds. Override with setSocketTimeout()
+#ifndef MQTT_SOCKET_TIMEOUT
+#define MQTT_SOCKET_TIMEOUT 15
+#endif
+
+// MQTT_MAX_PACKETS_PER_LOOP : most complete inbound packets handled by one
+//  call to loop(), so a burst of messages cannot hold the caller for long
+#ifndef MQTT_MAX_PACKETS_PER_LOOP
+#define MQTT_MAX_PACKETS_PER_LOOP 8
+#endif
+
+// MQTT_MAX_TRANSFER_SIZE : limit how much data is passed to the network client
+//  in each write call. Needed for the Arduino Wifi Shield. Leave undefined to
+//  pass the entire MQTT packet in each write call.
+//#define MQTT_MAX_TRANSFER_SIZE 80
+
+// MQTT_WRITE_BUFFER_SIZE : a packet started with beginPublish() is collected
+//  and passed to the network client in chunks of this many bytes, and the rest
+//  on endPublish() (on uncork() while corked). The default is one TCP segment
+//  (the ESP32 lwIP MSS).
+#ifndef MQTT_WRITE_BUFFER_SIZE
+#ifdef MQTT_MAX_TRANSFER_SIZE
+#define MQTT_WRITE_BUFFER_SIZE MQTT_MAX_TRANSFER_SIZE
+#else
+#define MQTT_WRITE_BUFFER_SIZE 1436
+#endif
+#endif
+
+// MQTT_MAX_INFLIGHT : most QoS 1 publishes awaiting their PUBACK at once.
+//  setInflightWindow() can lower the window at run time.
+#ifndef MQTT_MAX_INFLIGHT
+#define MQTT_MAX_INFLIGHT 8
+#endif
+
+// MQTT_INFLIGHT_STORE_SIZE : bytes kept for retransmitting the QoS 1
+//  publishes in flight. A packet that does not fit is refused.
+#ifndef MQTT_INFLIGHT_STORE_SIZE
+#define MQTT_INFLIGHT_STORE_SIZE 2048
+#endif
+
+// MQTT_MAX_TOPIC_ALIASES : MQTT 5 only. Outbound topics given a topic alias,
+//  first come first served and kept for the life of the client; the broker's
+//  Topic Alias Maximum may allow fewer. Topics of MQTT_TOPIC_ALIAS_LENGTH
+//  bytes or more are always sent in full.
+#ifndef MQTT_MAX_TOPIC_ALIASES
+#define MQTT_MAX_TOPIC_ALIASES 8
+#endif
+#ifndef MQTT_TOPIC_ALIAS_LENGTH
+#define MQTT_TOPIC_ALIAS_LENGTH 64
+#endif
+#if MQTT_MAX_TOPIC_ALIASES > 32
+#error "MQTT_MAX_TOPIC_ALIASES is at most 32"
+#endif
+
+// MQTT_RECEIVE_MAXIMUM : MQTT 5 only. QoS 1 messages the broker may send
+//  before their PUBACK; announced in CONNECT
+#ifndef MQTT_RECEIVE_MAXIMUM
+#define MQTT_RECEIVE_MAXIMUM 8
+#endif
+
+// Possible values for client.state()
+#define MQTT_CONNECTING             -5
+#define MQTT_CONNECTION_TIMEOUT     -4
+#define MQTT_CONNECTION_LOST        -3
+#define MQTT_CONNECT_FAILED         -2
+#define MQTT_DISCONNECTED           -1
+#define MQTT_CONNECTED               0
+#define MQTT_CONNECT_BAD_PROTOCOL    1
+#define MQTT_CONNECT_BAD_CLIENT_ID   2
+#define MQTT_CONNECT_UNAVAILABLE     3
+#define MQTT_CONNECT_BAD_CREDENTIALS 4
+#define MQTT_CONNECT_UNAUTHORIZED    5
+
+#define MQTTCONNECT     1 << 4  // Client request to connect to Server
+#define MQTTCONNACK     2 << 4  // Connect Acknowledgment
+#define MQTTPUBLISH     3 << 4  // Publish message
+#define MQTTPUBACK      4 << 4  // Publish Acknowledgment
+#define MQTTPUBREC      5 << 4  // Publish Received (assured delivery part 1)
+#define MQTTPUBREL      6 << 4  // Publish Release (assured delivery part 2)
+#define MQTTPUBCOMP     7 << 4  // Publish Complete (assured delivery part 3)
+#define MQTTSUBSCRIBE   8 << 4  // Client Subscribe request
+#define MQTTSUBACK      9 << 4  // Subscribe Acknowledgment
+#define MQTTUNSUBSCRIBE 10 << 4 // Client Unsubscribe request
+#define MQTTUNSUBACK    11 << 4 // Unsubscribe Acknowledgment
+#define MQTTPINGREQ     12 << 4 // PING Request
+#define MQTTPINGRESP    13 << 4 // PING Response
+#define MQTTDISCONNECT  14 << 4 // Client is Disconnecting
+#define MQTTReserved    15 << 4 // Reserved
+
+#define MQTTQOS0        (0 << 1)
+#define MQTTQOS1        (1 << 1)
+#define MQTTQOS2        (2 << 1)
+
+// MQTT 5 property identifiers used by the client
+#define MQTT_PROP_MESSAGE_EXPIRY      0x02
+#define MQTT_PROP_RESPONSE_TOPIC      0x08
+#define MQTT_PROP_CORRELATION_DATA    0x09
+#define MQTT_PROP_RECEIVE_MAXIMUM     0x21
+#define MQTT_PROP_TOPIC_ALIAS_MAXIMUM 0x22
+#define MQTT_PROP_TOPIC_ALIAS         0x23
+
+// Maximum size of fixed header and variable length size header
+#define MQTT_MAX_HEADER_SIZE 5
+#define MQTT_MAX_REMAINING_LENGTH 268435455
+
+// A PUBLISH header is sent as at most this many segments, built with this
+// much scratch (fixed header, topic length, packet id, property headers)
+#define MQTT_PUBLISH_HEADER_SEGMENTS 7
+#define MQTT_PUBLISH_HEADER_SCRATCH 32
+
+// MQTT_SMALL_PUBLISH_SIZE : a QoS 0 publishv() (and so publish()) of a
+// payload up to this size that fits in the write buffer is copied into it
+// in one pass instead of going through beginPublish()/write()/endPublish()
+#ifndef MQTT_SMALL_PUBLISH_SIZE
+#define MQTT_SMALL_PUBLISH_SIZE 512
+#endif
+
+#if defined(ESP8266) || defined(ESP32)
+#include <functional>
+#define MQTT_CALLBACK_SIGNATURE std::function<void(char*, uint8_t*, unsigned int)> callback
+#else
+#define MQTT_CALLBACK_SIGNATURE void (*callback)(char*, uint8_t*, unsigned int)
+#endif
+
+// Transfer counters, see getStats()
+struct PubSubClientStats {
+   uint32_t packetsIn;      // Complete packets read
+   uint32_t packetsDropped; // ...of which were larger than the buffer and discarded
+   uint32_t readCalls;      // Bulk reads from the network client
+   uint32_t bytesIn;
+   uint32_t writeCalls;     // Writes to the network client
+   uint32_t bytesOut;
+   uint32_t connectTcpUs;   // Last network connect (name lookup included for a domain)
+   uint32_t connectMqttUs;  // Last CONNECT sent -> CONNACK received
+   uint32_t qos1Published;  // QoS 1 publishes taken into the in-flight store
+   uint32_t pubacks;
+   uint32_t retransmits;    // Resent with DUP after a reconnect
+   uint32_t inflightDropped; // Unacknowledged, but not in a form the new protocol version can resend
+   uint32_t aliasedPublishes; // MQTT 5 publishes that named their topic by alias only
+   uint32_t chunkedMessages;  // Larger than the buffer, passed to the chunk handler
+   uint32_t bytesGathered;    // Outbound bytes copied into the write buffer
+};
+
+// One piece of a payload for publishv(), written from where it lies
+struct MqttSegment {
+   const uint8_t* data;
+   size_t length;
+};
+
+// MQTT 5 PUBLISH properties. Strings and data are not NUL-terminated; a
+// NULL pointer leaves the property out. For a received message,
+// publishProperties() points into the client buffer and is only valid in
+// the callback: copy what a reply needs before publishing it.
+struct MqttPublishProperties {
+   uint32_t messageExpiry;         // Seconds, 0 = does not expire
+   const char* responseTopic;
+   uint16_t responseTopicLength;
+   const uint8_t* correlationData;
+   uint16_t correlationDataLength;
+};
+
+// Takes the payload of a message too large for the buffer piece by piece as
+// it arrives, see setChunkHandler(). Its topic, message id and properties
+// must still fit in the buffer.
+class MqttChunkHandler {
+public:
+   virtual ~MqttChunkHandler() {}
+   // A message of `length` payload bytes starts; publishProperties() are
+   // valid during this call. Return false to have it discarded
+   virtual bool begin(const char* topic, uint32_t length) = 0;
+   // The next payload bytes in order; data is only valid during the call.
+   // Do not publish from here: the client is part way through reading
+   virtual void chunk(const uint8_t* data, size_t size) = 0;
+   // After the last chunk, or with complete false when the connection was
+   // lost or reset first
+   virtual void end(bool complete) = 0;
+};
+
+#define CHECK_STRING_LENGTH(l,s) if (l+2+strnlen(s, this->bufferSize) > this->bufferSize) {_client->stop();return false;}
+
+class PubSubClient : public Print {
+private:
+   Client* _client;
+   uint8_t* buffer;
+   uint16_t bufferSize;
+   uint16_t keepAlive;
+   uint16_t socketTimeout;
+   uint16_t nextMsgId;
+   unsigned long lastOutActivity;
+   unsigned long lastInActivity;
+   bool pingOutstanding;
+   MQTT_CALLBACK_SIGNATURE;
+   // Incremental packet reader: readPacket() consumes whatever the client
+   // has buffered and keeps its place until the packet is complete
+   enum ReadState : uint8_t { READ_FIXED_HEADER, READ_BODY };
+   ReadState readState;
+   uint16_t readPos;           // Bytes of the packet stored in the buffer
+   uint8_t readHeaderLength;   // Fixed header bytes, once known
+   uint32_t readLength;        // Remaining length from the fixed header
+   uint32_t readMultiplier;
+   uint32_t readBodyReceived;
+   boolean readOverflow;       // Body did not fit in the buffer
+   unsigned long readProgressAt;
+   unsigned long connectSentUs;
+   PubSubClientStats stats;
+   void init();
+   void resetReader();
+   int readAvailable(uint8_t* dst, size_t maxLength);
+   uint32_t readPacket(uint8_t*);
+   void streamPayload(const uint8_t* data, uint32_t offset, size_t length);
+   // Chunked delivery of a PUBLISH larger than the buffer: CHUNK_HEADER
+   // until its variable header is in, then CHUNK_PAYLOAD with each read
+   // made to chunkAt and passed on; CHUNK_OFF when it is discarded instead
+   enum ChunkState : uint8_t { CHUNK_NONE, CHUNK_HEADER, CHUNK_PAYLOAD, CHUNK_OFF };
+   MqttChunkHandler* chunkHandler;
+   ChunkState chunking;
+   uint16_t chunkAt;
+   uint16_t chunkMsgId;        // 0 for QoS 0
+   void startChunked();
+   // Outbound data between beginPublish() and endPublish(), and while
+   // corked every packet since cork() or the last full buffer
+   uint8_t writeBuffer[MQTT_WRITE_BUFFER_SIZE];
+   uint16_t writePos;
+   boolean publishing;
+   boolean writeFailed;
+   boolean corked;
+   size_t clientWrite(const uint8_t* buf, size_t size);
+   void sendChunk(const uint8_t* buf, size_t size);
+   boolean flushWrite();
+   void startPacket();
+   boolean finishPacket();
+   boolean sendPacket(const uint8_t* buf, size_t size);
+   // QoS 1 publishes awaiting their PUBACK, oldest first, each with a copy
+   // of the packet in a ring of bytes for retransmission
+   struct InflightEntry {
+      uint16_t msgId;
+      uint16_t offset;
+      uint16_t length;
+      boolean acked;
+   };
+   InflightEntry inflightEntries[MQTT_MAX_INFLIGHT];
+   uint8_t inflightHead;
+   uint8_t inflightUsed;       // Entries in the ring, acknowledged ones not yet released included
+   uint8_t inflightUnacked;
+   uint8_t inflightWindow;
+   uint8_t inflightStore[MQTT_INFLIGHT_STORE_SIZE];
+   uint16_t inflightStoreHead; // End of the newest packet
+   boolean recording;          // The packet being written is copied to the store
+   uint16_t recorded;
+   uint16_t nextPacketId();
+   int32_t allocateInflight(uint16_t length);
+   void recordInflight(const uint8_t* buf, size_t size);
+   void ackInflight(uint16_t msgId);
+   void releaseAcked();
+   void resendInflight();
+   boolean resendAliased(const uint8_t* packet, uint16_t length);
+   void convertInflight(uint8_t version);
+   boolean stripProperties(InflightEntry& entry);
+   // MQTT 5 session: protocol level, limits from the CONNACK, outbound
+   // topic aliases (alias n is aliasTopics[n-1]) and those the broker has
+   // been told on this connection
+   uint8_t protocol;
+   uint16_t serverReceiveMaximum;
+   uint16_t topicAliasMaximum;
+   char aliasTopics[MQTT_MAX_TOPIC_ALIASES][MQTT_TOPIC_ALIAS_LENGTH];
+   uint8_t aliasCount;
+   uint32_t aliasesSent;       // Bit n-1 for alias n
+   MqttPublishProperties received;
+   uint16_t topicAlias(const char* topic);
+   uint8_t buildPublishHeader(uint8_t header, const char* topic, uint32_t plength, uint16_t msgId, const MqttPublishProperties* properties, uint16_t* alias, uint8_t* scratch, MqttSegment* segments);
+   void sentAlias(uint16_t alias);
+   boolean publishSmall(const char* topic, const MqttSegment* segments, uint8_t count, uint32_t plength, boolean retained, const MqttPublishProperties* properties);
+   boolean readConnackProperties(const uint8_t* buf, uint32_t length);
+   boolean readPublishProperties(const uint8_t* buf, uint32_t length);
+   boolean write(uint8_t header, uint8_t* buf, uint16_t length);
+   uint16_t writeString(const char* string, uint8_t* buf, uint16_t pos);
+   // Build up the header ready to send
+   // Returns the size of the header
+   // Note: the header is built at the end of the first MQTT_MAX_HEADER_SIZE bytes, so will start
+   //       (MQTT_MAX_HEADER_SIZE - <returned size>) bytes into the buffer
+   size_t buildHeader(uint8_t header, uint8_t* buf, uint16_t length);
+   IPAddress ip;
+   const char* domain;
+   uint16_t port;
+   Stream* stream;
+   int _state;
+public:
+   PubSubClient();
+   PubSubClient(Client& client);
+   PubSubClient(IPAddress, uint16_t, Client& client);
+   PubSubClient(IPAddress, uint16_t, Client& client, Stream&);
+   PubSubClient(IPAddress, uint16_t, MQTT_CALLBACK_SIGNATURE,Client& client);
+   PubSubClient(IPAddress, uint16_t, MQTT_CALLBACK_SIGNATURE,Client& client, Stream&);
+   PubSubClient(uint8_t *, uint16_t, Client& client);
+   PubSubClient(uint8_t *, uint16_t, Client& client, Stream&);
+   PubSubClient(uint8_t *, uint16_t, MQTT_CALLBACK_SIGNATURE,Client& client);
+   PubSubClient(uint8_t *, uint16_t, MQTT_CALLBACK_SIGNATURE,Client& client, Stream&);
+   PubSubClient(const char*, uint16_t, Client& client);
+   PubSubClient(const char*, uint16_t, Client& client, Stream&);
+   PubSubClient(const char*, uint16_t, MQTT_CALLBACK_SIGNATURE,Client& client);
+   PubSubClient(const char*, uint16_t, MQTT_CALLBACK_SIGNATURE,Client& client, Stream&);
+
+   ~PubSubClient();
+
+   PubSubClient& setServer(IPAddress ip, uint16_t port);
+   PubSubClient& setServer(uint8_t * ip, uint16_t port);
+   PubSubClient& setServer(const char * domain, uint16_t port);
+   PubSubClient& setCallback(MQTT_CALLBACK_SIGNATURE);
+   PubSubClient& setClient(Client& client);
+   PubSubClient& setStream(Stream& stream);
+   // Messages larger than the buffer go to the handler in chunks instead of
+   // being discarded (or written to the stream); NULL turns this off
+   PubSubClient& setChunkHandler(MqttChunkHandler* handler);
+   PubSubClient& setKeepAlive(uint16_t keepAlive);
+   PubSubClient& setSocketTimeout(uint16_t timeout);
+
+   boolean setBufferSize(uint16_t size);
+   uint16_t getBufferSize();
+   const PubSubClientStats& getStats() const { return stats; }
+   // QoS 1 publishes allowed to await a PUBACK at once (1..MQTT_MAX_INFLIGHT)
+   PubSubClient& setInflightWindow(uint8_t window);
+   uint8_t inflight() const { return inflightUnacked; }
+   // MQTT_VERSION_3_1, MQTT_VERSION_3_1_1 or MQTT_VERSION_5, used from the next connect.
+   // MQTT 5 adds topic aliases, the Receive Maximum and PUBLISH properties.
+   // Unacknowledged QoS 1 publishes are rewritten for the new version where
+   // they can be, and dropped (stats().inflightDropped) where they cannot
+   PubSubClient& setProtocolVersion(uint8_t version);
+   uint8_t protocolVersion() const { return protocol; }
+   // MQTT 5 properties of the message passed to the callback
+   const MqttPublishProperties& publishProperties() const { return received; }
+
+   boolean connect(const char* id);
+   boolean connect(const char* id, const char* user, const char* pass);
+   boolean connect(const char* id, const char* willTopic, uint8_t willQos, boolean willRetain, const char* willMessage);
+   boolean connect(const char* id, const char* user, const char* pass, const char* willTopic, uint8_t willQos, boolean willRetain, const char* willMessage);
+   boolean connect(const char* id, const char* user, const char* pass, const char* willTopic, uint8_t willQos, boolean willRetain, const char* willMessage, boolean cleanSession);
+   // Start to connect without waiting for the broker.
+   // This API:
+   //   connectAsync(...) - opens the network connection if the client is not
+   //                       already connected, sends CONNECT and returns
+   //   poll() or loop()  - until poll() no longer returns MQTT_CONNECTING
+   // Returns 1 if CONNECT was sent (state() is then MQTT_CONNECTING), 0 if there was an error
+   boolean connectAsync(const char* id, const char* user = NULL, const char* pass = NULL, const char* willTopic = 0, uint8_t willQos = 0, boolean willRetain = 0, const char* willMessage = 0, boolean cleanSession = 1);
+   // Handle the CONNACK of a connectAsync() if it has arrived. Returns MQTT_CONNECTING
+   // while it is outstanding, MQTT_CONNECTED once accepted, otherwise the failure state
+   int poll();
+   void disconnect();
+   boolean publish(const char* topic, const char* payload);
+   boolean publish(const char* topic, const char* payload, boolean retained);
+   boolean publish(const char* topic, const uint8_t * payload, unsigned int plength);
+   boolean publish(const char* topic, const uint8_t * payload, unsigned int plength, boolean retained);
+   // qos 0 or 1. A QoS 1 publish is kept until the broker acknowledges it and is
+   // sent again, with DUP set, after a reconnect. Returns 0 when the in-flight
+   // window or store is full
+   boolean publish(const char* topic, const uint8_t * payload, unsigned int plength, boolean retained, uint8_t qos);
+   // Vectored publish: the payload is the segments in order, of any total
+   // length (it does not pass through the buffer, nor does the topic).
+   // Segments of a write buffer or more go to the client from where they
+   // lie; smaller pieces are gathered into MSS-sized writes
+   boolean publishv(const char* topic, const MqttSegment* segments, uint8_t count, boolean retained, uint8_t qos = 0, const MqttPublishProperties* properties = NULL);
+   boolean publish_P(const char* topic, const char* payload, boolean retained);
+   boolean publish_P(const char* topic, const uint8_t * payload, unsigned int plength, boolean retained);
+   // Start to publish a message.
+   // This API:
+   //   beginPublish(...)
+   //   one or more calls to write(...)
+   //   endPublish()
+   // Allows for arbitrarily large payloads to be sent without them having to be copied into
+   // a new buffer and held in memory at one time
+   // Returns 1 if the message was started successfully, 0 if there was an error
+   // (for QoS 1 also when the in-flight window or store is full)
+   boolean beginPublish(const char* topic, unsigned int plength, boolean retained);
+   boolean beginPublish(const char* topic, unsigned int plength, boolean retained, uint8_t qos);
+   // MQTT 5: with properties (ignored under 3.1.1). Under MQTT 5 every publish
+   // may name its topic by alias; a QoS 1 one is resent with the topic in full
+   boolean beginPublish(const char* topic, unsigned int plength, boolean retained, uint8_t qos, const MqttPublishProperties* properties);
+   // Finish off this publish message (started with beginPublish)
+   // Returns 1 if the packet was sent successfully, 0 if there was an error.
+   // A QoS 1 packet counts as sent once it is in the in-flight store
+   int endPublish();
+   // Write a single byte of payload (only to be used with beginPublish/endPublish)
+   virtual size_t write(uint8_t);
+   // Write size bytes from buffer into the payload (only to be used with beginPublish/endPublish)
+   // Returns the number of bytes written
+   virtual size_t write(const uint8_t *buffer, size_t size);
+   // Coalesce outbound packets. Between cork() and uncork() publishes,
+   // subscriptions, acknowledgements and pings are packed into the write
+   // buffer and reach the client a full MQTT_WRITE_BUFFER_SIZE at a time;
+   // uncork() writes the rest in one go, or drops it if the connection was
+   // lost meanwhile. A packet counts as sent once it is packed. CONNECT is
+   // never held back; disconnect() sends what is corked first. Returns 0
+   // if the last write failed or the rest was dropped
+   void cork();
+   boolean uncork();
+   boolean isCorked() const { return corked; }
+   boolean subscribe(const char* topic);
+   boolean subscribe(const char* topic, uint8_t qos);
+   boolean unsubscribe(const char* topic);
+   // Handles the complete packets that have arrived (at most
+   // MQTT_MAX_PACKETS_PER_LOOP) and returns without waiting for the rest
+   boolean loop();
+   boolean connected();
+   int state();
+
+};
+
+
+#endif
@@ -0,0 +1,115 @@
+#include "audio_capture.h"
+#include "scheduler.h"
+
+AudioCapture audioCapture;
+
+AudioCapture::AudioCapture()
+  : head(0), tail(0), fill(0), dropping(false), sequence(0), port(I2S_NUM_0), events(NULL), task(NULL) {
+  memset(&counters, 0, sizeof(counters));
+}
+
+bool AudioCapture::begin(i2s_port_t i2sPort, QueueHandle_t eventQueue) {
+  if (eventQueue == NULL || task != NULL) {
+    return false;
+  }
+  port = i2sPort;
+  events = eventQueue;
+  return xTaskCreatePinnedToCore(taskMain, "audio_capture", TASK_STACK, this, TASK_PRIORITY, &task, TASK_CORE) ==
+         pdPASS;
+}
+
+// Capture task: one event per DMA buffer; a lost event only delays the read
+// because drainDma() takes everything the driver has
+void AudioCapture::taskMain(void* arg) {
+  AudioCapture* capture = (AudioCapture*)arg;
+  i2s_event_t event;
+  for (;;) {
+    if (xQueueReceive(capture->events, &event, portMAX_DELAY) != pdTRUE) {
+      continue;
+    }
+    if (event.type == I2S_EVENT_RX_Q_OVF) {
+      // The driver dropped a buffer the task did not read in time
+      capture->counters.dmaOverruns++;
+      capture->sequence++;
+    } else if (event.type == I2S_EVENT_RX_DONE) {
+      capture->drainDma();
+    }
+  }
+}
+
+// Read every completed DMA buffer into the ring. A frame that starts while
+// the ring is full is read into a scratch buffer and dropped as a whole.
+void AudioCapture::drainDma() {
+  int16_t scratch[DISCARD_SAMPLES];
+  bool committed = false;
+  for (;;) {
+    uint32_t at = head.load(std::memory_order_relaxed);
+    if (fill == 0) {
+      dropping = at - tail.load(std::memory_order_acquire) >= RING_FRAMES;
+    }
+    size_t wanted = AudioFrame::SAMPLES - fill;
+    int16_t* destination = ring[at & (RING_FRAMES - 1)].samples + fill;
+    if (dropping) {
+      destination = scratch;
+      if (wanted > DISCARD_SAMPLES) {
+        wanted = DISCARD_SAMPLES;
+      }
+    }
+    size_t bytesRead = 0;
+    i2s_read(port, destination, wanted * sizeof(int16_t), &bytesRead, 0);
+    if (bytesRead == 0) {
+      break;
+    }
+    fill += bytesRead / sizeof(int16_t);
+    if (fill < AudioFrame::SAMPLES) {
+      continue;
+    }
+    fill = 0;
+    if (dropping) {
+      counters.ringOverruns++;
+      sequence++;
+      continue;
+    }
+
+    AudioFrame& frame = ring[at & (RING_FRAMES - 1)];
+    frame.sequence = sequence++;
+    frame.capturedAt = micros();
+    head.store(at + 1, std::memory_order_release);
+    counters.frames++;
+    uint32_t depth = at + 1 - tail.load(std::memory_order_acquire);
+    if (depth > counters.maxDepth) {
+      counters.maxDepth = depth;
+    }
+    committed = true;
+  }
+  if (committed) {
+    scheduler.notify(Scheduler::EVENT_AUDIO);
+  }
+}
+
+const AudioFrame* AudioCapture::peek() const {
+  uint32_t at = tail.load(std::memory_order_relaxed);
+  if (head.load(std::memory_order_acquire) == at) {
+    return NULL;
+  }
+  return &ring[at & (RING_FRAMES - 1)];
+}
+
+void AudioCapture::release() {
+  uint32_t at = tail.load(std::memory_order_relaxed);
+  if (head.load(std::memory_order_acquire) == at) {
+    return;
+  }
+  uint32_t latency = micros() - ring[at & (RING_FRAMES - 1)].capturedAt;
+  counters.analysed++;
+  counters.lastLatencyMicros = latency;
+  counters.totalLatencyMicros += latency;
+  if (latency > counters.maxLatencyMicros) {
+    counters.maxLatencyMicros = latency;
+  }
+  tail.store(at + 1, std::memory_order_release);
+}
+
+uint8_t AudioCapture::pending() const {
+  return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+}
@@ -0,0 +1,89 @@
+#ifndef AUDIO_CAPTURE_H
+#define AUDIO_CAPTURE_H
+
+#include <Arduino.h>
+#include <driver/i2s.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#include <atomic>
+
+// Microphone capture on its own FreeRTOS task.
+//
+// The I2S driver sends an event to a queue each time a DMA buffer fills. The
+// capture task, pinned to core 0 (the Arduino loop runs on core 1), blocks
+// on that queue, moves every completed buffer into the next frame of a
+// single-producer / single-consumer ring and wakes the loop with
+// Scheduler::EVENT_AUDIO. The analysis side takes frames with peek() and
+// release() whenever it gets to them, so a loop held up by a flash write or
+// a reconnect costs ring depth instead of samples.
+//
+// The ring needs no lock: the task only writes `head` and the loop only
+// writes `tail`, each published with release ordering after the frame (or
+// the slot) is done with. Every counter has a single writer as well.
+
+struct AudioFrame {
+  static const uint16_t SAMPLES = 1024;  // One DMA buffer, 64 ms at 16 kHz
+
+  alignas(4) int16_t samples[SAMPLES];  // Word loads in frameEnergyMac16()
+  uint32_t sequence;    // Frames captured before this one, dropped ones included
+  uint32_t capturedAt;  // micros() when the last sample was read from DMA
+};
+
+struct AudioCaptureStats {
+  // Capture task
+  uint32_t frames;        // Frames put into the ring
+  uint32_t dmaOverruns;   // DMA buffers the driver dropped (I2S_EVENT_RX_Q_OVF)
+  uint32_t ringOverruns;  // Frames dropped because the ring was full
+  uint8_t maxDepth;       // Most frames waiting at once
+  // Analysis side
+  uint32_t analysed;             // Frames released
+  uint32_t lastLatencyMicros;    // Capture -> release of the last frame
+  uint32_t maxLatencyMicros;
+  uint64_t totalLatencyMicros;
+};
+
+class AudioCapture {
+public:
+  static const uint8_t RING_FRAMES = 8;           // Power of two; 512 ms of audio
+  static const uint8_t EVENT_QUEUE_LENGTH = 8;    // Pass to i2s_driver_install()
+  static const uint32_t TASK_STACK = 3072;
+  static const UBaseType_t TASK_PRIORITY = 10;    // Below the WiFi and lwIP tasks
+  static const BaseType_t TASK_CORE = 0;
+
+  AudioCapture();
+
+  // Start the capture task on `port`, whose driver was installed with
+  // EVENT_QUEUE_LENGTH and `events` as its event queue
+  bool begin(i2s_port_t port, QueueHandle_t events);
+
+  // Oldest captured frame, or NULL if the ring is empty. It stays valid
+  // until release(), which hands the slot back to the capture task.
+  const AudioFrame* peek() const;
+  void release();
+  uint8_t pending() const;
+
+  const AudioCaptureStats& stats() const { return counters; }
+
+private:
+  static const uint16_t DISCARD_SAMPLES = 128;
+
+  AudioFrame ring[RING_FRAMES];
+  std::atomic<uint32_t> head;  // Frames committed, written by the capture task
+  std::atomic<uint32_t> tail;  // Frames released, written by the loop
+  uint16_t fill;               // Samples of the frame being read so far
+  bool dropping;               // That frame goes to scratch: the ring was full
+  uint32_t sequence;
+  i2s_port_t port;
+  QueueHandle_t events;
+  TaskHandle_t task;
+  AudioCaptureStats counters;
+
+  static void taskMain(void* arg);
+  void drainDma();
+};
+
+extern AudioCapture audioCapture;
+
+#endif
@@ -0,0 +1,69 @@
+#include "command_parser.h"
+#include "profiling.h"
+
+namespace {
+
+// Five members plus the two channel lists; with zero-copy the pool holds slots only
+typedef StaticJsonDocument<JSON_OBJECT_SIZE(5) + 2 * JSON_ARRAY_SIZE(COMMAND_MAX_LISTED_CHANNELS)> CommandDocument;
+
+// {"command": true, "requestId": true, "channel": true, "on": true, "off": true}, built on first use
+const JsonDocument& commandFilter() {
+  static StaticJsonDocument<JSON_OBJECT_SIZE(5)> filter;
+  if (filter.isNull()) {
+    filter["command"] = true;
+    filter["requestId"] = true;
+    filter["channel"] = true;
+    filter["on"] = true;
+    filter["off"] = true;
+  }
+  return filter;
+}
+
+bool isChannelIndex(JsonVariantConst value) {
+  return value.is<int>() && value.as<int>() >= 0 && value.as<int>() < 32;
+}
+
+// Fold a list of channel indexes into a bitmask; a missing list is empty
+uint32_t channelMask(JsonVariantConst list, bool& bad) {
+  if (list.isNull()) {
+    return 0;
+  }
+  if (!list.is<JsonArrayConst>()) {
+    bad = true;
+    return 0;
+  }
+  uint32_t mask = 0;
+  for (JsonVariantConst value : list.as<JsonArrayConst>()) {
+    if (isChannelIndex(value)) {
+      mask |= 1UL << value.as<int>();
+    } else {
+      bad = true;
+    }
+  }
+  return mask;
+}
+
+}  // namespace
+
+// Parse `payload` in place (it is modified); `out` points into it
+DeserializationError parseCommand(byte* payload, unsigned int length, ParsedCommand& out) {
+  PROFILE_SCOPE("parseCommand");
+  CommandDocument doc;
+  // char* input selects zero-copy mode
+  DeserializationError error = deserializeJson(doc, reinterpret_cast<char*>(payload), length,
+                                               DeserializationOption::Filter(commandFilter()));
+  out.command = doc["command"] | "";
+  out.requestId = doc["requestId"] | "";
+  out.badChannel = false;
+
+  JsonVariantConst channel = doc["channel"];
+  out.channel = -1;
+  if (isChannelIndex(channel)) {
+    out.channel = channel.as<int>();
+  } else if (!channel.isNull()) {
+    out.badChannel = true;
+  }
+  out.onMask = channelMask(doc["on"], out.badChannel);
+  out.offMask = channelMask(doc["off"], out.badChannel);
+  return error;
+}
@@ -0,0 +1,32 @@
+#ifndef COMMAND_PARSER_H
+#define COMMAND_PARSER_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// In-place parsing of MQTT command payloads.
+//
+// The payload is deserialized in ArduinoJson's zero-copy mode straight from
+// the PubSubClient buffer: strings are NUL-terminated where they lie instead
+// of being copied, and a filter skips every member except "command",
+// "requestId" and the relay channel arguments ("channel", "on", "off"), so
+// the document pool stays small however large the payload is. The returned
+// pointers are only valid until the MQTT callback returns (PubSubClient
+// reuses the buffer for the next packet).
+
+struct ParsedCommand {
+  const char* command;    // "" when missing
+  const char* requestId;  // "" when missing
+  int16_t channel;        // "channel", -1 when missing
+  uint32_t onMask;        // Channels listed in "on"
+  uint32_t offMask;       // Channels listed in "off"
+  bool badChannel;        // A channel argument was not an index 0-31
+};
+
+// Most channels accepted in each of the "on" / "off" lists
+const uint8_t COMMAND_MAX_LISTED_CHANNELS = 16;
+
+// Parse `payload` in place (it is modified); `out` points into it
+DeserializationError parseCommand(byte* payload, unsigned int length, ParsedCommand& out);
+
+#endif
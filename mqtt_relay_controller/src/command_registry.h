@@ -0,0 +1,216 @@
+#ifndef COMMAND_REGISTRY_H
+#define COMMAND_REGISTRY_H
+
+#include <Arduino.h>
+
+// Compile-time command registry with perfect-hash dispatch.
+//
+// A CommandRegistry is built from a constexpr table of {name, handler}. At
+// compile time it builds a hash-and-displace perfect hash: names are grouped
+// into buckets by one half of their hash, and each bucket (largest first)
+// gets the smallest displacement under which all its names land in free
+// slots of a power-of-two table at least twice the number of commands. A
+// lookup then costs one hash of the incoming name, one displacement read,
+// one slot read and one strcmp() against the single candidate, regardless of
+// how many commands are registered, and allocates nothing. Building is
+// roughly linear in the number of commands. Duplicate names or a table that
+// cannot be placed fail the build through static_assert on valid().
+
+// One incoming command; strings are owned by the caller (e.g. the MQTT buffer)
+struct CommandRequest {
+  const char* command;
+  const char* requestId;
+  const char* source;     // "mqtt" or "voice"
+  int16_t channel;        // Relay channel, -1 when not given
+  uint32_t onMask;        // set_channels: channels to switch on
+  uint32_t offMask;       // set_channels: channels to switch off
+  bool badChannel;        // A channel argument was not an index 0-31
+};
+
+typedef void (*CommandHandler)(const CommandRequest& request);
+
+struct CommandSpec {
+  const char* name;
+  CommandHandler handler;
+};
+
+namespace command_registry {
+
+constexpr uint32_t FNV_OFFSET = 2166136261u;
+constexpr uint32_t FNV_PRIME = 16777619u;
+constexpr uint32_t MAX_SEED = 16;
+constexpr uint32_t MAX_DISPLACEMENT = 0xFFFF;
+
+// FNV-1a, with the seed folded into the offset basis
+constexpr uint32_t hash(const char* name, uint32_t seed) {
+  uint32_t h = FNV_OFFSET ^ seed;
+  for (; *name != '\0'; name++) {
+    h = (h ^ (uint8_t)*name) * FNV_PRIME;
+  }
+  return h;
+}
+
+// Murmur3 finalizer: a second, independent-looking hash from the first
+constexpr uint32_t mix(uint32_t h) {
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h;
+}
+
+constexpr bool sameName(const char* a, const char* b) {
+  for (; *a != '\0' && *a == *b; a++, b++) {
+  }
+  return *a == *b;
+}
+
+// Smallest power of two >= 2 * count
+constexpr size_t tableSize(size_t count) {
+  size_t size = 1;
+  while (size < 2 * count) {
+    size <<= 1;
+  }
+  return size;
+}
+
+}  // namespace command_registry
+
+template <size_t N>
+class CommandRegistry {
+public:
+  static constexpr size_t TABLE_SIZE = command_registry::tableSize(N);
+  static constexpr size_t BUCKETS = (N + 1) / 2;
+  static constexpr uint8_t EMPTY = 0xFF;
+  static_assert(N > 0 && N < EMPTY, "1..254 commands");
+
+  constexpr explicit CommandRegistry(const CommandSpec (&table)[N])
+      : specs(), slots(), displacement(), seed(0), found(false) {
+    for (size_t i = 0; i < N; i++) {
+      specs[i] = table[i];
+    }
+    if (hasDuplicates()) {
+      return;
+    }
+    for (uint32_t candidate = 0; candidate < command_registry::MAX_SEED; candidate++) {
+      if (tryBuild(candidate)) {
+        seed = candidate;
+        found = true;
+        return;
+      }
+    }
+  }
+
+  // False when names repeat or the table could not be placed
+  constexpr bool valid() const { return found; }
+  constexpr size_t size() const { return N; }
+  constexpr uint32_t hashSeed() const { return seed; }
+
+  // O(1): one hash, two table reads, one strcmp; nullptr for unknown names
+  const CommandSpec* find(const char* name) const {
+    uint32_t h = command_registry::hash(name, seed);
+    uint32_t g = command_registry::mix(h);
+    uint8_t slot = slots[slotFor(h, g, displacement[g % BUCKETS])];
+    if (slot == EMPTY || strcmp(specs[slot].name, name) != 0) {
+      return nullptr;
+    }
+    return &specs[slot];
+  }
+
+  // Run the handler for request.command; false if it is not registered
+  bool dispatch(const CommandRequest& request) const {
+    const CommandSpec* spec = find(request.command);
+    if (spec == nullptr) {
+      return false;
+    }
+    spec->handler(request);
+    return true;
+  }
+
+private:
+  CommandSpec specs[N];
+  uint8_t slots[TABLE_SIZE];
+  uint16_t displacement[BUCKETS];
+  uint32_t seed;
+  bool found;
+
+  static constexpr size_t slotFor(uint32_t h, uint32_t g, uint32_t d) {
+    return (h + d * (g | 1u)) & (TABLE_SIZE - 1);
+  }
+
+  constexpr bool hasDuplicates() const {
+    for (size_t i = 0; i < N; i++) {
+      for (size_t j = i + 1; j < N; j++) {
+        if (command_registry::sameName(specs[i].name, specs[j].name)) {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  constexpr bool tryBuild(uint32_t candidate) {
+    uint32_t h[N] = {};
+    uint32_t g[N] = {};
+    size_t bucketSize[BUCKETS] = {};
+    for (size_t i = 0; i < N; i++) {
+      h[i] = command_registry::hash(specs[i].name, candidate);
+      g[i] = command_registry::mix(h[i]);
+      bucketSize[g[i] % BUCKETS]++;
+    }
+    for (size_t s = 0; s < TABLE_SIZE; s++) {
+      slots[s] = EMPTY;
+    }
+    for (size_t b = 0; b < BUCKETS; b++) {
+      displacement[b] = 0;
+    }
+
+    // Largest buckets first, while the table is emptiest
+    for (size_t size = N; size > 0; size--) {
+      for (size_t b = 0; b < BUCKETS; b++) {
+        if (bucketSize[b] == size && !placeBucket(b, h, g)) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  // Find the smallest displacement that puts every name of bucket `b` in a free slot
+  constexpr bool placeBucket(size_t b, const uint32_t* h, const uint32_t* g) {
+    for (uint32_t d = 0; d <= command_registry::MAX_DISPLACEMENT; d++) {
+      size_t placed = 0;
+      bool fits = true;
+      for (size_t i = 0; i < N && fits; i++) {
+        if (g[i] % BUCKETS != b) {
+          continue;
+        }
+        size_t slot = slotFor(h[i], g[i], d);
+        if (slots[slot] != EMPTY) {
+          fits = false;
+        } else {
+          slots[slot] = (uint8_t)i;
+          placed++;
+        }
+      }
+      if (fits) {
+        displacement[b] = (uint16_t)d;
+        return true;
+      }
+      // Undo this attempt's slots
+      for (size_t i = 0; i < N && placed > 0; i++) {
+        if (g[i] % BUCKETS == b) {
+          size_t slot = slotFor(h[i], g[i], d);
+          if (slots[slot] == (uint8_t)i) {
+            slots[slot] = EMPTY;
+            placed--;
+          }
+        }
+      }
+    }
+    return false;
+  }
+};
+
+#endif
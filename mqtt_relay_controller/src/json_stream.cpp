@@ -0,0 +1,151 @@
+#include "json_stream.h"
+
+JsonStreamSplitter::JsonStreamSplitter() {
+  begin(nullptr, nullptr);
+}
+
+void JsonStreamSplitter::begin(ElementCallback callback, void* callbackContext) {
+  onElement = callback;
+  context = callbackContext;
+  element[0] = '\0';
+  skeletonText[0] = '\0';
+  key[0] = '\0';
+  elementUsed = 0;
+  skeletonUsed = 0;
+  depth = 0;
+  inArray = false;
+  inString = false;
+  escaped = false;
+  elementOverflow = false;
+  complete = false;
+  failed = false;
+  elementCount = 0;
+  oversizedCount = 0;
+}
+
+void JsonStreamSplitter::appendSkeleton(char c) {
+  if (skeletonUsed >= SKELETON_SIZE - 1) {
+    failed = true;
+    return;
+  }
+  skeletonText[skeletonUsed++] = c;
+  skeletonText[skeletonUsed] = '\0';
+}
+
+// To the element while inside an array member, otherwise to the skeleton
+void JsonStreamSplitter::append(char c) {
+  if (!inArray) {
+    appendSkeleton(c);
+  } else if (elementUsed < ELEMENT_SIZE - 1) {
+    element[elementUsed++] = c;
+  } else {
+    elementOverflow = true;
+  }
+}
+
+// An array opens at depth 1: the skeleton ends in `"name":`, keep the name
+void JsonStreamSplitter::startArray() {
+  key[0] = '\0';
+  if (skeletonUsed >= 3 && skeletonText[skeletonUsed - 1] == ':' && skeletonText[skeletonUsed - 2] == '"') {
+    int open = skeletonUsed - 3;
+    while (open >= 0 && skeletonText[open] != '"') {
+      open--;
+    }
+    size_t length = skeletonUsed - 3 - open;
+    if (open >= 0 && length < KEY_SIZE) {
+      memcpy(key, skeletonText + open + 1, length);
+      key[length] = '\0';
+    }
+  }
+  appendSkeleton('[');
+  inArray = true;
+  elementUsed = 0;
+  elementOverflow = false;
+}
+
+void JsonStreamSplitter::endElement() {
+  if (elementOverflow) {
+    oversizedCount++;
+  } else if (elementUsed > 0) {
+    element[elementUsed] = '\0';
+    elementCount++;
+    if (onElement) {
+      onElement(key, element, elementUsed, context);
+    }
+  }
+  elementUsed = 0;
+  elementOverflow = false;
+}
+
+bool JsonStreamSplitter::write(const uint8_t* data, size_t size) {
+  for (size_t i = 0; i < size && !failed; i++) {
+    char c = (char)data[i];
+    if (inString) {
+      if (escaped) {
+        escaped = false;
+      } else if (c == '\\') {
+        escaped = true;
+      } else if (c == '"') {
+        inString = false;
+      }
+      append(c);
+      continue;
+    }
+    if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+      continue;  // Whitespace between tokens is dropped
+    }
+    if (complete || (depth == 0 && c != '{')) {
+      failed = true;  // The document is one object and nothing after it
+      break;
+    }
+    switch (c) {
+      case '"':
+        inString = true;
+        append(c);
+        break;
+      case '[':
+        if (depth == 1) {
+          depth++;
+          startArray();
+          break;
+        }
+        // fall through
+      case '{':
+        if (depth == UINT8_MAX) {
+          failed = true;
+          break;
+        }
+        depth++;
+        append(c);
+        break;
+      case ',':
+        if (inArray && depth == 2) {
+          endElement();
+        } else {
+          append(c);
+        }
+        break;
+      case ']':
+      case '}':
+        if (inArray && depth == 2) {
+          if (c != ']') {
+            failed = true;
+            break;
+          }
+          endElement();
+          inArray = false;
+          depth--;
+          appendSkeleton(c);
+          break;
+        }
+        depth--;
+        append(c);
+        complete = depth == 0;
+        break;
+      default:
+        append(c);
+        break;
+    }
+  }
+  return !failed;
+}
@@ -0,0 +1,70 @@
+#ifndef JSON_STREAM_H
+#define JSON_STREAM_H
+
+#include <Arduino.h>
+
+// Splits a JSON object that arrives in pieces, for documents far larger
+// than any buffer the device can spare.
+//
+// Bytes are fed in as they come (e.g. the chunks of an oversized MQTT
+// message). Each element of an array that is a member of the top-level
+// object is cut out on its own into a small buffer and handed to the
+// element callback, which deserializes it with ArduinoJson; the rest of the
+// object, with those arrays left empty, collects in the skeleton for one
+// deserializeJson() at the end. A document of any length is handled in
+// ELEMENT_SIZE + SKELETON_SIZE bytes as long as every element and the
+// skeleton fit; an element that does not is skipped and counted.
+
+class JsonStreamSplitter {
+public:
+  static const uint16_t ELEMENT_SIZE = 384;
+  static const uint16_t SKELETON_SIZE = 256;
+  static const uint8_t KEY_SIZE = 24;
+
+  // `key` names the array; `element` is NUL-terminated and may be modified
+  typedef void (*ElementCallback)(const char* key, char* element, size_t length, void* context);
+
+  JsonStreamSplitter();
+
+  // Start a new document
+  void begin(ElementCallback callback, void* context);
+
+  // Feed the next bytes; false once the document is malformed or the
+  // skeleton overflowed (the rest is then ignored)
+  bool write(const uint8_t* data, size_t size);
+
+  // After the last byte: true if one complete object was fed
+  bool finish() const { return !failed && complete && !inString; }
+
+  // The top-level object with its arrays emptied, NUL-terminated
+  char* skeleton() { return skeletonText; }
+  size_t skeletonLength() const { return skeletonUsed; }
+
+  uint32_t elements() const { return elementCount; }   // Passed to the callback
+  uint32_t oversized() const { return oversizedCount; } // Longer than ELEMENT_SIZE - 1, skipped
+
+private:
+  ElementCallback onElement;
+  void* context;
+  char element[ELEMENT_SIZE];
+  char skeletonText[SKELETON_SIZE];
+  char key[KEY_SIZE];
+  uint16_t elementUsed;
+  uint16_t skeletonUsed;
+  uint8_t depth;
+  bool inArray;        // Inside an array member of the top-level object
+  bool inString;
+  bool escaped;
+  bool elementOverflow;
+  bool complete;
+  bool failed;
+  uint32_t elementCount;
+  uint32_t oversizedCount;
+
+  void append(char c);
+  void appendSkeleton(char c);
+  void startArray();
+  void endElement();
+};
+
+#endif
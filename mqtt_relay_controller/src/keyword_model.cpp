@@ -0,0 +1,105 @@
+#include "keyword_model.h"
+#include "profiling.h"
+
+KeywordModel keywordModel(keywordModelWeights);
+
+namespace {
+
+typedef KeywordModelLayout Layout;
+
+// One layer's arrays, whatever its sizes
+struct LayerView {
+  const int8_t* filter;
+  const int32_t* bias;
+  const NnRequant* requant;
+};
+
+template <size_t WEIGHTS, uint16_t CHANNELS>
+LayerView view(const KeywordModelLayer<WEIGHTS, CHANNELS>& layer) {
+  return {layer.filter, layer.bias, layer.requant};
+}
+
+}  // namespace
+
+KeywordModel::KeywordModel(const KeywordModelWeights& weights)
+  : weights(weights), acceptProbability(DEFAULT_ACCEPT) {
+  memset(arena, 0, sizeof(arena));
+  memset(&counters, 0, sizeof(counters));
+}
+
+void KeywordModel::infer(const KeywordTemplate& utterance, int8_t* probabilities, bool reference) {
+  PROFILE_SCOPE("KeywordModel::infer");
+  const LayerView layers[Layout::LOGITS + 1] = {
+    {}, view(weights.conv), view(weights.depthwise1), view(weights.pointwise1), view(weights.depthwise2),
+    view(weights.pointwise2), view(weights.depthwise3), view(weights.pointwise3), {}, view(weights.dense),
+  };
+  uint32_t started = ESP.getCycleCount();
+  uint32_t layerStarted = started;
+
+  for (uint8_t t = Layout::CONV; t <= Layout::LOGITS; t++) {
+    const LayerView& layer = layers[t];
+    const int8_t* in = t == Layout::CONV ? &utterance.features[0][0] : tensor(t - 1);
+    int8_t* out = tensor(t);
+    if (t == Layout::POOL) {
+      nnAveragePool(Layout::SHAPES[t - 1], in, out);
+    } else if (t == Layout::LOGITS) {
+      NnFullyConnectedParams params = {weights.zero[t - 1], weights.zero[t], -128, 127};
+      uint16_t inputs = Layout::SHAPES[t - 1].size();
+      if (reference) {
+        nnFullyConnectedReference(params, inputs, in, layer.filter, layer.bias, layer.requant, CLASSES, out);
+      } else {
+        nnFullyConnected(params, inputs, in, layer.filter, layer.bias, layer.requant, CLASSES, out, scratch());
+      }
+    } else {
+      // Convolutions, each followed by a ReLU: the clamp at the zero point
+      NnConvParams params = Layout::GEOMETRY[t];
+      params.inputZero = weights.zero[t - 1];
+      params.outputZero = weights.zero[t];
+      params.activationMin = weights.zero[t];
+      params.activationMax = 127;
+      const NnShape& inShape = Layout::SHAPES[t - 1];
+      const NnShape& outShape = Layout::SHAPES[t];
+      if (Layout::isDepthwise(t)) {
+        if (reference) {
+          nnDepthwiseConv2dReference(params, inShape, in, layer.filter, layer.bias, layer.requant, outShape, out);
+        } else {
+          nnDepthwiseConv2d(params, inShape, in, layer.filter, layer.bias, layer.requant, outShape, out,
+                            scratch());
+        }
+      } else if (reference) {
+        nnConv2dReference(params, inShape, in, layer.filter, layer.bias, layer.requant, outShape, out);
+      } else {
+        nnConv2d(params, inShape, in, layer.filter, layer.bias, layer.requant, outShape, out, scratch());
+      }
+    }
+    uint32_t now = ESP.getCycleCount();
+    counters.layerCycles[t - 1] = now - layerStarted;
+    layerStarted = now;
+  }
+
+  nnSoftmax(tensor(Layout::LOGITS), CLASSES, weights.softmax, probabilities);
+  uint32_t now = ESP.getCycleCount();
+  counters.layerCycles[Layout::LAYERS - 1] = now - layerStarted;
+  counters.lastCycles = now - started;
+  if (counters.lastCycles > counters.maxCycles) {
+    counters.maxCycles = counters.lastCycles;
+  }
+  counters.inferences++;
+}
+
+int8_t KeywordModel::classify(const KeywordTemplate& utterance, int8_t* probabilities) {
+  int8_t scores[CLASSES];
+  infer(utterance, scores);
+  uint8_t best = 0;
+  for (uint8_t c = 1; c < CLASSES; c++) {
+    if (scores[c] > scores[best]) best = c;
+  }
+  if (probabilities != NULL) {
+    memcpy(probabilities, scores, sizeof(scores));
+  }
+  if (best == UNKNOWN || scores[best] + 128 < acceptProbability) {
+    return -1;
+  }
+  counters.accepted++;
+  return best;
+}
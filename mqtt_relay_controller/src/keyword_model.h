@@ -0,0 +1,181 @@
+#ifndef KEYWORD_MODEL_H
+#define KEYWORD_MODEL_H
+
+#include <Arduino.h>
+
+#include "keyword_spotter.h"
+#include "nn_kernels.h"
+
+// Keyword classification with a small int8 DS-CNN (depthwise separable
+// convolutional network), for the voice command vocabulary without
+// enrollment.
+//
+// The input is an utterance as the KeywordSpotter makes it: FRAMES frames
+// of c1..c12, trimmed, resampled and zero-mean, Q3 - already int8, so it is
+// the input tensor itself (scale 1/8, zero 0). The layers, with the shape
+// each one outputs (time x cepstrum x channels):
+//
+//   conv          3x3, stride 2 in time, ReLU      16 x 12 x 16
+//   depthwise 1   3x3, ReLU                        16 x 12 x 16
+//   pointwise 1   1x1, ReLU                        16 x 12 x 24
+//   depthwise 2   3x3, stride 2, ReLU               8 x  6 x 24
+//   pointwise 2   1x1, ReLU                         8 x  6 x 32
+//   depthwise 3   3x3, ReLU                         8 x  6 x 32
+//   pointwise 3   1x1, ReLU                         8 x  6 x 32
+//   pool          average over time and cepstrum    32
+//   dense         fully connected                   CLASSES
+//   softmax                                         CLASSES, scale 1/256
+//
+// Padding is TensorFlow's "same". The classes are the voice command
+// actions in main.cpp's order and UNKNOWN, for other words and noise.
+//
+// The weights, biases, requantization multipliers and zero points are a
+// KeywordModelWeights in flash (keyword_model_data.cpp, written by
+// host/tools/train_keyword_model.cpp). Activations live in a static arena:
+// layer by layer they alternate between two regions, each as large as the
+// largest tensor it holds, and the optimized kernels' int16 scratch follows
+// them. The plan is computed at compile time from the shapes below.
+
+// Weights of one layer: int8 filter, int32 bias, and per output channel the
+// weight scale (for host reference models) and the requantization
+template <size_t WEIGHTS, uint16_t CHANNELS>
+struct KeywordModelLayer {
+  int8_t filter[WEIGHTS];
+  int32_t bias[CHANNELS];
+  float scale[CHANNELS];
+  NnRequant requant[CHANNELS];
+};
+
+// Shapes and the arena plan
+struct KeywordModelLayout {
+  static const uint8_t FRAMES = KeywordTemplate::FRAMES;
+  static const uint8_t COEFFS = KeywordTemplate::COEFFS;
+  static const uint8_t CLASSES = 4;
+
+  // Activation tensors in order; tensor t is the output of layer t - 1
+  enum Tensor : uint8_t {
+    FEATURES, CONV, DEPTHWISE1, POINTWISE1, DEPTHWISE2, POINTWISE2, DEPTHWISE3, POINTWISE3, POOL, LOGITS, TENSORS
+  };
+  // Layers, softmax last
+  static const uint8_t LAYERS = TENSORS;
+
+  static constexpr NnShape SHAPES[TENSORS] = {
+    {FRAMES, COEFFS, 1}, {16, 12, 16}, {16, 12, 16}, {16, 12, 24}, {8, 6, 24},
+    {8, 6, 32}, {8, 6, 32}, {8, 6, 32}, {1, 1, 32}, {1, 1, CLASSES},
+  };
+  // Geometry of the convolution producing each tensor; the zero points and
+  // activation range (left 0) come with the weights
+  static constexpr NnConvParams GEOMETRY[TENSORS] = {
+    {},
+    {3, 3, 2, 1, 0, 1, 0, 0, 0, 0},
+    {3, 3, 1, 1, 1, 1, 0, 0, 0, 0},
+    {1, 1, 1, 1, 0, 0, 0, 0, 0, 0},
+    {3, 3, 2, 2, 0, 0, 0, 0, 0, 0},
+    {1, 1, 1, 1, 0, 0, 0, 0, 0, 0},
+    {3, 3, 1, 1, 1, 1, 0, 0, 0, 0},
+    {1, 1, 1, 1, 0, 0, 0, 0, 0, 0},
+    {},
+    {},
+  };
+
+  static constexpr bool isDepthwise(uint8_t t) { return t == DEPTHWISE1 || t == DEPTHWISE2 || t == DEPTHWISE3; }
+
+  // Bytes of the region holding the tensors of this parity (the input is
+  // the caller's)
+  static constexpr size_t regionSize(uint8_t parity) {
+    size_t size = 0;
+    for (uint8_t t = CONV; t < TENSORS; t++) {
+      if (t % 2 == parity && SHAPES[t].size() > size) size = SHAPES[t].size();
+    }
+    return (size + 3) & ~(size_t)3;
+  }
+  // Bytes of int16 scratch for the largest layer
+  static constexpr size_t scratchSize() {
+    size_t entries = nnFullyConnectedScratch(SHAPES[POOL].size(), CLASSES);
+    for (uint8_t t = CONV; t <= POINTWISE3; t++) {
+      size_t layer = isDepthwise(t) ? nnDepthwiseConv2dScratch(GEOMETRY[t], SHAPES[t - 1])
+                                    : nnConv2dScratch(GEOMETRY[t], SHAPES[t - 1], SHAPES[t]);
+      if (layer > entries) entries = layer;
+    }
+    return entries * sizeof(int16_t);
+  }
+  // Every tensor and scratch buffer in its own memory, for comparison
+  static constexpr size_t unplannedSize() {
+    size_t size = 0;
+    for (uint8_t t = CONV; t < TENSORS; t++) {
+      size += SHAPES[t].size();
+    }
+    for (uint8_t t = CONV; t <= POINTWISE3; t++) {
+      size += sizeof(int16_t) * (isDepthwise(t) ? nnDepthwiseConv2dScratch(GEOMETRY[t], SHAPES[t - 1])
+                                                : nnConv2dScratch(GEOMETRY[t], SHAPES[t - 1], SHAPES[t]));
+    }
+    return size + sizeof(int16_t) * nnFullyConnectedScratch(SHAPES[POOL].size(), CLASSES);
+  }
+};
+
+struct KeywordModelWeights {
+  KeywordModelLayer<16 * 3 * 3 * 1, 16> conv;
+  KeywordModelLayer<3 * 3 * 16, 16> depthwise1;
+  KeywordModelLayer<24 * 16, 24> pointwise1;
+  KeywordModelLayer<3 * 3 * 24, 24> depthwise2;
+  KeywordModelLayer<32 * 24, 32> pointwise2;
+  KeywordModelLayer<3 * 3 * 32, 32> depthwise3;
+  KeywordModelLayer<32 * 32, 32> pointwise3;
+  KeywordModelLayer<KeywordModelLayout::CLASSES * 32, KeywordModelLayout::CLASSES> dense;
+  float scale[KeywordModelLayout::TENSORS];   // Of each activation tensor
+  int8_t zero[KeywordModelLayout::TENSORS];
+  uint16_t softmax[256];                      // nnSoftmax() table for the logits' scale
+};
+
+struct KeywordModelStats {
+  uint32_t inferences;
+  uint32_t accepted;                                // classify() calls that returned a keyword
+  uint32_t lastCycles;                              // Of the last inference
+  uint32_t maxCycles;
+  uint32_t layerCycles[KeywordModelLayout::LAYERS]; // Of the last inference
+};
+
+class KeywordModel {
+public:
+  static const uint8_t CLASSES = KeywordModelLayout::CLASSES;
+  static const uint8_t UNKNOWN = 3;
+  static const uint16_t DEFAULT_ACCEPT = 192;  // Probability, /256; see the kwsnn bench
+  static constexpr size_t ARENA_SIZE =
+      KeywordModelLayout::regionSize(0) + KeywordModelLayout::regionSize(1) + KeywordModelLayout::scratchSize();
+
+  explicit KeywordModel(const KeywordModelWeights& weights);
+
+  // Class probabilities (scale 1/256, zero -128) of an utterance; the
+  // reference kernels with `reference` set (for benchmarks)
+  void infer(const KeywordTemplate& utterance, int8_t* probabilities, bool reference = false);
+
+  // The most probable class if it is a keyword with at least the accept
+  // probability, else -1; `probabilities` (CLASSES) may be NULL
+  int8_t classify(const KeywordTemplate& utterance, int8_t* probabilities = NULL);
+
+  void setAcceptProbability(uint16_t probability) { acceptProbability = probability; }
+  uint16_t getAcceptProbability() const { return acceptProbability; }
+  const KeywordModelStats& stats() const { return counters; }
+
+private:
+  const KeywordModelWeights& weights;
+  uint16_t acceptProbability;
+  alignas(4) uint8_t arena[ARENA_SIZE];
+  KeywordModelStats counters;
+
+  // Odd tensors at the start of the arena, even ones after them
+  int8_t* tensor(uint8_t t) { return (int8_t*)arena + (t % 2 ? 0 : KeywordModelLayout::regionSize(1)); }
+  int16_t* scratch() {
+    return (int16_t*)(arena + KeywordModelLayout::regionSize(0) + KeywordModelLayout::regionSize(1));
+  }
+};
+
+static_assert(KeywordModelLayout::SHAPES[KeywordModelLayout::POOL].channels ==
+                  KeywordModelLayout::SHAPES[KeywordModelLayout::POINTWISE3].channels,
+              "the pool keeps the channels");
+static_assert(KeywordModel::ARENA_SIZE % 4 == 0, "the scratch must be word aligned");
+
+extern const KeywordModelWeights keywordModelWeights;
+extern KeywordModel keywordModel;
+
+#endif
@@ -0,0 +1,257 @@
+// Keyword model weights, written by host/tools/train_keyword_model.cpp - do not edit.
+//
+// 500 synthetic speakers per class, 1777 training utterances, 40 epochs. Validation
+// accuracy on 197 held-out utterances: 100.0% in float, 100.0% in int8.
+
+#include "keyword_model.h"
+
+const KeywordModelWeights keywordModelWeights = {
+  {  // conv
+    {127, 79, 9, 24, 100, 44, 83, 8, -48, 8, 17, -54, 12, 19, -14, -127, -13, 47, 13, -31, -3, -21, 23, -26,
+     127, -88, -11, -21, -127, 81, 6, 13, 20, 44, 73, 29, 123, 93, 91, -95, 126, 26, -127, 60, -79, -127, -11,
+     -25, -9, 84, 25, 14, 18, -27, -127, -60, 38, -42, -2, 9, -21, -54, 20, 10, -71, -120, 61, -127, -20, -54,
+     7, -86, -127, 40, -42, -14, 37, 3, 101, -65, -1, -44, 17, -2, 127, 9, -8, 43, 24, -7, -69, 127, -3, -40,
+     54, -30, -12, -48, 0, -22, 21, -73, -22, -89, -11, -127, -125, -23, 2, 7, 55, -85, -6, -78, -88, -109,
+     -127, 31, 107, -125, 19, 63, -127, -20, 29, -57, 127, -17, -5, -89, -63, -7, 32, 27, -24, -89, 77, -21,
+     -5, -56, 117, -71, -127, 52},
+    {-31, 91, 132, -109, 257, 66, 122, -28, 51, -91, 160, 94, 165, 269, 33, 125},
+    {0.00860091764f, 0.00975575484f, 0.00743748154f, 0.00581110176f, 0.00430123834f, 0.00856632087f,
+     0.00845929608f, 0.00664936425f, 0.00680121453f, 0.0117128007f, 0.00964356307f, 0.00558727141f,
+     0.00707041379f, 0.00492915418f, 0.00622225553f, 0.00689328602f},
+    {{1503635044, -7}, {1705526720, -7}, {1300240085, -7}, {2031824186, -8}, {1503907598, -8},
+     {1497586745, -7}, {1478876389, -7}, {1162459347, -7}, {1189006213, -7}, {2047662626, -7},
+     {1685913059, -7}, {1953562967, -8}, {1236068335, -7}, {1723455396, -8}, {1087791076, -7},
+     {1205102391, -7}},
+  },
+  {  // depthwise 1
+    {-36, -94, -63, -104, 3, -89, -92, 15, -15, 37, 120, 102, -80, 8, -23, 10, 113, -56, 53, 57, -73, 67, 73,
+     36, -82, -37, 6, 76, -45, -49, -80, -22, -2, 105, -37, 75, 45, -32, 127, -97, -55, 124, 2, 24, -23, 18,
+     69, -1, 58, -65, -69, 28, -34, 2, 20, -127, 127, 127, 127, -80, 41, 40, -1, -20, 69, 68, -7, 28, 114, 127,
+     -75, 98, -3, -4, -2, 116, 127, -127, 8, -47, -1, 74, 42, -49, -5, 122, 5, -39, 53, 106, 19, 82, 100, 18,
+     63, 37, 53, 127, -44, -38, -35, -68, -107, 121, 89, 21, -41, 1, -114, 40, 17, 127, 71, -109, 127, -30, 78,
+     39, 16, 101, 59, -99, -1, -48, 47, 67, -97, 67, -127, 60, 4, 127, -127, -65, -48, 0, -6, -67, -88, -127,
+     115, 42, 127, 22},
+    {-17, 110, 96, -112, 82, 176, -15, 63, 39, -96, 96, 120, 53, 62, -248, 37},
+    {0.00705704233f, 0.00477502123f, 0.00761334831f, 0.00414681016f, 0.00461044442f, 0.00378430937f,
+     0.00442916248f, 0.00524300616f, 0.00428665569f, 0.0059477929f, 0.00808571931f, 0.00627314299f,
+     0.0047174315f, 0.00955465529f, 0.00185639015f, 0.00982241798f},
+    {{1161711391, -7}, {1572102389, -8}, {1253288991, -7}, {1365273544, -8}, {1517918003, -8},
+     {1245925730, -8}, {1458233710, -8}, {1726179241, -8}, {1411315538, -8}, {1958219449, -8},
+     {1331049439, -7}, {2065335968, -8}, {1553141855, -8}, {1572861742, -7}, {1222375884, -9},
+     {1616940119, -7}},
+  },
+  {  // pointwise 1
+    {51, 3, 79, 69, 38, 35, 87, 65, 10, -6, 127, 29, -24, -58, -1, 23, -114, 78, 39, 40, 44, 9, -72, -16, 127,
+     70, 46, -93, 15, 79, -47, 62, -2, -33, -27, 45, -14, 6, 18, -3, -39, -23, 53, 46, -21, 42, -32, 127, -86,
+     22, 38, -114, 7, 26, 17, 30, -43, -34, 42, 86, 12, -127, 51, 46, -5, -4, -10, 0, 1, 127, -20, -6, -2, -5,
+     -4, 36, 8, -13, 0, -15, -7, 30, 55, -49, -44, 1, 127, -62, 63, 99, -14, 21, -38, 86, -32, 45, 28, 5, 36,
+     -76, 107, 42, -127, 39, 2, -24, -124, 46, -23, -65, 42, 112, -44, -11, -12, 21, 8, 5, 14, 9, 29, -47, 127,
+     -11, 7, 4, -1, -17, -40, -36, 31, 58, 62, 32, -86, -127, 75, 87, 32, 37, 19, -100, 36, 84, 127, -50, -3,
+     35, 32, -47, -92, -28, 28, -73, -69, 110, -16, 5, 4, 67, -36, 92, -59, -24, 41, 52, -22, -28, 27, 21, 52,
+     -3, 127, 81, 14, 46, 127, -50, 104, -22, -77, -23, -45, 107, -58, 73, 17, 24, 124, 49, -46, -60, -63, 49,
+     127, -48, -22, -25, 104, 18, 15, -51, -37, 61, -34, 5, 17, 61, -27, -7, -22, -16, 17, -37, -3, 28, 45,
+     -55, 127, 82, -22, -38, -11, -13, 17, 54, -72, 21, -21, -25, 30, 16, 68, 84, -127, -39, -10, -50, -4, 9,
+     -47, 18, 1, 23, 9, 50, 6, 52, -11, 68, -14, -55, -88, 127, 4, -21, -26, 99, 30, -78, -18, 58, -39, 127,
+     -79, 37, 25, 53, -20, 54, 9, 72, 32, 1, -50, 34, -55, -5, -18, 45, -104, 127, -1, 46, 121, 9, 27, 113,
+     -43, 13, 18, 37, 10, -10, 42, 103, 127, -43, -38, -89, 54, 48, 6, -21, -18, 51, -3, 2, 0, -4, 39, 29, -5,
+     18, -5, -31, 127, 11, 1, 0, -58, 46, -36, 9, 37, 71, -64, -125, -5, 54, -15, 127, 19, 27, -12, 9, 76, -10,
+     -53, -127, -68, -56, -67, -102, 9, 97, -51, -62, -28, -18, -41, 72, 122, -30, -108, 44, -69, 74, -98, 29,
+     -39, 62, 50, 121, 127, -69, 24, -71, 91, -35, 81, -42, -69, -37, -12, -39, 67, -127, 32, -19, -3, -75, 1,
+     33},
+    {37, 114, 81, 46, -2, 60, -83, 60, -14, -154, 109, 43, 11, 49, -52, 28, 82, -12, 36, 67, 103, -121, 0, 16},
+    {0.00559708709f, 0.00506865187f, 0.00699987309f, 0.0046045999f, 0.00255581061f, 0.00396974059f,
+     0.00299864006f, 0.0058900998f, 0.00380584248f, 0.00239960663f, 0.0044170348f, 0.00569371507f,
+     0.00199481682f, 0.0076332069f, 0.00631200988f, 0.00275329943f, 0.005004365f, 0.00560609996f,
+     0.00547656277f, 0.00279812329f, 0.00614371523f, 0.00351288985f, 0.00510759233f, 0.00855993479f},
+    {{1488135360, -7}, {1347636717, -7}, {1861103552, -7}, {1224256087, -7}, {1359061271, -8},
+     {2110923502, -8}, {1594537386, -8}, {1566040628, -7}, {2023770109, -8}, {1275999254, -8},
+     {1174386884, -7}, {1513826493, -7}, {2121501701, -9}, {2029492291, -7}, {1678216712, -7},
+     {1464076642, -8}, {1330544333, -7}, {1490531674, -7}, {1456090745, -7}, {1487911886, -8},
+     {1633471078, -7}, {1867991515, -8}, {1357990080, -7}, {1137943849, -6}},
+  },
+  {  // depthwise 2
+    {44, 46, -92, 127, 2, -75, -38, 37, 88, -50, -15, 27, -31, 73, -2, -45, 2, 102, 127, -11, 2, -45, 79, 17,
+     -19, -85, 33, -67, 92, -1, -51, 116, 127, -1, 17, -3, -14, 38, 2, 50, -9, 127, -21, -7, 127, -39, -80,
+     127, -13, -24, 92, 51, -5, -90, 127, 3, 9, -10, 86, 64, 0, -4, 3, -24, 102, -103, 69, 127, 39, 22, 108,
+     28, -1, 127, -103, 81, -2, 99, -44, -5, 13, 127, -34, -60, -2, 46, 54, 13, 95, 63, 97, -3, -103, 127, -22,
+     -28, 120, 2, 12, 45, 127, 81, -6, -90, 13, -31, -39, -18, 127, 2, 32, 10, -20, 41, -81, 10, 126, -29, -32,
+     47, 73, 97, -60, -94, 0, 53, 52, 13, -40, -52, 34, -40, -11, 127, 16, 127, 55, -64, -21, 22, 21, 12, -14,
+     -30, -53, 43, -34, 10, 1, 81, 31, 33, -18, -50, -21, -61, 46, 32, 127, -31, 127, 63, 49, -9, -23, -33,
+     127, -63, 127, 56, 97, 20, -4, 127, 2, 127, 2, -19, 127, 127, -40, 6, -48, -1, 119, 93, -40, -5, -63, 1,
+     100, -1, -81, -5, 127, 34, -5, -65, -15, 73, -22, 61, 84, 20, -9, 41, 26, -5, -75, 53, -10, 19, -87, -24,
+     125, -29},
+    {23, 40, 98, 28, -112, 45, -23, 85, -12, 120, 117, 37, -50, 27, -28, 124, 41, -13, -8, -12, 101, -37, -14,
+     -3},
+    {0.00849436503f, 0.00894535147f, 0.00404060306f, 0.00551296864f, 0.00206593866f, 0.00497817853f,
+     0.00559285749f, 0.00309926225f, 0.00808693841f, 0.00481264014f, 0.00404474232f, 0.00635440368f,
+     0.00276346086f, 0.0124496575f, 0.0112220366f, 0.00289151422f, 0.00576197729f, 0.00492652692f,
+     0.00433722744f, 0.00339874416f, 0.00572540937f, 0.00769379502f, 0.00687262509f, 0.0110606104f},
+    {{1223651943, -7}, {1288618592, -7}, {1164134522, -8}, {1588336447, -8}, {1190431469, -9},
+     {1434258550, -8}, {1611353152, -8}, {1785851330, -9}, {1164960284, -7}, {1386565431, -8},
+     {1165327081, -8}, {1830761542, -8}, {1592356455, -9}, {1793429831, -7}, {1616585441, -7},
+     {1666143133, -9}, {1660078105, -8}, {1419377250, -8}, {1249594705, -8}, {1958418258, -9},
+     {1649542556, -8}, {1108326190, -7}, {1980065847, -8}, {1593331270, -7}},
+  },
+  {  // pointwise 2
+    {63, -29, 94, -26, -1, -31, 9, -2, 101, 1, 64, -22, 0, 3, -50, 0, -8, -89, -16, 7, -11, -74, -127, 97, 52,
+     -49, 90, 95, -1, -38, 1, 70, -55, 7, -90, -100, -1, -53, 126, -50, -6, 26, 127, -23, -93, 111, -13, 37, 6,
+     39, 41, 68, 4, 12, -25, 12, -5, 47, 64, 33, -13, 23, -45, 25, 17, 16, 30, -14, 127, -43, -35, -28, -18,
+     -62, 0, 6, 1, 31, -3, 7, -4, -1, -28, 32, 0, 75, 48, 1, 51, 127, -5, -3, 6, 34, 68, -54, -83, -33, -23,
+     52, 16, 33, 16, -16, -98, 9, 127, -74, -2, -39, -36, 13, 37, -8, -37, -8, 120, -36, 83, -69, -104, -14,
+     13, 2, 1, 16, -2, -1, 127, -2, 13, 41, 0, 29, 35, 0, -56, -3, 12, 2, 18, -6, 58, 71, 85, 27, -20, 20, 2,
+     -92, -3, 5, -38, -4, -77, 84, 1, -127, 65, -19, 33, -30, -74, 8, -51, 42, 69, 29, 21, 27, -27, -7, 0, 12,
+     0, 2, 3, -1, 28, -21, 0, -88, 12, 1, 127, -30, -8, 1, -19, 24, -51, -34, 95, 93, 45, -26, 1, -49, 43, 34,
+     13, 8, 14, 127, 0, 47, -13, -25, 66, -33, -82, 7, -71, -27, -1, -46, 48, -10, 35, -127, -16, 56, 46, 62,
+     33, -1, 45, 50, 0, 14, 98, 36, 28, 23, 21, 24, 62, 19, 76, 0, 62, -53, -22, -2, 37, -60, 3, 17, -13, -23,
+     -65, -21, 0, 67, 87, 0, 39, -38, 45, 0, 24, 12, 109, 127, 42, -66, -39, 38, -15, 2, -2, -17, -38, -3, 86,
+     58, 3, 82, 12, 0, -23, -127, 65, 9, -9, -1, -25, -40, -18, -45, 65, 13, 1, 116, -11, 23, 62, -7, 48, -85,
+     -2, 53, 127, 0, -19, -115, 2, 37, -14, 109, 19, 18, 65, -11, -72, -2, -3, -47, 3, -6, 6, 3, -32, -4, -1,
+     -76, -103, -2, 13, -127, -36, -5, 15, -40, -47, 65, 92, 37, -10, -7, 0, 8, -1, -1, -39, 0, 1, 127, 0, 39,
+     12, 0, -25, 23, 6, 1, 23, -1, -88, -36, 28, -25, 22, 6, -1, 58, -29, 10, -127, 1, 37, -37, 0, -9, -36, 0,
+     50, -15, 3, 3, -21, 10, 81, -25, -89, 127, 16, 24, -16, -20, -19, 20, -24, 27, 59, -2, 4, 57, -51, 4, 30,
+     -13, 7, -9, -29, -1, -13, -71, 53, -88, -55, -62, 19, -3, -8, 23, 15, -3, 83, 13, -1, 126, 44, 2, -39,
+     -64, 24, 13, 73, 127, 38, -38, 15, 15, 101, 1, -4, 62, 54, 127, 71, 8, 26, 33, -3, 92, 116, 3, 5, 100,
+     -23, 10, -8, 11, -116, 101, 48, 18, -19, -71, -2, 89, 21, -52, -75, 0, 34, 53, 38, -14, 76, -4, -43, -24,
+     80, 13, -83, 127, -45, -60, 31, 3, -57, -50, 1, 6, 4, -13, 67, -1, 33, 102, 1, 28, 18, 2, -21, 74, 11, -3,
+     -7, -9, 127, 12, -16, -11, -1, 25, 29, 59, -43, 72, 127, -8, -48, 12, 1, 29, -39, 1, -28, 26, -52, -3, 52,
+     59, -34, -30, -57, 1, 81, -127, -2, -40, 13, 11, 95, 2, -2, 38, 0, -21, 48, -2, 101, 33, 88, -4, -6, 46,
+     -32, 47, 106, -66, -39, -7, 11, 40, 17, -78, 67, 2, 84, 69, 0, 25, 59, -2, 13, -103, -13, -7, 127, 28, 53,
+     34, 0, 85, 17, 103, -27, 50, -22, -17, 24, 3, 49, -59, -1, -39, 115, 3, 98, 61, 63, -2, -6, 82, -36, -127,
+     -2, 127, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, -5, 0, 0, 10, -9, 0, 0, 0, 0, 0, 15, 127, 32, -54, -6, 3, -22,
+     -47, 127, 69, -8, 14, -64, 6, 76, -31, 13, 2, 68, 11, 11, 5, -14, -75, 12, 75, 122, 82, -105, 5, 89, -57,
+     -31, -101, -3, -27, -120, -1, 43, -18, 16, 49, 28, -74, -7, 87, 72, -97, 127, -6, -26, -33, -10, 0, -69,
+     0, 54, 127, 8, -22, -82, -1, -1, 117, -26, -11, -12, -14, 11, -51, 49, 23, 66, 124, 63, -67, -97, -2, 71,
+     127, -22, -23, -12, 62, 4, 20, -63, 0, -4, 62, 66, -52, -22, -25, 34, -49, -74, -22, 106, 21, 9, -1, 40,
+     1, -2, 40, 0, 51, 12, 0, 127, 64, 2, -94, -20, -29, 3, -14, 6, 34, -109, 70, 16, 18, -35, 0, 39, 23, 22,
+     -9, -2, 35, -29, 0, -68, -9, 0, -8, -57, 16, 6, -4, 16, 74, 127},
+    {40, -24, 26, 73, 45, 65, -11, 4, 22, -7, -2, 4, -81, 99, 20, 2, 14, 41, 4, 0, -1, -13, -26, 17, 76, 1115,
+     19, -3, -19, -33, 19, 37},
+    {0.00426951237f, 0.00443233643f, 0.00841163099f, 0.00402258849f, 0.0047123041f, 0.00181627134f,
+     0.00508658169f, 0.00313813798f, 0.00540575432f, 0.00539909909f, 0.00448084576f, 0.00389943039f,
+     0.00194530282f, 0.00327235553f, 0.00434777001f, 0.00501172245f, 0.00537490845f, 0.00457171956f,
+     0.00321261305f, 0.00411020406f, 0.00546329189f, 0.0051951753f, 0.00463795522f, 0.00383539358f,
+     0.00351688778f, 1.52365856e-05f, 0.00552815711f, 0.00368556264f, 0.0055813673f, 0.00406965846f,
+     0.00409414386f, 0.00595694408f},
+    {{1096662291, -7}, {1138485101, -7}, {1080301181, -6}, {2066475383, -8}, {1210397292, -7},
+     {1866101900, -9}, {1306533825, -7}, {1612117398, -8}, {1388516158, -7}, {1386806703, -7},
+     {1150945155, -7}, {2003206874, -8}, {1998673444, -9}, {1681067347, -8}, {1116763463, -7},
+     {1287305561, -7}, {1380593122, -7}, {1174286900, -7}, {1650376570, -8}, {2111485062, -8},
+     {1403295197, -7}, {1334427061, -7}, {1191300120, -7}, {1970310024, -8}, {1806687919, -8},
+     {2003790209, -16}, {1419956406, -7}, {1893339199, -8}, {1433623916, -7}, {2090656068, -8},
+     {2103234655, -8}, {1530094159, -7}},
+  },
+  {  // depthwise 3
+    {61, -39, 79, 3, 60, -22, 62, 13, -68, -92, 63, 127, 60, 74, -67, 47, -3, -71, 66, 127, -21, 6, 86, -11,
+     -11, 0, -127, 107, -110, 117, 127, -29, -19, 127, 127, -23, 7, -44, 29, 13, 37, 38, -13, -14, 79, 65,
+     -103, -40, -7, -109, 11, -21, -69, 70, -45, 44, 30, 0, -25, -26, -12, -6, -104, 69, 28, -8, -25, -38, 16,
+     127, 34, 14, 34, 104, -46, 1, 50, 5, -1, 30, -5, 88, -127, 5, 13, 29, 55, -2, -102, 0, 31, 114, 126, -127,
+     44, 127, 127, 47, 51, -3, 118, 21, -18, 127, 53, -2, 22, 97, 64, 61, 127, -26, 101, 37, -8, -12, 88, 40,
+     71, -49, 7, -2, -38, -10, 39, 80, 47, 19, -19, 45, 72, -40, 54, -55, -91, 13, 17, 99, -30, 127, 127, 108,
+     8, -46, 101, -127, -5, 74, 127, 93, -24, 24, -62, -127, 17, -62, 61, -99, -86, -110, -9, -29, -43, 127,
+     14, -3, 69, 15, 94, 21, -11, -30, 41, 2, -18, -84, -11, 31, 77, -13, 77, -16, -59, -50, -7, 0, 126, -77,
+     122, -17, -36, 92, 67, 65, 108, 6, 23, -31, -1, 6, 44, 22, -127, 48, 80, 57, -51, 9, 70, 114, -58, -18,
+     -116, 53, -127, -60, 127, 0, -29, -13, -127, 1, -123, 11, -46, -104, -29, -36, -50, 93, 127, 32, 127, 127,
+     19, -28, 65, 127, -13, -69, 127, -83, 54, -4, -6, 127, 53, 127, 4, 0, -3, 127, 113, 80, -24, -75, 56, 40,
+     73, -28, 127, -17, 91, 46, 14, 57, 10, -8, 23, -1, -11, 127, 16, -83, -16, 9, 6, -53, -11, -39, 23, 0, 87,
+     16, 9, 15, -59, 22},
+    {0, -12, 24, 5, 14, -62, -10, 24, 23, -8, 5, -7, -41, 0, 31, 17, 4, -21, -11, -9, 11, -7, -14, 12, 23,
+     -434, 18, -9, -20, -21, -20, 28},
+    {0.00721141975f, 0.00993887149f, 0.00704817474f, 0.00882484019f, 0.0051770024f, 0.00251558074f,
+     0.00817327388f, 0.00315981056f, 0.00488903141f, 0.00567201246f, 0.00965989381f, 0.00303737726f,
+     0.00293518626f, 0.00352533022f, 0.00290022837f, 0.00612454861f, 0.00687394151f, 0.00357169122f,
+     0.00741930818f, 0.00670863921f, 0.00588479964f, 0.00682873372f, 0.00817880034f, 0.00883136783f,
+     0.00762866158f, 3.49432667e-05f, 0.00903262384f, 0.00710453233f, 0.00507544121f, 0.00699535338f,
+     0.00545898359f, 0.00653901557f},
+    {{1944455190, -7}, {1339936580, -6}, {1900438529, -7}, {1189745355, -6}, {1395903931, -7},
+     {1356580032, -8}, {1101902632, -6}, {1703994565, -8}, {1318256712, -7}, {1529376244, -7},
+     {1302325429, -6}, {1637969826, -8}, {1582861171, -8}, {1901108762, -8}, {1564009390, -8},
+     {1651396084, -7}, {1853459057, -7}, {1926109913, -8}, {2000509302, -7}, {1808887677, -7},
+     {1586751235, -7}, {1841269428, -7}, {1102647698, -6}, {1190625396, -6}, {2056958423, -7},
+     {1206009242, -14}, {1217758285, -6}, {1915634539, -7}, {1368519423, -7}, {1886196013, -7},
+     {1471936088, -7}, {1763151111, -7}},
+  },
+  {  // pointwise 3
+    {-13, 61, 62, 0, 0, -2, 68, 2, -54, -127, 48, 57, 0, 3, 21, -9, -22, -31, 42, -1, 25, -27, 36, 0, 26, 0,
+     16, -3, 0, 11, -2, 9, -3, -127, 75, -54, -5, 10, -9, 8, 2, 87, 70, -16, -14, 42, -17, 16, 39, -30, -6,
+     -22, 18, 71, -70, 62, -28, 0, -12, -81, -106, -46, -25, 28, -13, 92, 36, -7, 30, -1, -126, -3, -26, 29, 8,
+     -19, 24, -21, 0, 11, 0, 8, 127, 30, 50, 44, 57, -53, 41, 0, 15, 1, 98, 67, 18, -46, 53, -85, 115, -6, -29,
+     -2, -65, -7, 74, -80, -99, 67, 11, -6, -31, 42, 50, 119, -56, 13, -41, 87, 67, -127, -31, 0, -36, 26, -64,
+     32, -19, -59, -24, -22, 106, -93, 43, -28, 73, 6, 39, 102, 119, -127, -43, 31, -7, 23, -34, -95, -39,
+     -102, -82, -17, 45, 48, 78, 0, 64, -18, 1, -40, 65, 50, 39, -33, -120, 2, 48, -2, -48, -2, 61, 17, 19, 65,
+     37, -42, -11, 19, -117, 96, 31, 19, 17, -127, 76, 119, -26, 0, 91, 5, -4, 82, 27, 68, 64, 105, -87, 35,
+     -49, 2, -45, 6, 55, -24, -29, -59, -3, 9, -40, -12, 81, -8, 127, -9, -46, 69, 13, -66, 20, 0, 46, 2, 16,
+     -80, 17, -58, -72, -20, 122, -6, 12, 1, 69, -8, -93, -54, -42, 32, 3, -1, -40, -31, -127, 31, 53, -3, -3,
+     76, 54, -34, 34, 0, -28, 93, -111, 109, -36, -15, -49, 114, -39, -10, -46, 0, -46, 1, 10, 5, -14, 0, 11,
+     -11, -25, -4, 11, 10, -5, -8, -34, 19, -68, 55, 121, 0, -71, 38, 127, 32, 90, -18, -59, 43, -30, -68, -11,
+     12, 53, -24, 19, 73, -114, 47, 66, -49, 22, 24, 68, 33, -4, 85, -27, -103, 99, -33, -71, 0, -109, 48, 127,
+     1, 108, -108, -32, 8, -15, 55, -95, 24, -97, -18, 72, 1, -15, -34, 17, -21, 2, -24, -23, 127, 3, 19, 112,
+     25, -31, 10, 11, 0, -36, 53, -88, 47, -14, -28, -91, 93, 56, 4, -42, -3, 22, 18, -22, -20, 68, -21, 6, 6,
+     51, -22, 35, -9, 70, -20, -127, -3, -100, 36, -3, 0, -53, 88, -18, 45, 59, 115, 104, -4, 21, 74, 29, -17,
+     -66, -2, 5, 29, 28, -69, -21, 41, 13, 33, 1, -26, -43, -40, 94, -37, 10, 86, 20, 0, 127, -34, 16, 0, -29,
+     -29, -55, 3, 49, 16, 27, 1, -59, 2, -54, 6, 42, -24, 10, -3, -37, 24, -127, 10, 36, 3, -12, 104, 22, -38,
+     -6, 0, 4, 43, -57, -30, 42, -9, 55, 76, -24, 0, 5, 0, 78, 1, -81, -127, 58, -5, -6, 22, 5, 7, -52, -9, 47,
+     -12, 30, 26, 19, 21, -23, 0, 1, 52, 5, -24, -11, 102, -68, -5, -35, -66, -22, 1, -34, -1, 84, 64, 4, 8,
+     12, -13, 5, -19, -75, 9, -127, 5, -16, 15, -54, 7, -12, 0, -6, 3, 2, -96, 74, -25, 127, 22, 19, 64, 78,
+     -2, -13, 26, 14, -3, -62, -2, -24, 28, -7, 1, 25, -75, 123, -9, 44, -27, -11, -65, 14, 0, 94, 45, -19,
+     -62, -30, 34, 32, 127, -17, -39, 31, -11, 27, -8, 2, 37, -36, 28, 25, -33, 12, 6, -61, 97, 88, 61, 44, 43,
+     -70, 14, 1, 0, 5, 89, 60, 68, 25, -72, -57, 41, 43, -74, -127, 5, 79, -10, 20, 5, -74, 7, 45, -42, -26,
+     -26, 34, 89, -30, 38, -72, -30, 43, 32, -87, 0, 29, 18, -41, 60, 96, -52, 58, -58, -23, 61, -46, -31, 85,
+     4, 23, 7, 87, -57, -42, 56, 8, -41, -82, -36, -101, -46, 59, 44, 4, 90, 10, 0, 14, 22, -77, 47, 24, -127,
+     6, -105, 89, 7, 118, -14, 48, 46, -16, 13, 17, -78, -24, 59, -1, 34, 78, -127, 14, -102, 86, -114, -99,
+     -12, -34, 0, 74, 56, 9, 26, -1, -22, 54, 127, -81, -25, 5, -4, -70, -1, 23, 18, -10, -12, -8, 14, -15, 79,
+     2, 7, -70, 3, -67, 9, -3, 21, 2, 0, -31, -72, -8, -71, -23, -2, 51, 77, -25, -31, 67, 16, 1, -4, 0, 52,
+     -4, 6, 4, 2, 100, 1, 0, -13, -55, 32, 14, -40, -36, 22, -31, 0, -29, -127, -111, 0, -68, -3, -19, 74, 6,
+     -69, 98, -4, -64, 23, 127, 3, -30, -3, -24, 17, 14, 28, 101, -20, -17, -26, -33, -9, -65, -46, 67, 0, 45,
+     -18, 27, -52, 20, 62, 54, 84, -81, -27, -88, 1, 93, -26, 39, 108, -76, -21, 37, -58, -11, -17, -59, 38,
+     64, 6, -29, -9, -43, 14, -30, 0, 24, -69, -116, 83, 127, 30, 53, -37, 123, 0, 23, 0, -72, 2, -15, -127,
+     29, 10, -1, -1, 7, 0, 0, -8, 54, 0, -18, 86, 1, -30, 4, 0, -25, -17, 38, 99, 48, 20, -2, 127, 28, -1, -3,
+     -4, -10, -3, -22, 2, 23, -17, 5, -11, 27, 50, 90, -12, -31, 4, -30, 85, 27, 72, -21, 0, -45, 108, 67, 33,
+     53, 0, -59, 57, 81, 87, 40, 1, -65, 17, 21, 47, -71, -9, -33, 48, -8, 69, -92, 2, -54, -11, -95, -50, -14,
+     53, 21, 0, 54, -12, -43, 10, -86, 127, 31, 52, 8, 2, 127, -2, -10, 4, 55, -68, 73, -67, -14, 34, 3, -1,
+     15, -28, -9, -18, -11, 56, -89, 31, -42, 0, 115, 96, 71, -41, 48, -63, 63, 2, -11, 14, -17, 12, -6, -11,
+     -32, 59, -78, -21, 9, -8, 32, -26, -95, 21, 105, 69, 22, 16, 87, -39, 66, 0, 5, 127, -75, 58, -30, 46,
+     -63, -33, 64, -103, -79, 24, 127, -7, 57, 66, -52, 36, 20, -11, -7, -66, 45, 96, 47, 32, 64, -57, -37, 41,
+     -92, 0, -58, -59, 42, 38, 57, 3, -15, 9, 25, 4, -117, 7, 51, -24, -67, 42, 3, 12, 43, -47, -4, -8, -2, -4,
+     -86, 104, -55, 127, 8, -31, -20, 0, -32, -36, 86, 78, 5, -34},
+    {7, 21, -29, 1, 28, 12, 1, -18, 16, -30, -4, 17, 12, -9, 1, -23, 7, -26, -26, 20, 27, 17, 5, 18, -22, 10,
+     -14, 40, 17, -2, 9, -17},
+    {0.00522615947f, 0.00518510677f, 0.00360876229f, 0.00296010869f, 0.00390893035f, 0.00307287392f,
+     0.00298148626f, 0.00350301294f, 0.00303858425f, 0.00425415533f, 0.00411928631f, 0.00342991622f,
+     0.00480759842f, 0.00516679604f, 0.00238659047f, 0.00271828007f, 0.00407761196f, 0.00433361996f,
+     0.0044428492f, 0.00393026974f, 0.0042883982f, 0.00329388003f, 0.00551753491f, 0.00576561177f,
+     0.00446795579f, 0.00448236987f, 0.00561673054f, 0.00365692703f, 0.00438740849f, 0.00420353888f,
+     0.00381271425f, 0.00356359384f},
+    {{1734084815, -7}, {1720463175, -7}, {1197418471, -7}, {1964379217, -8}, {1297016824, -7},
+     {2039212174, -8}, {1978565747, -8}, {1162329924, -7}, {2016456959, -8}, {1411565452, -7},
+     {1366814750, -7}, {1138075804, -7}, {1595202648, -7}, {1714387516, -7}, {1583782627, -8},
+     {1803897573, -8}, {1352986838, -7}, {1437932503, -7}, {1474175707, -7}, {1304097419, -7},
+     {1422927531, -7}, {1092937821, -7}, {1830765702, -7}, {1913079745, -7}, {1482506291, -7},
+     {1487289007, -7}, {1863679669, -7}, {1213399949, -7}, {1455780003, -7}, {1394770477, -7},
+     {1265091492, -7}, {1182431191, -7}},
+  },
+  {  // dense
+    {-90, -12, -10, -86, 25, 99, -87, -20, -37, -7, 89, -17, -54, 41, 9, 5, 57, -16, 16, -15, -29, -59, 127, 1,
+     53, -86, -48, 34, 7, 43, 61, 102, 28, -66, 63, 53, 5, -2, 70, 66, 3, 75, -57, -67, 14, 102, -22, -62, 95,
+     -26, 11, -42, -13, 77, 112, 29, 11, 23, 61, 8, 84, 10, -127, 9, 31, 79, 24, 53, 36, -15, 90, 0, 51, 127,
+     -57, 66, -76, 71, 4, -11, -34, -38, 93, -7, -21, -45, -77, 48, -15, -12, 34, -57, 35, -86, 23, 50, 31, 93,
+     -30, -54, 116, -36, 50, -38, -4, -127, -57, 42, 18, -71, 49, -32, 63, -76, -56, 79, 60, 6, 12, 97, -78,
+     -18, -13, 61, 75, -40, -13, -66},
+    {6, -13, -19, 24},
+    {0.00493761804f, 0.00461086351f, 0.00432583364f, 0.00571708521f},
+    {{2127029575, -6}, {1986270097, -6}, {1863484784, -6}, {1231404417, -5}},
+  },
+  // Activation scales and zero points, input first
+  {0.125f, 0.196540564f, 0.328183323f, 0.339293838f, 0.647424042f, 0.692841709f, 0.70631218f, 0.585125268f,
+   0.585125268f, 0.18668209f},
+  {0, -128, -128, -128, -128, -128, -128, -128, -128, -92},
+  // Softmax: exp(-d * logit scale), Q16
+  {65535, 54375, 45115, 37432, 31058, 25769, 21381, 17740, 14719, 12212, 10133, 8407, 6975, 5788, 4802, 3984,
+   3306, 2743, 2276, 1888, 1567, 1300, 1079, 895, 742, 616, 511, 424, 352, 292, 242, 201, 167, 138, 115, 95,
+   79, 66, 54, 45, 37, 31, 26, 21, 18, 15, 12, 10, 8, 7, 6, 5, 4, 3, 3, 2, 2, 2, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0,
+   0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+   0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+   0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+   0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+   0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+   0, 0, 0, 0, 0, 0, 0, 0},
+};
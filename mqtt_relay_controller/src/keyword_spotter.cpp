@@ -0,0 +1,209 @@
+#include "keyword_spotter.h"
+
+KeywordSpotter keywordSpotter(mfccFrontEnd);
+
+namespace {
+
+const uint8_t N = KeywordTemplate::FRAMES;
+const uint8_t COEFFS = KeywordTemplate::COEFFS;
+const int32_t INF = 1 << 30;  // Plus a full path of frame distances, still below 2^31
+const uint8_t Q8_TO_Q3 = 5;
+
+inline int32_t frameDistance(const int8_t* a, const int8_t* b) {
+  int32_t sum = 0;
+  for (uint8_t k = 0; k < COEFFS; k++) {
+    int32_t d = a[k] - b[k];
+    sum += d * d;
+  }
+  return sum;
+}
+
+// Distance from `c` to the envelope [lower, upper]
+inline int32_t envelopeDistance(const int8_t* c, const int8_t* upper, const int8_t* lower) {
+  int32_t sum = 0;
+  for (uint8_t k = 0; k < COEFFS; k++) {
+    int32_t d = c[k] > upper[k] ? c[k] - upper[k] : (c[k] < lower[k] ? lower[k] - c[k] : 0);
+    sum += d * d;
+  }
+  return sum;
+}
+
+} // namespace
+
+KeywordSpotter::KeywordSpotter(const MfccFrontEnd& features)
+    : source(features), start(0), acceptDistance(DEFAULT_ACCEPT) {
+  memset(&counters, 0, sizeof(counters));
+}
+
+void KeywordSpotter::markStart(uint8_t preroll) {
+  uint32_t written = source.written();
+  start = written - (preroll < written ? preroll : written);
+}
+
+uint16_t KeywordSpotter::framesSinceStart() const {
+  uint32_t frames = source.written() - start;
+  return frames < MfccFrontEnd::RING_FRAMES ? frames : MfccFrontEnd::RING_FRAMES;
+}
+
+bool KeywordSpotter::utterance(KeywordTemplate& out) const {
+  uint16_t frames = framesSinceStart();
+  if (frames < MIN_FRAMES) {
+    return false;
+  }
+  uint32_t first = source.written() - frames;
+  int16_t peak = 0;
+  for (uint16_t i = 0; i < frames; i++) {
+    int16_t level = source.energy(first + i);
+    if (level > peak) {
+      peak = level;
+    }
+  }
+  if (peak == 0) {
+    return false;
+  }
+  uint16_t lo = 0;
+  uint16_t hi = frames - 1;
+  while (source.energy(first + lo) < peak - TRIM_Q8) {
+    lo++;
+  }
+  while (source.energy(first + hi) < peak - TRIM_Q8) {
+    hi--;
+  }
+  uint16_t length = hi - lo + 1;
+  if (length < MIN_FRAMES) {
+    return false;
+  }
+
+  // Nearest-frame resampling to N frames, then zero mean per coefficient
+  int16_t resampled[N][COEFFS];
+  int32_t sum[COEFFS] = {};
+  for (uint8_t j = 0; j < N; j++) {
+    uint16_t at = lo + (j * (length - 1) + (N - 1) / 2) / (N - 1);
+    const int16_t* coeffs = source.frame(first + at) + 1;
+    for (uint8_t k = 0; k < COEFFS; k++) {
+      resampled[j][k] = coeffs[k];
+      sum[k] += coeffs[k];
+    }
+  }
+  out.keyword = 0;
+  for (uint8_t k = 0; k < COEFFS; k++) {
+    int32_t mean = (sum[k] + N / 2) / N;
+    for (uint8_t j = 0; j < N; j++) {
+      int32_t value = (resampled[j][k] - mean + (1 << (Q8_TO_Q3 - 1))) >> Q8_TO_Q3;
+      out.features[j][k] = (int8_t)(value > 127 ? 127 : (value < -127 ? -127 : value));
+    }
+  }
+  return true;
+}
+
+KeywordMatch KeywordSpotter::match(const KeywordTemplate& query, const KeywordTemplate* const* templates,
+                                   uint16_t count, bool prune) {
+  uint32_t startedAt = micros();
+  KeywordMatch result = {-1, -1, INT32_MAX};
+  if (count > MAX_TEMPLATES) {
+    count = MAX_TEMPLATES;
+  }
+
+  // Query envelope over the warping band
+  int8_t upper[N][COEFFS];
+  int8_t lower[N][COEFFS];
+  for (uint8_t i = 0; i < N; i++) {
+    uint8_t from = i > WARP ? i - WARP : 0;
+    uint8_t to = i + WARP < N ? i + WARP : N - 1;
+    for (uint8_t k = 0; k < COEFFS; k++) {
+      int8_t high = query.features[from][k];
+      int8_t low = high;
+      for (uint8_t j = from + 1; j <= to; j++) {
+        int8_t value = query.features[j][k];
+        high = value > high ? value : high;
+        low = value < low ? value : low;
+      }
+      upper[i][k] = high;
+      lower[i][k] = low;
+    }
+  }
+
+  // LB_Keogh of every template, then visit them in increasing bound order
+  int32_t bound[MAX_TEMPLATES];
+  uint8_t order[MAX_TEMPLATES];
+  for (uint16_t t = 0; t < count; t++) {
+    int32_t lb = 0;
+    for (uint8_t j = 0; j < N; j++) {
+      lb += envelopeDistance(templates[t]->features[j], upper[j], lower[j]);
+    }
+    bound[t] = lb;
+    uint16_t at = t;
+    while (at > 0 && bound[order[at - 1]] > lb) {
+      order[at] = order[at - 1];
+      at--;
+    }
+    order[at] = t;
+  }
+
+  int32_t tailBound[N + 1];
+  for (uint16_t visit = 0; visit < count; visit++) {
+    uint8_t t = order[visit];
+    if (prune && bound[t] >= result.distance) {
+      counters.pruned += count - visit;
+      break;
+    }
+    tailBound[N] = 0;
+    for (int j = N - 1; j >= 0; j--) {
+      tailBound[j] = tailBound[j + 1] + (prune ? envelopeDistance(templates[t]->features[j], upper[j], lower[j]) : 0);
+    }
+    counters.compared++;
+    int32_t distance = dtw(query.features, templates[t]->features, tailBound, prune ? result.distance : INT32_MAX);
+    if (distance < result.distance) {
+      result.distance = distance;
+      result.index = t;
+    }
+  }
+
+  if (result.index >= 0 && result.distance <= acceptDistance) {
+    result.keyword = templates[result.index]->keyword;
+    counters.accepted++;
+  }
+  counters.utterances++;
+  counters.lastMicros = micros() - startedAt;
+  if (counters.lastMicros > counters.maxMicros) {
+    counters.maxMicros = counters.lastMicros;
+  }
+  return result;
+}
+
+// Rows are query frames, columns candidate frames; two rows of the cost
+// matrix, column j at index j + 1
+int32_t KeywordSpotter::dtw(const Frame* query, const Frame* candidate, const int32_t* tailBound, int32_t best) {
+  int32_t rows[2][N + 1];
+  int32_t* previous = rows[0];
+  int32_t* current = rows[1];
+  for (uint8_t j = 0; j <= N; j++) {
+    previous[j] = INF;
+  }
+  previous[0] = 0;
+  for (uint8_t i = 0; i < N; i++) {
+    uint8_t lo = i > WARP ? i - WARP : 0;
+    uint8_t hi = i + WARP < N ? i + WARP : N - 1;
+    for (uint8_t j = 0; j <= N; j++) {
+      current[j] = INF;
+    }
+    int32_t rowMin = INF;
+    for (uint8_t j = lo; j <= hi; j++) {
+      int32_t step = previous[j];
+      step = previous[j + 1] < step ? previous[j + 1] : step;
+      step = current[j] < step ? current[j] : step;
+      int32_t cost = step + frameDistance(query[i], candidate[j]);
+      current[j + 1] = cost;
+      rowMin = cost < rowMin ? cost : rowMin;
+    }
+    counters.cells += hi - lo + 1;
+    if (rowMin + tailBound[hi + 1] >= best) {
+      counters.abandoned++;
+      return INT32_MAX;
+    }
+    int32_t* swap = previous;
+    previous = current;
+    current = swap;
+  }
+  return previous[N];
+}
@@ -0,0 +1,94 @@
+#ifndef KEYWORD_SPOTTER_H
+#define KEYWORD_SPOTTER_H
+
+#include <Arduino.h>
+
+#include "mfcc_frontend.h"
+
+// Keyword spotting against enrolled templates with dynamic time warping.
+//
+// Features are the cepstral coefficients c1..c12 of an MfccFrontEnd, one
+// frame per 10 ms; the spotter reads them from the front-end's ring, so an
+// utterance can start a little before the voice detector fired.
+//
+// An utterance is trimmed to the frames within TRIM_Q8 of its loudest,
+// resampled to FRAMES frames, made zero-mean per coefficient, which removes
+// the gain and any fixed colouring of the microphone path, and stored in Q3
+// (8 steps per doubling). Templates are utterances recorded at enrollment
+// (see keyword_templates.h).
+//
+// Matching is nearest-neighbour under DTW with a Sakoe-Chiba band of WARP
+// frames and squared Euclidean frame distance. For each template the
+// LB_Keogh bound, its distance to the query's min/max envelope over the
+// band, costs one pass; templates are tried in increasing bound order and
+// the search stops at the first bound no better than the best distance
+// found. DTW abandons a template as soon as the cheapest cell of a row plus
+// the bound of the columns not reached yet exceeds the best distance. Both
+// prunings are exact: the result is the one a full search would give.
+
+struct KeywordTemplate {
+  static const uint8_t FRAMES = 32;
+  static const uint8_t COEFFS = MfccFrontEnd::COEFFS - 1;  // c0 (level) is left out
+
+  uint8_t keyword;                 // Caller's keyword index
+  int8_t features[FRAMES][COEFFS];
+};
+
+struct KeywordMatch {
+  int16_t keyword;   // -1: nothing within the accept distance
+  int16_t index;     // Of the nearest template, -1 when there is none
+  int32_t distance;  // DTW distance to it
+};
+
+struct KeywordSpotterStats {
+  uint32_t utterances;   // match() calls
+  uint32_t accepted;
+  uint32_t compared;     // Templates whose DTW was started
+  uint32_t pruned;       // Skipped on their LB_Keogh bound
+  uint32_t abandoned;    // DTW stopped early
+  uint32_t cells;        // DTW cells computed
+  uint32_t lastMicros;   // Duration of the last match()
+  uint32_t maxMicros;
+};
+
+class KeywordSpotter {
+public:
+  static const uint8_t WARP = 4;            // Sakoe-Chiba band, frames
+  static const uint8_t MAX_TEMPLATES = 64;  // match() looks at no more
+  static const uint8_t MIN_FRAMES = 10;     // Shorter utterances are refused
+  static const int16_t TRIM_Q8 = 8 * 256;   // 8 doublings of energy, 24 dB
+  static const int32_t DEFAULT_ACCEPT = 110000;  // DTW distance; see the kws bench
+
+  explicit KeywordSpotter(const MfccFrontEnd& features);
+
+  // An utterance starts `preroll` feature frames back from now
+  void markStart(uint8_t preroll);
+  uint16_t framesSinceStart() const;
+
+  // Normalised features of the frames since markStart(); false if too
+  // short or too quiet to trim
+  bool utterance(KeywordTemplate& out) const;
+
+  // Nearest of `count` templates; `prune` off runs the full search (for
+  // benchmarks)
+  KeywordMatch match(const KeywordTemplate& query, const KeywordTemplate* const* templates, uint16_t count,
+                     bool prune = true);
+
+  void setAcceptDistance(int32_t distance) { acceptDistance = distance; }
+  int32_t getAcceptDistance() const { return acceptDistance; }
+  const KeywordSpotterStats& stats() const { return counters; }
+
+private:
+  typedef int8_t Frame[KeywordTemplate::COEFFS];
+
+  const MfccFrontEnd& source;
+  uint32_t start;                 // Frame number
+  int32_t acceptDistance;
+  KeywordSpotterStats counters;
+
+  int32_t dtw(const Frame* query, const Frame* candidate, const int32_t* tailBound, int32_t best);
+};
+
+extern KeywordSpotter keywordSpotter;
+
+#endif
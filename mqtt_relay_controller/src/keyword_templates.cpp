@@ -0,0 +1,90 @@
+#include "keyword_templates.h"
+
+KeywordTemplateStore keywordTemplates;
+
+static_assert(sizeof(uint32_t) + sizeof(KeywordTemplate) <= KeywordTemplateStore::SLOT_SIZE,
+              "a template and its magic word must fit a slot");
+
+KeywordTemplateStore::KeywordTemplateStore()
+  : partition(nullptr), mapped(nullptr), mapping(0), slots(0), nextSlot(0), used(0) {}
+
+bool KeywordTemplateStore::begin(const char* partitionLabel) {
+  partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, partitionLabel);
+  if (partition == nullptr) {
+    return false;
+  }
+  const void* address = nullptr;
+  if (esp_partition_mmap(partition, 0, partition->size, SPI_FLASH_MMAP_DATA, &address, &mapping) != ESP_OK) {
+    partition = nullptr;
+    return false;
+  }
+  mapped = (const uint8_t*)address;
+  uint32_t slotCount = partition->size / SLOT_SIZE;
+  slots = slotCount > KeywordSpotter::MAX_TEMPLATES ? KeywordSpotter::MAX_TEMPLATES : slotCount;
+  // Templates of another feature format (another magic word) cannot be
+  // matched: they are erased and have to be enrolled again
+  for (uint16_t i = 0; i < slots; i++) {
+    uint32_t magic = ((const Slot*)(mapped + (size_t)i * SLOT_SIZE))->magic;
+    if (magic != MAGIC && magic != ERASED) {
+      esp_partition_erase_range(partition, 0, partition->size);
+      break;
+    }
+  }
+  scan();
+  return true;
+}
+
+// Index the valid slots; a slot that is not erased counts as written
+void KeywordTemplateStore::scan() {
+  used = 0;
+  nextSlot = 0;
+  for (uint16_t i = 0; i < slots; i++) {
+    const Slot* slot = (const Slot*)(mapped + (size_t)i * SLOT_SIZE);
+    if (slot->magic == MAGIC) {
+      table[used++] = &slot->data;
+      nextSlot = i + 1;
+      continue;
+    }
+    const uint8_t* bytes = (const uint8_t*)slot;
+    for (size_t b = 0; b < sizeof(Slot); b++) {
+      if (bytes[b] != 0xFF) {
+        nextSlot = i + 1;  // Torn write
+        break;
+      }
+    }
+  }
+}
+
+bool KeywordTemplateStore::add(const KeywordTemplate& keywordTemplate) {
+  if (mapped == nullptr || nextSlot >= slots) {
+    return false;
+  }
+  size_t offset = (size_t)nextSlot * SLOT_SIZE;
+  // A failed slot is never reused: the next template goes after it
+  nextSlot++;
+  uint32_t magic = MAGIC;
+  if (esp_partition_write(partition, offset + offsetof(Slot, data), &keywordTemplate, sizeof(keywordTemplate)) !=
+          ESP_OK ||
+      esp_partition_write(partition, offset, &magic, sizeof(magic)) != ESP_OK) {
+    return false;
+  }
+  table[used++] = &((const Slot*)(mapped + offset))->data;
+  return true;
+}
+
+bool KeywordTemplateStore::clear() {
+  if (mapped == nullptr) {
+    return false;
+  }
+  bool ok = esp_partition_erase_range(partition, 0, partition->size) == ESP_OK;
+  scan();
+  return ok;
+}
+
+uint16_t KeywordTemplateStore::countFor(uint8_t keyword) const {
+  uint16_t count = 0;
+  for (uint16_t i = 0; i < used; i++) {
+    count += table[i]->keyword == keyword;
+  }
+  return count;
+}
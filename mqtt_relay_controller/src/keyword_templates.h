@@ -0,0 +1,62 @@
+#ifndef KEYWORD_TEMPLATES_H
+#define KEYWORD_TEMPLATES_H
+
+#include <Arduino.h>
+#include <esp_partition.h>
+
+#include "keyword_spotter.h"
+
+// Enrolled keyword templates in a raw flash partition, matched in place.
+//
+// The partition is an array of SLOT_SIZE slots, each a magic word followed
+// by one KeywordTemplate, filled in order. add() programs the template first
+// and the magic word last, so a power cut mid-write leaves a slot without
+// magic that begin() skips; slots are only reused after clear(). The
+// partition is mapped through the flash cache with esp_partition_mmap(), so
+// the spotter reads templates where they are stored: only the table of
+// pointers to the valid ones is in RAM. The magic word also names the
+// feature format; begin() erases templates of any other.
+
+class KeywordTemplateStore {
+public:
+  static const uint16_t SLOT_SIZE = 512;
+
+  KeywordTemplateStore();
+
+  // Map the partition and index its templates
+  bool begin(const char* partitionLabel);
+  bool ready() const { return mapped != nullptr; }
+
+  // Store one more template; false when full or on a flash error
+  bool add(const KeywordTemplate& keywordTemplate);
+  // Erase every template
+  bool clear();
+
+  uint16_t count() const { return used; }
+  uint16_t countFor(uint8_t keyword) const;
+  uint16_t capacity() const { return slots; }
+  const KeywordTemplate* const* templates() const { return table; }
+
+private:
+  struct Slot {
+    uint32_t magic;
+    KeywordTemplate data;
+  };
+
+  static const uint32_t MAGIC = 0x434D4B4B;  // "KKMC": MFCC templates
+  static const uint32_t ERASED = 0xFFFFFFFF;
+
+  const esp_partition_t* partition;
+  const uint8_t* mapped;
+  spi_flash_mmap_handle_t mapping;
+  uint16_t slots;
+  uint16_t nextSlot;  // First slot never written
+  uint16_t used;
+  const KeywordTemplate* table[KeywordSpotter::MAX_TEMPLATES];
+
+  void scan();
+};
+
+extern KeywordTemplateStore keywordTemplates;
+
+#endif
@@ -5,31 +5,73 @@
 #include <driver/i2s.h>
 #include <ArduinoOTA.h>
 
+#include "profiling.h"
+#include "scheduler.h"
+#include "mqtt_connection.h"
+#include "wifi_supervisor.h"
+#include "sound_player.h"
+#include "audio_capture.h"
+#include "voice_activity.h"
+#include "keyword_spotter.h"
+#include "mfcc_frontend.h"
+#include "keyword_templates.h"
+#include "keyword_model.h"
+#include "command_parser.h"
+#include "command_registry.h"
+#include "relay_bank.h"
+#include "state_journal.h"
+#include "outbox.h"
+#include "json_stream.h"
+#include "topic_router.h"
+
 // Forward declarations
-void handleTurnOn(String requestId, String source = "mqtt");
-void handleTurnOff(String requestId, String source = "mqtt");
-void handleGetStatus(String requestId, String source = "mqtt");
+void handleTurnOn(const CommandRequest& request);
+void handleTurnOff(const CommandRequest& request);
+void handleGetStatus(const CommandRequest& request);
+void handleEnableVoice(const CommandRequest& request);
+void handleDisableVoice(const CommandRequest& request);
+void handleSetChannels(const CommandRequest& request);
+void handleEnrollVoice(const CommandRequest& request);
+void handleClearVoice(const CommandRequest& request);
+void handleCommandMessage(char* topic, byte* payload, unsigned int length);
+void handleBatchMessage(char* topic, byte* payload, unsigned int length);
 void sendRegistration();
-void sendStatus(String requestId);
-void sendCommandResponse(String command, String requestId, bool success, String error, String source = "mqtt");
+void sendHeartbeat();
+void sendStatus(const char* requestId = "", bool reply = false);
+void sendCommandResponse(const char* command, const char* requestId, bool success, const char* error, const char* source = "mqtt");
+bool publishJson(const char* topic, const JsonDocument& doc, uint8_t qos = 0, const MqttPublishProperties* properties = nullptr);
+bool publishOrQueue(const char* topic, JsonDocument& doc, uint8_t qos, Outbox::Priority priority,
+                    const MqttPublishProperties* properties = nullptr);
 
 // Audio processing functions
 void setupI2S();
 void setupAudioOutput();
 void processAudioInput();
-void playTone(int frequency, int duration);
 void playConfirmationSound();
 void playErrorSound();
-bool detectVoiceActivity();
-String processVoiceCommand();
-void handleVoiceCommand(String command);
+bool detectVoiceActivity(const int16_t* audio, int samples);
+int8_t processVoiceCommand();
+void enrollVoiceCommand();
+void handleVoiceCommand(uint8_t index);
 
 // WiFi management
-void setup_wifi();
-void checkWiFiConnection();
+void handleWiFiConnected();
+void wifiTask();
 
 // OTA management
 void setupOTA();
+void handleOTA();
+
+// Scheduler tasks
+void serviceMqtt();
+void heartbeatTask();
+void commitStateTask();
+void drainOutboxTask();
+void handleSessionStart();
+
+// Relay state persistence
+uint32_t loadLegacyRelayState();
+void saveLegacyRelayState(uint32_t state);
 
 // Replace with your network credentials
 const char* ssid = "SLT-Fiber-EYcM6-2.4G";  // Network SSID (name)
@@ -41,23 +83,73 @@ const int mqtt_port = 1883;
 const char* deviceId = "esp32-light-controller";
 const char* deviceName = "Living Room Light";
 
+// MQTT 5 (falls back to 3.1.1 if the broker refuses it): topic aliases for
+// the device's own topics, and a command's Response Topic and Correlation
+// Data answered in kind instead of a JSON requestId. A response the
+// requester has not fetched within responseExpirySeconds is discarded by
+// the broker.
+const uint8_t mqttProtocolVersion = MQTT_VERSION_5;
+const uint32_t responseExpirySeconds = 30;
+
 // MQTT Topics
 const char* status_topic = "devices/esp32-light-controller/status";
 const char* heartbeat_topic = "devices/esp32-light-controller/heartbeat";
 const char* command_topic = "devices/esp32-light-controller/commands";
 const char* response_topic = "devices/esp32-light-controller/responses";
 const char* audio_topic = "devices/esp32-light-controller/audio";
+const char* batch_topic = "devices/esp32-light-controller/commands/batch";
+// Commands for every device, and for the groups this one belongs to in
+// its room (e.g. rooms/living-room/lights/commands)
+const char* broadcast_topic = "devices/all/commands";
+const char* group_filter = "rooms/living-room/+/commands";
+
+// Inbound topics and their handlers; each filter is also subscribed to
+struct TopicRoute {
+  const char* filter;
+  TopicHandler handler;
+  const char* name;
+};
+const TopicRoute topicRoutes[] = {
+  {command_topic, handleCommandMessage, "command"},
+  {batch_topic, handleBatchMessage, "batch"},
+  {broadcast_topic, handleCommandMessage, "broadcast"},
+  {group_filter, handleCommandMessage, "group"},
+};
+TopicRouter router;
+
+// Commands accepted over MQTT (and, for the voice actions, by voice);
+// dispatched through a perfect hash built at compile time
+constexpr CommandSpec commandTable[] = {
+  {"turn_on", handleTurnOn},
+  {"turn_off", handleTurnOff},
+  {"get_status", handleGetStatus},
+  {"enable_voice", handleEnableVoice},
+  {"disable_voice", handleDisableVoice},
+  {"set_channels", handleSetChannels},
+  {"enroll_turn_on", handleEnrollVoice},
+  {"enroll_turn_off", handleEnrollVoice},
+  {"enroll_get_status", handleEnrollVoice},
+  {"clear_voice_templates", handleClearVoice},
+};
+constexpr CommandRegistry<sizeof(commandTable) / sizeof(commandTable[0])> commands(commandTable);
+static_assert(commands.valid(), "command names must be unique");
 
 // MQTT Client
 WiFiClient espClient;
 PubSubClient client(espClient);
-
-// Variables to store the current state of the light (ON/OFF)
-String lightState = "off";
+MqttConnection mqttConnection(client, espClient);
 
 // Pin Assignments (Fixed pin conflicts)
 const int LIGHT_RELAY_PIN = 4;   // GPIO 4 for the light relay (existing)
 
+// Relay channels, channel 0 first; override with -DRELAY_PINS=4,5,...
+// Channel state lives in `relays` as a bitmask (bit n = channel n on)
+#ifndef RELAY_PINS
+#define RELAY_PINS LIGHT_RELAY_PIN
+#endif
+const uint8_t relayPins[] = {RELAY_PINS};
+const uint8_t relayCount = sizeof(relayPins) / sizeof(relayPins[0]);
+
 // I2S Microphone Pins (INMP441) - Fixed GPIO 25 conflict
 const int I2S_WS = 32;    // Word Select (LRCLK) - Changed from GPIO 25
 const int I2S_SCK = 22;   // Serial Clock (BCLK)
@@ -69,29 +161,78 @@ const int AUDIO_ENABLE_PIN = 18;  // GPIO 18 amplifier enable (optional)
 
 // Audio Configuration
 const int SAMPLE_RATE = 16000;
-const int BUFFER_SIZE = 1024;
+const int BUFFER_SIZE = AudioFrame::SAMPLES;  // DMA buffer = capture frame
 const int DETECTION_THRESHOLD = 2000;  // Voice activity threshold (increased for better detection)
 
-// Audio buffers
-int16_t audioBuffer[BUFFER_SIZE];
+// Feedback sounds: {frequency Hz, duration ms}, 0 Hz is a pause
+const Tone confirmationSound[] = {{800, 150}, {0, 50}, {1200, 150}};
+const Tone errorSound[] = {{400, 250}, {0, 100}, {300, 250}};
+const Tone startupSound[] = {{600, 100}, {0, 50}, {800, 100}, {0, 50}, {1000, 100}};
+const Tone listeningSound[] = {{1000, 50}};
+const Tone otaStartSound[] = {{1000, 200}, {0, 100}, {1200, 200}};
+const Tone otaEndSound[] = {{800, 150}, {0, 100}, {1000, 150}, {0, 100}, {1200, 150}};
+
+// Audio history (frames come from audioCapture)
 float audioHistory[32];  // History for better voice detection
 int historyIndex = 0;
 
 // Variable to enable or disable state saving
 const bool saveState = true;
 
-// EEPROM address to store the state
-const int eepromSize = 1;
+// Relay state journal: a raw flash partition (see partitions.csv). Older
+// firmware kept the state in EEPROM, which is read once to migrate it, and
+// is still used when an OTA update left the old partition table in place.
+const char* stateJournalPartition = "relaylog";
+const int legacyEepromSize = 2;
+
+// Messages produced while MQTT is down wait in this partition and are sent
+// after the reconnect at outboxDrainRate per second. Offline, a heartbeat is
+// queued only every offlineHeartbeatInterval: each one is ~3 KB of the 48 KB.
+const char* outboxPartition = "outbox";
+const uint16_t outboxDrainRate = 20;
+const unsigned long offlineHeartbeatInterval = 60000;
+
+// Voice commands are recognised by matching against templates the user
+// records with the enroll_<action> commands, kept in this partition. An
+// utterance starts two capture frames before the one that set off the voice
+// detector, which is often a vowel after a quieter consonant.
+const char* keywordPartition = "keywords";
+const uint8_t keywordPreroll = 3 * AudioFrame::SAMPLES / MfccFrontEnd::HOP;
 
 // Timing variables
 unsigned long lastHeartbeat = 0;
-unsigned long lastReconnect = 0;
-unsigned long lastAudioCheck = 0;
-unsigned long lastWiFiCheck = 0;
 const unsigned long heartbeatInterval = 15000; // 15 seconds
-const unsigned long reconnectInterval = 5000;  // 5 seconds
-const unsigned long audioCheckInterval = 50;   // 50ms for audio processing (faster)
-const unsigned long wifiCheckInterval = 10000; // 10 seconds WiFi check
+const unsigned long audioCheckInterval = 50;   // Voice window timeout; captured frames wake it immediately
+const unsigned long wifiCheckInterval = 500;   // WiFi timeouts; events wake it immediately
+const unsigned long otaCheckInterval = 50;     // 50ms OTA polling
+const unsigned long mqttKeepaliveInterval = 1000; // MQTT keepalive/connection check; data wakes it immediately
+
+// MQTT packet buffer for inbound commands; outbound JSON is streamed past it
+const uint16_t mqttBufferSize = 512;
+
+// MQTT 5 request/response: the Response Topic and Correlation Data of the
+// command being handled, copied out of the PubSubClient buffer (publishing
+// the reply reuses it). A longer topic or correlation is not echoed.
+struct ReplyContext {
+  bool active;              // Set while an MQTT command is dispatched
+  char topic[128];          // "" = reply on response_topic
+  char correlation[65];     // NUL-terminated for the outbox fallback
+  uint8_t correlationLength;
+};
+ReplyContext replyTo;
+
+// Batch messages may be far larger than the buffer: they are received in
+// chunks and each command runs as soon as it is complete (CommandBatch)
+const uint32_t maxBatchBytes = 64UL * 1024;
+
+// Shared document for outbound JSON. The heartbeat is the largest: about
+// 3 KB of pool on the ESP32 and 4 KB on a 64-bit host build.
+StaticJsonDocument<5120> publishDoc;
+
+// Scheduler task ids
+int8_t mqttTask = -1;
+int8_t journalTask = -1;
+int8_t outboxTask = -1;
 
 // Voice command detection
 bool voiceDetectionEnabled = true;
@@ -101,10 +242,11 @@ bool isProcessingVoice = false;
 const unsigned long voiceTimeoutMs = 2000;     // 2 seconds timeout for voice commands
 const unsigned long voiceCommandWindow = 1500; // 1.5 seconds to capture command
 
-// Enhanced voice command patterns with multiple variations
+// Voice commands, in keyword model class / template keyword order: the
+// phrases a user says for each and the command it dispatches
 struct VoiceCommand {
-  String patterns[3];  // Multiple patterns per command
-  String action;
+  const char* patterns[3];  // Multiple patterns per command
+  const char* action;
   int patternCount;
 };
 
@@ -117,62 +259,24 @@ const int NUM_VOICE_COMMANDS = sizeof(voiceCommands) / sizeof(VoiceCommand);
 
 // Voice processing variables
 String currentVoiceBuffer = "";
-float voiceEnergyHistory[10];
-int energyHistoryIndex = 0;
-
-// Connect to WiFi
-void setup_wifi() {
-  delay(10);
-  Serial.println();
-  Serial.print("Connecting to ");
-  Serial.println(ssid);
-
-  WiFi.begin(ssid, password);
-
-  int attempts = 0;
-  while (WiFi.status() != WL_CONNECTED && attempts < 20) {
-    delay(500);
-    Serial.print(".");
-    attempts++;
-  }
-
-  if (WiFi.status() == WL_CONNECTED) {
-    randomSeed(micros());
-    Serial.println("");
-    Serial.println("WiFi connected");
-    Serial.println("IP address: ");
-    Serial.println(WiFi.localIP());
-  } else {
-    Serial.println("");
-    Serial.println("Failed to connect to WiFi - will retry in main loop");
+int8_t enrollingCommand = -1;  // voiceCommands[] index the next utterance is recorded for
+VoiceActivityDetector voiceDetector(DETECTION_THRESHOLD);
+
+// WiFi is up (first connect or reconnect): start OTA once and connect MQTT right away
+void handleWiFiConnected() {
+  static bool otaStarted = false;
+  if (!otaStarted) {
+    // Mix in the MAC so devices booting together still draw different backoff jitter
+    randomSeed(micros() ^ (uint32_t)ESP.getEfuseMac());
+    setupOTA();
+    otaStarted = true;
   }
+  scheduler.runNow(mqttTask);
 }
 
-// Check WiFi connection and reconnect if needed
-void checkWiFiConnection() {
-  if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("WiFi disconnected - attempting reconnection...");
-    WiFi.disconnect();
-    delay(1000);
-    WiFi.begin(ssid, password);
-    
-    int attempts = 0;
-    while (WiFi.status() != WL_CONNECTED && attempts < 10) {
-      delay(500);
-      Serial.print(".");
-      attempts++;
-    }
-    
-    if (WiFi.status() == WL_CONNECTED) {
-      Serial.println("");
-      Serial.println("WiFi reconnected");
-      Serial.println("IP address: ");
-      Serial.println(WiFi.localIP());
-    } else {
-      Serial.println("");
-      Serial.println("WiFi reconnection failed - will retry later");
-    }
-  }
+// Supervise the WiFi station (scheduler task, woken by WiFi events)
+void wifiTask() {
+  wifiSupervisor.poll();
 }
 
 // Setup OTA (Over-The-Air) programming
@@ -199,22 +303,23 @@ void setupOTA() {
     
     // Stop voice detection during OTA
     voiceDetectionEnabled = false;
+
+    // The device reboots into the new image; don't lose a deferred relay state
+    stateJournal.flush();
+    outbox.flush();
     
-    // Play update sound
-    playTone(1000, 200);
-    delay(100);
-    playTone(1200, 200);
+    // Play update sound (the LEDC timer keeps playing while the update runs)
+    soundPlayer.play(otaStartSound);
   });
   
   ArduinoOTA.onEnd([]() {
     Serial.println("\n✅ OTA Update completed successfully");
     
-    // Play completion sound
-    playTone(800, 150);
-    delay(100);
-    playTone(1000, 150);
-    delay(100);
-    playTone(1200, 150);
+    // Play completion sound; ArduinoOTA reboots as soon as this returns
+    soundPlayer.play(otaEndSound);
+    while (soundPlayer.busy()) {
+      delay(10);
+    }
   });
   
   ArduinoOTA.onProgress([](unsigned int progress, unsigned int total) {
@@ -250,6 +355,11 @@ void setupOTA() {
   Serial.println("   Password: lightota2024");
 }
 
+// Handle OTA updates (scheduler task)
+void handleOTA() {
+  ArduinoOTA.handle();
+}
+
 // Setup I2S for microphone input (fixed pin assignments)
 void setupI2S() {
   i2s_config_t i2s_config = {
@@ -273,7 +383,9 @@ void setupI2S() {
     .data_in_num = I2S_SD
   };
 
-  esp_err_t result = i2s_driver_install(I2S_NUM_0, &i2s_config, 0, NULL);
+  // The driver reports each filled DMA buffer on i2sEvents for the capture task
+  QueueHandle_t i2sEvents = NULL;
+  esp_err_t result = i2s_driver_install(I2S_NUM_0, &i2s_config, AudioCapture::EVENT_QUEUE_LENGTH, &i2sEvents);
   if (result != ESP_OK) {
     Serial.printf("Failed to install I2S driver: %d\n", result);
     voiceDetectionEnabled = false;
@@ -287,20 +399,27 @@ void setupI2S() {
     return;
   }
 
+  if (!audioCapture.begin(I2S_NUM_0, i2sEvents)) {
+    Serial.println("Failed to start the audio capture task");
+    voiceDetectionEnabled = false;
+    return;
+  }
+
   Serial.println("I2S microphone initialized successfully on pins:");
   Serial.printf("  WS (Word Select): GPIO %d\n", I2S_WS);
   Serial.printf("  SCK (Serial Clock): GPIO %d\n", I2S_SCK);
   Serial.printf("  SD (Serial Data): GPIO %d\n", I2S_SD);
+  Serial.printf("  Capture task on core %d, %u x %u-sample frames\n", AudioCapture::TASK_CORE,
+                AudioCapture::RING_FRAMES, AudioFrame::SAMPLES);
 }
 
 // Setup audio output to PAM8610 amplifier (mono configuration)
 void setupAudioOutput() {
-  // Initialize audio output pins (mono setup - right channel only)
-  pinMode(AUDIO_OUTPUT_PIN, OUTPUT);
+  // Tones are generated by LEDC on the output pin (mono setup - right channel only)
   pinMode(AUDIO_ENABLE_PIN, OUTPUT);
-  
-  // Set initial states
-  digitalWrite(AUDIO_OUTPUT_PIN, LOW);
+  if (!soundPlayer.begin(AUDIO_OUTPUT_PIN)) {
+    Serial.println("❌ Failed to create sound timer - feedback sounds disabled");
+  }
   digitalWrite(AUDIO_ENABLE_PIN, HIGH);  // Enable amplifier
   
   Serial.println("🔊 PAM8610 audio output initialized (mono):");
@@ -309,84 +428,38 @@ void setupAudioOutput() {
   Serial.println("  Configuration: Mono (single speaker)");
 }
 
-// Play a simple tone on mono output (right channel)
-void playTone(int frequency, int duration) {
-  int halfPeriod = 1000000 / frequency / 2;
-  int cycles = frequency * duration / 1000;
-  
-  for (int i = 0; i < cycles; i++) {
-    digitalWrite(AUDIO_OUTPUT_PIN, HIGH);
-    delayMicroseconds(halfPeriod);
-    digitalWrite(AUDIO_OUTPUT_PIN, LOW);
-    delayMicroseconds(halfPeriod);
-  }
-}
-
 // Play confirmation sound (success)
 void playConfirmationSound() {
-  playTone(800, 150);  // 800Hz for 150ms
-  delay(50);
-  playTone(1200, 150); // 1200Hz for 150ms
+  soundPlayer.play(confirmationSound);
   Serial.println("✓ Played confirmation sound");
 }
 
 // Play error sound
 void playErrorSound() {
-  playTone(400, 250);  // 400Hz for 250ms
-  delay(100);
-  playTone(300, 250);  // 300Hz for 250ms
+  soundPlayer.play(errorSound);
   Serial.println("✗ Played error sound");
 }
 
 // Play startup sound
 void playStartupSound() {
-  playTone(600, 100);
-  delay(50);
-  playTone(800, 100);
-  delay(50);
-  playTone(1000, 100);
+  soundPlayer.play(startupSound);
   Serial.println("♪ Played startup sound");
 }
 
-// Enhanced voice activity detection with noise filtering
-bool detectVoiceActivity() {
+// Enhanced voice activity detection with noise filtering, over one captured frame
+bool detectVoiceActivity(const int16_t* audio, int samples) {
+  PROFILE_SCOPE("detectVoiceActivity");
   if (!voiceDetectionEnabled) return false;
-  
-  size_t bytesRead = 0;
-  esp_err_t result = i2s_read(I2S_NUM_0, audioBuffer, sizeof(audioBuffer), &bytesRead, 10);
-  
-  if (result != ESP_OK || bytesRead == 0) {
-    return false;
-  }
 
-  // Calculate RMS (Root Mean Square) for voice activity detection
-  long sum = 0;
-  int samples = bytesRead / sizeof(int16_t);
-  
-  for (int i = 0; i < samples; i++) {
-    sum += (long)audioBuffer[i] * audioBuffer[i];
-  }
-  
-  float rms = sqrt((float)sum / samples);
-  
-  // Store in energy history for better detection
-  voiceEnergyHistory[energyHistoryIndex] = rms;
-  energyHistoryIndex = (energyHistoryIndex + 1) % 10;
-  
-  // Calculate average energy over recent history
-  float avgEnergy = 0;
-  for (int i = 0; i < 10; i++) {
-    avgEnergy += voiceEnergyHistory[i];
-  }
-  avgEnergy /= 10;
-  
-  // Voice activity detected if current RMS is significantly above average
-  bool voiceDetected = (rms > DETECTION_THRESHOLD) && (rms > avgEnergy * 1.5);
+  // Frame energy against the threshold and the recent average, compared
+  // squared (see voice_activity.h)
+  bool voiceDetected = voiceDetector.process(audio, samples);
   
   if (voiceDetected) {
     lastVoiceActivity = millis();
     if (!isProcessingVoice) {
-      Serial.printf("Voice activity detected! RMS: %.1f, Avg: %.1f\n", rms, avgEnergy);
+      Serial.printf("Voice activity detected! Mean square: %u, Avg: %u\n", (unsigned)voiceDetector.level(),
+                    (unsigned)voiceDetector.background());
     }
     return true;
   }
@@ -394,23 +467,30 @@ bool detectVoiceActivity() {
   return false;
 }
 
-// Process audio input for voice commands
+// Process audio input for voice commands (scheduler task, woken by each captured frame)
 void processAudioInput() {
-  if (!voiceDetectionEnabled) return;
-  
-  // Check for voice activity
-  if (detectVoiceActivity()) {
-    if (!isProcessingVoice) {
+  PROFILE_SCOPE("processAudioInput");
+  // Every waiting frame, so the capture ring never fills behind a slow tick;
+  // with voice detection off they are only handed back
+  for (const AudioFrame* frame = audioCapture.peek(); frame != NULL; frame = audioCapture.peek()) {
+    if (voiceDetectionEnabled) {
+      mfccFrontEnd.addAudio(frame->samples, AudioFrame::SAMPLES);
+    }
+    bool voice = voiceDetectionEnabled && detectVoiceActivity(frame->samples, AudioFrame::SAMPLES);
+    audioCapture.release();
+    if (voice && !isProcessingVoice) {
       // Start voice command processing
       isProcessingVoice = true;
       voiceCommandStart = millis();
       currentVoiceBuffer = "";
+      keywordSpotter.markStart(keywordPreroll);
       Serial.println("🎤 Started voice command capture...");
       
       // Play a brief tone to indicate listening
-      playTone(1000, 50);
+      soundPlayer.play(listeningSound);
     }
   }
+  if (!voiceDetectionEnabled) return;
   
   // If we're processing voice and timeout hasn't occurred
   if (isProcessingVoice) {
@@ -418,131 +498,286 @@ void processAudioInput() {
     
     if (elapsed > voiceCommandWindow) {
       // Timeout - process what we have
-      String command = processVoiceCommand();
-      if (command != "") {
-        handleVoiceCommand(command);
+      if (enrollingCommand >= 0) {
+        enrollVoiceCommand();
       } else {
-        Serial.println("❌ Voice command timeout - no command recognized");
-        playErrorSound();
+        int8_t command = processVoiceCommand();
+        if (command >= 0) {
+          handleVoiceCommand(command);
+        } else {
+          Serial.println("❌ Voice command timeout - no command recognized");
+          playErrorSound();
+        }
       }
       isProcessingVoice = false;
     }
   }
 }
 
-// Process captured voice data into command (simplified pattern matching)
-String processVoiceCommand() {
-  // In a real implementation, this would:
-  // 1. Use actual speech recognition (Google Speech API, Whisper, etc.)
-  // 2. Convert audio to text
-  // 3. Parse the text for commands
-  
-  // For this implementation, we'll use a simplified approach:
-  // Detect patterns in the audio energy and duration to simulate basic command recognition
-  
-  unsigned long captureTime = millis() - voiceCommandStart;
-  
-  // Simple heuristic based on voice capture duration and recent activity
-  if (captureTime > 500 && captureTime < 3000) {
-    // Simulate command recognition based on timing patterns
-    // In reality, you would analyze the actual audio content
-    
-    float recentActivity = 0;
-    for (int i = 0; i < 10; i++) {
-      recentActivity += voiceEnergyHistory[i];
-    }
-    
-    // Use a simple pattern: longer utterances tend to be "turn on/off"
-    // shorter ones might be "status"
-    if (captureTime > 1000) {
-      // Simulate alternating between turn on/off for demonstration
-      static bool lastCommandWasOn = false;
-      lastCommandWasOn = !lastCommandWasOn;
-      return lastCommandWasOn ? "turn on" : "turn off";
-    } else if (captureTime > 600) {
-      return "status";
-    }
+// Classify the captured utterance with the keyword model; one it does not
+// accept is matched against the enrolled templates, if there are any.
+// Returns the voiceCommands[] index, -1 when nothing matched
+int8_t processVoiceCommand() {
+  PROFILE_SCOPE("processVoiceCommand");
+  KeywordTemplate query;
+  if (!keywordSpotter.utterance(query)) {
+    return -1;
   }
-  
-  return ""; // No command recognized
+  int8_t probabilities[KeywordModel::CLASSES];
+  int8_t keyword = keywordModel.classify(query, probabilities);
+  const KeywordModelStats& model = keywordModel.stats();
+  Serial.printf("🎤 Keyword model: class %d, p = %d/256 (%lu cycles)\n", keyword,
+                keyword >= 0 ? probabilities[keyword] + 128 : 0, (unsigned long)model.lastCycles);
+  if (keyword >= 0 && keyword < NUM_VOICE_COMMANDS) {
+    return keyword;
+  }
+  if (keywordTemplates.count() == 0) {
+    return -1;
+  }
+  KeywordMatch match = keywordSpotter.match(query, keywordTemplates.templates(), keywordTemplates.count());
+  const KeywordSpotterStats& stats = keywordSpotter.stats();
+  Serial.printf("🎤 Nearest template %d at distance %ld (%lu us)\n", match.index, (long)match.distance,
+                (unsigned long)stats.lastMicros);
+  if (match.keyword < 0 || match.keyword >= NUM_VOICE_COMMANDS) {
+    return -1;
+  }
+  return match.keyword;
 }
 
-// Handle voice command
-void handleVoiceCommand(String command) {
-  Serial.println("🎤 Voice command recognized: " + command);
-  
-  // Convert to lowercase for matching
-  command.toLowerCase();
-  
-  // Find matching command using enhanced pattern matching
-  for (int i = 0; i < NUM_VOICE_COMMANDS; i++) {
-    bool matched = false;
-    
-    // Check all patterns for this command
-    for (int j = 0; j < voiceCommands[i].patternCount; j++) {
-      if (command.indexOf(voiceCommands[i].patterns[j]) >= 0) {
-        matched = true;
-        break;
-      }
-    }
-    
-    if (matched) {
-      String action = voiceCommands[i].action;
-      String requestId = "voice_" + String(millis());
-      
-      Serial.println("✓ Executing voice command: " + action);
-      
-      if (action == "turn_on") {
-        handleTurnOn(requestId, "voice");
-        playConfirmationSound();
-      } else if (action == "turn_off") {
-        handleTurnOff(requestId, "voice");
-        playConfirmationSound();
-      } else if (action == "get_status") {
-        handleGetStatus(requestId, "voice");
-        playConfirmationSound();
-      }
-      
-      // Publish voice command event to MQTT
-      if (client.connected()) {
-        DynamicJsonDocument doc(512);
-        doc["deviceId"] = deviceId;
-        doc["voiceCommand"] = command;
-        doc["action"] = action;
-        doc["timestamp"] = millis();
-        doc["source"] = "voice";
-        doc["requestId"] = requestId;
-        
-        String message;
-        serializeJson(doc, message);
-        client.publish(audio_topic, message.c_str());
-        Serial.println("📡 Voice command published to MQTT");
-      }
-      
-      return;
-    }
+// Store the captured utterance as a template of the command being enrolled
+void enrollVoiceCommand() {
+  PROFILE_SCOPE("enrollVoiceCommand");
+  uint8_t index = enrollingCommand;
+  enrollingCommand = -1;
+  KeywordTemplate recorded;
+  bool ok = keywordSpotter.utterance(recorded);
+  if (ok) {
+    recorded.keyword = index;
+    ok = keywordTemplates.add(recorded);
+  }
+  uint16_t enrolled = keywordTemplates.countFor(index);
+  Serial.printf("%s Enrollment of \"%s\": %u templates\n", ok ? "✓" : "❌", voiceCommands[index].action,
+                (unsigned)enrolled);
+  if (ok) {
+    playConfirmationSound();
+  } else {
+    playErrorSound();
+  }
+
+  publishDoc.clear();
+  publishDoc["deviceId"] = deviceId;
+  publishDoc["event"] = "voice_enrolled";
+  publishDoc["action"] = voiceCommands[index].action;
+  publishDoc["success"] = ok;
+  publishDoc["templates"] = enrolled;
+  publishDoc["timestamp"] = millis();
+  publishOrQueue(audio_topic, publishDoc, 0, Outbox::PRIORITY_EVENT);
+}
+
+// Run a recognised voice command (voiceCommands[] index) through the registry
+void handleVoiceCommand(uint8_t index) {
+  PROFILE_SCOPE("handleVoiceCommand");
+  const VoiceCommand& command = voiceCommands[index];
+  char requestId[24];
+  snprintf(requestId, sizeof(requestId), "voice_%lu", millis());
+
+  Serial.printf("🎤 Voice command recognized: %s\n", command.patterns[0]);
+  Serial.printf("✓ Executing voice command: %s\n", command.action);
+
+  CommandRequest request = {command.action, requestId, "voice", -1, 0, 0, false};
+  if (commands.dispatch(request)) {
+    playConfirmationSound();
+  }
+
+  // Publish voice command event to MQTT (queued while disconnected)
+  publishDoc.clear();
+  publishDoc["deviceId"] = deviceId;
+  publishDoc["voiceCommand"] = command.patterns[0];
+  publishDoc["action"] = command.action;
+  publishDoc["timestamp"] = millis();
+  publishDoc["source"] = "voice";
+  publishDoc["requestId"] = requestId;
+
+  if (publishOrQueue(audio_topic, publishDoc, 0, Outbox::PRIORITY_EVENT) && client.connected()) {
+    Serial.println("📡 Voice command published to MQTT");
+  }
+}
+
+// Keep what a reply to this command needs from its MQTT 5 properties
+void captureReplyTo(const MqttPublishProperties& properties) {
+  replyTo.active = true;
+  replyTo.topic[0] = '\0';
+  replyTo.correlationLength = 0;
+  if (properties.responseTopic && properties.responseTopicLength < sizeof(replyTo.topic)) {
+    memcpy(replyTo.topic, properties.responseTopic, properties.responseTopicLength);
+    replyTo.topic[properties.responseTopicLength] = '\0';
+  }
+  if (properties.correlationData && properties.correlationDataLength < sizeof(replyTo.correlation)) {
+    memcpy(replyTo.correlation, properties.correlationData, properties.correlationDataLength);
+    replyTo.correlation[properties.correlationDataLength] = '\0';
+    replyTo.correlationLength = properties.correlationDataLength;
   }
-  
-  // Command not recognized
-  Serial.println("❌ Voice command not recognized: " + command);
-  playErrorSound();
 }
 
-// MQTT message callback
+// Commands sent together on batch_topic:
+// {"requestId": "...", "commands": [{"command": "turn_on", "channel": 1}, ...]}
+// A batch larger than the MQTT buffer arrives through PubSubClient's chunk
+// handler; JsonStreamSplitter cuts each command out of the stream and it is
+// parsed and dispatched on its own as soon as it is complete, so a batch of
+// any length needs no more RAM than one command. A small batch takes the same
+// path from the callback. The commands' own responses and status broadcasts
+// are left out: the batch is answered once, then the status is broadcast.
+// A batch cut off by a lost connection is only marked: end(false) runs inside
+// client.connected(), possibly while another message is being built, so the
+// mqtt task sends its answer on its next run.
+class CommandBatch : public MqttChunkHandler {
+public:
+  bool begin(const char* topic, uint32_t length) override;
+  void chunk(const uint8_t* data, size_t size) override;
+  void end(bool complete) override;
+
+  // Answers a batch interrupted since the last call (mqtt task)
+  void answerInterrupted();
+
+  // True while one of its commands is dispatched: responses go to record()
+  bool dispatching() const { return inCommand; }
+  void record(bool success) { commandFailed = commandFailed || !success; }
+
+private:
+  JsonStreamSplitter splitter;
+  ReplyContext reply;       // Of the batch message, restored for its response
+  uint32_t stateBefore;
+  uint16_t run;
+  uint16_t failed;
+  bool inCommand;
+  bool commandFailed;
+  bool interrupted = false;  // Cut off; its response is still owed
+
+  static void runCommand(const char* key, char* element, size_t length, void* context);
+  void respond(const char* requestId, const char* error);
+};
+CommandBatch batch;
+
+bool CommandBatch::begin(const char* topic, uint32_t length) {
+  if (strcmp(topic, batch_topic) != 0 || length > maxBatchBytes) {
+    Serial.printf("⚠️ %u byte message on %s does not fit the buffer - dropped\n", (unsigned)length, topic);
+    return false;
+  }
+  answerInterrupted(); // Its reply context is about to be overwritten
+  Serial.printf("📦 Batch of %u bytes arriving\n", (unsigned)length);
+  captureReplyTo(client.publishProperties());
+  reply = replyTo;
+  replyTo.active = false;
+  splitter.begin(runCommand, this);
+  stateBefore = relays.state();
+  run = 0;
+  failed = 0;
+  inCommand = false;
+  return true;
+}
+
+void CommandBatch::chunk(const uint8_t* data, size_t size) {
+  splitter.write(data, size);
+}
+
+// One element of an array in the batch; only "commands" holds commands
+void CommandBatch::runCommand(const char* key, char* element, size_t length, void* context) {
+  PROFILE_SCOPE("batchCommand");
+  CommandBatch& self = *static_cast<CommandBatch*>(context);
+  if (strcmp(key, "commands") != 0) {
+    return;
+  }
+  self.run++;
+  ParsedCommand parsed;
+  if (parseCommand(reinterpret_cast<byte*>(element), length, parsed)) {
+    self.failed++;
+    return;
+  }
+  CommandRequest request = {parsed.command, parsed.requestId, "batch",
+                            parsed.channel, parsed.onMask, parsed.offMask, parsed.badChannel};
+  self.inCommand = true;
+  self.commandFailed = false;
+  if (!commands.dispatch(request)) {
+    self.commandFailed = true;
+  }
+  self.inCommand = false;
+  if (self.commandFailed) {
+    self.failed++;
+  }
+}
+
+void CommandBatch::end(bool complete) {
+  if (!complete) {
+    Serial.printf("📦 Batch interrupted after %u commands\n", run);
+    interrupted = true;
+    scheduler.runNow(mqttTask);
+    return;
+  }
+  // The skeleton is what is left of the batch without its commands
+  ParsedCommand top = {"", "", -1, 0, 0, false};
+  bool wellFormed = splitter.finish() &&
+                    !parseCommand(reinterpret_cast<byte*>(splitter.skeleton()), splitter.skeletonLength(), top);
+  char error[48] = "";
+  if (!wellFormed) {
+    snprintf(error, sizeof(error), "Malformed batch after %u commands", run);
+  } else if (splitter.oversized() > 0) {
+    snprintf(error, sizeof(error), "%u commands too long", (unsigned)splitter.oversized());
+  } else if (failed > 0) {
+    snprintf(error, sizeof(error), "%u of %u commands failed", failed, run);
+  }
+  Serial.printf("📦 Batch: %u commands run, %u failed%s%s\n", run, failed, error[0] ? " - " : "", error);
+  respond(top.requestId, error);
+}
+
+void CommandBatch::answerInterrupted() {
+  if (!interrupted) {
+    return;
+  }
+  interrupted = false;
+  char error[48];
+  snprintf(error, sizeof(error), "Interrupted after %u commands", run);
+  respond("", error); // The requestId was not reached or cannot be trusted
+}
+
+void CommandBatch::respond(const char* requestId, const char* error) {
+  replyTo = reply;
+  sendCommandResponse("batch", requestId, error[0] == '\0', error, "mqtt");
+  replyTo.active = false;
+  if (relays.state() != stateBefore) {
+    sendStatus(); // One broadcast for the whole batch
+  }
+}
+
+// MQTT message callback: the router hands it to the handler of each
+// matching filter
 void callback(char* topic, byte* payload, unsigned int length) {
+  PROFILE_SCOPE("callback");
   Serial.print("📨 MQTT message arrived [");
   Serial.print(topic);
   Serial.print("] ");
   
-  String message;
-  for (int i = 0; i < length; i++) {
-    message += (char)payload[i];
+  Serial.write(payload, length);
+  Serial.println();
+
+  if (router.dispatch(topic, payload, length) == 0) {
+    Serial.printf("⚠️ No handler for %s\n", topic);
   }
-  Serial.println(message);
+}
 
-  // Parse JSON command
-  DynamicJsonDocument doc(512);
-  DeserializationError error = deserializeJson(doc, message);
+// A batch small enough for the buffer takes the chunked path in one piece
+void handleBatchMessage(char* topic, byte* payload, unsigned int length) {
+  if (batch.begin(topic, length)) {
+    batch.chunk(payload, length);
+    batch.end(true);
+  }
+}
+
+// One command, on the device's own topic, the broadcast or a group topic
+void handleCommandMessage(char* topic, byte* payload, unsigned int length) {
+  (void)topic;
+  // Parse in place: command/requestId point into the PubSubClient buffer
+  ParsedCommand parsed;
+  DeserializationError error = parseCommand(payload, length, parsed);
   
   if (error) {
     Serial.print("❌ Failed to parse JSON: ");
@@ -550,206 +785,538 @@ void callback(char* topic, byte* payload, unsigned int length) {
     return;
   }
 
-  String command = doc["command"];
-  String requestId = doc["requestId"];
+  Serial.print("📱 Processing MQTT command: ");
+  Serial.println(parsed.command);
 
-  Serial.println("📱 Processing MQTT command: " + command);
-
-  if (command == "turn_on") {
-    handleTurnOn(requestId, "mqtt");
-  } else if (command == "turn_off") {
-    handleTurnOff(requestId, "mqtt");
-  } else if (command == "get_status") {
-    handleGetStatus(requestId, "mqtt");
-  } else if (command == "enable_voice") {
-    voiceDetectionEnabled = true;
-    sendCommandResponse("enable_voice", requestId, true, "", "mqtt");
-    playConfirmationSound();
-    Serial.println("🎤 Voice detection enabled via MQTT");
-  } else if (command == "disable_voice") {
-    voiceDetectionEnabled = false;
-    sendCommandResponse("disable_voice", requestId, true, "", "mqtt");
-    playConfirmationSound();
-    Serial.println("🔇 Voice detection disabled via MQTT");
-  } else {
-    Serial.println("❌ Unknown MQTT command: " + command);
-    sendCommandResponse(command, requestId, false, "Unknown command", "mqtt");
+  captureReplyTo(client.publishProperties());
+  CommandRequest request = {parsed.command, parsed.requestId, "mqtt",
+                            parsed.channel, parsed.onMask, parsed.offMask, parsed.badChannel};
+  if (!commands.dispatch(request)) {
+    Serial.print("❌ Unknown MQTT command: ");
+    Serial.println(parsed.command);
+    sendCommandResponse(parsed.command, parsed.requestId, false, "Unknown command", "mqtt");
     playErrorSound();
   }
+  replyTo.active = false;
 }
 
-// Reconnect to MQTT broker
-void reconnect() {
-  // Loop until we're reconnected
-  while (!client.connected()) {
-    Serial.print("Attempting MQTT connection...");
-    
-    // Create a random client ID
-    String clientId = "ESP32Client-";
-    clientId += String(random(0xffff), HEX);
-    
-    // Attempt to connect
-    if (client.connect(clientId.c_str())) {
-      Serial.println("connected");
-      
-      // Subscribe to command topic
-      client.subscribe(command_topic);
-      Serial.print("Subscribed to: ");
-      Serial.println(command_topic);
-      
-      // Send device registration message
-      sendRegistration();
-      
-    } else {
-      Serial.print("failed, rc=");
-      Serial.print(client.state());
-      Serial.println(" try again in 5 seconds");
-      delay(5000);
+// Keep the MQTT session alive and process incoming packets (runs on socket data and every second)
+void serviceMqtt() {
+  PROFILE_SCOPE("serviceMqtt");
+  batch.answerInterrupted();
+  if (mqttConnection.poll()) {
+    client.loop();
+    return;
+  }
+
+  // Still connecting: come back for the next step, or when the backoff expires
+  uint32_t wait = mqttConnection.nextPollMs();
+  if (wait < mqttKeepaliveInterval) {
+    scheduler.runAfter(mqttTask, wait);
+  }
+}
+
+// Send periodic heartbeat (scheduler task); while disconnected fewer are queued
+void heartbeatTask() {
+  if (client.connected() || millis() - lastHeartbeat >= offlineHeartbeatInterval) {
+    sendHeartbeat();
+    lastHeartbeat = millis();
+  }
+}
+
+// Local IP as a dotted quad, without going through a heap String
+void formatLocalIP(char* out, size_t size) {
+  IPAddress ip = WiFi.localIP();
+  snprintf(out, size, "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+}
+
+// Stream a JSON document straight into the MQTT socket. The payload never
+// passes through a String or the PubSubClient buffer, so its size is not
+// limited by the buffer and nothing is allocated. A QoS 1 publish is kept
+// by the client until the broker acknowledges it; when its in-flight window
+// or store is full the document goes out at QoS 0 instead. `properties`
+// only apply under MQTT 5.
+bool publishJson(const char* topic, const JsonDocument& doc, uint8_t qos, const MqttPublishProperties* properties) {
+  PROFILE_SCOPE("publishJson");
+  if (doc.overflowed()) {
+    Serial.printf("⚠️ JSON for %s did not fit the document - fields dropped\n", topic);
+  }
+  size_t length = measureJson(doc);
+  bool started = client.beginPublish(topic, length, false, qos, properties);
+  if (!started && qos > 0 && client.connected()) {
+    Serial.printf("⚠️ %u publishes awaiting PUBACK - sending to %s at QoS 0\n", client.inflight(), topic);
+    started = client.beginPublish(topic, length, false, 0, properties);
+  }
+  if (!started) {
+    return false;
+  }
+  size_t written = serializeJson(doc, client);
+  return client.endPublish() && written == length;
+}
+
+// Publish now, or keep the message in the outbox until the next session.
+// The outbox keeps no MQTT 5 properties: a queued reply carries its
+// correlation data as the JSON requestId instead.
+bool publishOrQueue(const char* topic, JsonDocument& doc, uint8_t qos, Outbox::Priority priority,
+                    const MqttPublishProperties* properties) {
+  if (client.connected()) {
+    if (publishJson(topic, doc, qos, properties)) {
+      return true;
     }
+    if (client.connected()) {
+      return false;
+    }
+  }
+  if (properties && properties->correlationData) {
+    doc["requestId"] = replyTo.correlation;
+  }
+  if (!outbox.enqueue(topic, doc, priority)) {
+    Serial.printf("❌ Outbox full - message to %s dropped\n", topic);
+    return false;
   }
+  Serial.printf("📦 Queued for %s (%u waiting)\n", topic, outbox.depth());
+  uint32_t wait = outbox.nextFlushMs();
+  if (wait != UINT32_MAX) {
+    scheduler.runAfter(outboxTask, wait);
+  }
+  return true;
 }
 
 // Send device registration to MQTT
 void sendRegistration() {
-  DynamicJsonDocument doc(512);
-  doc["deviceId"] = deviceId;
-  doc["name"] = deviceName;
-  doc["ip"] = WiFi.localIP().toString();
-  doc["status"] = lightState;
-  doc["timestamp"] = millis();
-  doc["type"] = "registration";
-  doc["capabilities"] = JsonArray();
-  doc["capabilities"].add("relay_control");
-  doc["capabilities"].add("voice_commands");
-  doc["capabilities"].add("audio_feedback");
-  
-  String message;
-  serializeJson(doc, message);
+  PROFILE_SCOPE("sendRegistration");
+  char ip[16];
+  formatLocalIP(ip, sizeof(ip));
+
+  publishDoc.clear();
+  publishDoc["deviceId"] = deviceId;
+  publishDoc["name"] = deviceName;
+  publishDoc["ip"] = ip;
+  publishDoc["status"] = relays.isOn(0) ? "on" : "off";
+  publishDoc["state"] = relays.state();
+  publishDoc["channels"] = relays.count();
+  publishDoc["timestamp"] = millis();
+  publishDoc["type"] = "registration";
+  JsonArray capabilities = publishDoc.createNestedArray("capabilities");
+  capabilities.add("relay_control");
+  capabilities.add("multi_channel");
+  capabilities.add("voice_commands");
+  capabilities.add("audio_feedback");
   
-  client.publish(heartbeat_topic, message.c_str());
+  publishJson(heartbeat_topic, publishDoc);
   Serial.println("Registration sent via MQTT");
 }
 
 // Send heartbeat via MQTT
 void sendHeartbeat() {
-  if (!client.connected()) {
-    return;
-  }
-  
-  DynamicJsonDocument doc(512);
+  PROFILE_SCOPE("sendHeartbeat");
+  char ip[16];
+  formatLocalIP(ip, sizeof(ip));
+
+  JsonDocument& doc = publishDoc;
+  doc.clear();
   doc["deviceId"] = deviceId;
   doc["name"] = deviceName;
-  doc["ip"] = WiFi.localIP().toString();
-  doc["status"] = lightState;
+  doc["ip"] = ip;
+  doc["status"] = relays.isOn(0) ? "on" : "off";
+  doc["state"] = relays.state();
+  doc["channels"] = relays.count();
   doc["timestamp"] = millis();
   doc["type"] = "heartbeat";
   doc["relay_pin"] = LIGHT_RELAY_PIN;
+  JsonArray pins = doc.createNestedArray("relay_pins");
+  for (uint8_t i = 0; i < relays.count(); i++) {
+    pins.add(relays.pin(i));
+  }
   doc["voice_enabled"] = voiceDetectionEnabled;
   doc["audio_pins"]["microphone"]["ws"] = I2S_WS;
   doc["audio_pins"]["microphone"]["sck"] = I2S_SCK;
   doc["audio_pins"]["microphone"]["sd"] = I2S_SD;
   doc["audio_pins"]["output"] = AUDIO_OUTPUT_PIN;
+  // Microphone capture: frames lost in DMA or to a full ring, and how long
+  // frames wait for the analysis
+  const AudioCaptureStats& captureStats = audioCapture.stats();
+  JsonObject capture = doc.createNestedObject("audio_capture");
+  capture["frames"] = captureStats.frames;
+  capture["dma_overruns"] = captureStats.dmaOverruns;
+  capture["ring_overruns"] = captureStats.ringOverruns;
+  capture["max_depth"] = captureStats.maxDepth;
+  capture["latency_us"] = captureStats.analysed ? (uint32_t)(captureStats.totalLatencyMicros / captureStats.analysed) : 0;
+  capture["max_latency_us"] = captureStats.maxLatencyMicros;
+  // Keyword spotting: templates enrolled, utterances matched and the
+  // slowest match
+  const KeywordSpotterStats& spotterStats = keywordSpotter.stats();
+  JsonObject keywords = doc.createNestedObject("keywords");
+  keywords["templates"] = keywordTemplates.count();
+  keywords["utterances"] = spotterStats.utterances;
+  keywords["accepted"] = spotterStats.accepted;
+  keywords["max_match_us"] = spotterStats.maxMicros;
+  // MFCC front-end: cycles per 10 ms frame and the share of one core it
+  // takes in hundredths of a percent
+  const MfccFrontEndStats& featureStats = mfccFrontEnd.stats();
+  JsonObject features = doc.createNestedObject("features");
+  features["frames"] = featureStats.frames;
+  features["cycles"] = featureStats.frames ? (uint32_t)(featureStats.cycles / featureStats.frames) : 0;
+  features["max_cycles"] = featureStats.maxCycles;
+  features["load"] = mfccFrontEnd.load(ESP.getCpuFreqMHz());
+  // WiFi stats; histograms are counts per bucket (<100, <250, <500, <1000, <2000, <5000, <10000, >=10000 ms)
+  const WiFiSupervisorStats& wifiStats = wifiSupervisor.stats();
+  JsonObject wifi = doc.createNestedObject("wifi");
+  wifi["rssi"] = WiFi.RSSI();
+  wifi["attempts"] = wifiStats.attempts;
+  wifi["fast"] = wifiStats.fastAttempts;
+  wifi["failures"] = wifiStats.failures;
+  wifi["disconnects"] = wifiStats.disconnects;
+  wifi["last_reason"] = wifiStats.lastReason;
+  JsonArray associateMs = wifi.createNestedArray("associate_ms");
+  JsonArray ipMs = wifi.createNestedArray("ip_ms");
+  for (uint8_t i = 0; i < DurationHistogram::BUCKETS; i++) {
+    associateMs.add(wifiStats.associate.counts[i]);
+    ipMs.add(wifiStats.gotIp.counts[i]);
+  }
+
+  // State journal: records vs flash commits shows the coalescing
+  const StateJournalStats& journalStats = stateJournal.stats();
+  JsonObject journal = doc.createNestedObject("journal");
+  journal["records"] = journalStats.records;
+  journal["commits"] = journalStats.commits;
+  journal["erases"] = journalStats.erases;
+  journal["sector_wear"] = stateJournal.sectorWear();
+  journal["commit_us"] = journalStats.lastCommitUs;
+  journal["max_commit_us"] = journalStats.maxCommitUs;
+  journal["replay_us"] = journalStats.replayUs;
+  journal["failures"] = journalStats.failures;
+
+  // Connection stats
+  const MqttConnectionStats& mqttStats = mqttConnection.stats();
+  JsonObject mqtt = doc.createNestedObject("mqtt");
+  mqtt["attempts"] = mqttStats.attempts;
+  mqtt["failures"] = mqttStats.failures;
+  mqtt["sessions"] = mqttStats.sessions;
+  mqtt["reconnect_ms"] = mqttStats.lastReconnectMs;
+  mqtt["max_reconnect_ms"] = mqttStats.maxReconnectMs;
+  mqtt["last_error"] = mqttStats.lastError;
+  mqtt["dns_us"] = mqttStats.resolveUs;
+  mqtt["tcp_us"] = mqttStats.tcpConnectUs;
+  mqtt["connack_us"] = mqttStats.connackUs;
+  // QoS 1 responses: awaiting PUBACK now, and resent after reconnects
+  const PubSubClientStats& clientStats = client.getStats();
+  mqtt["inflight"] = client.inflight();
+  mqtt["pubacks"] = clientStats.pubacks;
+  mqtt["retransmits"] = clientStats.retransmits;
+  mqtt["inflight_dropped"] = clientStats.inflightDropped;
+  mqtt["protocol"] = client.protocolVersion();
+  mqtt["aliased"] = clientStats.aliasedPublishes;
+  // Inbound messages per route, and those no route took
+  JsonObject routed = mqtt.createNestedObject("routes");
+  for (uint8_t i = 0; i < router.count(); i++) {
+    routed[router.name(i)] = router.dispatches(i);
+  }
+  mqtt["unrouted"] = router.stats().unmatched;
+
+  // Outbox: messages waiting for a session, and the last drain
+  const OutboxStats& outboxStats = outbox.stats();
+  JsonObject queue = doc.createNestedObject("outbox");
+  queue["depth"] = outbox.depth();
+  queue["max_depth"] = outboxStats.maxDepth;
+  queue["queued"] = outboxStats.queued;
+  queue["sent"] = outboxStats.sent;
+  queue["dropped"] = outboxStats.dropped;
+  queue["drain_records"] = outboxStats.lastDrainRecords;
+  queue["drain_ms"] = outboxStats.lastDrainMs;
+
+  // Scheduler stats: per task [runs, avg us, max us, max late us]
+  doc["idle_ms"] = (uint32_t)(scheduler.idleMicros() / 1000);
+  JsonObject tasks = doc.createNestedObject("tasks");
+  for (uint8_t id = 0; id < scheduler.taskCount(); id++) {
+    const TaskStats& stats = scheduler.taskStats(id);
+    JsonArray task = tasks.createNestedArray(stats.name);
+    task.add(stats.runs);
+    task.add(stats.runs ? (uint32_t)(stats.totalMicros / stats.runs) : 0);
+    task.add(stats.maxMicros);
+    task.add(stats.maxLatenessMicros);
+  }
   
-  String message;
-  serializeJson(doc, message);
-  
-  if (client.publish(heartbeat_topic, message.c_str())) {
-    Serial.println("Heartbeat sent via MQTT");
-  } else {
+  if (!publishOrQueue(heartbeat_topic, doc, 0, Outbox::PRIORITY_TELEMETRY)) {
     Serial.println("Failed to send heartbeat");
+  } else if (client.connected()) {
+    Serial.println("Heartbeat sent via MQTT");
   }
 }
 
-// Send status via MQTT
-void sendStatus(String requestId = "") {
-  DynamicJsonDocument doc(512);
-  doc["deviceId"] = deviceId;
-  doc["status"] = lightState;
-  doc["relay_pin"] = LIGHT_RELAY_PIN;
-  doc["ip_address"] = WiFi.localIP().toString();
-  doc["timestamp"] = millis();
-  doc["type"] = "status";
-  doc["voice_enabled"] = voiceDetectionEnabled;
-  
-  if (requestId != "") {
-    doc["requestId"] = requestId;
+// MQTT 5 properties of a reply to the command being handled, nullptr under
+// 3.1.1. Responses expire; a command with a Response Topic is answered
+// there (`topic` is changed) and one with Correlation Data gets it back.
+const MqttPublishProperties* replyProperties(const char*& topic, MqttPublishProperties& properties) {
+  if (client.protocolVersion() != MQTT_VERSION_5) {
+    return nullptr;
   }
+  memset(&properties, 0, sizeof(properties));
+  properties.messageExpiry = responseExpirySeconds;
+  if (replyTo.active && replyTo.topic[0] != '\0') {
+    topic = replyTo.topic;
+  }
+  if (replyTo.active && replyTo.correlationLength > 0) {
+    properties.correlationData = reinterpret_cast<const uint8_t*>(replyTo.correlation);
+    properties.correlationDataLength = replyTo.correlationLength;
+  }
+  return &properties;
+}
+
+// Send status via MQTT: a broadcast, or with `reply` the answer to a get_status
+void sendStatus(const char* requestId, bool reply) {
+  PROFILE_SCOPE("sendStatus");
+  if (batch.dispatching()) {
+    return;
+  }
+  char ip[16];
+  formatLocalIP(ip, sizeof(ip));
+  const char* topic = reply ? response_topic : status_topic;
+  MqttPublishProperties storage;
+  const MqttPublishProperties* properties = reply ? replyProperties(topic, storage) : nullptr;
+
+  publishDoc.clear();
+  publishDoc["deviceId"] = deviceId;
+  publishDoc["status"] = relays.isOn(0) ? "on" : "off";
+  publishDoc["state"] = relays.state();
+  publishDoc["channels"] = relays.count();
+  publishDoc["relay_pin"] = LIGHT_RELAY_PIN;
+  publishDoc["ip_address"] = ip;
+  publishDoc["timestamp"] = millis();
+  publishDoc["type"] = "status";
+  publishDoc["voice_enabled"] = voiceDetectionEnabled;
   
-  String message;
-  serializeJson(doc, message);
-  
-  const char* topic = (requestId != "") ? response_topic : status_topic;
+  if (reply && !(properties && properties->correlationData)) {
+    publishDoc["requestId"] = requestId;
+  }
   
-  if (client.publish(topic, message.c_str())) {
-    Serial.println("Status sent via MQTT to " + String(topic));
-  } else {
+  if (!publishOrQueue(topic, publishDoc, reply ? 1 : 0, Outbox::PRIORITY_EVENT, properties)) {
     Serial.println("Failed to send status");
+  } else if (client.connected()) {
+    Serial.print("Status sent via MQTT to ");
+    Serial.println(topic);
   }
 }
 
 // Send command response via MQTT
-void sendCommandResponse(String command, String requestId, bool success, String error, String source) {
-  if (!client.connected()) return;
-  
-  DynamicJsonDocument doc(512);
-  doc["deviceId"] = deviceId;
-  doc["command"] = command;
-  doc["requestId"] = requestId;
-  doc["success"] = success;
-  doc["status"] = lightState;
-  doc["timestamp"] = millis();
-  doc["source"] = source;
-  
-  if (error != "") {
-    doc["error"] = error;
+void sendCommandResponse(const char* command, const char* requestId, bool success, const char* error, const char* source) {
+  PROFILE_SCOPE("sendCommandResponse");
+  if (batch.dispatching()) {
+    batch.record(success);
+    return;
+  }
+  const char* topic = response_topic;
+  MqttPublishProperties storage;
+  const MqttPublishProperties* properties = replyProperties(topic, storage);
+
+  publishDoc.clear();
+  publishDoc["deviceId"] = deviceId;
+  publishDoc["command"] = command;
+  if (!(properties && properties->correlationData)) {
+    publishDoc["requestId"] = requestId;
   }
+  publishDoc["success"] = success;
+  publishDoc["status"] = relays.isOn(0) ? "on" : "off";
+  publishDoc["state"] = relays.state();
+  publishDoc["timestamp"] = millis();
+  publishDoc["source"] = source;
   
-  String message;
-  serializeJson(doc, message);
+  if (error[0] != '\0') {
+    publishDoc["error"] = error;
+  }
   
-  if (client.publish(response_topic, message.c_str())) {
-    Serial.println("📡 Command response sent via MQTT (" + source + ")");
-  } else {
+  if (!publishOrQueue(topic, publishDoc, 1, Outbox::PRIORITY_EVENT, properties)) {
     Serial.println("❌ Failed to send command response");
+  } else if (client.connected()) {
+    Serial.printf("📡 Command response sent via MQTT (%s)\n", source);
   }
 }
 
-// Handle turn on command
-void handleTurnOn(String requestId, String source) {
-  Serial.println("💡 Command: Light turning ON (" + source + ")");
-  lightState = "on";
-  digitalWrite(LIGHT_RELAY_PIN, HIGH);  // HIGH turns relay ON
-  
-  if (saveState) {
-    EEPROM.write(0, 1);
-    EEPROM.commit();
+// Persist the relay bitmask; the flash write is deferred and coalesced
+void saveRelayState() {
+  if (!saveState) {
+    return;
+  }
+  if (!stateJournal.ready()) {
+    saveLegacyRelayState(relays.state());
+    return;
   }
+  stateJournal.record(relays.state());
+  scheduler.runAfter(journalTask, stateJournal.nextCommitMs());
+}
+
+// Write the pending relay state once it has settled (scheduler task)
+void commitStateTask() {
+  stateJournal.poll();
+  uint32_t wait = stateJournal.nextCommitMs();
+  if (wait != UINT32_MAX) {
+    scheduler.runAfter(journalTask, wait);
+  }
+}
+
+// Send queued messages one per drain interval while connected, and write
+// the outbox cache to flash when it is due (scheduler task)
+void drainOutboxTask() {
+  outbox.poll();
+  uint32_t wait = outbox.nextFlushMs();
+  if (client.connected() && outbox.depth() > 0) {
+    outbox.sendNext(client);
+    if (outbox.depth() > 0 && outbox.drainIntervalMs() < wait) {
+      wait = outbox.drainIntervalMs();
+    }
+  }
+  if (wait != UINT32_MAX) {
+    scheduler.runAfter(outboxTask, wait);
+  }
+}
+
+// New MQTT session: register, then start sending what was queued offline
+void handleSessionStart() {
+  sendRegistration();
+  scheduler.runNow(outboxTask);
+}
+
+// Relay state saved in EEPROM by firmware before the journal: low byte
+// first, byte 0 alone was the single-relay format (1 = on)
+uint32_t loadLegacyRelayState() {
+  if (!EEPROM.begin(legacyEepromSize)) {
+    return 0;
+  }
+  uint32_t state = EEPROM.read(0) | (EEPROM.read(1) << 8);
+  EEPROM.end();
+  return state == 0xFFFF ? 0 : state;  // Erased flash: nothing saved
+}
+
+// Without the relaylog partition the state goes to EEPROM as it used to,
+// one commit per change (channels above 16 are not kept)
+void saveLegacyRelayState(uint32_t state) {
+  if (!EEPROM.begin(legacyEepromSize)) {
+    return;
+  }
+  EEPROM.write(0, state & 0xFF);
+  EEPROM.write(1, (state >> 8) & 0xFF);
+  EEPROM.commit();
+  EEPROM.end();
+}
+
+// Switch one channel (channel 0 when the command does not name one)
+void switchRelay(const char* command, const CommandRequest& request, bool on) {
+  if (request.badChannel || request.channel >= relays.count()) {
+    Serial.printf("❌ %s: invalid channel (%s)\n", command, request.source);
+    sendCommandResponse(command, request.requestId, false, "Invalid channel", request.source);
+    playErrorSound();
+    return;
+  }
+  uint8_t channel = request.channel < 0 ? 0 : request.channel;
+
+  Serial.printf("💡 Command: Relay %u turning %s (%s)\n", channel, on ? "ON" : "OFF", request.source);
+  relays.set(channel, on);  // HIGH turns relay ON
+  saveRelayState();
   
-  sendCommandResponse("turn_on", requestId, true, "", source);
-  sendStatus(""); // Also broadcast status update
-  Serial.println("✅ Light turned ON via " + source);
+  sendCommandResponse(command, request.requestId, true, "", request.source);
+  sendStatus(); // Also broadcast status update
+  Serial.printf("✅ Relay %u turned %s via %s\n", channel, on ? "ON" : "OFF", request.source);
+}
+
+// Handle turn on command
+void handleTurnOn(const CommandRequest& request) {
+  PROFILE_SCOPE("handleTurnOn");
+  switchRelay("turn_on", request, true);
 }
 
 // Handle turn off command
-void handleTurnOff(String requestId, String source) {
-  Serial.println("💡 Command: Light turning OFF (" + source + ")");
-  lightState = "off";
-  digitalWrite(LIGHT_RELAY_PIN, LOW); // LOW turns relay OFF
-  
-  if (saveState) {
-    EEPROM.write(0, 0);
-    EEPROM.commit();
+void handleTurnOff(const CommandRequest& request) {
+  PROFILE_SCOPE("handleTurnOff");
+  switchRelay("turn_off", request, false);
+}
+
+// Handle set channels command: {"on": [..], "off": [..]} switched in one GPIO update
+void handleSetChannels(const CommandRequest& request) {
+  PROFILE_SCOPE("handleSetChannels");
+  uint32_t listed = request.onMask | request.offMask;
+  const char* error = "";
+  if (request.badChannel || (listed & ~relays.allMask()) != 0) {
+    error = "Invalid channel";
+  } else if ((request.onMask & request.offMask) != 0) {
+    error = "Channel listed in both on and off";
+  } else if (listed == 0) {
+    error = "No channels given";
+  }
+  if (error[0] != '\0') {
+    Serial.printf("❌ set_channels: %s (%s)\n", error, request.source);
+    sendCommandResponse("set_channels", request.requestId, false, error, request.source);
+    playErrorSound();
+    return;
+  }
+
+  uint32_t changed = relays.apply(listed, request.onMask);
+  if (changed != 0) {
+    saveRelayState();
   }
   
-  sendCommandResponse("turn_off", requestId, true, "", source);
-  sendStatus(""); // Also broadcast status update
-  Serial.println("✅ Light turned OFF via " + source);
+  sendCommandResponse("set_channels", request.requestId, true, "", request.source);
+  sendStatus(); // Also broadcast status update
+  Serial.printf("✅ Relays set to 0x%04lx (%d changed) via %s\n",
+                (unsigned long)relays.state(), __builtin_popcount(changed), request.source);
 }
 
 // Handle get status command
-void handleGetStatus(String requestId, String source) {
-  Serial.println("ℹ️ Command: Get status (" + source + ")");
-  sendStatus(requestId);
+void handleGetStatus(const CommandRequest& request) {
+  PROFILE_SCOPE("handleGetStatus");
+  Serial.printf("ℹ️ Command: Get status (%s)\n", request.source);
+  // Over MQTT 5 a command may be correlated without a requestId
+  sendStatus(request.requestId, request.requestId[0] != '\0' || replyTo.active);
+}
+
+// Handle enable voice command
+void handleEnableVoice(const CommandRequest& request) {
+  voiceDetectionEnabled = true;
+  sendCommandResponse("enable_voice", request.requestId, true, "", request.source);
+  playConfirmationSound();
+  Serial.println("🎤 Voice detection enabled via MQTT");
+}
+
+// Handle enroll_<action>: the next utterance becomes a template of <action>
+void handleEnrollVoice(const CommandRequest& request) {
+  const char* action = request.command + strlen("enroll_");
+  int8_t index = -1;
+  for (int i = 0; i < NUM_VOICE_COMMANDS; i++) {
+    if (strcmp(voiceCommands[i].action, action) == 0) {
+      index = i;
+    }
+  }
+  const char* error = "";
+  if (!voiceDetectionEnabled) {
+    error = "Voice detection is disabled";
+  } else if (!keywordTemplates.ready() || keywordTemplates.count() >= keywordTemplates.capacity()) {
+    error = "No room for voice templates";
+  } else if (index < 0) {
+    error = "Unknown voice command";
+  }
+  if (error[0] != '\0') {
+    sendCommandResponse(request.command, request.requestId, false, error, request.source);
+    playErrorSound();
+    return;
+  }
+  enrollingCommand = index;
+  sendCommandResponse(request.command, request.requestId, true, "", request.source);
+  Serial.printf("🎤 Say \"%s\" to enroll it\n", voiceCommands[index].patterns[0]);
+}
+
+// Handle clear voice templates command
+void handleClearVoice(const CommandRequest& request) {
+  bool ok = keywordTemplates.clear();
+  enrollingCommand = -1;
+  sendCommandResponse("clear_voice_templates", request.requestId, ok, ok ? "" : "Flash erase failed", request.source);
+  Serial.println("🗑️ Voice templates cleared");
+}
+
+// Handle disable voice command
+void handleDisableVoice(const CommandRequest& request) {
+  voiceDetectionEnabled = false;
+  sendCommandResponse("disable_voice", request.requestId, true, "", request.source);
+  playConfirmationSound();
+  Serial.println("🔇 Voice detection disabled via MQTT");
 }
 
 void setup() {
@@ -758,41 +1325,58 @@ void setup() {
   
   Serial.println("🚀 ESP32 Audio-Enabled Light Controller Starting...");
   
-  // Initialize EEPROM
+  // Replay the saved relay state from the journal
+  uint32_t initialState = 0;
   if (saveState) {
-    EEPROM.begin(eepromSize);
+    if (!stateJournal.begin(stateJournalPartition)) {
+      // Flashed over the air onto the old partition table
+      initialState = loadLegacyRelayState();
+      Serial.println("⚠️ No relaylog partition - relay state kept in EEPROM (flash partitions.csv over serial)");
+    } else if (stateJournal.hasState()) {
+      initialState = stateJournal.state();
+    } else {
+      initialState = loadLegacyRelayState();
+      stateJournal.record(initialState);
+      stateJournal.flush();
+    }
+    Serial.printf("💾 State journal replayed in %u us\n", (unsigned)stateJournal.stats().replayUs);
   }
 
-  // Initialize the GPIO pin for the light relay as output
-  pinMode(LIGHT_RELAY_PIN, OUTPUT);
-  
-  // Load saved state from EEPROM
-  if (saveState) {
-    lightState = EEPROM.read(0) == 1 ? "on" : "off";
+  // Enrolled voice command templates, matched straight from flash
+  if (!keywordTemplates.begin(keywordPartition)) {
+    Serial.println("⚠️ No keywords partition - voice commands cannot be enrolled (flash partitions.csv over serial)");
+  } else {
+    Serial.printf("🎤 %u voice templates enrolled\n", keywordTemplates.count());
   }
 
-  // Set initial relay state
-  digitalWrite(LIGHT_RELAY_PIN, lightState == "on" ? HIGH : LOW);
-  
-  Serial.println("💡 Light initial state: " + lightState);
+  // Messages queued before a reboot are still waiting to be sent
+  if (!outbox.begin(outboxPartition)) {
+    Serial.println("⚠️ No outbox partition - messages are dropped while offline (flash partitions.csv over serial)");
+  } else {
+    outbox.setDrainRate(outboxDrainRate);
+    Serial.printf("📦 Outbox: %u queued, replayed in %u us\n", outbox.depth(), (unsigned)outbox.stats().replayUs);
+  }
 
-  // Connect to Wi-Fi
-  setup_wifi();
-  
-  // Setup OTA (Over-The-Air) programming
-  if (WiFi.status() == WL_CONNECTED) {
-    setupOTA();
+  // Configure the relay outputs and set their initial state
+  if (!relays.begin(relayPins, relayCount, initialState)) {
+    Serial.println("❌ Invalid RELAY_PINS - relays disabled");
   }
   
+  Serial.printf("💡 Relay initial state: 0x%04lx (%u channels)\n",
+                (unsigned long)relays.state(), relays.count());
+
+  // Connect to Wi-Fi in the background; OTA starts once an IP is obtained
+  Serial.println();
+  wifiSupervisor.onConnected(handleWiFiConnected);
+  wifiSupervisor.begin(ssid, password);
+  
   // Setup Audio System
   Serial.println("🔊 Initializing audio system...");
   setupI2S();
   setupAudioOutput();
   
   // Initialize audio history arrays
-  for (int i = 0; i < 10; i++) {
-    voiceEnergyHistory[i] = 0;
-  }
+  voiceDetector.reset();
   for (int i = 0; i < 32; i++) {
     audioHistory[i] = 0;
   }
@@ -801,6 +1385,26 @@ void setup() {
   Serial.println("📡 Initializing MQTT...");
   client.setServer(mqtt_server, mqtt_port);
   client.setCallback(callback);
+  client.setBufferSize(mqttBufferSize);
+  client.setProtocolVersion(mqttProtocolVersion);
+  client.setChunkHandler(&batch);
+  mqttConnection.begin(mqtt_server, mqtt_port, "ESP32Client-");
+  for (const TopicRoute& route : topicRoutes) {
+    if (router.add(route.filter, route.handler, route.name) < 0 || !mqttConnection.addSubscription(route.filter)) {
+      Serial.printf("❌ Cannot subscribe to %s\n", route.filter);
+    }
+  }
+  mqttConnection.onSessionStart(handleSessionStart);
+
+  // Setup task scheduler: MQTT is serviced as soon as the socket has data
+  scheduler.begin(espClient);
+  mqttTask = scheduler.addTask("mqtt", mqttKeepaliveInterval, serviceMqtt, Scheduler::EVENT_SOCKET);
+  scheduler.addTask("heartbeat", heartbeatInterval, heartbeatTask);
+  scheduler.addTask("wifi", wifiCheckInterval, wifiTask, Scheduler::EVENT_WIFI);
+  scheduler.addTask("audio", audioCheckInterval, processAudioInput, Scheduler::EVENT_AUDIO);
+  scheduler.addTask("ota", otaCheckInterval, handleOTA);
+  journalTask = scheduler.addTask("journal", 0, commitStateTask);
+  outboxTask = scheduler.addTask("outbox", 0, drainOutboxTask);
   
   // Play startup sound
   delay(500);
@@ -810,55 +1414,34 @@ void setup() {
   Serial.println("📋 Configuration:");
   Serial.println("  Device ID: " + String(deviceId));
   Serial.println("  Device Name: " + String(deviceName));
-  Serial.println("  Relay Pin: GPIO " + String(LIGHT_RELAY_PIN));
+  Serial.print("  Relay Pins: GPIO");
+  for (uint8_t i = 0; i < relays.count(); i++) {
+    Serial.print(i == 0 ? " " : ", ");
+    Serial.print(relays.pin(i));
+  }
+  Serial.println();
   Serial.println("  Voice Detection: " + String(voiceDetectionEnabled ? "Enabled" : "Disabled"));
   Serial.println("  Sample Rate: " + String(SAMPLE_RATE) + " Hz");
   Serial.println("  Detection Threshold: " + String(DETECTION_THRESHOLD));
   Serial.println("📡 MQTT Topics:");
-  Serial.println("  📥 Subscribe: " + String(command_topic));
+  for (uint8_t i = 0; i < router.count(); i++) {
+    Serial.println("  📥 Subscribe: " + String(router.filter(i)));
+  }
   Serial.println("  📤 Status: " + String(status_topic));
   Serial.println("  💓 Heartbeat: " + String(heartbeat_topic));
   Serial.println("  📨 Responses: " + String(response_topic));
   Serial.println("  🎤 Audio Events: " + String(audio_topic));
   Serial.println("🎯 Ready for MQTT and voice commands!");
+
+  // Connect to the broker on the first tick
+  scheduler.runNow(mqttTask);
 }
 
 void loop() {
-  unsigned long now = millis();
-  
-  // Handle OTA updates
-  ArduinoOTA.handle();
-  
-  // Check WiFi connection periodically
-  if (now - lastWiFiCheck > wifiCheckInterval) {
-    checkWiFiConnection();
-    lastWiFiCheck = now;
-  }
-  
-  // Ensure MQTT connection
-  if (!client.connected()) {
-    if (now - lastReconnect > reconnectInterval) {
-      lastReconnect = now;
-      reconnect();
-    }
-  } else {
-    client.loop();
-    
-    // Send periodic heartbeat
-    if (now - lastHeartbeat > heartbeatInterval) {
-      sendHeartbeat();
-      lastHeartbeat = now;
-    }
-  }
-  
-  // Process audio input for voice commands (high frequency for responsiveness)
-  if (now - lastAudioCheck > audioCheckInterval) {
-    processAudioInput();
-    lastAudioCheck = now;
-  }
-  
-  // Small delay to prevent overwhelming the CPU but maintain responsiveness
-  delay(20);
+  // Sleep until the next task deadline or socket/event wake-up, then run due
+  // tasks. What they send over MQTT in this round (a response and the status
+  // broadcast after it, registration after the subscribe) leaves together
+  client.cork();
+  scheduler.tick();
+  client.uncork();
 }
-
-
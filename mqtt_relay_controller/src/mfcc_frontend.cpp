@@ -0,0 +1,440 @@
+#include "mfcc_frontend.h"
+#include "profiling.h"
+#include "voice_activity.h"
+
+MfccFrontEnd mfccFrontEnd;
+
+namespace {
+
+const uint16_t N = MfccFrontEnd::FFT_SIZE / 2;  // Complex FFT length
+const uint16_t BINS = MfccFrontEnd::BINS;
+const uint8_t BANDS = MfccFrontEnd::MEL_BANDS;
+const uint8_t COEFFS = MfccFrontEnd::COEFFS;
+const int32_t PREEMPHASIS = 31785;  // 0.97 in Q15
+const int32_t ROUND_Q15 = 1 << 14;
+const uint8_t NO_SEGMENT = 0xFF;
+
+// --- constexpr math for the tables -----------------------------------------
+
+constexpr double PI = 3.14159265358979323846;
+constexpr double LN2 = 0.69314718055994530942;
+
+constexpr double sine(double x) {
+  while (x > PI) {
+    x -= 2 * PI;
+  }
+  while (x < -PI) {
+    x += 2 * PI;
+  }
+  double term = x;
+  double sum = x;
+  for (int n = 1; n < 16; n++) {
+    term *= -x * x / ((2 * n) * (2 * n + 1));
+    sum += term;
+  }
+  return sum;
+}
+
+constexpr double cosine(double x) { return sine(x + PI / 2); }
+
+// ln(m 2^e) = e ln 2 + 2 atanh((m - 1) / (m + 1)), m in [1, 2)
+constexpr double naturalLog(double x) {
+  int exponent = 0;
+  while (x >= 2) {
+    x /= 2;
+    exponent++;
+  }
+  while (x < 1) {
+    x *= 2;
+    exponent--;
+  }
+  double y = (x - 1) / (x + 1);
+  double term = y;
+  double sum = 0;
+  for (int n = 1; n < 40; n += 2) {
+    sum += term / n;
+    term *= y * y;
+  }
+  return exponent * LN2 + 2 * sum;
+}
+
+// e^x = 2^k e^r, |r| <= ln 2 / 2
+constexpr double exponential(double x) {
+  int k = (int)(x / LN2 + (x >= 0 ? 0.5 : -0.5));
+  double r = x - k * LN2;
+  double term = 1;
+  double sum = 1;
+  for (int n = 1; n < 20; n++) {
+    term *= r / n;
+    sum += term;
+  }
+  for (; k > 0; k--) {
+    sum *= 2;
+  }
+  for (; k < 0; k++) {
+    sum /= 2;
+  }
+  return sum;
+}
+
+constexpr double squareRoot(double x) {
+  double root = x > 1 ? x : 1;
+  for (int i = 0; i < 64; i++) {
+    root = (root + x / root) / 2;
+  }
+  return root;
+}
+
+constexpr int32_t fixedPoint(double x, int bits) {
+  double scaled = x * (1 << bits);
+  return (int32_t)(scaled + (scaled >= 0 ? 0.5 : -0.5));
+}
+
+constexpr int16_t q15(double x) {
+  int32_t value = fixedPoint(x, 15);
+  return (int16_t)(value > 32767 ? 32767 : (value < -32768 ? -32768 : value));
+}
+
+constexpr double hzToMel(double hz) { return 1127.0 * naturalLog(1.0 + hz / 700.0); }
+
+// --- tables ----------------------------------------------------------------
+
+// W_512^k = cos - i sin for k < 256; the 256-point FFT uses every other one
+struct Twiddles {
+  int16_t cosine[MfccFrontEnd::FFT_SIZE / 2];
+  int16_t sine[MfccFrontEnd::FFT_SIZE / 2];
+
+  constexpr Twiddles() : cosine(), sine() {
+    for (uint16_t k = 0; k < MfccFrontEnd::FFT_SIZE / 2; k++) {
+      cosine[k] = q15(::cosine(2 * PI * k / MfccFrontEnd::FFT_SIZE));
+      sine[k] = q15(::sine(2 * PI * k / MfccFrontEnd::FFT_SIZE));
+    }
+  }
+};
+
+struct BitReverse {
+  uint8_t index[N];
+
+  constexpr BitReverse() : index() {
+    for (uint16_t i = 0; i < N; i++) {
+      uint16_t reversed = 0;
+      for (uint16_t bit = 1, mirror = N / 2; bit < N; bit <<= 1, mirror >>= 1) {
+        if (i & bit) {
+          reversed |= mirror;
+        }
+      }
+      index[i] = (uint8_t)reversed;
+    }
+  }
+};
+
+struct HammingWindow {
+  int16_t weight[MfccFrontEnd::WINDOW];
+
+  constexpr HammingWindow() : weight() {
+    for (uint16_t n = 0; n < MfccFrontEnd::WINDOW; n++) {
+      weight[n] = q15(0.54 - 0.46 * cosine(2 * PI * n / (MfccFrontEnd::WINDOW - 1)));
+    }
+  }
+};
+
+// Bin k lies between filter centres segment[k] - 1 and segment[k] (edges
+// 0 and MEL_BANDS + 1 are the low and high ends); weight[k] is its Q15
+// weight in filter segment[k], the rest goes to the filter below
+struct MelFilters {
+  static constexpr double LOW_HZ = 20;
+  static constexpr double HIGH_HZ = MfccFrontEnd::SAMPLE_RATE / 2;
+
+  uint8_t segment[BINS];
+  uint16_t weight[BINS];
+
+  constexpr MelFilters() : segment(), weight() {
+    double edges[BANDS + 2] = {};
+    for (uint8_t i = 0; i < BANDS + 2; i++) {
+      edges[i] = hzToMel(LOW_HZ) + (hzToMel(HIGH_HZ) - hzToMel(LOW_HZ)) * i / (BANDS + 1);
+    }
+    for (uint16_t k = 0; k < BINS; k++) {
+      double mel = hzToMel((double)k * MfccFrontEnd::SAMPLE_RATE / MfccFrontEnd::FFT_SIZE);
+      segment[k] = NO_SEGMENT;
+      for (uint8_t j = 0; j <= BANDS; j++) {
+        if (mel >= edges[j] && mel < edges[j + 1]) {
+          int32_t w = fixedPoint((mel - edges[j]) / (edges[j + 1] - edges[j]), 15);
+          segment[k] = j;
+          weight[k] = (uint16_t)(w > 32767 ? 32767 : w);
+        }
+      }
+    }
+  }
+};
+
+// Orthonormal DCT-II, Q12; row 0 is unused (c0 is the mean)
+struct DctTable {
+  int16_t weight[COEFFS][BANDS];
+
+  constexpr DctTable() : weight() {
+    for (uint8_t i = 1; i < COEFFS; i++) {
+      double scale = squareRoot(2.0 / BANDS);
+      for (uint8_t b = 0; b < BANDS; b++) {
+        weight[i][b] = (int16_t)fixedPoint(scale * cosine(PI * i * (b + 0.5) / BANDS), 12);
+      }
+    }
+  }
+};
+
+// log2(1 + i / 64) in Q16
+struct Log2Table {
+  uint32_t value[65];
+
+  constexpr Log2Table() : value() {
+    for (uint8_t i = 0; i <= 64; i++) {
+      value[i] = (uint32_t)fixedPoint(naturalLog(1.0 + i / 64.0) / LN2, 16);
+    }
+  }
+};
+
+constexpr Twiddles twiddles;
+constexpr BitReverse bitReverse;
+constexpr HammingWindow hamming;
+constexpr MelFilters melFilters;
+constexpr DctTable dct;
+constexpr Log2Table log2Table;
+
+static_assert(twiddles.cosine[0] == 32767 && twiddles.sine[128] == 32767 && twiddles.cosine[128] == 0,
+              "twiddle table");
+static_assert(bitReverse.index[1] == 128 && bitReverse.index[6] == 96, "bit reversal table");
+static_assert(log2Table.value[64] == 65536 && log2Table.value[32] == 38336, "log2 table");
+static_assert(melFilters.segment[0] == NO_SEGMENT && melFilters.segment[BINS - 1] == NO_SEGMENT &&
+                  melFilters.segment[1] == 0,
+              "mel filters span 20 Hz to below 8 kHz");
+
+inline int16_t saturate(int32_t value) {
+  return (int16_t)(value > 32767 ? 32767 : (value < -32768 ? -32768 : value));
+}
+
+} // namespace
+
+// --- stages ----------------------------------------------------------------
+
+int8_t mfccWindow(const int16_t* samples, int16_t* real, int16_t* imag) {
+  // Scale the raw samples up first, so quiet frames keep their low bits
+  // through the pre-emphasis
+  int32_t bits = 0;  // OR of the magnitudes (one less for negatives)
+  for (uint16_t n = 0; n < MfccFrontEnd::WINDOW; n++) {
+    bits |= samples[n] ^ (samples[n] >> 31);
+  }
+  int8_t scale = bits == 0 ? 0 : (int8_t)(15 - (32 - __builtin_clz(bits)));
+  if (scale < 0) {
+    scale = 0;
+  }
+  int16_t windowed[MfccFrontEnd::WINDOW];
+  bits = 0;
+  int32_t previous = samples[0] << scale;
+  for (uint16_t n = 0; n < MfccFrontEnd::WINDOW; n++) {
+    int32_t x = samples[n] << scale;
+    int32_t emphasised = (x * 32768 - PREEMPHASIS * previous) >> 16;
+    previous = x;
+    int32_t value = (emphasised * hamming.weight[n] + ROUND_Q15) >> 15;
+    windowed[n] = (int16_t)value;
+    bits |= value ^ (value >> 31);
+  }
+  int8_t shift = bits == 0 ? 0 : (int8_t)(14 - (32 - __builtin_clz(bits)));
+  for (uint16_t n = 0; n < MfccFrontEnd::WINDOW; n += 2) {
+    uint8_t at = bitReverse.index[n / 2];
+    if (shift >= 0) {
+      real[at] = (int16_t)(windowed[n] << shift);
+      imag[at] = (int16_t)(windowed[n + 1] << shift);
+    } else {
+      real[at] = (int16_t)(windowed[n] >> -shift);
+      imag[at] = (int16_t)(windowed[n + 1] >> -shift);
+    }
+  }
+  for (uint16_t m = MfccFrontEnd::WINDOW / 2; m < N; m++) {
+    real[bitReverse.index[m]] = 0;
+    imag[bitReverse.index[m]] = 0;
+  }
+  return scale + shift;
+}
+
+// Block floating point: magnitudes start below 2^14 sqrt(2) and stay there.
+// A stage halves its outputs unless every input component is below 2^13,
+// when no output can reach 2^14 sqrt(2) unhalved; the first always halves.
+uint8_t mfccFft(int16_t* real, int16_t* imag) {
+  int32_t bits = 0;  // OR of the output magnitudes of the last stage
+  for (uint16_t a = 0; a < N; a += 2) {
+    int32_t ar = real[a], ai = imag[a], br = real[a + 1], bi = imag[a + 1];
+    int32_t sr = (ar + br) >> 1, si = (ai + bi) >> 1, dr = (ar - br) >> 1, di = (ai - bi) >> 1;
+    real[a] = (int16_t)sr;
+    imag[a] = (int16_t)si;
+    real[a + 1] = (int16_t)dr;
+    imag[a + 1] = (int16_t)di;
+    bits |= (sr ^ (sr >> 31)) | (si ^ (si >> 31)) | (dr ^ (dr >> 31)) | (di ^ (di >> 31));
+  }
+  uint8_t unscaled = 0;
+  for (uint16_t half = 2; half < N; half <<= 1) {
+    uint8_t scale = bits >= (1 << 13) ? 1 : 0;
+    unscaled += 1 - scale;
+    bits = 0;
+    uint16_t step = N / half;  // W_{2 half}^j = W_512^(j step)
+    for (uint16_t j = 0; j < half; j++) {
+      int32_t wr = twiddles.cosine[j * step];
+      int32_t wi = twiddles.sine[j * step];
+      for (uint16_t a = j; a < N; a += 2 * half) {
+        uint16_t b = a + half;
+        int32_t br = real[b], bi = imag[b];
+        int32_t tr = (wr * br + wi * bi + ROUND_Q15) >> 15;
+        int32_t ti = (wr * bi - wi * br + ROUND_Q15) >> 15;
+        int32_t ar = real[a], ai = imag[a];
+        int32_t sr = (ar + tr) >> scale, si = (ai + ti) >> scale, dr = (ar - tr) >> scale, di = (ai - ti) >> scale;
+        real[b] = (int16_t)dr;
+        imag[b] = (int16_t)di;
+        real[a] = (int16_t)sr;
+        imag[a] = (int16_t)si;
+        bits |= (sr ^ (sr >> 31)) | (si ^ (si >> 31)) | (dr ^ (dr >> 31)) | (di ^ (di >> 31));
+      }
+    }
+  }
+  return unscaled;
+}
+
+// With Z the complex FFT of the packed even/odd samples, the real FFT is
+// X[k] = E + W_512^k O, E = (Z[k] + Z*[N-k]) / 2, O = (Z[k] - Z*[N-k]) / 2i;
+// computed at half scale, so |X| / 2 stays within int16
+void mfccPowerSpectrum(const int16_t* real, const int16_t* imag, uint32_t* power) {
+  for (uint16_t k = 0; k < N; k++) {
+    uint16_t mirror = (N - k) & (N - 1);
+    int32_t ar = real[k], ai = imag[k], cr = real[mirror], ci = imag[mirror];
+    int32_t er = (ar + cr) >> 2;
+    int32_t ei = (ai - ci) >> 2;
+    int32_t orr = (ai + ci) >> 2;
+    int32_t oi = (cr - ar) >> 2;
+    int32_t wr = twiddles.cosine[k];
+    int32_t wi = twiddles.sine[k];
+    int32_t xr = er + ((wr * orr + wi * oi + ROUND_Q15) >> 15);
+    int32_t xi = ei + ((wr * oi - wi * orr + ROUND_Q15) >> 15);
+    power[k] = (uint32_t)(xr * xr) + (uint32_t)(xi * xi);
+  }
+  // Nyquist: W = -1 and Z[N] = Z[0]
+  int32_t xr = ((real[0] + real[0]) >> 2) - ((imag[0] + imag[0]) >> 2);
+  power[N] = (uint32_t)(xr * xr);
+}
+
+void mfccMelEnergies(const uint32_t* power, uint64_t* mel) {
+  memset(mel, 0, BANDS * sizeof(mel[0]));
+  for (uint16_t k = 0; k < BINS; k++) {
+    uint8_t segment = melFilters.segment[k];
+    if (segment == NO_SEGMENT) {
+      continue;
+    }
+    uint64_t p = power[k];
+    uint32_t w = melFilters.weight[k];
+    if (segment < BANDS) {
+      mel[segment] += p * w;
+    }
+    if (segment > 0) {
+      mel[segment - 1] += p * (32768 - w);
+    }
+  }
+}
+
+int32_t mfccLog2(uint64_t x) {
+  if (x == 0) {
+    return 0;
+  }
+  int bits = 63 - __builtin_clzll(x);
+  uint32_t fraction = (uint32_t)((x << (63 - bits)) >> 48) & 0x7FFF;  // 15 bits below the leading one
+  uint32_t i = fraction >> 9;
+  uint32_t low = log2Table.value[i];
+  uint32_t value = low + (((log2Table.value[i + 1] - low) * (fraction & 511)) >> 9);
+  return bits * 256 + (int32_t)((value + 128) >> 8);
+}
+
+// mel holds band power * 2^15 (weights) / 2^18 (eight halving FFT stages
+// and the split) * 2^(2 shift) (block exponent, counting unhalved stages)
+void mfccLogMel(const uint64_t* mel, int8_t shift, int16_t* logMel) {
+  int32_t offset = (3 - 2 * shift) * 256;
+  int32_t loudest = 0;
+  for (uint8_t b = 0; b < BANDS; b++) {
+    int32_t value = mfccLog2(mel[b]) + offset;
+    logMel[b] = saturate(value > 0 ? value : 0);
+    loudest = logMel[b] > loudest ? logMel[b] : loudest;
+  }
+  int32_t floor = loudest - MfccFrontEnd::FLOOR_Q8;
+  for (uint8_t b = 0; b < BANDS; b++) {
+    if (logMel[b] < floor) {
+      logMel[b] = (int16_t)floor;
+    }
+  }
+}
+
+void mfccDct(const int16_t* logMel, int16_t* coeffs) {
+  int32_t total = 0;
+  for (uint8_t b = 0; b < BANDS; b++) {
+    total += logMel[b];
+  }
+  coeffs[0] = (int16_t)((total + BANDS / 2) / BANDS);
+  for (uint8_t i = 1; i < COEFFS; i++) {
+    int32_t sum = 1 << 11;
+    for (uint8_t b = 0; b < BANDS; b++) {
+      sum += logMel[b] * dct.weight[i][b];
+    }
+    coeffs[i] = saturate(sum >> 12);
+  }
+}
+
+// --- streaming -------------------------------------------------------------
+
+MfccFrontEnd::MfccFrontEnd() {
+  reset();
+}
+
+void MfccFrontEnd::reset() {
+  filled = 0;
+  frames = 0;
+  memset(history, 0, sizeof(history));
+  memset(ring, 0, sizeof(ring));
+  memset(energies, 0, sizeof(energies));
+  memset(&counters, 0, sizeof(counters));
+}
+
+void MfccFrontEnd::addAudio(const int16_t* samples, size_t count) {
+  PROFILE_SCOPE("MfccFrontEnd::addAudio");
+  for (size_t i = 0; i < count; i++) {
+    history[filled++] = samples[i];
+    if (filled == WINDOW) {
+      compute();
+      memmove(history, history + HOP, (WINDOW - HOP) * sizeof(history[0]));
+      filled = WINDOW - HOP;
+    }
+  }
+}
+
+void MfccFrontEnd::compute() {
+  uint32_t started = ESP.getCycleCount();
+  uint64_t mel[MEL_BANDS];
+  int16_t logMel[MEL_BANDS];
+  int8_t shift = mfccWindow(history, real, imag);
+  shift += mfccFft(real, imag);
+  mfccPowerSpectrum(real, imag, power);
+  mfccMelEnergies(power, mel);
+  mfccLogMel(mel, shift, logMel);
+  uint16_t slot = frames & (RING_FRAMES - 1);
+  mfccDct(logMel, ring[slot]);
+  energies[slot] = (int16_t)mfccLog2(frameEnergy(history, WINDOW));
+  frames++;
+
+  uint32_t elapsed = ESP.getCycleCount() - started;
+  counters.frames++;
+  counters.lastCycles = elapsed;
+  counters.cycles += elapsed;
+  if (elapsed > counters.maxCycles) {
+    counters.maxCycles = elapsed;
+  }
+}
+
+uint32_t MfccFrontEnd::load(uint32_t cpuMhz) const {
+  if (counters.frames == 0 || cpuMhz == 0) {
+    return 0;
+  }
+  // cycles per frame * frames per second / (MHz * 10^6) * 10^4
+  return (uint32_t)(counters.cycles * FRAMES_PER_SECOND / counters.frames / (cpuMhz * 100));
+}
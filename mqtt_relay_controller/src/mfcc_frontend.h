@@ -0,0 +1,120 @@
+#ifndef MFCC_FRONTEND_H
+#define MFCC_FRONTEND_H
+
+#include <Arduino.h>
+
+// Streaming MFCC feature front-end in fixed point.
+//
+// Every HOP samples (10 ms) the last WINDOW (25 ms) become one feature
+// frame:
+//
+//   energy   sum of squares of the raw samples, with frameEnergy() (see
+//            voice_activity.h), as log2 in Q8
+//   window   the raw samples are shifted left to use 15 bits, then get
+//            pre-emphasis y = (x - 0.97 x[-1]) / 2 within the frame (x[-1] of
+//            the first sample is itself) and a Hamming window, and are
+//            shifted again until the largest is in [2^13, 2^14) - block
+//            floating point, the total shift is the frame's exponent - and
+//            stored bit-reversed as the even/odd halves of a 256-point
+//            complex sequence, zero padded
+//   FFT      radix-2 in int16; a stage halves when its input could
+//            otherwise overflow, and the stages that do not add to the
+//            exponent
+//   split    the 257 bins of the 512-point real FFT from the complex one,
+//            as power re^2 + im^2
+//   mel      MEL_BANDS triangular filters, 20 Hz to 8 kHz on the HTK mel
+//            scale, summed in 64 bits with Q15 weights; each bin feeds the
+//            rising edge of one filter and the falling edge of the one below
+//   log      log2 in Q8 (256 steps per doubling) from the leading bit and an
+//            interpolated 64-entry table, corrected for the exponent;
+//            powers below 1 (in sample units) are floored to 0, and bands
+//            more than FLOOR_Q8 below the loudest are raised to that: the
+//            int16 FFT's rounding noise, not the signal, sets them
+//   DCT      orthonormal DCT-II to c1..c12, Q12 table; c0 is the mean of
+//            the log-mel bands (the orthonormal c0 / sqrt(MEL_BANDS), which
+//            keeps it in int16)
+//
+// The twiddle, window, mel and DCT tables are computed by constexpr code at
+// build time and live in flash. Frames go into a ring of the last
+// RING_FRAMES, each COEFFS coefficients c0..c12 (Q8, log2 units) plus the
+// frame's energy for level decisions; unlike c0 it is not tilted by the
+// pre-emphasis towards hiss. Detectors read them by frame number.
+//
+// Every frame is timed with the cycle counter (CCOUNT on the ESP32) for the
+// on-target load in stats(); the mfcc bench has a cycle model of the same
+// code for the ESP32.
+
+struct MfccFrontEndStats {
+  uint32_t frames;
+  uint32_t lastCycles;   // Of the last frame
+  uint32_t maxCycles;
+  uint64_t cycles;       // All frames
+};
+
+class MfccFrontEnd {
+public:
+  static const uint16_t SAMPLE_RATE = 16000;
+  static const uint16_t WINDOW = 400;       // 25 ms
+  static const uint16_t HOP = 160;          // 10 ms
+  static const uint16_t FFT_SIZE = 512;     // Real FFT, as a 256-point complex one
+  static const uint16_t BINS = FFT_SIZE / 2 + 1;
+  static const uint8_t MEL_BANDS = 26;
+  static const uint8_t COEFFS = 13;
+  static const uint16_t RING_FRAMES = 256;  // 2.56 s
+  static const int16_t FLOOR_Q8 = 16 * 256; // Log-mel range, 16 doublings (48 dB)
+  static const uint16_t FRAMES_PER_SECOND = SAMPLE_RATE / HOP;
+
+  MfccFrontEnd();
+  void reset();
+
+  // Any number of samples; one frame is computed per HOP of them
+  void addAudio(const int16_t* samples, size_t count);
+
+  // Frames since reset(); frame numbers below written() - RING_FRAMES are
+  // overwritten
+  uint32_t written() const { return frames; }
+  // Coefficients c0..c(COEFFS-1) of a frame, Q8
+  const int16_t* frame(uint32_t index) const { return ring[index & (RING_FRAMES - 1)]; }
+  // log2 of a frame's sum of squares, Q8
+  int16_t energy(uint32_t index) const { return energies[index & (RING_FRAMES - 1)]; }
+
+  const MfccFrontEndStats& stats() const { return counters; }
+  // Share of one core at `cpuMhz` used at the real-time frame rate, in
+  // hundredths of a percent
+  uint32_t load(uint32_t cpuMhz) const;
+
+private:
+  alignas(4) int16_t history[WINDOW];  // Oldest first; word loads in frameEnergyMac16()
+  uint16_t filled;
+  uint32_t frames;
+  int16_t ring[RING_FRAMES][COEFFS];
+  int16_t energies[RING_FRAMES];
+  int16_t real[FFT_SIZE / 2];
+  int16_t imag[FFT_SIZE / 2];
+  uint32_t power[BINS];
+  MfccFrontEndStats counters;
+
+  void compute();
+};
+
+// The stages of one frame, for benchmarks and tests. Buffers are 256
+// entries for real/imag, BINS for power, MEL_BANDS for mel/logMel.
+
+// Pre-emphasise and window `samples` (WINDOW) into bit-reversed real/imag;
+// returns the block exponent
+int8_t mfccWindow(const int16_t* samples, int16_t* real, int16_t* imag);
+// 256-point complex FFT in place on bit-reversed input, scaled by 1/256
+// times 2 to the returned power, which adds to the block exponent
+uint8_t mfccFft(int16_t* real, int16_t* imag);
+// Power of the BINS real-FFT bins
+void mfccPowerSpectrum(const int16_t* real, const int16_t* imag, uint32_t* power);
+void mfccMelEnergies(const uint32_t* power, uint64_t* mel);
+// log2 in Q8 of mel energies of a frame with block exponent `shift`
+void mfccLogMel(const uint64_t* mel, int8_t shift, int16_t* logMel);
+void mfccDct(const int16_t* logMel, int16_t* coeffs);
+// log2(x) in Q8; 0 for 0
+int32_t mfccLog2(uint64_t x);
+
+extern MfccFrontEnd mfccFrontEnd;
+
+#endif
@@ -0,0 +1,237 @@
+#include "mqtt_connection.h"
+
+MqttConnection::MqttConnection(PubSubClient& mqttClient, WiFiClient& netClient)
+  : mqtt(mqttClient), net(netClient), host(nullptr), port(0), clientIdPrefix(""),
+    subscriptionCount(0), subscribeIndex(0), sessionCallback(nullptr),
+    current(MQTT_STATE_WAIT_WIFI), resolved(false), consecutiveFailures(0),
+    retryAt(0), lostAt(0), connectSentAt(0) {
+  memset(&counters, 0, sizeof(counters));
+}
+
+// Configure the broker; the first attempt starts on the next poll()
+void MqttConnection::begin(const char* brokerHost, uint16_t brokerPort, const char* prefix) {
+  host = brokerHost;
+  port = brokerPort;
+  clientIdPrefix = prefix;
+  resolved = false;
+  lostAt = millis();
+  current = MQTT_STATE_WAIT_WIFI;
+
+  // Bound the CONNACK wait in PubSubClient::poll()
+  mqtt.setSocketTimeout(CONNACK_TIMEOUT_S);
+}
+
+bool MqttConnection::addSubscription(const char* topic) {
+  if (subscriptionCount >= MAX_SUBSCRIPTIONS) {
+    return false;
+  }
+  subscriptions[subscriptionCount++] = topic;
+  return true;
+}
+
+const char* MqttConnection::stateName() const {
+  switch (current) {
+    case MQTT_STATE_WAIT_WIFI:    return "wait_wifi";
+    case MQTT_STATE_BACKOFF:      return "backoff";
+    case MQTT_STATE_RESOLVE:      return "resolve";
+    case MQTT_STATE_TCP_CONNECT:  return "tcp_connect";
+    case MQTT_STATE_MQTT_CONNECT: return "mqtt_connect";
+    case MQTT_STATE_CONNACK:      return "connack";
+    case MQTT_STATE_SUBSCRIBE:    return "subscribe";
+    case MQTT_STATE_REGISTER:     return "register";
+    case MQTT_STATE_CONNECTED:    return "connected";
+  }
+  return "unknown";
+}
+
+uint32_t MqttConnection::nextPollMs() const {
+  switch (current) {
+    case MQTT_STATE_CONNECTED:
+    case MQTT_STATE_WAIT_WIFI:
+      return UINT32_MAX;
+    case MQTT_STATE_BACKOFF: {
+      long remaining = (long)(retryAt - millis());
+      return remaining > 0 ? (uint32_t)remaining : 0;
+    }
+    case MQTT_STATE_CONNACK: {
+      // Socket data wakes the task; otherwise come back for the timeout
+      long remaining = (long)(connectSentAt + CONNACK_TIMEOUT_S * 1000UL - millis());
+      return remaining > 0 ? (uint32_t)remaining : 0;
+    }
+    default:
+      return 0;
+  }
+}
+
+// Begin a new attempt: resolve the broker first unless a cached address is usable
+void MqttConnection::startAttempt() {
+  counters.attempts++;
+  current = resolved ? MQTT_STATE_TCP_CONNECT : MQTT_STATE_RESOLVE;
+  Serial.printf("Attempting MQTT connection (attempt %u)...\n", (unsigned)counters.attempts);
+}
+
+// Abort the attempt and back off: exponential, capped, "equal jitter"
+void MqttConnection::fail(int error) {
+  net.stop();
+  counters.failures++;
+  counters.lastError = error;
+  if (consecutiveFailures < 255) {
+    consecutiveFailures++;
+  }
+  if (consecutiveFailures % RESOLVE_AFTER_FAILURES == 0) {
+    resolved = false;
+  }
+
+  uint8_t shift = consecutiveFailures - 1 < 16 ? consecutiveFailures - 1 : 16;
+  uint32_t window = BACKOFF_BASE_MS << shift;
+  if (window > BACKOFF_CAP_MS) {
+    window = BACKOFF_CAP_MS;
+  }
+  uint32_t wait = window / 2 + random(window / 2 + 1);
+  counters.backoffMs = window;
+  retryAt = millis() + wait;
+
+  Serial.printf("❌ MQTT %s failed, rc=%d - retry in %u ms\n", stateName(), error, (unsigned)wait);
+  current = MQTT_STATE_BACKOFF;
+}
+
+// The session dropped: retry after a random slice of the base window
+void MqttConnection::sessionLost(unsigned long now) {
+  net.stop();
+  // Let PubSubClient see the socket close, or it would take the next TCP
+  // session for this one: connectAsync() would skip CONNECT and uncork()
+  // would send what was packed for this session
+  mqtt.connected();
+  lostAt = now;
+  consecutiveFailures = 0;
+  retryAt = now + random(BACKOFF_BASE_MS);
+  current = MQTT_STATE_BACKOFF;
+  Serial.printf("⚠️ MQTT connection lost (rc=%d)\n", mqtt.state());
+}
+
+// Advance the state machine by one step
+bool MqttConnection::poll() {
+  unsigned long now = millis();
+
+  if (WiFi.status() != WL_CONNECTED) {
+    if (current == MQTT_STATE_CONNECTED) {
+      sessionLost(now);
+    } else if (current != MQTT_STATE_WAIT_WIFI) {
+      net.stop();
+    }
+    current = MQTT_STATE_WAIT_WIFI;
+    return false;
+  }
+
+  switch (current) {
+    case MQTT_STATE_WAIT_WIFI:
+      startAttempt();
+      break;
+
+    case MQTT_STATE_BACKOFF:
+      if ((long)(now - retryAt) >= 0) {
+        startAttempt();
+      }
+      break;
+
+    case MQTT_STATE_RESOLVE: {
+      unsigned long started = micros();
+      if (WiFi.hostByName(host, brokerIp) == 1) {
+        counters.resolveUs = micros() - started;
+        resolved = true;
+        current = MQTT_STATE_TCP_CONNECT;
+      } else {
+        fail(MQTT_CONNECT_FAILED);
+      }
+      break;
+    }
+
+    case MQTT_STATE_TCP_CONNECT: {
+      unsigned long started = micros();
+      if (net.connect(brokerIp, port, TCP_CONNECT_TIMEOUT_MS)) {
+        counters.tcpConnectUs = micros() - started;
+        // PubSubClient hands over whole packets in MSS-sized writes, so
+        // Nagle would only hold back the last piece of each until an ACK
+        net.setNoDelay(true);
+        current = MQTT_STATE_MQTT_CONNECT;
+      } else {
+        fail(MQTT_CONNECT_FAILED);
+      }
+      break;
+    }
+
+    case MQTT_STATE_MQTT_CONNECT: {
+      // The TCP session is already up, so connectAsync() only sends CONNECT
+      char clientId[40];
+      snprintf(clientId, sizeof(clientId), "%s%lx", clientIdPrefix, random(0xffff));
+      if (mqtt.connectAsync(clientId)) {
+        connectSentAt = now;
+        current = MQTT_STATE_CONNACK;
+      } else {
+        fail(mqtt.state());
+      }
+      break;
+    }
+
+    case MQTT_STATE_CONNACK: {
+      int rc = mqtt.poll();
+      if (rc == MQTT_CONNECTING) {
+        break;
+      }
+      if (rc == MQTT_CONNECT_BAD_PROTOCOL && mqtt.protocolVersion() == MQTT_VERSION_5) {
+        // The broker does not speak MQTT 5: retry with 3.1.1. Responses
+        // awaiting a PUBACK are rewritten for it or, if they cannot be, dropped
+        uint32_t dropped = mqtt.getStats().inflightDropped;
+        mqtt.setProtocolVersion(MQTT_VERSION_3_1_1);
+        Serial.printf("⚠️ Broker refused MQTT 5 - using 3.1.1 (%u unacknowledged publishes dropped)\n",
+                      (unsigned)(mqtt.getStats().inflightDropped - dropped));
+      }
+      if (rc != MQTT_CONNECTED) {
+        fail(rc);
+        break;
+      }
+      counters.connackUs = mqtt.getStats().connectMqttUs;
+      Serial.println("connected");
+      subscribeIndex = 0;
+      current = MQTT_STATE_SUBSCRIBE;
+      break;
+    }
+
+    case MQTT_STATE_SUBSCRIBE:
+      if (subscribeIndex < subscriptionCount) {
+        if (!mqtt.subscribe(subscriptions[subscribeIndex])) {
+          fail(mqtt.state());
+          break;
+        }
+        Serial.print("Subscribed to: ");
+        Serial.println(subscriptions[subscribeIndex]);
+        subscribeIndex++;
+      }
+      if (subscribeIndex >= subscriptionCount) {
+        current = MQTT_STATE_REGISTER;
+      }
+      break;
+
+    case MQTT_STATE_REGISTER:
+      if (sessionCallback != nullptr) {
+        sessionCallback();
+      }
+      counters.sessions++;
+      counters.lastReconnectMs = now - lostAt;
+      if (counters.lastReconnectMs > counters.maxReconnectMs) {
+        counters.maxReconnectMs = counters.lastReconnectMs;
+      }
+      consecutiveFailures = 0;
+      current = MQTT_STATE_CONNECTED;
+      Serial.printf("📡 MQTT session up after %u ms\n", (unsigned)counters.lastReconnectMs);
+      return true;
+
+    case MQTT_STATE_CONNECTED:
+      if (mqtt.connected()) {
+        return true;
+      }
+      sessionLost(now);
+      break;
+  }
+  return false;
+}
@@ -0,0 +1,106 @@
+#ifndef MQTT_CONNECTION_H
+#define MQTT_CONNECTION_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <PubSubClient.h>
+
+// Resumable MQTT connection state machine.
+//
+// Every poll() performs at most one step of
+//   resolve -> TCP connect -> CONNECT -> CONNACK -> subscribe -> register
+// so the relay, OTA and audio tasks keep running between steps; while the
+// CONNACK is outstanding poll() only checks whether it has arrived. A failed
+// step backs off exponentially (capped) with per-device jitter, and the
+// first retry after a lost session is spread over BACKOFF_BASE_MS, so a
+// fleet does not reconnect in lockstep after a broker restart.
+//
+// Two steps still block the loop task while they run: the name lookup
+// (WiFi.hostByName(), bounded by the lwIP resolver's own timeout; the
+// address is cached, so it runs on the first attempt and again only after
+// RESOLVE_AFTER_FAILURES failed attempts) and the TCP handshake
+// (net.connect(), at most TCP_CONNECT_TIMEOUT_MS). With the broker down,
+// that is one stall of up to TCP_CONNECT_TIMEOUT_MS per backoff period.
+// Audio capture runs in its own FreeRTOS task and is not held up. The
+// Arduino WiFiClient has no asynchronous connect to poll instead.
+
+enum MqttConnectionState : uint8_t {
+  MQTT_STATE_WAIT_WIFI,
+  MQTT_STATE_BACKOFF,
+  MQTT_STATE_RESOLVE,
+  MQTT_STATE_TCP_CONNECT,
+  MQTT_STATE_MQTT_CONNECT,
+  MQTT_STATE_CONNACK,
+  MQTT_STATE_SUBSCRIBE,
+  MQTT_STATE_REGISTER,
+  MQTT_STATE_CONNECTED
+};
+
+struct MqttConnectionStats {
+  uint32_t attempts;         // Connection attempts started
+  uint32_t failures;         // Attempts that ended in a backoff
+  uint32_t sessions;         // Sessions established (subscribed and registered)
+  uint32_t lastReconnectMs;  // Session lost (or boot) -> registered, last session
+  uint32_t maxReconnectMs;
+  uint32_t backoffMs;        // Backoff window of the last failure
+  int lastError;             // PubSubClient state() of the last failure
+  uint32_t resolveUs;        // Phase times of the last successful attempt
+  uint32_t tcpConnectUs;
+  uint32_t connackUs;        // CONNECT sent -> CONNACK received
+};
+
+typedef void (*SessionCallback)();
+
+class MqttConnection {
+public:
+  static const uint32_t BACKOFF_BASE_MS = 1000;
+  static const uint32_t BACKOFF_CAP_MS = 60000;
+  static const int32_t TCP_CONNECT_TIMEOUT_MS = 2000;  // Longest loop stall per attempt
+  static const uint16_t CONNACK_TIMEOUT_S = 2;  // Also bounds a stalled inbound packet
+  static const uint8_t RESOLVE_AFTER_FAILURES = 4;  // Re-resolve the broker after this many failures in a row
+  static const uint8_t MAX_SUBSCRIPTIONS = 8;
+
+  MqttConnection(PubSubClient& mqtt, WiFiClient& net);
+
+  void begin(const char* host, uint16_t port, const char* clientIdPrefix);
+  bool addSubscription(const char* topic);
+  // Called once per session after subscribing, e.g. to publish a registration
+  void onSessionStart(SessionCallback callback) { sessionCallback = callback; }
+
+  // Advance the state machine by one step; returns true while the session is up
+  bool poll();
+  // Milliseconds until poll() has more work to do (0 = immediately)
+  uint32_t nextPollMs() const;
+
+  MqttConnectionState state() const { return current; }
+  const char* stateName() const;
+  const MqttConnectionStats& stats() const { return counters; }
+
+private:
+  PubSubClient& mqtt;
+  WiFiClient& net;
+  const char* host;
+  uint16_t port;
+  const char* clientIdPrefix;
+
+  const char* subscriptions[MAX_SUBSCRIPTIONS];
+  uint8_t subscriptionCount;
+  uint8_t subscribeIndex;
+  SessionCallback sessionCallback;
+
+  MqttConnectionState current;
+  IPAddress brokerIp;
+  bool resolved;
+  uint8_t consecutiveFailures;
+  unsigned long retryAt;
+  unsigned long lostAt;
+  unsigned long connectSentAt;
+
+  MqttConnectionStats counters;
+
+  void startAttempt();
+  void fail(int error);
+  void sessionLost(unsigned long now);
+};
+
+#endif
@@ -0,0 +1,349 @@
+#include "nn_kernels.h"
+
+#if defined(__XTENSA__)
+#include <xtensa/config/core-isa.h>
+#endif
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// Depthwise taps inside the input, per output position
+static const uint8_t MAX_DEPTHWISE_TAPS = 25;
+
+int32_t nnRequantize(int32_t acc, NnRequant requant) {
+  int left = requant.shift > 0 ? requant.shift : 0;
+  int right = requant.shift > 0 ? 0 : -requant.shift;
+  int32_t x = (int32_t)((uint32_t)acc << left);
+
+  // Saturating rounding doubling high multiply
+  int32_t high;
+  if (x == INT32_MIN && requant.multiplier == INT32_MIN) {
+    high = INT32_MAX;
+  } else {
+    int64_t product = (int64_t)x * requant.multiplier;
+    int32_t nudge = product >= 0 ? (1 << 30) : (1 - (1 << 30));
+    high = (int32_t)((product + nudge) / ((int64_t)1 << 31));
+  }
+
+  // Rounding divide by 2^right, half away from zero
+  int32_t mask = (int32_t)(((uint32_t)1 << right) - 1);
+  int32_t remainder = high & mask;
+  int32_t threshold = (mask >> 1) + (high < 0 ? 1 : 0);
+  return (high >> right) + (remainder > threshold ? 1 : 0);
+}
+
+static inline int8_t nnOutput(int32_t acc, NnRequant requant, int8_t zero, int8_t low, int8_t high) {
+  int32_t value = nnRequantize(acc, requant) + zero;
+  if (value < low) value = low;
+  if (value > high) value = high;
+  return (int8_t)value;
+}
+
+int32_t nnDot16Reference(const int16_t* a, const int16_t* b, size_t count) {
+  int32_t sum = 0;
+  for (size_t i = 0; i < count; i++) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+int32_t nnDot16Unrolled(const int16_t* a, const int16_t* b, size_t count) {
+  int32_t even = 0;
+  int32_t odd = 0;
+  for (size_t i = 0; i < count; i += 4) {
+    even += a[i] * b[i] + a[i + 2] * b[i + 2];
+    odd += a[i + 1] * b[i + 1] + a[i + 3] * b[i + 3];
+  }
+  return even + odd;
+}
+
+#if defined(__XTENSA__)
+// The MAC16 data registers are loaded with LDINC, which increments the
+// address before it loads, so both pointers start one word early. Each
+// MULA.DD multiplies one half of an m0/m1 word by the same half of an m2/m3
+// word and loads the next word into the register pair not being multiplied:
+// the loop takes two words of each operand per iteration and one
+// instruction per multiply. The last two words are loaded before the loop
+// ends and multiplied after it, so nothing is read past the end.
+int32_t nnDot16Mac16(const int16_t* a, const int16_t* b, size_t count) {
+#if XCHAL_HAVE_MAC16
+  if (count == 0) {
+    return 0;
+  }
+  const int16_t* x = a - 2;
+  const int16_t* y = b - 2;
+  uint32_t iterations = count / 4 - 1;
+  uint32_t low;
+  asm volatile(
+      "wsr.acclo %[zero]\n"
+      "wsr.acchi %[zero]\n"
+      "ldinc m0, %[x]\n"
+      "ldinc m2, %[y]\n"
+      "beqz %[iterations], 2f\n"
+      "1:\n"
+      "mula.dd.ll.ldinc m1, %[x], m0, m2\n"
+      "mula.dd.hh.ldinc m3, %[y], m0, m2\n"
+      "addi %[iterations], %[iterations], -1\n"
+      "mula.dd.ll.ldinc m0, %[x], m1, m3\n"
+      "mula.dd.hh.ldinc m2, %[y], m1, m3\n"
+      "bnez %[iterations], 1b\n"
+      "2:\n"
+      "mula.dd.ll.ldinc m1, %[x], m0, m2\n"
+      "mula.dd.hh.ldinc m3, %[y], m0, m2\n"
+      "mula.dd.ll m1, m3\n"
+      "mula.dd.hh m1, m3\n"
+      "rsr.acclo %[low]\n"
+      : [low] "=r"(low), [x] "+r"(x), [y] "+r"(y), [iterations] "+r"(iterations)
+      : [zero] "r"(0)
+      : "memory");
+  return (int32_t)low;
+#else
+  return nnDot16Unrolled(a, b, count);
+#endif
+}
+#endif
+
+#if defined(__x86_64__)
+// PMADDWD multiplies eight pairs and adds neighbouring products into four
+// 32-bit lanes; the sums are bounded by the caller, so the lanes never
+// overflow
+int32_t nnDot16Sse2(const int16_t* a, const int16_t* b, size_t count) {
+  __m128i total = _mm_setzero_si128();
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+    __m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+    total = _mm_add_epi32(total, _mm_madd_epi16(x, y));
+  }
+  int32_t lanes[4];
+  _mm_storeu_si128((__m128i*)lanes, total);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] + nnDot16Reference(a + i, b + i, count - i);
+}
+#endif
+
+int32_t nnDot16(const int16_t* a, const int16_t* b, size_t count) {
+#if defined(__XTENSA__)
+  return nnDot16Mac16(a, b, count);
+#elif defined(__x86_64__)
+  return nnDot16Sse2(a, b, count);
+#else
+  return nnDot16Unrolled(a, b, count);
+#endif
+}
+
+const char* nnDotKernel() {
+#if defined(__XTENSA__) && XCHAL_HAVE_MAC16
+  return "mac16";
+#elif defined(__x86_64__)
+  return "sse2";
+#else
+  return "unrolled";
+#endif
+}
+
+void nnConv2dReference(const NnConvParams& params, const NnShape& inputShape, const int8_t* input,
+                       const int8_t* filter, const int32_t* bias, const NnRequant* requant,
+                       const NnShape& outputShape, int8_t* output) {
+  const uint16_t inputChannels = inputShape.channels;
+  for (int oy = 0; oy < outputShape.height; oy++) {
+    for (int ox = 0; ox < outputShape.width; ox++) {
+      for (int oc = 0; oc < outputShape.channels; oc++) {
+        int32_t acc = bias[oc];
+        for (int ky = 0; ky < params.kernelHeight; ky++) {
+          for (int kx = 0; kx < params.kernelWidth; kx++) {
+            int iy = oy * params.strideHeight - params.padTop + ky;
+            int ix = ox * params.strideWidth - params.padLeft + kx;
+            if (iy < 0 || iy >= inputShape.height || ix < 0 || ix >= inputShape.width) continue;
+            for (int ic = 0; ic < inputChannels; ic++) {
+              int32_t x = input[(iy * inputShape.width + ix) * inputChannels + ic] - params.inputZero;
+              int32_t w = filter[((oc * params.kernelHeight + ky) * params.kernelWidth + kx) * inputChannels + ic];
+              acc += x * w;
+            }
+          }
+        }
+        output[(oy * outputShape.width + ox) * outputShape.channels + oc] =
+            nnOutput(acc, requant[oc], params.outputZero, params.activationMin, params.activationMax);
+      }
+    }
+  }
+}
+
+void nnConv2d(const NnConvParams& params, const NnShape& inputShape, const int8_t* input, const int8_t* filter,
+              const int32_t* bias, const NnRequant* requant, const NnShape& outputShape, int8_t* output,
+              int16_t* scratch) {
+  const uint16_t inputChannels = inputShape.channels;
+  const size_t row = (size_t)params.kernelWidth * inputChannels;
+  const size_t patch = params.kernelHeight * row;
+  const size_t length = nnDotLength(patch);
+  int16_t* column = scratch;
+  int16_t* weights = scratch + length;
+  for (int oc = 0; oc < outputShape.channels; oc++) {
+    int16_t* w = weights + oc * length;
+    for (size_t i = 0; i < patch; i++) {
+      w[i] = filter[oc * patch + i];
+    }
+    for (size_t i = patch; i < length; i++) {
+      w[i] = 0;
+    }
+  }
+  for (size_t i = patch; i < length; i++) {
+    column[i] = 0;
+  }
+
+  for (int oy = 0; oy < outputShape.height; oy++) {
+    for (int ox = 0; ox < outputShape.width; ox++) {
+      int16_t* p = column;
+      for (int ky = 0; ky < params.kernelHeight; ky++) {
+        int iy = oy * params.strideHeight - params.padTop + ky;
+        if (iy < 0 || iy >= inputShape.height) {
+          memset(p, 0, row * sizeof(int16_t));
+          p += row;
+          continue;
+        }
+        for (int kx = 0; kx < params.kernelWidth; kx++) {
+          int ix = ox * params.strideWidth - params.padLeft + kx;
+          if (ix < 0 || ix >= inputShape.width) {
+            memset(p, 0, inputChannels * sizeof(int16_t));
+            p += inputChannels;
+            continue;
+          }
+          const int8_t* in = input + (iy * inputShape.width + ix) * inputChannels;
+          for (int ic = 0; ic < inputChannels; ic++) {
+            *p++ = in[ic] - params.inputZero;
+          }
+        }
+      }
+      int8_t* out = output + (oy * outputShape.width + ox) * outputShape.channels;
+      for (int oc = 0; oc < outputShape.channels; oc++) {
+        int32_t acc = bias[oc] + nnDot16(column, weights + oc * length, length);
+        out[oc] = nnOutput(acc, requant[oc], params.outputZero, params.activationMin, params.activationMax);
+      }
+    }
+  }
+}
+
+void nnDepthwiseConv2dReference(const NnConvParams& params, const NnShape& inputShape, const int8_t* input,
+                                const int8_t* filter, const int32_t* bias, const NnRequant* requant,
+                                const NnShape& outputShape, int8_t* output) {
+  const uint16_t channels = inputShape.channels;
+  for (int oy = 0; oy < outputShape.height; oy++) {
+    for (int ox = 0; ox < outputShape.width; ox++) {
+      for (int c = 0; c < channels; c++) {
+        int32_t acc = bias[c];
+        for (int ky = 0; ky < params.kernelHeight; ky++) {
+          for (int kx = 0; kx < params.kernelWidth; kx++) {
+            int iy = oy * params.strideHeight - params.padTop + ky;
+            int ix = ox * params.strideWidth - params.padLeft + kx;
+            if (iy < 0 || iy >= inputShape.height || ix < 0 || ix >= inputShape.width) continue;
+            int32_t x = input[(iy * inputShape.width + ix) * channels + c] - params.inputZero;
+            int32_t w = filter[(ky * params.kernelWidth + kx) * channels + c];
+            acc += x * w;
+          }
+        }
+        output[(oy * outputShape.width + ox) * channels + c] =
+            nnOutput(acc, requant[c], params.outputZero, params.activationMin, params.activationMax);
+      }
+    }
+  }
+}
+
+void nnDepthwiseConv2d(const NnConvParams& params, const NnShape& inputShape, const int8_t* input,
+                       const int8_t* filter, const int32_t* bias, const NnRequant* requant,
+                       const NnShape& outputShape, int8_t* output, int16_t* scratch) {
+  const uint16_t channels = inputShape.channels;
+  const size_t taps = (size_t)params.kernelHeight * params.kernelWidth;
+  if (taps > MAX_DEPTHWISE_TAPS) {
+    nnDepthwiseConv2dReference(params, inputShape, input, filter, bias, requant, outputShape, output);
+    return;
+  }
+  int16_t* weights = scratch;
+  for (size_t i = 0; i < taps * channels; i++) {
+    weights[i] = filter[i];
+  }
+
+  const int8_t* tapInput[MAX_DEPTHWISE_TAPS];
+  const int16_t* tapWeights[MAX_DEPTHWISE_TAPS];
+  for (int oy = 0; oy < outputShape.height; oy++) {
+    for (int ox = 0; ox < outputShape.width; ox++) {
+      uint8_t inside = 0;
+      for (int ky = 0; ky < params.kernelHeight; ky++) {
+        int iy = oy * params.strideHeight - params.padTop + ky;
+        if (iy < 0 || iy >= inputShape.height) continue;
+        for (int kx = 0; kx < params.kernelWidth; kx++) {
+          int ix = ox * params.strideWidth - params.padLeft + kx;
+          if (ix < 0 || ix >= inputShape.width) continue;
+          tapInput[inside] = input + (iy * inputShape.width + ix) * channels;
+          tapWeights[inside] = weights + (ky * params.kernelWidth + kx) * channels;
+          inside++;
+        }
+      }
+      int8_t* out = output + (oy * outputShape.width + ox) * channels;
+      for (int c = 0; c < channels; c++) {
+        int32_t acc = bias[c];
+        for (uint8_t t = 0; t < inside; t++) {
+          acc += (int16_t)(tapInput[t][c] - params.inputZero) * tapWeights[t][c];
+        }
+        out[c] = nnOutput(acc, requant[c], params.outputZero, params.activationMin, params.activationMax);
+      }
+    }
+  }
+}
+
+void nnFullyConnectedReference(const NnFullyConnectedParams& params, uint16_t inputs, const int8_t* input,
+                               const int8_t* weights, const int32_t* bias, const NnRequant* requant,
+                               uint16_t outputs, int8_t* output) {
+  for (int o = 0; o < outputs; o++) {
+    int32_t acc = bias[o];
+    for (int i = 0; i < inputs; i++) {
+      acc += (input[i] - params.inputZero) * weights[o * inputs + i];
+    }
+    output[o] = nnOutput(acc, requant[o], params.outputZero, params.activationMin, params.activationMax);
+  }
+}
+
+void nnFullyConnected(const NnFullyConnectedParams& params, uint16_t inputs, const int8_t* input,
+                      const int8_t* weights, const int32_t* bias, const NnRequant* requant, uint16_t outputs,
+                      int8_t* output, int16_t* scratch) {
+  const size_t length = nnDotLength(inputs);
+  int16_t* column = scratch;
+  int16_t* rows = scratch + length;
+  for (size_t i = 0; i < length; i++) {
+    column[i] = i < inputs ? input[i] - params.inputZero : 0;
+  }
+  for (int o = 0; o < outputs; o++) {
+    int16_t* w = rows + o * length;
+    for (size_t i = 0; i < length; i++) {
+      w[i] = i < inputs ? weights[o * inputs + i] : 0;
+    }
+    int32_t acc = bias[o] + nnDot16(column, w, length);
+    output[o] = nnOutput(acc, requant[o], params.outputZero, params.activationMin, params.activationMax);
+  }
+}
+
+void nnAveragePool(const NnShape& inputShape, const int8_t* input, int8_t* output) {
+  const int32_t count = (int32_t)inputShape.height * inputShape.width;
+  for (int c = 0; c < inputShape.channels; c++) {
+    int32_t sum = 0;
+    for (int32_t i = 0; i < count; i++) {
+      sum += input[i * inputShape.channels + c];
+    }
+    int32_t average = sum > 0 ? (sum + count / 2) / count : (sum - count / 2) / count;
+    output[c] = (int8_t)(average < -128 ? -128 : average > 127 ? 127 : average);
+  }
+}
+
+void nnSoftmax(const int8_t* input, uint16_t count, const uint16_t* expTable, int8_t* output) {
+  int8_t largest = -128;
+  for (uint16_t i = 0; i < count; i++) {
+    if (input[i] > largest) largest = input[i];
+  }
+  uint32_t sum = 0;
+  for (uint16_t i = 0; i < count; i++) {
+    sum += expTable[largest - input[i]];
+  }
+  for (uint16_t i = 0; i < count; i++) {
+    uint32_t probability = ((uint32_t)expTable[largest - input[i]] * 256 + sum / 2) / sum;
+    int32_t q = (int32_t)probability - 128;
+    output[i] = (int8_t)(q > 127 ? 127 : q);
+  }
+}
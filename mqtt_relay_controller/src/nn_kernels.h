@@ -0,0 +1,131 @@
+#ifndef NN_KERNELS_H
+#define NN_KERNELS_H
+
+#include <Arduino.h>
+
+// Int8 neural network kernels, quantized the way TensorFlow Lite does it.
+//
+// Tensors are int8, height x width x channels with channels innermost, and
+// each has a scale and zero point: real = scale * (q - zero). Weights are
+// symmetric (zero 0) with a scale per output channel, biases int32 in units
+// of input scale times weight scale. A kernel sums (input - inputZero) *
+// weight into an int32 accumulator starting at the bias; the output is the
+// accumulator times inputScale * weightScale / outputScale, applied as a Q31
+// multiplier and a power-of-two shift (nnRequantize(), gemmlowp's rounding),
+// plus outputZero, clamped to [activationMin, activationMax] - a ReLU is a
+// clamp at outputZero.
+//
+// Each kernel has a reference version that is the definition, one multiply
+// per innermost iteration with the bounds checked for every tap. The other
+// versions widen their operands to int16 in a caller's scratch buffer
+// (sized by the *Scratch() functions) with the zero point already taken
+// off: the weights once per call, and for convolutions and fully connected
+// layers each output position's input patch (im2col), padding included as
+// zeros, once for all output channels. Their inner loop is then a dot
+// product of aligned int16 pairs, nnDot16(): MULA.DD with LDINC into the
+// 40-bit MAC16 accumulator on the ESP32, PMADDWD on x86-64, an unrolled loop
+// elsewhere. Depthwise convolutions have one accumulator per channel and
+// no long dot products; they keep the accumulator in a register over the
+// taps that are inside the input, 16-bit multiplies (MUL16S). All sums are
+// exact, so every version agrees with the reference bit for bit.
+
+struct NnShape {
+  uint8_t height;
+  uint8_t width;
+  uint16_t channels;
+
+  constexpr size_t size() const { return (size_t)height * width * channels; }
+};
+
+// Q31 multiplier in [2^30, 2^31) and a power-of-two shift, left if positive
+struct NnRequant {
+  int32_t multiplier;
+  int8_t shift;
+};
+
+struct NnConvParams {
+  uint8_t kernelHeight;
+  uint8_t kernelWidth;
+  uint8_t strideHeight;
+  uint8_t strideWidth;
+  uint8_t padTop;    // "Same" padding; the bottom and right follow from the shapes
+  uint8_t padLeft;
+  int8_t inputZero;
+  int8_t outputZero;
+  int8_t activationMin;
+  int8_t activationMax;
+};
+
+struct NnFullyConnectedParams {
+  int8_t inputZero;
+  int8_t outputZero;
+  int8_t activationMin;
+  int8_t activationMax;
+};
+
+// Rows of widened weights and patches are padded to whole MAC16 iterations
+constexpr size_t nnDotLength(size_t count) { return (count + 3) & ~(size_t)3; }
+
+// int16 entries of scratch each optimized kernel needs
+constexpr size_t nnConv2dScratch(const NnConvParams& params, const NnShape& input, const NnShape& output) {
+  return nnDotLength((size_t)params.kernelHeight * params.kernelWidth * input.channels) * (output.channels + 1);
+}
+constexpr size_t nnDepthwiseConv2dScratch(const NnConvParams& params, const NnShape& input) {
+  return (size_t)params.kernelHeight * params.kernelWidth * input.channels;
+}
+constexpr size_t nnFullyConnectedScratch(uint16_t inputs, uint16_t outputs) {
+  return nnDotLength(inputs) * (outputs + 1);
+}
+
+// (acc * multiplier) >> (31 - shift), rounded as gemmlowp does
+int32_t nnRequantize(int32_t acc, NnRequant requant);
+
+// Sum of a[i] * b[i]; a and b 4-byte aligned, count a multiple of 4 and
+// the sum within int32
+int32_t nnDot16Reference(const int16_t* a, const int16_t* b, size_t count);
+int32_t nnDot16Unrolled(const int16_t* a, const int16_t* b, size_t count);
+#if defined(__XTENSA__)
+int32_t nnDot16Mac16(const int16_t* a, const int16_t* b, size_t count);
+#endif
+#if defined(__x86_64__)
+int32_t nnDot16Sse2(const int16_t* a, const int16_t* b, size_t count);
+#endif
+// The best of them for this CPU, and its name
+int32_t nnDot16(const int16_t* a, const int16_t* b, size_t count);
+const char* nnDotKernel();
+
+// filter: output channels x kernelHeight x kernelWidth x input channels;
+// bias and requant per output channel
+void nnConv2dReference(const NnConvParams& params, const NnShape& inputShape, const int8_t* input,
+                       const int8_t* filter, const int32_t* bias, const NnRequant* requant,
+                       const NnShape& outputShape, int8_t* output);
+void nnConv2d(const NnConvParams& params, const NnShape& inputShape, const int8_t* input, const int8_t* filter,
+              const int32_t* bias, const NnRequant* requant, const NnShape& outputShape, int8_t* output,
+              int16_t* scratch);
+
+// Depth multiplier 1; filter: kernelHeight x kernelWidth x channels
+void nnDepthwiseConv2dReference(const NnConvParams& params, const NnShape& inputShape, const int8_t* input,
+                                const int8_t* filter, const int32_t* bias, const NnRequant* requant,
+                                const NnShape& outputShape, int8_t* output);
+void nnDepthwiseConv2d(const NnConvParams& params, const NnShape& inputShape, const int8_t* input,
+                       const int8_t* filter, const int32_t* bias, const NnRequant* requant,
+                       const NnShape& outputShape, int8_t* output, int16_t* scratch);
+
+// weights: outputs x inputs; bias and requant per output
+void nnFullyConnectedReference(const NnFullyConnectedParams& params, uint16_t inputs, const int8_t* input,
+                               const int8_t* weights, const int32_t* bias, const NnRequant* requant,
+                               uint16_t outputs, int8_t* output);
+void nnFullyConnected(const NnFullyConnectedParams& params, uint16_t inputs, const int8_t* input,
+                      const int8_t* weights, const int32_t* bias, const NnRequant* requant, uint16_t outputs,
+                      int8_t* output, int16_t* scratch);
+
+// Mean over height and width, rounded half away from zero; the output has
+// the input's scale and zero point
+void nnAveragePool(const NnShape& inputShape, const int8_t* input, int8_t* output);
+
+// Probabilities with scale 1/256 and zero point -128. expTable[d] is
+// exp(-d * inputScale) in Q16 (65535 for d = 0), d the distance below the
+// largest input.
+void nnSoftmax(const int8_t* input, uint16_t count, const uint16_t* expTable, int8_t* output);
+
+#endif
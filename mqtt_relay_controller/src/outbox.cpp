@@ -0,0 +1,485 @@
+#include "outbox.h"
+#include "profiling.h"
+
+#include <esp_timer.h>
+#include <stddef.h>
+
+Outbox outbox;
+
+namespace {
+
+const uint32_t FNV_OFFSET = 2166136261u;
+const uint32_t FNV_PRIME = 16777619u;
+
+uint32_t fnv(uint32_t hash, const uint8_t* data, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    hash = (hash ^ data[i]) * FNV_PRIME;
+  }
+  return hash;
+}
+
+// serializeJson() target for records too large for the cache: hashes the
+// bytes, or programs them into flash 64 bytes at a time
+class RecordWriter : public Print {
+public:
+  RecordWriter(const esp_partition_t* partition, size_t offset, uint32_t hash)
+    : partition(partition), offset(offset), hash(hash), used(0), ok(true) {}
+
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override {
+    for (size_t i = 0; i < size; i++) {
+      chunk[used++] = buffer[i];
+      if (used == sizeof(chunk)) {
+        flush();
+      }
+    }
+    return size;
+  }
+  void flush() override {
+    if (used == 0) {
+      return;
+    }
+    hash = fnv(hash, chunk, used);
+    if (partition != nullptr) {
+      ok = ok && esp_partition_write(partition, offset, chunk, used) == ESP_OK;
+      offset += used;
+    }
+    used = 0;
+  }
+  uint32_t digest() const { return hash; }
+  bool succeeded() const { return ok; }
+
+private:
+  const esp_partition_t* partition;  // nullptr: hash only
+  size_t offset;
+  uint32_t hash;
+  uint8_t chunk[64];
+  size_t used;
+  bool ok;
+};
+
+} // namespace
+
+Outbox::Outbox()
+  : partition(nullptr), sectors(0), activeSector(-1), writeOffset(0), generation(0), nextSequence(1),
+    count(0), cacheUsed(0), cachedAt(0), drainRate(DEFAULT_DRAIN_RATE), draining(false),
+    drainStartedAt(0), drainedRecords(0) {
+  memset(&counters, 0, sizeof(counters));
+}
+
+uint32_t Outbox::checksum(const RecordHeader& header, const uint8_t* data, size_t length) {
+  uint32_t hash = fnv(FNV_OFFSET, (const uint8_t*)&header.length, sizeof(header.length));
+  hash = fnv(hash, &header.priority, sizeof(header.priority));
+  hash = fnv(hash, (const uint8_t*)&header.sequence, sizeof(header.sequence));
+  return data != nullptr ? fnv(hash, data, length) : hash;
+}
+
+bool Outbox::readSectorHeader(uint8_t sector, uint32_t& sectorGeneration, uint32_t& firstSequence) {
+  SectorHeader header;
+  if (esp_partition_read(partition, sectorOffset(sector), &header, sizeof(header)) != ESP_OK) {
+    return false;
+  }
+  if (header.magic != MAGIC || header.version != FORMAT_VERSION ||
+      header.check != ~(header.generation ^ header.firstSequence)) {
+    return false;
+  }
+  sectorGeneration = header.generation;
+  firstSequence = header.firstSequence;
+  return true;
+}
+
+// Walk the records of a sector and index the unsent ones. In the newest
+// sector the walk also finds where the next record goes.
+void Outbox::replaySector(uint8_t sector, bool newest) {
+  uint16_t offset = sizeof(SectorHeader);
+  bool clean = false;
+  while (offset + sizeof(RecordHeader) <= SPI_FLASH_SEC_SIZE) {
+    RecordHeader header;
+    if (esp_partition_read(partition, sectorOffset(sector) + offset, &header, sizeof(header)) != ESP_OK) {
+      break;
+    }
+    if (header.length == 0xFFFF) {
+      clean = true;
+      break;
+    }
+    uint16_t data = offset + sizeof(RecordHeader);
+    if (header.length > SPI_FLASH_SEC_SIZE - data) {
+      break;
+    }
+    if (header.sent == 0xFF) {
+      // Verify in cache-sized pieces; the cache is empty until the first enqueue()
+      uint32_t hash = checksum(header, nullptr, 0);
+      for (uint16_t done = 0; done < header.length; ) {
+        uint16_t piece = header.length - done < CACHE_SIZE ? header.length - done : CACHE_SIZE;
+        if (esp_partition_read(partition, sectorOffset(sector) + data + done, cache, piece) != ESP_OK) {
+          break;
+        }
+        hash = fnv(hash, cache, piece);
+        done += piece;
+      }
+      if (hash != header.check) {
+        // Torn by a power cut: the last record written, nothing follows it
+        break;
+      }
+      Entry entry = {header.sequence, data, header.length, sector, header.priority};
+      if (!addEntry(entry)) {
+        counters.dropped++;
+      }
+    }
+    if (header.sequence >= nextSequence) {
+      nextSequence = header.sequence + 1;
+    }
+    offset = data + header.length;
+  }
+  if (newest) {
+    // Never append after a torn record
+    writeOffset = clean ? offset : SPI_FLASH_SEC_SIZE;
+  }
+}
+
+// Open the partition and index the records not yet sent
+bool Outbox::begin(const char* partitionLabel) {
+  PROFILE_SCOPE("Outbox::begin");
+  int64_t start = esp_timer_get_time();
+  partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, partitionLabel);
+  if (partition == nullptr || partition->size / SPI_FLASH_SEC_SIZE < 2) {
+    partition = nullptr;
+    return false;
+  }
+  uint32_t sectorCount = partition->size / SPI_FLASH_SEC_SIZE;
+  sectors = sectorCount > 64 ? 64 : sectorCount;
+  count = 0;
+  cacheUsed = 0;
+
+  // The newest sector has the highest generation
+  int8_t newest = -1;
+  uint32_t newestGeneration = 0;
+  for (uint8_t sector = 0; sector < sectors; sector++) {
+    uint32_t sectorGeneration, firstSequence;
+    if (readSectorHeader(sector, sectorGeneration, firstSequence) &&
+        (newest < 0 || sectorGeneration > newestGeneration)) {
+      newest = sector;
+      newestGeneration = sectorGeneration;
+      if (firstSequence > nextSequence) {
+        nextSequence = firstSequence;
+      }
+    }
+  }
+
+  if (newest >= 0) {
+    // Oldest first, so the index comes out in sequence order
+    for (uint8_t i = 1; i <= sectors; i++) {
+      uint8_t sector = (newest + i) % sectors;
+      uint32_t sectorGeneration, firstSequence;
+      if (readSectorHeader(sector, sectorGeneration, firstSequence) &&
+          sectorGeneration <= newestGeneration && newestGeneration - sectorGeneration < sectors) {
+        replaySector(sector, sector == newest);
+      }
+    }
+    activeSector = newest;
+    generation = newestGeneration;
+  }
+
+  counters.replayUs = esp_timer_get_time() - start;
+  if (count > counters.maxDepth) {
+    counters.maxDepth = count;
+  }
+  return true;
+}
+
+bool Outbox::addEntry(const Entry& entry) {
+  if (count == MAX_RECORDS) {
+    return false;
+  }
+  entries[count++] = entry;
+  return true;
+}
+
+// Take an entry out of the index; `markSent` also clears its sent byte so
+// the next boot does not index it again
+void Outbox::removeEntry(uint8_t index, bool markSent) {
+  const Entry& entry = entries[index];
+  if (markSent && entry.sector != IN_CACHE) {
+    uint8_t sent = 0;
+    size_t at = sectorOffset(entry.sector) + entry.offset - sizeof(RecordHeader) + offsetof(RecordHeader, sent);
+    if (esp_partition_write(partition, at, &sent, 1) != ESP_OK) {
+      counters.failures++;
+    }
+  }
+  memmove(entries + index, entries + index + 1, (count - index - 1) * sizeof(Entry));
+  count--;
+
+  // A cache whose records have all gone out needs no flush
+  bool cached = false;
+  for (uint8_t i = 0; i < count && !cached; i++) {
+    cached = entries[i].sector == IN_CACHE;
+  }
+  if (!cached) {
+    cacheUsed = 0;
+  }
+}
+
+// The ring is about to erase `sector`: its unsent records are lost
+void Outbox::dropSector(uint8_t sector) {
+  for (uint8_t i = count; i > 0; i--) {
+    if (entries[i - 1].sector == sector) {
+      removeEntry(i - 1, false);
+      counters.dropped++;
+    }
+  }
+}
+
+// Make room for `size` bytes in the active sector, starting the next sector
+// of the ring if needed
+bool Outbox::reserve(uint16_t size) {
+  if (activeSector >= 0 && writeOffset + size <= SPI_FLASH_SEC_SIZE) {
+    return true;
+  }
+  uint8_t sector = activeSector < 0 ? 0 : (activeSector + 1) % sectors;
+  dropSector(sector);
+  // Whatever happens next, the old active sector is finished
+  activeSector = sector;
+  writeOffset = SPI_FLASH_SEC_SIZE;
+  if (esp_partition_erase_range(partition, sectorOffset(sector), SPI_FLASH_SEC_SIZE) != ESP_OK) {
+    counters.failures++;
+    return false;
+  }
+  counters.erases++;
+  generation++;
+  SectorHeader header = {MAGIC, generation, nextSequence, FORMAT_VERSION, 0xFFFF, ~(generation ^ nextSequence)};
+  if (esp_partition_write(partition, sectorOffset(sector), &header, sizeof(header)) != ESP_OK) {
+    counters.failures++;
+    return false;
+  }
+  writeOffset = sizeof(SectorHeader);
+  return true;
+}
+
+// Append a cached record (its header followed by the data) to the ring
+bool Outbox::writeRecord(const uint8_t* record) {
+  RecordHeader header;
+  memcpy(&header, record, sizeof(header));
+  uint16_t size = sizeof(RecordHeader) + header.length;
+  if (!reserve(size)) {
+    return false;
+  }
+  if (esp_partition_write(partition, sectorOffset(activeSector) + writeOffset, record, size) != ESP_OK) {
+    // Possibly half written: append nothing more to this sector
+    writeOffset = SPI_FLASH_SEC_SIZE;
+    counters.failures++;
+    return false;
+  }
+  writeOffset += size;
+  return true;
+}
+
+// Queue a message; adds "seq" to `doc`. Returns false if it was dropped.
+bool Outbox::enqueue(const char* topic, JsonDocument& doc, Priority priority) {
+  PROFILE_SCOPE("Outbox::enqueue");
+  if (partition == nullptr) {
+    counters.dropped++;
+    return false;
+  }
+  doc["seq"] = nextSequence;
+  size_t topicLength = strlen(topic);
+  size_t payloadLength = measureJson(doc);
+  size_t length = topicLength + 1 + payloadLength;
+  if (sizeof(RecordHeader) + length > SECTOR_DATA) {
+    counters.dropped++;
+    return false;
+  }
+
+  if (count == MAX_RECORDS) {
+    // Make room by dropping the oldest record of the lowest priority
+    uint8_t victim = 0;
+    for (uint8_t i = 1; i < count; i++) {
+      if (entries[i].priority > entries[victim].priority) {
+        victim = i;
+      }
+    }
+    removeEntry(victim, true);
+    counters.dropped++;
+  }
+
+  RecordHeader header = {(uint16_t)length, (uint8_t)priority, 0xFF, nextSequence, 0};
+  Entry entry = {nextSequence, 0, (uint16_t)length, IN_CACHE, (uint8_t)priority};
+  // serializeJson() also writes a terminating NUL
+  size_t size = sizeof(RecordHeader) + length + 1;
+  if (size <= CACHE_SIZE) {
+    if (cacheUsed + size > CACHE_SIZE && !flush()) {
+      counters.dropped++;
+      return false;
+    }
+    uint8_t* data = cache + cacheUsed + sizeof(RecordHeader);
+    memcpy(data, topic, topicLength + 1);
+    serializeJson(doc, (char*)data + topicLength + 1, payloadLength + 1);
+    header.check = checksum(header, data, length);
+    memcpy(cache + cacheUsed, &header, sizeof(header));
+    if (cacheUsed == 0) {
+      cachedAt = millis();
+    }
+    entry.offset = cacheUsed + sizeof(RecordHeader);
+    cacheUsed += sizeof(RecordHeader) + length;
+  } else {
+    // Larger than the cache: serialize twice, once for the check and once into flash
+    RecordWriter hasher(nullptr, 0, checksum(header, (const uint8_t*)topic, topicLength + 1));
+    serializeJson(doc, hasher);
+    hasher.flush();
+    header.check = hasher.digest();
+    if (!reserve(sizeof(RecordHeader) + length)) {
+      counters.dropped++;
+      return false;
+    }
+    size_t at = sectorOffset(activeSector) + writeOffset;
+    bool ok = esp_partition_write(partition, at, &header, sizeof(header)) == ESP_OK &&
+              esp_partition_write(partition, at + sizeof(header), topic, topicLength + 1) == ESP_OK;
+    RecordWriter writer(partition, at + sizeof(header) + topicLength + 1, 0);
+    if (ok) {
+      serializeJson(doc, writer);
+      writer.flush();
+    }
+    entry.sector = activeSector;
+    entry.offset = writeOffset + sizeof(RecordHeader);
+    writeOffset += sizeof(RecordHeader) + length;
+    if (!ok || !writer.succeeded()) {
+      writeOffset = SPI_FLASH_SEC_SIZE;
+      counters.failures++;
+      counters.dropped++;
+      return false;
+    }
+  }
+
+  nextSequence++;
+  entries[count++] = entry;
+  counters.queued++;
+  if (count > counters.maxDepth) {
+    counters.maxDepth = count;
+  }
+  return true;
+}
+
+// Milliseconds until poll() will flush the cache, UINT32_MAX when it is empty
+uint32_t Outbox::nextFlushMs() const {
+  if (cacheUsed == 0) {
+    return UINT32_MAX;
+  }
+  long wait = (long)(cachedAt + FLUSH_DEFER_MS - millis());
+  return wait > 0 ? (uint32_t)wait : 0;
+}
+
+// Write the cache to flash once it is due
+void Outbox::poll() {
+  if (cacheUsed > 0 && nextFlushMs() == 0) {
+    flush();
+  }
+}
+
+// Write the cache to flash now (e.g. before a reboot)
+bool Outbox::flush() {
+  if (cacheUsed == 0) {
+    return true;
+  }
+  PROFILE_SCOPE("Outbox::flush");
+  for (;;) {
+    // Cached records are in index order. Starting a sector can drop
+    // entries and shift the index, so look the record up again after it.
+    uint8_t index = 0;
+    while (index < count && entries[index].sector != IN_CACHE) {
+      index++;
+    }
+    if (index == count) {
+      break;
+    }
+    uint32_t sequence = entries[index].sequence;
+    if (!writeRecord(cache + entries[index].offset - sizeof(RecordHeader))) {
+      // What did not make it stays cached and is tried again on the next flush
+      cachedAt = millis();
+      return false;
+    }
+    for (index = 0; entries[index].sequence != sequence; index++) {
+    }
+    entries[index].sector = activeSector;
+    entries[index].offset = writeOffset - entries[index].length;
+  }
+  cacheUsed = 0;
+  counters.flushes++;
+  return true;
+}
+
+// Publish the next record through `client`; false when there is nothing
+// to send or the client refused it
+bool Outbox::sendNext(PubSubClient& client) {
+  PROFILE_SCOPE("Outbox::sendNext");
+  if (count == 0 || !client.connected()) {
+    return false;
+  }
+  // Events first, oldest first
+  uint8_t next = 0;
+  for (uint8_t i = 1; i < count; i++) {
+    if (entries[i].priority < entries[next].priority ||
+        (entries[i].priority == entries[next].priority && entries[i].sequence < entries[next].sequence)) {
+      next = i;
+    }
+  }
+  const Entry& entry = entries[next];
+  uint8_t qos = entry.priority == PRIORITY_EVENT ? 1 : 0;
+
+  bool ok;
+  if (entry.sector == IN_CACHE) {
+    const char* topic = (const char*)cache + entry.offset;
+    size_t topicLength = strlen(topic);
+    size_t payloadLength = entry.length - topicLength - 1;
+    MqttSegment payload = {(const uint8_t*)topic + topicLength + 1, payloadLength};
+    ok = client.publishv(topic, &payload, 1, false, qos);
+  } else {
+    // Copy it through a small buffer; the topic is in the first piece
+    uint8_t piece[256];
+    size_t at = sectorOffset(entry.sector) + entry.offset;
+    uint16_t size = entry.length < sizeof(piece) ? entry.length : sizeof(piece);
+    if (esp_partition_read(partition, at, piece, size) != ESP_OK) {
+      counters.failures++;
+      return false;
+    }
+    size_t topicLength = strnlen((const char*)piece, size);
+    if (topicLength == size) {
+      // Not a record this firmware wrote; get rid of it
+      removeEntry(next, true);
+      counters.dropped++;
+      return false;
+    }
+    size_t payloadLength = entry.length - topicLength - 1;
+    if (!client.beginPublish((const char*)piece, payloadLength, false, qos)) {
+      return false;
+    }
+    client.write(piece + topicLength + 1, size - topicLength - 1);
+    for (size_t done = size; done < entry.length; done += size) {
+      size = entry.length - done < sizeof(piece) ? entry.length - done : sizeof(piece);
+      if (esp_partition_read(partition, at + done, piece, size) != ESP_OK) {
+        // The packet on the wire is cut short; only a new session recovers
+        counters.failures++;
+        client.disconnect();
+        return false;
+      }
+      client.write(piece, size);
+    }
+    ok = client.endPublish();
+  }
+  if (!ok) {
+    return false;
+  }
+
+  if (!draining) {
+    draining = true;
+    drainStartedAt = millis();
+    drainedRecords = 0;
+  }
+  drainedRecords++;
+  counters.sent++;
+  removeEntry(next, true);
+  if (count == 0) {
+    draining = false;
+    counters.lastDrainRecords = drainedRecords;
+    counters.lastDrainMs = millis() - drainStartedAt;
+  }
+  return true;
+}
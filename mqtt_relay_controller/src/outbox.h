@@ -0,0 +1,140 @@
+#ifndef OUTBOX_H
+#define OUTBOX_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <PubSubClient.h>
+#include <esp_partition.h>
+
+// Store-and-forward queue for messages produced while MQTT is down.
+//
+// enqueue() gives the document the next sequence number ("seq") and
+// serializes it into a RAM cache. The cache is written to a raw flash
+// partition FLUSH_DEFER_MS after its first record, or when it fills, so an
+// outage shorter than that costs no flash at all. The partition is a ring
+// of 4 KB sectors holding variable-length records
+// {length, priority, sent, sequence, check, topic\0payload}; when the ring
+// is full the oldest sector is erased and its unsent records are lost,
+// which the backend sees as a gap in "seq". Records larger than the cache
+// go straight to flash.
+//
+// Once connected, sendNext() publishes one record at a time, events before
+// telemetry and oldest first within a priority, and marks it sent by
+// clearing its `sent` byte in flash. The caller paces the calls
+// (drainIntervalMs()). Unsent records survive a reboot: begin() walks the
+// ring and rebuilds the RAM index.
+
+struct OutboxStats {
+  uint32_t queued;        // Records accepted by enqueue()
+  uint32_t sent;
+  uint32_t dropped;       // Lost unsent: ring or index full, or too large
+  uint32_t flushes;       // Cache flushes to flash
+  uint32_t erases;
+  uint32_t failures;      // Flash errors
+  uint16_t maxDepth;
+  uint16_t lastDrainRecords;
+  uint32_t lastDrainMs;   // First to last record sent after the last reconnect
+  uint32_t replayUs;      // begin(): walk the ring and rebuild the index
+};
+
+class Outbox {
+public:
+  enum Priority { PRIORITY_EVENT = 0, PRIORITY_TELEMETRY = 1 };
+
+  static const uint8_t MAX_RECORDS = 128;
+  static const uint16_t CACHE_SIZE = 2048;
+  static const uint32_t FLUSH_DEFER_MS = 10000;
+  static const uint16_t DEFAULT_DRAIN_RATE = 20;  // Records per second
+  static const uint16_t FORMAT_VERSION = 1;
+
+  Outbox();
+
+  // Open the partition and index the records not yet sent
+  bool begin(const char* partitionLabel);
+  bool ready() const { return partition != nullptr; }
+
+  // Queue a message; adds "seq" to `doc`. Returns false if it was dropped.
+  bool enqueue(const char* topic, JsonDocument& doc, Priority priority);
+  uint8_t depth() const { return count; }
+
+  // Publish the next record through `client`; false when there is nothing
+  // to send or the client refused it
+  bool sendNext(PubSubClient& client);
+  void setDrainRate(uint16_t recordsPerSecond) { drainRate = recordsPerSecond ? recordsPerSecond : 1; }
+  uint32_t drainIntervalMs() const { return 1000 / drainRate; }
+
+  // Milliseconds until poll() will flush the cache, UINT32_MAX when it is empty
+  uint32_t nextFlushMs() const;
+  // Write the cache to flash once it is due
+  void poll();
+  // Write the cache to flash now (e.g. before a reboot)
+  bool flush();
+
+  const OutboxStats& stats() const { return counters; }
+
+private:
+  struct SectorHeader {
+    uint32_t magic;
+    uint32_t generation;
+    uint32_t firstSequence;    // Next sequence number when the sector was started
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t check;            // ~(generation ^ firstSequence)
+  };
+
+  struct RecordHeader {
+    uint16_t length;           // topic\0payload bytes; 0xFFFF: free space
+    uint8_t priority;
+    uint8_t sent;              // 0xFF until published, then 0x00
+    uint32_t sequence;
+    uint32_t check;            // FNV-1a of length, priority, sequence and data
+  };
+
+  // A record not yet sent, in the cache or in a sector
+  struct Entry {
+    uint32_t sequence;
+    uint16_t offset;
+    uint16_t length;           // Data bytes, header excluded
+    uint8_t sector;            // IN_CACHE while only in RAM
+    uint8_t priority;
+  };
+
+  static const uint32_t MAGIC = 0x5842544F;  // "OTBX"
+  static const uint8_t IN_CACHE = 0xFF;
+  static const uint16_t SECTOR_DATA = SPI_FLASH_SEC_SIZE - sizeof(SectorHeader);
+
+  const esp_partition_t* partition;
+  uint8_t sectors;
+  int8_t activeSector;         // -1 until the first sector is started
+  uint16_t writeOffset;        // Next free byte in the active sector
+  uint32_t generation;
+  uint32_t nextSequence;
+
+  Entry entries[MAX_RECORDS];
+  uint8_t count;
+
+  uint8_t cache[CACHE_SIZE];
+  uint16_t cacheUsed;
+  unsigned long cachedAt;
+
+  uint16_t drainRate;
+  bool draining;
+  unsigned long drainStartedAt;
+  uint16_t drainedRecords;
+
+  OutboxStats counters;
+
+  static uint32_t checksum(const RecordHeader& header, const uint8_t* data, size_t length);
+  size_t sectorOffset(uint8_t sector) const { return (size_t)sector * SPI_FLASH_SEC_SIZE; }
+  bool readSectorHeader(uint8_t sector, uint32_t& sectorGeneration, uint32_t& firstSequence);
+  void replaySector(uint8_t sector, bool newest);
+  bool addEntry(const Entry& entry);
+  void removeEntry(uint8_t index, bool markSent);
+  void dropSector(uint8_t sector);
+  bool reserve(uint16_t size);
+  bool writeRecord(const uint8_t* record);
+};
+
+extern Outbox outbox;
+
+#endif
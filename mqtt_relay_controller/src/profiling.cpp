@@ -0,0 +1,66 @@
+#include "profiling.h"
+
+#ifdef ENABLE_PROFILING
+
+#ifdef HOST_NATIVE
+#include <HostHal.h>
+#endif
+
+static ProfileSlot* slotList = nullptr;
+
+// Link a slot into the report list the first time its scope runs
+void profilingRegister(ProfileSlot& slot) {
+  slot.registered = true;
+  slot.next = slotList;
+  slotList = &slot;
+}
+
+ProfileSlot* profilingSlots() {
+  return slotList;
+}
+
+ProfileSlot* profilingFind(const char* name) {
+  for (ProfileSlot* slot = slotList; slot != nullptr; slot = slot->next) {
+    if (strcmp(slot->name, name) == 0) {
+      return slot;
+    }
+  }
+  return nullptr;
+}
+
+void profilingReset() {
+  for (ProfileSlot* slot = slotList; slot != nullptr; slot = slot->next) {
+    slot->calls = 0;
+    slot->cycles = 0;
+    slot->maxCycles = 0;
+    slot->allocations = 0;
+  }
+}
+
+// Heap allocation counter; only the host build can observe malloc
+uint64_t profilingAllocationCount() {
+#ifdef HOST_NATIVE
+  host::HeapStats stats = host::heapStats();
+  return stats.allocations + stats.reallocations;
+#else
+  return 0;
+#endif
+}
+
+// Print one line per profiled function: calls, mean/max cycles, allocations per call
+void profilingReport(Print& out) {
+  out.printf("%-28s %10s %14s %14s %12s\n", "function", "calls", "cycles/call", "max cycles", "allocs/call");
+  for (ProfileSlot* slot = slotList; slot != nullptr; slot = slot->next) {
+    if (slot->calls == 0) {
+      continue;
+    }
+    out.printf("%-28s %10u %14.0f %14u %12.2f\n",
+               slot->name,
+               (unsigned)slot->calls,
+               (double)slot->cycles / slot->calls,
+               (unsigned)slot->maxCycles,
+               (double)slot->allocations / slot->calls);
+  }
+}
+
+#endif
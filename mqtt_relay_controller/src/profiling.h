@@ -0,0 +1,70 @@
+#ifndef PROFILING_H
+#define PROFILING_H
+
+// Per-function profiling hooks.
+//
+// PROFILE_SCOPE("name") at the top of a function accumulates call count,
+// CPU cycles (ESP.getCycleCount(), i.e. CCOUNT on target, rdtsc on host) and
+// heap allocations (host build only) for that function. Without
+// -DENABLE_PROFILING the macro compiles to nothing, so it is free to leave
+// in hot paths.
+
+#ifdef ENABLE_PROFILING
+
+#include <Arduino.h>
+
+struct ProfileSlot {
+  const char* name;
+  uint32_t calls;
+  uint64_t cycles;
+  uint32_t maxCycles;
+  uint64_t allocations;
+  bool registered;
+  ProfileSlot* next;
+};
+
+void profilingRegister(ProfileSlot& slot);
+ProfileSlot* profilingSlots();
+ProfileSlot* profilingFind(const char* name);
+void profilingReset();
+void profilingReport(Print& out);
+uint64_t profilingAllocationCount();
+
+class ProfileScope {
+public:
+  explicit ProfileScope(ProfileSlot& slot)
+      : slot(slot), startCycles(ESP.getCycleCount()), startAllocations(profilingAllocationCount()) {
+    if (!slot.registered) {
+      profilingRegister(slot);
+    }
+  }
+
+  ~ProfileScope() {
+    uint32_t elapsed = ESP.getCycleCount() - startCycles;
+    slot.calls++;
+    slot.cycles += elapsed;
+    if (elapsed > slot.maxCycles) {
+      slot.maxCycles = elapsed;
+    }
+    slot.allocations += profilingAllocationCount() - startAllocations;
+  }
+
+private:
+  ProfileSlot& slot;
+  uint32_t startCycles;
+  uint64_t startAllocations;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name)                                                              \
+  static ProfileSlot PROFILE_CONCAT(profileSlot_, __LINE__) = {name, 0, 0, 0, 0, false, nullptr}; \
+  ProfileScope PROFILE_CONCAT(profileScope_, __LINE__)(PROFILE_CONCAT(profileSlot_, __LINE__))
+
+#else
+
+#define PROFILE_SCOPE(name) do {} while (0)
+
+#endif
+
+#endif
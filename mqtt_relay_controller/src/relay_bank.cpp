@@ -0,0 +1,66 @@
+#include "relay_bank.h"
+
+#include <soc/gpio_struct.h>
+
+RelayBank relays;
+
+RelayBank::RelayBank() : channels(0), current(0) {
+  memset(pins, 0, sizeof(pins));
+  memset(&counters, 0, sizeof(counters));
+}
+
+// Configure the pins as outputs and drive them to `initialState`
+bool RelayBank::begin(const uint8_t* channelPins, uint8_t count, uint32_t initialState) {
+  if (count == 0 || count > MAX_CHANNELS) {
+    return false;
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    // GPIO34-39 are input only
+    if (channelPins[i] >= 34) {
+      return false;
+    }
+  }
+
+  memcpy(pins, channelPins, count);
+  channels = count;
+  current = initialState & allMask();
+  for (uint8_t i = 0; i < channels; i++) {
+    pinMode(pins[i], OUTPUT);
+  }
+  write(current, allMask() & ~current);
+  return true;
+}
+
+// Switch the channels in `mask` to the levels in `values`; returns the bits that changed
+uint32_t RelayBank::apply(uint32_t mask, uint32_t values) {
+  mask &= allMask();
+  uint32_t next = (current & ~mask) | (values & mask);
+  uint32_t changed = next ^ current;
+  if (changed == 0) {
+    return 0;
+  }
+  current = next;
+  write(changed & next, changed & ~next);
+  counters.batches++;
+  counters.switches += __builtin_popcount(changed);
+  return changed;
+}
+
+// One store per register: HIGH (relay on) via w1ts, LOW via w1tc
+void RelayBank::write(uint32_t onChannels, uint32_t offChannels) {
+  uint32_t set0 = 0, clear0 = 0, set1 = 0, clear1 = 0;
+  for (uint8_t i = 0; i < channels; i++) {
+    uint32_t channelBit = 1UL << i;
+    uint8_t gpio = pins[i];
+    if (onChannels & channelBit) {
+      if (gpio < 32) set0 |= 1UL << gpio; else set1 |= 1UL << (gpio - 32);
+    } else if (offChannels & channelBit) {
+      if (gpio < 32) clear0 |= 1UL << gpio; else clear1 |= 1UL << (gpio - 32);
+    }
+  }
+
+  if (set0) { GPIO.out_w1ts = set0; counters.registerWrites++; }
+  if (clear0) { GPIO.out_w1tc = clear0; counters.registerWrites++; }
+  if (set1) { GPIO.out1_w1ts.val = set1; counters.registerWrites++; }
+  if (clear1) { GPIO.out1_w1tc.val = clear1; counters.registerWrites++; }
+}
@@ -0,0 +1,51 @@
+#ifndef RELAY_BANK_H
+#define RELAY_BANK_H
+
+#include <Arduino.h>
+
+// Bank of relay channels driven from GPIO outputs.
+//
+// Channel state is a bitmask (bit n = channel n on). apply() changes any
+// subset of channels with one store to the GPIO set register and one to the
+// clear register per 32-pin bank, so every relay in a batch switches
+// together. The w1ts/w1tc registers only touch the bits written, so no
+// read-modify-write of the output register can race other pin users.
+
+struct RelayBankStats {
+  uint32_t batches;         // apply() calls that changed at least one channel
+  uint32_t switches;        // Individual channel changes
+  uint32_t registerWrites;  // GPIO set/clear register stores
+};
+
+class RelayBank {
+public:
+  static const uint8_t MAX_CHANNELS = 16;
+
+  RelayBank();
+
+  // Configure the pins as outputs and drive them to `initialState`
+  bool begin(const uint8_t* channelPins, uint8_t count, uint32_t initialState);
+
+  // Switch the channels in `mask` to the levels in `values`; returns the bits that changed
+  uint32_t apply(uint32_t mask, uint32_t values);
+  uint32_t set(uint8_t channel, bool on) { return apply(1UL << channel, on ? 1UL << channel : 0); }
+
+  uint8_t count() const { return channels; }
+  uint32_t allMask() const { return channels >= 32 ? UINT32_MAX : (1UL << channels) - 1; }
+  uint32_t state() const { return current; }
+  bool isOn(uint8_t channel) const { return (current >> channel) & 1; }
+  uint8_t pin(uint8_t channel) const { return pins[channel]; }
+  const RelayBankStats& stats() const { return counters; }
+
+private:
+  uint8_t pins[MAX_CHANNELS];
+  uint8_t channels;
+  uint32_t current;
+  RelayBankStats counters;
+
+  void write(uint32_t onChannels, uint32_t offChannels);
+};
+
+extern RelayBank relays;
+
+#endif
@@ -0,0 +1,291 @@
+#include "scheduler.h"
+
+#include <esp_vfs_eventfd.h>
+#include <unistd.h>
+
+#ifdef HOST_NATIVE
+#include <HostHal.h>
+#else
+#include <sys/select.h>
+#endif
+
+Scheduler scheduler;
+
+Scheduler::Scheduler()
+  : numTasks(0), heapSize(0), client(nullptr), eventFd(-1), pendingEvents(0), idleTotal(0) {
+}
+
+// Create the wake-up eventfd and watch `client` for incoming data
+void Scheduler::begin(WiFiClient& mqttClient) {
+  client = &mqttClient;
+
+  esp_vfs_eventfd_config_t config = ESP_VFS_EVENTD_CONFIG_DEFAULT();
+  esp_err_t result = esp_vfs_eventfd_register(&config);
+  if (result != ESP_OK && result != ESP_ERR_INVALID_STATE) {
+    Serial.printf("⚠️ Scheduler: eventfd unavailable (%d), falling back to timed waits\n", result);
+    return;
+  }
+  eventFd = eventfd(0, EFD_SUPPORT_ISR);
+  if (eventFd < 0) {
+    Serial.println("⚠️ Scheduler: failed to create eventfd, falling back to timed waits");
+  }
+}
+
+// Add a task; returns its id or -1 when the table is full
+int8_t Scheduler::addTask(const char* name, uint32_t periodMs, TaskCallback callback, uint32_t eventMask) {
+  if (numTasks >= MAX_TASKS || callback == nullptr) {
+    return -1;
+  }
+  uint8_t id = numTasks++;
+  Task& task = tasks[id];
+  task.callback = callback;
+  task.periodMicros = periodMs * 1000UL;
+  task.eventMask = eventMask;
+  task.deadline = 0;
+  task.heapIndex = -1;
+  memset(&task.stats, 0, sizeof(task.stats));
+  task.stats.name = name;
+  if (task.periodMicros > 0) {
+    schedule(id, micros() + task.periodMicros);
+  }
+  return id;
+}
+
+void Scheduler::setPeriod(int8_t id, uint32_t periodMs) {
+  if (id < 0 || id >= numTasks) return;
+  tasks[id].periodMicros = periodMs * 1000UL;
+  if (tasks[id].periodMicros == 0) {
+    unschedule(id);
+  } else {
+    schedule(id, micros() + tasks[id].periodMicros);
+  }
+}
+
+void Scheduler::runNow(int8_t id) {
+  runAfter(id, 0);
+}
+
+void Scheduler::runAfter(int8_t id, uint32_t delayMs) {
+  if (id < 0 || id >= numTasks) return;
+  schedule(id, micros() + delayMs * 1000UL);
+}
+
+int8_t Scheduler::findTask(const char* name) const {
+  for (uint8_t id = 0; id < numTasks; id++) {
+    if (strcmp(tasks[id].stats.name, name) == 0) {
+      return id;
+    }
+  }
+  return -1;
+}
+
+void Scheduler::resetStats() {
+  for (uint8_t id = 0; id < numTasks; id++) {
+    const char* name = tasks[id].stats.name;
+    memset(&tasks[id].stats, 0, sizeof(TaskStats));
+    tasks[id].stats.name = name;
+  }
+  idleTotal = 0;
+}
+
+// Wake the loop task from task context
+void Scheduler::notify(uint32_t events) {
+  __atomic_fetch_or(&pendingEvents, events, __ATOMIC_RELEASE);
+  if (eventFd >= 0) {
+    uint64_t one = 1;
+    write(eventFd, &one, sizeof(one));
+  }
+}
+
+// Wake the loop task from an interrupt handler (eventfd was created with EFD_SUPPORT_ISR)
+void IRAM_ATTR Scheduler::notifyFromISR(uint32_t events) {
+  notify(events);
+}
+
+// --- Deadline heap ---------------------------------------------------------
+
+// Wrap-safe: micros() rolls over every ~71 minutes
+bool Scheduler::before(uint8_t a, uint8_t b) const {
+  return (int32_t)(tasks[a].deadline - tasks[b].deadline) < 0;
+}
+
+void Scheduler::heapSwap(uint8_t i, uint8_t j) {
+  uint8_t a = heap[i];
+  uint8_t b = heap[j];
+  heap[i] = b;
+  heap[j] = a;
+  tasks[b].heapIndex = i;
+  tasks[a].heapIndex = j;
+}
+
+void Scheduler::siftUp(uint8_t i) {
+  while (i > 0) {
+    uint8_t parent = (i - 1) / 2;
+    if (!before(heap[i], heap[parent])) break;
+    heapSwap(i, parent);
+    i = parent;
+  }
+}
+
+void Scheduler::siftDown(uint8_t i) {
+  for (;;) {
+    uint8_t smallest = i;
+    uint8_t left = 2 * i + 1;
+    uint8_t right = left + 1;
+    if (left < heapSize && before(heap[left], heap[smallest])) smallest = left;
+    if (right < heapSize && before(heap[right], heap[smallest])) smallest = right;
+    if (smallest == i) break;
+    heapSwap(i, smallest);
+    i = smallest;
+  }
+}
+
+void Scheduler::schedule(uint8_t id, uint32_t deadline) {
+  Task& task = tasks[id];
+  task.deadline = deadline;
+  if (task.heapIndex < 0) {
+    task.heapIndex = heapSize;
+    heap[heapSize++] = id;
+  }
+  siftUp(task.heapIndex);
+  siftDown(task.heapIndex);
+}
+
+void Scheduler::unschedule(uint8_t id) {
+  int8_t index = tasks[id].heapIndex;
+  if (index < 0) return;
+  heapSize--;
+  if (index != heapSize) {
+    heapSwap(index, heapSize);
+    siftUp(index);
+    siftDown(index);
+  }
+  tasks[id].heapIndex = -1;
+}
+
+// --- Dispatch --------------------------------------------------------------
+
+// Take the pending event bits and sample the MQTT socket
+uint32_t Scheduler::collectEvents() {
+  uint32_t events = __atomic_exchange_n(&pendingEvents, 0, __ATOMIC_ACQUIRE);
+  if (client != nullptr && client->available() > 0) {
+    events |= EVENT_SOCKET;
+  }
+  return events;
+}
+
+// Sleep until the socket or eventfd becomes readable, or the timeout passes
+void Scheduler::waitForEvents(uint32_t timeoutMicros) {
+  int socketFd = client != nullptr ? client->fd() : -1;
+
+#ifdef HOST_NATIVE
+  int fds[2] = {eventFd, socketFd};
+  uint32_t ready = host::waitForActivity(fds, 2, timeoutMicros);
+  bool eventFdReady = (ready & 1) != 0;
+#else
+  if (eventFd < 0 && socketFd < 0) {
+    delay(timeoutMicros / 1000);
+    return;
+  }
+  fd_set readSet;
+  FD_ZERO(&readSet);
+  int maxFd = -1;
+  if (eventFd >= 0) {
+    FD_SET(eventFd, &readSet);
+    maxFd = eventFd;
+  }
+  if (socketFd >= 0) {
+    FD_SET(socketFd, &readSet);
+    if (socketFd > maxFd) maxFd = socketFd;
+  }
+  struct timeval tv;
+  tv.tv_sec = timeoutMicros / 1000000UL;
+  tv.tv_usec = timeoutMicros % 1000000UL;
+  int result = select(maxFd + 1, &readSet, nullptr, nullptr, &tv);
+  bool eventFdReady = result > 0 && eventFd >= 0 && FD_ISSET(eventFd, &readSet);
+#endif
+
+  // Reset the eventfd counter; the event bits themselves live in pendingEvents
+  if (eventFdReady) {
+    uint64_t count;
+    read(eventFd, &count, sizeof(count));
+  }
+}
+
+void Scheduler::runTask(uint8_t id, uint32_t lateness) {
+  Task& task = tasks[id];
+  uint32_t start = micros();
+  task.callback();
+  uint32_t elapsed = micros() - start;
+
+  TaskStats& stats = task.stats;
+  stats.runs++;
+  stats.totalMicros += elapsed;
+  if (elapsed > stats.maxMicros) stats.maxMicros = elapsed;
+  if (lateness > stats.maxLatenessMicros) stats.maxLatenessMicros = lateness;
+}
+
+// Run every task subscribed to one of `events`
+void Scheduler::runEventTasks(uint32_t events) {
+  for (uint8_t id = 0; id < numTasks; id++) {
+    if (tasks[id].eventMask & events) {
+      runTask(id, 0);
+    }
+  }
+}
+
+// One scheduling round
+void Scheduler::tick() {
+  uint32_t events = collectEvents();
+
+  // Nothing to do yet: sleep until the earliest deadline or an event
+  if (events == 0) {
+    uint32_t now = micros();
+    uint32_t timeout = MAX_IDLE_MICROS;
+    if (heapSize > 0) {
+      int32_t untilDue = (int32_t)(tasks[heap[0]].deadline - now);
+      if (untilDue <= 0) {
+        timeout = 0;
+      } else if ((uint32_t)untilDue < timeout) {
+        timeout = untilDue;
+      }
+    }
+    if (timeout > 0) {
+      waitForEvents(timeout);
+      idleTotal += micros() - now;
+      events = collectEvents();
+    }
+  }
+
+  // Events first: a relay command must not queue behind periodic work
+  if (events != 0) {
+    runEventTasks(events);
+  }
+
+  // Then every timer that was due when this round started. Each task runs at
+  // most once per round, and pending events are served between timer tasks.
+  uint32_t now = micros();
+  while (heapSize > 0 && (int32_t)(now - tasks[heap[0]].deadline) >= 0) {
+    uint8_t id = heap[0];
+    Task& task = tasks[id];
+    uint32_t lateness = now - task.deadline;
+
+    // Keep the period phase unless we fell a whole period behind
+    uint32_t next = task.deadline + task.periodMicros;
+    if ((int32_t)(next - now) <= 0) {
+      next = now + task.periodMicros;
+    }
+    if (task.periodMicros > 0) {
+      schedule(id, next);
+    } else {
+      unschedule(id);
+    }
+
+    runTask(id, lateness);
+
+    events = collectEvents();
+    if (events != 0) {
+      runEventTasks(events);
+    }
+  }
+}
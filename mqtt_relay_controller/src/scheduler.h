@@ -0,0 +1,100 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+// Cooperative, event-driven task scheduler for the main loop.
+//
+// Periodic tasks are kept in a min-heap ordered by deadline. Between
+// deadlines the loop task sleeps in select() on the MQTT socket and an
+// eventfd, so a relay command wakes it immediately instead of waiting out a
+// fixed delay(). Other contexts (ISRs, FreeRTOS tasks) wake the loop with
+// notify()/notifyFromISR() and an event bit; tasks subscribe to event bits
+// with their event mask.
+
+typedef void (*TaskCallback)();
+
+struct TaskStats {
+  const char* name;
+  uint32_t runs;
+  uint64_t totalMicros;
+  uint32_t maxMicros;
+  uint32_t maxLatenessMicros;  // Start time past the deadline, worst case
+};
+
+class Scheduler {
+public:
+  static const uint8_t MAX_TASKS = 12;
+  static const uint32_t MAX_IDLE_MICROS = 1000000;
+
+  // Event bits
+  static const uint32_t EVENT_SOCKET = 1UL << 0;  // MQTT socket has data
+  static const uint32_t EVENT_AUDIO = 1UL << 1;   // Audio frames ready
+  static const uint32_t EVENT_GPIO = 1UL << 2;    // Local input changed
+  static const uint32_t EVENT_WIFI = 1UL << 3;    // WiFi station event
+
+  Scheduler();
+
+  // Create the wake-up eventfd and watch `client` for incoming data
+  void begin(WiFiClient& client);
+
+  // Add a task that runs every `periodMs` (0 = event driven only) and
+  // whenever one of the `eventMask` bits fires. Returns the task id or -1.
+  int8_t addTask(const char* name, uint32_t periodMs, TaskCallback callback, uint32_t eventMask = 0);
+  void setPeriod(int8_t id, uint32_t periodMs);
+  void runNow(int8_t id);
+  void runAfter(int8_t id, uint32_t delayMs);
+
+  // Wake the loop task and run the tasks subscribed to `events`
+  void notify(uint32_t events);
+  void notifyFromISR(uint32_t events);
+
+  // One scheduling round: sleep until the next deadline or event, then run
+  // event tasks followed by every task whose deadline has passed.
+  void tick();
+
+  uint8_t taskCount() const { return numTasks; }
+  const TaskStats& taskStats(uint8_t id) const { return tasks[id].stats; }
+  int8_t findTask(const char* name) const;
+  uint64_t idleMicros() const { return idleTotal; }
+  void resetStats();
+
+private:
+  struct Task {
+    TaskCallback callback;
+    uint32_t periodMicros;
+    uint32_t eventMask;
+    uint32_t deadline;
+    int8_t heapIndex;  // -1 when not scheduled
+    TaskStats stats;
+  };
+
+  Task tasks[MAX_TASKS];
+  uint8_t numTasks;
+
+  // Min-heap of task ids ordered by deadline (wrap-safe comparison)
+  uint8_t heap[MAX_TASKS];
+  uint8_t heapSize;
+
+  WiFiClient* client;
+  int eventFd;
+  volatile uint32_t pendingEvents;
+  uint64_t idleTotal;
+
+  bool before(uint8_t a, uint8_t b) const;
+  void heapSwap(uint8_t i, uint8_t j);
+  void siftUp(uint8_t i);
+  void siftDown(uint8_t i);
+  void schedule(uint8_t id, uint32_t deadline);
+  void unschedule(uint8_t id);
+
+  uint32_t collectEvents();
+  void waitForEvents(uint32_t timeoutMicros);
+  void runTask(uint8_t id, uint32_t lateness);
+  void runEventTasks(uint32_t events);
+};
+
+extern Scheduler scheduler;
+
+#endif
@@ -0,0 +1,115 @@
+#include "sound_player.h"
+
+SoundPlayer soundPlayer;
+
+SoundPlayer::SoundPlayer()
+  : head(0), queued(0), playing(false), timer(nullptr), lock(portMUX_INITIALIZER_UNLOCKED) {
+  memset(&counters, 0, sizeof(counters));
+}
+
+// Attach the LEDC channel to the amplifier input
+bool SoundPlayer::begin(uint8_t outputPin) {
+  ledcAttachPin(outputPin, LEDC_CHANNEL);
+  ledcWriteTone(LEDC_CHANNEL, 0);
+
+  esp_timer_create_args_t args = {};
+  args.callback = onToneEnd;
+  args.arg = this;
+  args.dispatch_method = ESP_TIMER_TASK;
+  args.name = "sound";
+  return esp_timer_create(&args, &timer) == ESP_OK;
+}
+
+// Queue a whole sequence behind anything still playing; all or nothing
+bool SoundPlayer::play(const Tone* tones, uint8_t count) {
+  if (timer == nullptr || count == 0) {
+    return false;
+  }
+
+  bool start = false;
+  portENTER_CRITICAL(&lock);
+  if (queued + count > QUEUE_LENGTH) {
+    portEXIT_CRITICAL(&lock);
+    counters.dropped++;
+    return false;
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    queue[(head + queued + i) % QUEUE_LENGTH] = tones[i];
+  }
+  queued += count;
+  counters.sounds++;
+  if (!playing) {
+    playing = true;
+    start = true;
+  }
+  portEXIT_CRITICAL(&lock);
+
+  // Otherwise the running timer picks the new tones up
+  if (start) {
+    advance();
+  }
+  return true;
+}
+
+bool SoundPlayer::playTone(uint16_t frequency, uint16_t durationMs) {
+  Tone tone = {frequency, durationMs};
+  return play(&tone, 1);
+}
+
+// Silence the output and drop everything queued (loop task)
+void SoundPlayer::stop() {
+  if (timer == nullptr) {
+    return;
+  }
+  portENTER_CRITICAL(&lock);
+  queued = 0;
+  portEXIT_CRITICAL(&lock);
+  // If the timer already fired, its callback finds the queue empty and
+  // silences the output itself
+  if (esp_timer_stop(timer) == ESP_OK) {
+    ledcWriteTone(LEDC_CHANNEL, 0);
+    playing = false;
+  }
+}
+
+// Runs on the esp_timer task when the current tone has played out
+void SoundPlayer::onToneEnd(void* arg) {
+  static_cast<SoundPlayer*>(arg)->advance();
+}
+
+// Start the next queued tone, or silence the output when the queue is empty.
+// Only the caller that set `playing` (play() or the timer callback) gets
+// here, so LEDC writes never race.
+void SoundPlayer::advance() {
+  for (;;) {
+    Tone next = {0, 0};
+    bool more;
+    portENTER_CRITICAL(&lock);
+    more = queued > 0;
+    if (more) {
+      next = queue[head];
+      head = (head + 1) % QUEUE_LENGTH;
+      queued--;
+    }
+    portEXIT_CRITICAL(&lock);
+
+    // ledcWriteTone() reconfigures the LEDC timer, so it runs outside the lock
+    ledcWriteTone(LEDC_CHANNEL, next.frequency);
+    if (more) {
+      counters.tones++;
+      esp_timer_start_once(timer, (uint64_t)next.durationMs * 1000ULL);
+      return;
+    }
+
+    // Tones queued while silencing are started here rather than lost
+    portENTER_CRITICAL(&lock);
+    bool idle = queued == 0;
+    if (idle) {
+      playing = false;
+    }
+    portEXIT_CRITICAL(&lock);
+    if (idle) {
+      return;
+    }
+  }
+}
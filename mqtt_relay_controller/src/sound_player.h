@@ -0,0 +1,61 @@
+#ifndef SOUND_PLAYER_H
+#define SOUND_PLAYER_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+
+// Asynchronous tone player for the amplifier output.
+//
+// The square wave is generated by the LEDC PWM peripheral, so no CPU time is
+// spent while a tone plays. Sequences are queued and a one-shot esp_timer
+// switches to the next tone when the current one ends; play() only copies
+// the tones into the queue and returns.
+
+// One step of a sound; frequency 0 is a pause
+struct Tone {
+  uint16_t frequency;
+  uint16_t durationMs;
+};
+
+struct SoundPlayerStats {
+  uint32_t sounds;    // Sequences accepted by play()
+  uint32_t tones;     // Tones started (pauses included)
+  uint32_t dropped;   // Sequences rejected because the queue was full
+};
+
+class SoundPlayer {
+public:
+  static const uint8_t QUEUE_LENGTH = 16;
+  static const uint8_t LEDC_CHANNEL = 0;
+
+  SoundPlayer();
+
+  // Attach the LEDC channel to the amplifier input
+  bool begin(uint8_t outputPin);
+  // Queue a whole sequence behind anything still playing; all or nothing
+  bool play(const Tone* tones, uint8_t count);
+  template <size_t N>
+  bool play(const Tone (&tones)[N]) { return play(tones, N); }
+  bool playTone(uint16_t frequency, uint16_t durationMs);
+  // Silence the output and drop everything queued
+  void stop();
+
+  bool busy() const { return playing; }
+  const SoundPlayerStats& stats() const { return counters; }
+
+private:
+  Tone queue[QUEUE_LENGTH];
+  uint8_t head;
+  uint8_t queued;
+  volatile bool playing;
+  esp_timer_handle_t timer;
+  portMUX_TYPE lock;
+  SoundPlayerStats counters;
+
+  static void onToneEnd(void* arg);
+  void advance();
+};
+
+extern SoundPlayer soundPlayer;
+
+#endif
@@ -0,0 +1,207 @@
+#include "state_journal.h"
+#include "profiling.h"
+
+#include <esp_timer.h>
+
+StateJournal stateJournal;
+
+StateJournal::StateJournal()
+  : partition(nullptr), sectors(0), activeSector(-1), nextSlot(0), generation(0),
+    hasCommitted(false), committed(0), dirty(false), pendingState(0),
+    firstChangeAt(0), lastChangeAt(0) {
+  memset(&counters, 0, sizeof(counters));
+}
+
+size_t StateJournal::recordOffset(uint8_t sector, uint16_t slot) const {
+  return (size_t)sector * SPI_FLASH_SEC_SIZE + sizeof(SectorHeader) + (size_t)slot * sizeof(Record);
+}
+
+bool StateJournal::readHeader(uint8_t sector, uint32_t& sectorGeneration) {
+  SectorHeader header;
+  if (esp_partition_read(partition, (size_t)sector * SPI_FLASH_SEC_SIZE, &header, sizeof(header)) != ESP_OK) {
+    return false;
+  }
+  if (header.magic != MAGIC || header.version != FORMAT_VERSION || header.generationCheck != ~header.generation) {
+    return false;
+  }
+  sectorGeneration = header.generation;
+  return true;
+}
+
+bool StateJournal::slotEmpty(uint8_t sector, uint16_t slot) {
+  Record record;
+  if (esp_partition_read(partition, recordOffset(sector, slot), &record, sizeof(record)) != ESP_OK) {
+    return false;
+  }
+  return record.state == UINT32_MAX && record.check == UINT32_MAX;
+}
+
+// Records are appended in order, so the used slots are a prefix of the sector
+uint16_t StateJournal::firstEmptySlot(uint8_t sector) {
+  uint16_t low = 0, high = RECORDS_PER_SECTOR;
+  while (low < high) {
+    uint16_t middle = (low + high) / 2;
+    if (slotEmpty(sector, middle)) {
+      high = middle;
+    } else {
+      low = middle + 1;
+    }
+  }
+  return low;
+}
+
+// Newest intact record below `end`; only the last write can be torn
+bool StateJournal::lastRecord(uint8_t sector, uint16_t end, uint32_t& state) {
+  for (uint16_t slot = end; slot > 0 && end - slot < 2; slot--) {
+    Record record;
+    if (esp_partition_read(partition, recordOffset(sector, slot - 1), &record, sizeof(record)) != ESP_OK) {
+      return false;
+    }
+    if (record.check == ~record.state) {
+      state = record.state;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Open the partition and replay the newest record
+bool StateJournal::begin(const char* partitionLabel) {
+  PROFILE_SCOPE("StateJournal::begin");
+  int64_t start = esp_timer_get_time();
+  partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, partitionLabel);
+  if (partition == nullptr || partition->size / SPI_FLASH_SEC_SIZE < 2) {
+    partition = nullptr;
+    return false;
+  }
+  uint32_t sectorCount = partition->size / SPI_FLASH_SEC_SIZE;
+  sectors = sectorCount > 64 ? 64 : sectorCount;
+
+  // The newest sector has the highest generation
+  int8_t newest = -1;
+  uint32_t newestGeneration = 0;
+  for (uint8_t sector = 0; sector < sectors; sector++) {
+    uint32_t sectorGeneration;
+    if (readHeader(sector, sectorGeneration) && (newest < 0 || sectorGeneration > newestGeneration)) {
+      newest = sector;
+      newestGeneration = sectorGeneration;
+    }
+  }
+
+  if (newest >= 0) {
+    activeSector = newest;
+    generation = newestGeneration;
+    nextSlot = firstEmptySlot(newest);
+    hasCommitted = lastRecord(newest, nextSlot, committed);
+    if (!hasCommitted) {
+      // Power was lost between formatting the sector and its first record
+      uint8_t previous = (newest + sectors - 1) % sectors;
+      uint32_t previousGeneration;
+      if (readHeader(previous, previousGeneration) && previousGeneration == newestGeneration - 1) {
+        hasCommitted = lastRecord(previous, firstEmptySlot(previous), committed);
+      }
+    }
+  }
+
+  counters.replayUs = esp_timer_get_time() - start;
+  return true;
+}
+
+// Note a new state; it is written later by poll()
+void StateJournal::record(uint32_t state) {
+  unsigned long now = millis();
+  if (!dirty) {
+    firstChangeAt = now;
+  }
+  dirty = true;
+  pendingState = state;
+  lastChangeAt = now;
+  counters.records++;
+}
+
+// Milliseconds until poll() will commit, UINT32_MAX when nothing is pending
+uint32_t StateJournal::nextCommitMs() const {
+  if (!dirty) {
+    return UINT32_MAX;
+  }
+  unsigned long now = millis();
+  long idle = (long)(lastChangeAt + IDLE_COMMIT_MS - now);
+  long deferred = (long)(firstChangeAt + MAX_DEFER_MS - now);
+  long wait = idle < deferred ? idle : deferred;
+  return wait > 0 ? (uint32_t)wait : 0;
+}
+
+// Commit a pending state once it is due
+void StateJournal::poll() {
+  if (dirty && nextCommitMs() == 0) {
+    flush();
+  }
+}
+
+// Commit a pending state now (e.g. before a reboot)
+bool StateJournal::flush() {
+  if (!dirty) {
+    return true;
+  }
+  dirty = false;
+  if (hasCommitted && pendingState == committed) {
+    return true;
+  }
+  if (!write(pendingState)) {
+    // Keep it pending and try again after the idle delay
+    dirty = true;
+    firstChangeAt = lastChangeAt = millis();
+    return false;
+  }
+  return true;
+}
+
+// Erase the next sector of the ring and stamp it with the next generation
+bool StateJournal::startSector() {
+  uint8_t sector = activeSector < 0 ? 0 : (activeSector + 1) % sectors;
+  if (esp_partition_erase_range(partition, (size_t)sector * SPI_FLASH_SEC_SIZE, SPI_FLASH_SEC_SIZE) != ESP_OK) {
+    return false;
+  }
+  counters.erases++;
+  SectorHeader header = {MAGIC, FORMAT_VERSION, generation + 1, ~(generation + 1)};
+  if (esp_partition_write(partition, (size_t)sector * SPI_FLASH_SEC_SIZE, &header, sizeof(header)) != ESP_OK) {
+    return false;
+  }
+  generation++;
+  activeSector = sector;
+  nextSlot = 0;
+  return true;
+}
+
+bool StateJournal::write(uint32_t state) {
+  PROFILE_SCOPE("StateJournal::write");
+  if (partition == nullptr) {
+    return false;
+  }
+  int64_t start = esp_timer_get_time();
+  bool ok = true;
+  if (activeSector < 0 || nextSlot >= RECORDS_PER_SECTOR) {
+    ok = startSector();
+  }
+  if (ok) {
+    Record record = {state, ~state};
+    ok = esp_partition_write(partition, recordOffset(activeSector, nextSlot), &record, sizeof(record)) == ESP_OK;
+    // A failed slot is never reused: the next commit appends after it
+    nextSlot++;
+  }
+  if (!ok) {
+    counters.failures++;
+    Serial.println("❌ State journal write failed");
+    return false;
+  }
+
+  uint32_t elapsed = esp_timer_get_time() - start;
+  committed = state;
+  hasCommitted = true;
+  counters.commits++;
+  counters.lastCommitUs = elapsed;
+  if (elapsed > counters.maxCommitUs) {
+    counters.maxCommitUs = elapsed;
+  }
+  return true;
+}
@@ -0,0 +1,103 @@
+#ifndef STATE_JOURNAL_H
+#define STATE_JOURNAL_H
+
+#include <Arduino.h>
+#include <esp_partition.h>
+
+// Log-structured journal of the relay state in a raw flash partition.
+//
+// The partition is a ring of 4 KB sectors. Each sector starts with a header
+// carrying a generation number and holds 510 fixed 8-byte records of
+// {state, ~state}; a commit appends one record, so a sector is erased once
+// per 510 commits and the ring spreads the erases evenly over all sectors.
+// A record whose two halves do not match was torn by a power cut and is
+// skipped. Boot replay reads the sector headers, binary-searches the newest
+// sector for its last record and is done in a dozen small reads.
+//
+// record() only notes the new state. The write happens from poll() once the
+// state has been stable for IDLE_COMMIT_MS, or MAX_DEFER_MS after the first
+// pending change, so a burst of toggles costs one record, and a state that
+// returns to the committed value costs nothing.
+
+struct StateJournalStats {
+  uint32_t records;       // record() calls
+  uint32_t commits;       // Records written to flash
+  uint32_t erases;        // Sector erases since boot
+  uint32_t failures;      // Flash errors
+  uint32_t lastCommitUs;
+  uint32_t maxCommitUs;
+  uint32_t replayUs;      // begin(): locate and read the newest record
+};
+
+class StateJournal {
+public:
+  static const uint32_t IDLE_COMMIT_MS = 500;
+  static const uint32_t MAX_DEFER_MS = 3000;
+  static const uint8_t FORMAT_VERSION = 1;
+
+  StateJournal();
+
+  // Open the partition and replay the newest record
+  bool begin(const char* partitionLabel);
+  bool ready() const { return partition != nullptr; }
+  bool hasState() const { return hasCommitted; }
+  uint32_t state() const { return committed; }
+
+  // Note a new state; it is written later by poll()
+  void record(uint32_t state);
+  bool pending() const { return dirty; }
+  // Milliseconds until poll() will commit, UINT32_MAX when nothing is pending
+  uint32_t nextCommitMs() const;
+  // Commit a pending state once it is due
+  void poll();
+  // Commit a pending state now (e.g. before a reboot)
+  bool flush();
+
+  // Approximate lifetime erases of each sector
+  uint32_t sectorWear() const { return sectors ? (generation + sectors - 1) / sectors : 0; }
+  uint8_t sectorCount() const { return sectors; }
+  const StateJournalStats& stats() const { return counters; }
+
+private:
+  struct SectorHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t generation;
+    uint32_t generationCheck;  // ~generation
+  };
+
+  struct Record {
+    uint32_t state;
+    uint32_t check;            // ~state
+  };
+
+  static const uint32_t MAGIC = 0x4C4A5352;  // "RSJL"
+  static const uint16_t RECORDS_PER_SECTOR = (SPI_FLASH_SEC_SIZE - sizeof(SectorHeader)) / sizeof(Record);
+
+  const esp_partition_t* partition;
+  uint8_t sectors;
+  int8_t activeSector;       // -1 until the first sector is formatted
+  uint16_t nextSlot;
+  uint32_t generation;
+
+  bool hasCommitted;
+  uint32_t committed;
+  bool dirty;
+  uint32_t pendingState;
+  unsigned long firstChangeAt;
+  unsigned long lastChangeAt;
+
+  StateJournalStats counters;
+
+  size_t recordOffset(uint8_t sector, uint16_t slot) const;
+  bool readHeader(uint8_t sector, uint32_t& sectorGeneration);
+  bool slotEmpty(uint8_t sector, uint16_t slot);
+  uint16_t firstEmptySlot(uint8_t sector);
+  bool lastRecord(uint8_t sector, uint16_t end, uint32_t& state);
+  bool startSector();
+  bool write(uint32_t state);
+};
+
+extern StateJournal stateJournal;
+
+#endif
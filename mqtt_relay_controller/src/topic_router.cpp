@@ -0,0 +1,180 @@
+#include "topic_router.h"
+
+TopicRouter::TopicRouter() : routeCount(0), nodeCount(1), labelsUsed(0) {
+  memset(routes, 0, sizeof(routes));
+  memset(nodes, 0, sizeof(nodes));
+  memset(edges, 0, sizeof(edges));
+  memset(&counters, 0, sizeof(counters));
+}
+
+// FNV-1a of the level, with the parent folded into the offset basis
+uint16_t TopicRouter::slotFor(uint8_t parent, const char* level, size_t length) {
+  uint32_t h = 2166136261u ^ parent;
+  for (size_t i = 0; i < length; i++) {
+    h = (h ^ (uint8_t)level[i]) * 16777619u;
+  }
+  return (h ^ (h >> 16)) & (EDGE_SLOTS - 1);
+}
+
+int TopicRouter::findChild(uint8_t parent, const char* level, size_t length) const {
+  for (uint16_t slot = slotFor(parent, level, length);; slot = (slot + 1) & (EDGE_SLOTS - 1)) {
+    uint8_t child = edges[slot];
+    if (child == 0) {
+      return -1;
+    }
+    const Node& node = nodes[child];
+    if (node.parent == parent && node.labelLength == length && memcmp(labels + node.label, level, length) == 0) {
+      return child;
+    }
+  }
+}
+
+int TopicRouter::addChild(uint8_t parent, const char* level, size_t length) {
+  if (nodeCount >= MAX_NODES || length > 255 || labelsUsed + length > LABEL_BYTES) {
+    return -1;
+  }
+  uint8_t child = nodeCount++;
+  Node& node = nodes[child];
+  node.parent = parent;
+  if (level != NULL) {
+    memcpy(labels + labelsUsed, level, length);
+    node.label = labelsUsed;
+    node.labelLength = length;
+    labelsUsed += length;
+    // MAX_NODES < EDGE_SLOTS, so there is always a free slot
+    uint16_t slot = slotFor(parent, level, length);
+    while (edges[slot] != 0) {
+      slot = (slot + 1) & (EDGE_SLOTS - 1);
+    }
+    edges[slot] = child;
+  }
+  return child;
+}
+
+int8_t TopicRouter::add(const char* filter, TopicHandler handler, const char* name) {
+  if (routeCount >= MAX_ROUTES || filter == NULL || filter[0] == '\0' || handler == NULL) {
+    return -1;
+  }
+  uint8_t node = 0;
+  uint8_t levels = 0;
+  bool rest = false;
+  const char* at = filter;
+  for (;;) {
+    const char* end = strchr(at, '/');
+    size_t length = end != NULL ? (size_t)(end - at) : strlen(at);
+    if (++levels > MAX_LEVELS) {
+      return -1;
+    }
+    if (memchr(at, '#', length) != NULL) {
+      // Only as a whole level, and the last one
+      if (length != 1 || end != NULL) {
+        return -1;
+      }
+      rest = true;
+      break;
+    }
+    if (memchr(at, '+', length) != NULL) {
+      if (length != 1) {
+        return -1;
+      }
+      if (nodes[node].plus == 0) {
+        int child = addChild(node, NULL, 0);
+        if (child < 0) {
+          return -1;
+        }
+        nodes[node].plus = child;
+      }
+      node = nodes[node].plus;
+    } else {
+      int child = findChild(node, at, length);
+      if (child < 0) {
+        child = addChild(node, at, length);
+      }
+      if (child < 0) {
+        return -1;
+      }
+      node = child;
+    }
+    if (end == NULL) {
+      break;
+    }
+    at = end + 1;
+  }
+
+  uint8_t route = routeCount++;
+  routes[route].filter = filter;
+  routes[route].name = name != NULL ? name : filter;
+  routes[route].handler = handler;
+  routes[route].dispatches = 0;
+  if (rest) {
+    nodes[node].rest |= 1UL << route;
+  } else {
+    nodes[node].exact |= 1UL << route;
+  }
+  return route;
+}
+
+// Depth first over the literal and `+` children that exist for each level.
+// A branch only goes one level deeper per step and filters have at most
+// MAX_LEVELS levels, so the stack never holds more than MAX_LEVELS + 1
+uint32_t TopicRouter::match(const char* topic) {
+  struct Step {
+    uint8_t node;
+    const char* level;  // Next level of the topic, NULL once all are matched
+  };
+  Step stack[MAX_LEVELS + 1];
+  uint8_t depth = 0;
+  uint8_t visits = 0;
+  uint32_t matched = 0;
+  // Wildcards in the first level do not match system topics
+  bool system = topic[0] == '$';
+
+  stack[depth++] = {0, topic};
+  while (depth > 0) {
+    Step step = stack[--depth];
+    const Node& node = nodes[step.node];
+    bool wildcards = !(system && step.node == 0);
+    visits++;
+    if (wildcards) {
+      matched |= node.rest;
+    }
+    if (step.level == NULL) {
+      matched |= node.exact;
+      continue;
+    }
+    const char* end = strchr(step.level, '/');
+    size_t length = end != NULL ? (size_t)(end - step.level) : strlen(step.level);
+    const char* next = end != NULL ? end + 1 : NULL;
+    int child = findChild(step.node, step.level, length);
+    if (child > 0) {
+      stack[depth++] = {(uint8_t)child, next};
+    }
+    if (node.plus != 0 && wildcards) {
+      stack[depth++] = {node.plus, next};
+    }
+  }
+
+  counters.visits += visits;
+  if (visits > counters.maxVisits) {
+    counters.maxVisits = visits;
+  }
+  return matched;
+}
+
+uint8_t TopicRouter::dispatch(char* topic, byte* payload, unsigned int length) {
+  counters.messages++;
+  uint32_t matched = match(topic);
+  if (matched == 0) {
+    counters.unmatched++;
+    return 0;
+  }
+  uint8_t taken = 0;
+  for (uint8_t route = 0; route < routeCount; route++) {
+    if (matched & (1UL << route)) {
+      routes[route].dispatches++;
+      routes[route].handler(topic, payload, length);
+      taken++;
+    }
+  }
+  return taken;
+}
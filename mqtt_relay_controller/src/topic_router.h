@@ -0,0 +1,86 @@
+#ifndef TOPIC_ROUTER_H
+#define TOPIC_ROUTER_H
+
+#include <Arduino.h>
+
+// Routes inbound MQTT messages to per-filter handlers.
+//
+// Filters are kept in a trie with one node per filter level. Literal levels
+// are found through a hash table keyed by (parent node, level), a `+` level
+// is a node's single wildcard child and a trailing `#` is a bit on the node
+// it follows, so matching a topic costs a hash probe per level (plus the
+// `+` branches the filters actually have), however many filters are
+// registered. Wildcards follow MQTT: `#` also matches its parent level
+// ("a/#" matches "a"), and a filter starting with a wildcard does not match
+// topics starting with '$'. Everything lives in fixed tables; nothing is
+// allocated. Nodes of a filter that did not fit stay in the trie unused.
+
+typedef void (*TopicHandler)(char* topic, byte* payload, unsigned int length);
+
+struct TopicRouterStats {
+  uint32_t messages;    // dispatch() calls
+  uint32_t unmatched;   // Messages no filter matched
+  uint32_t visits;      // Trie nodes visited, all messages
+  uint8_t maxVisits;    // Most nodes visited for one message
+};
+
+class TopicRouter {
+public:
+  static const uint8_t MAX_ROUTES = 32;
+  static const uint8_t MAX_NODES = 128;
+  static const uint8_t MAX_LEVELS = 16;       // Levels of one filter
+  static const uint16_t LABEL_BYTES = 1024;   // Literal levels of all filters
+  static const uint16_t EDGE_SLOTS = 256;     // Power of two, at least 2 * MAX_NODES
+
+  TopicRouter();
+
+  // Send messages whose topic matches `filter` to `handler`; `name` labels
+  // the route in the stats. Returns the route number, -1 if the filter is
+  // malformed or the tables are full. Both strings must outlive the router
+  int8_t add(const char* filter, TopicHandler handler, const char* name);
+
+  // Routes matching `topic`, bit n for route n
+  uint32_t match(const char* topic);
+  // Pass the message to every matching route, in the order they were added;
+  // returns how many took it. They share the payload, so a handler that
+  // parses it in place should not overlap another route
+  uint8_t dispatch(char* topic, byte* payload, unsigned int length);
+
+  uint8_t count() const { return routeCount; }
+  const char* filter(uint8_t route) const { return routes[route].filter; }
+  const char* name(uint8_t route) const { return routes[route].name; }
+  uint32_t dispatches(uint8_t route) const { return routes[route].dispatches; }
+  const TopicRouterStats& stats() const { return counters; }
+
+private:
+  struct Route {
+    const char* filter;
+    const char* name;
+    TopicHandler handler;
+    uint32_t dispatches;
+  };
+
+  struct Node {
+    uint16_t label;         // Offset of the level in labels
+    uint8_t labelLength;
+    uint8_t parent;
+    uint8_t plus;           // Node of a `+` level below, 0 = none
+    uint32_t exact;         // Routes whose filter ends here
+    uint32_t rest;          // Routes whose filter ends here with "/#"
+  };
+
+  Route routes[MAX_ROUTES];
+  uint8_t routeCount;
+  Node nodes[MAX_NODES];    // 0 is the root
+  uint8_t nodeCount;
+  char labels[LABEL_BYTES];
+  uint16_t labelsUsed;
+  uint8_t edges[EDGE_SLOTS];  // Node of a literal level, 0 = free slot
+  TopicRouterStats counters;
+
+  static uint16_t slotFor(uint8_t parent, const char* level, size_t length);
+  int findChild(uint8_t parent, const char* level, size_t length) const;
+  int addChild(uint8_t parent, const char* level, size_t length);
+};
+
+#endif
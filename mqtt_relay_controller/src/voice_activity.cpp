@@ -0,0 +1,172 @@
+#include "voice_activity.h"
+
+#if defined(__XTENSA__)
+#include <xtensa/config/core-isa.h>
+#endif
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+uint64_t frameEnergyReference(const int16_t* samples, size_t count) {
+  uint64_t energy = 0;
+  for (size_t i = 0; i < count; i++) {
+    energy += (uint32_t)(samples[i] * samples[i]);
+  }
+  return energy;
+}
+
+// A square is at most 2^30, so two of them still fit an unsigned 32-bit add
+uint64_t frameEnergyUnrolled(const int16_t* samples, size_t count) {
+  uint64_t even = 0;
+  uint64_t odd = 0;
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    even += (uint32_t)(samples[i] * samples[i]) + (uint32_t)(samples[i + 2] * samples[i + 2]);
+    odd += (uint32_t)(samples[i + 1] * samples[i + 1]) + (uint32_t)(samples[i + 3] * samples[i + 3]);
+  }
+  for (; i < count; i++) {
+    even += (uint32_t)(samples[i] * samples[i]);
+  }
+  return even + odd;
+}
+
+#if defined(__XTENSA__)
+// MULA.AA.LL / .HH square both halves of a 32-bit load into the 40-bit
+// MAC16 accumulator. 256 squares stay below 2^38, so the accumulator is
+// read out and cleared every 128 words.
+uint64_t frameEnergyMac16(const int16_t* samples, size_t count) {
+#if XCHAL_HAVE_MAC16
+  uint64_t energy = 0;
+  if (count > 0 && ((uintptr_t)samples & 2) != 0) {
+    energy = (uint32_t)(samples[0] * samples[0]);
+    samples++;
+    count--;
+  }
+  const uint32_t* words = (const uint32_t*)samples;
+  size_t pairs = count / 2;
+  while (pairs > 0) {
+    uint32_t block = pairs < 128 ? pairs : 128;
+    pairs -= block;
+    uint32_t low;
+    uint32_t high;
+    uint32_t word;
+    asm volatile(
+        "wsr.acclo %[zero]\n"
+        "wsr.acchi %[zero]\n"
+        "1:\n"
+        "l32i %[word], %[words], 0\n"
+        "addi %[words], %[words], 4\n"
+        "addi %[block], %[block], -1\n"
+        "mula.aa.ll %[word], %[word]\n"
+        "mula.aa.hh %[word], %[word]\n"
+        "bnez %[block], 1b\n"
+        "rsr.acclo %[low]\n"
+        "rsr.acchi %[high]\n"
+        : [low] "=r"(low), [high] "=r"(high), [word] "=&r"(word), [words] "+r"(words), [block] "+r"(block)
+        : [zero] "r"(0)
+        : "memory");
+    energy += ((uint64_t)(high & 0xFF) << 32) | low;
+  }
+  if (count & 1) {
+    energy += (uint32_t)(samples[count - 1] * samples[count - 1]);
+  }
+  return energy;
+#else
+  return frameEnergyUnrolled(samples, count);
+#endif
+}
+#endif
+
+#if defined(__x86_64__)
+// PMADDWD sums the squares of neighbouring samples into 32-bit lanes. Two
+// squares of -32768 make 2^31, which only fits unsigned, so the lanes are
+// zero-extended to 64 bits before they are added up.
+uint64_t frameEnergySse2(const int16_t* samples, size_t count) {
+  __m128i total = _mm_setzero_si128();
+  const __m128i zero = _mm_setzero_si128();
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(samples + i));
+    __m128i pairs = _mm_madd_epi16(x, x);
+    total = _mm_add_epi64(total, _mm_unpacklo_epi32(pairs, zero));
+    total = _mm_add_epi64(total, _mm_unpackhi_epi32(pairs, zero));
+  }
+  uint64_t lanes[2];
+  _mm_storeu_si128((__m128i*)lanes, total);
+  return lanes[0] + lanes[1] + frameEnergyReference(samples + i, count - i);
+}
+
+__attribute__((target("avx2"))) uint64_t frameEnergyAvx2(const int16_t* samples, size_t count) {
+  __m256i total = _mm256_setzero_si256();
+  const __m256i zero = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m256i x = _mm256_loadu_si256((const __m256i*)(samples + i));
+    __m256i pairs = _mm256_madd_epi16(x, x);
+    total = _mm256_add_epi64(total, _mm256_unpacklo_epi32(pairs, zero));
+    total = _mm256_add_epi64(total, _mm256_unpackhi_epi32(pairs, zero));
+  }
+  uint64_t lanes[4];
+  _mm256_storeu_si256((__m256i*)lanes, total);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] + frameEnergySse2(samples + i, count - i);
+}
+
+bool frameEnergyAvx2Supported() {
+  static const bool supported = __builtin_cpu_supports("avx2");
+  return supported;
+}
+#endif
+
+uint64_t frameEnergy(const int16_t* samples, size_t count) {
+#if defined(__XTENSA__)
+  return frameEnergyMac16(samples, count);
+#elif defined(__x86_64__)
+  return frameEnergyAvx2Supported() ? frameEnergyAvx2(samples, count) : frameEnergySse2(samples, count);
+#else
+  return frameEnergyUnrolled(samples, count);
+#endif
+}
+
+const char* frameEnergyKernel() {
+#if defined(__XTENSA__) && XCHAL_HAVE_MAC16
+  return "mac16";
+#elif defined(__x86_64__)
+  return frameEnergyAvx2Supported() ? "avx2" : "sse2";
+#else
+  return "unrolled";
+#endif
+}
+
+VoiceActivityDetector::VoiceActivityDetector(uint16_t threshold)
+  : thresholdSquared((uint64_t)threshold * threshold) {
+  reset();
+}
+
+void VoiceActivityDetector::reset() {
+  memset(history, 0, sizeof(history));
+  next = 0;
+  sum = 0;
+  lastEnergy = 0;
+  lastCount = 0;
+  memset(&counters, 0, sizeof(counters));
+}
+
+bool VoiceActivityDetector::process(const int16_t* samples, size_t count) {
+  return update(frameEnergy(samples, count), count);
+}
+
+bool VoiceActivityDetector::update(uint64_t energy, size_t count) {
+  sum += energy - history[next];
+  history[next] = energy;
+  next = next + 1 < HISTORY ? next + 1 : 0;
+  lastEnergy = energy;
+  lastCount = count;
+  counters.frames++;
+
+  // RMS > threshold and RMS > 1.5 x average, squared
+  bool voice = energy > thresholdSquared * count && 4 * HISTORY * energy > 9 * sum;
+  if (voice) {
+    counters.detections++;
+  }
+  return voice;
+}
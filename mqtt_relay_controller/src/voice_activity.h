@@ -0,0 +1,75 @@
+#ifndef VOICE_ACTIVITY_H
+#define VOICE_ACTIVITY_H
+
+#include <Arduino.h>
+
+// Voice activity detection in integer arithmetic.
+//
+// A frame's energy is its exact sum of squares: 64 bits, since 1024
+// full-scale samples need 41. Instead of taking sqrt() of the mean square
+// to compare RMS values, both sides of each comparison are squared:
+// "RMS above the threshold" becomes energy > threshold^2 * samples, and
+// "RMS 1.5 times the recent average" becomes
+// 4 * HISTORY * energy > 9 * (sum of the last HISTORY energies), so the
+// average is taken over energies. The history keeps a running sum that is
+// updated in O(1) per frame.
+//
+// frameEnergy() uses the fastest kernel built for the target: the MAC16
+// 40-bit multiply-accumulate on the ESP32, AVX2 or SSE2 on x86-64 hosts,
+// a 4-way unrolled loop elsewhere. All of them are exact, so they agree bit
+// for bit with frameEnergyReference().
+
+// Sum of squares, one sample at a time
+uint64_t frameEnergyReference(const int16_t* samples, size_t count);
+// Sum of squares, four samples per iteration in two accumulators
+uint64_t frameEnergyUnrolled(const int16_t* samples, size_t count);
+#if defined(__XTENSA__)
+uint64_t frameEnergyMac16(const int16_t* samples, size_t count);
+#endif
+#if defined(__x86_64__)
+uint64_t frameEnergySse2(const int16_t* samples, size_t count);
+// Only when frameEnergyAvx2Supported()
+uint64_t frameEnergyAvx2(const int16_t* samples, size_t count);
+bool frameEnergyAvx2Supported();
+#endif
+
+// Sum of squares with the best kernel for this CPU, and its name
+uint64_t frameEnergy(const int16_t* samples, size_t count);
+const char* frameEnergyKernel();
+
+struct VoiceActivityStats {
+  uint32_t frames;
+  uint32_t detections;  // Frames process() returned true for
+};
+
+class VoiceActivityDetector {
+public:
+  static const uint8_t HISTORY = 10;
+
+  // `threshold` is the RMS a frame must exceed, in sample units
+  explicit VoiceActivityDetector(uint16_t threshold);
+
+  // Add one frame to the history; true if it is voice: above the threshold
+  // and 1.5 times the average of the last HISTORY frames (itself included)
+  bool process(const int16_t* samples, size_t count);
+  // The same with the frame's energy already computed
+  bool update(uint64_t energy, size_t count);
+  void reset();
+
+  // Mean squares of the last frame and of the history, for logs
+  uint32_t level() const { return lastCount ? (uint32_t)(lastEnergy / lastCount) : 0; }
+  uint32_t background() const { return lastCount ? (uint32_t)(sum / HISTORY / lastCount) : 0; }
+  uint64_t historySum() const { return sum; }
+  const VoiceActivityStats& stats() const { return counters; }
+
+private:
+  uint64_t thresholdSquared;
+  uint64_t history[HISTORY];
+  uint8_t next;
+  uint64_t sum;             // Of history[]
+  uint64_t lastEnergy;
+  size_t lastCount;
+  VoiceActivityStats counters;
+};
+
+#endif
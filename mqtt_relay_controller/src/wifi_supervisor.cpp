@@ -0,0 +1,259 @@
+#include "wifi_supervisor.h"
+#include "scheduler.h"
+
+#include <Preferences.h>
+
+WiFiSupervisor wifiSupervisor;
+
+const uint16_t DurationHistogram::BOUNDS_MS[DurationHistogram::BUCKETS - 1] = {
+  100, 250, 500, 1000, 2000, 5000, 10000
+};
+
+void DurationHistogram::add(uint32_t ms) {
+  uint8_t bucket = 0;
+  while (bucket < BUCKETS - 1 && ms >= BOUNDS_MS[bucket]) {
+    bucket++;
+  }
+  if (counts[bucket] < UINT16_MAX) {
+    counts[bucket]++;
+  }
+  if (ms > maxMs) {
+    maxMs = ms;
+  }
+}
+
+WiFiSupervisor::WiFiSupervisor()
+  : ssid(nullptr), password(nullptr), current(WIFI_STATE_IDLE), connectedCallback(nullptr),
+    cacheValid(false), reuseLease(false), useStaticIP(false),
+    fastAttempt(false), skipFastPath(false), consecutiveFailures(0), missedProbes(0), attemptStart(0), retryAt(0),
+    pendingEvents(0), associatedAt(0), gotIpAt(0), disconnectReason(0) {
+  memset(&cache, 0, sizeof(cache));
+  memset(&counters, 0, sizeof(counters));
+}
+
+// Load the cached access point and start connecting; returns immediately
+void WiFiSupervisor::begin(const char* networkSsid, const char* networkPassword) {
+  ssid = networkSsid;
+  password = networkPassword;
+
+  Preferences prefs;
+  if (prefs.begin("wifi", true)) {
+    cacheValid = prefs.getBytes("ap", &cache, sizeof(cache)) == sizeof(cache) &&
+                 cache.version == CACHE_VERSION && cache.channel != 0;
+    prefs.end();
+  }
+  if (cacheValid) {
+    Serial.printf("📶 Cached AP %02x:%02x:%02x:%02x:%02x:%02x on channel %u\n",
+                  cache.bssid[0], cache.bssid[1], cache.bssid[2],
+                  cache.bssid[3], cache.bssid[4], cache.bssid[5], cache.channel);
+  }
+
+  // Reconnects are driven from poll(); the driver must not race us
+  WiFi.mode(WIFI_STA);
+  WiFi.setAutoReconnect(false);
+  WiFi.onEvent(handleEvent);
+  startAttempt();
+}
+
+void WiFiSupervisor::setStaticIP(IPAddress ip, IPAddress gateway, IPAddress subnet, IPAddress dns) {
+  useStaticIP = true;
+  staticIP = ip;
+  staticGateway = gateway;
+  staticSubnet = subnet;
+  staticDns = dns;
+}
+
+const char* WiFiSupervisor::stateName() const {
+  switch (current) {
+    case WIFI_STATE_IDLE:        return "idle";
+    case WIFI_STATE_ASSOCIATING: return "associating";
+    case WIFI_STATE_WAIT_IP:     return "wait_ip";
+    case WIFI_STATE_CONNECTED:   return "connected";
+    case WIFI_STATE_BACKOFF:     return "backoff";
+  }
+  return "unknown";
+}
+
+// Runs on the WiFi event task: record and wake the loop task, nothing else
+void WiFiSupervisor::handleEvent(arduino_event_t* event) {
+  WiFiSupervisor& self = wifiSupervisor;
+  uint32_t flag = 0;
+  switch (event->event_id) {
+    case ARDUINO_EVENT_WIFI_STA_CONNECTED:
+      self.associatedAt = millis();
+      flag = EVENT_CONNECTED;
+      break;
+    case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+      self.gotIpAt = millis();
+      flag = EVENT_GOT_IP;
+      break;
+    case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+      self.disconnectReason = event->event_info.wifi_sta_disconnected.reason;
+      flag = EVENT_DISCONNECTED;
+      break;
+    default:
+      return;
+  }
+  __atomic_fetch_or(&self.pendingEvents, flag, __ATOMIC_RELEASE);
+  scheduler.notify(Scheduler::EVENT_WIFI);
+}
+
+// Start an association: directed at the cached BSSID/channel when possible
+void WiFiSupervisor::startAttempt() {
+  fastAttempt = cacheValid && !skipFastPath;
+  counters.attempts++;
+  attemptStart = millis();
+  __atomic_store_n(&pendingEvents, 0, __ATOMIC_RELEASE);
+
+  if (useStaticIP) {
+    WiFi.config(staticIP, staticGateway, staticSubnet, staticDns);
+  } else if (fastAttempt && reuseLease && cache.ip != 0) {
+    WiFi.config(IPAddress(cache.ip), IPAddress(cache.gateway), IPAddress(cache.subnet), IPAddress(cache.dns));
+  } else {
+    WiFi.config(IPAddress(), IPAddress(), IPAddress());  // DHCP
+  }
+
+  if (fastAttempt) {
+    counters.fastAttempts++;
+    WiFi.begin(ssid, password, cache.channel, cache.bssid);
+  } else {
+    Serial.print("Connecting to ");
+    Serial.println(ssid);
+    WiFi.begin(ssid, password);
+  }
+  current = WIFI_STATE_ASSOCIATING;
+}
+
+// Give up on this attempt (`reason` is the disconnect reason, 0 for a
+// timeout). A directed attempt that found no AP is retried cheaply every
+// PROBE_RETRY_MS, with a full scan after PROBES_BEFORE_SCAN of them; any
+// other first failure of a directed attempt rescans at once (the AP may have
+// changed channel). After that retries back off and use the directed probe,
+// with a full scan every SCAN_EVERY_FAILURES attempts.
+void WiFiSupervisor::fail(uint8_t reason) {
+  counters.failures++;
+  if (consecutiveFailures < 255) {
+    consecutiveFailures++;
+  }
+  if (fastAttempt && reason == WIFI_REASON_NO_AP_FOUND) {
+    missedProbes++;
+    skipFastPath = missedProbes >= PROBES_BEFORE_SCAN;
+    if (skipFastPath) {
+      missedProbes = 0;
+      Serial.println("⚠️ WiFi AP not on its cached channel - falling back to full scan");
+    }
+    retryAt = millis() + PROBE_RETRY_MS;
+    current = WIFI_STATE_BACKOFF;
+    return;
+  }
+  if (fastAttempt && consecutiveFailures == 1) {
+    skipFastPath = true;
+    Serial.println("⚠️ WiFi fast reconnect failed - falling back to full scan");
+    startAttempt();
+    return;
+  }
+  skipFastPath = consecutiveFailures % SCAN_EVERY_FAILURES == 0;
+
+  uint8_t shift = consecutiveFailures - 1 < 8 ? consecutiveFailures - 1 : 8;
+  uint32_t wait = BACKOFF_BASE_MS << shift;
+  if (wait > BACKOFF_CAP_MS) {
+    wait = BACKOFF_CAP_MS;
+  }
+  retryAt = millis() + wait;
+  current = WIFI_STATE_BACKOFF;
+  Serial.printf("WiFi connection failed - will retry in %u ms\n", (unsigned)wait);
+}
+
+// Persist BSSID/channel/lease, but only when they changed (NVS wear)
+void WiFiSupervisor::saveCache() {
+  CachedAccessPoint fresh;
+  memset(&fresh, 0, sizeof(fresh));
+  fresh.version = CACHE_VERSION;
+  const uint8_t* bssid = WiFi.BSSID();
+  if (bssid == nullptr) {
+    return;
+  }
+  memcpy(fresh.bssid, bssid, sizeof(fresh.bssid));
+  fresh.channel = WiFi.channel();
+  fresh.ip = (uint32_t)WiFi.localIP();
+  fresh.gateway = (uint32_t)WiFi.gatewayIP();
+  fresh.subnet = (uint32_t)WiFi.subnetMask();
+  fresh.dns = (uint32_t)WiFi.dnsIP();
+
+  if (cacheValid && memcmp(&fresh, &cache, sizeof(cache)) == 0) {
+    return;
+  }
+  cache = fresh;
+  cacheValid = true;
+  Preferences prefs;
+  if (prefs.begin("wifi", false)) {
+    prefs.putBytes("ap", &cache, sizeof(cache));
+    prefs.end();
+  }
+}
+
+// Process pending WiFi events and timeouts (scheduler task)
+void WiFiSupervisor::poll() {
+  uint32_t events = __atomic_exchange_n(&pendingEvents, 0, __ATOMIC_ACQUIRE);
+  unsigned long now = millis();
+
+  switch (current) {
+    case WIFI_STATE_IDLE:
+      break;
+
+    case WIFI_STATE_ASSOCIATING:
+      if (events & EVENT_CONNECTED) {
+        counters.associate.add(associatedAt - attemptStart);
+        current = WIFI_STATE_WAIT_IP;
+        // STA_GOT_IP may already be pending; handled below
+      } else if ((events & EVENT_DISCONNECTED) && disconnectReason != WIFI_REASON_ASSOC_LEAVE) {
+        fail(disconnectReason);
+        break;
+      } else {
+        uint32_t timeout = fastAttempt ? FAST_ASSOCIATE_TIMEOUT_MS : SCAN_ASSOCIATE_TIMEOUT_MS;
+        if (now - attemptStart > timeout) {
+          WiFi.disconnect();
+          fail(0);
+        }
+        break;
+      }
+      // fall through
+
+    case WIFI_STATE_WAIT_IP:
+      if (events & EVENT_GOT_IP) {
+        counters.gotIp.add(gotIpAt - attemptStart);
+        consecutiveFailures = 0;
+        missedProbes = 0;
+        skipFastPath = false;
+        current = WIFI_STATE_CONNECTED;
+        saveCache();
+        Serial.printf("WiFi connected in %lu ms (%s), IP address: %s\n",
+                      gotIpAt - attemptStart, fastAttempt ? "cached AP" : "scan",
+                      WiFi.localIP().toString().c_str());
+        if (connectedCallback != nullptr) {
+          connectedCallback();
+        }
+      } else if (events & EVENT_DISCONNECTED) {
+        fail(disconnectReason);
+      } else if (now - associatedAt > DHCP_TIMEOUT_MS) {
+        WiFi.disconnect();
+        fail(0);
+      }
+      break;
+
+    case WIFI_STATE_CONNECTED:
+      if (events & EVENT_DISCONNECTED) {
+        counters.disconnects++;
+        counters.lastReason = disconnectReason;
+        Serial.printf("WiFi disconnected (reason %u) - reconnecting...\n", disconnectReason);
+        startAttempt();
+      }
+      break;
+
+    case WIFI_STATE_BACKOFF:
+      if ((long)(now - retryAt) >= 0) {
+        startAttempt();
+      }
+      break;
+  }
+}
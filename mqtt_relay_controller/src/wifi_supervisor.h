@@ -0,0 +1,136 @@
+#ifndef WIFI_SUPERVISOR_H
+#define WIFI_SUPERVISOR_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+// Asynchronous WiFi station supervisor.
+//
+// Connection progress comes from WiFi events (STA_CONNECTED, STA_GOT_IP,
+// STA_DISCONNECTED), which only record a flag and wake the scheduler; all
+// decisions are taken in poll() on the loop task, so nothing here blocks.
+//
+// The BSSID, channel and DHCP lease of the last good connection are kept in
+// NVS. Reconnects pass the cached BSSID/channel to WiFi.begin(), which skips
+// the all-channel scan. While the AP does not answer there (NO_AP_FOUND, as
+// when it is rebooting or powered off) the directed probe is repeated every
+// PROBE_RETRY_MS, and only after PROBES_BEFORE_SCAN of them does a full scan
+// look for it on other channels; any other failure of the directed attempt
+// rescans at once. Later retries back off and mostly use the directed probe
+// again. Optionally the cached lease (or a configured static IP) is applied
+// with WiFi.config() to skip DHCP as well.
+
+// Histogram of durations in milliseconds
+struct DurationHistogram {
+  static const uint8_t BUCKETS = 8;
+  static const uint16_t BOUNDS_MS[BUCKETS - 1];  // Upper bounds; the last bucket is open
+
+  uint16_t counts[BUCKETS];
+  uint32_t maxMs;
+
+  void add(uint32_t ms);
+};
+
+struct WiFiSupervisorStats {
+  uint32_t attempts;       // WiFi.begin() calls
+  uint32_t fastAttempts;   // ...of which used the cached BSSID/channel
+  uint32_t failures;       // Attempts that timed out or were rejected
+  uint32_t disconnects;    // Established links that dropped
+  uint8_t lastReason;      // wifi_err_reason_t of the last disconnect
+  DurationHistogram associate;  // begin() -> STA_CONNECTED
+  DurationHistogram gotIp;      // begin() -> STA_GOT_IP
+};
+
+enum WiFiSupervisorState : uint8_t {
+  WIFI_STATE_IDLE,
+  WIFI_STATE_ASSOCIATING,
+  WIFI_STATE_WAIT_IP,
+  WIFI_STATE_CONNECTED,
+  WIFI_STATE_BACKOFF
+};
+
+typedef void (*WiFiConnectedCallback)();
+
+class WiFiSupervisor {
+public:
+  static const uint32_t FAST_ASSOCIATE_TIMEOUT_MS = 3000;
+  static const uint32_t SCAN_ASSOCIATE_TIMEOUT_MS = 15000;
+  static const uint32_t DHCP_TIMEOUT_MS = 10000;
+  static const uint32_t BACKOFF_BASE_MS = 250;
+  static const uint32_t BACKOFF_CAP_MS = 5000;
+  static const uint8_t SCAN_EVERY_FAILURES = 4;
+  static const uint32_t PROBE_RETRY_MS = 250;
+  static const uint8_t PROBES_BEFORE_SCAN = 16;  // About 6 s of directed probes
+
+  WiFiSupervisor();
+
+  // Load the cached access point and start connecting; returns immediately
+  void begin(const char* ssid, const char* password);
+  // Use a fixed address instead of DHCP
+  void setStaticIP(IPAddress ip, IPAddress gateway, IPAddress subnet, IPAddress dns);
+  // Re-apply the last DHCP lease as a static config on fast reconnects
+  void setReuseLease(bool enabled) { reuseLease = enabled; }
+  // Called on the loop task every time an IP address is obtained
+  void onConnected(WiFiConnectedCallback callback) { connectedCallback = callback; }
+
+  // Process pending WiFi events and timeouts (scheduler task)
+  void poll();
+
+  bool connected() const { return current == WIFI_STATE_CONNECTED; }
+  WiFiSupervisorState state() const { return current; }
+  const char* stateName() const;
+  const WiFiSupervisorStats& stats() const { return counters; }
+
+private:
+  // Persisted in NVS ("wifi"/"ap"); version guards against layout changes
+  struct CachedAccessPoint {
+    uint8_t version;
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint32_t ip;
+    uint32_t gateway;
+    uint32_t subnet;
+    uint32_t dns;
+  };
+
+  static const uint8_t CACHE_VERSION = 1;
+  static const uint32_t EVENT_CONNECTED = 1UL << 0;
+  static const uint32_t EVENT_GOT_IP = 1UL << 1;
+  static const uint32_t EVENT_DISCONNECTED = 1UL << 2;
+
+  const char* ssid;
+  const char* password;
+  WiFiSupervisorState current;
+  WiFiConnectedCallback connectedCallback;
+
+  CachedAccessPoint cache;
+  bool cacheValid;
+  bool reuseLease;
+  bool useStaticIP;
+  IPAddress staticIP, staticGateway, staticSubnet, staticDns;
+
+  bool fastAttempt;
+  bool skipFastPath;   // Cached BSSID/channel just failed; scan next time
+  uint8_t consecutiveFailures;
+  uint8_t missedProbes;  // Directed attempts in a row that found no AP
+  unsigned long attemptStart;
+  unsigned long retryAt;
+
+  // Written by the WiFi event task
+  volatile uint32_t pendingEvents;
+  volatile unsigned long associatedAt;
+  volatile unsigned long gotIpAt;
+  volatile uint8_t disconnectReason;
+
+  WiFiSupervisorStats counters;
+
+  static void handleEvent(arduino_event_t* event);
+
+  void startAttempt();
+  void fail(uint8_t reason);
+  void saveCache();
+};
+
+extern WiFiSupervisor wifiSupervisor;
+
+#endif